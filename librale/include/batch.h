@@ -0,0 +1,129 @@
+/*-------------------------------------------------------------------------
+ *
+ * batch.h
+ *		Group commit for writes accepted by the leader
+ *
+ * Writers queue their key-value pair and wait.  Whichever writer finds no
+ * commit round in flight runs the next one for everybody queued: one call
+ * to the commit function, which applies the entries, appends them to
+ * rale.db under one flush (and one fdatasync) and sends each follower one
+ * frame.  Writers arriving meanwhile accumulate for the round after.
+ *
+ * A batch closes when it reaches write_batch_max_entries or
+ * write_batch_max_bytes.  An idle leader commits a lone write at once; only
+ * when the previous round carried several writers does the next one wait,
+ * up to write_batch_max_delay_us, for as many writes to join.  A group
+ * queued by batch_submit_group() is one writer.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BATCH_SIZE_BUCKETS		12		/* [0] one entry, [i] <= 2^i entries */
+#define BATCH_WAIT_BUCKETS		20		/* [0] < 1us, [i] < 2^i us */
+
+/* What a queued write does; lease.h describes leases */
+typedef enum batch_op
+{
+	BATCH_OP_PUT = 0,			/* Store key, attached to lease if non-zero */
+	BATCH_OP_LEASE_GRANT,		/* New lease of ttl seconds, named by its revision */
+	BATCH_OP_LEASE_REVOKE,		/* Drop lease and every key attached to it */
+	BATCH_OP_LEASE_EXPIRE		/* The same, unless it was renewed meanwhile */
+} batch_op_t;
+
+/* A queued write; lives on the waiting writer's stack */
+typedef struct batch_entry
+{
+	struct batch_entry *next;
+	batch_op_t			op;
+	const char		   *key;
+	const char		   *value;
+	const char		   *expected;	/* Compare-and-swap: NULL if the key must be absent */
+	int					cas;		/* Apply only if the key still holds expected */
+	uint64_t			lease;
+	int					ttl;
+	size_t				bytes;
+	uint64_t			trace_id;	/* Writer's trace, 0 if not sampled */
+	uint64_t			queued_us;
+	int					joined;		/* Queued by the same call as the entry before */
+	int					result;		/* Set by the commit function */
+	uint64_t			revision;	/* Set by the commit function: its replication index */
+	int					done;
+} batch_entry_t;
+
+/* Result of a compare-and-swap whose key no longer held the expected value */
+#define BATCH_CAS_FAILED		1
+
+/* Result of a lease operation, or a leased PUT, naming no live lease */
+#define BATCH_LEASE_NOT_FOUND	2
+
+/* Commit count entries linked by next, setting each one's result */
+typedef void (*batch_commit_fn) (batch_entry_t *entries, int count);
+
+typedef struct batch_stats
+{
+	uint64_t			batches;
+	uint64_t			entries;
+	uint64_t			bytes;
+	uint64_t			closed_entries;	/* Batch full by write_batch_max_entries */
+	uint64_t			closed_bytes;	/* Batch full by write_batch_max_bytes */
+	uint64_t			closed_delay;	/* write_batch_max_delay_us ran out */
+	uint64_t			max_size;
+	uint64_t			max_wait_us;
+	uint64_t			wait_total_us;
+	uint64_t			size_histogram[BATCH_SIZE_BUCKETS];
+	uint64_t			wait_histogram[BATCH_WAIT_BUCKETS];	/* Queue to commit start */
+} batch_stats_t;
+
+extern void batch_init(batch_commit_fn commit);
+
+/*
+ * Queue one write and return once a round has committed it: the result
+ * the commit function gave it, or -1 if the batcher is not running.  The
+ * revision it was committed at goes to *revision unless that is NULL.
+ */
+extern int batch_submit(const char *key, const char *value, uint64_t *revision);
+
+/*
+ * Like batch_submit(), but the commit function stores value only if key
+ * then holds expected (is absent, for a NULL expected), and returns
+ * BATCH_CAS_FAILED otherwise.  Entries of one round are compared in queue
+ * order, so each sees the writes queued before it.
+ */
+extern int batch_submit_cas(const char *key, const char *expected, const char *value,
+							uint64_t *revision);
+
+/* Like batch_submit(), but the key lives only as long as lease does */
+extern int batch_submit_leased(const char *key, const char *value, uint64_t lease,
+							   uint64_t *revision);
+
+/*
+ * Queue a lease grant, revocation or expiry.  A grant's revision is the
+ * new lease's id; lease and ttl are ignored where they do not apply.
+ */
+extern int batch_submit_lease(batch_op_t op, uint64_t lease, int ttl, uint64_t *revision);
+
+/*
+ * Queue count entries, filled in as for the calls above, as one group:
+ * they join the commit queue together and in order, and this returns once
+ * all of them are committed, with each one's result and revision set.
+ */
+extern void batch_submit_group(batch_entry_t *entries, int count);
+
+extern void batch_get_stats(batch_stats_t *stats);
+
+/* Upper bound of the bucket holding the given percentile */
+extern uint64_t batch_size_percentile(const batch_stats_t *stats, int percent);
+extern uint64_t batch_wait_percentile(const batch_stats_t *stats, int percent);
+
+/* Stop accepting writes once the round in flight, if any, has finished */
+extern void batch_finit(void);
+
+#endif							/* BATCH_H */
@@ -0,0 +1,63 @@
+/*-------------------------------------------------------------------------
+ *
+ * bloom.h
+ *		Counting Bloom filter over the keys of a hash table
+ *
+ * Lets hash_get() turn away most lookups of absent keys before it takes the
+ * table mutex or walks a chain.  Counters instead of bits make deletes
+ * possible; a counter that reaches its maximum stays there, so the filter
+ * can answer "maybe" wrongly but never "absent" wrongly.
+ *
+ * Keys are given by their 64-bit hash_key(), which the table computes
+ * anyway.  The filter is blocked: a key's BLOOM_HASHES counters all lie in
+ * one 64-counter block, so a check reads a single cache line.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOOM_COUNTERS_PER_KEY	10		/* About 2% false positives at capacity */
+#define BLOOM_HASHES			7
+#define BLOOM_BLOCK				64		/* Counters per block, one cache line */
+
+typedef struct bloom bloom_t;
+
+typedef struct bloom_stats
+{
+	uint64_t			capacity;	/* Keys the filter was sized for */
+	uint64_t			counters;
+	uint64_t			keys;		/* Keys currently added */
+	uint64_t			checks;		/* bloom_may_contain() calls */
+	uint64_t			negatives;	/* Answered "absent" */
+	uint64_t			false_positives; /* Answered "maybe" for an absent key */
+} bloom_stats_t;
+
+/* Sized for capacity keys; NULL if out of memory */
+extern bloom_t *bloom_create(uint64_t capacity);
+extern void bloom_destroy(bloom_t *filter);
+
+/* Writers serialize among themselves (the table mutex); checks need no lock */
+extern void bloom_add(bloom_t *filter, uint64_t hash);
+extern void bloom_remove(bloom_t *filter, uint64_t hash);
+extern void bloom_clear(bloom_t *filter);
+
+/* false only if hash was never added, or has been removed since */
+extern bool bloom_may_contain(bloom_t *filter, uint64_t hash);
+
+/* The caller found no key after bloom_may_contain() said maybe */
+extern void bloom_note_false_positive(bloom_t *filter);
+
+extern void bloom_get_stats(const bloom_t *filter, bloom_stats_t *stats);
+
+/* Share of absent-key checks the filter let through, 0 with none yet */
+extern double bloom_false_positive_rate(const bloom_stats_t *stats);
+
+#endif							/* BLOOM_H */
@@ -11,6 +11,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -67,14 +68,68 @@ typedef struct database_config
 	char				path[MAX_STRING_LENGTH];
 	uint32_t			max_size;
 	uint32_t			max_connections;
+	uint32_t			key_filter_capacity; /* Keys the lookup filter is sized for, 0 disables */
+	int					index_layout; /* hash_layout_t */
+	int					value_log;	/* Keep long values in the value log */
+	int					value_inline_max; /* Longest value kept in the index */
+	int					value_segment_mb; /* Value log segment size */
+	int					value_cache_mb; /* Value log page cache size */
+	int					value_gc_percent; /* Garbage share that triggers collection */
+	int					storage_engine; /* storage_engine_t */
+	int					lsm_memtable_mb; /* Memtable size before a flush */
+	int					lsm_sst_mb;	/* Compaction output file size */
+	int					lsm_level0_files; /* Level 0 files that start a compaction */
+	int					lsm_level_base_mb; /* Level 1 size; each level below is 10x */
 } database_config_t;
 
 typedef struct dstore_config
 {
 	uint32_t			keep_alive_interval;
 	uint32_t			keep_alive_timeout;
+	int					forward_writes; /* Followers proxy writes to the leader */
 } dstore_config_t;
 
+typedef struct watchdog_settings
+{
+	int					mode;		/* watchdog_mode_t */
+	char				device[MAX_STRING_LENGTH];
+	uint32_t			timeout;	/* Device timeout in seconds */
+	uint32_t			tick_budget_ms; /* Longest main-loop tick that feeds it */
+	int					test_mode;	/* device is a plain file stand-in */
+	int					soft_noboot; /* Simulate expiry, never reboot */
+} watchdog_settings_t;
+
+typedef struct affinity_settings
+{
+	char				consensus_cpus[MAX_STRING_LENGTH]; /* Main loop thread */
+	char				io_cpus[MAX_STRING_LENGTH]; /* REST and connection threads */
+} affinity_settings_t;
+
+typedef struct trace_settings
+{
+	uint32_t			sample_rate; /* Trace 1 in N requests, 0 disables */
+} trace_settings_t;
+
+typedef struct wal_settings
+{
+	int					backend;	/* wal_backend_t */
+	int					sync;		/* fdatasync every rale.db flush */
+} wal_settings_t;
+
+typedef struct write_batch_settings
+{
+	int					max_entries; /* Writes per group commit */
+	int					max_bytes;	/* Key and value bytes per group commit */
+	int					max_delay_us; /* Longest wait for a batch to fill */
+} write_batch_settings_t;
+
+typedef struct rest_settings
+{
+	int					port;		/* REST API port, 0 disables the server */
+	char				bind_address[MAX_STRING_LENGTH];
+	int					acceptors;	/* SO_REUSEPORT listeners */
+} rest_settings_t;
+
 typedef struct config_t
 {
 	database_config_t	db;
@@ -83,7 +138,36 @@ typedef struct config_t
 	log_config_t		dstore_log;
 	dstore_config_t		dstore;
 	communication_config_t communication;
+	watchdog_settings_t	watchdog;
+	affinity_settings_t	affinity;
+	trace_settings_t	trace;
+	wal_settings_t		wal;
+	write_batch_settings_t write_batch;
+	rest_settings_t		rest;
 	char				log_directory[MAX_LONG_STRING_LENGTH];
 } config_t;
 
+/*
+ * Published configuration snapshot (config.c).  config_current() pins the
+ * snapshot, or returns NULL before the first config_publish(); either way
+ * it must be paired with config_release(), after which the snapshot may be
+ * freed.  Pins nest and never block.
+ */
+extern const config_t *config_current(void);
+extern void config_release(void);
+
+/*
+ * Handle to a 32-bit (int or uint32_t) setting: the field's offset in
+ * config_t, fixed when the handle is declared.  config_get_int() reads it
+ * from the published snapshot under a pin, or from fallback before the
+ * first publish.
+ */
+typedef size_t config_handle_t;
+
+#define CONFIG_HANDLE(field)	((config_handle_t) offsetof(config_t, field))
+
+extern int config_get_int(config_handle_t handle, const config_t *fallback);
+extern int config_publish(const config_t *config, char *errbuf, size_t errbuflen);
+extern void config_snapshot_cleanup(void);
+
 #endif							/* CONFIG_H */
@@ -13,13 +13,15 @@
 
 /** Local headers */
 #include "config.h"
+#include "engine.h"
 #include "hash.h"
 
 /** Database structure */
 typedef struct cluster_db_t
 {
 	char db_file[1024];
-	hash_table_t *hash_table;
+	const engine_ops_t *ops;
+	void *engine;
 } cluster_db_t;
 
 /** Function declarations */
@@ -32,5 +34,15 @@ int db_save(char *errbuf, size_t errbuflen);
 int db_load(char *errbuf, size_t errbuflen);
 int db_initialized(char *errbuf, size_t errbuflen);
 int db_insert(const char *key, const char *value, char *errbuf, size_t errbuflen);
+uint64_t db_change_count(void);
+int db_wait_for_change(uint64_t seen, int timeout_ms);
+int db_watch(const char *key, const char *seen, int timeout_ms, char *value, size_t value_size);
+int db_scan(uint32_t partition, uint32_t partitions, uint64_t *cursor,
+			hash_scan_cb cb, void *arg, char *errbuf, size_t errbuflen);
+void db_filter_stats(bloom_stats_t *stats);
+void db_value_log_stats(vlog_stats_t *stats);
+const char *db_engine_name(void);
+bool db_persistent(void);
+void db_lsm_stats(lsm_stats_t *stats);
 
 #endif /* DB_H */
@@ -27,9 +27,25 @@ extern int dstore_client_tick(void);
 
 extern void dstore_replicate_to_followers(const char *key, const char *value, char *errbuf, size_t errbuflen);
 extern void dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen);
+extern uint32_t dstore_get_replication(librale_replica_status_t *replicas, uint32_t max, uint64_t *last_index);
 extern int dstore_handle_put(const char *key, const char *value, char *errbuf, size_t errbuflen);
+extern int dstore_handle_cas(const char *key, const char *expected, const char *value,
+							 char *errbuf, size_t errbuflen);
 extern int dstore_send_message(uint32_t target_node_idx, const char *message);
 
+/** Leases, see lease.h; 0, BATCH_LEASE_NOT_FOUND or -1 */
+extern int dstore_put_leased(const char *key, const char *value, uint64_t lease,
+							 char *errbuf, size_t errbuflen);
+extern int dstore_put_batch(librale_put_t *puts, int count, char *errbuf, size_t errbuflen);
+extern int dstore_lease_grant(int ttl, uint64_t *lease, char *errbuf, size_t errbuflen);
+extern int dstore_lease_revoke(uint64_t lease, char *errbuf, size_t errbuflen);
+extern int dstore_lease_keepalive(uint64_t lease, int *ttl, char *errbuf, size_t errbuflen);
+
+/** Revisions: the replication index a write committed at */
+extern uint64_t dstore_write_revision(void);
+extern uint64_t dstore_applied_revision(void);
+extern int dstore_wait_revision(uint64_t revision, int timeout_ms);
+
 /** Propagation functions for automatic cluster management */
 extern int dstore_propagate_node_addition(int32_t new_node_id, const char *name,
 										const char *ip, uint16_t rale_port, uint16_t dstore_port);
@@ -38,6 +54,7 @@ extern int dstore_propagate_node_removal(int32_t node_id);
 /** Leader status helpers (exposed for status reporting) */
 int dstore_is_current_leader(void);
 int dstore_get_current_leader(void);
+void dstore_not_leader(char *buf, size_t buflen);
 
 /** Connectivity helper for status reporting */
 int dstore_is_node_connected(int32_t node_id);
@@ -0,0 +1,80 @@
+/*-------------------------------------------------------------------------
+ *
+ * engine.h
+ *		Storage engines behind db.c.
+ *
+ * db.c keeps one engine, chosen by storage_engine at db_init(), and calls
+ * it through an engine_ops_t.  The hash engine is the in-memory key index
+ * (hash.c, with its key filter and value log), filled from rale.db at
+ * startup.  The LSM engine (lsm.c) keeps its own files under
+ * <db.path>/lsm, so its data may be far larger than memory and survives a
+ * restart without rale.db.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Local headers */
+#include "config.h"
+#include "hash.h"
+#include "lsm.h"
+
+#define ENGINE_LSM_DIR		"lsm"
+
+typedef enum storage_engine
+{
+	STORAGE_ENGINE_HASH = 0,
+	STORAGE_ENGINE_LSM
+} storage_engine_t;
+
+/*
+ * get() returns 0 with the value copied, 1 if the key is absent and -1 on
+ * error.  A snapshot from snapshot() fixes what get() and iter_open() see;
+ * engines without snapshots leave snapshot NULL and read the latest data.
+ * iter_next() returns 1 with the next key and value (valid until the next
+ * call), 0 at the end and -1 on error; iterators visit keys in no
+ * particular order.  scan() follows hash_scan().
+ */
+typedef struct engine_ops
+{
+	const char		   *name;
+	bool				persistent;		/* Keeps its data without rale.db */
+	void			   *(*open) (const config_t *config, char *errbuf, size_t errbuflen);
+	void				(*close) (void *engine);
+	int					(*get) (void *engine, const void *snapshot, const char *key,
+								char *value, size_t value_size);
+	int					(*put) (void *engine, const char *key, const char *value,
+								char *errbuf, size_t errbuflen);
+	int					(*remove) (void *engine, const char *key, char *errbuf,
+								   size_t errbuflen);
+	void			   *(*snapshot) (void *engine);
+	void				(*release) (void *engine, void *snapshot);
+	void			   *(*iter_open) (void *engine, const void *snapshot);
+	int					(*iter_next) (void *iter, const char **key, const char **value);
+	void				(*iter_close) (void *iter);
+	int					(*scan) (void *engine, uint32_t partition, uint32_t partitions,
+								 uint64_t *cursor, hash_scan_cb cb, void *arg,
+								 char *errbuf, size_t errbuflen);
+	int					(*save) (void *engine, const char *filename, char *errbuf,
+								 size_t errbuflen);
+	int					(*load) (void *engine, const char *filename, char *errbuf,
+								 size_t errbuflen);
+} engine_ops_t;
+
+extern const engine_ops_t hash_engine_ops;	/* engine_hash.c */
+extern const engine_ops_t lsm_engine_ops;	/* engine_lsm.c */
+
+/* Internals of an engine of the matching kind, for statistics */
+extern hash_table_t *engine_hash_table(void *engine);
+extern vlog_t *engine_hash_value_log(void *engine);
+extern lsm_t *engine_lsm(void *engine);
+
+#endif							/* ENGINE_H */
@@ -16,18 +16,25 @@
 
 /** System headers */
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /** Local headers */
 #include "config.h"
+#include "bloom.h"
+#include "hash_swiss.h"
+#include "vlog.h"
 
 /** Hash table constants */
 #define HASH_SIZE		1024
 #define MAX_KEY_SIZE	255
 #define MAX_VALUE_SIZE	1024
 
+/** Value flags */
+#define HASH_VALUE_LOGGED	0x01	/* The value is a vlog.h reference */
+
 /** Hash table iteration macros */
 #define HASH_ITERATE(table, entry, bucket) \
 	for ((bucket) = 0; (bucket) < HASH_SIZE; (bucket)++) \
@@ -40,26 +47,53 @@
 /** Hash entry structure */
 typedef struct hash_entry_t
 {
-	char				key[MAX_KEY_SIZE];		/** Key string */
-	char				value[MAX_VALUE_SIZE];	/** Value string */
 	struct hash_entry_t  *next;					/** Next entry in chain */
+	uint64_t			hash;					/** hash_key() of the key */
+	uint32_t			key_len;				/** Key length, without the terminator */
+	uint8_t				flags;					/** HASH_VALUE_* */
+	uint32_t			value_cap;				/** Bytes allocated at value */
+	char			   *value;					/** Value or its vlog reference, sized to fit */
+	char				key[MAX_KEY_SIZE];		/** Key string */
 } hash_entry_t;
 
+/** Index layouts behind the same hash_* API */
+typedef enum hash_layout
+{
+	HASH_LAYOUT_CHAINED = 0,	/* HASH_SIZE buckets of linked entries */
+	HASH_LAYOUT_SWISS			/* Open addressing, see hash_swiss.h */
+} hash_layout_t;
+
 /** Hash table structure */
 typedef struct hash_table_t
 {
 	hash_entry_t		*entries[HASH_SIZE];		/** Array of entry pointers */
 	pthread_mutex_t	mutex;						/** Mutex for thread safety */
+	bloom_t			*filter;					/** Key filter, NULL if disabled */
+	hash_swiss_t	*swiss;						/** Used instead of entries if set */
+	vlog_t			*vlog;						/** Value log, NULL keeps values inline */
+	size_t			value_inline_max;			/** Longer values go to the value log */
 } hash_table_t;
 
+/** Scan callback; return non-zero to stop before the entry is consumed */
+typedef int (*hash_scan_cb) (const char *key, const char *value, void *arg);
+
 /** Function declarations */
-static inline unsigned int hash_func(const char *key);
+uint64_t hash_key(const char *key, size_t len);
+uint64_t hash_key_seeded(const char *key, size_t len, uint64_t seed);
 int hash_init(hash_table_t *table, char *errbuf, size_t errbuflen);
+int hash_init_layout(hash_table_t *table, hash_layout_t layout, char *errbuf, size_t errbuflen);
 int hash_destroy(hash_table_t *table, char *errbuf, size_t errbuflen);
 int hash_put(hash_table_t *table, const char *key, const char *value, char *errbuf, size_t errbuflen);
 int hash_get(hash_table_t *table, const char *key, char *value, size_t value_size, char *errbuf, size_t errbuflen);
 int hash_delete(hash_table_t *table, const char *key, char *errbuf, size_t errbuflen);
 int hash_save(hash_table_t *table, const char *filename, char *errbuf, size_t errbuflen);
 int hash_load(hash_table_t *table, const char *filename, char *errbuf, size_t errbuflen);
+int hash_scan(hash_table_t *table, uint32_t partition, uint32_t partitions, uint64_t *cursor,
+			  hash_scan_cb cb, void *arg, char *errbuf, size_t errbuflen);
+int hash_enable_filter(hash_table_t *table, uint64_t capacity, char *errbuf, size_t errbuflen);
+void hash_filter_stats(hash_table_t *table, bloom_stats_t *stats);
+int hash_enable_value_log(hash_table_t *table, vlog_t *vlog, size_t inline_max, int gc_percent,
+						  char *errbuf, size_t errbuflen);
+void hash_value_log_stats(hash_table_t *table, vlog_stats_t *stats);
 
 #endif							/* RALE_HASH_H */
@@ -0,0 +1,62 @@
+/*-------------------------------------------------------------------------
+ *
+ * hash_swiss.h
+ *		Open-addressing index behind the hash_* API
+ *
+ * Swiss-table layout: one control byte per slot holding 7 bits of the
+ * key's hash (or empty / deleted), probed 16 slots at a time with one SIMD
+ * compare (SSE2, NEON, or a byte loop elsewhere).  Slots point at records
+ * sized to their key and value, so a hit touches the control group, the
+ * slot and one record instead of a chain of entries.
+ *
+ * Not thread safe; hash.c calls it under the table mutex.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef HASH_SWISS_H
+#define HASH_SWISS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_SWISS_GROUP			16		/* Slots per control group */
+#define HASH_SWISS_INITIAL_SLOTS	1024
+
+typedef struct hash_swiss hash_swiss_t;
+
+/* Visit one record; non-zero stops the walk */
+typedef int (*hash_swiss_visit) (uint64_t hash, const char *key, const char *value,
+								 uint8_t flags, void *arg);
+
+extern hash_swiss_t *hash_swiss_create(void);
+extern void hash_swiss_destroy(hash_swiss_t *index);
+
+/*
+ * 1 if the key was added, 0 if its value was replaced, -1 out of memory.
+ * Values are at most a few KB (MAX_VALUE_SIZE); flags are stored alongside.
+ */
+extern int hash_swiss_put(hash_swiss_t *index, uint64_t hash, const char *key,
+						  size_t key_len, const char *value, uint8_t flags);
+
+/* The stored value, valid until the next put or delete; NULL if absent */
+extern const char *hash_swiss_get(hash_swiss_t *index, uint64_t hash,
+								  const char *key, size_t key_len, uint8_t *flags);
+
+/* 0 if the key was removed, -1 if absent */
+extern int hash_swiss_delete(hash_swiss_t *index, uint64_t hash,
+							 const char *key, size_t key_len);
+
+extern uint64_t hash_swiss_count(const hash_swiss_t *index);
+extern uint64_t hash_swiss_slots(const hash_swiss_t *index);
+
+/*
+ * Visit records in slot order from *slot up to end.  Returns 1 when end is
+ * reached, 0 when visit stopped the walk, with *slot at the refused record.
+ */
+extern int hash_swiss_walk(hash_swiss_t *index, uint64_t *slot, uint64_t end,
+						   hash_swiss_visit visit, void *arg);
+
+#endif							/* HASH_SWISS_H */
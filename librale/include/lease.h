@@ -0,0 +1,113 @@
+/*-------------------------------------------------------------------------
+ *
+ * lease.h
+ *		Leases: keys that live only as long as their holder keeps renewing
+ *
+ * A lease is granted with a TTL in seconds and named by the revision its
+ * grant committed at.  Any number of keys are attached to it by PUTs that
+ * carry the lease; one keepalive renews them all, and when the lease is
+ * revoked or runs out every attached key goes with it.  A PUT without a
+ * lease, or a delete, detaches the key.
+ *
+ * Every member keeps the same table: grants, leased PUTs and revocations
+ * are replicated writes like any other.  Keepalives are not: the leader
+ * renews in memory and ships the ids renewed since the last checkpoint,
+ * several hundred to a line, every LEASE_CHECKPOINT_MS.  Followers so know
+ * roughly when each lease runs out, and a new leader lets a lease expire
+ * on schedule instead of granting every one a fresh TTL, while holders
+ * that are alive get at least LEASE_FAILOVER_GRACE_MS to find it.
+ *
+ * Only the leader expires leases.  Leased keys are not written to rale.db,
+ * so a restart does not bring back keys whose holder is gone; a member
+ * that connects to the leader drops its table and receives the leader's
+ * with the catch-up snapshot instead.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEASE_MAX_TTL				(7 * 24 * 3600)	/* Seconds */
+#define LEASE_CHECKPOINT_MS			500
+#define LEASE_FAILOVER_GRACE_MS		3000
+#define LEASE_LINE_MAX				900		/* Bytes per LEASE_RENEW line */
+#define LEASE_RENEW_PREFIX			"LEASE_RENEW "
+
+/* Called for each key a revocation removes, with the lease table locked */
+typedef void (*lease_key_cb) (const char *key, void *arg);
+
+/* Called by lease_snapshot() for each lease (key NULL) and each attached key */
+typedef void (*lease_visit_cb) (uint64_t id, int ttl, const char *key, void *arg);
+
+/* Milliseconds on a monotonic clock */
+typedef uint64_t (*lease_clock_fn) (void);
+
+typedef struct lease_stats
+{
+	uint64_t			leases;		/* Live leases */
+	uint64_t			keys;		/* Keys attached to them */
+	uint64_t			granted;
+	uint64_t			revoked;	/* Including expired ones */
+	uint64_t			expired;	/* Run out on this node as leader */
+	uint64_t			keepalives;	/* Renewals on this node as leader */
+	uint64_t			checkpoints;	/* LEASE_RENEW lines sent or applied */
+} lease_stats_t;
+
+/* Install a lease; granting an existing id only updates its TTL */
+extern int	lease_grant(uint64_t id, int ttl);
+extern bool lease_exists(uint64_t id);
+
+/* Attach key to lease id, detaching it from any other; -1 if id is unknown */
+extern int	lease_attach(const char *key, uint64_t id);
+
+/* The key was overwritten without a lease or deleted */
+extern void lease_detach(const char *key);
+
+/* The key is attached to a lease */
+extern bool lease_key_attached(const char *key);
+
+/*
+ * Drop lease id, calling cb for each attached key.  With only_expired, a
+ * lease renewed since it was found expired is kept.  Returns the number of
+ * keys, or -1 if there is no such (expired) lease.
+ */
+extern int	lease_revoke(uint64_t id, bool only_expired, lease_key_cb cb, void *arg);
+
+/* Leader: renew lease id; its TTL, or -1 if it is unknown or has run out */
+extern int	lease_keepalive(uint64_t id);
+
+/* Follower: apply a "LEASE_RENEW <id>..." checkpoint line's ids */
+extern void lease_apply_renewals(const char *ids);
+
+/*
+ * Leader: "LEASE_RENEW <id>..." lines, newline-separated, for the leases
+ * renewed since the last call; NULL if there were none.  Free the result.
+ */
+extern char *lease_take_renewals(void);
+
+/*
+ * Up to max leases past their deadline, into ids.  is_leader says whether
+ * this node leads now; on the call where it first does, every lease gets
+ * the failover grace and none is reported.
+ */
+extern int	lease_expired(bool is_leader, uint64_t *ids, int max);
+
+/* Visit every lease, each followed by its keys, with the table locked */
+extern void lease_snapshot(lease_visit_cb cb, void *arg);
+
+extern void lease_get_stats(lease_stats_t *stats);
+
+/* Forget every lease, calling cb (if any) for each attached key */
+extern void lease_reset(lease_key_cb cb, void *arg);
+
+/* Replace CLOCK_MONOTONIC for deadlines (tests); NULL restores it */
+extern void lease_set_clock(lease_clock_fn clock);
+
+#endif							/* LEASE_H */
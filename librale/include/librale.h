@@ -24,6 +24,56 @@ typedef enum librale_status
 typedef struct librale_config_t librale_config_t;
 typedef struct librale_node_t librale_node_t;
 
+/* Copy of one cluster member's addressing, safe to use outside librale */
+typedef struct librale_node_info
+{
+	int32_t		id;
+	char		name[256];
+	char		ip[64];
+	uint16_t	rale_port;
+	uint16_t	dstore_port;
+} librale_node_info_t;
+
+/* Consensus state of the local node */
+typedef struct librale_rale_status
+{
+	int32_t		role;
+	int32_t		term;
+	int32_t		leader_id;
+	int32_t		last_log_index;
+	int32_t		commit_index;
+	int32_t		last_applied;
+} librale_rale_status_t;
+
+/*
+ * Leader's view of one follower's replication progress.  Indexes count
+ * entries replicated by this leader since it started.
+ */
+typedef struct librale_replica_status
+{
+	int32_t		node_id;
+	bool		connected;
+	uint64_t	sent_index;			/* Last entry sent */
+	uint64_t	match_index;		/* Highest entry the follower acknowledged */
+	uint64_t	lag_entries;		/* Entries replicated but not acknowledged */
+	uint64_t	lag_ms;				/* Age of the oldest unacknowledged entry */
+	uint64_t	entries_in_flight;	/* Sent but not acknowledged */
+	uint64_t	bytes_in_flight;
+	int64_t		last_ack_age_ms;	/* -1 before the first acknowledgement */
+	uint64_t	rtt_ewma_us;		/* Send-to-ack time, smoothed */
+	uint64_t	gap_index;			/* First entry missing below an acknowledged one, 0 if none */
+} librale_replica_status_t;
+
+/* One write of librale_dstore_put_batch() */
+typedef struct librale_put
+{
+	const char *key;
+	const char *value;
+	uint64_t	lease;				/* Attach to this lease, 0 for none */
+	int			result;				/* Set as librale_dstore_put_leased() returns */
+	uint64_t	revision;			/* Set once committed */
+} librale_put_t;
+
 extern librale_config_t *librale_config_create(void);
 extern void librale_config_destroy(librale_config_t *config);
 extern librale_status_t librale_config_set_node_id(librale_config_t *config, int32_t node_id);
@@ -35,6 +85,20 @@ extern librale_status_t librale_config_set_db_path(librale_config_t *config, con
 extern librale_status_t librale_config_set_log_directory(librale_config_t *config, const char *path);
 extern librale_status_t librale_config_set_config(librale_config_t *dest, const void *src);
 
+/*
+ * Publish config as the snapshot librale threads read reloadable settings
+ * (keep-alive interval and timeout) from.  Readers never block; the swap is
+ * atomic, so they see either the previous snapshot or this one.
+ */
+extern librale_status_t librale_config_publish(const librale_config_t *config);
+
+/*
+ * Pin the most recently published snapshot (NULL before the first publish)
+ * until librale_config_release(); a later publish frees it only after that.
+ */
+extern const librale_config_t *librale_config_current(void);
+extern void librale_config_release(void);
+
 extern int32_t librale_config_get_node_id(const librale_config_t *config);
 extern const char *librale_config_get_node_name(const librale_config_t *config);
 extern const char *librale_config_get_node_ip(const librale_config_t *config);
@@ -57,17 +121,82 @@ extern librale_status_t librale_rale_tick(void);
 
 extern void librale_dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen);
 extern void librale_dstore_replicate_to_followers(const char *key, const char *value, char *errbuf, size_t errbuflen);
+/* Fills up to max followers; returns the number filled */
+extern uint32_t librale_dstore_get_replication(librale_replica_status_t *replicas, uint32_t max,
+											   uint64_t *last_index);
+
+/*
+ * Compare-and-swap on the leader: store value only if key holds expected
+ * (is absent, for a NULL expected).  Returns 0 once stored, 1 if the key
+ * held something else, -1 with errbuf set on error ("NOT_LEADER <id> <ip>
+ * <term>" on a follower).
+ */
+extern int librale_dstore_cas(const char *key, const char *expected, const char *value,
+							  char *errbuf, size_t errbuflen);
+
+/*
+ * Revisions order writes: a PUT or CAS committed on the leader returns the
+ * replication index it got, and a node that has applied revision n has
+ * applied every write up to it.  librale_dstore_write_revision() is that of
+ * the calling thread's last write, 0 if it did not commit on this node.
+ */
+extern uint64_t librale_dstore_write_revision(void);
+extern uint64_t librale_dstore_applied_revision(void);
+
+/* Wait up to timeout_ms for revision to be applied here; 0 once it is, 1 on timeout */
+extern int librale_dstore_wait_revision(uint64_t revision, int timeout_ms);
+
+/*
+ * Leases on the leader.  A lease is granted for ttl seconds and named by
+ * the revision of its grant; keys stored with it are removed, all in one
+ * replicated write, when it is revoked or no keepalive renews it in time.
+ * The lease functions and put_leased return 0, 1 if the lease does not
+ * exist (or has run out), and -1 with errbuf set on error, "NOT_LEADER
+ * <id> <ip> <term>" on a follower.
+ */
+extern int librale_dstore_lease_grant(int ttl, uint64_t *lease, char *errbuf, size_t errbuflen);
+extern int librale_dstore_lease_revoke(uint64_t lease, char *errbuf, size_t errbuflen);
+extern int librale_dstore_lease_keepalive(uint64_t lease, int *ttl, char *errbuf, size_t errbuflen);
+extern int librale_dstore_put_leased(const char *key, const char *value, uint64_t lease,
+									 char *errbuf, size_t errbuflen);
+
+/*
+ * Commit count writes on the leader as one group commit, in order, and
+ * set each one's result and revision.  Returns 0 once they are done, or
+ * -1 with errbuf set if none was attempted ("NOT_LEADER <id> <ip> <term>"
+ * on a follower).
+ */
+extern int librale_dstore_put_batch(librale_put_t *puts, int count,
+									char *errbuf, size_t errbuflen);
 
 extern librale_status_t librale_db_get(const char *key, char *value, size_t value_size, char *errbuf, size_t errbuflen);
 
+/*
+ * Block up to timeout_ms until key differs from seen (NULL: absent).
+ * Returns 0 with the new value, 1 if the key is now absent, 2 on timeout
+ * and -1 for bad arguments.
+ */
+extern int librale_db_watch(const char *key, const char *seen, int timeout_ms,
+							char *value, size_t value_size);
+
+/* Resumable partitioned scan; callback returns non-zero to stop before the entry */
+typedef int (*librale_db_scan_cb) (const char *key, const char *value, void *arg);
+extern librale_status_t librale_db_scan(uint32_t partition, uint32_t partitions, uint64_t *cursor,
+										librale_db_scan_cb cb, void *arg, bool *complete,
+										char *errbuf, size_t errbuflen);
+
 extern uint32_t librale_cluster_get_node_count(void);
 extern librale_status_t librale_cluster_get_node(int32_t node_id, librale_node_t *node);
+extern librale_status_t librale_cluster_get_node_info(uint32_t index, librale_node_info_t *info);
 extern int32_t librale_cluster_get_self_id(void);
 extern librale_status_t librale_cluster_set_state_file(const char *path);
 
 extern librale_status_t librale_rale_init(const librale_config_t *config);
 extern librale_status_t librale_rale_finit(void);
+/* On shutdown: flush the WAL and, as leader, make a follower take over */
+extern librale_status_t librale_rale_hand_off(void);
 extern int32_t librale_get_current_role(void);
+extern librale_status_t librale_get_rale_status(librale_rale_status_t *status);
 
 /* Logging is handled by raled daemon, not librale */
 
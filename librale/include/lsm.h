@@ -0,0 +1,163 @@
+/*-------------------------------------------------------------------------
+ *
+ * lsm.h
+ *		Log-structured merge tree storage engine
+ *
+ * Writes go to a log file and a sorted in-memory table (the memtable).  A
+ * full memtable is written out as a sorted table file (SST) in level 0;
+ * a background thread merges level 0 into level 1 and each level into the
+ * next once it outgrows its budget, ten times that of the level above.
+ * Levels 1 and up hold SSTs with disjoint key ranges, so a lookup reads at
+ * most one file per level, and each file's Bloom filter turns most of
+ * those reads away.
+ *
+ * Every write gets a sequence number.  Readers work on a version, a
+ * reference-counted set of memtables and SSTs, at a snapshot sequence;
+ * compaction keeps the older entries a live snapshot can still see.
+ *
+ * Files live in <db.path>/lsm: NNNNNN.log, NNNNNN.sst and MANIFEST, the
+ * list of live SSTs, replaced atomically after each flush or compaction.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef LSM_H
+#define LSM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LSM_LEVELS			7
+#define LSM_BLOCK_SIZE		4096	/* Target data block size */
+#define LSM_ENTRY_HEADER	12		/* u16 key length, u16 value length, u64 seq/type */
+#define LSM_FILTER_BITS		10		/* Per key, about 1% false positives */
+#define LSM_FILTER_HASHES	7
+#define LSM_HASH_SEED		UINT64_C(0x6c736d2066696c74)	/* Stored filters need a fixed seed */
+
+#define LSM_TYPE_DELETE		0
+#define LSM_TYPE_VALUE		1
+
+#define LSM_MAX_SEQ			(UINT64_MAX >> 8)
+
+typedef struct lsm_stats
+{
+	uint64_t			memtable_bytes;
+	uint64_t			level_files[LSM_LEVELS];
+	uint64_t			level_bytes[LSM_LEVELS];
+	uint64_t			flushes;
+	uint64_t			compactions;
+	uint64_t			user_bytes;		/* Key and value bytes written by clients */
+	uint64_t			flush_bytes;	/* SST bytes written by flushes */
+	uint64_t			compaction_read_bytes;
+	uint64_t			compaction_write_bytes;
+	uint64_t			stalls;			/* Writes that waited for a flush */
+	uint64_t			filter_checks;
+	uint64_t			filter_negatives;
+} lsm_stats_t;
+
+/* One entry as stored: user key, newest sequence first among equal keys */
+typedef struct lsm_entry
+{
+	const char		   *key;
+	const char		   *value;
+	uint16_t			key_len;
+	uint16_t			value_len;
+	uint64_t			seq;
+	uint8_t				type;
+} lsm_entry_t;
+
+/* An open SST, shared by every version that lists it */
+typedef struct lsm_sst
+{
+	_Atomic int			refs;
+	_Atomic bool		obsolete;	/* Unlink when the last reference goes */
+	uint64_t			number;
+	char				path[1100];
+	int					fd;
+	uint64_t			file_size;
+	uint64_t			entries;
+	char			   *smallest;	/* User keys, NUL-terminated */
+	char			   *largest;
+	uint32_t			blocks;
+	uint64_t		   *block_offset;
+	uint32_t		   *block_size;
+	char			  **block_last;	/* Last user key of each block */
+	uint8_t			   *filter;
+	uint64_t			filter_bits;
+} lsm_sst_t;
+
+typedef struct lsm_sst_iter
+{
+	lsm_sst_t		   *sst;
+	uint32_t			block;		/* Block in buf */
+	uint32_t			pos;		/* Offset of the current entry in buf */
+	uint32_t			size;
+	bool				valid;
+	lsm_entry_t			entry;
+	char				buf[LSM_BLOCK_SIZE];
+} lsm_sst_iter_t;
+
+typedef struct lsm_sst_writer lsm_sst_writer_t;
+
+typedef struct lsm_options
+{
+	uint64_t			memtable_bytes;		/* Switch memtables at this size */
+	uint64_t			sst_bytes;			/* Compaction output file size */
+	uint64_t			level_base_bytes;	/* Level 1 budget */
+	int					level0_files;		/* Level 0 files that start a compaction */
+	int					sync;				/* fdatasync the log on every write */
+} lsm_options_t;
+
+typedef struct lsm lsm_t;
+typedef struct lsm_snapshot lsm_snapshot_t;
+typedef struct lsm_iter lsm_iter_t;
+
+/* Order of (key, seq): keys ascending, then sequences descending */
+extern int lsm_entry_compare(const char *a, size_t a_len, uint64_t a_seq,
+							 const char *b, size_t b_len, uint64_t b_seq);
+
+/* Engine (lsm.c) */
+extern lsm_t *lsm_open(const char *dir, const lsm_options_t *options, char *errbuf,
+					   size_t errbuflen);
+extern void lsm_close(lsm_t *lsm);
+extern int	lsm_put(lsm_t *lsm, const char *key, size_t key_len, const char *value,
+					size_t value_len, char *errbuf, size_t errbuflen);
+extern int	lsm_delete(lsm_t *lsm, const char *key, size_t key_len, char *errbuf,
+					   size_t errbuflen);
+extern int	lsm_get(lsm_t *lsm, const lsm_snapshot_t *snapshot, const char *key,
+					size_t key_len, char *value, size_t value_size);
+extern lsm_snapshot_t *lsm_snapshot_acquire(lsm_t *lsm);
+extern void lsm_snapshot_release(lsm_t *lsm, lsm_snapshot_t *snapshot);
+extern lsm_iter_t *lsm_iter_open(lsm_t *lsm, const lsm_snapshot_t *snapshot);
+extern bool lsm_iter_valid(const lsm_iter_t *iter);
+extern const char *lsm_iter_key(const lsm_iter_t *iter);
+extern const char *lsm_iter_value(const lsm_iter_t *iter);
+extern void lsm_iter_next(lsm_iter_t *iter);
+extern void lsm_iter_close(lsm_iter_t *iter);
+extern void lsm_get_stats(lsm_t *lsm, lsm_stats_t *stats);
+
+/* SST files (lsm_sst.c) */
+extern lsm_sst_writer_t *lsm_sst_create(const char *path, uint64_t expected_entries,
+										char *errbuf, size_t errbuflen);
+extern int	lsm_sst_add(lsm_sst_writer_t *writer, const lsm_entry_t *entry);
+extern uint64_t lsm_sst_writer_bytes(const lsm_sst_writer_t *writer);
+extern uint64_t lsm_sst_writer_entries(const lsm_sst_writer_t *writer);
+extern int	lsm_sst_finish(lsm_sst_writer_t *writer, char *errbuf, size_t errbuflen);
+extern void lsm_sst_abort(lsm_sst_writer_t *writer);
+
+extern lsm_sst_t *lsm_sst_open(const char *path, uint64_t number, char *errbuf,
+							   size_t errbuflen);
+extern void lsm_sst_ref(lsm_sst_t *sst);
+extern void lsm_sst_unref(lsm_sst_t *sst);
+extern bool lsm_sst_may_contain(const lsm_sst_t *sst, uint64_t hash);
+
+extern void lsm_sst_iter_init(lsm_sst_iter_t *iter, lsm_sst_t *sst);
+extern void lsm_sst_iter_first(lsm_sst_iter_t *iter);
+extern void lsm_sst_iter_seek(lsm_sst_iter_t *iter, const char *key, size_t key_len);
+extern void lsm_sst_iter_next(lsm_sst_iter_t *iter);
+
+#endif							/* LSM_H */
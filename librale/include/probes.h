@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------
+ *
+ * probes.h
+ *		USDT static probe points
+ *
+ * With ENABLE_USDT_PROBES (configure finds <sys/sdt.h>) each probe is a
+ * single nop plus an ELF note, so it costs nothing until a tracer attaches,
+ * e.g.
+ *
+ *		bpftrace -e 'usdt:./raled:rale:command__start { @s[tid] = nsecs; }
+ *			usdt:./raled:rale:command__done /@s[tid]/ {
+ *				@us = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+ *
+ * Without it the probes compile to nothing and their arguments are not
+ * evaluated.
+ *
+ * Provider "rale":
+ *
+ *	command__start(const char *command)
+ *	command__done(const char *command, int status)
+ *	hash__put__start(const char *key)
+ *	hash__put__done(const char *key, int result)
+ *	hash__get__start(const char *key)
+ *	hash__get__done(const char *key, int result)
+ *	replication__send(int node_id, const char *frame, int result)
+ *	replication__receive(const char *frame)
+ *	election__start(int term)
+ *	election__won(int term, int votes)
+ *	election__lost(int term)
+ *	heartbeat__send(int term)
+ *	heartbeat__receive(int leader_id, int term)
+ *	connection__accept(int fd, int slot)
+ *	connection__close(int fd, int slot)
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef ENABLE_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define RALE_PROBE1(name, a)			DTRACE_PROBE1(rale, name, a)
+#define RALE_PROBE2(name, a, b)			DTRACE_PROBE2(rale, name, a, b)
+#define RALE_PROBE3(name, a, b, c)		DTRACE_PROBE3(rale, name, a, b, c)
+
+#else
+
+#define RALE_PROBE1(name, a)			((void) 0)
+#define RALE_PROBE2(name, a, b)			((void) 0)
+#define RALE_PROBE3(name, a, b, c)		((void) 0)
+
+#endif							/* ENABLE_USDT_PROBES */
+
+#endif							/* PROBES_H */
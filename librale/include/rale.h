@@ -47,4 +47,7 @@ int rale_process_command(const char *command, char *response, size_t response_si
 int rale_get_status(char *status, size_t status_size);
 int rale_quram_process(void);
 
+struct watchdog_context_t;
+void rale_set_watchdog(const struct watchdog_context_t *watchdog);
+
 #endif /* RALE_H */
@@ -0,0 +1,164 @@
+/*-------------------------------------------------------------------------
+ *
+ * rale_client.h
+ *		Non-blocking client for the RALE key-value store
+ *
+ * A client keeps one keep-alive HTTP connection to the REST API of every
+ * member it is given and pipelines requests on it: submitting never
+ * blocks, and replies are matched to requests in order.  Writes go to the
+ * leader, found by asking every member for STATUS and cached until a
+ * member answers NOT_LEADER or the leader's connection drops.  NOT_LEADER
+ * names the current leader, so the request is resent straight there.
+ * Reads go to the leader too, or to any member with read_any.
+ *
+ * Everything happens in rale_client_process(), on the caller's thread.
+ * rale_client_fd() is an epoll descriptor that turns readable whenever
+ * there is work for it (a reply, a writable socket, a due timer), so an
+ * application with its own event loop adds it there and calls
+ * rale_client_process(client, 0) when it fires.  A client is not safe for
+ * concurrent use; give each thread its own.
+ *
+ * A submitted request comes back as a future.  Its callback, if any, runs
+ * inside rale_client_process() once the request completes; without one,
+ * poll rale_future_status() or block in rale_future_wait().  The caller
+ * releases every future it got, at any time: releasing a pending one
+ * drops its callback but not the request.
+ *
+ * Every write returns the revision it committed at, and the client keeps
+ * the newest revision its session has seen.  GETs carry it as min_rev, so
+ * a member serves them only once it has caught up that far; with read_any
+ * a session still reads its own writes, and a read that a lagging member
+ * cannot serve in time is sent to the leader instead.
+ *
+ * A lease keeps keys alive only while its holder does: grant one, store
+ * any number of keys with rale_client_put_leased(), and renew them all
+ * with one rale_client_lease_keepalive() well within the TTL, say every
+ * third of it.  Once it runs out or is revoked, every one of its keys is
+ * removed.
+ *
+ * A watch holds a long poll (WATCH) on a connection of its own and calls
+ * back whenever the key's value differs from the one last reported.  It
+ * reports states, not every write: two quick writes may be seen as one.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RALE_CLIENT_H
+#define RALE_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RALE_CLIENT_MAX_MEMBERS		16
+#define RALE_CLIENT_DEFAULT_PORT	8080
+
+typedef enum rale_client_status
+{
+	RALE_CLIENT_OK = 0,
+	RALE_CLIENT_PENDING,		/* Not completed yet */
+	RALE_CLIENT_NOT_FOUND,		/* The key, or the lease, is absent */
+	RALE_CLIENT_CAS_FAILED,		/* The key held something other than expected */
+	RALE_CLIENT_TIMEOUT,		/* No reply within request_timeout_ms */
+	RALE_CLIENT_UNAVAILABLE,	/* No leader or member reachable, or the
+								 * connection dropped under a write */
+	RALE_CLIENT_ERROR			/* Refused by the server */
+} rale_client_status_t;
+
+typedef struct rale_client rale_client_t;
+typedef struct rale_future rale_future_t;
+
+typedef void (*rale_client_cb) (rale_future_t *future, void *arg);
+
+/* value is NULL with RALE_CLIENT_NOT_FOUND, once the key has been removed */
+typedef void (*rale_watch_cb) (const char *key, rale_client_status_t status,
+							   const char *value, void *arg);
+
+/* Zero fields take the defaults */
+typedef struct rale_client_options
+{
+	int					request_timeout_ms;	/* Default 5000 */
+	int					max_redirects;		/* Resends after NOT_LEADER; default 3 */
+	int					reconnect_ms;		/* Wait before reconnecting; default 200 */
+	bool				read_any;			/* Spread GETs over all members */
+} rale_client_options_t;
+
+/*
+ * members are "host:port" of each member's REST API (port defaults to
+ * RALE_CLIENT_DEFAULT_PORT).  Names are resolved here, once; connections
+ * are made in the background.  options may be NULL.
+ */
+extern rale_client_t *rale_client_create(const char *const *members, int count,
+										 const rale_client_options_t *options,
+										 char *errbuf, size_t errbuflen);
+
+/* Pending futures complete as RALE_CLIENT_UNAVAILABLE; not from a callback */
+extern void rale_client_destroy(rale_client_t *client);
+
+extern int rale_client_fd(const rale_client_t *client);
+
+/*
+ * Wait up to timeout_ms (0: not at all, -1: indefinitely) for events and
+ * handle them, running callbacks.  Returns the number of requests that
+ * completed, or -1 if the wait itself failed.
+ */
+extern int rale_client_process(rale_client_t *client, int timeout_ms);
+
+/* Node id of the cached leader, -1 if none is known */
+extern int32_t rale_client_leader(const rale_client_t *client);
+
+/* These return NULL only for bad arguments or lack of memory */
+extern rale_future_t *rale_client_get(rale_client_t *client, const char *key,
+									  rale_client_cb cb, void *arg);
+extern rale_future_t *rale_client_put(rale_client_t *client, const char *key,
+									  const char *value, rale_client_cb cb, void *arg);
+
+/* Store value only if key holds expected; NULL expected: only if absent */
+extern rale_future_t *rale_client_cas(rale_client_t *client, const char *key,
+									  const char *expected, const char *value,
+									  rale_client_cb cb, void *arg);
+
+/* Like rale_client_put(), but the key goes when lease does */
+extern rale_future_t *rale_client_put_leased(rale_client_t *client, const char *key,
+											 const char *value, uint64_t lease,
+											 rale_client_cb cb, void *arg);
+
+/*
+ * Grant a lease of ttl seconds; its id is the future's revision (and its
+ * value, in decimal).  Keepalive's value is the TTL the lease has again.
+ * A lease that is gone completes keepalive, revoke and put_leased with
+ * RALE_CLIENT_NOT_FOUND.
+ */
+extern rale_future_t *rale_client_lease_grant(rale_client_t *client, int ttl,
+											  rale_client_cb cb, void *arg);
+extern rale_future_t *rale_client_lease_keepalive(rale_client_t *client, uint64_t lease,
+												  rale_client_cb cb, void *arg);
+extern rale_future_t *rale_client_lease_revoke(rale_client_t *client, uint64_t lease,
+											   rale_client_cb cb, void *arg);
+
+/* Returns a watch id for rale_client_unwatch(), or -1 */
+extern int	rale_client_watch(rale_client_t *client, const char *key,
+							  rale_watch_cb cb, void *arg);
+extern void rale_client_unwatch(rale_client_t *client, int watch_id);
+
+extern rale_client_status_t rale_future_status(const rale_future_t *future);
+
+/* The value read or stored; the server's message for RALE_CLIENT_ERROR */
+extern const char *rale_future_value(const rale_future_t *future);
+
+/* Revision a write committed at, or that a read's state is at least; 0 if unknown */
+extern uint64_t rale_future_revision(const rale_future_t *future);
+
+/* Newest revision the session has seen; hand it to another client to carry on */
+extern uint64_t rale_client_revision(const rale_client_t *client);
+extern void rale_client_advance_revision(rale_client_t *client, uint64_t revision);
+
+/* Process the client until future completes or timeout_ms passes */
+extern rale_client_status_t rale_future_wait(rale_client_t *client, rale_future_t *future,
+											 int timeout_ms);
+
+extern void rale_future_release(rale_future_t *future);
+
+#endif							/* RALE_CLIENT_H */
@@ -20,6 +20,7 @@ extern int rale_proto_init(uint16_t port, const config_t *config);
 extern int rale_init(const config_t *config);
 extern int rale_finit(void);
 extern int rale_quram_process(void);
+extern int rale_hand_off_leadership(void);
 extern connection_t *rale_setup_socket(const uint16_t port);
 
 #endif							/* RALE_PROTO_H */
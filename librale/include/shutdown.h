@@ -6,6 +6,11 @@
  *		This module provides a coordinated shutdown mechanism that ensures all
  *		subsystems gracefully shut down before the main process exits.
  *
+ *		A request sets every subsystem's state and makes an eventfd
+ *		readable for good, so loops that add librale_shutdown_fd() to their
+ *		select() or sleep in librale_shutdown_sleep() return at once rather
+ *		than at their next poll.
+ *
  * Copyright (c) 2025, RALE Project
  * All rights reserved.
  *
@@ -16,16 +21,33 @@
 #define RALE_SHUTDOWN_H
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum shutdown_subsystem
+{
+	SHUTDOWN_SUBSYSTEM_DSTORE = 0,
+	SHUTDOWN_SUBSYSTEM_RALE,
+	SHUTDOWN_SUBSYSTEM_COMM,
+	SHUTDOWN_SUBSYSTEMS
+} shutdown_subsystem_t;
 
+typedef enum shutdown_state
+{
+	SHUTDOWN_STATE_RUNNING = 0,
+	SHUTDOWN_STATE_REQUESTED,
+	SHUTDOWN_STATE_COMPLETE		/* The subsystem's loop has exited */
+} shutdown_state_t;
+
+/* librale_request_shutdown() is async-signal-safe */
 void librale_request_shutdown(void);
-int librale_is_shutdown_requested(const char *subsystem);
-int librale_wait_for_shutdown_completion(int timeout_seconds);
-void librale_signal_shutdown_complete(const char *subsystem);
+int librale_is_shutdown_requested(shutdown_subsystem_t subsystem);
+int librale_shutdown_fd(void);
+bool librale_shutdown_sleep(int timeout_ms);
+uint64_t librale_shutdown_elapsed_ms(void);
+int librale_wait_for_shutdown_completion(shutdown_subsystem_t subsystem, int timeout_ms);
+void librale_signal_shutdown_complete(shutdown_subsystem_t subsystem);
 int librale_shutdown_init(void);
 void librale_shutdown_cleanup(void);
 
-#define SHUTDOWN_SUBSYSTEM_DSTORE	"dstore"
-#define SHUTDOWN_SUBSYSTEM_RALE		"rale"
-#define SHUTDOWN_SUBSYSTEM_COMM		"comm"
-
 #endif							/* RALE_SHUTDOWN_H */
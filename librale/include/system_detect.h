@@ -160,6 +160,31 @@
 #define IS_MACOS() defined(OS_MACOS)
 #define IS_LINUX() defined(OS_LINUX)
 
+/*-------------------------------------------------------------------------
+ * CPU Topology
+ *-------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define SYSTEM_MAX_CPUS         1024    /* Online CPUs recorded by topology detection */
+#define SYSTEM_MAX_NUMA_NODES   64
+
+typedef struct system_cpu_t {
+    int         cpu;                    /* Logical CPU number */
+    int         core_id;                /* Physical core within its package */
+    int         package_id;             /* Socket */
+    int         numa_node;              /* 0 when the kernel reports no NUMA nodes */
+} system_cpu_t;
+
+typedef struct system_topology_t {
+    int             cpu_count;          /* Online CPUs in cpus[], ascending */
+    int             core_count;         /* Distinct (package, core) pairs */
+    int             package_count;
+    int             numa_node_count;
+    system_cpu_t    cpus[SYSTEM_MAX_CPUS];
+} system_topology_t;
+
 /*-------------------------------------------------------------------------
  * System Information Functions
  *-------------------------------------------------------------------------*/
@@ -198,6 +223,36 @@ int has_feature(const char *feature);
  */
 const char *get_default_path(const char *path_type);
 
+/**
+ * Read CPU, core, package and NUMA layout from sysfs; -1 where unavailable
+ */
+int system_topology_detect(system_topology_t *topology);
+
+/**
+ * NUMA node of a logical CPU, or -1 if the CPU is not online
+ */
+int system_topology_numa_node(const system_topology_t *topology, int cpu);
+
+/**
+ * Parse a kernel-style CPU list ("0-3,8,10-11"); returns the count or -1
+ */
+int system_parse_cpu_list(const char *list, int *cpus, int max_cpus);
+
+/**
+ * Format CPUs back into the compact list form
+ */
+void system_format_cpu_list(const int *cpus, int count, char *out, size_t outlen);
+
+/**
+ * Restrict a thread to the given CPUs; -1 with errno set on failure
+ */
+int system_pin_thread(pthread_t thread, const int *cpus, int count);
+
+/**
+ * Prefer a NUMA node for the calling thread's future allocations
+ */
+int system_prefer_numa_node(int node);
+
 #ifdef __cplusplus
 }
 #endif
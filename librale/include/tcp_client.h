@@ -17,6 +17,7 @@
 /** System headers */
 #include <stddef.h>
 #include <netinet/in.h>
+#include <sys/types.h>
 
 /** Buffer size for receiving messages */
 #define TCP_CLIENT_BUFFER_SIZE	1024
@@ -38,6 +39,15 @@ extern tcp_client_t *tcp_client_init(const char *ip_address, int port,
 								   void (*on_disconnection) (int, const char *, int),
 								   char *errbuf, size_t errbuflen);
 extern void tcp_client_send(tcp_client_t *client, const char *message);
+
+/**
+ * Send count bytes of fd from *offset, then trailer and a newline if not
+ * NULL, corked into full segments.  Returns 1 once all of it is out, 0 if
+ * the socket buffer was full and nothing was sent, or -1 if the connection
+ * failed (on_disconnection has run).
+ */
+extern int tcp_client_sendfile(tcp_client_t *client, int fd, off_t *offset,
+							   size_t count, const char *trailer);
 extern void tcp_client_receive(tcp_client_t *client);
 extern void tcp_client_cleanup(tcp_client_t *client);
 extern void tcp_client_run(tcp_client_t *client);
@@ -0,0 +1,82 @@
+/*-------------------------------------------------------------------------
+ *
+ * trace.h
+ *		Sampled per-request tracing spans
+ *
+ * A sampled client request gets a cluster-unique trace id.  Each stage the
+ * request passes through (parse, local apply, rale.db write, replication
+ * send, follower apply) is recorded as a span in a ring owned by the thread
+ * that ran it.  The id travels to followers in the replication frame, so
+ * their spans join the same trace.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Spans kept per thread; older ones are overwritten */
+#define TRACE_RING_SIZE			4096
+
+/* Replication frames of sampled requests start with "@<16 hex digits> " */
+#define TRACE_CONTEXT_PREFIX	'@'
+#define TRACE_CONTEXT_LENGTH	18
+
+typedef enum trace_stage
+{
+	TRACE_STAGE_REQUEST = 0,	/* Whole client request */
+	TRACE_STAGE_PARSE,			/* Command text or JSON to dispatch */
+	TRACE_STAGE_LOCAL_APPLY,	/* db_insert on this node */
+	TRACE_STAGE_PERSIST,		/* Append to rale.db */
+	TRACE_STAGE_REPLICATE_SEND, /* Frames queued to every follower */
+	TRACE_STAGE_FOLLOWER_APPLY, /* Replicated frame handled by a follower */
+	TRACE_STAGE_COUNT
+} trace_stage_t;
+
+/*
+ * Start a request on the calling thread.  Returns the trace id, or 0 when
+ * the request is not sampled (trace_sample_rate); every other call is then
+ * a no-op until trace_end().
+ */
+extern uint64_t trace_begin(void);
+
+/* Continue a trace received from another node; 0 clears it */
+extern void trace_adopt(uint64_t trace_id);
+
+extern void trace_end(void);
+
+/* Trace id active on the calling thread, 0 if none */
+extern uint64_t trace_current(void);
+
+/* Span start time in ns, or 0 without an active trace (no clock read) */
+extern uint64_t trace_clock(void);
+
+/* Record [start_ns, now] as a stage of the active trace */
+extern void trace_span(trace_stage_t stage, uint64_t start_ns);
+
+extern const char *trace_stage_name(trace_stage_t stage);
+
+/*
+ * Write the "@<id> " frame prefix for the active trace into buf.  Returns
+ * its length, 0 without an active trace.
+ */
+extern size_t trace_format_context(char *buf, size_t buflen);
+
+/* Skip a frame's trace prefix, returning the rest and the id (0 if none) */
+extern const char *trace_strip_context(const char *frame, uint64_t *trace_id);
+
+/*
+ * Write every span still held by any thread's ring to path in Chrome trace
+ * event format.  Returns the number of spans written, -1 on error.
+ */
+extern int trace_export_chrome(const char *path, char *errbuf, size_t errbuflen);
+
+/* Release the rings; only once all threads have stopped */
+extern void trace_cleanup(void);
+
+#endif							/* TRACE_H */
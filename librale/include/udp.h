@@ -17,10 +17,25 @@
 /** System headers */
 #include <stddef.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 
 /** Maximum size for the UDP receive buffer */
 #define UDP_BUFFER_SIZE	1024
 
+/** Datagrams moved per recvmmsg()/sendmmsg() call */
+#define UDP_BATCH_SIZE	32
+
+/** One received datagram, NUL-terminated */
+typedef struct udp_message_t
+{
+	char				data[UDP_BUFFER_SIZE];
+	char				sender_address[INET_ADDRSTRLEN];
+	int					sender_port;
+} udp_message_t;
+
+/** Datagrams queued by udp_queue() until udp_flush() */
+typedef struct udp_outbox udp_outbox_t;
+
 /** Structure to represent a connection, holding socket and address info */
 typedef struct connection_t
 {
@@ -29,6 +44,8 @@ typedef struct connection_t
 	struct sockaddr_in	client_addr;	/** Client address */
 	socklen_t			addr_len;		/** Length of the address structure */
 	void	(*on_receive) (const char *message, const char *sender_address, int sender_port);	/** Message reception callback */
+	void	(*on_receive_batch) (const udp_message_t *messages, int count);	/** Takes precedence over on_receive */
+	udp_outbox_t	   *outbox;		/** Allocated on first udp_queue() */
 } connection_t;
 
 /** Function declarations */
@@ -44,6 +61,9 @@ extern int udp_bind(connection_t *udp, int port);
 extern int udp_sendto(connection_t *udp, const char *message, const char *address, int port);
 extern int udp_recvfrom(connection_t *udp, char *buffer, size_t buffer_len,
 						char *sender_address_buf, int *sender_port);
+extern int udp_recv_batch(connection_t *udp, udp_message_t *messages, int max_messages);
+extern int udp_queue(connection_t *udp, const char *message, const char *address, int port);
+extern int udp_flush(connection_t *udp);
 extern void udp_loop(connection_t *udp);
 extern void udp_process_messages(connection_t *udp);
 
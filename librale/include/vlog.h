@@ -0,0 +1,83 @@
+/*-------------------------------------------------------------------------
+ *
+ * vlog.h
+ *		Value log: large values kept on disk instead of in the key index
+ *
+ * Values are appended to segment files (vlog.<id> under the database
+ * directory) and the index keeps only a short reference to them, so the
+ * index grows with the number of keys rather than the bytes stored.  Reads
+ * go through a CLOCK page cache.  Overwrites and deletes only mark bytes as
+ * garbage; a background thread copies the live records out of a segment
+ * once enough of it is garbage, then removes the file.
+ *
+ * rale.db stays the durable copy: segments are discarded on open and
+ * refilled as the snapshot is loaded.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef VLOG_H
+#define VLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define VLOG_REF_SIZE		48		/* Room for a reference in text form */
+#define VLOG_PAGE_SIZE		4096	/* Page cache granule */
+#define VLOG_MAX_SEGMENTS	4096	/* Segments on disk at once */
+
+/* vlog_read() result for a reference whose segment was collected */
+#define VLOG_STALE			1
+
+typedef struct vlog vlog_t;
+
+typedef struct vlog_stats
+{
+	uint64_t			segments;		/* Segment files on disk */
+	uint64_t			bytes;			/* Bytes in them */
+	uint64_t			garbage_bytes;	/* Of which overwritten or deleted */
+	uint64_t			appends;
+	uint64_t			cache_pages;
+	uint64_t			cache_hits;
+	uint64_t			cache_misses;
+	uint64_t			gc_segments;	/* Segments collected */
+	uint64_t			gc_relocated;	/* Live values copied forward */
+	uint64_t			gc_reclaimed_bytes;
+} vlog_stats_t;
+
+/*
+ * Move one value out of a segment being collected.  If key still points at
+ * ref, the owner appends value again, replaces ref and returns 1; if the
+ * value is dead it returns 0, and -1 if it could not be moved, which keeps
+ * the segment.
+ */
+typedef int (*vlog_relocate_fn) (void *arg, const char *key, const char *ref,
+								 const char *value);
+
+/* Empty value log in dir; NULL with errbuf set on failure */
+extern vlog_t *vlog_open(const char *dir, uint64_t segment_bytes, uint64_t cache_bytes,
+						 char *errbuf, size_t errbuflen);
+
+/* Stops the collector, closes and removes the segments */
+extern void vlog_close(vlog_t *vlog);
+
+/* Start the collector; gc_percent is the garbage share that triggers it */
+extern int vlog_start_gc(vlog_t *vlog, vlog_relocate_fn relocate, void *arg,
+						 int gc_percent);
+
+/* Append a value and write its reference to ref; 0 or -1 */
+extern int vlog_append(vlog_t *vlog, const char *key, size_t key_len,
+					   const char *value, size_t value_len,
+					   char *ref, size_t ref_size);
+
+/* Copy the value of ref into value; 0, -1, or VLOG_STALE */
+extern int vlog_read(vlog_t *vlog, const char *ref, char *value, size_t value_size);
+
+/* The value behind ref was overwritten or deleted */
+extern void vlog_discard(vlog_t *vlog, const char *ref);
+
+extern void vlog_get_stats(vlog_t *vlog, vlog_stats_t *stats);
+
+#endif							/* VLOG_H */
@@ -0,0 +1,81 @@
+/*-------------------------------------------------------------------------
+ *
+ * wal.h
+ *		Append writer for the rale.db key-value log
+ *
+ * Records are gathered in one buffer and written at the file's tail with
+ * explicit offsets, so the file stays open and no stdio is involved.  A
+ * caller that handles several records at once (a batch of replication
+ * frames) brackets them with wal_batch_begin()/wal_batch_end() and pays for
+ * one write, and one fdatasync with wal_sync, instead of one per record.
+ *
+ * With the io_uring backend the buffer and the file are registered with the
+ * ring once; a flush is then a fixed-buffer write linked to its fdatasync,
+ * submitted and reaped with a single io_uring_enter().  Where io_uring is
+ * not compiled in or the kernel refuses it, the plain pwrite() backend is
+ * used instead.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Records buffered before a flush is forced */
+#define WAL_BUFFER_SIZE			(64 * 1024)
+
+/* Submission queue depth; a flush needs at most two entries */
+#define WAL_URING_DEPTH			8
+
+typedef enum wal_backend
+{
+	WAL_BACKEND_AUTO = 0,		/* io_uring when available, else sync */
+	WAL_BACKEND_SYNC,			/* pwrite() and fdatasync() */
+	WAL_BACKEND_URING			/* Registered buffer and file on an io_uring */
+} wal_backend_t;
+
+typedef struct wal_stats
+{
+	wal_backend_t		backend;	/* Backend actually in use */
+	uint64_t			appends;	/* Records appended */
+	uint64_t			flushes;	/* Buffer flushes */
+	uint64_t			syscalls;	/* System calls made by flushes */
+	uint64_t			bytes;		/* Bytes written */
+} wal_stats_t;
+
+/*
+ * Open path for appending with the requested backend; sync adds an
+ * fdatasync to every flush.  Returns 0, or -1 with errbuf filled in.
+ */
+extern int wal_open(const char *path, wal_backend_t backend, int sync,
+					char *errbuf, size_t errbuflen);
+
+/* Append one record; it is written now unless a batch is open */
+extern int wal_append(const char *record, size_t len);
+
+/* Defer writes from the calling thread until the matching wal_batch_end() */
+extern void wal_batch_begin(void);
+extern int wal_batch_end(void);
+
+/* Write out everything buffered so far */
+extern int wal_flush(void);
+
+/*
+ * Swap in replacement, a complete log the caller has written and synced,
+ * for the file at path, and go on appending to it.  Counters carry over.
+ */
+extern int	wal_replace(const char *path, const char *replacement,
+						char *errbuf, size_t errbuflen);
+
+extern void wal_get_stats(wal_stats_t *stats);
+extern const char *wal_backend_name(wal_backend_t backend);
+
+/* Flush and close; appends after this are dropped */
+extern void wal_close(void);
+
+#endif							/* WAL_H */
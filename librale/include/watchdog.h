@@ -32,6 +32,8 @@
 #define WATCHDOG_DEFAULT_TIMEOUT	30		/* Default timeout in seconds */
 #define WATCHDOG_SAFETY_MARGIN		5		/* Safety margin in seconds */
 #define WATCHDOG_KEEPALIVE_INTERVAL	10		/* Keepalive interval in seconds */
+#define WATCHDOG_DEFAULT_TICK_BUDGET_MS	1000	/* Longest main-loop tick that still feeds */
+#define WATCHDOG_TICK_BUCKETS		16		/* log2(ms) tick latency buckets */
 
 /* Watchdog mode enumeration */
 typedef enum {
@@ -61,6 +63,14 @@ typedef struct watchdog_stats_t {
     time_t		last_disable;
     uint32_t		current_timeout;
     bool		is_test_mode;
+
+    /* Main-loop liveness, see watchdog_tick_begin() */
+    uint64_t		ticks;
+    uint64_t		ticks_over_budget;
+    uint64_t		expirations;		/* Timeouts seen in test_mode/soft_noboot */
+    uint64_t		last_tick_us;
+    uint64_t		max_tick_us;
+    uint64_t		tick_histogram[WATCHDOG_TICK_BUCKETS];	/* [0] < 1ms, [i] < 2^i ms */
 } watchdog_stats_t;
 
 /* Watchdog configuration structure */
@@ -70,7 +80,8 @@ typedef struct watchdog_config_t {
     uint32_t			timeout_seconds;
     uint32_t			safety_margin_seconds;
     uint32_t			keepalive_interval_seconds;
-    bool			test_mode;
+    uint32_t			tick_budget_ms;		/* Ticks slower than this do not feed */
+    bool			test_mode;		/* device_path is a plain file stand-in */
     bool			soft_noboot;		/* For testing - don't reboot */
 } watchdog_config_t;
 
@@ -83,6 +94,8 @@ typedef struct watchdog_context_t {
     time_t			last_keepalive;
     time_t			enabled_at;
     bool			is_active;
+    bool			expiry_reported;	/* Current expiry already counted */
+    struct timespec		tick_started;
     pthread_mutex_t		mutex;
 } watchdog_context_t;
 
@@ -120,6 +133,11 @@ bool watchdog_should_enable_for_leadership(const watchdog_context_t *ctx, uint32
 bool watchdog_time_to_keepalive(const watchdog_context_t *ctx);
 uint32_t watchdog_time_until_expiry(const watchdog_context_t *ctx);
 
+/* Main-loop liveness: the watchdog is fed only by ticks within budget */
+void watchdog_tick_begin(watchdog_context_t *ctx);
+uint64_t watchdog_tick_end(watchdog_context_t *ctx, bool *over_budget);
+uint32_t watchdog_tick_percentile(const watchdog_stats_t *stats, int percent);
+
 /* Watchdog test functions */
 bool watchdog_enable_test_mode(watchdog_context_t *ctx);
 bool watchdog_disable_test_mode(watchdog_context_t *ctx);
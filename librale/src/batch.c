@@ -0,0 +1,457 @@
+/*-------------------------------------------------------------------------
+ *
+ * batch.c
+ *		Group commit for writes accepted by the leader.
+ *
+ *		batch_mutex guards the queue and the statistics.  At most one round
+ *		runs at a time (round_in_flight); its writer drops the mutex while
+ *		the commit function runs, so new writers keep queueing behind it.
+ *		Every waiting writer sleeps on round_done and rechecks its entry
+ *		when a round ends: committed, or still queued and now free to run
+ *		the next round itself.  A writer lingering for company sleeps on
+ *		arrival instead, which each new entry signals.
+ *
+ *		The linger target is the size of the previous batch: a burst of N
+ *		concurrent writers tends to arrive again as N, while a single
+ *		writer never waits for anybody.  A group queued by one call counts
+ *		as one writer, so it is committed at once as well.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+/** Local headers */
+#include "batch.h"
+#include "config.h"
+#include "trace.h"
+
+/* Used until a configuration is published */
+#define BATCH_DEFAULT_MAX_ENTRIES	64
+#define BATCH_DEFAULT_MAX_BYTES		(64 * 1024)
+#define BATCH_DEFAULT_MAX_DELAY_US	200
+
+static pthread_mutex_t batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t round_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t arrival;
+static pthread_once_t arrival_once = PTHREAD_ONCE_INIT;
+
+static batch_commit_fn batch_commit = NULL;
+static batch_entry_t *queue_head = NULL;
+static batch_entry_t *queue_tail = NULL;
+static uint64_t queue_count = 0;
+static uint64_t queue_bytes = 0;
+static bool round_in_flight = false;
+static bool lingering = false;
+static uint64_t last_size = 0;
+static uint64_t last_writers = 0;
+static batch_stats_t batch_stats;
+
+static uint64_t
+batch_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static void
+batch_limits(uint64_t *max_entries, uint64_t *max_bytes, uint64_t *max_delay_us)
+{
+	const config_t *current = config_current();
+
+	*max_entries = BATCH_DEFAULT_MAX_ENTRIES;
+	*max_bytes = BATCH_DEFAULT_MAX_BYTES;
+	*max_delay_us = BATCH_DEFAULT_MAX_DELAY_US;
+	if (current != NULL)
+	{
+		if (current->write_batch.max_entries > 0)
+			*max_entries = (uint64_t) current->write_batch.max_entries;
+		if (current->write_batch.max_bytes > 0)
+			*max_bytes = (uint64_t) current->write_batch.max_bytes;
+		if (current->write_batch.max_delay_us >= 0)
+			*max_delay_us = (uint64_t) current->write_batch.max_delay_us;
+	}
+	config_release();
+}
+
+/* Smallest i with value <= 2^i (sizes) or value < 2^i (waits), capped */
+static int
+batch_bucket(uint64_t value, bool inclusive, int buckets)
+{
+	int			i = 0;
+
+	if (inclusive && value > 0)
+		value--;
+	while (value > 0 && i < buckets - 1)
+	{
+		value >>= 1;
+		i++;
+	}
+	return i;
+}
+
+/* Lingers are timed on the monotonic clock */
+static void
+batch_arrival_init(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&arrival, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/*
+ * Wait on arrival until the queue holds target entries or max_bytes, or
+ * max_delay_us passes.  Returns true if the delay ran out.
+ */
+static bool
+batch_linger(uint64_t target, uint64_t max_bytes, uint64_t max_delay_us)
+{
+	struct timespec deadline;
+	bool		expired = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += (time_t) (max_delay_us / 1000000);
+	deadline.tv_nsec += (long) (max_delay_us % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	lingering = true;
+	while (queue_count < target && queue_bytes < max_bytes)
+	{
+		if (pthread_cond_timedwait(&arrival, &batch_mutex, &deadline) == ETIMEDOUT)
+		{
+			expired = queue_count < target && queue_bytes < max_bytes;
+			break;
+		}
+	}
+	lingering = false;
+	return expired;
+}
+
+/* Close a batch off the queue and commit it; batch_mutex held on entry and exit */
+static void
+batch_run_round(void)
+{
+	batch_entry_t  *head;
+	batch_entry_t  *entry;
+	batch_entry_t  *last = NULL;
+	uint64_t		max_entries;
+	uint64_t		max_bytes;
+	uint64_t		max_delay_us;
+	uint64_t		count = 0;
+	uint64_t		bytes = 0;
+	uint64_t		writers = 0;
+	uint64_t		now;
+	bool			expired = false;
+
+	round_in_flight = true;
+	batch_limits(&max_entries, &max_bytes, &max_delay_us);
+
+	/* Under load, give the writers of the last round time to come back */
+	if (max_delay_us > 0 && last_writers > 1 && queue_count < last_size)
+		expired = batch_linger(last_size < max_entries ? last_size : max_entries,
+							   max_bytes, max_delay_us);
+
+	/* Oldest first, always at least one entry */
+	head = queue_head;
+	for (entry = queue_head; entry != NULL; entry = entry->next)
+	{
+		if (count == max_entries)
+		{
+			batch_stats.closed_entries++;
+			break;
+		}
+		if (count > 0 && bytes + entry->bytes > max_bytes)
+		{
+			batch_stats.closed_bytes++;
+			break;
+		}
+		count++;
+		bytes += entry->bytes;
+		last = entry;
+	}
+	if (entry == NULL && expired)
+		batch_stats.closed_delay++;
+
+	queue_head = last->next;
+	if (queue_head == NULL)
+		queue_tail = NULL;
+	last->next = NULL;
+	queue_count -= count;
+	queue_bytes -= bytes;
+
+	now = batch_now_us();
+	for (entry = head; entry != NULL; entry = entry->next)
+	{
+		uint64_t	wait_us = now - entry->queued_us;
+
+		batch_stats.wait_histogram[batch_bucket(wait_us, false, BATCH_WAIT_BUCKETS)]++;
+		batch_stats.wait_total_us += wait_us;
+		if (wait_us > batch_stats.max_wait_us)
+			batch_stats.max_wait_us = wait_us;
+		if (!entry->joined || entry == head)
+			writers++;
+	}
+	batch_stats.batches++;
+	batch_stats.entries += count;
+	batch_stats.bytes += bytes;
+	batch_stats.size_histogram[batch_bucket(count, true, BATCH_SIZE_BUCKETS)]++;
+	if (count > batch_stats.max_size)
+		batch_stats.max_size = count;
+
+	pthread_mutex_unlock(&batch_mutex);
+	batch_commit(head, (int) count);
+	pthread_mutex_lock(&batch_mutex);
+
+	/* The commit function is done with the list; waiters may now return */
+	for (entry = head; entry != NULL; entry = entry->next)
+		entry->done = 1;
+	last_size = count;
+	last_writers = writers;
+	round_in_flight = false;
+	pthread_cond_broadcast(&round_done);
+}
+
+void
+batch_init(batch_commit_fn commit)
+{
+	pthread_mutex_lock(&batch_mutex);
+	batch_commit = commit;
+	last_size = 0;
+	last_writers = 0;
+	memset(&batch_stats, 0, sizeof(batch_stats));
+	pthread_mutex_unlock(&batch_mutex);
+}
+
+/*
+ * Queue count entries in order and wait until rounds have committed them
+ * all.  Rounds take the queue oldest first, so the last entry is the last
+ * to be done.
+ */
+static void
+batch_enqueue_group(batch_entry_t *entries, int count)
+{
+	batch_entry_t *last = &entries[count - 1];
+	uint64_t	trace_id = trace_current();
+	uint64_t	now;
+	int			i;
+
+	for (i = 0; i < count; i++)
+	{
+		entries[i].bytes = strlen(entries[i].key) + strlen(entries[i].value) + 2;
+		entries[i].trace_id = trace_id;
+		entries[i].result = -1;
+		entries[i].joined = i > 0;
+	}
+
+	pthread_once(&arrival_once, batch_arrival_init);
+	pthread_mutex_lock(&batch_mutex);
+	if (batch_commit == NULL)
+	{
+		pthread_mutex_unlock(&batch_mutex);
+		return;
+	}
+
+	now = batch_now_us();
+	for (i = 0; i < count; i++)
+	{
+		entries[i].queued_us = now;
+		if (queue_tail != NULL)
+			queue_tail->next = &entries[i];
+		else
+			queue_head = &entries[i];
+		queue_tail = &entries[i];
+		queue_count++;
+		queue_bytes += entries[i].bytes;
+	}
+	if (lingering)
+		pthread_cond_signal(&arrival);
+
+	while (!last->done)
+	{
+		if (round_in_flight)
+			pthread_cond_wait(&round_done, &batch_mutex);
+		else if (batch_commit == NULL)
+			break;				/* Stopped while still queued */
+		else
+			batch_run_round();
+	}
+	pthread_mutex_unlock(&batch_mutex);
+}
+
+/* Queue entry and wait until a round has committed it */
+static int
+batch_enqueue(batch_entry_t *entry)
+{
+	batch_enqueue_group(entry, 1);
+	return entry->result;
+}
+
+int
+batch_submit(const char *key, const char *value, uint64_t *revision)
+{
+	batch_entry_t entry;
+	int			result;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.key = key;
+	entry.value = value;
+	result = batch_enqueue(&entry);
+	if (revision != NULL)
+		*revision = entry.revision;
+	return result;
+}
+
+int
+batch_submit_cas(const char *key, const char *expected, const char *value,
+				 uint64_t *revision)
+{
+	batch_entry_t entry;
+	int			result;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.key = key;
+	entry.value = value;
+	entry.expected = expected;
+	entry.cas = 1;
+	result = batch_enqueue(&entry);
+	if (revision != NULL)
+		*revision = entry.revision;
+	return result;
+}
+
+int
+batch_submit_leased(const char *key, const char *value, uint64_t lease,
+					uint64_t *revision)
+{
+	batch_entry_t entry;
+	int			result;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.key = key;
+	entry.value = value;
+	entry.lease = lease;
+	result = batch_enqueue(&entry);
+	if (revision != NULL)
+		*revision = entry.revision;
+	return result;
+}
+
+int
+batch_submit_lease(batch_op_t op, uint64_t lease, int ttl, uint64_t *revision)
+{
+	batch_entry_t entry;
+	int			result;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.op = op;
+	entry.key = "";
+	entry.value = "";
+	entry.lease = lease;
+	entry.ttl = ttl;
+	result = batch_enqueue(&entry);
+	if (revision != NULL)
+		*revision = entry.revision;
+	return result;
+}
+
+void
+batch_submit_group(batch_entry_t *entries, int count)
+{
+	int			i;
+
+	if (entries == NULL || count <= 0)
+		return;
+	for (i = 0; i < count; i++)
+	{
+		entries[i].next = NULL;
+		entries[i].done = 0;
+	}
+	batch_enqueue_group(entries, count);
+}
+
+void
+batch_get_stats(batch_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+
+	pthread_mutex_lock(&batch_mutex);
+	memcpy(stats, &batch_stats, sizeof(*stats));
+	pthread_mutex_unlock(&batch_mutex);
+}
+
+static uint64_t
+batch_percentile(const uint64_t *histogram, int buckets, uint64_t total,
+				 uint64_t max, int percent)
+{
+	uint64_t	rank;
+	uint64_t	seen = 0;
+	int			i;
+
+	if (total == 0)
+		return 0;
+
+	rank = (total * (uint64_t) percent + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < buckets - 1; i++)
+	{
+		seen += histogram[i];
+		if (seen >= rank)
+			return (UINT64_C(1) << i) < max ? (UINT64_C(1) << i) : max;
+	}
+	return max;
+}
+
+uint64_t
+batch_size_percentile(const batch_stats_t *stats, int percent)
+{
+	if (stats == NULL)
+		return 0;
+	return batch_percentile(stats->size_histogram, BATCH_SIZE_BUCKETS,
+							stats->batches, stats->max_size, percent);
+}
+
+uint64_t
+batch_wait_percentile(const batch_stats_t *stats, int percent)
+{
+	if (stats == NULL)
+		return 0;
+	return batch_percentile(stats->wait_histogram, BATCH_WAIT_BUCKETS,
+							stats->entries, stats->max_wait_us, percent);
+}
+
+void
+batch_finit(void)
+{
+	batch_entry_t *entry;
+
+	pthread_mutex_lock(&batch_mutex);
+	while (round_in_flight)
+		pthread_cond_wait(&round_done, &batch_mutex);
+	batch_commit = NULL;
+
+	/* Writers still queued give up with -1 */
+	for (entry = queue_head; entry != NULL; entry = entry->next)
+		entry->done = 1;
+	queue_head = queue_tail = NULL;
+	queue_count = queue_bytes = 0;
+	pthread_cond_broadcast(&round_done);
+	pthread_mutex_unlock(&batch_mutex);
+}
@@ -0,0 +1,200 @@
+/*-------------------------------------------------------------------------
+ *
+ * bloom.c
+ *		Counting Bloom filter over the keys of a hash table.
+ *
+ *		The key's hash picks the block; a second, mixed copy of it
+ *		supplies six bits per counter inside the block.  Counters are single
+ *		bytes, written only by the table's writer under its mutex and read
+ *		lock-free by hash_get(), hence the relaxed atomics.  Adding a key
+ *		raises its counters before the entry is linked and removing it
+ *		lowers them after the entry is unlinked, so a reader racing a writer
+ *		sees either the old or the new state, never a key that is present
+ *		but filtered out.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/** Local headers */
+#include "bloom.h"
+
+#define BLOOM_COUNTER_MAX	UINT8_MAX	/* Saturated counters are never lowered */
+
+struct bloom
+{
+	uint64_t			capacity;
+	uint64_t			blocks;
+	_Atomic uint64_t	keys;
+	_Atomic uint64_t	checks;
+	_Atomic uint64_t	negatives;
+	_Atomic uint64_t	false_positives;
+	_Atomic uint8_t    *counters;
+};
+
+/* splitmix64 finalizer; decorrelates the in-block positions from the block */
+static uint64_t
+bloom_mix(uint64_t h)
+{
+	h ^= h >> 30;
+	h *= UINT64_C(0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= UINT64_C(0x94d049bb133111eb);
+	h ^= h >> 31;
+	return h;
+}
+
+/* The block of a key's counters, and their positions inside it */
+static _Atomic uint8_t *
+bloom_locate(const bloom_t *filter, uint64_t hash, uint32_t positions[BLOOM_HASHES])
+{
+	uint64_t	bits = bloom_mix(hash);
+	int			i;
+
+	for (i = 0; i < BLOOM_HASHES; i++)
+	{
+		positions[i] = (uint32_t) (bits & (BLOOM_BLOCK - 1));
+		bits >>= 6;
+	}
+	return filter->counters + (hash % filter->blocks) * BLOOM_BLOCK;
+}
+
+bloom_t *
+bloom_create(uint64_t capacity)
+{
+	bloom_t	   *filter;
+
+	if (capacity == 0)
+		capacity = 1;
+
+	filter = calloc(1, sizeof(bloom_t));
+	if (filter == NULL)
+		return NULL;
+
+	filter->capacity = capacity;
+	filter->blocks = (capacity * BLOOM_COUNTERS_PER_KEY + BLOOM_BLOCK - 1) / BLOOM_BLOCK;
+	filter->counters = calloc(filter->blocks * BLOOM_BLOCK, sizeof(_Atomic uint8_t));
+	if (filter->counters == NULL)
+	{
+		free(filter);
+		return NULL;
+	}
+	return filter;
+}
+
+void
+bloom_destroy(bloom_t *filter)
+{
+	if (filter == NULL)
+		return;
+	free((void *) filter->counters);
+	free(filter);
+}
+
+void
+bloom_add(bloom_t *filter, uint64_t hash)
+{
+	_Atomic uint8_t *block;
+	uint32_t	positions[BLOOM_HASHES];
+	int			i;
+
+	block = bloom_locate(filter, hash, positions);
+	for (i = 0; i < BLOOM_HASHES; i++)
+	{
+		uint8_t		c = atomic_load_explicit(&block[positions[i]], memory_order_relaxed);
+
+		if (c < BLOOM_COUNTER_MAX)
+			atomic_store_explicit(&block[positions[i]], (uint8_t) (c + 1), memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&filter->keys, 1, memory_order_relaxed);
+}
+
+void
+bloom_remove(bloom_t *filter, uint64_t hash)
+{
+	_Atomic uint8_t *block;
+	uint32_t	positions[BLOOM_HASHES];
+	int			i;
+
+	block = bloom_locate(filter, hash, positions);
+	for (i = 0; i < BLOOM_HASHES; i++)
+	{
+		uint8_t		c = atomic_load_explicit(&block[positions[i]], memory_order_relaxed);
+
+		if (c > 0 && c < BLOOM_COUNTER_MAX)
+			atomic_store_explicit(&block[positions[i]], (uint8_t) (c - 1), memory_order_relaxed);
+	}
+	atomic_fetch_sub_explicit(&filter->keys, 1, memory_order_relaxed);
+}
+
+void
+bloom_clear(bloom_t *filter)
+{
+	uint64_t	i;
+
+	for (i = 0; i < filter->blocks * BLOOM_BLOCK; i++)
+		atomic_store_explicit(&filter->counters[i], 0, memory_order_relaxed);
+	atomic_store_explicit(&filter->keys, 0, memory_order_relaxed);
+}
+
+bool
+bloom_may_contain(bloom_t *filter, uint64_t hash)
+{
+	_Atomic uint8_t *block;
+	uint32_t	positions[BLOOM_HASHES];
+	int			i;
+
+	atomic_fetch_add_explicit(&filter->checks, 1, memory_order_relaxed);
+	block = bloom_locate(filter, hash, positions);
+	for (i = 0; i < BLOOM_HASHES; i++)
+	{
+		if (atomic_load_explicit(&block[positions[i]], memory_order_relaxed) == 0)
+		{
+			atomic_fetch_add_explicit(&filter->negatives, 1, memory_order_relaxed);
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+bloom_note_false_positive(bloom_t *filter)
+{
+	atomic_fetch_add_explicit(&filter->false_positives, 1, memory_order_relaxed);
+}
+
+void
+bloom_get_stats(const bloom_t *filter, bloom_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+	if (filter == NULL)
+	{
+		stats->capacity = stats->counters = stats->keys = 0;
+		stats->checks = stats->negatives = stats->false_positives = 0;
+		return;
+	}
+
+	stats->capacity = filter->capacity;
+	stats->counters = filter->blocks * BLOOM_BLOCK;
+	stats->keys = atomic_load_explicit(&filter->keys, memory_order_relaxed);
+	stats->checks = atomic_load_explicit(&filter->checks, memory_order_relaxed);
+	stats->negatives = atomic_load_explicit(&filter->negatives, memory_order_relaxed);
+	stats->false_positives = atomic_load_explicit(&filter->false_positives, memory_order_relaxed);
+}
+
+double
+bloom_false_positive_rate(const bloom_stats_t *stats)
+{
+	uint64_t	absent;
+
+	if (stats == NULL)
+		return 0.0;
+	absent = stats->negatives + stats->false_positives;
+	return absent > 0 ? (double) stats->false_positives / (double) absent : 0.0;
+}
@@ -0,0 +1,187 @@
+/*-------------------------------------------------------------------------
+ *
+ * config.c
+ *		Published configuration snapshots.
+ *
+ *		Settings that may change while the daemon runs are read through an
+ *		immutable config_t snapshot.  A reload builds a complete new snapshot
+ *		and publishes it with one atomic pointer swap, so a reader sees
+ *		either the old settings or the new ones, never a mix, and never
+ *		takes a lock.
+ *
+ *		A reader pins the snapshot with config_current() and unpins it with
+ *		config_release().  Pinning only increments one of two reader
+ *		counters, picked by the parity of a grace-period epoch.  After a
+ *		swap, the publisher flips the epoch and waits for the counter of the
+ *		old parity to drain.  Every reader that could still see the old
+ *		snapshot registered there, so it can then be freed.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Local headers */
+#include "config.h"
+#include "rale_error.h"
+#include "util.h"
+
+typedef struct config_snapshot_t
+{
+	config_t					config;
+	struct config_snapshot_t   *retired_next;
+} config_snapshot_t;
+
+static _Atomic(config_snapshot_t *) current_snapshot = NULL;
+
+/* Grace periods: readers register in readers[epoch & 1] */
+static _Atomic uint64_t reader_epoch = 0;
+static _Atomic long readers[2];
+
+/* Pins held by this thread, and the counter the outermost one registered in */
+static __thread int pin_depth = 0;
+static __thread unsigned pin_slot = 0;
+
+/* Serializes publishers; readers never take it */
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static config_snapshot_t *retired_snapshots = NULL;
+
+const config_t *
+config_current(void)
+{
+	config_snapshot_t *snapshot;
+
+	if (pin_depth++ == 0)
+	{
+		for (;;)
+		{
+			unsigned slot = (unsigned) (atomic_load(&reader_epoch) & 1);
+
+			atomic_fetch_add(&readers[slot], 1);
+			/* A flip in between may not wait for us; register again */
+			if ((unsigned) (atomic_load(&reader_epoch) & 1) == slot)
+			{
+				pin_slot = slot;
+				break;
+			}
+			atomic_fetch_sub(&readers[slot], 1);
+		}
+	}
+
+	snapshot = atomic_load(&current_snapshot);
+	return snapshot ? &snapshot->config : NULL;
+}
+
+void
+config_release(void)
+{
+	if (pin_depth > 0 && --pin_depth == 0)
+		atomic_fetch_sub(&readers[pin_slot], 1);
+}
+
+int
+config_get_int(config_handle_t handle, const config_t *fallback)
+{
+	const config_t *current = config_current();
+	int32_t		value = 0;
+
+	if (current == NULL)
+		current = fallback;
+	if (current != NULL && handle + sizeof(value) <= sizeof(config_t))
+		memcpy(&value, (const char *) current + handle, sizeof(value));
+	config_release();
+	return (int) value;
+}
+
+/*
+ * Wait until no reader can hold a snapshot that was unpublished before the
+ * call.  Caller holds publish_mutex and no pin.
+ */
+static void
+config_synchronize(void)
+{
+	unsigned	old_slot = (unsigned) (atomic_fetch_add(&reader_epoch, 1) & 1);
+
+	while (atomic_load(&readers[old_slot]) > 0)
+		sched_yield();
+}
+
+static void
+config_free_retired(void)
+{
+	while (retired_snapshots != NULL)
+	{
+		config_snapshot_t *next = retired_snapshots->retired_next;
+
+		rfree((void **) &retired_snapshots);
+		retired_snapshots = next;
+	}
+}
+
+int
+config_publish(const config_t *config, char *errbuf, size_t errbuflen)
+{
+	config_snapshot_t *snapshot;
+	config_snapshot_t *previous;
+
+	if (config == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "CONFIG_ERR_INVALID: Cannot publish a NULL configuration.");
+		return -1;
+	}
+
+	snapshot = rmalloc(sizeof(config_snapshot_t));
+	if (snapshot == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "CONFIG_ERR_NO_MEMORY: Failed to allocate configuration snapshot.");
+		return -1;
+	}
+	memcpy(&snapshot->config, config, sizeof(config_t));
+	snapshot->retired_next = NULL;
+
+	pthread_mutex_lock(&publish_mutex);
+	previous = atomic_exchange(&current_snapshot, snapshot);
+	if (previous != NULL)
+	{
+		previous->retired_next = retired_snapshots;
+		retired_snapshots = previous;
+	}
+
+	/*
+	 * Readers pin for a few loads, so the wait is short.  A publisher that
+	 * holds a pin itself would wait for itself; its snapshots are freed by
+	 * the next publish instead.
+	 */
+	if (pin_depth == 0)
+	{
+		config_synchronize();
+		config_free_retired();
+	}
+	pthread_mutex_unlock(&publish_mutex);
+
+	rale_debug_log("Published configuration snapshot (keep_alive_interval=%u, keep_alive_timeout=%u)",
+				   config->dstore.keep_alive_interval, config->dstore.keep_alive_timeout);
+	return 0;
+}
+
+void
+config_snapshot_cleanup(void)
+{
+	config_snapshot_t *snapshot;
+
+	pthread_mutex_lock(&publish_mutex);
+	snapshot = atomic_exchange(&current_snapshot, NULL);
+	if (snapshot != NULL)
+		rfree((void **) &snapshot);
+	config_free_retired();
+	pthread_mutex_unlock(&publish_mutex);
+}
@@ -13,6 +13,8 @@
 /** System headers */
 #include <sys/stat.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
 
 /** Constants */
 #define SAFE_DB_FILE                 (global_cluster_db.db_file[0] ? global_cluster_db.db_file : "<unset>")
@@ -31,12 +33,20 @@
 /** Static variables */
 static pthread_mutex_t db_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/** Change notification: writers bump the count, and wake waiters if any */
+static _Atomic uint64_t db_changes = 0;
+static _Atomic int db_waiters = 0;
+static pthread_mutex_t db_change_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t db_change_cond;
+static pthread_once_t db_change_once = PTHREAD_ONCE_INIT;
+
 /** Global variables */
 cluster_db_t global_cluster_db;
 
 /** Function declarations */
 static int db_load_nolock(char *errbuf, size_t errbuflen);
 static void db_destroy(void);
+static void db_notify_change(void);
 
 int
 db_init(const config_t *config)
@@ -67,14 +77,29 @@ db_init(const config_t *config)
 			 config->db.path, CLUSTER_DB_FILE);
 	global_cluster_db.db_file[sizeof(global_cluster_db.db_file) - 1] = '\0';
 
-	/** Allocate and initialize the hash table */
-	global_cluster_db.hash_table = (hash_table_t *) rmalloc(sizeof(hash_table_t));
-	if (global_cluster_db.hash_table == NULL)
+	/** Open the configured storage engine */
+	if (config->db.storage_engine == STORAGE_ENGINE_LSM)
+	{
+		global_cluster_db.ops = &lsm_engine_ops;
+	}
+	else
 	{
+		global_cluster_db.ops = &hash_engine_ops;
+	}
+	global_cluster_db.engine = global_cluster_db.ops->open(config, NULL, 0);
+	if (global_cluster_db.engine == NULL)
+	{
+		global_cluster_db.ops = NULL;
 		pthread_mutex_unlock(&db_mutex);
-		return DB_ERR_NO_MEM;
+		return DB_ERR_FILE_IO;
+	}
+
+	/** A persistent engine reopened its own files; rale.db is for the others */
+	if (global_cluster_db.ops->persistent)
+	{
+		pthread_mutex_unlock(&db_mutex);
+		return DB_INIT_LOADED_OK;
 	}
-	hash_init(global_cluster_db.hash_table, NULL, 0);
 
 	/** Check if the cluster storage file exists */
 	if (db_initialized(NULL, 0))
@@ -96,14 +121,23 @@ db_init(const config_t *config)
 }
 
 /**
- * Internal function to load data from the database file into the hash table.
+ * Internal function to load data from the database file into the engine.
  */
 static int
 db_load_nolock(char *errbuf, size_t errbuflen)
 {
 	int			hash_load_ret;
 
-	hash_load_ret = hash_load(global_cluster_db.hash_table, global_cluster_db.db_file, errbuf, errbuflen);
+	if (global_cluster_db.engine == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Cluster storage is not initialized");
+		}
+		return DB_ERR_GENERAL;
+	}
+	hash_load_ret = global_cluster_db.ops->load(global_cluster_db.engine, global_cluster_db.db_file,
+												errbuf, errbuflen);
 	if (hash_load_ret != 0)
 	{
 		if (errbuf != NULL && errbuflen > 0)
@@ -120,16 +154,21 @@ db_load_nolock(char *errbuf, size_t errbuflen)
 }
 
 /**
- * Save the hash table to the storage file.
+ * Save the engine's data to the storage file.
  */
 int
 db_save(char *errbuf, size_t errbuflen)
 {
-	int			hash_save_ret;
+	int			hash_save_ret = -1;
 
 	pthread_mutex_lock(&db_mutex);
 
-	hash_save_ret = hash_save(global_cluster_db.hash_table, global_cluster_db.db_file, errbuf, errbuflen);
+	if (global_cluster_db.engine != NULL)
+	{
+		hash_save_ret = global_cluster_db.ops->save(global_cluster_db.engine,
+													global_cluster_db.db_file,
+													errbuf, errbuflen);
+	}
 	if (hash_save_ret != 0)
 	{
 		if (errbuf != NULL && errbuflen > 0)
@@ -146,7 +185,7 @@ db_save(char *errbuf, size_t errbuflen)
 }
 
 /**
- * Load the hash table from the storage file.
+ * Load the storage file into the engine.
  */
 int
 db_load(char *errbuf, size_t errbuflen)
@@ -208,9 +247,12 @@ db_initialized(char *errbuf, size_t errbuflen)
 int
 db_get(const char *key, char *value, size_t value_size, char *errbuf, size_t errbuflen)
 {
-	int			get_ret;
+	int			get_ret = -1;
 
-	get_ret = hash_get(global_cluster_db.hash_table, key, value, value_size, errbuf, errbuflen);
+	if (global_cluster_db.engine != NULL && key != NULL && value != NULL && value_size > 0)
+	{
+		get_ret = global_cluster_db.ops->get(global_cluster_db.engine, NULL, key, value, value_size);
+	}
 	if (get_ret != 0)
 	{
 		if (errbuf != NULL && errbuflen > 0)
@@ -228,7 +270,16 @@ db_get(const char *key, char *value, size_t value_size, char *errbuf, size_t err
 int
 db_insert(const char *key, const char *value, char *errbuf, size_t errbuflen)
 {
-	hash_put(global_cluster_db.hash_table, key, value, errbuf, errbuflen);
+	/** Not opened: the write only reaches rale.db, as it always has */
+	if (global_cluster_db.engine == NULL)
+	{
+		return DB_SUCCESS;
+	}
+	if (global_cluster_db.ops->put(global_cluster_db.engine, key, value, errbuf, errbuflen) != 0)
+	{
+		return DB_ERR_GENERAL;
+	}
+	db_notify_change();
 	return DB_SUCCESS;
 }
 
@@ -238,10 +289,196 @@ db_insert(const char *key, const char *value, char *errbuf, size_t errbuflen)
 int
 db_delete(const char *key, char *errbuf, size_t errbuflen)
 {
-	hash_delete(global_cluster_db.hash_table, key, errbuf, errbuflen);
+	if (global_cluster_db.engine == NULL)
+	{
+		return DB_SUCCESS;
+	}
+	/** A missing key is not an error; only a failed write is */
+	if (global_cluster_db.ops->remove(global_cluster_db.engine, key, errbuf, errbuflen) != 0 &&
+		global_cluster_db.ops->persistent)
+	{
+		return DB_ERR_GENERAL;
+	}
+	db_notify_change();
 	return DB_SUCCESS;
 }
 
+/**
+ * Count a write and wake db_wait_for_change().  The mutex is only taken
+ * while somebody waits, so ordinary writes pay one atomic increment.
+ */
+static void
+db_notify_change(void)
+{
+	atomic_fetch_add(&db_changes, 1);
+	if (atomic_load(&db_waiters) > 0)
+	{
+		pthread_mutex_lock(&db_change_mutex);
+		pthread_cond_broadcast(&db_change_cond);
+		pthread_mutex_unlock(&db_change_mutex);
+	}
+}
+
+static void
+db_change_cond_init(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&db_change_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Number of writes applied so far; pass it to db_wait_for_change().
+ */
+uint64_t
+db_change_count(void)
+{
+	return atomic_load(&db_changes);
+}
+
+/**
+ * Wait up to timeout_ms for a write after the one db_change_count()
+ * returned seen for.  Returns 0 once there was one, 1 on timeout.
+ */
+int
+db_wait_for_change(uint64_t seen, int timeout_ms)
+{
+	struct timespec ts;
+	int			ret = 0;
+
+	pthread_once(&db_change_once, db_change_cond_init);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&db_change_mutex);
+	atomic_fetch_add(&db_waiters, 1);
+	while (ret == 0 && atomic_load(&db_changes) == seen)
+	{
+		ret = pthread_cond_timedwait(&db_change_cond, &db_change_mutex, &ts);
+	}
+	atomic_fetch_sub(&db_waiters, 1);
+	pthread_mutex_unlock(&db_change_mutex);
+	return atomic_load(&db_changes) != seen ? 0 : 1;
+}
+
+/**
+ * Wait up to timeout_ms for key to differ from seen, where a NULL seen
+ * stands for an absent key.  Returns 0 with the new value copied, 1 if the
+ * key is now absent, and 2 if it still matched seen at the deadline.
+ */
+int
+db_watch(const char *key, const char *seen, int timeout_ms, char *value, size_t value_size)
+{
+	struct timespec ts;
+	int64_t		deadline_ms;
+	int64_t		remaining_ms;
+	uint64_t	changes;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	deadline_ms = (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + timeout_ms;
+	for (;;)
+	{
+		/** Read the count first, so a write after the get still wakes us */
+		changes = db_change_count();
+		if (db_get(key, value, value_size, NULL, 0) == 0)
+		{
+			if (seen == NULL || strcmp(value, seen) != 0)
+			{
+				return 0;
+			}
+		}
+		else if (seen != NULL)
+		{
+			return 1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		remaining_ms = deadline_ms - ((int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+		if (remaining_ms <= 0 || db_wait_for_change(changes, (int) remaining_ms) != 0)
+		{
+			return 2;
+		}
+	}
+}
+
+/**
+ * Walk one partition of the cluster storage, resuming from *cursor.
+ */
+int
+db_scan(uint32_t partition, uint32_t partitions, uint64_t *cursor,
+		hash_scan_cb cb, void *arg, char *errbuf, size_t errbuflen)
+{
+	if (global_cluster_db.engine == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Cluster storage is not initialized");
+		}
+		return DB_ERR_GENERAL;
+	}
+
+	return global_cluster_db.ops->scan(global_cluster_db.engine, partition, partitions,
+									   cursor, cb, arg, errbuf, errbuflen);
+}
+
+/**
+ * Counters of the key filter in front of lookups; all zero without one.
+ */
+void
+db_filter_stats(bloom_stats_t *stats)
+{
+	hash_filter_stats(global_cluster_db.ops == &hash_engine_ops ?
+					  engine_hash_table(global_cluster_db.engine) : NULL, stats);
+}
+
+/**
+ * Counters of the value log; all zero without one.
+ */
+void
+db_value_log_stats(vlog_stats_t *stats)
+{
+	vlog_get_stats(global_cluster_db.ops == &hash_engine_ops ?
+				   engine_hash_value_log(global_cluster_db.engine) : NULL, stats);
+}
+
+/**
+ * Name of the storage engine in use, "hash" before db_init().
+ */
+const char *
+db_engine_name(void)
+{
+	return global_cluster_db.ops != NULL ? global_cluster_db.ops->name : hash_engine_ops.name;
+}
+
+/**
+ * Whether the engine keeps its own data, so rale.db is neither loaded nor
+ * written.
+ */
+bool
+db_persistent(void)
+{
+	return global_cluster_db.ops != NULL && global_cluster_db.ops->persistent;
+}
+
+/**
+ * Counters of the LSM engine; all zero with another engine.
+ */
+void
+db_lsm_stats(lsm_stats_t *stats)
+{
+	lsm_get_stats(global_cluster_db.ops == &lsm_engine_ops ?
+				  engine_lsm(global_cluster_db.engine) : NULL, stats);
+}
+
 /**
  * Finalize the cluster database.
  */
@@ -261,11 +498,11 @@ static void
 db_destroy(void)
 {
 	pthread_mutex_lock(&db_mutex);
-	if (global_cluster_db.hash_table != NULL)
+	if (global_cluster_db.engine != NULL)
 	{
-		hash_destroy(global_cluster_db.hash_table, NULL, 0);
-		rfree((void **) &global_cluster_db.hash_table);
-		global_cluster_db.hash_table = NULL;
+		global_cluster_db.ops->close(global_cluster_db.engine);
+		global_cluster_db.engine = NULL;
+		global_cluster_db.ops = NULL;
 	}
 	pthread_mutex_unlock(&db_mutex);
 }
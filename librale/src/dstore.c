@@ -32,14 +32,25 @@
 
 /** System headers */
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <time.h>
+#include <unistd.h>
 
 /** Local headers */
 #include "librale_internal.h"
 #include "shutdown.h"
+#include "trace.h"
+#include "probes.h"
+#include "wal.h"
+#include "batch.h"
+#include "lease.h"
 
 /** Constants */
 #define MODULE							"DSTORE"
@@ -47,15 +58,63 @@
 #define MAX_NODES					10
 #define KEEP_ALIVE_MESSAGE			"KEEP_ALIVE"
 #define CONNECTION_RETRY_INTERVAL	5		/** Retry connections every 5 seconds */
-#define REPLICATION_MESSAGE_BUFFER_SIZE (MAX_KEY_SIZE + MAX_VALUE_SIZE + 10)
-	/** "PUT " + key + "=" + value + null + leeway */
+#define REPLICATION_MESSAGE_BUFFER_SIZE (TRACE_CONTEXT_LENGTH + MAX_KEY_SIZE + MAX_VALUE_SIZE + 40)
+	/** Optional trace context + "REPLICATE <index> " + key + "=" + value + null + leeway */
+#define RALE_DB_LINE_SIZE			(MAX_KEY_SIZE + MAX_VALUE_SIZE + 2)
+	/** key + "=" + value + newline + null; keys and values carry their own null */
+#define REPLICATE_PREFIX			"REPLICATE "
+#define REPLICATE_LEASE_PREFIX		"REPLICATE_LEASE "
+	/** "REPLICATE_LEASE <index> GRANT <id> <ttl>|PUT <id> key=value|REVOKE <id>|EXPIRE <id>|RESET 0" */
+#define REPLICATE_LINE_OVERHEAD		(sizeof(REPLICATE_LEASE_PREFIX) + 64)
+	/** Index, lease operation and id around an entry's key and value */
+#define LEASE_EXPIRE_MAX			64		/** Leases expired per checkpoint */
+#define REPLICATION_ACK_PREFIX		"REPL_ACK "
+#define REPLICA_PENDING_MAX			256		/** Unacknowledged entries timed per follower */
+#define CATCHUP_PREFIX				"CATCHUP "	/** "CATCHUP <index>" opens a snapshot stream */
+#define CATCHUP_ENTRY_PREFIX		"CATCHUP_KV "	/** One "key=value" of the snapshot */
+#define CATCHUP_END					"CATCHUP_END"
+#define CATCHUP_CHUNK_SIZE			(64 * 1024)	/** Snapshot bytes sent to a follower per tick */
+#define CATCHUP_LINE_SIZE			(sizeof(CATCHUP_ENTRY_PREFIX) + RALE_DB_LINE_SIZE)
 
 /** Default keep-alive interval if not configured */
 #define DEFAULT_KEEP_ALIVE_INTERVAL 5
 
+/** An entry sent to a follower and not yet acknowledged */
+typedef struct replica_pending_t
+{
+	uint64_t	index;
+	uint64_t	sent_us;
+	uint32_t	bytes;
+	bool		acked;			/** Acknowledged past a missing entry */
+} replica_pending_t;
+
+/** Leader-side replication progress of one follower, by node index */
+typedef struct replica_progress_t
+{
+	uint64_t	sent_index;
+	uint64_t	match_index;
+	uint64_t	bytes_in_flight;
+	uint64_t	last_ack_us;		/** 0 until the first acknowledgement */
+	uint64_t	rtt_ewma_us;
+	uint64_t	gap_index;		/** First entry missing below an acknowledged one, or 0 */
+	bool		based;			/** match_index is known for this connection */
+	uint32_t	pending_head;
+	uint32_t	pending_count;
+	replica_pending_t pending[REPLICA_PENDING_MAX];
+} replica_progress_t;
+
 /** Static variables */
 static tcp_server_t *tcp_server_ptr;
 static tcp_client_t *tcp_clients[MAX_NODES];
+
+/**
+ * One lock per peer over sends, connects and teardown on tcp_clients[].
+ * Commit rounds send from the REST threads while the loop thread sends
+ * keep-alives, catch-up and leases on the same socket.  Recursive, since
+ * a failed send tears the connection down from inside tcp_client_send().
+ */
+static pthread_mutex_t client_mutex[MAX_NODES];
+static pthread_once_t client_mutex_once = PTHREAD_ONCE_INIT;
 static config_t dstore_config;
 static time_t last_keep_alive_sent[MAX_NODES];	/** Track last keep-alive time for each node */
 static int connection_status[MAX_NODES];		/** Track connection status for each node */
@@ -63,15 +122,72 @@ static time_t last_connection_attempt[MAX_NODES];	/** Track connection attempt t
 static int connection_attempt_count[MAX_NODES];	/** Track connection attempt count */
 static int client_socket_to_node[TCP_SERVER_MAX_CLIENTS];	/** Map client socket index to node ID */
 
+/** Unterminated tail of the last read on each server slot */
+static char server_carry[TCP_SERVER_MAX_CLIENTS][REPLICATION_MESSAGE_BUFFER_SIZE];
+static size_t server_carry_len[TCP_SERVER_MAX_CLIENTS];
+
+/** Same for each client connection; only the loop thread reads them */
+static char client_carry[MAX_NODES][REPLICATION_MESSAGE_BUFFER_SIZE];
+static size_t client_carry_len[MAX_NODES];
+
+/** Follower: the catch-up stream being installed and the keys it has set */
+static int catchup_slot = -1;
+static hash_table_t *catchup_keys;
+static uint64_t catchup_entries;
+
+/** Leader: a snapshot being sent to one follower */
+typedef struct catchup_job_t
+{
+	bool		active;
+	FILE	   *file;			/** CATCHUP_KV lines, each newline-terminated; unlinked */
+	off_t		size;
+	off_t		sent;
+	off_t	   *cuts;			/** End of each chunk, on a line boundary */
+	size_t		ncuts;
+	size_t		cuts_cap;
+	size_t		next_cut;
+	uint64_t	entries;
+	uint64_t	index;			/** Replication index the snapshot covers */
+} catchup_job_t;
+
+static catchup_job_t catchup_jobs[MAX_NODES];
+
+/** Replication telemetry; written by the send and ack paths, read by STATUS */
+static pthread_mutex_t replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+static replica_progress_t replica_progress[MAX_NODES];
+static uint64_t replication_index;		/** Entries replicated by this node */
+
+/** Newest replication index applied here, as leader or follower */
+static _Atomic uint64_t applied_index;
+static _Atomic int applied_waiters;
+static pthread_mutex_t applied_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t applied_cond;
+static pthread_once_t applied_once = PTHREAD_ONCE_INIT;
+
+/** Revision of this thread's last write committed here, 0 if none */
+static __thread uint64_t write_revision;
+
+/** Reloadable settings read on every tick, through the published snapshot */
+static const config_handle_t keep_alive_interval_handle = CONFIG_HANDLE(dstore.keep_alive_interval);
+static const config_handle_t forward_writes_handle = CONFIG_HANDLE(dstore.forward_writes);
+
 /** Helper function to get current keep-alive interval */
 static int
 get_keep_alive_interval(void)
 {
-	/** Use configuration if available, otherwise fall back to default */
-	if (dstore_config.dstore.keep_alive_interval > 0)
-		                return (int)dstore_config.dstore.keep_alive_interval;
+	int			interval = config_get_int(keep_alive_interval_handle, &dstore_config);
+
+	return interval > 0 ? interval : DEFAULT_KEEP_ALIVE_INTERVAL;
+}
 
-	return DEFAULT_KEEP_ALIVE_INTERVAL;
+/**
+ * Whether a follower proxies writes to the leader itself rather than
+ * telling the writer where the leader is.
+ */
+static bool
+dstore_forward_writes(void)
+{
+	return config_get_int(forward_writes_handle, &dstore_config) != 0;
 }
 
 /** Function prototypes */
@@ -96,6 +212,7 @@ static void dstore_client_on_disconnection(
 static void dstore_init_client(uint32_t node_idx);
 static int dstore_init_server(int port);
 static void dstore_save_to_rale_db(const char *key, const char *value);
+static int dstore_format_rale_db_line(const char *key, const char *value, char *line, size_t size);
 
 static void dstore_send_keep_alive(void);
 static void dstore_server_send_keep_alive(void);
@@ -180,6 +297,30 @@ int dstore_propagate_node_addition(int32_t new_node_id, const char *name,
 int dstore_propagate_node_removal(int node_id);
 static int dstore_handle_propagated_add(const char *command);
 static int dstore_handle_propagated_remove(const char *command);
+static void dstore_apply_frame(const char *frame, int client_sock_idx);
+static void dstore_apply_replicated(const char *command, int client_sock_idx);
+static void dstore_apply_lease(const char *command, int client_sock_idx);
+static void dstore_ack_replicated(uint64_t index, int client_sock_idx);
+static void dstore_ship_leases(uint32_t node_idx);
+static void dstore_lease_tick(void);
+static void dstore_replica_sent(uint32_t node_idx, uint64_t index, size_t bytes);
+static void dstore_replica_acked(uint32_t node_idx, uint64_t index);
+static void dstore_replica_reset(uint32_t node_idx);
+static void dstore_replica_caught_up(uint32_t node_idx, uint64_t index);
+static void dstore_start_catchup(uint32_t node_idx);
+static void dstore_pump_catchup(void);
+static void dstore_pump_catchup_one(uint32_t node_idx);
+static void dstore_catchup_begin(int client_sock_idx, const char *entries);
+static void dstore_catchup_touch(const char *key);
+static void dstore_apply_catchup_line(const char *line);
+static void dstore_catchup_end(void);
+static void dstore_catchup_abort(void);
+static void dstore_reset_server_slot(int client_sock_idx);
+static void dstore_send_frame(const char *frame, uint64_t first_index,
+							  const uint32_t *entry_bytes, int count);
+static void dstore_commit_batch(batch_entry_t *entries, int count);
+static uint64_t dstore_reserve_indexes(uint64_t count);
+static void dstore_advance_applied(uint64_t index);
 
 /** External variables */
 extern cluster_t cluster;
@@ -188,7 +329,9 @@ extern volatile int system_exit;
 /**
  * dstore_save_to_rale_db
  *
- * Appends a key-value pair to the rale.db file in the configured database path.
+ * Appends a key-value pair to the rale.db file in the configured database
+ * path, through the writer opened by dstore_init().  Nothing is appended
+ * when the storage engine keeps its own log (storage_engine = lsm).
  *
  * @param key   The key to store.
  * @param value The value to store.
@@ -196,24 +339,34 @@ extern volatile int system_exit;
 static void
 dstore_save_to_rale_db(const char *key, const char *value)
 {
-	char db_path[512];
-	FILE *fp;
+	char kv_line[RALE_DB_LINE_SIZE];
+	int len;
 
-	/** Construct path to rale.db in the configured database path */
-	snprintf(db_path, sizeof(db_path), "%s/rale.db",
-		dstore_config.db.path);
+	if (db_persistent())
+		return;
+	len = dstore_format_rale_db_line(key, value, kv_line, sizeof(kv_line));
+	if (len > 0)
+		(void) wal_append(kv_line, (size_t) len);
+}
 
-	fp = fopen(db_path, "a");
-	if (fp == NULL)
+/**
+ * Format the rale.db record for key into line; returns its length, or -1.
+ */
+static int
+dstore_format_rale_db_line(const char *key, const char *value, char *line, size_t size)
+{
+	int len;
+
+	len = snprintf(line, size, "%s=%s\n", key, value);
+	if (len < 0)
+		return -1;
+	if ((size_t) len >= size)
 	{
-		return;
+		/** Truncated records still end at a newline */
+		len = (int) size - 1;
+		line[len - 1] = '\n';
 	}
-
-	/** Write key-value pair to file */
-	char kv_line[1024];
-	snprintf(kv_line, sizeof(kv_line), "%s=%s\n", key, value);
-	fputs(kv_line, fp);
-	fclose(fp);
+	return len;
 }
 
 int
@@ -274,6 +427,20 @@ dstore_init(const uint16_t dstore_port, const config_t *config)
 		return -1;
 	}
 	
+	/** Keep rale.db open; a failure here only costs persistence */
+	{
+		char db_path[512];
+		char wal_err[256];
+
+		snprintf(db_path, sizeof(db_path), "%s/rale.db", dstore_config.db.path);
+		if (wal_open(db_path, (wal_backend_t) dstore_config.wal.backend,
+					 dstore_config.wal.sync, wal_err, sizeof(wal_err)) != 0)
+			rale_debug_log("rale.db writer not opened: %s", wal_err);
+	}
+
+	/** Writes accepted as leader go through the group commit */
+	batch_init(dstore_commit_batch);
+
 	dlog_init();
 	return 0;
 }
@@ -327,6 +494,32 @@ dstore_init_server(int port)
 	return 0;
 }
 
+static void
+dstore_client_mutex_init(void)
+{
+	pthread_mutexattr_t attr;
+	uint32_t	i;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	for (i = 0; i < MAX_NODES; i++)
+		pthread_mutex_init(&client_mutex[i], &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static void
+dstore_lock_client(uint32_t node_idx)
+{
+	pthread_once(&client_mutex_once, dstore_client_mutex_init);
+	pthread_mutex_lock(&client_mutex[node_idx]);
+}
+
+static void
+dstore_unlock_client(uint32_t node_idx)
+{
+	pthread_mutex_unlock(&client_mutex[node_idx]);
+}
+
 /**
  * Initialize a client connection to a specific node (by index).
  */
@@ -365,8 +558,11 @@ dstore_init_client(uint32_t node_idx)
 		return;
 	}
 
+	/** The loop thread and a commit round may both find the slot empty */
+	dstore_lock_client(node_idx);
 	if (tcp_clients[node_idx] != NULL)
 	{
+		dstore_unlock_client(node_idx);
 		rale_debug_log("DStore client connection already established for node index %d (requesting node: %d)",
 			node_idx, cluster.self_id);
 		return;
@@ -385,6 +581,7 @@ dstore_init_client(uint32_t node_idx)
 										   dstore_client_on_receive,
 										   dstore_client_on_disconnection,
 										   NULL, 0);
+	dstore_unlock_client(node_idx);
 	if (tcp_clients[node_idx] == NULL)
 	{
 		rale_debug_log("failed to create TCPClient for node_idx %d (IP: %s, Port: %d) from self_id %d",
@@ -410,6 +607,7 @@ dstore_server_on_connection(
 	rale_debug_log(
 		"New DStore client connection established: socket index %d from %s:%d",
 		client_sock_idx, client_ip, client_port);
+	dstore_reset_server_slot(client_sock_idx);
 
 	/** Find which node this connection belongs to */
 	for (i = 0; i < cluster.node_count; i++)
@@ -481,21 +679,64 @@ dstore_server_on_receive(
 	int client_sock_idx,
 	const char *message)
 {
-    char buf[1024];
+    char buf[REPLICATION_MESSAGE_BUFFER_SIZE + TCP_SERVER_BUFFER_SIZE];
     char *saveptr = NULL;
     char *line;
+    char *tail;
+    size_t len;
+    size_t add;
 
     rale_debug_log("Server (self_id %d) received from client socket_idx %d: \"%s\"",
         (cluster.self_id >= 0) ? cluster.self_id : -1, client_sock_idx,
         message);
 
-    strncpy(buf, message, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
+    if (client_sock_idx < 0 || client_sock_idx >= TCP_SERVER_MAX_CLIENTS)
+        return;
+
+    /**
+     * Frames can straddle reads (catch-up streams always do): complete the
+     * previous read's last line, and hold back this read's unterminated one.
+     */
+    len = server_carry_len[client_sock_idx];
+    memcpy(buf, server_carry[client_sock_idx], len);
+    add = strlen(message);
+    if (add > sizeof(buf) - 1 - len)
+        add = sizeof(buf) - 1 - len;
+    memcpy(buf + len, message, add);
+    len += add;
+    buf[len] = '\0';
+
+    tail = strrchr(buf, '\n');
+    tail = (tail != NULL) ? tail + 1 : buf;
+    server_carry_len[client_sock_idx] = (size_t) (buf + len - tail);
+    if (server_carry_len[client_sock_idx] >= sizeof(server_carry[client_sock_idx]))
+    {
+        rale_debug_log("Dropping overlong frame on client socket_idx %d", client_sock_idx);
+        server_carry_len[client_sock_idx] = 0;
+    }
+    memcpy(server_carry[client_sock_idx], tail, server_carry_len[client_sock_idx]);
+    *tail = '\0';
 
+    /** Every rale.db record from this read goes out in one write */
+    wal_batch_begin();
     line = strtok_r(buf, "\n", &saveptr);
     while (line != NULL)
     {
-        if (strcmp(line, KEEP_ALIVE_MESSAGE) == 0)
+        if (strncmp(line, CATCHUP_ENTRY_PREFIX, strlen(CATCHUP_ENTRY_PREFIX)) == 0)
+        {
+            if (client_sock_idx == catchup_slot)
+                dstore_apply_catchup_line(line + strlen(CATCHUP_ENTRY_PREFIX));
+        }
+        else if (strcmp(line, CATCHUP_END) == 0)
+        {
+            if (client_sock_idx == catchup_slot)
+                dstore_catchup_end();
+        }
+        else if (strncmp(line, CATCHUP_PREFIX, strlen(CATCHUP_PREFIX)) == 0)
+        {
+            dstore_catchup_begin(client_sock_idx, line + strlen(CATCHUP_PREFIX));
+        }
+        else if (strcmp(line, KEEP_ALIVE_MESSAGE) == 0)
         {
             rale_debug_log(
                 "DStore keep-alive received: Server (Node %d) from client socket %d",
@@ -534,7 +775,9 @@ dstore_server_on_receive(
             /*
              * Key-value commands:
              * - GET key           → respond VALUE/NOT_FOUND
-             * - DELETE key        → leader applies, replicates; follower forwards
+             * - DELETE key        → leader applies, replicates; a follower
+             *                       applies it from the leader, otherwise
+             *                       answers NOT_LEADER (or forwards)
              * - FORWARD_DELETE k  → leader applies and replicates (from follower)
              * - PUT key=value     → existing handler
              */
@@ -562,24 +805,39 @@ dstore_server_on_receive(
             {
                 const int   is_forward = (strncmp(line, "FORWARD_DELETE ", 15) == 0);
                 const char *key = line + (is_forward ? 15 : 7);
+                int         current_leader = dstore_get_current_leader();
 
-                if (!is_forward && !dstore_is_current_leader())
+                if (!is_forward && current_leader != cluster.self_id &&
+                    current_leader != -1 &&
+                    client_socket_to_node[client_sock_idx] == current_leader)
+                {
+                    /** The leader replicating its own delete */
+                    (void) db_delete(key, NULL, 0);
+                    lease_detach(key);
+                    dstore_catchup_touch(key);
+                }
+                else if (!is_forward && current_leader != cluster.self_id)
                 {
-                    int current_leader = dstore_get_current_leader();
-                    if (current_leader != -1 && current_leader != cluster.self_id)
+                    uint32_t leader_idx = find_node_index_by_id(current_leader);
+
+                    if (dstore_forward_writes() &&
+                        leader_idx != MAX_NODES && connection_status[leader_idx] == 1)
                     {
-                        uint32_t leader_idx = find_node_index_by_id(current_leader);
-                        if (leader_idx != MAX_NODES && connection_status[leader_idx] == 1)
-                        {
-                            char fwd[512];
-                            snprintf(fwd, sizeof(fwd), "FORWARD_DELETE %s", key);
-                            dstore_send_message(leader_idx, fwd);
-                        }
+                        char fwd[512];
+                        snprintf(fwd, sizeof(fwd), "FORWARD_DELETE %s", key);
+                        dstore_send_message(leader_idx, fwd);
+                    }
+                    else if (tcp_server_ptr != NULL)
+                    {
+                        char resp[512];
+                        dstore_not_leader(resp, sizeof(resp));
+                        tcp_server_send(tcp_server_ptr, client_sock_idx, resp);
                     }
                 }
                 else
                 {
                     (void) db_delete(key, NULL, 0);
+                    lease_detach(key);
 
                     {
                         char msg[512];
@@ -596,11 +854,12 @@ dstore_server_on_receive(
             }
             else
             {
-                dstore_put_from_command(line, NULL, 0);
+                dstore_apply_frame(line, client_sock_idx);
             }
         }
         line = strtok_r(NULL, "\n", &saveptr);
     }
+    (void) wal_batch_end();
 }
 
 static void
@@ -608,17 +867,52 @@ dstore_client_on_receive(
 	int client_sock,
 	const char *message)
 {
-    char buf[1024];
+    char buf[REPLICATION_MESSAGE_BUFFER_SIZE + TCP_CLIENT_BUFFER_SIZE];
     char *saveptr = NULL;
     char *line;
+    char *tail;
+    size_t len;
+    size_t add;
+    uint32_t node_idx = MAX_NODES;
 
     rale_debug_log("Client (self_id %d) received from server_sock %d: \"%s\"",
         (cluster.self_id >= 0) ? cluster.self_id : -1, client_sock,
         message);
 
-    strncpy(buf, message, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
+    for (uint32_t i = 0; i < cluster.node_count && i < MAX_NODES; i++)
+    {
+        if (tcp_clients[i] != NULL && tcp_clients[i]->sock == client_sock)
+        {
+            node_idx = i;
+            break;
+        }
+    }
+    if (node_idx == MAX_NODES)
+        return;
+
+    /** Acks and frames straddle reads too; carry the unterminated line */
+    len = client_carry_len[node_idx];
+    memcpy(buf, client_carry[node_idx], len);
+    add = strlen(message);
+    if (add > sizeof(buf) - 1 - len)
+        add = sizeof(buf) - 1 - len;
+    memcpy(buf + len, message, add);
+    len += add;
+    buf[len] = '\0';
+
+    tail = strrchr(buf, '\n');
+    tail = (tail != NULL) ? tail + 1 : buf;
+    client_carry_len[node_idx] = (size_t) (buf + len - tail);
+    if (client_carry_len[node_idx] >= sizeof(client_carry[node_idx]))
+    {
+        rale_debug_log("Dropping overlong frame from node_idx %d", node_idx);
+        client_carry_len[node_idx] = 0;
+    }
+    memcpy(client_carry[node_idx], tail, client_carry_len[node_idx]);
+    *tail = '\0';
 
+    /** Every rale.db record from this read goes out in one write */
+    wal_batch_begin();
     line = strtok_r(buf, "\n", &saveptr);
     while (line != NULL)
     {
@@ -628,782 +922,2380 @@ dstore_client_on_receive(
                 "DStore keep-alive received: Client (Node %d) from server socket %d",
                 cluster.self_id, client_sock);
         }
+        else if (strncmp(line, REPLICATION_ACK_PREFIX, strlen(REPLICATION_ACK_PREFIX)) == 0)
+        {
+            uint64_t index = strtoull(line + strlen(REPLICATION_ACK_PREFIX), NULL, 10);
+
+            dstore_replica_acked(node_idx, index);
+        }
         else if (*line != '\0')
         {
-            dstore_put_from_command(line, NULL, 0);
+            dstore_apply_frame(line, -1);
         }
         line = strtok_r(NULL, "\n", &saveptr);
     }
+    (void) wal_batch_end();
 }
 
 /**
- * Main loop for client connections. Attempts to connect/reconnect to other nodes.
+ * Apply one frame received from a peer.  A frame from a sampled request
+ * carries its trace id, and the work done here joins that trace.
+ * client_sock_idx is the server slot it arrived on, -1 for frames read
+ * from our own client connections.
  */
-int
-dstore_client_loop(char *errbuf, size_t errbuflen)
+static void
+dstore_apply_frame(const char *frame, int client_sock_idx)
 {
-	uint32_t i;
-	int ret;
-	time_t current_time = time(NULL);
-
-	(void) errbuf;
-	(void) errbuflen;
+	uint64_t	trace_id;
+	uint64_t	start;
+	const char *command = trace_strip_context(frame, &trace_id);
+
+	RALE_PROBE1(replication__receive, command);
+	trace_adopt(trace_id);
+	start = trace_clock();
+	if (strncmp(command, REPLICATE_PREFIX, strlen(REPLICATE_PREFIX)) == 0)
+		dstore_apply_replicated(command, client_sock_idx);
+	else if (strncmp(command, REPLICATE_LEASE_PREFIX, strlen(REPLICATE_LEASE_PREFIX)) == 0)
+		dstore_apply_lease(command, client_sock_idx);
+	else if (strncmp(command, LEASE_RENEW_PREFIX, strlen(LEASE_RENEW_PREFIX)) == 0)
+		lease_apply_renewals(command + strlen(LEASE_RENEW_PREFIX));
+	else
+		dstore_put_from_command(command, NULL, 0);
+	trace_span(TRACE_STAGE_FOLLOWER_APPLY, start);
+	trace_end();
+}
 
-	if (cluster.node_count == 0) /** Use cluster.node_count */
+/**
+ * Apply an entry replicated by the leader, "REPLICATE <index> key=value",
+ * and acknowledge it on the connection it arrived on.  A failed apply is
+ * not acknowledged, so it shows up as lag on the leader.
+ */
+static void
+dstore_apply_replicated(const char *command, int client_sock_idx)
+{
+	const char *kv;
+	const char *separator;
+	char	   *end;
+	char		key_buf[MAX_KEY_SIZE];
+	size_t		key_len;
+	unsigned long long index;
+	uint64_t	stage_start;
+
+	index = strtoull(command + strlen(REPLICATE_PREFIX), &end, 10);
+	if (end == command + strlen(REPLICATE_PREFIX) || *end != ' ')
 	{
-		rale_debug_log("Cluster not initialized in dstore_client_loop.");
-		return -1; /** Or some other appropriate action */
+		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+			"Malformed replication frame: \"%s\".", command);
+		return;
 	}
 
-	/** Check if we have other nodes to connect to */
-	if (cluster.node_count == 1)
+	kv = end + 1;
+	separator = strchr(kv, '=');
+	key_len = (separator != NULL) ? (size_t)(separator - kv) : 0;
+	if (key_len == 0 || key_len >= sizeof(key_buf) || strlen(separator + 1) >= MAX_VALUE_SIZE)
 	{
-    	return 0; /** No other nodes to connect to */
+		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+			"Invalid key or value in replicated entry %llu.", index);
+		return;
 	}
+	memcpy(key_buf, kv, key_len);
+	key_buf[key_len] = '\0';
 
-	/** Add a small delay to ensure server is fully ready */
-	static int first_run = 1;
-	if (first_run)
+	stage_start = trace_clock();
+	if (db_insert(key_buf, separator + 1, NULL, 0) < 0)
 	{
-		rale_debug_log("%s", "First client loop run, ensuring server is ready...");
-		first_run = 0;
-		return 0; /** Skip first run to let server fully initialize */
+		rale_set_error_fmt(RALE_ERROR_DB_WRITE, MODULE,
+			"Failed to apply replicated entry %llu (key '%s').", index, key_buf);
+		return;
 	}
+	lease_detach(key_buf);
+	dstore_catchup_touch(key_buf);
+	trace_span(TRACE_STAGE_LOCAL_APPLY, stage_start);
+
+	stage_start = trace_clock();
+	dstore_save_to_rale_db(key_buf, separator + 1);
+	trace_span(TRACE_STAGE_PERSIST, stage_start);
+	dstore_ack_replicated((uint64_t) index, client_sock_idx);
+}
 
-	/** Handle peer-to-peer connections for all nodes */
-	for (i = 0; i < MAX_NODES; i++)
-	{
-		if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
-			cluster.nodes[i].id == cluster.self_id)
-		{
-			continue;
-		}
-
-		/**
-		 * Initiate client connections to all peers (except self). Allowing
-		 * bidirectional TCP links ensures each node can independently mark
-		 * peers online and avoids asymmetric "offline" views.
-		 */
+/** lease_key_cb: a revoked lease's key goes too */
+static void
+dstore_delete_leased(const char *key, void *arg)
+{
+	(void) arg;
+	(void) db_delete(key, NULL, 0);
+	dstore_catchup_touch(key);
+}
 
-		if (tcp_clients[i] == NULL)
-		{
-			                                                                        dstore_init_client(i);
-			if (tcp_clients[i] == NULL) /** Check if init failed */
-			{
-				char warn_msg[256];
-				snprintf(warn_msg, sizeof(warn_msg), 
-					"Failed to initialize client for node_idx %d in client loop",
-					i);
-				/* Warning: initialization failed for TCP client */
-				continue;
-			}
-		}
+/**
+ * lease_key_cb for a RESET: keys of our own leases go, but unlike a
+ * revocation this is not newer than the catch-up snapshot, which may
+ * still bring the key back.
+ */
+static void
+dstore_drop_leased(const char *key, void *arg)
+{
+	(void) arg;
+	(void) db_delete(key, NULL, 0);
+}
 
-		if (tcp_clients[i]->is_connected == 1)
-		{
-			tcp_client_run(tcp_clients[i]); /** Process any incoming messages for this client */
-			continue;
-		}
+/**
+ * Apply a lease operation replicated by the leader, "REPLICATE_LEASE
+ * <index> <op> <id> ...", and acknowledge it.  Index 0 marks the table
+ * shipped after a catch-up, which is neither numbered nor acknowledged.
+ * Leased keys stay out of rale.db.
+ */
+static void
+dstore_apply_lease(const char *command, int client_sock_idx)
+{
+	char		op[8];
+	char		key_buf[MAX_KEY_SIZE];
+	const char *separator;
+	unsigned long long index;
+	unsigned long long id;
+	int			consumed = 0;
+	int			ttl;
+
+	if (sscanf(command + strlen(REPLICATE_LEASE_PREFIX), "%llu %7s %llu %n",
+			   &index, op, &id, &consumed) != 3 || consumed == 0)
+	{
+		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+			"Malformed lease replication frame: \"%s\".", command);
+		return;
+	}
 
-		/** Check if enough time has passed since last connection attempt */
-		/** Use exponential backoff for persistent failures */
-		int retry_interval = CONNECTION_RETRY_INTERVAL;
-		if (connection_attempt_count[i] > 5) {
-			retry_interval = CONNECTION_RETRY_INTERVAL * 2; /** 10 seconds after 5 failures */
-		}
-		if (connection_attempt_count[i] > 10) {
-			retry_interval = CONNECTION_RETRY_INTERVAL * 4; /** 20 seconds after 10 failures */
-		}
-		
-		if (current_time - last_connection_attempt[i] < retry_interval)
+	if (strcmp(op, "GRANT") == 0)
+	{
+		ttl = atoi(command + strlen(REPLICATE_LEASE_PREFIX) + consumed);
+		if (lease_grant((uint64_t) id, ttl) < 0)
 		{
-			continue; /** Wait before retrying */
-		}
-
-		last_connection_attempt[i] = current_time;
-		connection_attempt_count[i]++;
-
-		/** Attempt to connect if not connected */
-		/* Reduce logging noise - only log every 5th attempt or first attempt */
-		if (connection_attempt_count[i] == 1 || connection_attempt_count[i] % 5 == 0) {
-			rale_debug_log(
-				"Node (%d) attempting to connect to node_idx %d (IP: %s, Port: %d) - Attempt %d",
-				cluster.self_id, i, cluster.nodes[i].ip,
-				cluster.nodes[i].dstore_port, connection_attempt_count[i]);
+			rale_set_error_fmt(RALE_ERROR_OUT_OF_MEMORY, MODULE,
+				"Failed to apply lease grant %llu.", id);
+			return;
 		}
+	}
+	else if (strcmp(op, "PUT") == 0)
+	{
+		const char *kv = command + strlen(REPLICATE_LEASE_PREFIX) + consumed;
+		size_t		key_len;
 
-		ret = tcp_client_connect(tcp_clients[i],
-								cluster.nodes[i].ip,
-								cluster.nodes[i].dstore_port);
-		if (ret != 0)
+		separator = strchr(kv, '=');
+		key_len = (separator != NULL) ? (size_t) (separator - kv) : 0;
+		if (key_len == 0 || key_len >= sizeof(key_buf) || strlen(separator + 1) >= MAX_VALUE_SIZE)
 		{
-			char warn_msg[256];
-			snprintf(warn_msg, sizeof(warn_msg), 
-				"Node (%d) failed to connect to node_idx %d (IP: %s, Port: %d). "
-				"TCP connect error: %d. Server may not be ready yet. "
-				"Will retry in %d seconds.",
-				cluster.self_id, i, cluster.nodes[i].ip,
-				cluster.nodes[i].dstore_port, ret, CONNECTION_RETRY_INTERVAL);
-			/* Warning: initialization failed for TCP client */
-			connection_status[i] = 0; /** Mark as disconnected */
-			continue;
+			rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+				"Invalid key or value in replicated entry %llu.", index);
+			return;
 		}
-		
-		/** Connection successful - log with detailed information */
-		rale_debug_log(
-			"DStore connection ESTABLISHED: Our raled Node %d successfully connected to raled Node %d (%s:%d)",
-			cluster.self_id, cluster.nodes[i].id, cluster.nodes[i].ip,
-			cluster.nodes[i].dstore_port);
-		connection_status[i] = 1; /** Mark as connected */
-		cluster.nodes[i].state = NODE_STATE_CANDIDATE; /** Mark peer reachable */
-		last_keep_alive_sent[i] = current_time; /** Initialize keep-alive timer */
-		connection_attempt_count[i] = 0; /** Reset attempt count on success */
-		
-		/** Identify ourselves to the server so it can map this socket to our node_id */
+		memcpy(key_buf, kv, key_len);
+		key_buf[key_len] = '\0';
+		if (db_insert(key_buf, separator + 1, NULL, 0) < 0)
 		{
-			char hello_msg[64];
-			snprintf(hello_msg, sizeof(hello_msg), "HELLO %d", cluster.self_id);
-			tcp_client_send(tcp_clients[i], hello_msg);
-		rale_debug_log("DStore HELLO sent: Node %d -> Node %d: %s",
-			cluster.self_id, cluster.nodes[i].id, hello_msg);
+			rale_set_error_fmt(RALE_ERROR_DB_WRITE, MODULE,
+				"Failed to apply replicated entry %llu (key '%s').", index, key_buf);
+			return;
 		}
-
-		/** Send initial keep-alive message */
-		tcp_client_send(tcp_clients[i], KEEP_ALIVE_MESSAGE);
-		rale_debug_log(
-			"DStore keep-alive sent: Node %d -> Node %d",
-			cluster.self_id, cluster.nodes[i].id);
-
-		/** Send our current cluster snapshot so the server learns about all nodes */
-		                                                dstore_send_cluster_snapshot_to_target_idx(i);
+		if (lease_attach(key_buf, (uint64_t) id) < 0)
+			rale_debug_log("Key '%s' replicated under lease %llu, which is unknown here",
+				key_buf, id);
+		dstore_catchup_touch(key_buf);
 	}
-	
-	/** Send periodic keep-alive messages to all connected nodes */
-	dstore_send_keep_alive();
-	
-	return 0;
+	else if (strcmp(op, "REVOKE") == 0 || strcmp(op, "EXPIRE") == 0)
+		(void) lease_revoke((uint64_t) id, false, dstore_delete_leased, NULL);
+	else if (strcmp(op, "RESET") == 0)
+		lease_reset(dstore_drop_leased, NULL);	/** The leader's table follows */
+	else
+	{
+		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+			"Unknown lease operation in frame: \"%s\".", command);
+		return;
+	}
+
+	if (index > 0)
+		dstore_ack_replicated((uint64_t) index, client_sock_idx);
 }
 
 /**
- * Non-blocking client tick - process one client iteration
- * Called by daemon in its main loop
+ * Record a replicated entry as applied and acknowledge it on the server
+ * slot it arrived on.
  */
-int
-dstore_client_tick(void)
+static void
+dstore_ack_replicated(uint64_t index, int client_sock_idx)
+{
+	char		ack[64];
+
+	dstore_advance_applied(index);
+	if (tcp_server_ptr != NULL && client_sock_idx >= 0)
+	{
+		snprintf(ack, sizeof(ack), "%s%llu", REPLICATION_ACK_PREFIX, (unsigned long long) index);
+		(void) tcp_server_send(tcp_server_ptr, client_sock_idx, ack);
+	}
+}
+
+/**
+ * Forget the partial frame and catch-up state of a server slot.
+ */
+static void
+dstore_reset_server_slot(int client_sock_idx)
+{
+	if (client_sock_idx < 0 || client_sock_idx >= TCP_SERVER_MAX_CLIENTS)
+		return;
+	server_carry_len[client_sock_idx] = 0;
+	if (client_sock_idx == catchup_slot)
+		dstore_catchup_abort();
+}
+
+/**
+ * Follower: drop a catch-up stream cut short.  What it applied stays; the
+ * next connection from the leader starts a new one.
+ */
+static void
+dstore_catchup_abort(void)
+{
+	if (catchup_keys != NULL)
+	{
+		(void) hash_destroy(catchup_keys, NULL, 0);
+		free(catchup_keys);
+		catchup_keys = NULL;
+	}
+	catchup_slot = -1;
+	catchup_entries = 0;
+}
+
+/**
+ * Follower: "CATCHUP <index>" opened a snapshot stream on a server slot.
+ * Until CATCHUP_END, every key the stream or the leader's replication sets
+ * is recorded, so the keys outside the snapshot can be dropped at the end.
+ * The leader sends the header before it scans its table, so every write
+ * the snapshot misses is replicated after this point.
+ */
+static void
+dstore_catchup_begin(int client_sock_idx, const char *index)
+{
+	dstore_catchup_abort();
+	catchup_keys = malloc(sizeof(hash_table_t));
+	if (catchup_keys == NULL || hash_init(catchup_keys, NULL, 0) != 0)
+	{
+		free(catchup_keys);
+		catchup_keys = NULL;
+		rale_debug_log("No memory to install catch-up from client socket %d", client_sock_idx);
+		return;
+	}
+	catchup_slot = client_sock_idx;
+	rale_debug_log("DStore catch-up from client socket %d: snapshot through index %s",
+		client_sock_idx, index);
+}
+
+/**
+ * Follower: the leader replicated a write or delete of key.  Replication
+ * frames share the connection with the snapshot stream and are newer than
+ * it, so the snapshot's line for the key, if still to come, is ignored.
+ */
+static void
+dstore_catchup_touch(const char *key)
+{
+	if (catchup_keys != NULL)
+		(void) hash_put(catchup_keys, key, "R", NULL, 0);
+}
+
+/**
+ * Follower: apply one "key=value" line of the leader's snapshot.  It goes
+ * into the table only; rale.db is rewritten once the stream ends.
+ */
+static void
+dstore_apply_catchup_line(const char *line)
+{
+	const char *separator = strchr(line, '=');
+	char		key_buf[MAX_KEY_SIZE];
+	char		seen[2];
+	size_t		key_len = (separator != NULL) ? (size_t)(separator - line) : 0;
+
+	if (catchup_keys == NULL)
+		return;
+	if (key_len == 0 || key_len >= sizeof(key_buf) || strlen(separator + 1) >= MAX_VALUE_SIZE)
+	{
+		rale_debug_log("Skipping malformed catch-up line \"%s\"", line);
+		return;
+	}
+	memcpy(key_buf, line, key_len);
+	key_buf[key_len] = '\0';
+
+	if (hash_get(catchup_keys, key_buf, seen, sizeof(seen), NULL, 0) == 0)
+		return;
+	if (db_insert(key_buf, separator + 1, NULL, 0) < 0)
+	{
+		rale_set_error_fmt(RALE_ERROR_DB_WRITE, MODULE,
+			"Failed to apply catch-up entry (key '%s').", key_buf);
+		return;
+	}
+	lease_detach(key_buf);
+	(void) hash_put(catchup_keys, key_buf, "S", NULL, 0);
+	catchup_entries++;
+}
+
+/** Keys of the local table that neither the snapshot nor replication set */
+typedef struct catchup_stale_t
+{
+	char	  **keys;
+	size_t		count;
+	size_t		cap;
+} catchup_stale_t;
+
+/** db_scan callback collecting stale keys; they are deleted after the scan */
+static int
+dstore_catchup_find_stale(const char *key, const char *value, void *arg)
+{
+	catchup_stale_t *stale = arg;
+	char		seen[2];
+
+	(void) value;
+	if (hash_get(catchup_keys, key, seen, sizeof(seen), NULL, 0) == 0)
+		return 0;
+	if (stale->count == stale->cap)
+	{
+		size_t		cap = stale->cap > 0 ? stale->cap * 2 : 64;
+		char	  **keys = realloc(stale->keys, cap * sizeof(char *));
+
+		if (keys == NULL)
+			return 1;
+		stale->keys = keys;
+		stale->cap = cap;
+	}
+	stale->keys[stale->count] = strdup(key);
+	if (stale->keys[stale->count] == NULL)
+		return 1;
+	stale->count++;
+	return 0;
+}
+
+/** db_scan callback writing one rale.db line per unleased key */
+static int
+dstore_write_rale_db_line(const char *key, const char *value, void *arg)
+{
+	char		line[RALE_DB_LINE_SIZE];
+	int			len;
+
+	if (lease_key_attached(key))
+		return 0;
+	len = dstore_format_rale_db_line(key, value, line, sizeof(line));
+	if (len > 0 && fwrite(line, 1, (size_t) len, (FILE *) arg) != (size_t) len)
+		return 1;
+	return 0;
+}
+
+/**
+ * Follower: replace rale.db with the table as it now stands, so the next
+ * start loads the installed snapshot rather than an append of it.
+ */
+static void
+dstore_rewrite_rale_db(void)
+{
+	char		path[512];
+	char		tmp[520];
+	char		errbuf[256];
+	uint64_t	cursor = 0;
+	FILE	   *fp;
+	int			ret;
+
+	/** The engine already holds the installed snapshot on disk */
+	if (db_persistent())
+		return;
+
+	snprintf(path, sizeof(path), "%s/rale.db", dstore_config.db.path);
+	snprintf(tmp, sizeof(tmp), "%s.catchup", path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL)
+	{
+		rale_debug_log("Cannot create %s: %s", tmp, strerror(errno));
+		return;
+	}
+	ret = db_scan(0, 1, &cursor, dstore_write_rale_db_line, fp, errbuf, sizeof(errbuf));
+	if (ret == 1 && (fflush(fp) != 0 || fsync(fileno(fp)) != 0))
+	{
+		snprintf(errbuf, sizeof(errbuf), "%s", strerror(errno));
+		ret = -1;
+	}
+	if (fclose(fp) != 0 && ret == 1)
+	{
+		snprintf(errbuf, sizeof(errbuf), "%s", strerror(errno));
+		ret = -1;
+	}
+	if (ret != 1)
+	{
+		rale_debug_log("rale.db not rewritten after catch-up: %s",
+			ret == 0 ? "short write" : errbuf);
+		(void) unlink(tmp);
+		return;
+	}
+	if (wal_replace(path, tmp, errbuf, sizeof(errbuf)) != 0)
+		rale_debug_log("rale.db not replaced after catch-up: %s", errbuf);
+}
+
+/**
+ * Follower: CATCHUP_END.  The table now holds the leader's snapshot plus
+ * what it replicated since; drop every other key, then rewrite rale.db.
+ */
+static void
+dstore_catchup_end(void)
+{
+	catchup_stale_t stale = {NULL, 0, 0};
+	uint64_t	cursor = 0;
+	size_t		i;
+
+	if (catchup_keys == NULL)
+		return;
+
+	if (db_scan(0, 1, &cursor, dstore_catchup_find_stale, &stale, NULL, 0) == 1)
+	{
+		for (i = 0; i < stale.count; i++)
+		{
+			(void) db_delete(stale.keys[i], NULL, 0);
+			lease_detach(stale.keys[i]);
+		}
+		dstore_rewrite_rale_db();
+	}
+	else
+		rale_debug_log("Catch-up could not list local keys; keeping %zu stale candidates",
+			stale.count);
+
+	rale_debug_log("DStore catch-up from client socket %d done: %llu entries applied, %zu removed",
+		catchup_slot, (unsigned long long) catchup_entries, stale.count);
+	for (i = 0; i < stale.count; i++)
+		free(stale.keys[i]);
+	free(stale.keys);
+	dstore_catchup_abort();
+}
+
+/** Record a chunk of a follower's snapshot ending at the file's current size */
+static int
+dstore_catchup_cut(catchup_job_t *job)
+{
+	if (job->ncuts == job->cuts_cap)
+	{
+		size_t		cap = job->cuts_cap > 0 ? job->cuts_cap * 2 : 64;
+		off_t	   *cuts = realloc(job->cuts, cap * sizeof(off_t));
+
+		if (cuts == NULL)
+			return 1;
+		job->cuts = cuts;
+		job->cuts_cap = cap;
+	}
+	job->cuts[job->ncuts++] = job->size;
+	return 0;
+}
+
+/** db_scan callback writing one unleased key to a follower's snapshot */
+static int
+dstore_catchup_add(const char *key, const char *value, void *arg)
+{
+	catchup_job_t *job = arg;
+	char		line[CATCHUP_LINE_SIZE];
+	off_t		chunk_start;
+	int			len;
+
+	/** Leased keys follow with the lease table */
+	if (lease_key_attached(key))
+		return 0;
+
+	len = snprintf(line, sizeof(line), "%s%s=%s\n", CATCHUP_ENTRY_PREFIX, key, value);
+	if (len < 0 || (size_t) len >= sizeof(line))
+		return 1;
+
+	/** Chunks end on a line, so a replicated frame never lands inside one */
+	chunk_start = job->ncuts > 0 ? job->cuts[job->ncuts - 1] : 0;
+	if (job->size > chunk_start && job->size - chunk_start + len > CATCHUP_CHUNK_SIZE &&
+		dstore_catchup_cut(job) != 0)
+		return 1;
+	if (fwrite(line, 1, (size_t) len, job->file) != (size_t) len)
+		return 1;
+	job->size += len;
+	job->entries++;
+	return 0;
+}
+
+static void
+dstore_catchup_free(uint32_t node_idx)
+{
+	if (catchup_jobs[node_idx].file != NULL)
+		fclose(catchup_jobs[node_idx].file);
+	free(catchup_jobs[node_idx].cuts);
+	memset(&catchup_jobs[node_idx], 0, sizeof(catchup_job_t));
+}
+
+/**
+ * Leader: give up on a catch-up the follower has the header of.  Dropping
+ * the connection makes the follower abandon the install; the reconnect
+ * starts a new one.
+ */
+static void
+dstore_catchup_fail(uint32_t node_idx, const char *reason)
+{
+	tcp_client_t *client = tcp_clients[node_idx];
+
+	rale_debug_log("No catch-up for node_idx %d: %s", node_idx, reason);
+	dstore_catchup_free(node_idx);
+	dstore_lock_client(node_idx);
+	if (client != NULL && client->is_connected)
+	{
+		client->is_connected = 0;
+		dstore_client_on_disconnection(client->sock, client->ip_address, 0);
+	}
+	dstore_unlock_client(node_idx);
+}
+
+/**
+ * Leader: start catching up a follower we just connected to.
+ *
+ * The CATCHUP header goes out first.  From then on the follower records
+ * every key replication touches, so a write committed while the table is
+ * scanned reaches it as a replicated frame behind the header and is not
+ * dropped as stale at CATCHUP_END.  The scan then writes a point-in-time
+ * snapshot, deletes included, to an unlinked file in the database
+ * directory rather than to memory, recording line-aligned chunk ends.
+ * dstore_pump_catchup() sends it a chunk per tick with sendfile(), so a
+ * large table neither fills memory nor holds up heartbeats.
+ */
+static void
+dstore_start_catchup(uint32_t node_idx)
+{
+	catchup_job_t *job = &catchup_jobs[node_idx];
+	char		header[64];
+	char		path[PATH_MAX];
+	char		errbuf[256];
+	uint64_t	cursor = 0;
+	int			len;
+
+	if (!dstore_is_current_leader() || tcp_clients[node_idx] == NULL ||
+		!tcp_clients[node_idx]->is_connected)
+		return;
+
+	dstore_catchup_free(node_idx);
+	pthread_mutex_lock(&replica_mutex);
+	job->index = replication_index;
+	pthread_mutex_unlock(&replica_mutex);
+	if (job->index < atomic_load(&applied_index))
+		job->index = atomic_load(&applied_index);
+
+	snprintf(header, sizeof(header), "%s%llu", CATCHUP_PREFIX, (unsigned long long) job->index);
+	if (dstore_send_message(node_idx, header) != 0)
+		return;
+
+	len = snprintf(path, sizeof(path), "%s/catchup-%d.snap", dstore_config.db.path,
+		cluster.nodes[node_idx].id);
+	if (len < 0 || (size_t) len >= sizeof(path))
+	{
+		dstore_catchup_fail(node_idx, "snapshot path too long");
+		return;
+	}
+	job->file = fopen(path, "w+");
+	if (job->file == NULL)
+	{
+		snprintf(errbuf, sizeof(errbuf), "cannot create %s: %s", path, strerror(errno));
+		dstore_catchup_fail(node_idx, errbuf);
+		return;
+	}
+	(void) unlink(path);
+
+	if (db_scan(0, 1, &cursor, dstore_catchup_add, job, errbuf, sizeof(errbuf)) != 1)
+	{
+		dstore_catchup_fail(node_idx, "snapshot failed");
+		return;
+	}
+	if (fflush(job->file) != 0 || dstore_catchup_cut(job) != 0)
+	{
+		dstore_catchup_fail(node_idx, "cannot write snapshot");
+		return;
+	}
+	job->active = true;
+	dstore_pump_catchup_one(node_idx);
+}
+
+/**
+ * Leader: send the next chunk of a follower's snapshot, and close the
+ * stream once it is all out.  A chunk starts only when the socket takes it
+ * without waiting; the last one is corked together with CATCHUP_END.
+ */
+static void
+dstore_pump_catchup_one(uint32_t node_idx)
+{
+	catchup_job_t *job = &catchup_jobs[node_idx];
+	off_t		end;
+	bool		last;
+	int			ret = -1;
+
+	if (!job->active)
+		return;
+
+	end = job->cuts[job->next_cut];
+	last = job->next_cut + 1 == job->ncuts;
+	dstore_lock_client(node_idx);
+	if (tcp_clients[node_idx] != NULL && tcp_clients[node_idx]->is_connected)
+		ret = tcp_client_sendfile(tcp_clients[node_idx], fileno(job->file), &job->sent,
+			(size_t) (end - job->sent), last ? CATCHUP_END : NULL);
+	dstore_unlock_client(node_idx);
+
+	if (ret < 0)
+	{
+		rale_debug_log("Catch-up to node_idx %d dropped at %lld of %lld bytes",
+			node_idx, (long long) job->sent, (long long) job->size);
+		dstore_catchup_free(node_idx);
+		return;
+	}
+	if (ret == 0)
+		return;					/** Socket buffer full; next tick */
+
+	job->next_cut++;
+	if (!last)
+		return;
+
+	dstore_replica_caught_up(node_idx, job->index);
+	rale_debug_log("Caught up node_idx %d: %llu entries, %lld bytes, through index %llu",
+		node_idx, (unsigned long long) job->entries, (long long) job->size,
+		(unsigned long long) job->index);
+	dstore_catchup_free(node_idx);
+}
+
+/** Leader: advance every follower's catch-up by one chunk */
+static void
+dstore_pump_catchup(void)
+{
+	uint32_t	i;
+
+	for (i = 0; i < MAX_NODES; i++)
+		dstore_pump_catchup_one(i);
+}
+
+/**
+ * Main loop for client connections. Attempts to connect/reconnect to other nodes.
+ */
+int
+dstore_client_loop(char *errbuf, size_t errbuflen)
 {
-	static int first_run = 1;
-	static time_t last_connect_attempt = 0;
-	time_t current_time = time(NULL);
 	uint32_t i;
 	int ret;
+	time_t current_time = time(NULL);
+
+	(void) errbuf;
+	(void) errbuflen;
+
+	if (cluster.node_count == 0) /** Use cluster.node_count */
+	{
+		rale_debug_log("Cluster not initialized in dstore_client_loop.");
+		return -1; /** Or some other appropriate action */
+	}
+
+	/** Check if we have other nodes to connect to */
+	if (cluster.node_count == 1)
+	{
+    	return 0; /** No other nodes to connect to */
+	}
+
+	/** Add a small delay to ensure server is fully ready */
+	static int first_run = 1;
+	if (first_run)
+	{
+		rale_debug_log("%s", "First client loop run, ensuring server is ready...");
+		first_run = 0;
+		return 0; /** Skip first run to let server fully initialize */
+	}
+
+	/** Handle peer-to-peer connections for all nodes */
+	for (i = 0; i < MAX_NODES; i++)
+	{
+		if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
+			cluster.nodes[i].id == cluster.self_id)
+		{
+			continue;
+		}
+
+		/**
+		 * Initiate client connections to all peers (except self). Allowing
+		 * bidirectional TCP links ensures each node can independently mark
+		 * peers online and avoids asymmetric "offline" views.
+		 */
+
+		if (tcp_clients[i] == NULL)
+		{
+			                                                                        dstore_init_client(i);
+			if (tcp_clients[i] == NULL) /** Check if init failed */
+			{
+				char warn_msg[256];
+				snprintf(warn_msg, sizeof(warn_msg), 
+					"Failed to initialize client for node_idx %d in client loop",
+					i);
+				/* Warning: initialization failed for TCP client */
+				continue;
+			}
+		}
+
+		if (tcp_clients[i]->is_connected == 1)
+		{
+			tcp_client_run(tcp_clients[i]); /** Process any incoming messages for this client */
+			continue;
+		}
+
+		/** Check if enough time has passed since last connection attempt */
+		/** Use exponential backoff for persistent failures */
+		int retry_interval = CONNECTION_RETRY_INTERVAL;
+		if (connection_attempt_count[i] > 5) {
+			retry_interval = CONNECTION_RETRY_INTERVAL * 2; /** 10 seconds after 5 failures */
+		}
+		if (connection_attempt_count[i] > 10) {
+			retry_interval = CONNECTION_RETRY_INTERVAL * 4; /** 20 seconds after 10 failures */
+		}
+		
+		if (current_time - last_connection_attempt[i] < retry_interval)
+		{
+			continue; /** Wait before retrying */
+		}
+
+		last_connection_attempt[i] = current_time;
+		connection_attempt_count[i]++;
+
+		/** Attempt to connect if not connected */
+		/* Reduce logging noise - only log every 5th attempt or first attempt */
+		if (connection_attempt_count[i] == 1 || connection_attempt_count[i] % 5 == 0) {
+			rale_debug_log(
+				"Node (%d) attempting to connect to node_idx %d (IP: %s, Port: %d) - Attempt %d",
+				cluster.self_id, i, cluster.nodes[i].ip,
+				cluster.nodes[i].dstore_port, connection_attempt_count[i]);
+		}
+
+		/** Held until the peer has our hello, ahead of any replicated frame */
+		dstore_lock_client(i);
+		ret = tcp_client_connect(tcp_clients[i],
+								cluster.nodes[i].ip,
+								cluster.nodes[i].dstore_port);
+		if (ret != 0)
+		{
+			char warn_msg[256];
+			dstore_unlock_client(i);
+			snprintf(warn_msg, sizeof(warn_msg), 
+				"Node (%d) failed to connect to node_idx %d (IP: %s, Port: %d). "
+				"TCP connect error: %d. Server may not be ready yet. "
+				"Will retry in %d seconds.",
+				cluster.self_id, i, cluster.nodes[i].ip,
+				cluster.nodes[i].dstore_port, ret, CONNECTION_RETRY_INTERVAL);
+			/* Warning: initialization failed for TCP client */
+			connection_status[i] = 0; /** Mark as disconnected */
+			continue;
+		}
+		
+		/** Connection successful - log with detailed information */
+		rale_debug_log(
+			"DStore connection ESTABLISHED: Our raled Node %d successfully connected to raled Node %d (%s:%d)",
+			cluster.self_id, cluster.nodes[i].id, cluster.nodes[i].ip,
+			cluster.nodes[i].dstore_port);
+		connection_status[i] = 1; /** Mark as connected */
+		client_carry_len[i] = 0; /** Nothing carries over from the last connection */
+		cluster.nodes[i].state = NODE_STATE_CANDIDATE; /** Mark peer reachable */
+		last_keep_alive_sent[i] = current_time; /** Initialize keep-alive timer */
+		connection_attempt_count[i] = 0; /** Reset attempt count on success */
+		
+		/** Identify ourselves to the server so it can map this socket to our node_id */
+		{
+			char hello_msg[64];
+			snprintf(hello_msg, sizeof(hello_msg), "HELLO %d", cluster.self_id);
+			tcp_client_send(tcp_clients[i], hello_msg);
+		rale_debug_log("DStore HELLO sent: Node %d -> Node %d: %s",
+			cluster.self_id, cluster.nodes[i].id, hello_msg);
+		}
+
+		/** Send initial keep-alive message */
+		tcp_client_send(tcp_clients[i], KEEP_ALIVE_MESSAGE);
+		rale_debug_log(
+			"DStore keep-alive sent: Node %d -> Node %d",
+			cluster.self_id, cluster.nodes[i].id);
+
+		/** Send our current cluster snapshot so the server learns about all nodes */
+		                                                dstore_send_cluster_snapshot_to_target_idx(i);
+		dstore_unlock_client(i);
+		dstore_start_catchup(i);
+	}
+	dstore_pump_catchup();
+	
+	/** Send periodic keep-alive messages to all connected nodes */
+	dstore_send_keep_alive();
+	
+	return 0;
+}
+
+/**
+ * Non-blocking client tick - process one client iteration
+ * Called by daemon in its main loop
+ */
+int
+dstore_client_tick(void)
+{
+	static int first_run = 1;
+	static time_t last_connect_attempt = 0;
+	time_t current_time = time(NULL);
+	uint32_t i;
+	int ret;
+
+	/** Check basic state */
+	if (cluster.node_count == 0)
+	{
+		return 0; /** No cluster yet */
+	}
+
+	if (cluster.node_count == 1)
+	{
+		return 0; /** No other nodes to connect to */
+	}
+
+	/** Skip first run to let server initialize */
+	if (first_run)
+	{
+		first_run = 0;
+		return 0;
+	}
+
+	/** Snapshots for followers that reconnected go out a chunk per tick */
+	dstore_pump_catchup();
+
+	/** Only attempt connections periodically, not every tick */
+	if (current_time - last_connect_attempt < 1)
+	{
+		/** Still process existing connections */
+		for (i = 0; i < MAX_NODES; i++)
+		{
+			if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
+				cluster.nodes[i].id == cluster.self_id)
+			{
+				continue;
+			}
+
+			if (tcp_clients[i] != NULL && tcp_clients[i]->is_connected == 1)
+			{
+				tcp_client_run(tcp_clients[i]);
+			}
+		}
+		return 0;
+	}
+
+	last_connect_attempt = current_time;
+
+	/** Process connection attempts for one node per tick to avoid blocking */
+	for (i = 0; i < MAX_NODES; i++)
+	{
+		if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
+			cluster.nodes[i].id == cluster.self_id)
+		{
+			continue;
+		}
+
+		/** Initialize client if needed */
+		if (tcp_clients[i] == NULL)
+		{
+			dstore_init_client(i);
+			if (tcp_clients[i] == NULL)
+			{
+				continue;
+			}
+		}
+
+		/** Process existing connection */
+		if (tcp_clients[i]->is_connected == 1)
+		{
+			tcp_client_run(tcp_clients[i]);
+			continue;
+		}
+
+		/** Attempt connection with backoff */
+		int retry_interval = CONNECTION_RETRY_INTERVAL;
+		if (connection_attempt_count[i] > 5) {
+			retry_interval = CONNECTION_RETRY_INTERVAL * 2;
+		}
+		if (connection_attempt_count[i] > 10) {
+			retry_interval = CONNECTION_RETRY_INTERVAL * 4;
+		}
+		
+		if (current_time - last_connection_attempt[i] < retry_interval)
+		{
+			continue;
+		}
+
+		last_connection_attempt[i] = current_time;
+		connection_attempt_count[i]++;
+
+		/** Attempt to connect; held until the peer has our hello */
+		dstore_lock_client(i);
+		ret = tcp_client_connect(tcp_clients[i],
+								cluster.nodes[i].ip,
+								cluster.nodes[i].dstore_port);
+		if (ret == 0)
+		{
+			/** Connection successful */
+			rale_debug_log("DStore connection ESTABLISHED: Node %d -> Node %d (%s:%d)",
+				cluster.self_id, cluster.nodes[i].id, cluster.nodes[i].ip,
+				cluster.nodes[i].dstore_port);
+			connection_status[i] = 1;
+			client_carry_len[i] = 0;
+			cluster.nodes[i].state = NODE_STATE_CANDIDATE;
+			last_keep_alive_sent[i] = current_time;
+			connection_attempt_count[i] = 0;
+			
+			/** Send hello and initial keep-alive */
+			char hello_msg[64];
+			snprintf(hello_msg, sizeof(hello_msg), "HELLO %d", cluster.self_id);
+			tcp_client_send(tcp_clients[i], hello_msg);
+			tcp_client_send(tcp_clients[i], KEEP_ALIVE_MESSAGE);
+			dstore_send_cluster_snapshot_to_target_idx(i);
+			dstore_unlock_client(i);
+			dstore_start_catchup(i);
+			dstore_ship_leases(i);
+		}
+		else
+		{
+			dstore_unlock_client(i);
+		}
+		
+		/** Only process one connection attempt per tick to avoid blocking */
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Send current cluster membership to a connected client target by node index.
+ */
+static void
+dstore_send_cluster_snapshot_to_target_idx(uint32_t node_idx)
+{
+    char cmd[256];
+
+    if (node_idx >= cluster.node_count)
+        return;
+    if (tcp_clients[node_idx] == NULL || tcp_clients[node_idx]->is_connected != 1)
+        return;
+
+    for (uint32_t j = 0; j < cluster.node_count; j++)
+    {
+        if (cluster.nodes[j].id == -1)
+            continue;
+        snprintf(cmd, sizeof(cmd),
+                 "PROPAGATE_ADD %d %s %s %d %d",
+                 cluster.nodes[j].id,
+                 cluster.nodes[j].name,
+                 cluster.nodes[j].ip,
+                 cluster.nodes[j].rale_port,
+                 cluster.nodes[j].dstore_port);
+        dstore_lock_client(node_idx);
+        tcp_client_send(tcp_clients[node_idx], cmd);
+        dstore_unlock_client(node_idx);
+        char debug_msg[256];
+        snprintf(debug_msg, sizeof(debug_msg), 
+             "Sent snapshot entry to node_idx %d: %s",
+             node_idx, cmd);
+        rale_debug_log("%s", debug_msg);
+    }
+
+	/** Also send leader snapshot so the server peer learns the current leader */
+	{
+		int leader_id = dstore_get_current_leader();
+		char leader_msg[128];
+		int term = 0;
+		if (leader_id >= 0)
+		{
+			snprintf(leader_msg, sizeof(leader_msg), "LEADER %d %d", term, leader_id);
+			dstore_lock_client(node_idx);
+			tcp_client_send(tcp_clients[node_idx], leader_msg);
+			dstore_unlock_client(node_idx);
+			rale_debug_log(
+				"Sent leader snapshot to node_idx %d: %s",
+				node_idx, leader_msg);
+		}
+	}
+}
+
+/**
+ * Main loop for the server component. Initializes server if needed and runs it.
+ */
+void
+dstore_server_loop(char *errbuf, size_t errbuflen)
+{
+	uint32_t self_idx;
+
+	(void) errbuf;
+	(void) errbuflen;
+
+	/** Server should already be initialized in dstore_init(), just run it */
+	if (tcp_server_ptr == NULL)
+	{
+		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
+			"TCP server not initialized. Server should be initialized in dstore_init().");
+		return;
+	}
+
+	/** Only check cluster state for client operations, not server operations */
+	if (cluster.node_count == 0)
+	{
+		rale_debug_log("cluster not initialized in dstore_server_loop, skipping client operations");
+		/** Still run the server to accept incoming connections */
+	}
+	else
+	{
+		/** Find the array index for self_id */
+		self_idx = find_node_index_by_id(cluster.self_id);
+		if (self_idx == MAX_NODES)
+		{
+			rale_debug_log("Self node %d not found in cluster yet, skipping client operations",
+			cluster.self_id);
+		}
+	}
+
+	/** Add debug before running server */
+	rale_debug_log("Running tcp_server_run for self_id %d, tcp_server_ptr=%p",
+		(cluster.self_id >= 0) ? cluster.self_id : -1, (void *)tcp_server_ptr);
+		
+	rale_debug_log("About to call tcp_server_run with server pointer %p",
+		(void *)tcp_server_ptr);
+
+	if (tcp_server_ptr == NULL)
+	{
+		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
+			"tcp_server_ptr is NULL! Server not initialized properly.");
+		return;
+	}
+
+	rale_debug_log("Calling tcp_server_run...");
+		
+	/** Main loop: keep daemon alive until shutdown signal */
+	while (!librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_DSTORE))
+	{
+		int result = tcp_server_run(tcp_server_ptr);
+		
+		/** Check shutdown more frequently for faster shutdown response */
+		if (librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_DSTORE))
+		{
+			rale_debug_log(
+				"Shutdown requested for DStore server, beginning cleanup");
+			break;
+		}
+		
+		/** Send periodic keep-alive messages to all connected nodes */
+		/** Only send keep-alive when it's time, not every loop iteration */
+		static time_t last_keep_alive_check = 0;
+		time_t current_time = time(NULL);
+		
+		if (last_keep_alive_check == 0 || 
+			(current_time - last_keep_alive_check) >= get_keep_alive_interval())
+		{
+			dstore_send_keep_alive();
+			last_keep_alive_check = current_time;
+		}
+		
+		/** Additional check for shutdown after keep-alive */
+		if (librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_DSTORE))
+		{
+			rale_debug_log(
+				"Shutdown requested after keep-alive, beginning cleanup");
+			break;
+		}
+		
+		/** Add small delay to prevent tight loop when no activity */
+		if (result == 0) /** Timeout occurred */
+		{
+			(void) librale_shutdown_sleep(100);
+		}
+	}
+	
+	/** Perform cleanup before exiting */
+	rale_debug_log(
+		"DStore server loop exiting for self_id %d, performing cleanup",
+		(cluster.self_id >= 0) ? cluster.self_id : -1);
+	
+	/** Close all client connections gracefully */
+	for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++)
+	{
+		if (client_socket_to_node[i] != -1)
+		{
+			rale_debug_log("Closing client connection in slot %d for node %d",
+				i, client_socket_to_node[i]);
+			tcp_server_client_disconnect(tcp_server_ptr, i);
+			client_socket_to_node[i] = -1;
+		}
+	}
+	
+	/** Clear connection status for all nodes */
+	for (uint32_t i = 0; i < cluster.node_count; i++)
+	{
+		connection_status[i] = 0;
+	}
+	
+	rale_debug_log(
+		"DStore server cleanup completed for self_id %d",
+		(cluster.self_id >= 0) ? cluster.self_id : -1);
+	
+	/** Signal that DStore shutdown is complete */
+	librale_signal_shutdown_complete(SHUTDOWN_SUBSYSTEM_DSTORE);
+}
+
+/**
+ * Non-blocking server tick - process one server iteration
+ * Called by daemon in its main loop
+ */
+int
+dstore_server_tick(void)
+{
+	static time_t last_keep_alive_check = 0;
+	time_t current_time;
+	int result;
+
+	/** Check if server is initialized */
+	if (tcp_server_ptr == NULL)
+	{
+		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
+			"TCP server not initialized for tick operation.");
+		return -1;
+	}
+
+	/** Check shutdown state */
+	if (librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_DSTORE))
+	{
+		return -1; /** Signal shutdown to daemon */
+	}
+
+	/** Process one server iteration (non-blocking) */
+	result = tcp_server_run(tcp_server_ptr);
+
+	/** Handle periodic keep-alive */
+	current_time = time(NULL);
+	if (last_keep_alive_check == 0 || 
+		(current_time - last_keep_alive_check) >= get_keep_alive_interval())
+	{
+		dstore_send_keep_alive();
+		last_keep_alive_check = current_time;
+	}
+
+	dstore_lease_tick();
+
+	return result;
+}
+
+/**
+ * Callback for when a client disconnects from our server.
+ */
+static void
+dstore_server_on_disconnection(
+	int client_sock_idx,
+	const char *client_ip,
+	int client_port)
+{
+	static time_t last_log_time = 0;
+	static int    suppressed = 0;
+	time_t        now = time(NULL);
+
+	if (last_log_time == 0 || (now - last_log_time) >= 1)
+	{
+		if (suppressed > 0)
+		{
+			rale_debug_log(
+				"Suppressed %d repeated disconnect logs in last interval",
+				suppressed);
+			suppressed = 0;
+		}
+		rale_debug_log(
+			"DStore connection LOST: Raled client %s:%d disconnected from our raled Node %d (socket %d)",
+			client_ip, client_port, cluster.self_id, client_sock_idx);
+		last_log_time = now;
+	}
+	else
+	{
+		/* Throttle noisy repeats within the same second */
+		suppressed++;
+	}
+	/* Reduce logging noise - remove excessive DEBUG messages */
+	
+	/** Clear the client socket to node mapping */
+	if (client_sock_idx >= 0 && client_sock_idx < TCP_SERVER_MAX_CLIENTS)
+	{
+		int node_id = client_socket_to_node[client_sock_idx];
+		if (node_id != -1)
+		{
+			/** Find the node index and mark as disconnected */
+			uint32_t node_idx = find_node_index_by_id(node_id);
+			if (node_idx != MAX_NODES)
+			{
+				connection_status[node_idx] = 0; /** Mark as disconnected */
+			}
+			client_socket_to_node[client_sock_idx] = -1; /** Clear the mapping */
+		}
+	}
+	dstore_reset_server_slot(client_sock_idx);
+	
+	tcp_server_client_disconnect(tcp_server_ptr, client_sock_idx);
+}
+
+/**
+ * Callback for when our client connection to a server is disconnected.
+ */
+static void
+dstore_client_on_disconnection(int client_sock, const char *client_ip,
+							  int client_port)
+{
+	uint32_t node_idx = MAX_NODES;
+
+	/** Find which node this disconnection belongs to */
+	for (uint32_t j = 0; j < cluster.node_count; j++)
+	{
+		if (strcmp(cluster.nodes[j].ip, client_ip) == 0 && 
+			cluster.nodes[j].dstore_port == client_port)
+		{
+			node_idx = j;
+			break;
+		}
+	}
+
+	/** Log the disconnection with detailed information */
+	if (node_idx != MAX_NODES)
+	{
+		rale_debug_log( 
+			"DStore connection LOST: Our raled Node %d disconnected from raled Node %d (%s:%d, socket %d)",
+			cluster.self_id, cluster.nodes[node_idx].id, client_ip, client_port, client_sock);
+		connection_status[node_idx] = 0; /** Mark as disconnected */
+		cluster.nodes[node_idx].state = NODE_STATE_OFFLINE;
+		/** Entries in flight on the lost connection will never be acknowledged */
+		dstore_replica_reset(node_idx);
+	}
+	else
+	{
+		rale_debug_log( 
+			"DStore connection LOST: Unknown client %s:%d disconnected (socket %d)",
+			client_ip, client_port, client_sock);
+	}
+
+	rale_debug_log("Tcp_client[] pointers: %p", (void*)tcp_clients);
+	for (uint32_t k = 0; k < MAX_NODES; k++)
+	{
+		char debug_msg2[256];
+		snprintf(debug_msg2, sizeof(debug_msg2), "Tcp_client[%d]=%p", k, (void*)tcp_clients[k]);
+		rale_debug_log("%s", debug_msg2);
+	}
+	for (uint32_t j = 0; j < MAX_NODES; j++) /** MAX_NODES should be cluster->node_count */
+	{
+		if (cluster.node_count == 0) /** Use cluster.node_count */
+		{
+			break;
+		}
+		if (tcp_clients[j] != NULL && tcp_clients[j]->sock == client_sock)
+		{
+			/**
+			 * The client stays allocated: the loop thread may be reading
+			 * from it while a commit round's send fails.  Shutting the
+			 * socket down wakes that read; the loop thread's next connect
+			 * closes it and reuses the client.
+			 */
+			rale_debug_log("Shutting down TCP client for node_idx %d (socket %d)",
+				j, client_sock);
+			dstore_lock_client(j);
+			tcp_clients[j]->is_connected = 0;
+			(void) shutdown(client_sock, SHUT_RDWR);
+			connection_status[j] = 0; /** Mark as disconnected */
+			dstore_unlock_client(j);
+			break;
+		}
+	}
+}
+
+/**
+ * Send a message to the primary node.
+ */
+
+
+/**
+ * Send a message to a target node.
+ */
+int
+dstore_send_message(uint32_t target_node_idx, const char *message)
+{
+	const char *reason;
+
+	if (cluster.node_count == 0) /** Use cluster.node_count */
+	{
+		rale_set_error_fmt(RALE_ERROR_NOT_INITIALIZED, MODULE, "Cluster not initialized for dstore_send_message.");
+		return -1;
+	}
+
+	if (target_node_idx >= cluster.node_count) /** Use cluster.node_count */
+	{
+		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
+			"Target node_idx %d is out of bounds (max: %d).",
+			target_node_idx, cluster.node_count - 1);
+		return -1;
+	}
+
+	if (tcp_clients[target_node_idx] != NULL && tcp_clients[target_node_idx]->is_connected)
+	{
+		/** tcp_client_send is void, so we can't directly check for send errors here. */
+		/** Underlying TCP implementation might handle some retries or log errors. */
+		rale_debug_log("Sending message from self_id %d to node_idx %d: \"%s\"",
+			cluster.self_id, target_node_idx, message);
+		dstore_lock_client(target_node_idx);
+		tcp_client_send(tcp_clients[target_node_idx], message);
+		dstore_unlock_client(target_node_idx);
+		return 0;
+	}
+	else
+	{
+		reason = (tcp_clients[target_node_idx] == NULL) ? "client not initialized" :
+				 "client not connected";
+		rale_set_error_fmt(RALE_ERROR_NETWORK_UNREACHABLE, MODULE,
+			"cannot send message from self_id %d to node_idx %d (%s)",
+			cluster.self_id, target_node_idx, reason);
+		return -1;
+	}
+}
+
+/**
+ * Replicates a key-value pair to all follower nodes.
+ */
+void
+dstore_replicate_to_followers(const char *key, const char *value, char *errbuf, size_t errbuflen)
+{
+	char     message[REPLICATION_MESSAGE_BUFFER_SIZE];
+	size_t   context_len;
+	uint64_t index;
+	uint32_t entry_bytes;
+
+	(void) errbuf;
+	(void) errbuflen;
+
+	if (cluster.node_count == 0) /** Use cluster.node_count */
+	{
+		rale_set_error_fmt(RALE_ERROR_NOT_INITIALIZED, MODULE, "Cluster not initialized in dstore_replicate_to_followers.");
+		return;
+	}
+
+	index = dstore_reserve_indexes(1);
+
+	/** Construct the message, prefixed with the trace id of a sampled request */
+	context_len = trace_format_context(message, sizeof(message));
+	int written = snprintf(message + context_len, sizeof(message) - context_len,
+		REPLICATE_PREFIX "%llu %s=%s", (unsigned long long) index, key, value);
+	if (written >= (int)(sizeof(message) - context_len))
+	{
+		rale_set_error_fmt(RALE_ERROR_MESSAGE_TOO_LARGE, MODULE, "Message buffer too small for key-value pair");
+		return;
+	}
+
+	entry_bytes = (uint32_t) (context_len + (size_t) written);
+	dstore_send_frame(message, index, &entry_bytes, 1);
+}
+
+/**
+ * Reserve count replication indexes and return the first.  Numbering
+ * carries on from the newest entry applied here, so a new leader's
+ * revisions follow those of the leader before it.
+ */
+static uint64_t
+dstore_reserve_indexes(uint64_t count)
+{
+	uint64_t	applied = atomic_load(&applied_index);
+	uint64_t	first;
+
+	pthread_mutex_lock(&replica_mutex);
+	if (replication_index < applied)
+		replication_index = applied;
+	first = replication_index + 1;
+	replication_index += count;
+	pthread_mutex_unlock(&replica_mutex);
+	return first;
+}
+
+static void
+dstore_applied_cond_init(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&applied_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
 
-	/** Check basic state */
-	if (cluster.node_count == 0)
+/**
+ * Record every entry up to index as applied and wake
+ * dstore_wait_revision().  As with db changes, the mutex is only taken
+ * while somebody waits.
+ */
+static void
+dstore_advance_applied(uint64_t index)
+{
+	uint64_t	current = atomic_load(&applied_index);
+
+	while (current < index &&
+		   !atomic_compare_exchange_weak(&applied_index, &current, index))
+		;
+	if (atomic_load(&applied_waiters) > 0)
 	{
-		return 0; /** No cluster yet */
+		pthread_mutex_lock(&applied_mutex);
+		pthread_cond_broadcast(&applied_cond);
+		pthread_mutex_unlock(&applied_mutex);
 	}
+}
 
-	if (cluster.node_count == 1)
+/**
+ * Newest revision applied on this node.
+ */
+uint64_t
+dstore_applied_revision(void)
+{
+	return atomic_load(&applied_index);
+}
+
+/**
+ * Wait up to timeout_ms until this node has applied revision.  Returns 0
+ * once it has, 1 on timeout.
+ */
+int
+dstore_wait_revision(uint64_t revision, int timeout_ms)
+{
+	struct timespec ts;
+	int			ret = 0;
+
+	if (atomic_load(&applied_index) >= revision)
+		return 0;
+
+	pthread_once(&applied_once, dstore_applied_cond_init);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
 	{
-		return 0; /** No other nodes to connect to */
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
 	}
 
-	/** Skip first run to let server initialize */
-	if (first_run)
+	pthread_mutex_lock(&applied_mutex);
+	atomic_fetch_add(&applied_waiters, 1);
+	while (ret == 0 && atomic_load(&applied_index) < revision)
 	{
-		first_run = 0;
-		return 0;
+		ret = pthread_cond_timedwait(&applied_cond, &applied_mutex, &ts);
 	}
+	atomic_fetch_sub(&applied_waiters, 1);
+	pthread_mutex_unlock(&applied_mutex);
+	return atomic_load(&applied_index) >= revision ? 0 : 1;
+}
 
-	/** Only attempt connections periodically, not every tick */
-	if (current_time - last_connect_attempt < 1)
+/**
+ * Revision at which the calling thread's last PUT or CAS committed, 0 if
+ * it did not commit here (it failed, or a follower forwarded it).
+ */
+uint64_t
+dstore_write_revision(void)
+{
+	return write_revision;
+}
+
+/**
+ * Send one frame to every follower.  It carries count entries numbered
+ * from first_index, whose lengths entry_bytes gives for the in-flight
+ * accounting.
+ */
+static void
+dstore_send_frame(const char *frame, uint64_t first_index,
+				  const uint32_t *entry_bytes, int count)
+{
+	uint32_t	i;
+	int			k;
+	int			send_ret;
+	const char *reason;
+
+	for (i = 0; i < cluster.node_count; i++) /** Use cluster.node_count */
 	{
-		/** Still process existing connections */
-		for (i = 0; i < MAX_NODES; i++)
+		/** Skip self (primary node) */
+		if (cluster.nodes[i].id == cluster.self_id)
 		{
-			if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
-				cluster.nodes[i].id == cluster.self_id)
-			{
-				continue;
-			}
-
-			if (tcp_clients[i] != NULL && tcp_clients[i]->is_connected == 1)
-			{
-				tcp_client_run(tcp_clients[i]);
-			}
+			continue;
 		}
-		return 0;
-	}
-
-	last_connect_attempt = current_time;
 
-	/** Process connection attempts for one node per tick to avoid blocking */
-	for (i = 0; i < MAX_NODES; i++)
-	{
-		if (i >= cluster.node_count || cluster.nodes[i].id == -1 ||
-			cluster.nodes[i].id == cluster.self_id)
+		/** Skip nodes that are not part of the cluster (e.g. id is -1) */
+		if (cluster.nodes[i].id == -1)
 		{
 			continue;
 		}
 
-		/** Initialize client if needed */
+		rale_debug_log("Replicating %d entries to follower node_idx %d (NodeID %d)",
+			count, i, cluster.nodes[i].id);
+
+		/** Ensure client is initialized for the target node */
 		if (tcp_clients[i] == NULL)
 		{
 			dstore_init_client(i);
-			if (tcp_clients[i] == NULL)
+			if (tcp_clients[i] == NULL) /** Check if init failed */
 			{
-				continue;
+				char warn_msg[256];
+				snprintf(warn_msg, sizeof(warn_msg), 
+					"failed to initialize client for replication to node_idx %d",
+					i);
+				/* Warning: initialization failed for TCP client */
+				continue; /** Skip this follower if client init failed */
 			}
 		}
 
-		/** Process existing connection */
-		if (tcp_clients[i]->is_connected == 1)
+		/** Send the message if the client is connected */
+		if (tcp_clients[i] != NULL && tcp_clients[i]->is_connected)
 		{
-			tcp_client_run(tcp_clients[i]);
-			continue;
-		}
-
-		/** Attempt connection with backoff */
-		int retry_interval = CONNECTION_RETRY_INTERVAL;
-		if (connection_attempt_count[i] > 5) {
-			retry_interval = CONNECTION_RETRY_INTERVAL * 2;
-		}
-		if (connection_attempt_count[i] > 10) {
-			retry_interval = CONNECTION_RETRY_INTERVAL * 4;
+			send_ret = dstore_send_message(i, frame);
+			RALE_PROBE3(replication__send, cluster.nodes[i].id, frame, send_ret);
+			if (send_ret == 0)
+			{
+				for (k = 0; k < count; k++)
+					dstore_replica_sent(i, first_index + (uint64_t) k, entry_bytes[k]);
+			}
+			else
+			{
+				char warn_msg2[256];
+				snprintf(warn_msg2, sizeof(warn_msg2), 
+					"failed to send message to follower node_idx %d",
+					i);
+				/* Warning: failed to send message to follower */
+			}
 		}
-		
-		if (current_time - last_connection_attempt[i] < retry_interval)
+		else
 		{
-			continue;
+			reason = (tcp_clients[i] == NULL) ? "client structure is NULL" :
+					 "client not connected";
+			char warn_msg3[256];
+			snprintf(warn_msg3, sizeof(warn_msg3), 
+				"cannot replicate to follower node_idx %d: %s",
+				i, reason);
+			/* Warning: cannot replicate to follower */
+			/** Optionally, you might want to queue the message or handle the failure in another way */
 		}
+	}
+}
 
-		last_connection_attempt[i] = current_time;
-		connection_attempt_count[i]++;
+/** Record [start_ns, now] as stage of every sampled, applied entry */
+static void
+dstore_batch_span(batch_entry_t *entries, trace_stage_t stage, uint64_t start_ns)
+{
+	batch_entry_t *entry;
 
-		/** Attempt to connect */
-		ret = tcp_client_connect(tcp_clients[i],
-								cluster.nodes[i].ip,
-								cluster.nodes[i].dstore_port);
-		if (ret == 0)
+	if (start_ns == 0)
+		return;
+	for (entry = entries; entry != NULL; entry = entry->next)
+	{
+		if (entry->trace_id == 0 || entry->result != 0)
+			continue;
+		trace_adopt(entry->trace_id);
+		trace_span(stage, start_ns);
+	}
+}
+
+/**
+ * Whether key holds expected, or is absent for a NULL expected.  Only the
+ * commit function calls this, so no write can slip in before the swap.
+ */
+static bool
+dstore_cas_matches(const char *key, const char *expected)
+{
+	char		current[MAX_VALUE_SIZE];
+
+	if (db_get(key, current, sizeof(current), NULL, 0) != 0)
+		return expected == NULL;
+	return expected != NULL && strcmp(current, expected) == 0;
+}
+
+/**
+ * Format an applied entry's replication line at index into buf; returns
+ * its length.  Leased PUTs and lease operations use REPLICATE_LEASE.
+ */
+static size_t
+dstore_format_entry(char *buf, size_t size, const batch_entry_t *entry, uint64_t index)
+{
+	unsigned long long idx = (unsigned long long) index;
+	unsigned long long lease = (unsigned long long) entry->lease;
+	int			len;
+
+	switch (entry->op)
+	{
+		case BATCH_OP_LEASE_GRANT:
+			len = snprintf(buf, size, REPLICATE_LEASE_PREFIX "%llu GRANT %llu %d",
+				idx, idx, entry->ttl);
+			break;
+		case BATCH_OP_LEASE_REVOKE:
+		case BATCH_OP_LEASE_EXPIRE:
+			len = snprintf(buf, size, REPLICATE_LEASE_PREFIX "%llu %s %llu", idx,
+				entry->op == BATCH_OP_LEASE_EXPIRE ? "EXPIRE" : "REVOKE", lease);
+			break;
+		default:
+			if (entry->lease != 0)
+				len = snprintf(buf, size, REPLICATE_LEASE_PREFIX "%llu PUT %llu %s=%s",
+					idx, lease, entry->key, entry->value);
+			else
+				len = snprintf(buf, size, REPLICATE_PREFIX "%llu %s=%s",
+					idx, entry->key, entry->value);
+			break;
+	}
+	return len > 0 ? (size_t) len : 0;
+}
+
+/**
+ * Apply one entry on the leader, before it is numbered.  A lease grant
+ * needs its number for an id, so dstore_commit_batch() installs it after.
+ */
+static int
+dstore_apply_entry(batch_entry_t *entry)
+{
+	int			result;
+
+	switch (entry->op)
+	{
+		case BATCH_OP_LEASE_GRANT:
+			return 0;
+		case BATCH_OP_LEASE_REVOKE:
+		case BATCH_OP_LEASE_EXPIRE:
+			if (lease_revoke(entry->lease, entry->op == BATCH_OP_LEASE_EXPIRE,
+							 dstore_delete_leased, NULL) < 0)
+				return BATCH_LEASE_NOT_FOUND;
+			return 0;
+		default:
+			break;
+	}
+
+	if (entry->cas && !dstore_cas_matches(entry->key, entry->expected))
+		return BATCH_CAS_FAILED;
+	if (entry->lease != 0 && !lease_exists(entry->lease))
+		return BATCH_LEASE_NOT_FOUND;
+	result = db_insert(entry->key, entry->value, NULL, 0);
+	if (result != 0)
+		return result;
+
+	/** Leased keys stay out of rale.db, so a restart cannot resurrect them */
+	if (entry->lease != 0)
+		(void) lease_attach(entry->key, entry->lease);
+	else
+	{
+		lease_detach(entry->key);
+		dstore_save_to_rale_db(entry->key, entry->value);
+	}
+	return 0;
+}
+
+/**
+ * Commit function of the write batcher.  Entries are applied in queue
+ * order, appended to rale.db under one flush, and numbered contiguously
+ * into a single frame per follower, one REPLICATE line each; a
+ * compare-and-swap whose key has moved on is skipped.  An entry's number
+ * is the revision its writer gets back, and a granted lease's id.  Sampled
+ * entries keep their own trace; the flush and the send are shared spans.
+ */
+static void
+dstore_commit_batch(batch_entry_t *entries, int count)
+{
+	batch_entry_t *entry;
+	uint64_t	own_trace = trace_current();
+	uint64_t	sampled = 0;
+	uint64_t	stage_start;
+	uint64_t	first_index;
+	uint32_t   *entry_bytes;
+	char	   *frame;
+	size_t		frame_size = 1;
+	size_t		len = 0;
+	int			applied = 0;
+
+	wal_batch_begin();
+	for (entry = entries; entry != NULL; entry = entry->next)
+	{
+		trace_adopt(entry->trace_id);
+		stage_start = trace_clock();
+		entry->result = dstore_apply_entry(entry);
+		trace_span(TRACE_STAGE_LOCAL_APPLY, stage_start);
+		if (entry->result != 0)
+			continue;
+		frame_size += TRACE_CONTEXT_LENGTH + REPLICATE_LINE_OVERHEAD + entry->bytes;
+		applied++;
+		if (sampled == 0)
+			sampled = entry->trace_id;
+	}
+
+	/** Clock reads only when some entry is sampled */
+	trace_adopt(sampled);
+	stage_start = trace_clock();
+	(void) wal_batch_end();
+	dstore_batch_span(entries, TRACE_STAGE_PERSIST, stage_start);
+
+	/** Number the entries; each writer gets its own as the revision */
+	if (applied > 0)
+	{
+		int			k = 0;
+
+		first_index = dstore_reserve_indexes((uint64_t) applied);
+		for (entry = entries; entry != NULL; entry = entry->next)
 		{
-			/** Connection successful */
-			rale_debug_log("DStore connection ESTABLISHED: Node %d -> Node %d (%s:%d)",
-				cluster.self_id, cluster.nodes[i].id, cluster.nodes[i].ip,
-				cluster.nodes[i].dstore_port);
-			connection_status[i] = 1;
-			cluster.nodes[i].state = NODE_STATE_CANDIDATE;
-			last_keep_alive_sent[i] = current_time;
-			connection_attempt_count[i] = 0;
-			
-			/** Send hello and initial keep-alive */
-			char hello_msg[64];
-			snprintf(hello_msg, sizeof(hello_msg), "HELLO %d", cluster.self_id);
-			tcp_client_send(tcp_clients[i], hello_msg);
-			tcp_client_send(tcp_clients[i], KEEP_ALIVE_MESSAGE);
-			dstore_send_cluster_snapshot_to_target_idx(i);
+			if (entry->result != 0)
+				continue;
+			entry->revision = first_index + (uint64_t) k++;
+			if (entry->op == BATCH_OP_LEASE_GRANT &&
+				lease_grant(entry->revision, entry->ttl) < 0)
+				rale_set_error_fmt(RALE_ERROR_OUT_OF_MEMORY, MODULE,
+					"Cannot install lease %llu.", (unsigned long long) entry->revision);
 		}
-		
-		/** Only process one connection attempt per tick to avoid blocking */
-		break;
+		dstore_advance_applied(first_index + (uint64_t) applied - 1);
 	}
 
-	return 0;
+	if (applied == 0 || cluster.node_count == 0)
+	{
+		trace_adopt(own_trace);
+		return;
+	}
+
+	frame = malloc(frame_size);
+	entry_bytes = malloc((size_t) applied * sizeof(uint32_t));
+	if (frame == NULL || entry_bytes == NULL)
+	{
+		rale_set_error_fmt(RALE_ERROR_OUT_OF_MEMORY, MODULE,
+			"Cannot allocate a replication frame for %d of %d entries.", applied, count);
+		free(frame);
+		free(entry_bytes);
+		trace_adopt(own_trace);
+		return;
+	}
+
+	/** frame_size bounds every line, so none is cut short */
+	applied = 0;
+	for (entry = entries; entry != NULL; entry = entry->next)
+	{
+		size_t	line_start;
+
+		if (entry->result != 0)
+			continue;
+		if (len > 0)
+			frame[len++] = '\n';
+		line_start = len;
+		trace_adopt(entry->trace_id);
+		len += trace_format_context(frame + len, frame_size - len);
+		len += dstore_format_entry(frame + len, frame_size - len, entry,
+			first_index + (uint64_t) applied);
+		entry_bytes[applied++] = (uint32_t) (len - line_start);
+	}
+
+	trace_adopt(sampled);
+	stage_start = trace_clock();
+	dstore_send_frame(frame, first_index, entry_bytes, applied);
+	dstore_batch_span(entries, TRACE_STAGE_REPLICATE_SEND, stage_start);
+
+	free(frame);
+	free(entry_bytes);
+	trace_adopt(own_trace);
+}
+
+static uint64_t
+dstore_monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
 }
 
 /**
- * Send current cluster membership to a connected client target by node index.
+ * Lease upkeep, every LEASE_CHECKPOINT_MS.  The leader revokes the leases
+ * that ran out, each with all its keys in one replicated entry, and sends
+ * followers one checkpoint of the leases renewed since the last.
  */
 static void
-dstore_send_cluster_snapshot_to_target_idx(uint32_t node_idx)
+dstore_lease_tick(void)
 {
-    char cmd[256];
+	static uint64_t last_tick_us = 0;
+	uint64_t	now = dstore_monotonic_us();
+	uint64_t	expired[LEASE_EXPIRE_MAX];
+	char	   *renewals;
+	bool		is_leader;
+	int			count;
+	int			i;
+
+	if (now - last_tick_us < (uint64_t) LEASE_CHECKPOINT_MS * 1000)
+		return;
+	last_tick_us = now;
 
-    if (node_idx >= cluster.node_count)
-        return;
-    if (tcp_clients[node_idx] == NULL || tcp_clients[node_idx]->is_connected != 1)
-        return;
+	is_leader = dstore_is_current_leader() != 0;
+	count = lease_expired(is_leader, expired, LEASE_EXPIRE_MAX);
+	for (i = 0; i < count; i++)
+	{
+		rale_debug_log("Lease %llu ran out", (unsigned long long) expired[i]);
+		(void) batch_submit_lease(BATCH_OP_LEASE_EXPIRE, expired[i], 0, NULL);
+	}
+	if (!is_leader)
+		return;
 
-    for (uint32_t j = 0; j < cluster.node_count; j++)
-    {
-        if (cluster.nodes[j].id == -1)
-            continue;
-        snprintf(cmd, sizeof(cmd),
-                 "PROPAGATE_ADD %d %s %s %d %d",
-                 cluster.nodes[j].id,
-                 cluster.nodes[j].name,
-                 cluster.nodes[j].ip,
-                 cluster.nodes[j].rale_port,
-                 cluster.nodes[j].dstore_port);
-        tcp_client_send(tcp_clients[node_idx], cmd);
-        char debug_msg[256];
-        snprintf(debug_msg, sizeof(debug_msg), 
-             "Sent snapshot entry to node_idx %d: %s",
-             node_idx, cmd);
-        rale_debug_log("%s", debug_msg);
-    }
+	/** Renewals are not numbered: losing one only shortens a deadline */
+	renewals = lease_take_renewals();
+	if (renewals != NULL && cluster.node_count > 1)
+		dstore_send_frame(renewals, 0, NULL, 0);
+	free(renewals);
+}
+
+/** Lease table lines bound for one follower, sent LEASE_SHIPMENT_SIZE at a time */
+typedef struct lease_shipment_t
+{
+	uint32_t	node_idx;
+	char	   *buf;
+	size_t		len;
+} lease_shipment_t;
+
+#define LEASE_SHIPMENT_SIZE			(16 * 1024)
+
+static void
+dstore_ship_lease_line(uint64_t id, int ttl, const char *key, void *arg)
+{
+	lease_shipment_t *shipment = arg;
+	char		line[REPLICATION_MESSAGE_BUFFER_SIZE + 64];
+	char		value[MAX_VALUE_SIZE];
+	int			len;
+
+	if (key == NULL)
+		len = snprintf(line, sizeof(line), REPLICATE_LEASE_PREFIX "0 GRANT %llu %d",
+			(unsigned long long) id, ttl);
+	else if (db_get(key, value, sizeof(value), NULL, 0) == 0)
+		len = snprintf(line, sizeof(line), REPLICATE_LEASE_PREFIX "0 PUT %llu %s=%s",
+			(unsigned long long) id, key, value);
+	else
+		return;
+	if (len < 0 || (size_t) len >= sizeof(line))
+		return;
 
-	/** Also send leader snapshot so the server peer learns the current leader */
+	if (shipment->len + (size_t) len + 2 > LEASE_SHIPMENT_SIZE)
 	{
-		int leader_id = dstore_get_current_leader();
-		char leader_msg[128];
-		int term = 0;
-		if (leader_id >= 0)
-		{
-			snprintf(leader_msg, sizeof(leader_msg), "LEADER %d %d", term, leader_id);
-			tcp_client_send(tcp_clients[node_idx], leader_msg);
-			rale_debug_log(
-				"Sent leader snapshot to node_idx %d: %s",
-				node_idx, leader_msg);
-		}
+		(void) dstore_send_message(shipment->node_idx, shipment->buf);
+		shipment->len = 0;
 	}
+	if (shipment->len > 0)
+		shipment->buf[shipment->len++] = '\n';
+	memcpy(shipment->buf + shipment->len, line, (size_t) len + 1);
+	shipment->len += (size_t) len;
 }
 
 /**
- * Main loop for the server component. Initializes server if needed and runs it.
+ * Send a follower we just connected to the lease table, right behind the
+ * CATCHUP header (the snapshot leaves leased keys out): it drops its own,
+ * which may hold leases revoked while it was away, and installs ours with
+ * their keys.
  */
-void
-dstore_server_loop(char *errbuf, size_t errbuflen)
+static void
+dstore_ship_leases(uint32_t node_idx)
 {
-	uint32_t self_idx;
+	lease_shipment_t shipment;
 
-	(void) errbuf;
-	(void) errbuflen;
+	if (!dstore_is_current_leader() || tcp_clients[node_idx] == NULL ||
+		!tcp_clients[node_idx]->is_connected)
+		return;
 
-	/** Server should already be initialized in dstore_init(), just run it */
-	if (tcp_server_ptr == NULL)
-	{
-		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
-			"TCP server not initialized. Server should be initialized in dstore_init().");
+	shipment.node_idx = node_idx;
+	shipment.buf = malloc(LEASE_SHIPMENT_SIZE);
+	if (shipment.buf == NULL)
 		return;
-	}
+	shipment.len = (size_t) snprintf(shipment.buf, LEASE_SHIPMENT_SIZE,
+		REPLICATE_LEASE_PREFIX "0 RESET 0");
+	lease_snapshot(dstore_ship_lease_line, &shipment);
+	(void) dstore_send_message(node_idx, shipment.buf);
+	free(shipment.buf);
+}
 
-	/** Only check cluster state for client operations, not server operations */
-	if (cluster.node_count == 0)
+/**
+ * Record an entry sent to a follower.  Only the newest REPLICA_PENDING_MAX
+ * unacknowledged entries are timed; older ones stop counting as in flight.
+ */
+static void
+dstore_replica_sent(uint32_t node_idx, uint64_t index, size_t bytes)
+{
+	replica_progress_t *progress;
+	replica_pending_t  *slot;
+
+	if (node_idx >= MAX_NODES)
+		return;
+
+	pthread_mutex_lock(&replica_mutex);
+	progress = &replica_progress[node_idx];
+	if (!progress->based)
 	{
-		rale_debug_log("cluster not initialized in dstore_server_loop, skipping client operations");
-		/** Still run the server to accept incoming connections */
+		/** First entry this leader sends on the connection: the follower has all before it */
+		progress->match_index = index - 1;
+		progress->gap_index = 0;
+		progress->based = true;
 	}
-	else
+	if (progress->pending_count == REPLICA_PENDING_MAX)
 	{
-		/** Find the array index for self_id */
-		self_idx = find_node_index_by_id(cluster.self_id);
-		if (self_idx == MAX_NODES)
-		{
-			rale_debug_log("Self node %d not found in cluster yet, skipping client operations",
-			cluster.self_id);
-		}
+		progress->bytes_in_flight -= progress->pending[progress->pending_head].bytes;
+		progress->pending_head = (progress->pending_head + 1) % REPLICA_PENDING_MAX;
+		progress->pending_count--;
 	}
+	slot = &progress->pending[(progress->pending_head + progress->pending_count) % REPLICA_PENDING_MAX];
+	slot->index = index;
+	slot->sent_us = dstore_monotonic_us();
+	slot->bytes = (uint32_t) bytes;
+	slot->acked = false;
+	progress->pending_count++;
+	progress->bytes_in_flight += bytes;
+	progress->sent_index = index;
+	pthread_mutex_unlock(&replica_mutex);
+}
 
-	/** Add debug before running server */
-	rale_debug_log("Running tcp_server_run for self_id %d, tcp_server_ptr=%p",
-		(cluster.self_id >= 0) ? cluster.self_id : -1, (void *)tcp_server_ptr);
-		
-	rale_debug_log("About to call tcp_server_run with server pointer %p",
-		(void *)tcp_server_ptr);
+/**
+ * A follower applied the entry at index.  Its send time gives one RTT
+ * sample, smoothed with gain 1/8 as in TCP's SRTT.  The follower applies
+ * in order but skips entries it never received or could not apply, so
+ * match_index only advances through a contiguous run of acknowledged
+ * entries; an acknowledgement past a hole records the hole in gap_index
+ * until catch-up fills it.
+ */
+static void
+dstore_replica_acked(uint32_t node_idx, uint64_t index)
+{
+	replica_progress_t *progress;
+	uint64_t	now = dstore_monotonic_us();
+	uint32_t	i;
 
-	if (tcp_server_ptr == NULL)
+	if (node_idx >= MAX_NODES)
+		return;
+
+	pthread_mutex_lock(&replica_mutex);
+	progress = &replica_progress[node_idx];
+	progress->last_ack_us = now;
+	if (index <= progress->match_index)
 	{
-		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
-			"tcp_server_ptr is NULL! Server not initialized properly.");
+		pthread_mutex_unlock(&replica_mutex);
 		return;
 	}
 
-	rale_debug_log("Calling tcp_server_run...");
-		
-	/** Main loop: keep daemon alive until shutdown signal */
-	while (!librale_is_shutdown_requested("dstore"))
+	for (i = 0; i < progress->pending_count; i++)
 	{
-		int result = tcp_server_run(tcp_server_ptr);
-		
-		/** Check shutdown more frequently for faster shutdown response */
-		if (librale_is_shutdown_requested("dstore"))
-		{
-			rale_debug_log(
-				"Shutdown requested for DStore server, beginning cleanup");
+		replica_pending_t *entry = &progress->pending[(progress->pending_head + i) % REPLICA_PENDING_MAX];
+
+		if (entry->index > index)
 			break;
-		}
-		
-		/** Send periodic keep-alive messages to all connected nodes */
-		/** Only send keep-alive when it's time, not every loop iteration */
-		static time_t last_keep_alive_check = 0;
-		time_t current_time = time(NULL);
-		
-		if (last_keep_alive_check == 0 || 
-			(current_time - last_keep_alive_check) >= get_keep_alive_interval())
-		{
-			dstore_send_keep_alive();
-			last_keep_alive_check = current_time;
-		}
-		
-		/** Additional check for shutdown after keep-alive */
-		if (librale_is_shutdown_requested("dstore"))
+		if (entry->index == index && !entry->acked)
 		{
-			rale_debug_log(
-				"Shutdown requested after keep-alive, beginning cleanup");
+			uint64_t sample = now - entry->sent_us;
+
+			if (progress->rtt_ewma_us == 0)
+				progress->rtt_ewma_us = sample;
+			else
+				progress->rtt_ewma_us = (progress->rtt_ewma_us * 7 + sample) / 8;
+			progress->bytes_in_flight -= entry->bytes;
+			entry->bytes = 0;
+			entry->acked = true;
 			break;
 		}
-		
-		/** Add small delay to prevent tight loop when no activity */
-		if (result == 0) /** Timeout occurred */
-		{
-			usleep(100000); /** 100ms delay */
-		}
 	}
-	
-	/** Perform cleanup before exiting */
-	rale_debug_log(
-		"DStore server loop exiting for self_id %d, performing cleanup",
-		(cluster.self_id >= 0) ? cluster.self_id : -1);
-	
-	/** Close all client connections gracefully */
-	for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++)
+
+	/** An entry no longer timed still counts when it is next in line */
+	if (index == progress->match_index + 1)
+		progress->match_index = index;
+
+	while (progress->pending_count > 0)
 	{
-		if (client_socket_to_node[i] != -1)
-		{
-			rale_debug_log("Closing client connection in slot %d for node %d",
-				i, client_socket_to_node[i]);
-			tcp_server_client_disconnect(tcp_server_ptr, i);
-			client_socket_to_node[i] = -1;
-		}
+		replica_pending_t *oldest = &progress->pending[progress->pending_head];
+
+		if (oldest->index > progress->match_index + 1 ||
+			(oldest->index == progress->match_index + 1 && !oldest->acked))
+			break;
+		if (oldest->index == progress->match_index + 1)
+			progress->match_index = oldest->index;
+		progress->bytes_in_flight -= oldest->bytes;
+		progress->pending_head = (progress->pending_head + 1) % REPLICA_PENDING_MAX;
+		progress->pending_count--;
 	}
-	
-	/** Clear connection status for all nodes */
-	for (uint32_t i = 0; i < cluster.node_count; i++)
+
+	if (index > progress->match_index)
 	{
-		connection_status[i] = 0;
+		if (progress->gap_index != progress->match_index + 1)
+			rale_debug_log("Follower node_idx %u acknowledged entry %llu without entry %llu",
+				node_idx, (unsigned long long) index,
+				(unsigned long long) (progress->match_index + 1));
+		progress->gap_index = progress->match_index + 1;
 	}
-	
-	rale_debug_log(
-		"DStore server cleanup completed for self_id %d",
-		(cluster.self_id >= 0) ? cluster.self_id : -1);
-	
-	/** Signal that DStore shutdown is complete */
-	librale_signal_shutdown_complete("dstore");
+	else
+		progress->gap_index = 0;
+	pthread_mutex_unlock(&replica_mutex);
+}
+
+static void
+dstore_replica_reset(uint32_t node_idx)
+{
+	if (node_idx >= MAX_NODES)
+		return;
+
+	pthread_mutex_lock(&replica_mutex);
+	replica_progress[node_idx].pending_head = 0;
+	replica_progress[node_idx].pending_count = 0;
+	replica_progress[node_idx].bytes_in_flight = 0;
+	replica_progress[node_idx].based = false;
+	pthread_mutex_unlock(&replica_mutex);
 }
 
 /**
- * Non-blocking server tick - process one server iteration
- * Called by daemon in its main loop
+ * A follower was sent everything through index by catch-up; entries
+ * replicated afterwards are acknowledged from there.
  */
-int
-dstore_server_tick(void)
+static void
+dstore_replica_caught_up(uint32_t node_idx, uint64_t index)
 {
-	static time_t last_keep_alive_check = 0;
-	time_t current_time;
-	int result;
+	replica_progress_t *progress;
 
-	/** Check if server is initialized */
-	if (tcp_server_ptr == NULL)
-	{
-		rale_set_error_fmt(RALE_ERROR_NETWORK_INIT, MODULE,
-			"TCP server not initialized for tick operation.");
-		return -1;
-	}
+	if (node_idx >= MAX_NODES)
+		return;
 
-	/** Check shutdown state */
-	if (librale_is_shutdown_requested("dstore"))
+	pthread_mutex_lock(&replica_mutex);
+	progress = &replica_progress[node_idx];
+	while (progress->pending_count > 0 &&
+		   progress->pending[progress->pending_head].index <= index)
 	{
-		return -1; /** Signal shutdown to daemon */
+		progress->bytes_in_flight -= progress->pending[progress->pending_head].bytes;
+		progress->pending_head = (progress->pending_head + 1) % REPLICA_PENDING_MAX;
+		progress->pending_count--;
 	}
+	if (index > progress->match_index || !progress->based)
+		progress->match_index = index;
+	progress->gap_index = 0;
+	progress->based = true;
+	pthread_mutex_unlock(&replica_mutex);
+}
 
-	/** Process one server iteration (non-blocking) */
-	result = tcp_server_run(tcp_server_ptr);
+/**
+ * Snapshot of every follower's replication progress, as seen by this node
+ * when it is the leader.  *last_index is the newest entry replicated.
+ */
+uint32_t
+dstore_get_replication(librale_replica_status_t *replicas, uint32_t max, uint64_t *last_index)
+{
+	uint64_t	now = dstore_monotonic_us();
+	uint32_t	count = 0;
+	uint32_t	i;
 
-	/** Handle periodic keep-alive */
-	current_time = time(NULL);
-	if (last_keep_alive_check == 0 || 
-		(current_time - last_keep_alive_check) >= get_keep_alive_interval())
+	if (replicas == NULL)
+		return 0;
+
+	pthread_mutex_lock(&replica_mutex);
+	if (last_index != NULL)
+		*last_index = replication_index;
+	for (i = 0; i < cluster.node_count && i < MAX_NODES && count < max; i++)
 	{
-		dstore_send_keep_alive();
-		last_keep_alive_check = current_time;
-	}
+		const replica_progress_t *progress = &replica_progress[i];
+		librale_replica_status_t *out;
 
-	return result;
+		if (cluster.nodes[i].id == cluster.self_id || cluster.nodes[i].id == -1)
+			continue;
+
+		out = &replicas[count++];
+		memset(out, 0, sizeof(*out));
+		out->node_id = cluster.nodes[i].id;
+		out->connected = (tcp_clients[i] != NULL && tcp_clients[i]->is_connected);
+		out->sent_index = progress->sent_index;
+		out->match_index = progress->match_index;
+		out->lag_entries = replication_index - progress->match_index;
+		out->entries_in_flight = progress->sent_index > progress->match_index ?
+			progress->sent_index - progress->match_index : 0;
+		out->bytes_in_flight = progress->bytes_in_flight;
+		out->last_ack_age_ms = progress->last_ack_us != 0 ?
+			(int64_t) ((now - progress->last_ack_us) / 1000) : -1;
+		out->rtt_ewma_us = progress->rtt_ewma_us;
+		out->gap_index = progress->gap_index;
+		if (progress->pending_count > 0)
+			out->lag_ms = (now - progress->pending[progress->pending_head].sent_us) / 1000;
+	}
+	pthread_mutex_unlock(&replica_mutex);
+	return count;
 }
 
 /**
- * Callback for when a client disconnects from our server.
+ * Handle PUT command from external source (e.g., client interface) on the
+ * leader.  The write joins the next group commit round, which stores it
+ * locally, appends it to rale.db and replicates it to followers; this
+ * returns once that round is done.
  */
-static void
-dstore_server_on_disconnection(
-	int client_sock_idx,
-	const char *client_ip,
-	int client_port)
+int
+dstore_handle_put(const char *key, const char *value, char *errbuf, size_t errbuflen)
 {
-	static time_t last_log_time = 0;
-	static int    suppressed = 0;
-	time_t        now = time(NULL);
+	int db_ret;
 
-	if (last_log_time == 0 || (now - last_log_time) >= 1)
+	if (key == NULL || value == NULL)
 	{
-		if (suppressed > 0)
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			rale_debug_log(
-				"Suppressed %d repeated disconnect logs in last interval",
-				suppressed);
-			suppressed = 0;
+			snprintf(errbuf, errbuflen, "invalid parameters: key or value is NULL");
 		}
-		rale_debug_log(
-			"DStore connection LOST: Raled client %s:%d disconnected from our raled Node %d (socket %d)",
-			client_ip, client_port, cluster.self_id, client_sock_idx);
-		last_log_time = now;
-	}
-	else
-	{
-		/* Throttle noisy repeats within the same second */
-		suppressed++;
+		return -1;
 	}
-	/* Reduce logging noise - remove excessive DEBUG messages */
-	
-	/** Clear the client socket to node mapping */
-	if (client_sock_idx >= 0 && client_sock_idx < TCP_SERVER_MAX_CLIENTS)
+
+	db_ret = batch_submit(key, value, &write_revision);
+	if (db_ret < 0)
 	{
-		int node_id = client_socket_to_node[client_sock_idx];
-		if (node_id != -1)
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			/** Find the node index and mark as disconnected */
-			uint32_t node_idx = find_node_index_by_id(node_id);
-			if (node_idx != MAX_NODES)
-			{
-				connection_status[node_idx] = 0; /** Mark as disconnected */
-			}
-			client_socket_to_node[client_sock_idx] = -1; /** Clear the mapping */
+			snprintf(errbuf, errbuflen, "failed to store key-value pair ('%s') locally. DB error: %d", key, db_ret);
 		}
+		return -1;
 	}
-	
-	tcp_server_client_disconnect(tcp_server_ptr, client_sock_idx);
+	return 0;
 }
 
 /**
- * Callback for when our client connection to a server is disconnected.
+ * Store value under key only if the key holds expected (is absent, for a
+ * NULL expected) when the write commits.  Only the leader can compare
+ * against the committed state, so a follower refuses with
+ * dstore_not_leader() in errbuf, even with forward_writes on.  Returns 0
+ * once stored, BATCH_CAS_FAILED if the key held something else, and -1 on
+ * error.
  */
-static void
-dstore_client_on_disconnection(int client_sock, const char *client_ip,
-							  int client_port)
-{
-	uint32_t node_idx = MAX_NODES;
-
-	/** Find which node this disconnection belongs to */
-	for (uint32_t j = 0; j < cluster.node_count; j++)
-	{
-		if (strcmp(cluster.nodes[j].ip, client_ip) == 0 && 
-			cluster.nodes[j].dstore_port == client_port)
-		{
-			node_idx = j;
-			break;
-		}
-	}
-
-	/** Log the disconnection with detailed information */
-	if (node_idx != MAX_NODES)
-	{
-		rale_debug_log( 
-			"DStore connection LOST: Our raled Node %d disconnected from raled Node %d (%s:%d, socket %d)",
-			cluster.self_id, cluster.nodes[node_idx].id, client_ip, client_port, client_sock);
-		connection_status[node_idx] = 0; /** Mark as disconnected */
-		cluster.nodes[node_idx].state = NODE_STATE_OFFLINE;
-	}
-	else
-	{
-		rale_debug_log( 
-			"DStore connection LOST: Unknown client %s:%d disconnected (socket %d)",
-			client_ip, client_port, client_sock);
-	}
+int
+dstore_handle_cas(const char *key, const char *expected, const char *value,
+				  char *errbuf, size_t errbuflen)
+{
+	int			ret;
 
-	rale_debug_log("Tcp_client[] pointers: %p", (void*)tcp_clients);
-	for (uint32_t k = 0; k < MAX_NODES; k++)
+	if (key == NULL || value == NULL)
 	{
-		char debug_msg2[256];
-		snprintf(debug_msg2, sizeof(debug_msg2), "Tcp_client[%d]=%p", k, (void*)tcp_clients[k]);
-		rale_debug_log("%s", debug_msg2);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "invalid parameters: key or value is NULL");
+		}
+		return -1;
 	}
-	for (uint32_t j = 0; j < MAX_NODES; j++) /** MAX_NODES should be cluster->node_count */
+	if (strlen(key) >= MAX_KEY_SIZE || strlen(value) >= MAX_VALUE_SIZE)
 	{
-		if (cluster.node_count == 0) /** Use cluster.node_count */
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			break;
+			snprintf(errbuf, errbuflen, "key or value too long");
 		}
-		if (tcp_clients[j] != NULL && tcp_clients[j]->sock == client_sock)
+		return -1;
+	}
+	write_revision = 0;
+	if (!dstore_is_current_leader())
+	{
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			char client_cleanup_msg[256];
-			snprintf(client_cleanup_msg, sizeof(client_cleanup_msg), 
-				"cleaning up TCP client structure for node_idx %d (socket %d)",
-				j, client_sock);
-			rale_debug_log("%s", client_cleanup_msg);
-			tcp_client_cleanup(tcp_clients[j]);
-			free(tcp_clients[j]);
-			tcp_clients[j] = NULL;
-			connection_status[j] = 0; /** Mark as disconnected */
-			break; /** Found and cleaned up the client */
+			dstore_not_leader(errbuf, errbuflen);
 		}
+		return -1;
 	}
-}
-
-/**
- * Send a message to the primary node.
- */
 
+	ret = batch_submit_cas(key, expected, value, &write_revision);
+	if (ret < 0 && errbuf != NULL && errbuflen > 0)
+	{
+		snprintf(errbuf, errbuflen, "failed to store key-value pair ('%s') locally. DB error: %d", key, ret);
+	}
+	return ret;
+}
 
 /**
- * Send a message to a target node.
+ * Store value under key for as long as lease lives.  Like CAS, only the
+ * leader knows which leases are alive, so a follower refuses with
+ * dstore_not_leader() in errbuf.  Returns 0 once stored,
+ * BATCH_LEASE_NOT_FOUND if the lease has gone, and -1 on error.
  */
 int
-dstore_send_message(uint32_t target_node_idx, const char *message)
+dstore_put_leased(const char *key, const char *value, uint64_t lease,
+				  char *errbuf, size_t errbuflen)
 {
-	const char *reason;
+	int			ret;
 
-	if (cluster.node_count == 0) /** Use cluster.node_count */
+	if (key == NULL || value == NULL || lease == 0)
 	{
-		rale_set_error_fmt(RALE_ERROR_NOT_INITIALIZED, MODULE, "Cluster not initialized for dstore_send_message.");
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "invalid parameters: key, value or lease missing");
+		}
 		return -1;
 	}
-
-	if (target_node_idx >= cluster.node_count) /** Use cluster.node_count */
+	if (strlen(key) >= MAX_KEY_SIZE || strlen(value) >= MAX_VALUE_SIZE)
 	{
-		rale_set_error_fmt(RALE_ERROR_INVALID_PARAMETER, MODULE,
-			"Target node_idx %d is out of bounds (max: %d).",
-			target_node_idx, cluster.node_count - 1);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "key or value too long");
+		}
 		return -1;
 	}
-
-	if (tcp_clients[target_node_idx] != NULL && tcp_clients[target_node_idx]->is_connected)
+	write_revision = 0;
+	if (!dstore_is_current_leader())
 	{
-		/** tcp_client_send is void, so we can't directly check for send errors here. */
-		/** Underlying TCP implementation might handle some retries or log errors. */
-		rale_debug_log("Sending message from self_id %d to node_idx %d: \"%s\"",
-			cluster.self_id, target_node_idx, message);
-		tcp_client_send(tcp_clients[target_node_idx], message);
-		return 0;
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			dstore_not_leader(errbuf, errbuflen);
+		}
+		return -1;
 	}
-	else
+
+	ret = batch_submit_leased(key, value, lease, &write_revision);
+	if (ret < 0 && errbuf != NULL && errbuflen > 0)
 	{
-		reason = (tcp_clients[target_node_idx] == NULL) ? "client not initialized" :
-				 "client not connected";
-		rale_set_error_fmt(RALE_ERROR_NETWORK_UNREACHABLE, MODULE,
-			"cannot send message from self_id %d to node_idx %d (%s)",
-			cluster.self_id, target_node_idx, reason);
-		return -1;
+		snprintf(errbuf, errbuflen, "failed to store key-value pair ('%s') locally. DB error: %d", key, ret);
 	}
+	return ret;
 }
 
 /**
- * Replicates a key-value pair to all follower nodes.
+ * Commit count writes on the leader as one group: they join the commit
+ * queue together, so a client batch costs one round rather than one per
+ * write.  Writes that are too long fail alone with -1; the others get
+ * what dstore_put_leased() or dstore_handle_put() would have returned.
+ * Returns 0 once done, or -1 with errbuf set if nothing was queued,
+ * dstore_not_leader() on a follower.
  */
-void
-dstore_replicate_to_followers(const char *key, const char *value, char *errbuf, size_t errbuflen)
+int
+dstore_put_batch(librale_put_t *puts, int count, char *errbuf, size_t errbuflen)
 {
-	uint32_t      i;
-	char     message[REPLICATION_MESSAGE_BUFFER_SIZE];
-	int      send_ret;
-	const char *reason;
-
-	(void) errbuf;
-	(void) errbuflen;
+	batch_entry_t *entries;
+	int		   *slot;
+	int			queued = 0;
+	int			i;
 
-	if (cluster.node_count == 0) /** Use cluster.node_count */
+	write_revision = 0;
+	if (puts == NULL || count <= 0)
 	{
-		rale_set_error_fmt(RALE_ERROR_NOT_INITIALIZED, MODULE, "Cluster not initialized in dstore_replicate_to_followers.");
-		return;
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "invalid parameters: no writes");
+		}
+		return -1;
 	}
-
-	/** Construct the message */
-	int written = snprintf(message, sizeof(message), "PUT %s=%s", key, value);
-	if (written >= (int)sizeof(message))
+	if (!dstore_is_current_leader())
 	{
-		rale_set_error_fmt(RALE_ERROR_MESSAGE_TOO_LARGE, MODULE, "Message buffer too small for key-value pair");
-		return;
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			dstore_not_leader(errbuf, errbuflen);
+		}
+		return -1;
 	}
 
-	for (i = 0; i < cluster.node_count; i++) /** Use cluster.node_count */
+	entries = calloc((size_t) count, sizeof(batch_entry_t));
+	slot = malloc((size_t) count * sizeof(int));
+	if (entries == NULL || slot == NULL)
 	{
-		/** Skip self (primary node) */
-		if ((int32_t)i == cluster.self_id)
+		free(entries);
+		free(slot);
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			continue;
+			snprintf(errbuf, errbuflen, "out of memory for %d writes", count);
 		}
+		return -1;
+	}
 
-		/** Skip nodes that are not part of the cluster (e.g. id is -1) */
-		if (cluster.nodes[i].id == -1)
-		{
+	for (i = 0; i < count; i++)
+	{
+		puts[i].result = -1;
+		puts[i].revision = 0;
+		if (puts[i].key == NULL || puts[i].value == NULL ||
+			strlen(puts[i].key) >= MAX_KEY_SIZE || strlen(puts[i].value) >= MAX_VALUE_SIZE)
 			continue;
-		}
+		entries[queued].key = puts[i].key;
+		entries[queued].value = puts[i].value;
+		entries[queued].lease = puts[i].lease;
+		slot[queued++] = i;
+	}
 
-		rale_debug_log("Replicating to follower node_idx %d (NodeID %d): \"%s\"",
-			i, cluster.nodes[i].id, message);
+	if (queued > 0)
+		batch_submit_group(entries, queued);
+	for (i = 0; i < queued; i++)
+	{
+		puts[slot[i]].result = entries[i].result;
+		puts[slot[i]].revision = entries[i].revision;
+		if (entries[i].result == 0 && entries[i].revision > write_revision)
+			write_revision = entries[i].revision;
+	}
+	free(slot);
+	free(entries);
+	return 0;
+}
 
-		/** Ensure client is initialized for the target node */
-		if (tcp_clients[i] == NULL)
+/**
+ * Grant a lease of ttl seconds on the leader and return its id in *lease:
+ * the revision the grant committed at.  Returns 0, or -1 with errbuf set.
+ */
+int
+dstore_lease_grant(int ttl, uint64_t *lease, char *errbuf, size_t errbuflen)
+{
+	int			ret;
+
+	write_revision = 0;
+	if (ttl <= 0 || ttl > LEASE_MAX_TTL || lease == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			dstore_init_client(i);
-			if (tcp_clients[i] == NULL) /** Check if init failed */
-			{
-				char warn_msg[256];
-				snprintf(warn_msg, sizeof(warn_msg), 
-					"failed to initialize client for replication to node_idx %d",
-					i);
-				/* Warning: initialization failed for TCP client */
-				continue; /** Skip this follower if client init failed */
-			}
+			snprintf(errbuf, errbuflen, "TTL must be between 1 and %d seconds", LEASE_MAX_TTL);
 		}
-
-		/** Send the message if the client is connected */
-		if (tcp_clients[i] != NULL && tcp_clients[i]->is_connected)
+		return -1;
+	}
+	if (!dstore_is_current_leader())
+	{
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			send_ret = dstore_send_message(i, message);
-			if (send_ret != 0)
-			{
-				char warn_msg2[256];
-				snprintf(warn_msg2, sizeof(warn_msg2), 
-					"failed to send message to follower node_idx %d",
-					i);
-				/* Warning: failed to send message to follower */
-			}
+			dstore_not_leader(errbuf, errbuflen);
 		}
-		else
+		return -1;
+	}
+
+	ret = batch_submit_lease(BATCH_OP_LEASE_GRANT, 0, ttl, &write_revision);
+	if (ret != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			reason = (tcp_clients[i] == NULL) ? "client structure is NULL" :
-					 "client not connected";
-			char warn_msg3[256];
-			snprintf(warn_msg3, sizeof(warn_msg3), 
-				"cannot replicate to follower node_idx %d: %s",
-				i, reason);
-			/* Warning: cannot replicate to follower */
-			/** Optionally, you might want to queue the message or handle the failure in another way */
+			snprintf(errbuf, errbuflen, "failed to grant lease. DB error: %d", ret);
 		}
+		return -1;
 	}
+	*lease = write_revision;
+	return 0;
 }
 
 /**
- * Handle PUT command from external source (e.g., client interface).
- * For primary nodes: stores locally and replicates to followers.
- * For follower nodes: forwards to primary node.
+ * Revoke lease on the leader, removing every key attached to it in one
+ * replicated entry.  Returns 0, BATCH_LEASE_NOT_FOUND if there is no such
+ * lease, and -1 with errbuf set on error.
  */
 int
-dstore_handle_put(const char *key, const char *value, char *errbuf, size_t errbuflen)
+dstore_lease_revoke(uint64_t lease, char *errbuf, size_t errbuflen)
 {
-	int db_ret;
+	int			ret;
 
-	if (key == NULL || value == NULL)
+	write_revision = 0;
+	if (!dstore_is_current_leader())
 	{
 		if (errbuf != NULL && errbuflen > 0)
 		{
-			snprintf(errbuf, errbuflen, "invalid parameters: key or value is NULL");
+			dstore_not_leader(errbuf, errbuflen);
 		}
 		return -1;
 	}
 
-	/** Store locally */
-	db_ret = db_insert(key, value, errbuf, errbuflen);
-	if (db_ret < 0)
+	ret = batch_submit_lease(BATCH_OP_LEASE_REVOKE, lease, 0, &write_revision);
+	if (ret < 0 && errbuf != NULL && errbuflen > 0)
+	{
+		snprintf(errbuf, errbuflen, "failed to revoke lease %llu. DB error: %d",
+				 (unsigned long long) lease, ret);
+	}
+	return ret;
+}
+
+/**
+ * Renew lease, and with it every attached key, for another TTL, which goes
+ * to *ttl.  Nothing is written: followers learn of it from the next
+ * checkpoint.  Returns 0, BATCH_LEASE_NOT_FOUND if the lease is gone or
+ * has run out, and -1 with errbuf set on a follower.
+ */
+int
+dstore_lease_keepalive(uint64_t lease, int *ttl, char *errbuf, size_t errbuflen)
+{
+	int			renewed;
+
+	if (!dstore_is_current_leader())
 	{
 		if (errbuf != NULL && errbuflen > 0)
 		{
-			snprintf(errbuf, errbuflen, "failed to store key-value pair ('%s') locally. DB error: %d", key, db_ret);
+			dstore_not_leader(errbuf, errbuflen);
 		}
 		return -1;
 	}
-	dstore_save_to_rale_db(key, value);
-	dstore_replicate_to_followers(key, value, errbuf, errbuflen);
+
+	renewed = lease_keepalive(lease);
+	if (renewed < 0)
+		return BATCH_LEASE_NOT_FOUND;
+	if (ttl != NULL)
+		*ttl = renewed;
 	return 0;
 }
 
@@ -1423,9 +3315,7 @@ dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen)
 	int        db_ret;
 	const char *value_start;
 
-	(void) errbuf;
-	(void) errbuflen;
-
+	write_revision = 0;
 	if (cluster.node_count == 0) /** Use cluster.node_count */
 	{
 		rale_set_error_fmt(RALE_ERROR_NOT_INITIALIZED, MODULE, "Cluster not initialized in dstore_put_from_command.");
@@ -1612,13 +3502,15 @@ dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen)
 	if (!dstore_is_current_leader())
 	{
 		int current_leader = dstore_get_current_leader();
-		char warn_msg[256];
-		snprintf(warn_msg, sizeof(warn_msg), 
-			"Rejected write request: Node %d is not leader. Current leader is Node %d. "
-			"Forwarding request to leader.",
-			cluster.self_id, current_leader);
-		/* Warning: connection failed */
-		
+
+		/** Unless proxying, tell the writer where to go; it saves a hop */
+		if (!dstore_forward_writes())
+		{
+			if (errbuf != NULL && errbuflen > 0)
+				dstore_not_leader(errbuf, errbuflen);
+			return;
+		}
+
 		/** Forward the request to the leader if we know who it is */
 		if (current_leader != -1 && current_leader != cluster.self_id)
 		{
@@ -1628,7 +3520,10 @@ dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen)
 			{
 				/** Forward the PUT command to the leader */
 				char forward_cmd[512];
-				snprintf(forward_cmd, sizeof(forward_cmd), "FORWARD_PUT %s=%s", key_buf, value_buf);
+				size_t context_len = trace_format_context(forward_cmd, sizeof(forward_cmd));
+
+				snprintf(forward_cmd + context_len, sizeof(forward_cmd) - context_len,
+					"FORWARD_PUT %s=%s", key_buf, value_buf);
 				dstore_send_message(leader_idx, forward_cmd);
 				rale_debug_log( "Forwarded PUT request to leader Node %d", current_leader);
 			}
@@ -1640,28 +3535,17 @@ dstore_put_from_command(const char *command, char *errbuf, size_t errbuflen)
 		return;
 	}
 
-	/** Store locally */
-	db_ret = db_insert(key_buf, value_buf, errbuf, errbuflen);
-	if (db_ret < 0)
+	/**
+	 * Store locally, save to rale.db and replicate to followers, batched
+	 * with whatever other writes arrive meanwhile.
+	 */
+	if (dstore_handle_put(key_buf, value_buf, NULL, 0) < 0)
 	{
 		rale_set_error_fmt(RALE_ERROR_DB_WRITE, MODULE,
-			"Failed to store key-value pair ('%s') locally. DB error: %d.",
-			key_buf, db_ret);
-		/** Depending on requirements, you might want to stop replication if local store fails */
+			"Failed to store key-value pair ('%s') locally.", key_buf);
 		return;
 	}
-	rale_debug_log("successfully stored key-value pair locally: key='%s'", key_buf);
-
-	/** Save to rale.db file */
-	dstore_save_to_rale_db(key_buf, value_buf);
-
-	/**
-	 * Replicate to followers.
-	 * This should only happen on the primary node.
-	 * Assuming the caller of dstore_put_from_command ensures this,
-	 * or dstore_replicate_to_followers handles it (which it does by skipping self_id).
-	 */
-	dstore_replicate_to_followers(key_buf, value_buf, errbuf, errbuflen);
+	rale_debug_log("successfully committed key-value pair: key='%s'", key_buf);
 }
 
 /**
@@ -1685,7 +3569,9 @@ dstore_send_keep_alive(void)
 		{
 			if (current_time - last_keep_alive_sent[i] >= get_keep_alive_interval())
 			{
+				dstore_lock_client(i);
 				tcp_client_send(tcp_clients[i], KEEP_ALIVE_MESSAGE);
+				dstore_unlock_client(i);
 				last_keep_alive_sent[i] = current_time;
 				rale_debug_log(
 					"DStore keep-alive sent: Node %d -> Node %d (%s:%d)",
@@ -1781,7 +3667,9 @@ dstore_broadcast_leader_snapshot(int term, int leader_id)
 	{
 		if (tcp_clients[i] != NULL && tcp_clients[i]->is_connected == 1)
 		{
+			dstore_lock_client(i);
 			tcp_client_send(tcp_clients[i], msg);
+			dstore_unlock_client(i);
 			rale_debug_log(
 				"Broadcast leader snapshot to client node_idx %d: %s",
 				i, msg);
@@ -1836,6 +3724,11 @@ dstore_finit(char *errbuf, size_t errbuflen)
 		return 0;
 	}
 
+	/** Let the commit round in flight finish, then write out rale.db */
+	batch_finit();
+	wal_close();
+	lease_reset(NULL, NULL);
+
 	/** Clean up TCP server */
 	if (tcp_server_ptr != NULL)
 	{
@@ -1932,14 +3825,15 @@ dstore_is_current_leader(void)
 }
 
 /**
- * Get the current leader ID by reading from RALE state.
+ * Read the term and leader id from rale.state.  Returns 0, or -1 if the
+ * file cannot be read or parsed.
  */
-int
-dstore_get_current_leader(void)
+static int
+dstore_read_rale_state(int *term, int *leader_id)
 {
 	char rale_state_path[512];
 	FILE *fp;
-	int current_term = -1, voted_for = -1, leader_id = -1, last_log_index = -1, last_log_term = -1;
+	int current_term = -1, voted_for = -1, leader = -1, last_log_index = -1, last_log_term = -1;
 	
 	/** Construct path to rale.state in the configured database path */
 	snprintf(rale_state_path, sizeof(rale_state_path), "%s/rale.state",
@@ -1948,46 +3842,79 @@ dstore_get_current_leader(void)
 	fp = fopen(rale_state_path, "r");
 	if (!fp)
 	{
-		char debug_msg8[256];
-		snprintf(debug_msg8, sizeof(debug_msg8), "Cannot read RALE state file: %s", rale_state_path);
-		rale_debug_log("%s", debug_msg8);
-		return -1; /** No leader if we can't read state */
+		rale_debug_log("Cannot read RALE state file: %s", rale_state_path);
+		return -1;
 	}
 
 	char line[256];
-	if (fgets(line, sizeof(line), fp) != NULL)
-	{
-		/** Manual parsing for safety */
-		char *token = strtok(line, " \n");
-		if (token) current_term = atoi(token);
-		token = strtok(NULL, " \n");
-		if (token) voted_for = atoi(token);
-		token = strtok(NULL, " \n");
-		if (token) leader_id = atoi(token);
-		token = strtok(NULL, " \n");
-		if (token) last_log_index = atoi(token);
-		token = strtok(NULL, " \n");
-		if (token) last_log_term = atoi(token);
-		
-		if (current_term < 0 || voted_for < 0 || leader_id < 0 || last_log_index < 0 || last_log_term < 0)
-		{
-			fclose(fp);
-			rale_debug_log("Failed to parse RALE state file - invalid values");
-			return -1; /** Not leader if we can't parse state */
-		}
-	}
-	else
+	if (fgets(line, sizeof(line), fp) == NULL)
 	{
 		fclose(fp);
 		rale_debug_log("Failed to read RALE state file");
-		return -1; /** No leader if we can't read state */
+		return -1;
 	}
-
 	fclose(fp);
 
+	/** Manual parsing for safety */
+	char *token = strtok(line, " \n");
+	if (token) current_term = atoi(token);
+	token = strtok(NULL, " \n");
+	if (token) voted_for = atoi(token);
+	token = strtok(NULL, " \n");
+	if (token) leader = atoi(token);
+	token = strtok(NULL, " \n");
+	if (token) last_log_index = atoi(token);
+	token = strtok(NULL, " \n");
+	if (token) last_log_term = atoi(token);
+
+	if (current_term < 0 || voted_for < 0 || leader < 0 || last_log_index < 0 || last_log_term < 0)
+	{
+		rale_debug_log("Failed to parse RALE state file - invalid values");
+		return -1;
+	}
+
+	*term = current_term;
+	*leader_id = leader;
+	return 0;
+}
+
+/**
+ * Get the current leader ID by reading from RALE state.
+ */
+int
+dstore_get_current_leader(void)
+{
+	int term;
+	int leader_id;
+
+	if (dstore_read_rale_state(&term, &leader_id) != 0)
+		return -1; /** No leader if we can't read state */
 	return leader_id;
 }
 
+/**
+ * Tell a writer that reached a follower where writes go: "NOT_LEADER
+ * <leader id> <leader ip> <term>", with -1 and "-" while no leader is
+ * known.  Clients cache the leader from it and resend there themselves.
+ */
+void
+dstore_not_leader(char *buf, size_t buflen)
+{
+	int			term = -1;
+	int			leader_id = -1;
+	uint32_t	leader_idx = MAX_NODES;
+
+	if (dstore_read_rale_state(&term, &leader_id) == 0 && leader_id != cluster.self_id)
+		leader_idx = find_node_index_by_id(leader_id);
+	else
+		leader_id = -1;
+
+	snprintf(buf, buflen, "NOT_LEADER %d %s %d", leader_id,
+			 (leader_idx != MAX_NODES && cluster.nodes[leader_idx].ip[0] != '\0') ?
+			 cluster.nodes[leader_idx].ip : "-",
+			 term);
+}
+
 /**
  * Check if we currently have an active TCP connection to the given node.
  * Returns 1 if connected, 0 otherwise.
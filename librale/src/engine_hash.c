@@ -0,0 +1,240 @@
+/*-------------------------------------------------------------------------
+ *
+ * engine_hash.c
+ *		In-memory hash storage engine.
+ *
+ *		The key index of hash.c, with the key filter and value log that
+ *		database_config_t asks for.  It has no snapshots, and its iterator
+ *		walks the table one hash_scan() entry at a time, so writes made
+ *		meanwhile may or may not be seen.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** Local headers */
+#include "librale_internal.h"
+#include "engine.h"
+
+typedef struct engine_hash
+{
+	hash_table_t	   *table;
+	vlog_t			   *vlog;
+} engine_hash_t;
+
+typedef struct engine_hash_iter
+{
+	hash_table_t	   *table;
+	uint64_t			cursor;
+	bool				done;
+	bool				taken;		/* The callback kept an entry this step */
+	char				key[MAX_KEY_SIZE];
+	char				value[MAX_VALUE_SIZE];
+} engine_hash_iter_t;
+
+static void
+engine_hash_close(void *engine)
+{
+	engine_hash_t *hash = (engine_hash_t *) engine;
+
+	if (hash == NULL)
+	{
+		return;
+	}
+	/** Stop the collector first; it relocates values into the table */
+	vlog_close(hash->vlog);
+	if (hash->table != NULL)
+	{
+		hash_destroy(hash->table, NULL, 0);
+		rfree((void **) &hash->table);
+	}
+	rfree((void **) &hash);
+}
+
+static void *
+engine_hash_open(const config_t *config, char *errbuf, size_t errbuflen)
+{
+	engine_hash_t *hash;
+
+	hash = (engine_hash_t *) rmalloc(sizeof(engine_hash_t));
+	if (hash == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Memory allocation failed for hash engine");
+		}
+		return NULL;
+	}
+	memset(hash, 0, sizeof(engine_hash_t));
+
+	hash->table = (hash_table_t *) rmalloc(sizeof(hash_table_t));
+	if (hash->table == NULL ||
+		hash_init_layout(hash->table, (hash_layout_t) config->db.index_layout,
+						 errbuf, errbuflen) != 0)
+	{
+		rfree((void **) &hash->table);
+		rfree((void **) &hash);
+		return NULL;
+	}
+	if (config->db.key_filter_capacity > 0)
+	{
+		hash_enable_filter(hash->table, config->db.key_filter_capacity, NULL, 0);
+	}
+
+	/** Long values go to the value log, which is refilled from rale.db */
+	if (config->db.value_log)
+	{
+		hash->vlog = vlog_open(config->db.path,
+							   (uint64_t) config->db.value_segment_mb * 1024 * 1024,
+							   (uint64_t) config->db.value_cache_mb * 1024 * 1024,
+							   errbuf, errbuflen);
+		if (hash->vlog == NULL ||
+			hash_enable_value_log(hash->table, hash->vlog,
+								  (size_t) config->db.value_inline_max,
+								  config->db.value_gc_percent, errbuf, errbuflen) != 0)
+		{
+			engine_hash_close(hash);
+			return NULL;
+		}
+	}
+	return hash;
+}
+
+static int
+engine_hash_get(void *engine, const void *snapshot, const char *key, char *value,
+				size_t value_size)
+{
+	engine_hash_t *hash = (engine_hash_t *) engine;
+
+	(void) snapshot;
+	return hash_get(hash->table, key, value, value_size, NULL, 0) == 0 ? 0 : 1;
+}
+
+static int
+engine_hash_put(void *engine, const char *key, const char *value, char *errbuf,
+				size_t errbuflen)
+{
+	return hash_put(((engine_hash_t *) engine)->table, key, value, errbuf, errbuflen);
+}
+
+static int
+engine_hash_remove(void *engine, const char *key, char *errbuf, size_t errbuflen)
+{
+	return hash_delete(((engine_hash_t *) engine)->table, key, errbuf, errbuflen);
+}
+
+static void *
+engine_hash_iter_open(void *engine, const void *snapshot)
+{
+	engine_hash_iter_t *iter;
+
+	(void) snapshot;
+	iter = (engine_hash_iter_t *) rmalloc(sizeof(engine_hash_iter_t));
+	if (iter == NULL)
+	{
+		return NULL;
+	}
+	iter->table = ((engine_hash_t *) engine)->table;
+	iter->cursor = 0;
+	iter->done = false;
+	return iter;
+}
+
+/** Keep the first entry offered, refuse the next so the cursor stops there */
+static int
+engine_hash_iter_take(const char *key, const char *value, void *arg)
+{
+	engine_hash_iter_t *iter = (engine_hash_iter_t *) arg;
+
+	if (iter->taken)
+	{
+		return 1;
+	}
+	strlcpy(iter->key, key, sizeof(iter->key));
+	strlcpy(iter->value, value, sizeof(iter->value));
+	iter->taken = true;
+	return 0;
+}
+
+static int
+engine_hash_iter_next(void *it, const char **key, const char **value)
+{
+	engine_hash_iter_t *iter = (engine_hash_iter_t *) it;
+	int			ret;
+
+	if (iter->done)
+	{
+		return 0;
+	}
+	iter->taken = false;
+	ret = hash_scan(iter->table, 0, 1, &iter->cursor, engine_hash_iter_take, iter, NULL, 0);
+	if (ret < 0)
+	{
+		return -1;
+	}
+	iter->done = (ret == 1);
+	if (!iter->taken)
+	{
+		return 0;
+	}
+	*key = iter->key;
+	*value = iter->value;
+	return 1;
+}
+
+static void
+engine_hash_iter_close(void *iter)
+{
+	rfree(&iter);
+}
+
+static int
+engine_hash_scan(void *engine, uint32_t partition, uint32_t partitions, uint64_t *cursor,
+				 hash_scan_cb cb, void *arg, char *errbuf, size_t errbuflen)
+{
+	return hash_scan(((engine_hash_t *) engine)->table, partition, partitions, cursor,
+					 cb, arg, errbuf, errbuflen);
+}
+
+static int
+engine_hash_save(void *engine, const char *filename, char *errbuf, size_t errbuflen)
+{
+	return hash_save(((engine_hash_t *) engine)->table, filename, errbuf, errbuflen);
+}
+
+static int
+engine_hash_load(void *engine, const char *filename, char *errbuf, size_t errbuflen)
+{
+	return hash_load(((engine_hash_t *) engine)->table, filename, errbuf, errbuflen);
+}
+
+hash_table_t *
+engine_hash_table(void *engine)
+{
+	return engine != NULL ? ((engine_hash_t *) engine)->table : NULL;
+}
+
+vlog_t *
+engine_hash_value_log(void *engine)
+{
+	return engine != NULL ? ((engine_hash_t *) engine)->vlog : NULL;
+}
+
+const engine_ops_t hash_engine_ops = {
+	"hash",
+	false,
+	engine_hash_open,
+	engine_hash_close,
+	engine_hash_get,
+	engine_hash_put,
+	engine_hash_remove,
+	NULL,						/* No snapshots */
+	NULL,
+	engine_hash_iter_open,
+	engine_hash_iter_next,
+	engine_hash_iter_close,
+	engine_hash_scan,
+	engine_hash_save,
+	engine_hash_load
+};
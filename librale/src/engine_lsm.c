@@ -0,0 +1,448 @@
+/*-------------------------------------------------------------------------
+ *
+ * engine_lsm.c
+ *		LSM-tree storage engine.
+ *
+ *		Adapts lsm.c to engine_ops_t.  Its iterators return keys in order
+ *		at a snapshot, so scan() places each key in a partition by hash and
+ *		counts the partition's keys in *cursor.  A scan that stops early
+ *		leaves its iterator in a small cache under that cursor, and the next
+ *		page picks it up where it stopped; without one (expired after
+ *		ENGINE_LSM_SCAN_IDLE seconds, or evicted) a scan re-walks the
+ *		partition and skips *cursor keys.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <time.h>
+
+/** Local headers */
+#include "librale_internal.h"
+#include "engine.h"
+
+#define ENGINE_LSM_SCANS		8		/* Paused scans kept for their next page */
+#define ENGINE_LSM_SCAN_IDLE	30		/* Seconds before a paused scan is dropped */
+
+typedef struct engine_lsm_scan
+{
+	lsm_iter_t		   *iter;		/* At the entry the callback refused */
+	uint32_t			partition;
+	uint32_t			partitions;
+	uint64_t			cursor;
+	time_t				paused;
+} engine_lsm_scan_t;
+
+typedef struct engine_lsm
+{
+	lsm_t			   *lsm;
+	pthread_mutex_t		scan_mutex;
+	engine_lsm_scan_t	scans[ENGINE_LSM_SCANS];
+} engine_lsm_t;
+
+typedef struct engine_lsm_iter
+{
+	lsm_iter_t		   *iter;
+	bool				started;
+} engine_lsm_iter_t;
+
+static void *
+engine_lsm_open(const config_t *config, char *errbuf, size_t errbuflen)
+{
+	engine_lsm_t *engine;
+	lsm_options_t options;
+	char		dir[MAX_STRING_LENGTH + sizeof(ENGINE_LSM_DIR) + 1];
+
+	engine = (engine_lsm_t *) rmalloc(sizeof(engine_lsm_t));
+	if (engine == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Memory allocation failed for LSM engine");
+		}
+		return NULL;
+	}
+	memset(engine, 0, sizeof(engine_lsm_t));
+
+	options.memtable_bytes = (uint64_t) config->db.lsm_memtable_mb * 1024 * 1024;
+	options.sst_bytes = (uint64_t) config->db.lsm_sst_mb * 1024 * 1024;
+	options.level_base_bytes = (uint64_t) config->db.lsm_level_base_mb * 1024 * 1024;
+	options.level0_files = config->db.lsm_level0_files;
+	options.sync = config->wal.sync;
+	snprintf(dir, sizeof(dir), "%s/%s", config->db.path, ENGINE_LSM_DIR);
+
+	engine->lsm = lsm_open(dir, &options, errbuf, errbuflen);
+	if (engine->lsm == NULL)
+	{
+		rfree((void **) &engine);
+		return NULL;
+	}
+	pthread_mutex_init(&engine->scan_mutex, NULL);
+	return engine;
+}
+
+static void
+engine_lsm_close(void *e)
+{
+	engine_lsm_t *engine = (engine_lsm_t *) e;
+	int			i;
+
+	if (engine == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < ENGINE_LSM_SCANS; i++)
+	{
+		lsm_iter_close(engine->scans[i].iter);
+	}
+	lsm_close(engine->lsm);
+	pthread_mutex_destroy(&engine->scan_mutex);
+	rfree((void **) &engine);
+}
+
+static int
+engine_lsm_get(void *e, const void *snapshot, const char *key, char *value, size_t value_size)
+{
+	return lsm_get(((engine_lsm_t *) e)->lsm, (const lsm_snapshot_t *) snapshot,
+				   key, strlen(key), value, value_size);
+}
+
+static int
+engine_lsm_put(void *e, const char *key, const char *value, char *errbuf, size_t errbuflen)
+{
+	return lsm_put(((engine_lsm_t *) e)->lsm, key, strlen(key), value, strlen(value),
+				   errbuf, errbuflen);
+}
+
+static int
+engine_lsm_remove(void *e, const char *key, char *errbuf, size_t errbuflen)
+{
+	return lsm_delete(((engine_lsm_t *) e)->lsm, key, strlen(key), errbuf, errbuflen);
+}
+
+static void *
+engine_lsm_snapshot(void *e)
+{
+	return lsm_snapshot_acquire(((engine_lsm_t *) e)->lsm);
+}
+
+static void
+engine_lsm_release(void *e, void *snapshot)
+{
+	lsm_snapshot_release(((engine_lsm_t *) e)->lsm, (lsm_snapshot_t *) snapshot);
+}
+
+static void *
+engine_lsm_iter_open(void *e, const void *snapshot)
+{
+	engine_lsm_iter_t *iter;
+
+	iter = (engine_lsm_iter_t *) rmalloc(sizeof(engine_lsm_iter_t));
+	if (iter == NULL)
+	{
+		return NULL;
+	}
+	iter->iter = lsm_iter_open(((engine_lsm_t *) e)->lsm, (const lsm_snapshot_t *) snapshot);
+	iter->started = false;
+	if (iter->iter == NULL)
+	{
+		rfree((void **) &iter);
+		return NULL;
+	}
+	return iter;
+}
+
+static int
+engine_lsm_iter_next(void *it, const char **key, const char **value)
+{
+	engine_lsm_iter_t *iter = (engine_lsm_iter_t *) it;
+
+	if (iter->started)
+	{
+		lsm_iter_next(iter->iter);
+	}
+	iter->started = true;
+	if (!lsm_iter_valid(iter->iter))
+	{
+		return 0;
+	}
+	*key = lsm_iter_key(iter->iter);
+	*value = lsm_iter_value(iter->iter);
+	return 1;
+}
+
+static void
+engine_lsm_iter_close(void *it)
+{
+	engine_lsm_iter_t *iter = (engine_lsm_iter_t *) it;
+
+	if (iter == NULL)
+	{
+		return;
+	}
+	lsm_iter_close(iter->iter);
+	rfree((void **) &iter);
+}
+
+static bool
+engine_lsm_in_partition(const char *key, uint32_t partition, uint32_t partitions)
+{
+	return partitions == 1 ||
+		hash_key_seeded(key, strlen(key), LSM_HASH_SEED) % partitions == partition;
+}
+
+/** Take the paused scan for this page, dropping any that sat too long */
+static lsm_iter_t *
+engine_lsm_scan_resume(engine_lsm_t *engine, uint32_t partition, uint32_t partitions,
+					   uint64_t cursor)
+{
+	time_t		now = time(NULL);
+	lsm_iter_t *iter = NULL;
+	int			i;
+
+	pthread_mutex_lock(&engine->scan_mutex);
+	for (i = 0; i < ENGINE_LSM_SCANS; i++)
+	{
+		engine_lsm_scan_t *scan = &engine->scans[i];
+
+		if (scan->iter == NULL)
+		{
+			continue;
+		}
+		if (iter == NULL && scan->partition == partition &&
+			scan->partitions == partitions && scan->cursor == cursor)
+		{
+			iter = scan->iter;
+			scan->iter = NULL;
+		}
+		else if (now - scan->paused > ENGINE_LSM_SCAN_IDLE)
+		{
+			lsm_iter_close(scan->iter);
+			scan->iter = NULL;
+		}
+	}
+	pthread_mutex_unlock(&engine->scan_mutex);
+	return iter;
+}
+
+/** Keep a stopped scan, in a free slot or the longest-paused one's */
+static void
+engine_lsm_scan_pause(engine_lsm_t *engine, lsm_iter_t *iter, uint32_t partition,
+					  uint32_t partitions, uint64_t cursor)
+{
+	engine_lsm_scan_t *slot = &engine->scans[0];
+	int			i;
+
+	pthread_mutex_lock(&engine->scan_mutex);
+	for (i = 0; i < ENGINE_LSM_SCANS; i++)
+	{
+		if (engine->scans[i].iter == NULL)
+		{
+			slot = &engine->scans[i];
+			break;
+		}
+		if (engine->scans[i].paused < slot->paused)
+		{
+			slot = &engine->scans[i];
+		}
+	}
+	lsm_iter_close(slot->iter);
+	slot->iter = iter;
+	slot->partition = partition;
+	slot->partitions = partitions;
+	slot->cursor = cursor;
+	slot->paused = time(NULL);
+	pthread_mutex_unlock(&engine->scan_mutex);
+}
+
+static int
+engine_lsm_scan(void *e, uint32_t partition, uint32_t partitions, uint64_t *cursor,
+				hash_scan_cb cb, void *arg, char *errbuf, size_t errbuflen)
+{
+	engine_lsm_t *engine = (engine_lsm_t *) e;
+	lsm_iter_t *iter;
+	uint64_t	skip;
+
+	if (engine == NULL || cursor == NULL || cb == NULL || partitions == 0 ||
+		partition >= partitions)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Invalid parameters for LSM scan");
+		}
+		return -1;
+	}
+
+	iter = engine_lsm_scan_resume(engine, partition, partitions, *cursor);
+	if (iter == NULL)
+	{
+		iter = lsm_iter_open(engine->lsm, NULL);
+		if (iter == NULL)
+		{
+			if (errbuf != NULL && errbuflen > 0)
+			{
+				snprintf(errbuf, errbuflen, "Memory allocation failed for LSM scan");
+			}
+			return -1;
+		}
+		for (skip = 0; skip < *cursor && lsm_iter_valid(iter); lsm_iter_next(iter))
+		{
+			if (engine_lsm_in_partition(lsm_iter_key(iter), partition, partitions))
+			{
+				skip++;
+			}
+		}
+	}
+
+	for (; lsm_iter_valid(iter); lsm_iter_next(iter))
+	{
+		if (!engine_lsm_in_partition(lsm_iter_key(iter), partition, partitions))
+		{
+			continue;
+		}
+		if (cb(lsm_iter_key(iter), lsm_iter_value(iter), arg) != 0)
+		{
+			engine_lsm_scan_pause(engine, iter, partition, partitions, *cursor);
+			return 0;
+		}
+		(*cursor)++;
+	}
+	lsm_iter_close(iter);
+	return 1;
+}
+
+/** Write the latest data in hash_save() format */
+static int
+engine_lsm_save(void *e, const char *filename, char *errbuf, size_t errbuflen)
+{
+	engine_lsm_t *engine = (engine_lsm_t *) e;
+	lsm_iter_t *iter;
+	FILE	   *file;
+	int			num_entries = 0;
+	bool		ok;
+
+	file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to open file for saving: %s", filename);
+		}
+		return -1;
+	}
+	iter = lsm_iter_open(engine->lsm, NULL);
+	ok = iter != NULL && fwrite(&num_entries, sizeof(int), 1, file) == 1;
+	for (; ok && lsm_iter_valid(iter); lsm_iter_next(iter))
+	{
+		int			key_len = (int) strlen(lsm_iter_key(iter));
+		int			value_len = (int) strlen(lsm_iter_value(iter));
+
+		ok = fwrite(&key_len, sizeof(int), 1, file) == 1 &&
+			fwrite(lsm_iter_key(iter), (size_t) key_len, 1, file) == 1 &&
+			fwrite(&value_len, sizeof(int), 1, file) == 1 &&
+			(value_len == 0 || fwrite(lsm_iter_value(iter), (size_t) value_len, 1, file) == 1);
+		num_entries++;
+	}
+	lsm_iter_close(iter);
+
+	/** The count comes first but is known last */
+	ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&num_entries, sizeof(int), 1, file) == 1;
+	if (fclose(file) != 0)
+	{
+		ok = false;
+	}
+	if (!ok)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to save LSM data to file: %s", filename);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/** Write every entry of a hash_save() format file */
+static int
+engine_lsm_load(void *e, const char *filename, char *errbuf, size_t errbuflen)
+{
+	engine_lsm_t *engine = (engine_lsm_t *) e;
+	FILE	   *file;
+	int			num_entries;
+	int			key_len;
+	int			value_len;
+	int			i;
+	char		key[MAX_KEY_SIZE];
+	char		value[MAX_VALUE_SIZE];
+
+	file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "File not found: %s", filename);
+		}
+		return -1;
+	}
+	if (fread(&num_entries, sizeof(int), 1, file) != 1)
+	{
+		fclose(file);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to read entry count");
+		}
+		return -1;
+	}
+	for (i = 0; i < num_entries; i++)
+	{
+		if (fread(&key_len, sizeof(int), 1, file) != 1 ||
+			key_len <= 0 || key_len >= MAX_KEY_SIZE ||
+			fread(key, (size_t) key_len, 1, file) != 1 ||
+			fread(&value_len, sizeof(int), 1, file) != 1 ||
+			value_len < 0 || value_len >= MAX_VALUE_SIZE ||
+			(value_len > 0 && fread(value, (size_t) value_len, 1, file) != 1))
+		{
+			fclose(file);
+			if (errbuf != NULL && errbuflen > 0)
+			{
+				snprintf(errbuf, errbuflen, "Truncated entry %d in %s", i, filename);
+			}
+			return -1;
+		}
+		if (lsm_put(engine->lsm, key, (size_t) key_len, value, (size_t) value_len,
+					errbuf, errbuflen) != 0)
+		{
+			fclose(file);
+			return -1;
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+lsm_t *
+engine_lsm(void *e)
+{
+	return e != NULL ? ((engine_lsm_t *) e)->lsm : NULL;
+}
+
+const engine_ops_t lsm_engine_ops = {
+	"lsm",
+	true,
+	engine_lsm_open,
+	engine_lsm_close,
+	engine_lsm_get,
+	engine_lsm_put,
+	engine_lsm_remove,
+	engine_lsm_snapshot,
+	engine_lsm_release,
+	engine_lsm_iter_open,
+	engine_lsm_iter_next,
+	engine_lsm_iter_close,
+	engine_lsm_scan,
+	engine_lsm_save,
+	engine_lsm_load
+};
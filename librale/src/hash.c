@@ -17,10 +17,26 @@
  * hash.c
  *    Simple hash table implementation for librale.
  *
- *    This hash table uses chained hashing to resolve collisions. It provides
+ *    This hash table uses chained hashing to resolve collisions. Keys are
+ *    hashed with a randomly seeded wyhash; each entry keeps the full hash
+ *    and the key length, which chain walks compare first. It provides
  *    basic operations like put, get, delete, and also supports saving to
  *    and loading from a file. Thread safety is managed via a mutex.
  *
+ *    hash_init_layout() can put an open-addressing index (hash_swiss.c)
+ *    behind the same functions instead of the bucket chains.
+ *
+ *    An optional counting Bloom filter (hash_enable_filter) answers most
+ *    lookups of absent keys before the mutex is taken.  It is kept in step
+ *    by put and delete and rebuilt after a snapshot load.
+ *
+ *    With a value log (hash_enable_value_log) values longer than
+ *    value_inline_max are appended to it and the index keeps a reference,
+ *    flagged HASH_VALUE_LOGGED.  hash_get() reads them back after dropping
+ *    the mutex; a reference whose segment the collector removed meanwhile
+ *    is looked up again.  Replaced and deleted references are reported to
+ *    the log as garbage.
+ *
  * Copyright (c) 2024-2025, pgElephant, Inc.
  *
  * IDENTIFICATION
@@ -30,46 +46,392 @@
  */
 
 /** System headers */
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 /** Local headers */
 #include "librale_internal.h"
+#include "probes.h"
 
 /** Constants */
 #define MODULE "DSTORE"
 
-static unsigned int
-hash_func(const char *key)
+/** Multiplier constants of wyhash */
+static const uint64_t hash_secret[4] = {
+	UINT64_C(0x2d358dccaa6c78a5), UINT64_C(0x8bb84b93962eacc9),
+	UINT64_C(0x4b33a62ed433d4a3), UINT64_C(0x4d5a2da51de1aa47)
+};
+
+/** Per-process seed, so bucket placement cannot be predicted from outside */
+static uint64_t hash_seed;
+static pthread_once_t hash_seed_once = PTHREAD_ONCE_INIT;
+
+static void
+hash_init_seed(void)
+{
+	struct timespec ts;
+	uint64_t	seed = 0;
+	int			fd;
+
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd >= 0)
+	{
+		if (read(fd, &seed, sizeof(seed)) != (ssize_t) sizeof(seed))
+		{
+			seed = 0;
+		}
+		close(fd);
+	}
+	if (seed == 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		seed = ((uint64_t) ts.tv_sec << 32) ^ (uint64_t) ts.tv_nsec ^
+			((uint64_t) getpid() << 16) ^ (uint64_t) (uintptr_t) &ts;
+	}
+	hash_seed = seed;
+}
+
+static inline uint64_t
+hash_read64(const uint8_t *p)
+{
+	uint64_t	v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t
+hash_read32(const uint8_t *p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/** 64x64 -> 128 bit multiply; *a gets the low half, *b the high half */
+static inline void
+hash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__extension__ unsigned __int128 r = *a;
+
+	r *= *b;
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t	ha = *a >> 32, hb = *b >> 32;
+	uint64_t	la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t	rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t	t = rl + (rm0 << 32);
+	uint64_t	c = t < rl;
+	uint64_t	lo = t + (rm1 << 32);
+
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+hash_mix(uint64_t a, uint64_t b)
+{
+	hash_mum(&a, &b);
+	return a ^ b;
+}
+
+/**
+ * 64-bit hash of len bytes of key under seed (wyhash, final version 4).
+ *
+ * Keys up to 16 bytes take two overlapping loads and one multiply.  Longer
+ * ones are consumed 16 bytes per multiply, and past 48 bytes as three
+ * independent 16-byte lanes, so the multiplies overlap in the pipeline
+ * the way SIMD lanes would.  Unaligned loads go through memcpy.
+ *
+ * Use a fixed seed only for hashes that are stored on disk.
+ */
+uint64_t
+hash_key_seeded(const char *key, size_t len, uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *) key;
+	uint64_t	a;
+	uint64_t	b;
+	size_t		i = len;
+
+	seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+	if (len <= 16)
+	{
+		if (len >= 4)
+		{
+			a = (hash_read32(p) << 32) | hash_read32(p + ((len >> 3) << 2));
+			b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - ((len >> 3) << 2));
+		}
+		else if (len > 0)
+		{
+			a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		if (i > 48)
+		{
+			uint64_t	see1 = seed;
+			uint64_t	see2 = seed;
+
+			do
+			{
+				seed = hash_mix(hash_read64(p) ^ hash_secret[1], hash_read64(p + 8) ^ seed);
+				see1 = hash_mix(hash_read64(p + 16) ^ hash_secret[2], hash_read64(p + 24) ^ see1);
+				see2 = hash_mix(hash_read64(p + 32) ^ hash_secret[3], hash_read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16)
+		{
+			seed = hash_mix(hash_read64(p) ^ hash_secret[1], hash_read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = hash_read64(p + i - 16);
+		b = hash_read64(p + i - 8);
+	}
+
+	a ^= hash_secret[1];
+	b ^= seed;
+	hash_mum(&a, &b);
+	return hash_mix(a ^ hash_secret[0] ^ len, b ^ hash_secret[1]);
+}
+
+/**
+ * Hash of a key under the per-process seed, for in-memory structures.
+ */
+uint64_t
+hash_key(const char *key, size_t len)
+{
+	pthread_once(&hash_seed_once, hash_init_seed);
+	return hash_key_seeded(key, len, hash_seed);
+}
+
+/** Bucket of a key hash */
+static inline unsigned int
+hash_bucket(uint64_t hash_val)
+{
+	return (unsigned int) (hash_val % HASH_SIZE);
+}
+
+/**
+ * Whether entry holds key: the stored hash and length rule out nearly
+ * every other entry before a byte of key is compared.
+ */
+static inline int
+hash_entry_matches(const hash_entry_t *entry, uint64_t hash_val, const char *key,
+				   size_t key_len)
+{
+	return entry->hash == hash_val && entry->key_len == key_len &&
+		memcmp(entry->key, key, key_len) == 0;
+}
+
+/**
+ * Visit every entry, whichever the layout.  Caller holds the mutex.
+ */
+static int
+hash_visit_all(hash_table_t *table, hash_swiss_visit visit, void *arg)
 {
-	unsigned int hash = 5381;
-	int          c;
+	hash_entry_t  *entry;
+	uint64_t	slot = 0;
+	int			bucket;
 
-	while ((c = *key++))
+	if (table->swiss != NULL)
 	{
-		hash = ((hash << 5) + hash) + (unsigned int)c; /** hash * 33 + c */
+		return hash_swiss_walk(table->swiss, &slot, hash_swiss_slots(table->swiss), visit, arg);
 	}
-	return hash % HASH_SIZE;
+	HASH_ITERATE(table, entry, bucket)
+	{
+		if (visit(entry->hash, entry->key, entry->value, entry->flags, arg) != 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
 }
 
-/** Hash function to compute the bucket index */
-static unsigned int
-hash(const char *key)
+static int
+hash_filter_add_visit(uint64_t hash_val, const char *key, const char *value, uint8_t flags,
+					  void *arg)
 {
-	unsigned int hash_val = 0;
+	(void) key;
+	(void) value;
+	(void) flags;
+	bloom_add((bloom_t *) arg, hash_val);
+	return 0;
+}
 
-	while (*key)
+/**
+ * Refill the key filter from the table, shedding counters left saturated
+ * by deleted keys.  Caller holds the mutex.  Lookups racing the refill
+ * may miss keys, so it runs only while the table is not yet served.
+ */
+static void
+hash_rebuild_filter(hash_table_t *table)
+{
+	if (table->filter == NULL)
 	{
-		hash_val = (hash_val << 5) + (unsigned int)*key++;
+		return;
 	}
+	bloom_clear(table->filter);
+	(void) hash_visit_all(table, hash_filter_add_visit, table->filter);
+}
 
-	return hash_val % HASH_SIZE;
+/**
+ * Stored value of key and its flags, NULL if absent.  Caller holds the
+ * mutex; the pointer is good until it is released.
+ */
+static const char *
+hash_find_value(hash_table_t *table, uint64_t hash_val, const char *key, size_t key_len,
+				uint8_t *flags)
+{
+	hash_entry_t  *entry;
+
+	if (table->swiss != NULL)
+	{
+		return hash_swiss_get(table->swiss, hash_val, key, key_len, flags);
+	}
+	for (entry = table->entries[hash_bucket(hash_val)]; entry != NULL; entry = entry->next)
+	{
+		if (hash_entry_matches(entry, hash_val, key, key_len))
+		{
+			*flags = entry->flags;
+			return entry->value;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Store value in a chained entry, reusing its buffer when it fits.  The
+ * buffer is sized to what it holds, so an entry whose value went to the
+ * value log keeps only the reference.  On failure the entry is unchanged.
+ */
+static int
+hash_entry_set_value(hash_entry_t *entry, const char *value)
+{
+	size_t		size = strlen(value) + 1;
+	char	   *buf;
+
+	if (size > entry->value_cap)
+	{
+		buf = malloc(size);
+		if (buf == NULL)
+		{
+			return -1;
+		}
+		free(entry->value);
+		entry->value = buf;
+		entry->value_cap = (uint32_t) size;
+	}
+	memcpy(entry->value, value, size);
+	return 0;
+}
+
+/** Free a chained entry and its value */
+static void
+hash_entry_free(hash_entry_t *entry)
+{
+	free(entry->value);
+	rfree((void **) &entry);
+}
+
+/**
+ * Remember the value log reference key holds, if any, so it can be
+ * discarded once the key is overwritten or deleted.  Caller holds the mutex.
+ */
+static void
+hash_logged_ref(hash_table_t *table, uint64_t hash_val, const char *key, size_t key_len,
+				char *ref, size_t ref_size)
+{
+	const char *found;
+	uint8_t		flags = 0;
+
+	ref[0] = '\0';
+	if (table->vlog == NULL)
+	{
+		return;
+	}
+	found = hash_find_value(table, hash_val, key, key_len, &flags);
+	if (found != NULL && (flags & HASH_VALUE_LOGGED) != 0)
+	{
+		strlcpy(ref, found, ref_size);
+	}
+}
+
+/**
+ * What the index stores for value: the value itself, or a reference to a
+ * copy appended to the value log when it is longer than value_inline_max.
+ * Caller holds the mutex.
+ */
+static int
+hash_stored_value(hash_table_t *table, const char *key, size_t key_len, const char *value,
+				  char *ref, size_t ref_size, const char **stored, uint8_t *flags)
+{
+	size_t		value_len = strlen(value);
+
+	*stored = value;
+	*flags = 0;
+	if (table->vlog == NULL || value_len <= table->value_inline_max)
+	{
+		return 0;
+	}
+	if (vlog_append(table->vlog, key, key_len, value, value_len, ref, ref_size) != 0)
+	{
+		return -1;
+	}
+	*stored = ref;
+	*flags = HASH_VALUE_LOGGED;
+	return 0;
+}
+
+/**
+ * The value itself for a visitor: logged values are read back into buf.
+ * NULL if the value log cannot be read.  Caller holds the mutex, so the
+ * reference is current and its segment still exists.
+ */
+static const char *
+hash_visit_value(hash_table_t *table, const char *value, uint8_t flags, char *buf,
+				 size_t buf_size)
+{
+	if ((flags & HASH_VALUE_LOGGED) == 0)
+	{
+		return value;
+	}
+	if (table->vlog == NULL || vlog_read(table->vlog, value, buf, buf_size) != 0)
+	{
+		return NULL;
+	}
+	return buf;
 }
 
 int
 hash_init(hash_table_t *table, char *errbuf, size_t errbuflen)
+{
+	return hash_init_layout(table, HASH_LAYOUT_CHAINED, errbuf, errbuflen);
+}
+
+int
+hash_init_layout(hash_table_t *table, hash_layout_t layout, char *errbuf,
+				 size_t errbuflen)
 {
 	int i;
 
@@ -85,8 +447,26 @@ hash_init(hash_table_t *table, char *errbuf, size_t errbuflen)
 	{
 		table->entries[i] = NULL;
 	}
+	table->filter = NULL;
+	table->swiss = NULL;
+	table->vlog = NULL;
+	table->value_inline_max = 0;
+	if (layout == HASH_LAYOUT_SWISS)
+	{
+		table->swiss = hash_swiss_create();
+		if (table->swiss == NULL)
+		{
+			if (errbuf != NULL && errbuflen > 0)
+			{
+				snprintf(errbuf, errbuflen, "Memory allocation failed for index");
+			}
+			return -1;
+		}
+	}
 	if (pthread_mutex_init(&table->mutex, NULL) != 0)
 	{
+		hash_swiss_destroy(table->swiss);
+		table->swiss = NULL;
 		if (errbuf != NULL && errbuflen > 0)
 		{
 			snprintf(errbuf, errbuflen, "Failed to initialize mutex");
@@ -103,6 +483,13 @@ hash_put(hash_table_t *table, const char *key, const char *value, char *errbuf,
 	unsigned int index;
 	hash_entry_t  *entry;
 	hash_entry_t  *new_entry;
+	uint64_t	hash_val;
+	size_t		key_len;
+	const char *stored;
+	uint8_t		flags;
+	char		ref[VLOG_REF_SIZE];
+	char		old_ref[VLOG_REF_SIZE];
+	int			ret;
 
 	if (table == NULL || key == NULL || value == NULL)
 	{
@@ -112,7 +499,8 @@ hash_put(hash_table_t *table, const char *key, const char *value, char *errbuf,
 		}
 		return -1;
 	}
-	if (strlen(key) >= MAX_KEY_SIZE || strlen(value) >= MAX_VALUE_SIZE)
+	key_len = strlen(key);
+	if (key_len >= MAX_KEY_SIZE || strlen(value) >= MAX_VALUE_SIZE)
 	{
 		if (errbuf != NULL && errbuflen > 0)
 		{
@@ -120,32 +508,114 @@ hash_put(hash_table_t *table, const char *key, const char *value, char *errbuf,
 		}
 		return -1;
 	}
-	index = hash(key);
+	RALE_PROBE1(hash__put__start, key);
+	hash_val = hash_key(key, key_len);
+	index = hash_bucket(hash_val);
 	pthread_mutex_lock(&table->mutex);
+	if (hash_stored_value(table, key, key_len, value, ref, sizeof(ref), &stored, &flags) != 0)
+	{
+		pthread_mutex_unlock(&table->mutex);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to append to value log");
+		}
+		RALE_PROBE2(hash__put__done, key, -1);
+		return -1;
+	}
+	if (table->swiss != NULL)
+	{
+		hash_logged_ref(table, hash_val, key, key_len, old_ref, sizeof(old_ref));
+		/** A new key is visible to filtered lookups once the filter has it */
+		ret = hash_swiss_put(table->swiss, hash_val, key, key_len, stored, flags);
+		if (ret == 1 && table->filter != NULL)
+		{
+			bloom_add(table->filter, hash_val);
+		}
+		if (table->vlog != NULL)
+		{
+			/** Whichever copy the index no longer points at is garbage */
+			if (ret >= 0 && old_ref[0] != '\0')
+			{
+				vlog_discard(table->vlog, old_ref);
+			}
+			else if (ret < 0 && flags == HASH_VALUE_LOGGED)
+			{
+				vlog_discard(table->vlog, ref);
+			}
+		}
+		pthread_mutex_unlock(&table->mutex);
+		if (ret < 0 && errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Memory allocation failed");
+		}
+		RALE_PROBE2(hash__put__done, key, ret < 0 ? -1 : 0);
+		return ret < 0 ? -1 : 0;
+	}
 	for (entry = table->entries[index]; entry != NULL; entry = entry->next)
 	{
-		if (strcmp(entry->key, key) == 0)
+		if (hash_entry_matches(entry, hash_val, key, key_len))
 		{
-			strlcpy(entry->value, value, MAX_VALUE_SIZE);
+			old_ref[0] = '\0';
+			if ((entry->flags & HASH_VALUE_LOGGED) != 0 && table->vlog != NULL)
+			{
+				strlcpy(old_ref, entry->value, sizeof(old_ref));
+			}
+			if (hash_entry_set_value(entry, stored) != 0)
+			{
+				if (flags == HASH_VALUE_LOGGED)
+				{
+					vlog_discard(table->vlog, ref);
+				}
+				pthread_mutex_unlock(&table->mutex);
+				if (errbuf != NULL && errbuflen > 0)
+				{
+					snprintf(errbuf, errbuflen, "Memory allocation failed");
+				}
+				RALE_PROBE2(hash__put__done, key, -1);
+				return -1;
+			}
+			entry->flags = flags;
+			if (old_ref[0] != '\0')
+			{
+				vlog_discard(table->vlog, old_ref);
+			}
 			pthread_mutex_unlock(&table->mutex);
+			RALE_PROBE2(hash__put__done, key, 0);
 			return 0;
 		}
 	}
 	new_entry = rmalloc(sizeof(hash_entry_t));
+	if (new_entry != NULL && hash_entry_set_value(new_entry, stored) != 0)
+	{
+		rfree((void **) &new_entry);
+	}
 	if (new_entry == NULL)
 	{
 		if (errbuf != NULL && errbuflen > 0)
 		{
 			snprintf(errbuf, errbuflen, "Memory allocation failed");
 		}
+		if (flags == HASH_VALUE_LOGGED)
+		{
+			vlog_discard(table->vlog, ref);
+		}
 		pthread_mutex_unlock(&table->mutex);
+		RALE_PROBE2(hash__put__done, key, -1);
 		return -1;
 	}
-	strlcpy(new_entry->key, key, MAX_KEY_SIZE);
-	strlcpy(new_entry->value, value, MAX_VALUE_SIZE);
+	memcpy(new_entry->key, key, key_len + 1);
+	new_entry->hash = hash_val;
+	new_entry->key_len = (uint32_t) key_len;
+	new_entry->flags = flags;
+	/** Filter first: a lock-free reader must not miss a linked key */
+	if (table->filter != NULL)
+	{
+		bloom_add(table->filter, hash_val);
+	}
 	new_entry->next = table->entries[index];
 	table->entries[index] = new_entry;
 	pthread_mutex_unlock(&table->mutex);
+	RALE_PROBE2(hash__put__done, key, 0);
 	return 0;
 }
 
@@ -153,8 +623,12 @@ int
 hash_get(hash_table_t *table, const char *key, char *value, size_t value_size,
 		 char *errbuf, size_t errbuflen)
 {
-	unsigned int hash_val;
-	hash_entry_t  *entry;
+	uint64_t	hash_val;
+	size_t		key_len;
+	const char *found;
+	uint8_t		flags = 0;
+	char		ref[VLOG_REF_SIZE];
+	int			ret;
 
 	if (table == NULL || key == NULL || value == NULL || value_size == 0)
 	{
@@ -164,20 +638,60 @@ hash_get(hash_table_t *table, const char *key, char *value, size_t value_size,
 		}
 		return -1;
 	}
-	pthread_mutex_lock(&table->mutex);
-	hash_val = hash_func(key);
-	entry = table->entries[hash_val];
-	while (entry != NULL)
+	RALE_PROBE1(hash__get__start, key);
+	key_len = strlen(key);
+	hash_val = hash_key(key, key_len);
+	if (table->filter != NULL && !bloom_may_contain(table->filter, hash_val))
+	{
+		RALE_PROBE2(hash__get__done, key, -1);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Key not found");
+		}
+		return -1;
+	}
+	do
 	{
-		if (strcmp(entry->key, key) == 0)
+		pthread_mutex_lock(&table->mutex);
+		found = hash_find_value(table, hash_val, key, key_len, &flags);
+		if (found != NULL && (flags & HASH_VALUE_LOGGED) == 0)
 		{
-			strlcpy(value, entry->value, value_size);
+			strlcpy(value, found, value_size);
 			pthread_mutex_unlock(&table->mutex);
+			RALE_PROBE2(hash__get__done, key, 0);
 			return 0;
 		}
-		entry = entry->next;
+		if (found == NULL)
+		{
+			pthread_mutex_unlock(&table->mutex);
+			break;
+		}
+
+		/** Read the log without the mutex; retry if the segment was collected */
+		strlcpy(ref, found, sizeof(ref));
+		pthread_mutex_unlock(&table->mutex);
+		ret = vlog_read(table->vlog, ref, value, value_size);
+		if (ret == 0)
+		{
+			RALE_PROBE2(hash__get__done, key, 0);
+			return 0;
+		}
+		if (ret < 0)
+		{
+			RALE_PROBE2(hash__get__done, key, -1);
+			if (errbuf != NULL && errbuflen > 0)
+			{
+				snprintf(errbuf, errbuflen, "Failed to read value log");
+			}
+			return -1;
+		}
+	} while (ret == VLOG_STALE);
+
+	if (table->filter != NULL)
+	{
+		bloom_note_false_positive(table->filter);
 	}
-	pthread_mutex_unlock(&table->mutex);
+	RALE_PROBE2(hash__get__done, key, -1);
 	if (errbuf != NULL && errbuflen > 0)
 	{
 		snprintf(errbuf, errbuflen, "Key not found");
@@ -191,6 +705,9 @@ hash_delete(hash_table_t *table, const char *key, char *errbuf, size_t errbuflen
 	unsigned int index;
 	hash_entry_t  *entry;
 	hash_entry_t  *prev = NULL;
+	uint64_t	hash_val;
+	size_t		key_len;
+	char		old_ref[VLOG_REF_SIZE];
 
 	if (table == NULL || key == NULL)
 	{
@@ -200,12 +717,31 @@ hash_delete(hash_table_t *table, const char *key, char *errbuf, size_t errbuflen
 		}
 		return -1;
 	}
-	index = hash(key);
+	key_len = strlen(key);
+	hash_val = hash_key(key, key_len);
+	index = hash_bucket(hash_val);
 	pthread_mutex_lock(&table->mutex);
-	for (entry = table->entries[index]; entry != NULL;
+	if (table->swiss != NULL)
+	{
+		hash_logged_ref(table, hash_val, key, key_len, old_ref, sizeof(old_ref));
+		if (hash_swiss_delete(table->swiss, hash_val, key, key_len) == 0)
+		{
+			if (table->filter != NULL)
+			{
+				bloom_remove(table->filter, hash_val);
+			}
+			if (old_ref[0] != '\0')
+			{
+				vlog_discard(table->vlog, old_ref);
+			}
+			pthread_mutex_unlock(&table->mutex);
+			return 0;
+		}
+	}
+	for (entry = table->swiss != NULL ? NULL : table->entries[index]; entry != NULL;
 		 prev = entry, entry = entry->next)
 	{
-		if (strcmp(entry->key, key) == 0)
+		if (hash_entry_matches(entry, hash_val, key, key_len))
 		{
 			if (prev != NULL)
 			{
@@ -215,10 +751,15 @@ hash_delete(hash_table_t *table, const char *key, char *errbuf, size_t errbuflen
 			{
 				table->entries[index] = entry->next;
 			}
-			if (entry != NULL)
+			if (table->filter != NULL)
 			{
-				rfree((void **) &entry);
+				bloom_remove(table->filter, hash_val);
 			}
+			if ((entry->flags & HASH_VALUE_LOGGED) != 0 && table->vlog != NULL)
+			{
+				vlog_discard(table->vlog, entry->value);
+			}
+			hash_entry_free(entry);
 			pthread_mutex_unlock(&table->mutex);
 			return 0;
 		}
@@ -253,14 +794,16 @@ hash_destroy(hash_table_t *table, char *errbuf, size_t errbuflen)
 		while (entry != NULL)
 		{
 			next = entry->next;
-			if (entry != NULL)
-			{
-				rfree((void **) &entry);
-			}
+			hash_entry_free(entry);
 			entry = next;
 		}
 		table->entries[i] = NULL;
 	}
+	bloom_destroy(table->filter);
+	table->filter = NULL;
+	hash_swiss_destroy(table->swiss);
+	table->swiss = NULL;
+	table->vlog = NULL;
 	pthread_mutex_unlock(&table->mutex);
 	if (pthread_mutex_destroy(&table->mutex) != 0)
 	{
@@ -273,33 +816,79 @@ hash_destroy(hash_table_t *table, char *errbuf, size_t errbuflen)
 	return 0;
 }
 
+/** hash_save() output file, and its table for reading logged values */
+typedef struct hash_save_arg
+{
+	hash_table_t   *table;
+	FILE		   *file;
+	char			value[MAX_VALUE_SIZE];
+} hash_save_arg_t;
+
+/** hash_save() record writer; stops at a value that cannot be read */
+static int
+hash_save_visit(uint64_t hash_val, const char *key, const char *value, uint8_t flags,
+				void *arg)
+{
+	hash_save_arg_t *save = (hash_save_arg_t *) arg;
+	FILE	   *file = save->file;
+	size_t		key_len = strlen(key);
+	size_t		value_len;
+
+	(void) hash_val;
+	value = hash_visit_value(save->table, value, flags, save->value, sizeof(save->value));
+	if (value == NULL)
+	{
+		return 1;
+	}
+	value_len = strlen(value);
+	fwrite(&key_len, sizeof(int), 1, file);
+	fwrite(key, key_len, 1, file);
+	fwrite(&value_len, sizeof(int), 1, file);
+	fwrite(value, value_len, 1, file);
+	return 0;
+}
+
+static int
+hash_count_visit(uint64_t hash_val, const char *key, const char *value, uint8_t flags,
+				 void *arg)
+{
+	(void) hash_val;
+	(void) key;
+	(void) value;
+	(void) flags;
+	(*(int *) arg)++;
+	return 0;
+}
+
 int
 hash_save(hash_table_t *table, const char *filename, char *errbuf, size_t errbuflen)
 {
 	FILE       *file;
-	int         bucket;
-	hash_entry_t  *entry;
 	int         num_entries = 0;
-	size_t         key_len;
-	size_t         value_len;
+	hash_save_arg_t *save;
+	int			complete;
 
-	file = fopen(filename, "wb");
-	if (file == NULL)
+	save = rmalloc(sizeof(hash_save_arg_t));
+	if (save == NULL)
 	{
 		if (errbuf != NULL && errbuflen > 0)
 		{
-			snprintf(errbuf, errbuflen, "Failed to open file for saving: %s", filename);
+			snprintf(errbuf, errbuflen, "Memory allocation failed");
 		}
 		return -1;
 	}
-	pthread_mutex_lock(&table->mutex);
-	for (bucket = 0; bucket < HASH_SIZE; bucket++)
+	file = fopen(filename, "wb");
+	if (file == NULL)
 	{
-		for (entry = table->entries[bucket]; entry != NULL; entry = entry->next)
+		if (errbuf != NULL && errbuflen > 0)
 		{
-			num_entries++;
+			snprintf(errbuf, errbuflen, "Failed to open file for saving: %s", filename);
 		}
+		rfree((void **) &save);
+		return -1;
 	}
+	pthread_mutex_lock(&table->mutex);
+	(void) hash_visit_all(table, hash_count_visit, &num_entries);
 	if (fwrite(&num_entries, sizeof(int), 1, file) != 1)
 	{
 		if (file != NULL)
@@ -312,26 +901,27 @@ hash_save(hash_table_t *table, const char *filename, char *errbuf, size_t errbuf
 		{
 			snprintf(errbuf, errbuflen, "Failed to write entry count");
 		}
+		rfree((void **) &save);
 		return -1;
 	}
-	for (bucket = 0; bucket < HASH_SIZE; bucket++)
-	{
-		for (entry = table->entries[bucket]; entry != NULL; entry = entry->next)
-		{
-			key_len = strlen(entry->key);
-			value_len = strlen(entry->value);
-			fwrite(&key_len, sizeof(int), 1, file);
-			fwrite(entry->key, key_len, 1, file);
-			fwrite(&value_len, sizeof(int), 1, file);
-			fwrite(entry->value, value_len, 1, file);
-		}
-	}
+	save->table = table;
+	save->file = file;
+	complete = hash_visit_all(table, hash_save_visit, save);
 	pthread_mutex_unlock(&table->mutex);
+	rfree((void **) &save);
 	if (file != NULL)
 	{
 		fclose(file);
 		file = NULL;
 	}
+	if (!complete)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to read value log while saving: %s", filename);
+		}
+		return -1;
+	}
 	return 0;
 }
 
@@ -355,7 +945,7 @@ hash_load(hash_table_t *table, const char *filename, char *errbuf, size_t errbuf
 		}
 		return -1;
 	}
-	pthread_mutex_lock(&table->mutex);
+	/** hash_put() takes the mutex itself, per entry */
 	if (fread(&num_entries, sizeof(int), 1, file) != 1)
 	{
 		if (file != NULL)
@@ -363,7 +953,6 @@ hash_load(hash_table_t *table, const char *filename, char *errbuf, size_t errbuf
 			fclose(file);
 			file = NULL;
 		}
-		pthread_mutex_unlock(&table->mutex);
 		if (errbuf != NULL && errbuflen > 0)
 		{
 			snprintf(errbuf, errbuflen, "Failed to read entry count");
@@ -380,6 +969,8 @@ hash_load(hash_table_t *table, const char *filename, char *errbuf, size_t errbuf
 		value[value_len] = '\0';
 		hash_put(table, key, value, NULL, 0);
 	}
+	pthread_mutex_lock(&table->mutex);
+	hash_rebuild_filter(table);
 	pthread_mutex_unlock(&table->mutex);
 	if (file != NULL)
 	{
@@ -388,3 +979,324 @@ hash_load(hash_table_t *table, const char *filename, char *errbuf, size_t errbuf
 	}
 	return 0;
 }
+
+/** hash_scan() callback and its argument, for hash_swiss_walk() */
+typedef struct hash_scan_arg
+{
+	hash_table_t   *table;
+	hash_scan_cb	cb;
+	void		   *arg;
+	int				failed;		/* A logged value could not be read */
+	char			value[MAX_VALUE_SIZE];
+} hash_scan_arg_t;
+
+static int
+hash_scan_visit(uint64_t hash_val, const char *key, const char *value, uint8_t flags,
+				void *arg)
+{
+	hash_scan_arg_t *scan = (hash_scan_arg_t *) arg;
+
+	(void) hash_val;
+	value = hash_visit_value(scan->table, value, flags, scan->value, sizeof(scan->value));
+	if (value == NULL)
+	{
+		scan->failed = 1;
+		return 1;
+	}
+	return scan->cb(key, value, scan->arg);
+}
+
+static int
+hash_scan_swiss(hash_table_t *table, uint32_t partition, uint32_t partitions,
+				uint64_t *cursor, hash_scan_arg_t *scan)
+{
+	uint64_t	slots;
+	uint64_t	first_slot;
+	uint64_t	end_slot;
+	int			ret;
+
+	pthread_mutex_lock(&table->mutex);
+	slots = hash_swiss_slots(table->swiss);
+	first_slot = slots / partitions * partition;
+	end_slot = partition + 1 == partitions ? slots : slots / partitions * (partition + 1);
+	if (*cursor < first_slot)
+	{
+		*cursor = first_slot;
+	}
+	ret = hash_swiss_walk(table->swiss, cursor, end_slot, hash_scan_visit, scan);
+	pthread_mutex_unlock(&table->mutex);
+	return scan->failed ? -1 : ret;
+}
+
+/**
+ * Resumable scan over one partition of the table.
+ *
+ * The bucket space is split into "partitions" equal ranges so several
+ * readers can export the table in parallel.  *cursor encodes the bucket in
+ * its upper 32 bits and the position inside that bucket's chain in the
+ * lower 32 bits; pass 0 to start.  The callback returns non-zero to stop,
+ * in which case the cursor points at the entry it refused.
+ *
+ * With the open-addressing layout the slots are split instead, and
+ * *cursor is simply the slot index.
+ *
+ * Returns 1 when the partition is exhausted, 0 when the scan stopped early
+ * and -1 on error.  Entries written between calls may be skipped or
+ * returned twice; callers needing a point-in-time view must quiesce writes.
+ */
+int
+hash_scan(hash_table_t *table, uint32_t partition, uint32_t partitions,
+		  uint64_t *cursor, hash_scan_cb cb, void *arg, char *errbuf,
+		  size_t errbuflen)
+{
+	uint32_t		first_bucket;
+	uint32_t		end_bucket;
+	uint32_t		bucket;
+	uint32_t		position;
+	uint32_t		i;
+	hash_entry_t   *entry;
+	hash_scan_arg_t *scan;
+	int				ret = 1;
+
+	if (table == NULL || cursor == NULL || cb == NULL || partitions == 0 ||
+		partition >= partitions)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Invalid parameters for hash_scan");
+		}
+		return -1;
+	}
+
+	scan = rmalloc(sizeof(hash_scan_arg_t));
+	if (scan == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Memory allocation failed");
+		}
+		return -1;
+	}
+	scan->table = table;
+	scan->cb = cb;
+	scan->arg = arg;
+	scan->failed = 0;
+
+	if (table->swiss != NULL)
+	{
+		ret = hash_scan_swiss(table, partition, partitions, cursor, scan);
+		rfree((void **) &scan);
+		if (ret < 0 && errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to read value log");
+		}
+		return ret;
+	}
+
+	first_bucket = (uint32_t) (((uint64_t) HASH_SIZE * partition) / partitions);
+	end_bucket = (uint32_t) (((uint64_t) HASH_SIZE * (partition + 1)) / partitions);
+
+	bucket = (uint32_t) (*cursor >> 32);
+	position = (uint32_t) (*cursor & 0xFFFFFFFFu);
+	if (bucket < first_bucket)
+	{
+		bucket = first_bucket;
+		position = 0;
+	}
+
+	pthread_mutex_lock(&table->mutex);
+	for (; bucket < end_bucket; bucket++, position = 0)
+	{
+		entry = table->entries[bucket];
+		for (i = 0; entry != NULL && i < position; i++)
+		{
+			entry = entry->next;
+		}
+		for (; entry != NULL; entry = entry->next, position++)
+		{
+			if (hash_scan_visit(entry->hash, entry->key, entry->value, entry->flags, scan) != 0)
+			{
+				ret = scan->failed ? -1 : 0;
+				break;
+			}
+		}
+		if (entry != NULL)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&table->mutex);
+	rfree((void **) &scan);
+
+	if (ret < 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to read value log");
+		}
+		return -1;
+	}
+	if (ret == 0)
+	{
+		*cursor = ((uint64_t) bucket << 32) | position;
+		return 0;
+	}
+	*cursor = (uint64_t) end_bucket << 32;
+	return 1;
+}
+
+/**
+ * Front hash_get() with a counting Bloom filter sized for capacity keys,
+ * filled with the keys already present.
+ */
+int
+hash_enable_filter(hash_table_t *table, uint64_t capacity, char *errbuf,
+				   size_t errbuflen)
+{
+	bloom_t	   *filter;
+
+	if (table == NULL || capacity == 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Invalid parameters for hash_enable_filter");
+		}
+		return -1;
+	}
+
+	filter = bloom_create(capacity);
+	if (filter == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Memory allocation failed for key filter");
+		}
+		return -1;
+	}
+
+	pthread_mutex_lock(&table->mutex);
+	if (table->filter != NULL)
+	{
+		pthread_mutex_unlock(&table->mutex);
+		bloom_destroy(filter);
+		return 0;
+	}
+	/** Fill before publishing, so no reader sees a partial filter */
+	(void) hash_visit_all(table, hash_filter_add_visit, filter);
+	table->filter = filter;
+	pthread_mutex_unlock(&table->mutex);
+	return 0;
+}
+
+void
+hash_filter_stats(hash_table_t *table, bloom_stats_t *stats)
+{
+	bloom_get_stats(table != NULL ? table->filter : NULL, stats);
+}
+
+/**
+ * Value log hook: move key's value into the active segment if it still
+ * points at ref.
+ */
+static int
+hash_relocate_value(void *arg, const char *key, const char *ref, const char *value)
+{
+	hash_table_t *table = (hash_table_t *) arg;
+	size_t		key_len = strlen(key);
+	uint64_t	hash_val = hash_key(key, key_len);
+	const char *found;
+	uint8_t		flags = 0;
+	char		new_ref[VLOG_REF_SIZE];
+	hash_entry_t  *entry;
+	int			moved = 0;
+
+	pthread_mutex_lock(&table->mutex);
+	found = hash_find_value(table, hash_val, key, key_len, &flags);
+	if (found == NULL || (flags & HASH_VALUE_LOGGED) == 0 || strcmp(found, ref) != 0)
+	{
+		pthread_mutex_unlock(&table->mutex);
+		return 0;
+	}
+	if (vlog_append(table->vlog, key, key_len, value, strlen(value), new_ref,
+					sizeof(new_ref)) != 0)
+	{
+		pthread_mutex_unlock(&table->mutex);
+		return -1;
+	}
+	if (table->swiss != NULL)
+	{
+		moved = hash_swiss_put(table->swiss, hash_val, key, key_len, new_ref,
+							   HASH_VALUE_LOGGED) == 0 ? 1 : -1;
+	}
+	else
+	{
+		for (entry = table->entries[hash_bucket(hash_val)]; entry != NULL; entry = entry->next)
+		{
+			if (hash_entry_matches(entry, hash_val, key, key_len))
+			{
+				moved = hash_entry_set_value(entry, new_ref) == 0 ? 1 : -1;
+				break;
+			}
+		}
+	}
+	if (moved < 0)
+	{
+		vlog_discard(table->vlog, new_ref);
+	}
+	pthread_mutex_unlock(&table->mutex);
+	return moved;
+}
+
+/**
+ * Keep values longer than inline_max in vlog instead of the index, and let
+ * its collector relocate them.  The table must still be empty.
+ */
+int
+hash_enable_value_log(hash_table_t *table, vlog_t *vlog, size_t inline_max, int gc_percent,
+					  char *errbuf, size_t errbuflen)
+{
+	int			num_entries = 0;
+
+	if (table == NULL || vlog == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Invalid parameters for hash_enable_value_log");
+		}
+		return -1;
+	}
+
+	pthread_mutex_lock(&table->mutex);
+	(void) hash_visit_all(table, hash_count_visit, &num_entries);
+	if (num_entries > 0 || table->vlog != NULL)
+	{
+		pthread_mutex_unlock(&table->mutex);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Value log must be enabled on an empty table");
+		}
+		return -1;
+	}
+	table->vlog = vlog;
+	table->value_inline_max = inline_max;
+	pthread_mutex_unlock(&table->mutex);
+
+	if (vlog_start_gc(vlog, hash_relocate_value, table, gc_percent) != 0)
+	{
+		pthread_mutex_lock(&table->mutex);
+		table->vlog = NULL;
+		pthread_mutex_unlock(&table->mutex);
+		if (errbuf != NULL && errbuflen > 0)
+		{
+			snprintf(errbuf, errbuflen, "Failed to start value log collector");
+		}
+		return -1;
+	}
+	return 0;
+}
+
+void
+hash_value_log_stats(hash_table_t *table, vlog_stats_t *stats)
+{
+	vlog_get_stats(table != NULL ? table->vlog : NULL, stats);
+}
@@ -0,0 +1,388 @@
+/*-------------------------------------------------------------------------
+ *
+ * hash_swiss.c
+ *		Open-addressing index behind the hash_* API.
+ *
+ *		The low 7 bits of a key's hash are its tag (H2), the rest pick the
+ *		first group (H1).  Groups are probed triangularly, which visits
+ *		every group of a power-of-two table.  A lookup compares the tag
+ *		against all 16 control bytes of a group at once and checks only the
+ *		slots that match; a group with an empty slot ends the probe.
+ *
+ *		A delete leaves a tombstone unless its group still has an empty
+ *		slot, in which case no probe can have passed the group and the slot
+ *		may become empty again.  Tombstones count towards the 7/8 load
+ *		limit; reaching it rehashes, to double size if live records fill
+ *		more than 7/16 of the slots, otherwise in place.
+ *
+ *		Records hold the full hash, the lengths, the caller's value flags,
+ *		and key and value bytes back to back.  A value that outgrows its
+ *		record moves to a new one.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/** Local headers */
+#include "hash_swiss.h"
+
+#define CTRL_EMPTY		((uint8_t) 0x80)
+#define CTRL_DELETED	((uint8_t) 0xFE)	/* Full slots are 0x00-0x7F */
+
+#define RECORD_VALUE_ROUND	16		/* Value room is rounded up to this */
+
+typedef struct hash_record
+{
+	uint64_t	hash;
+	uint32_t	key_len;
+	uint16_t	value_room;		/* Bytes available for the value and its NUL */
+	uint16_t	flags;			/* Caller's value flags */
+	char		data[];			/* Key, NUL, value, NUL */
+} hash_record_t;
+
+struct hash_swiss
+{
+	uint8_t	   *ctrl;
+	hash_record_t **slots;
+	uint64_t	capacity;		/* Slots, a power of two multiple of the group */
+	uint64_t	count;
+	uint64_t	tombstones;
+};
+
+/* Bit i set for each control byte i of the group equal to tag */
+static inline uint32_t
+group_match(const uint8_t *group, uint8_t tag)
+{
+#if defined(__SSE2__)
+	__m128i		ctrl = _mm_loadu_si128((const __m128i *) group);
+
+	return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) tag)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	static const uint8_t lane_bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+										  1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t	eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(tag));
+	uint8x16_t	bits = vandq_u8(eq, vld1q_u8(lane_bits));
+
+	return (uint32_t) vaddv_u8(vget_low_u8(bits)) |
+		((uint32_t) vaddv_u8(vget_high_u8(bits)) << 8);
+#else
+	uint32_t	mask = 0;
+	int			i;
+
+	for (i = 0; i < HASH_SWISS_GROUP; i++)
+	{
+		if (group[i] == tag)
+			mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+/* Bit i set for each empty or deleted slot (control byte high bit set) */
+static inline uint32_t
+group_match_free(const uint8_t *group)
+{
+#if defined(__SSE2__)
+	return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+	return group_match(group, CTRL_EMPTY) | group_match(group, CTRL_DELETED);
+#endif
+}
+
+static inline uint8_t
+hash_tag(uint64_t hash)
+{
+	return (uint8_t) (hash & 0x7F);
+}
+
+static inline uint64_t
+hash_first_group(const hash_swiss_t *index, uint64_t hash)
+{
+	return (hash >> 7) & (index->capacity / HASH_SWISS_GROUP - 1);
+}
+
+static inline int
+lowest_bit(uint32_t mask)
+{
+	return __builtin_ctz(mask);
+}
+
+static bool
+hash_swiss_alloc(hash_swiss_t *index, uint64_t capacity)
+{
+	index->ctrl = malloc(capacity);
+	index->slots = calloc(capacity, sizeof(hash_record_t *));
+	if (index->ctrl == NULL || index->slots == NULL)
+	{
+		free(index->ctrl);
+		free(index->slots);
+		return false;
+	}
+	memset(index->ctrl, CTRL_EMPTY, capacity);
+	index->capacity = capacity;
+	index->count = 0;
+	index->tombstones = 0;
+	return true;
+}
+
+/* Slot holding the key, -1 if none */
+static int64_t
+hash_swiss_find(const hash_swiss_t *index, uint64_t hash, const char *key, size_t key_len)
+{
+	uint64_t	groups = index->capacity / HASH_SWISS_GROUP;
+	uint64_t	group = hash_first_group(index, hash);
+	uint8_t		tag = hash_tag(hash);
+	uint64_t	probe;
+
+	for (probe = 1; probe <= groups; probe++)
+	{
+		const uint8_t *ctrl = index->ctrl + group * HASH_SWISS_GROUP;
+		uint32_t	match = group_match(ctrl, tag);
+
+		while (match != 0)
+		{
+			uint64_t	slot = group * HASH_SWISS_GROUP + (uint64_t) lowest_bit(match);
+			const hash_record_t *record = index->slots[slot];
+
+			if (record->hash == hash && record->key_len == key_len &&
+				memcmp(record->data, key, key_len) == 0)
+				return (int64_t) slot;
+			match &= match - 1;
+		}
+		if (group_match(ctrl, CTRL_EMPTY) != 0)
+			return -1;
+		group = (group + probe) & (groups - 1);
+	}
+	return -1;
+}
+
+/* First empty or deleted slot on the key's probe sequence; the table has room */
+static uint64_t
+hash_swiss_free_slot(const hash_swiss_t *index, uint64_t hash)
+{
+	uint64_t	groups = index->capacity / HASH_SWISS_GROUP;
+	uint64_t	group = hash_first_group(index, hash);
+	uint64_t	probe;
+
+	for (probe = 1;; probe++)
+	{
+		uint32_t	free_mask = group_match_free(index->ctrl + group * HASH_SWISS_GROUP);
+
+		if (free_mask != 0)
+			return group * HASH_SWISS_GROUP + (uint64_t) lowest_bit(free_mask);
+		group = (group + probe) & (groups - 1);
+	}
+}
+
+static void
+hash_swiss_place(hash_swiss_t *index, hash_record_t *record)
+{
+	uint64_t	slot = hash_swiss_free_slot(index, record->hash);
+
+	if (index->ctrl[slot] == CTRL_DELETED)
+		index->tombstones--;
+	index->ctrl[slot] = hash_tag(record->hash);
+	index->slots[slot] = record;
+	index->count++;
+}
+
+/* Rehash every record into a table of capacity slots */
+static bool
+hash_swiss_rehash(hash_swiss_t *index, uint64_t capacity)
+{
+	hash_swiss_t old = *index;
+	uint64_t	i;
+
+	if (!hash_swiss_alloc(index, capacity))
+	{
+		*index = old;
+		return false;
+	}
+	for (i = 0; i < old.capacity; i++)
+	{
+		if ((old.ctrl[i] & CTRL_EMPTY) == 0)
+			hash_swiss_place(index, old.slots[i]);
+	}
+	free(old.ctrl);
+	free(old.slots);
+	return true;
+}
+
+static hash_record_t *
+hash_record_new(uint64_t hash, const char *key, size_t key_len, const char *value,
+				size_t value_len, uint8_t flags)
+{
+	size_t		room = (value_len + 1 + RECORD_VALUE_ROUND - 1) & ~(size_t) (RECORD_VALUE_ROUND - 1);
+	hash_record_t *record = malloc(sizeof(hash_record_t) + key_len + 1 + room);
+
+	if (record == NULL)
+		return NULL;
+	record->hash = hash;
+	record->key_len = (uint32_t) key_len;
+	record->value_room = (uint16_t) room;
+	record->flags = flags;
+	memcpy(record->data, key, key_len);
+	record->data[key_len] = '\0';
+	memcpy(record->data + key_len + 1, value, value_len + 1);
+	return record;
+}
+
+hash_swiss_t *
+hash_swiss_create(void)
+{
+	hash_swiss_t *index = calloc(1, sizeof(hash_swiss_t));
+
+	if (index == NULL)
+		return NULL;
+	if (!hash_swiss_alloc(index, HASH_SWISS_INITIAL_SLOTS))
+	{
+		free(index);
+		return NULL;
+	}
+	return index;
+}
+
+void
+hash_swiss_destroy(hash_swiss_t *index)
+{
+	uint64_t	i;
+
+	if (index == NULL)
+		return;
+	for (i = 0; i < index->capacity; i++)
+	{
+		if ((index->ctrl[i] & CTRL_EMPTY) == 0)
+			free(index->slots[i]);
+	}
+	free(index->ctrl);
+	free(index->slots);
+	free(index);
+}
+
+int
+hash_swiss_put(hash_swiss_t *index, uint64_t hash, const char *key, size_t key_len,
+			   const char *value, uint8_t flags)
+{
+	size_t		value_len = strlen(value);
+	int64_t		slot = hash_swiss_find(index, hash, key, key_len);
+	hash_record_t *record;
+
+	if (slot >= 0)
+	{
+		record = index->slots[slot];
+		if (value_len < record->value_room)
+		{
+			memcpy(record->data + key_len + 1, value, value_len + 1);
+			record->flags = flags;
+			return 0;
+		}
+		record = hash_record_new(hash, key, key_len, value, value_len, flags);
+		if (record == NULL)
+			return -1;
+		free(index->slots[slot]);
+		index->slots[slot] = record;
+		return 0;
+	}
+
+	if ((index->count + index->tombstones + 1) * 8 > index->capacity * 7)
+	{
+		uint64_t	capacity = index->capacity;
+
+		if ((index->count + 1) * 16 > capacity * 7)
+			capacity *= 2;
+		if (!hash_swiss_rehash(index, capacity))
+			return -1;
+	}
+
+	record = hash_record_new(hash, key, key_len, value, value_len, flags);
+	if (record == NULL)
+		return -1;
+	hash_swiss_place(index, record);
+	return 1;
+}
+
+const char *
+hash_swiss_get(hash_swiss_t *index, uint64_t hash, const char *key, size_t key_len,
+			   uint8_t *flags)
+{
+	int64_t		slot = hash_swiss_find(index, hash, key, key_len);
+
+	if (slot < 0)
+		return NULL;
+	if (flags != NULL)
+		*flags = (uint8_t) index->slots[slot]->flags;
+	return index->slots[slot]->data + key_len + 1;
+}
+
+int
+hash_swiss_delete(hash_swiss_t *index, uint64_t hash, const char *key, size_t key_len)
+{
+	int64_t		slot = hash_swiss_find(index, hash, key, key_len);
+	uint64_t	group_start;
+
+	if (slot < 0)
+		return -1;
+
+	free(index->slots[slot]);
+	index->slots[slot] = NULL;
+	index->count--;
+
+	group_start = (uint64_t) slot & ~(uint64_t) (HASH_SWISS_GROUP - 1);
+	if (group_match(index->ctrl + group_start, CTRL_EMPTY) != 0)
+		index->ctrl[slot] = CTRL_EMPTY;
+	else
+	{
+		index->ctrl[slot] = CTRL_DELETED;
+		index->tombstones++;
+	}
+	return 0;
+}
+
+uint64_t
+hash_swiss_count(const hash_swiss_t *index)
+{
+	return index != NULL ? index->count : 0;
+}
+
+uint64_t
+hash_swiss_slots(const hash_swiss_t *index)
+{
+	return index != NULL ? index->capacity : 0;
+}
+
+int
+hash_swiss_walk(hash_swiss_t *index, uint64_t *slot, uint64_t end,
+				hash_swiss_visit visit, void *arg)
+{
+	uint64_t	i;
+
+	if (end > index->capacity)
+		end = index->capacity;
+	for (i = *slot; i < end; i++)
+	{
+		const hash_record_t *record;
+
+		if ((index->ctrl[i] & CTRL_EMPTY) != 0)
+			continue;
+		record = index->slots[i];
+		if (visit(record->hash, record->data, record->data + record->key_len + 1,
+				  (uint8_t) record->flags, arg) != 0)
+		{
+			*slot = i;
+			return 0;
+		}
+	}
+	*slot = end;
+	return 1;
+}
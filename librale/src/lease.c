@@ -0,0 +1,524 @@
+/*-------------------------------------------------------------------------
+ *
+ * lease.c
+ *		Lease table shared by the leader and its followers.
+ *
+ *		Leases hang off LEASE_BUCKETS chains by id.  Each keeps a doubly
+ *		linked list of its keys, and the same key records also hang off
+ *		LEASE_KEY_BUCKETS chains by key hash, so attaching, detaching and
+ *		revoking never scan more than one chain or one lease's keys.
+ *		lease_mutex guards all of it; lease_key_count lets the PUT path
+ *		skip the lock while no key is leased at all.
+ *
+ *		Deadlines are on the monotonic clock of the node holding them.
+ *		A follower never sees the leader's clock: it restarts a lease's TTL
+ *		whenever a grant or a renewal checkpoint arrives.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Local headers */
+#include "lease.h"
+#include "hash.h"
+
+#define LEASE_BUCKETS			1024
+#define LEASE_KEY_BUCKETS		4096
+
+typedef struct lease lease_t;
+
+/* A key attached to a lease */
+typedef struct lease_key
+{
+	struct lease_key   *bucket_next;
+	struct lease_key   *prev;		/* Within the lease */
+	struct lease_key   *next;
+	lease_t			   *lease;
+	uint64_t			hash;
+	char				key[];
+} lease_key_t;
+
+struct lease
+{
+	lease_t			   *bucket_next;
+	uint64_t			id;
+	int					ttl;
+	uint64_t			deadline_ms;
+	int					renewed;	/* Kept alive since the last checkpoint */
+	lease_key_t		   *keys;
+	uint64_t			key_count;
+};
+
+static pthread_mutex_t lease_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lease_t *leases[LEASE_BUCKETS];
+static lease_key_t *lease_keys[LEASE_KEY_BUCKETS];
+static _Atomic uint64_t lease_key_count;
+static bool was_leader = false;
+static lease_stats_t lease_stats;
+static lease_clock_fn lease_clock = NULL;
+
+static uint64_t
+lease_now_ms(void)
+{
+	struct timespec ts;
+
+	if (lease_clock != NULL)
+		return lease_clock();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+void
+lease_set_clock(lease_clock_fn clock)
+{
+	lease_clock = clock;
+}
+
+static lease_t **
+lease_bucket(uint64_t id)
+{
+	return &leases[(id ^ (id >> 17)) % LEASE_BUCKETS];
+}
+
+static lease_t *
+lease_find(uint64_t id)
+{
+	lease_t    *lease;
+
+	for (lease = *lease_bucket(id); lease != NULL; lease = lease->bucket_next)
+	{
+		if (lease->id == id)
+			return lease;
+	}
+	return NULL;
+}
+
+static lease_key_t *
+lease_key_find(const char *key, uint64_t hash)
+{
+	lease_key_t *attached;
+
+	for (attached = lease_keys[hash % LEASE_KEY_BUCKETS]; attached != NULL;
+		 attached = attached->bucket_next)
+	{
+		if (attached->hash == hash && strcmp(attached->key, key) == 0)
+			return attached;
+	}
+	return NULL;
+}
+
+/* Take attached off its lease's list */
+static void
+lease_key_unlink(lease_key_t *attached)
+{
+	if (attached->prev != NULL)
+		attached->prev->next = attached->next;
+	else
+		attached->lease->keys = attached->next;
+	if (attached->next != NULL)
+		attached->next->prev = attached->prev;
+	attached->lease->key_count--;
+	attached->prev = attached->next = NULL;
+}
+
+/* Take attached out of the key chains and free it; still on its lease's list */
+static void
+lease_key_free(lease_key_t *attached)
+{
+	lease_key_t **link = &lease_keys[attached->hash % LEASE_KEY_BUCKETS];
+
+	while (*link != attached)
+		link = &(*link)->bucket_next;
+	*link = attached->bucket_next;
+	atomic_fetch_sub(&lease_key_count, 1);
+	free(attached);
+}
+
+static void
+lease_restart(lease_t *lease, uint64_t now)
+{
+	lease->deadline_ms = now + (uint64_t) lease->ttl * 1000;
+}
+
+int
+lease_grant(uint64_t id, int ttl)
+{
+	lease_t    *lease;
+	lease_t   **bucket;
+
+	if (id == 0 || ttl <= 0)
+		return -1;
+
+	pthread_mutex_lock(&lease_mutex);
+	lease = lease_find(id);
+	if (lease == NULL)
+	{
+		lease = calloc(1, sizeof(lease_t));
+		if (lease == NULL)
+		{
+			pthread_mutex_unlock(&lease_mutex);
+			return -1;
+		}
+		lease->id = id;
+		bucket = lease_bucket(id);
+		lease->bucket_next = *bucket;
+		*bucket = lease;
+		lease_stats.leases++;
+		lease_stats.granted++;
+	}
+	lease->ttl = ttl;
+	lease_restart(lease, lease_now_ms());
+	pthread_mutex_unlock(&lease_mutex);
+	return 0;
+}
+
+bool
+lease_exists(uint64_t id)
+{
+	bool		found;
+
+	pthread_mutex_lock(&lease_mutex);
+	found = lease_find(id) != NULL;
+	pthread_mutex_unlock(&lease_mutex);
+	return found;
+}
+
+int
+lease_attach(const char *key, uint64_t id)
+{
+	uint64_t	hash = hash_key(key, strlen(key));
+	lease_key_t *attached;
+	lease_t    *lease;
+
+	pthread_mutex_lock(&lease_mutex);
+	lease = lease_find(id);
+	if (lease == NULL)
+	{
+		pthread_mutex_unlock(&lease_mutex);
+		return -1;
+	}
+
+	attached = lease_key_find(key, hash);
+	if (attached != NULL && attached->lease == lease)
+	{
+		pthread_mutex_unlock(&lease_mutex);
+		return 0;
+	}
+	if (attached != NULL)
+	{
+		/* Moves from another lease */
+		lease_key_unlink(attached);
+	}
+	else
+	{
+		size_t		len = strlen(key);
+
+		attached = malloc(sizeof(lease_key_t) + len + 1);
+		if (attached == NULL)
+		{
+			pthread_mutex_unlock(&lease_mutex);
+			return -1;
+		}
+		memcpy(attached->key, key, len + 1);
+		attached->hash = hash;
+		attached->bucket_next = lease_keys[hash % LEASE_KEY_BUCKETS];
+		lease_keys[hash % LEASE_KEY_BUCKETS] = attached;
+		atomic_fetch_add(&lease_key_count, 1);
+	}
+
+	attached->lease = lease;
+	attached->prev = NULL;
+	attached->next = lease->keys;
+	if (lease->keys != NULL)
+		lease->keys->prev = attached;
+	lease->keys = attached;
+	lease->key_count++;
+	pthread_mutex_unlock(&lease_mutex);
+	return 0;
+}
+
+void
+lease_detach(const char *key)
+{
+	uint64_t	hash;
+	lease_key_t *attached;
+
+	/* Every PUT comes here; most clusters lease nothing */
+	if (atomic_load_explicit(&lease_key_count, memory_order_relaxed) == 0)
+		return;
+
+	hash = hash_key(key, strlen(key));
+	pthread_mutex_lock(&lease_mutex);
+	attached = lease_key_find(key, hash);
+	if (attached != NULL)
+	{
+		lease_key_unlink(attached);
+		lease_key_free(attached);
+	}
+	pthread_mutex_unlock(&lease_mutex);
+}
+
+bool
+lease_key_attached(const char *key)
+{
+	uint64_t	hash;
+	bool		found;
+
+	if (atomic_load_explicit(&lease_key_count, memory_order_relaxed) == 0)
+		return false;
+
+	hash = hash_key(key, strlen(key));
+	pthread_mutex_lock(&lease_mutex);
+	found = lease_key_find(key, hash) != NULL;
+	pthread_mutex_unlock(&lease_mutex);
+	return found;
+}
+
+int
+lease_revoke(uint64_t id, bool only_expired, lease_key_cb cb, void *arg)
+{
+	lease_t   **link;
+	lease_t    *lease;
+	lease_key_t *attached;
+	int			count = 0;
+
+	pthread_mutex_lock(&lease_mutex);
+	for (link = lease_bucket(id); *link != NULL; link = &(*link)->bucket_next)
+	{
+		if ((*link)->id == id)
+			break;
+	}
+	lease = *link;
+	if (lease == NULL || (only_expired && lease->deadline_ms > lease_now_ms()))
+	{
+		pthread_mutex_unlock(&lease_mutex);
+		return -1;
+	}
+	*link = lease->bucket_next;
+
+	while ((attached = lease->keys) != NULL)
+	{
+		if (cb != NULL)
+			cb(attached->key, arg);
+		lease_key_unlink(attached);
+		lease_key_free(attached);
+		count++;
+	}
+	lease_stats.leases--;
+	lease_stats.revoked++;
+	if (only_expired)
+		lease_stats.expired++;
+	pthread_mutex_unlock(&lease_mutex);
+	free(lease);
+	return count;
+}
+
+int
+lease_keepalive(uint64_t id)
+{
+	uint64_t	now = lease_now_ms();
+	lease_t    *lease;
+	int			ttl = -1;
+
+	pthread_mutex_lock(&lease_mutex);
+	lease = lease_find(id);
+	if (lease != NULL && lease->deadline_ms > now)
+	{
+		lease_restart(lease, now);
+		lease->renewed = 1;
+		lease_stats.keepalives++;
+		ttl = lease->ttl;
+	}
+	pthread_mutex_unlock(&lease_mutex);
+	return ttl;
+}
+
+void
+lease_apply_renewals(const char *ids)
+{
+	uint64_t	now = lease_now_ms();
+	const char *p = ids;
+	char	   *end;
+	lease_t    *lease;
+
+	pthread_mutex_lock(&lease_mutex);
+	for (;;)
+	{
+		uint64_t	id = strtoull(p, &end, 10);
+
+		if (end == p)
+			break;
+		p = end;
+		lease = lease_find(id);
+		if (lease != NULL)
+			lease_restart(lease, now);
+	}
+	lease_stats.checkpoints++;
+	pthread_mutex_unlock(&lease_mutex);
+}
+
+char *
+lease_take_renewals(void)
+{
+	char	   *lines = NULL;
+	size_t		size = 0;
+	size_t		len = 0;
+	size_t		line_start = 0;
+	int			b;
+
+	pthread_mutex_lock(&lease_mutex);
+	for (b = 0; b < LEASE_BUCKETS; b++)
+	{
+		lease_t    *lease;
+
+		for (lease = leases[b]; lease != NULL; lease = lease->bucket_next)
+		{
+			if (!lease->renewed)
+				continue;
+			lease->renewed = 0;
+
+			/* Room for a line break, the prefix, an id and the terminator */
+			if (len + sizeof(LEASE_RENEW_PREFIX) + 24 > size)
+			{
+				size_t		new_size = size > 0 ? size * 2 : 4 * LEASE_LINE_MAX;
+				char	   *grown = realloc(lines, new_size);
+
+				if (grown == NULL)
+					continue;	/* The follower's deadline just runs short */
+				lines = grown;
+				size = new_size;
+			}
+			if (len == 0 || len - line_start > LEASE_LINE_MAX)
+			{
+				if (len > 0)
+					lines[len++] = '\n';
+				line_start = len;
+				len += (size_t) sprintf(lines + len, "%s%llu", LEASE_RENEW_PREFIX,
+										(unsigned long long) lease->id);
+				lease_stats.checkpoints++;
+			}
+			else
+				len += (size_t) sprintf(lines + len, " %llu",
+										(unsigned long long) lease->id);
+		}
+	}
+	pthread_mutex_unlock(&lease_mutex);
+	return lines;
+}
+
+int
+lease_expired(bool is_leader, uint64_t *ids, int max)
+{
+	uint64_t	now = lease_now_ms();
+	int			count = 0;
+	int			b;
+
+	pthread_mutex_lock(&lease_mutex);
+	if (!is_leader || !was_leader)
+	{
+		/*
+		 * A new leader's deadlines are only as fresh as the last checkpoint
+		 * it applied; give holders time to find it before expiring anything.
+		 */
+		for (b = 0; is_leader && b < LEASE_BUCKETS; b++)
+		{
+			lease_t    *lease;
+
+			for (lease = leases[b]; lease != NULL; lease = lease->bucket_next)
+			{
+				uint64_t	grace = (uint64_t) lease->ttl * 1000;
+
+				if (grace > LEASE_FAILOVER_GRACE_MS)
+					grace = LEASE_FAILOVER_GRACE_MS;
+				if (lease->deadline_ms < now + grace)
+					lease->deadline_ms = now + grace;
+			}
+		}
+		was_leader = is_leader;
+		pthread_mutex_unlock(&lease_mutex);
+		return 0;
+	}
+
+	for (b = 0; b < LEASE_BUCKETS && count < max; b++)
+	{
+		lease_t    *lease;
+
+		for (lease = leases[b]; lease != NULL && count < max; lease = lease->bucket_next)
+		{
+			if (lease->deadline_ms <= now)
+				ids[count++] = lease->id;
+		}
+	}
+	pthread_mutex_unlock(&lease_mutex);
+	return count;
+}
+
+void
+lease_snapshot(lease_visit_cb cb, void *arg)
+{
+	int			b;
+
+	pthread_mutex_lock(&lease_mutex);
+	for (b = 0; b < LEASE_BUCKETS; b++)
+	{
+		lease_t    *lease;
+		lease_key_t *attached;
+
+		for (lease = leases[b]; lease != NULL; lease = lease->bucket_next)
+		{
+			cb(lease->id, lease->ttl, NULL, arg);
+			for (attached = lease->keys; attached != NULL; attached = attached->next)
+				cb(lease->id, lease->ttl, attached->key, arg);
+		}
+	}
+	pthread_mutex_unlock(&lease_mutex);
+}
+
+void
+lease_get_stats(lease_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+
+	pthread_mutex_lock(&lease_mutex);
+	memcpy(stats, &lease_stats, sizeof(*stats));
+	stats->keys = atomic_load(&lease_key_count);
+	pthread_mutex_unlock(&lease_mutex);
+}
+
+void
+lease_reset(lease_key_cb cb, void *arg)
+{
+	int			b;
+
+	pthread_mutex_lock(&lease_mutex);
+	for (b = 0; b < LEASE_BUCKETS; b++)
+	{
+		while (leases[b] != NULL)
+		{
+			lease_t    *lease = leases[b];
+			lease_key_t *attached;
+
+			leases[b] = lease->bucket_next;
+			while ((attached = lease->keys) != NULL)
+			{
+				if (cb != NULL)
+					cb(attached->key, arg);
+				lease_key_unlink(attached);
+				lease_key_free(attached);
+			}
+			free(lease);
+		}
+	}
+	lease_stats.leases = 0;
+	pthread_mutex_unlock(&lease_mutex);
+}
@@ -12,6 +12,7 @@
 #include "librale_internal.h"
 #include "shutdown.h"
 #include "rale_error.h"
+#include "batch.h"
 
 volatile int system_exit = 0;
 
@@ -160,6 +161,36 @@ librale_config_set_config(librale_config_t *dest, const void *src)
 	return RALE_SUCCESS;
 }
 
+librale_status_t
+librale_config_publish(const librale_config_t *config)
+{
+	char errbuf[256];
+
+	if (config == NULL)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	if (config_publish((const config_t *)config, errbuf, sizeof(errbuf)) != 0)
+	{
+		rale_set_error(RALE_ERROR_OUT_OF_MEMORY, "librale_config_publish", errbuf, NULL, NULL);
+		return RALE_ERROR_GENERAL;
+	}
+	return RALE_SUCCESS;
+}
+
+const librale_config_t *
+librale_config_current(void)
+{
+	return (const librale_config_t *) config_current();
+}
+
+void
+librale_config_release(void)
+{
+	config_release();
+}
+
 int32_t
 librale_config_get_node_id(const librale_config_t *config)
 {
@@ -339,6 +370,90 @@ librale_dstore_replicate_to_followers(const char *key, const char *value, char *
 	dstore_replicate_to_followers(key, value, errbuf, errbuflen);
 }
 
+uint32_t
+librale_dstore_get_replication(librale_replica_status_t *replicas, uint32_t max, uint64_t *last_index)
+{
+	return dstore_get_replication(replicas, max, last_index);
+}
+
+int
+librale_dstore_cas(const char *key, const char *expected, const char *value,
+				   char *errbuf, size_t errbuflen)
+{
+	return dstore_handle_cas(key, expected, value, errbuf, errbuflen);
+}
+
+uint64_t
+librale_dstore_write_revision(void)
+{
+	return dstore_write_revision();
+}
+
+uint64_t
+librale_dstore_applied_revision(void)
+{
+	return dstore_applied_revision();
+}
+
+int
+librale_dstore_wait_revision(uint64_t revision, int timeout_ms)
+{
+	if (timeout_ms < 0)
+	{
+		timeout_ms = 0;
+	}
+
+	return dstore_wait_revision(revision, timeout_ms);
+}
+
+int
+librale_dstore_lease_grant(int ttl, uint64_t *lease, char *errbuf, size_t errbuflen)
+{
+	return dstore_lease_grant(ttl, lease, errbuf, errbuflen);
+}
+
+int
+librale_dstore_lease_revoke(uint64_t lease, char *errbuf, size_t errbuflen)
+{
+	int			ret = dstore_lease_revoke(lease, errbuf, errbuflen);
+
+	return ret == BATCH_LEASE_NOT_FOUND ? 1 : ret;
+}
+
+int
+librale_dstore_lease_keepalive(uint64_t lease, int *ttl, char *errbuf, size_t errbuflen)
+{
+	int			ret = dstore_lease_keepalive(lease, ttl, errbuf, errbuflen);
+
+	return ret == BATCH_LEASE_NOT_FOUND ? 1 : ret;
+}
+
+int
+librale_dstore_put_leased(const char *key, const char *value, uint64_t lease,
+						  char *errbuf, size_t errbuflen)
+{
+	int			ret = dstore_put_leased(key, value, lease, errbuf, errbuflen);
+
+	return ret == BATCH_LEASE_NOT_FOUND ? 1 : ret;
+}
+
+int
+librale_dstore_put_batch(librale_put_t *puts, int count, char *errbuf, size_t errbuflen)
+{
+	int			ret = dstore_put_batch(puts, count, errbuf, errbuflen);
+	int			i;
+
+	if (ret == 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (puts[i].result == BATCH_LEASE_NOT_FOUND)
+				puts[i].result = 1;
+		}
+	}
+	return ret;
+}
+
 librale_status_t
 librale_db_get(const char *key, char *value, size_t value_size, char *errbuf, size_t errbuflen)
 {
@@ -350,6 +465,39 @@ librale_db_get(const char *key, char *value, size_t value_size, char *errbuf, si
 	return db_get(key, value, value_size, errbuf, errbuflen);
 }
 
+int
+librale_db_watch(const char *key, const char *seen, int timeout_ms, char *value, size_t value_size)
+{
+	if (key == NULL || value == NULL || value_size == 0)
+	{
+		return -1;
+	}
+
+	return db_watch(key, seen, timeout_ms, value, value_size);
+}
+
+librale_status_t
+librale_db_scan(uint32_t partition, uint32_t partitions, uint64_t *cursor,
+				librale_db_scan_cb cb, void *arg, bool *complete,
+				char *errbuf, size_t errbuflen)
+{
+	int			ret;
+
+	if (cursor == NULL || cb == NULL || complete == NULL || errbuf == NULL)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	ret = db_scan(partition, partitions, cursor, cb, arg, errbuf, errbuflen);
+	if (ret < 0)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	*complete = (ret == 1);
+	return RALE_SUCCESS;
+}
+
 uint32_t
 librale_cluster_get_node_count(void)
 {
@@ -367,6 +515,29 @@ librale_cluster_get_node(int32_t node_id, librale_node_t *node)
 	return cluster_get_node(node_id, (node_t *)node);
 }
 
+librale_status_t
+librale_cluster_get_node_info(uint32_t index, librale_node_info_t *info)
+{
+	node_t		node;
+
+	if (info == NULL)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	if (cluster_get_node_by_index(index, &node) != RALE_SUCCESS)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	info->id = node.id;
+	strlcpy(info->name, node.name, sizeof(info->name));
+	strlcpy(info->ip, node.ip, sizeof(info->ip));
+	info->rale_port = node.rale_port;
+	info->dstore_port = node.dstore_port;
+	return RALE_SUCCESS;
+}
+
 int32_t
 librale_cluster_get_self_id(void)
 {
@@ -401,9 +572,34 @@ librale_rale_finit(void)
 	return rale_finit();
 }
 
+librale_status_t
+librale_rale_hand_off(void)
+{
+	return rale_hand_off_leadership();
+}
+
 int32_t
 librale_get_current_role(void)
 {
 	extern rale_state_t current_rale_state;
 	return (int32_t)current_rale_state.role;
 }
+
+librale_status_t
+librale_get_rale_status(librale_rale_status_t *status)
+{
+	extern rale_state_t current_rale_state;
+
+	if (status == NULL)
+	{
+		return RALE_ERROR_GENERAL;
+	}
+
+	status->role = (int32_t)current_rale_state.role;
+	status->term = current_rale_state.current_term;
+	status->leader_id = current_rale_state.leader_id;
+	status->last_log_index = current_rale_state.last_log_index;
+	status->commit_index = current_rale_state.commit_index;
+	status->last_applied = current_rale_state.last_applied;
+	return RALE_SUCCESS;
+}
@@ -0,0 +1,2046 @@
+/*-------------------------------------------------------------------------
+ *
+ * lsm.c
+ *		Log-structured merge tree storage engine.
+ *
+ *		Writers are serialized by write_mutex: each appends its entry to the
+ *		memtable's log, inserts it into the memtable skiplist and only then
+ *		publishes its sequence number.  Skiplist links are stored with
+ *		release and loaded with acquire, so readers walk the memtable
+ *		without a lock.
+ *
+ *		The rest of the state is one version pointer, swapped under mutex.
+ *		A full memtable becomes the immutable one (imm) of a new version and
+ *		the worker thread writes it to a level 0 SST, then compacts: all of
+ *		level 0 into level 1 once it holds level0_files files, and one file
+ *		of level n into level n + 1 (round-robin through the key space) once
+ *		level n exceeds its budget.  A file with nothing to merge with below
+ *		is moved down without rewriting it.  Compaction drops versions no
+ *		snapshot can see and deletions with nothing left to hide.
+ *
+ *		Writers wait while imm is still being flushed, or while level 0 has
+ *		three times level0_files files, so the tree cannot outrun the worker.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Local headers */
+#include "hash.h"
+#include "lsm.h"
+
+#define LSM_MAX_HEIGHT		12
+#define LSM_ARENA_CHUNK		(1024 * 1024)
+#define LSM_LEVEL0_STOP		3		/* Writers wait at level0_files times this */
+#define LSM_MANIFEST		"MANIFEST"
+
+/* Skiplist node; key and value follow next[height] */
+typedef struct lsm_node
+{
+	uint64_t			seq;
+	uint16_t			key_len;
+	uint16_t			value_len;
+	uint8_t				type;
+	uint8_t				height;
+	_Atomic(struct lsm_node *) next[];
+} lsm_node_t;
+
+typedef struct lsm_chunk
+{
+	struct lsm_chunk   *prev;
+	size_t				used;
+	size_t				size;
+	char				data[];
+} lsm_chunk_t;
+
+typedef struct lsm_memtable
+{
+	_Atomic int			refs;
+	uint64_t			log_number;
+	int					log_fd;
+	lsm_node_t		   *head;
+	_Atomic int			height;
+	_Atomic uint64_t	bytes;
+	lsm_chunk_t		   *chunks;
+	uint32_t			rnd;
+} lsm_memtable_t;
+
+/* Memtables and SSTs a reader sees; level 0 newest first, others by key */
+typedef struct lsm_version
+{
+	_Atomic int			refs;
+	lsm_memtable_t	   *mem;
+	lsm_memtable_t	   *imm;
+	int					files[LSM_LEVELS];
+	lsm_sst_t		  **level[LSM_LEVELS];
+} lsm_version_t;
+
+struct lsm_snapshot
+{
+	uint64_t			seq;
+	struct lsm_snapshot *prev;
+	struct lsm_snapshot *next;
+};
+
+/* Merge input: a memtable, or a run of SSTs with disjoint key ranges */
+typedef struct lsm_child
+{
+	lsm_memtable_t	   *mem;
+	lsm_node_t		   *node;
+	lsm_sst_t		  **files;
+	int					nfiles;
+	int					file;
+	lsm_sst_iter_t	   *iter;
+	bool				valid;
+	lsm_entry_t			entry;
+} lsm_child_t;
+
+typedef struct lsm_merge
+{
+	lsm_child_t		   *children;
+	int					nchildren;
+	int					current;	/* Child with the smallest entry, -1 at the end */
+} lsm_merge_t;
+
+struct lsm_iter
+{
+	lsm_version_t	   *version;
+	uint64_t			seq;
+	lsm_merge_t			merge;
+	bool				valid;
+	uint16_t			key_len;
+	char				key[MAX_KEY_SIZE];
+	char				value[MAX_VALUE_SIZE];
+};
+
+struct lsm
+{
+	char				dir[1024];
+	lsm_options_t		options;
+	pthread_mutex_t		write_mutex;	/* One writer at a time */
+	pthread_mutex_t		mutex;			/* current, snapshots, next_file, stats */
+	pthread_cond_t		work_cond;		/* Wakes the worker */
+	pthread_cond_t		done_cond;		/* Wakes stalled writers */
+	lsm_version_t	   *current;
+	lsm_memtable_t	   *mem;			/* current->mem, for the writer */
+	_Atomic uint64_t	last_seq;
+	uint64_t			next_file;
+	lsm_snapshot_t		snapshots;		/* List head, oldest first */
+	char			   *compact_pointer[LSM_LEVELS];
+	pthread_t			worker;
+	bool				worker_started;
+	_Atomic bool		stopping;
+	char				error[256];		/* Worker failure; writes fail once set */
+	lsm_stats_t			stats;
+	_Atomic uint64_t	user_bytes;
+	_Atomic uint64_t	filter_checks;
+	_Atomic uint64_t	filter_negatives;
+};
+
+/* A pending flush or compaction */
+typedef struct lsm_compaction
+{
+	int					level;		/* Inputs from level and level + 1 */
+	lsm_sst_t		  **inputs[2];
+	int					ninputs[2];
+	lsm_version_t	   *base;
+} lsm_compaction_t;
+
+/* SSTs being written by a flush or compaction */
+typedef struct lsm_build
+{
+	lsm_t			   *lsm;
+	int					level;		/* Output level */
+	lsm_version_t	   *base;		/* For deeper levels, when dropping deletions */
+	bool				drop_deletes;
+	bool				single_file;	/* A flush: one file, however large */
+	uint64_t			smallest_snapshot;
+	lsm_sst_writer_t   *writer;
+	char				path[1100];
+	uint64_t			number;
+	lsm_sst_t		  **outputs;
+	int					noutputs;
+	bool				has_key;
+	uint16_t			key_len;
+	char				key[MAX_KEY_SIZE];
+	uint64_t			key_last_seq;	/* Newest sequence seen for key */
+	uint64_t			bytes;
+} lsm_build_t;
+
+static void *lsm_worker(void *arg);
+
+static inline int
+lsm_key_compare(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	return lsm_entry_compare(a, a_len, 0, b, b_len, 0);
+}
+
+static void
+lsm_set_error(char *errbuf, size_t errbuflen, const char *what, const char *path)
+{
+	if (errbuf != NULL && errbuflen > 0)
+		snprintf(errbuf, errbuflen, "%s %s: %s", what, path, strerror(errno));
+}
+
+static void
+lsm_file_path(const lsm_t *lsm, uint64_t number, const char *suffix, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%06" PRIu64 ".%s", lsm->dir, number, suffix);
+}
+
+/*
+ * Memtable
+ */
+
+static inline const char *
+lsm_node_key(const lsm_node_t *node)
+{
+	return (const char *) &node->next[node->height];
+}
+
+static void *
+lsm_arena_alloc(lsm_memtable_t *mem, size_t size)
+{
+	lsm_chunk_t *chunk = mem->chunks;
+	void	   *p;
+
+	size = (size + 7) & ~(size_t) 7;
+	if (chunk == NULL || chunk->used + size > chunk->size)
+	{
+		size_t		chunk_size = size > LSM_ARENA_CHUNK ? size : LSM_ARENA_CHUNK;
+
+		chunk = malloc(sizeof(lsm_chunk_t) + chunk_size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->prev = mem->chunks;
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		mem->chunks = chunk;
+	}
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+	atomic_fetch_add_explicit(&mem->bytes, size, memory_order_relaxed);
+	return p;
+}
+
+static lsm_node_t *
+lsm_node_alloc(lsm_memtable_t *mem, int height, size_t data_len)
+{
+	lsm_node_t *node = lsm_arena_alloc(mem, sizeof(lsm_node_t) +
+									   (size_t) height * sizeof(node->next[0]) + data_len);
+	int			i;
+
+	if (node == NULL)
+		return NULL;
+	node->height = (uint8_t) height;
+	for (i = 0; i < height; i++)
+		atomic_init(&node->next[i], NULL);
+	return node;
+}
+
+/* A memtable logging to NNNNNN.log; number 0 creates no log */
+static lsm_memtable_t *
+lsm_memtable_create(lsm_t *lsm, uint64_t log_number, char *errbuf, size_t errbuflen)
+{
+	lsm_memtable_t *mem = calloc(1, sizeof(lsm_memtable_t));
+	char		path[1100];
+
+	if (mem == NULL)
+		return NULL;
+	atomic_init(&mem->refs, 1);
+	atomic_init(&mem->height, 1);
+	atomic_init(&mem->bytes, 0);
+	mem->rnd = 0x9e3779b9u ^ (uint32_t) log_number;
+	mem->log_number = log_number;
+	mem->log_fd = -1;
+	mem->head = lsm_node_alloc(mem, LSM_MAX_HEIGHT, 0);
+	if (mem->head == NULL)
+	{
+		free(mem);
+		return NULL;
+	}
+	if (log_number != 0)
+	{
+		lsm_file_path(lsm, log_number, "log", path, sizeof(path));
+		mem->log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+		if (mem->log_fd < 0)
+		{
+			lsm_set_error(errbuf, errbuflen, "Failed to create LSM log", path);
+			free(mem->chunks);
+			free(mem);
+			return NULL;
+		}
+	}
+	return mem;
+}
+
+static void
+lsm_memtable_unref(lsm_memtable_t *mem)
+{
+	lsm_chunk_t *chunk;
+
+	if (mem == NULL || atomic_fetch_sub_explicit(&mem->refs, 1, memory_order_acq_rel) != 1)
+		return;
+	if (mem->log_fd >= 0)
+		close(mem->log_fd);
+	while ((chunk = mem->chunks) != NULL)
+	{
+		mem->chunks = chunk->prev;
+		free(chunk);
+	}
+	free(mem);
+}
+
+/* First node at or after (key, seq); fills prev[] for an insert if given */
+static lsm_node_t *
+lsm_memtable_seek(lsm_memtable_t *mem, const char *key, size_t key_len, uint64_t seq,
+				  lsm_node_t **prev)
+{
+	lsm_node_t *x = mem->head;
+	int			level = atomic_load_explicit(&mem->height, memory_order_acquire) - 1;
+
+	for (;;)
+	{
+		lsm_node_t *next = atomic_load_explicit(&x->next[level], memory_order_acquire);
+
+		if (next != NULL &&
+			lsm_entry_compare(lsm_node_key(next), next->key_len, next->seq,
+							  key, key_len, seq) < 0)
+		{
+			x = next;
+			continue;
+		}
+		if (prev != NULL)
+			prev[level] = x;
+		if (level == 0)
+			return next;
+		level--;
+	}
+}
+
+/* Single writer only */
+static int
+lsm_memtable_insert(lsm_memtable_t *mem, const lsm_entry_t *entry)
+{
+	lsm_node_t *prev[LSM_MAX_HEIGHT];
+	lsm_node_t *node;
+	int			height = 1;
+	int			current = atomic_load_explicit(&mem->height, memory_order_relaxed);
+	int			i;
+
+	while (height < LSM_MAX_HEIGHT)
+	{
+		mem->rnd = mem->rnd * 1103515245u + 12345u;
+		if (((mem->rnd >> 16) & 3) != 0)
+			break;
+		height++;
+	}
+	(void) lsm_memtable_seek(mem, entry->key, entry->key_len, entry->seq, prev);
+	for (i = current; i < height; i++)
+		prev[i] = mem->head;
+
+	node = lsm_node_alloc(mem, height, (size_t) entry->key_len + entry->value_len);
+	if (node == NULL)
+		return -1;
+	node->seq = entry->seq;
+	node->key_len = entry->key_len;
+	node->value_len = entry->value_len;
+	node->type = entry->type;
+	memcpy((char *) lsm_node_key(node), entry->key, entry->key_len);
+	memcpy((char *) lsm_node_key(node) + entry->key_len, entry->value, entry->value_len);
+
+	if (height > current)
+		atomic_store_explicit(&mem->height, height, memory_order_relaxed);
+	for (i = 0; i < height; i++)
+	{
+		atomic_store_explicit(&node->next[i],
+							  atomic_load_explicit(&prev[i]->next[i], memory_order_relaxed),
+							  memory_order_relaxed);
+		atomic_store_explicit(&prev[i]->next[i], node, memory_order_release);
+	}
+	return 0;
+}
+
+static void
+lsm_node_entry(const lsm_node_t *node, lsm_entry_t *entry)
+{
+	entry->key = lsm_node_key(node);
+	entry->value = entry->key + node->key_len;
+	entry->key_len = node->key_len;
+	entry->value_len = node->value_len;
+	entry->seq = node->seq;
+	entry->type = node->type;
+}
+
+static bool
+lsm_memtable_empty(lsm_memtable_t *mem)
+{
+	return atomic_load_explicit(&mem->head->next[0], memory_order_acquire) == NULL;
+}
+
+/*
+ * Log: memtable entries in SST block format, replayed at open
+ */
+
+static int
+lsm_log_append(lsm_memtable_t *mem, const lsm_entry_t *entry, bool sync)
+{
+	char		record[LSM_BLOCK_SIZE];
+	uint64_t	seq_type = (entry->seq << 8) | entry->type;
+	size_t		len = LSM_ENTRY_HEADER + (size_t) entry->key_len + entry->value_len;
+	size_t		done = 0;
+
+	memcpy(record, &entry->key_len, sizeof(uint16_t));
+	memcpy(record + 2, &entry->value_len, sizeof(uint16_t));
+	memcpy(record + 4, &seq_type, sizeof(uint64_t));
+	memcpy(record + LSM_ENTRY_HEADER, entry->key, entry->key_len);
+	memcpy(record + LSM_ENTRY_HEADER + entry->key_len, entry->value, entry->value_len);
+	while (done < len)
+	{
+		ssize_t		n = write(mem->log_fd, record + done, len - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		done += (size_t) n;
+	}
+	if (sync && fdatasync(mem->log_fd) != 0)
+		return -1;
+	return 0;
+}
+
+/* Insert a log's entries into mem; a torn last record is ignored */
+static int
+lsm_log_replay(lsm_t *lsm, uint64_t number, lsm_memtable_t *mem, char *errbuf,
+			   size_t errbuflen)
+{
+	char		path[1100];
+	struct stat st;
+	char	   *data;
+	size_t		pos = 0;
+	int			fd;
+	ssize_t		n;
+
+	lsm_file_path(lsm, number, "log", path, sizeof(path));
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to open LSM log", path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	data = malloc((size_t) st.st_size + 1);
+	n = data != NULL ? read(fd, data, (size_t) st.st_size) : -1;
+	close(fd);
+	if (n != st.st_size)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to read LSM log", path);
+		free(data);
+		return -1;
+	}
+	while (pos + LSM_ENTRY_HEADER <= (size_t) st.st_size)
+	{
+		lsm_entry_t entry;
+		uint64_t	seq_type;
+
+		memcpy(&entry.key_len, data + pos, sizeof(uint16_t));
+		memcpy(&entry.value_len, data + pos + 2, sizeof(uint16_t));
+		memcpy(&seq_type, data + pos + 4, sizeof(uint64_t));
+		if (pos + LSM_ENTRY_HEADER + entry.key_len + entry.value_len > (size_t) st.st_size)
+			break;
+		entry.key = data + pos + LSM_ENTRY_HEADER;
+		entry.value = entry.key + entry.key_len;
+		entry.seq = seq_type >> 8;
+		entry.type = (uint8_t) (seq_type & 0xFF);
+		if (lsm_memtable_insert(mem, &entry) != 0)
+		{
+			free(data);
+			return -1;
+		}
+		if (entry.seq > atomic_load_explicit(&lsm->last_seq, memory_order_relaxed))
+			atomic_store_explicit(&lsm->last_seq, entry.seq, memory_order_relaxed);
+		pos += LSM_ENTRY_HEADER + (size_t) entry.key_len + entry.value_len;
+	}
+	free(data);
+	return 0;
+}
+
+/*
+ * Versions
+ */
+
+static lsm_version_t *
+lsm_version_copy(const lsm_version_t *from)
+{
+	lsm_version_t *v = calloc(1, sizeof(lsm_version_t));
+	int			level;
+	int			i;
+
+	if (v == NULL)
+		return NULL;
+	atomic_init(&v->refs, 1);
+	if (from == NULL)
+		return v;
+	v->mem = from->mem;
+	v->imm = from->imm;
+	if (v->mem != NULL)
+		atomic_fetch_add_explicit(&v->mem->refs, 1, memory_order_relaxed);
+	if (v->imm != NULL)
+		atomic_fetch_add_explicit(&v->imm->refs, 1, memory_order_relaxed);
+	for (level = 0; level < LSM_LEVELS; level++)
+	{
+		if (from->files[level] == 0)
+			continue;
+		v->level[level] = malloc((size_t) from->files[level] * sizeof(lsm_sst_t *));
+		if (v->level[level] == NULL)
+			continue;			/* Caught by lsm_version_add() callers */
+		v->files[level] = from->files[level];
+		for (i = 0; i < v->files[level]; i++)
+		{
+			v->level[level][i] = from->level[level][i];
+			lsm_sst_ref(v->level[level][i]);
+		}
+	}
+	return v;
+}
+
+static void
+lsm_version_unref(lsm_version_t *v)
+{
+	int			level;
+	int			i;
+
+	if (v == NULL || atomic_fetch_sub_explicit(&v->refs, 1, memory_order_acq_rel) != 1)
+		return;
+	lsm_memtable_unref(v->mem);
+	lsm_memtable_unref(v->imm);
+	for (level = 0; level < LSM_LEVELS; level++)
+	{
+		for (i = 0; i < v->files[level]; i++)
+			lsm_sst_unref(v->level[level][i]);
+		free(v->level[level]);
+	}
+	free(v);
+}
+
+static bool
+lsm_version_complete(const lsm_version_t *v, const lsm_version_t *from)
+{
+	int			level;
+
+	for (level = 0; level < LSM_LEVELS; level++)
+	{
+		if (v->files[level] != from->files[level])
+			return false;
+	}
+	return true;
+}
+
+/* Add sst to a level: first in level 0, in key order below */
+static int
+lsm_version_add(lsm_version_t *v, int level, lsm_sst_t *sst)
+{
+	lsm_sst_t **files = realloc(v->level[level],
+								(size_t) (v->files[level] + 1) * sizeof(lsm_sst_t *));
+	int			pos = 0;
+
+	if (files == NULL)
+		return -1;
+	v->level[level] = files;
+	if (level > 0)
+	{
+		while (pos < v->files[level] &&
+			   lsm_key_compare(files[pos]->smallest, strlen(files[pos]->smallest),
+							   sst->smallest, strlen(sst->smallest)) < 0)
+			pos++;
+	}
+	memmove(&files[pos + 1], &files[pos], (size_t) (v->files[level] - pos) * sizeof(lsm_sst_t *));
+	files[pos] = sst;
+	v->files[level]++;
+	lsm_sst_ref(sst);
+	return 0;
+}
+
+static void
+lsm_version_remove(lsm_version_t *v, int level, const lsm_sst_t *sst)
+{
+	int			i;
+
+	for (i = 0; i < v->files[level]; i++)
+	{
+		if (v->level[level][i] != sst)
+			continue;
+		lsm_sst_unref(v->level[level][i]);
+		memmove(&v->level[level][i], &v->level[level][i + 1],
+				(size_t) (v->files[level] - i - 1) * sizeof(lsm_sst_t *));
+		v->files[level]--;
+		return;
+	}
+}
+
+/* Replace current; mutex held */
+static void
+lsm_install(lsm_t *lsm, lsm_version_t *v)
+{
+	lsm_version_t *old = lsm->current;
+
+	lsm->current = v;
+	lsm_version_unref(old);
+}
+
+/* Snapshot sequence and version for a reader */
+static lsm_version_t *
+lsm_acquire(lsm_t *lsm, const lsm_snapshot_t *snapshot, uint64_t *seq)
+{
+	lsm_version_t *v;
+
+	pthread_mutex_lock(&lsm->mutex);
+	*seq = snapshot != NULL ? snapshot->seq
+		: atomic_load_explicit(&lsm->last_seq, memory_order_acquire);
+	v = lsm->current;
+	atomic_fetch_add_explicit(&v->refs, 1, memory_order_relaxed);
+	pthread_mutex_unlock(&lsm->mutex);
+	return v;
+}
+
+static uint64_t
+lsm_smallest_snapshot(lsm_t *lsm)
+{
+	if (lsm->snapshots.next != &lsm->snapshots)
+		return lsm->snapshots.next->seq;
+	return atomic_load_explicit(&lsm->last_seq, memory_order_acquire);
+}
+
+/*
+ * MANIFEST: "next_file N", "last_seq N", "log N", then "sst LEVEL NUMBER"
+ * per file; written to MANIFEST.tmp and renamed over the old one.
+ */
+
+static int
+lsm_manifest_write(lsm_t *lsm, const lsm_version_t *v, char *errbuf, size_t errbuflen)
+{
+	char		path[1100];
+	char		tmp[1100];
+	FILE	   *file;
+	int			level;
+	int			i;
+	bool		ok;
+	int			dir_fd;
+
+	snprintf(path, sizeof(path), "%s/%s", lsm->dir, LSM_MANIFEST);
+	snprintf(tmp, sizeof(tmp), "%s/%s.tmp", lsm->dir, LSM_MANIFEST);
+	file = fopen(tmp, "w");
+	if (file == NULL)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to write", tmp);
+		return -1;
+	}
+	fprintf(file, "next_file %" PRIu64 "\nlast_seq %" PRIu64 "\nlog %" PRIu64 "\n",
+			lsm->next_file, atomic_load_explicit(&lsm->last_seq, memory_order_acquire),
+			v->imm != NULL ? v->imm->log_number : v->mem->log_number);
+	for (level = 0; level < LSM_LEVELS; level++)
+	{
+		for (i = 0; i < v->files[level]; i++)
+			fprintf(file, "sst %d %" PRIu64 "\n", level, v->level[level][i]->number);
+	}
+	ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok || rename(tmp, path) != 0)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to write", path);
+		unlink(tmp);
+		return -1;
+	}
+	dir_fd = open(lsm->dir, O_RDONLY);
+	if (dir_fd >= 0)
+	{
+		(void) fsync(dir_fd);
+		close(dir_fd);
+	}
+	return 0;
+}
+
+static int
+lsm_manifest_read(lsm_t *lsm, lsm_version_t *v, uint64_t *log_number, char *errbuf,
+				  size_t errbuflen)
+{
+	char		path[1100];
+	char		line[128];
+	FILE	   *file;
+	uint64_t	value;
+	uint64_t	number;
+	int			level;
+
+	snprintf(path, sizeof(path), "%s/%s", lsm->dir, LSM_MANIFEST);
+	file = fopen(path, "r");
+	if (file == NULL)
+		return errno == ENOENT ? 0 : -1;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, "next_file %" SCNu64, &value) == 1)
+			lsm->next_file = value;
+		else if (sscanf(line, "last_seq %" SCNu64, &value) == 1)
+			atomic_store_explicit(&lsm->last_seq, value, memory_order_relaxed);
+		else if (sscanf(line, "log %" SCNu64, &value) == 1)
+			*log_number = value;
+		else if (sscanf(line, "sst %d %" SCNu64, &level, &number) == 2 &&
+				 level >= 0 && level < LSM_LEVELS)
+		{
+			char		sst_path[1100];
+			lsm_sst_t  *sst;
+
+			lsm_file_path(lsm, number, "sst", sst_path, sizeof(sst_path));
+			sst = lsm_sst_open(sst_path, number, errbuf, errbuflen);
+			if (sst == NULL)
+			{
+				fclose(file);
+				return -1;
+			}
+			/* Level 0 is listed newest first; keep that order */
+			if (level == 0)
+			{
+				lsm_sst_t **files = realloc(v->level[0], (size_t) (v->files[0] + 1) * sizeof(lsm_sst_t *));
+
+				if (files == NULL)
+				{
+					lsm_sst_unref(sst);
+					fclose(file);
+					return -1;
+				}
+				files[v->files[0]++] = sst;
+				v->level[0] = files;
+				continue;
+			}
+			if (lsm_version_add(v, level, sst) != 0)
+			{
+				lsm_sst_unref(sst);
+				fclose(file);
+				return -1;
+			}
+			lsm_sst_unref(sst);
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+/*
+ * Point lookups
+ */
+
+/* 0 found (value copied), 1 deleted, 2 not in this source */
+static int
+lsm_result(const lsm_entry_t *entry, char *value, size_t value_size)
+{
+	size_t		len;
+
+	if (entry->type == LSM_TYPE_DELETE)
+		return 1;
+	len = entry->value_len < value_size - 1 ? entry->value_len : value_size - 1;
+	memcpy(value, entry->value, len);
+	value[len] = '\0';
+	return 0;
+}
+
+static int
+lsm_memtable_get(lsm_memtable_t *mem, const char *key, size_t key_len, uint64_t seq,
+				 char *value, size_t value_size)
+{
+	lsm_node_t *node = lsm_memtable_seek(mem, key, key_len, seq, NULL);
+	lsm_entry_t entry;
+
+	if (node == NULL || lsm_key_compare(lsm_node_key(node), node->key_len, key, key_len) != 0)
+		return 2;
+	lsm_node_entry(node, &entry);
+	return lsm_result(&entry, value, value_size);
+}
+
+static int
+lsm_sst_get(lsm_t *lsm, lsm_sst_t *sst, lsm_sst_iter_t *iter, const char *key,
+			size_t key_len, uint64_t hash, uint64_t seq, char *value, size_t value_size)
+{
+	if (lsm_key_compare(key, key_len, sst->smallest, strlen(sst->smallest)) < 0 ||
+		lsm_key_compare(key, key_len, sst->largest, strlen(sst->largest)) > 0)
+		return 2;
+	atomic_fetch_add_explicit(&lsm->filter_checks, 1, memory_order_relaxed);
+	if (!lsm_sst_may_contain(sst, hash))
+	{
+		atomic_fetch_add_explicit(&lsm->filter_negatives, 1, memory_order_relaxed);
+		return 2;
+	}
+	lsm_sst_iter_init(iter, sst);
+	lsm_sst_iter_seek(iter, key, key_len);
+	while (iter->valid &&
+		   lsm_key_compare(iter->entry.key, iter->entry.key_len, key, key_len) == 0)
+	{
+		if (iter->entry.seq <= seq)
+			return lsm_result(&iter->entry, value, value_size);
+		lsm_sst_iter_next(iter);
+	}
+	return 2;
+}
+
+/*
+ * Value of key as of snapshot (NULL for the latest): 0 if found, 1 if
+ * absent or deleted, -1 on error.
+ */
+int
+lsm_get(lsm_t *lsm, const lsm_snapshot_t *snapshot, const char *key, size_t key_len,
+		char *value, size_t value_size)
+{
+	lsm_version_t *v;
+	lsm_sst_iter_t iter;
+	uint64_t	seq;
+	uint64_t	hash;
+	int			ret;
+	int			level;
+	int			i;
+
+	if (lsm == NULL || key == NULL || value == NULL || value_size == 0)
+		return -1;
+	v = lsm_acquire(lsm, snapshot, &seq);
+	ret = lsm_memtable_get(v->mem, key, key_len, seq, value, value_size);
+	if (ret == 2 && v->imm != NULL)
+		ret = lsm_memtable_get(v->imm, key, key_len, seq, value, value_size);
+	if (ret != 2)
+	{
+		lsm_version_unref(v);
+		return ret == 0 ? 0 : 1;
+	}
+
+	hash = hash_key_seeded(key, key_len, LSM_HASH_SEED);
+	for (i = 0; ret == 2 && i < v->files[0]; i++)
+		ret = lsm_sst_get(lsm, v->level[0][i], &iter, key, key_len, hash, seq, value, value_size);
+	for (level = 1; ret == 2 && level < LSM_LEVELS; level++)
+	{
+		int			lo = 0;
+		int			hi = v->files[level];
+
+		/* The one file whose largest key is not below key */
+		while (lo < hi)
+		{
+			int			mid = lo + (hi - lo) / 2;
+			const char *largest = v->level[level][mid]->largest;
+
+			if (lsm_key_compare(largest, strlen(largest), key, key_len) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < v->files[level])
+			ret = lsm_sst_get(lsm, v->level[level][lo], &iter, key, key_len, hash, seq,
+							  value, value_size);
+	}
+	lsm_version_unref(v);
+	return ret == 0 ? 0 : 1;
+}
+
+/*
+ * Writes
+ */
+
+/* Switch to a fresh memtable once the current one is full; mutex held */
+static int
+lsm_make_room(lsm_t *lsm, char *errbuf, size_t errbuflen)
+{
+	for (;;)
+	{
+		lsm_memtable_t *mem;
+		lsm_version_t *v;
+
+		if (atomic_load(&lsm->stopping) || lsm->error[0] != '\0')
+		{
+			if (errbuf != NULL && errbuflen > 0)
+				snprintf(errbuf, errbuflen, "LSM engine unavailable: %s",
+						 lsm->error[0] != '\0' ? lsm->error : "shutting down");
+			return -1;
+		}
+		if (atomic_load_explicit(&lsm->mem->bytes, memory_order_relaxed) < lsm->options.memtable_bytes)
+			return 0;
+		if (lsm->current->imm != NULL ||
+			lsm->current->files[0] >= lsm->options.level0_files * LSM_LEVEL0_STOP)
+		{
+			lsm->stats.stalls++;
+			pthread_cond_signal(&lsm->work_cond);
+			pthread_cond_wait(&lsm->done_cond, &lsm->mutex);
+			continue;
+		}
+
+		mem = lsm_memtable_create(lsm, lsm->next_file, errbuf, errbuflen);
+		if (mem == NULL)
+			return -1;
+		v = lsm_version_copy(lsm->current);
+		if (v == NULL || !lsm_version_complete(v, lsm->current))
+		{
+			lsm_version_unref(v);
+			lsm_memtable_unref(mem);
+			return -1;
+		}
+		lsm->next_file++;
+		v->imm = v->mem;
+		v->mem = mem;
+		close(v->imm->log_fd);
+		v->imm->log_fd = -1;
+		lsm_install(lsm, v);
+		lsm->mem = mem;
+		pthread_cond_signal(&lsm->work_cond);
+	}
+}
+
+static int
+lsm_write(lsm_t *lsm, const char *key, size_t key_len, const char *value, size_t value_len,
+		  uint8_t type, char *errbuf, size_t errbuflen)
+{
+	lsm_entry_t entry;
+	int			ret;
+
+	if (lsm == NULL || key == NULL || key_len == 0 || key_len >= MAX_KEY_SIZE ||
+		value_len >= MAX_VALUE_SIZE)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Invalid parameters for LSM write");
+		return -1;
+	}
+	entry.key = key;
+	entry.key_len = (uint16_t) key_len;
+	entry.value = value != NULL ? value : "";
+	entry.value_len = (uint16_t) value_len;
+	entry.type = type;
+
+	pthread_mutex_lock(&lsm->write_mutex);
+	pthread_mutex_lock(&lsm->mutex);
+	ret = lsm_make_room(lsm, errbuf, errbuflen);
+	pthread_mutex_unlock(&lsm->mutex);
+	if (ret == 0)
+	{
+		entry.seq = atomic_load_explicit(&lsm->last_seq, memory_order_relaxed) + 1;
+		if (lsm_log_append(lsm->mem, &entry, lsm->options.sync != 0) != 0)
+		{
+			if (errbuf != NULL && errbuflen > 0)
+				snprintf(errbuf, errbuflen, "Failed to append to LSM log: %s", strerror(errno));
+			ret = -1;
+		}
+		else if (lsm_memtable_insert(lsm->mem, &entry) != 0)
+		{
+			if (errbuf != NULL && errbuflen > 0)
+				snprintf(errbuf, errbuflen, "Memory allocation failed for memtable entry");
+			ret = -1;
+		}
+		else
+		{
+			atomic_store_explicit(&lsm->last_seq, entry.seq, memory_order_release);
+			atomic_fetch_add_explicit(&lsm->user_bytes, key_len + value_len,
+									  memory_order_relaxed);
+		}
+	}
+	pthread_mutex_unlock(&lsm->write_mutex);
+	return ret;
+}
+
+int
+lsm_put(lsm_t *lsm, const char *key, size_t key_len, const char *value, size_t value_len,
+		char *errbuf, size_t errbuflen)
+{
+	return lsm_write(lsm, key, key_len, value, value_len, LSM_TYPE_VALUE, errbuf, errbuflen);
+}
+
+int
+lsm_delete(lsm_t *lsm, const char *key, size_t key_len, char *errbuf, size_t errbuflen)
+{
+	return lsm_write(lsm, key, key_len, NULL, 0, LSM_TYPE_DELETE, errbuf, errbuflen);
+}
+
+/*
+ * Merging iterator
+ */
+
+static void
+lsm_child_load(lsm_child_t *child)
+{
+	if (child->mem != NULL)
+	{
+		child->valid = child->node != NULL;
+		if (child->valid)
+			lsm_node_entry(child->node, &child->entry);
+		return;
+	}
+	/* Past the end of one file: on to the next of the run */
+	while (!child->iter->valid && child->file + 1 < child->nfiles)
+	{
+		child->file++;
+		lsm_sst_iter_init(child->iter, child->files[child->file]);
+		lsm_sst_iter_first(child->iter);
+	}
+	child->valid = child->iter->valid;
+	if (child->valid)
+		child->entry = child->iter->entry;
+}
+
+static void
+lsm_child_seek(lsm_child_t *child, const char *key, size_t key_len)
+{
+	int			lo = 0;
+	int			hi = child->nfiles;
+
+	if (child->mem != NULL)
+	{
+		child->node = key != NULL
+			? lsm_memtable_seek(child->mem, key, key_len, LSM_MAX_SEQ, NULL)
+			: atomic_load_explicit(&child->mem->head->next[0], memory_order_acquire);
+		lsm_child_load(child);
+		return;
+	}
+	while (key != NULL && lo < hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+		const char *largest = child->files[mid]->largest;
+
+		if (lsm_key_compare(largest, strlen(largest), key, key_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	child->valid = false;
+	if (lo >= child->nfiles)
+		return;
+	child->file = lo;
+	lsm_sst_iter_init(child->iter, child->files[lo]);
+	if (key != NULL)
+		lsm_sst_iter_seek(child->iter, key, key_len);
+	else
+		lsm_sst_iter_first(child->iter);
+	lsm_child_load(child);
+}
+
+static void
+lsm_child_next(lsm_child_t *child)
+{
+	if (child->mem != NULL)
+		child->node = atomic_load_explicit(&child->node->next[0], memory_order_acquire);
+	else
+		lsm_sst_iter_next(child->iter);
+	lsm_child_load(child);
+}
+
+static void
+lsm_merge_update(lsm_merge_t *merge)
+{
+	int			i;
+
+	merge->current = -1;
+	for (i = 0; i < merge->nchildren; i++)
+	{
+		lsm_child_t *c = &merge->children[i];
+		lsm_entry_t *best;
+
+		if (!c->valid)
+			continue;
+		if (merge->current < 0)
+		{
+			merge->current = i;
+			continue;
+		}
+		best = &merge->children[merge->current].entry;
+		if (lsm_entry_compare(c->entry.key, c->entry.key_len, c->entry.seq,
+							  best->key, best->key_len, best->seq) < 0)
+			merge->current = i;
+	}
+}
+
+static int
+lsm_merge_add(lsm_merge_t *merge, lsm_memtable_t *mem, lsm_sst_t **files, int nfiles)
+{
+	lsm_child_t *c = &merge->children[merge->nchildren];
+
+	memset(c, 0, sizeof(lsm_child_t));
+	c->mem = mem;
+	c->files = files;
+	c->nfiles = nfiles;
+	if (mem == NULL)
+	{
+		c->iter = malloc(sizeof(lsm_sst_iter_t));
+		if (c->iter == NULL)
+			return -1;
+	}
+	merge->nchildren++;
+	return 0;
+}
+
+static void
+lsm_merge_free(lsm_merge_t *merge)
+{
+	int			i;
+
+	for (i = 0; i < merge->nchildren; i++)
+		free(merge->children[i].iter);
+	free(merge->children);
+	merge->children = NULL;
+	merge->nchildren = 0;
+}
+
+/* Merge over everything in a version */
+static int
+lsm_merge_version(lsm_merge_t *merge, lsm_version_t *v)
+{
+	int			level;
+	int			i;
+	int			ok = 0;
+
+	merge->nchildren = 0;
+	merge->current = -1;
+	merge->children = calloc((size_t) (2 + v->files[0] + LSM_LEVELS), sizeof(lsm_child_t));
+	if (merge->children == NULL)
+		return -1;
+	ok |= lsm_merge_add(merge, v->mem, NULL, 0);
+	if (v->imm != NULL)
+		ok |= lsm_merge_add(merge, v->imm, NULL, 0);
+	for (i = 0; i < v->files[0]; i++)
+		ok |= lsm_merge_add(merge, NULL, &v->level[0][i], 1);
+	for (level = 1; level < LSM_LEVELS; level++)
+	{
+		if (v->files[level] > 0)
+			ok |= lsm_merge_add(merge, NULL, v->level[level], v->files[level]);
+	}
+	if (ok != 0)
+	{
+		lsm_merge_free(merge);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+lsm_merge_seek(lsm_merge_t *merge, const char *key, size_t key_len)
+{
+	int			i;
+
+	for (i = 0; i < merge->nchildren; i++)
+		lsm_child_seek(&merge->children[i], key, key_len);
+	lsm_merge_update(merge);
+}
+
+static void
+lsm_merge_next(lsm_merge_t *merge)
+{
+	lsm_child_next(&merge->children[merge->current]);
+	lsm_merge_update(merge);
+}
+
+/*
+ * User iterator: the newest version of each key visible at seq, in key
+ * order, deleted keys skipped.  The version it pins keeps its files.
+ */
+
+/* Stop at the next visible key; with skip set, pass over iter->key first */
+static void
+lsm_iter_find(lsm_iter_t *iter, bool skip)
+{
+	lsm_merge_t *merge = &iter->merge;
+
+	iter->valid = false;
+	while (merge->current >= 0)
+	{
+		lsm_entry_t *e = &merge->children[merge->current].entry;
+
+		if (e->seq > iter->seq ||
+			(skip && lsm_key_compare(e->key, e->key_len, iter->key, iter->key_len) == 0))
+		{
+			lsm_merge_next(merge);
+			continue;
+		}
+		memcpy(iter->key, e->key, e->key_len);
+		iter->key[e->key_len] = '\0';
+		iter->key_len = e->key_len;
+		skip = true;
+		if (e->type == LSM_TYPE_DELETE)
+		{
+			lsm_merge_next(merge);
+			continue;
+		}
+		memcpy(iter->value, e->value, e->value_len);
+		iter->value[e->value_len] = '\0';
+		iter->valid = true;
+		return;
+	}
+}
+
+lsm_iter_t *
+lsm_iter_open(lsm_t *lsm, const lsm_snapshot_t *snapshot)
+{
+	lsm_iter_t *iter = calloc(1, sizeof(lsm_iter_t));
+
+	if (iter == NULL)
+		return NULL;
+	iter->version = lsm_acquire(lsm, snapshot, &iter->seq);
+	if (lsm_merge_version(&iter->merge, iter->version) != 0)
+	{
+		lsm_version_unref(iter->version);
+		free(iter);
+		return NULL;
+	}
+	lsm_merge_seek(&iter->merge, NULL, 0);
+	lsm_iter_find(iter, false);
+	return iter;
+}
+
+bool
+lsm_iter_valid(const lsm_iter_t *iter)
+{
+	return iter->valid;
+}
+
+const char *
+lsm_iter_key(const lsm_iter_t *iter)
+{
+	return iter->key;
+}
+
+const char *
+lsm_iter_value(const lsm_iter_t *iter)
+{
+	return iter->value;
+}
+
+void
+lsm_iter_next(lsm_iter_t *iter)
+{
+	if (iter->valid)
+		lsm_iter_find(iter, true);
+}
+
+void
+lsm_iter_close(lsm_iter_t *iter)
+{
+	if (iter == NULL)
+		return;
+	lsm_merge_free(&iter->merge);
+	lsm_version_unref(iter->version);
+	free(iter);
+}
+
+/*
+ * Snapshots
+ */
+
+lsm_snapshot_t *
+lsm_snapshot_acquire(lsm_t *lsm)
+{
+	lsm_snapshot_t *snapshot = malloc(sizeof(lsm_snapshot_t));
+
+	if (snapshot == NULL)
+		return NULL;
+	pthread_mutex_lock(&lsm->mutex);
+	snapshot->seq = atomic_load_explicit(&lsm->last_seq, memory_order_acquire);
+	snapshot->next = &lsm->snapshots;
+	snapshot->prev = lsm->snapshots.prev;
+	snapshot->prev->next = snapshot;
+	lsm->snapshots.prev = snapshot;
+	pthread_mutex_unlock(&lsm->mutex);
+	return snapshot;
+}
+
+void
+lsm_snapshot_release(lsm_t *lsm, lsm_snapshot_t *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+	pthread_mutex_lock(&lsm->mutex);
+	snapshot->prev->next = snapshot->next;
+	snapshot->next->prev = snapshot->prev;
+	pthread_mutex_unlock(&lsm->mutex);
+	free(snapshot);
+}
+
+/*
+ * Building SSTs
+ */
+
+static int
+lsm_build_cut(lsm_build_t *build, char *errbuf, size_t errbuflen)
+{
+	lsm_sst_t **outputs;
+	lsm_sst_t  *sst;
+
+	if (build->writer == NULL)
+		return 0;
+	build->bytes += lsm_sst_writer_bytes(build->writer);
+	if (lsm_sst_finish(build->writer, errbuf, errbuflen) != 0)
+	{
+		build->writer = NULL;
+		return -1;
+	}
+	build->writer = NULL;
+	sst = lsm_sst_open(build->path, build->number, errbuf, errbuflen);
+	outputs = realloc(build->outputs, (size_t) (build->noutputs + 1) * sizeof(lsm_sst_t *));
+	if (sst == NULL || outputs == NULL)
+	{
+		if (sst != NULL)
+		{
+			atomic_store(&sst->obsolete, true);
+			lsm_sst_unref(sst);
+		}
+		else
+			unlink(build->path);
+		return -1;
+	}
+	build->outputs = outputs;
+	build->outputs[build->noutputs++] = sst;
+	return 0;
+}
+
+/* A deeper level than the output holds key, so its deletion must stay */
+static bool
+lsm_build_key_below(const lsm_build_t *build, const char *key, size_t key_len)
+{
+	int			level;
+	int			i;
+
+	for (level = build->level + 1; level < LSM_LEVELS; level++)
+	{
+		for (i = 0; i < build->base->files[level]; i++)
+		{
+			lsm_sst_t  *sst = build->base->level[level][i];
+
+			if (lsm_key_compare(key, key_len, sst->largest, strlen(sst->largest)) > 0)
+				continue;
+			if (lsm_key_compare(key, key_len, sst->smallest, strlen(sst->smallest)) >= 0)
+				return true;
+			break;
+		}
+	}
+	return false;
+}
+
+static int
+lsm_build_add(lsm_build_t *build, const lsm_entry_t *entry, char *errbuf, size_t errbuflen)
+{
+	lsm_t	   *lsm = build->lsm;
+	bool		new_key = !build->has_key ||
+		lsm_key_compare(entry->key, entry->key_len, build->key, build->key_len) != 0;
+
+	if (new_key)
+	{
+		memcpy(build->key, entry->key, entry->key_len);
+		build->key_len = entry->key_len;
+		build->has_key = true;
+		build->key_last_seq = LSM_MAX_SEQ + 1;
+	}
+	/* Hidden by a newer version every snapshot sees */
+	if (build->key_last_seq <= build->smallest_snapshot)
+		return 0;
+	build->key_last_seq = entry->seq;
+	if (entry->type == LSM_TYPE_DELETE && build->drop_deletes &&
+		entry->seq <= build->smallest_snapshot &&
+		!lsm_build_key_below(build, entry->key, entry->key_len))
+		return 0;
+
+	/* Files split only between keys, so levels stay disjoint */
+	if (build->writer != NULL && new_key && !build->single_file &&
+		lsm_sst_writer_bytes(build->writer) >= lsm->options.sst_bytes &&
+		lsm_build_cut(build, errbuf, errbuflen) != 0)
+		return -1;
+	if (build->writer == NULL)
+	{
+		pthread_mutex_lock(&lsm->mutex);
+		build->number = lsm->next_file++;
+		pthread_mutex_unlock(&lsm->mutex);
+		lsm_file_path(lsm, build->number, "sst", build->path, sizeof(build->path));
+		build->writer = lsm_sst_create(build->path,
+									   lsm->options.sst_bytes / 64, errbuf, errbuflen);
+		if (build->writer == NULL)
+			return -1;
+	}
+	return lsm_sst_add(build->writer, entry);
+}
+
+static void
+lsm_build_abort(lsm_build_t *build)
+{
+	int			i;
+
+	lsm_sst_abort(build->writer);
+	build->writer = NULL;
+	for (i = 0; i < build->noutputs; i++)
+	{
+		atomic_store(&build->outputs[i]->obsolete, true);
+		lsm_sst_unref(build->outputs[i]);
+	}
+	free(build->outputs);
+	build->outputs = NULL;
+	build->noutputs = 0;
+}
+
+/*
+ * Flush and compaction
+ */
+
+static void
+lsm_worker_fail(lsm_t *lsm, const char *errbuf)
+{
+	pthread_mutex_lock(&lsm->mutex);
+	snprintf(lsm->error, sizeof(lsm->error), "%s", errbuf[0] != '\0' ? errbuf : "worker failed");
+	pthread_cond_broadcast(&lsm->done_cond);
+	pthread_mutex_unlock(&lsm->mutex);
+}
+
+/* Write mem out as level 0 SSTs, returned in build */
+static int
+lsm_write_level0(lsm_t *lsm, lsm_memtable_t *mem, lsm_version_t *base, lsm_build_t *build,
+				 char *errbuf, size_t errbuflen)
+{
+	lsm_node_t *node;
+
+	memset(build, 0, sizeof(lsm_build_t));
+	build->lsm = lsm;
+	build->base = base;
+	build->single_file = true;
+	pthread_mutex_lock(&lsm->mutex);
+	build->smallest_snapshot = lsm_smallest_snapshot(lsm);
+	pthread_mutex_unlock(&lsm->mutex);
+
+	for (node = atomic_load_explicit(&mem->head->next[0], memory_order_acquire);
+		 node != NULL;
+		 node = atomic_load_explicit(&node->next[0], memory_order_acquire))
+	{
+		lsm_entry_t entry;
+
+		lsm_node_entry(node, &entry);
+		if (lsm_build_add(build, &entry, errbuf, errbuflen) != 0)
+		{
+			lsm_build_abort(build);
+			return -1;
+		}
+	}
+	if (lsm_build_cut(build, errbuf, errbuflen) != 0)
+	{
+		lsm_build_abort(build);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+lsm_flush(lsm_t *lsm, char *errbuf, size_t errbuflen)
+{
+	lsm_version_t *base;
+	lsm_version_t *v;
+	lsm_build_t build;
+	char		path[1100];
+	uint64_t	log_number;
+
+	pthread_mutex_lock(&lsm->mutex);
+	base = lsm->current;
+	atomic_fetch_add_explicit(&base->refs, 1, memory_order_relaxed);
+	pthread_mutex_unlock(&lsm->mutex);
+
+	if (lsm_write_level0(lsm, base->imm, base, &build, errbuf, errbuflen) != 0)
+	{
+		lsm_version_unref(base);
+		return -1;
+	}
+
+	pthread_mutex_lock(&lsm->mutex);
+	v = lsm_version_copy(lsm->current);
+	if (v == NULL || !lsm_version_complete(v, lsm->current) ||
+		(build.noutputs > 0 && lsm_version_add(v, 0, build.outputs[0]) != 0))
+	{
+		pthread_mutex_unlock(&lsm->mutex);
+		lsm_version_unref(v);
+		lsm_version_unref(base);
+		lsm_build_abort(&build);
+		snprintf(errbuf, errbuflen, "Memory allocation failed for LSM version");
+		return -1;
+	}
+	log_number = v->imm->log_number;
+	lsm_memtable_unref(v->imm);
+	v->imm = NULL;
+	if (lsm_manifest_write(lsm, v, errbuf, errbuflen) != 0)
+	{
+		pthread_mutex_unlock(&lsm->mutex);
+		lsm_version_unref(v);
+		lsm_version_unref(base);
+		lsm_build_abort(&build);
+		return -1;
+	}
+	lsm_install(lsm, v);
+	lsm->stats.flushes++;
+	lsm->stats.flush_bytes += build.bytes;
+	pthread_cond_broadcast(&lsm->done_cond);
+	pthread_mutex_unlock(&lsm->mutex);
+
+	lsm_file_path(lsm, log_number, "log", path, sizeof(path));
+	unlink(path);
+	if (build.noutputs > 0)
+		lsm_sst_unref(build.outputs[0]);
+	free(build.outputs);
+	lsm_version_unref(base);
+	return 0;
+}
+
+static uint64_t
+lsm_level_bytes(const lsm_version_t *v, int level)
+{
+	uint64_t	bytes = 0;
+	int			i;
+
+	for (i = 0; i < v->files[level]; i++)
+		bytes += v->level[level][i]->file_size;
+	return bytes;
+}
+
+static void
+lsm_range_extend(const lsm_sst_t *sst, const char **smallest, const char **largest)
+{
+	if (*smallest == NULL ||
+		lsm_key_compare(sst->smallest, strlen(sst->smallest), *smallest, strlen(*smallest)) < 0)
+		*smallest = sst->smallest;
+	if (*largest == NULL ||
+		lsm_key_compare(sst->largest, strlen(sst->largest), *largest, strlen(*largest)) > 0)
+		*largest = sst->largest;
+}
+
+/* Pick the inputs of the most urgent compaction; mutex held */
+static bool
+lsm_pick_compaction(lsm_t *lsm, lsm_compaction_t *c)
+{
+	lsm_version_t *v = lsm->current;
+	double		best_score = 0;
+	int			best = -1;
+	int			level;
+	int			i;
+	const char *smallest = NULL;
+	const char *largest = NULL;
+	lsm_sst_t **next;
+	int			nnext;
+
+	if (v->files[0] >= lsm->options.level0_files)
+	{
+		best = 0;
+		best_score = (double) v->files[0] / lsm->options.level0_files;
+	}
+	for (level = 1; level < LSM_LEVELS - 1; level++)
+	{
+		double		budget = (double) lsm->options.level_base_bytes;
+		double		score;
+
+		for (i = 1; i < level; i++)
+			budget *= 10;
+		score = (double) lsm_level_bytes(v, level) / budget;
+		if (score >= 1 && score > best_score)
+		{
+			best = level;
+			best_score = score;
+		}
+	}
+	if (best < 0)
+		return false;
+
+	memset(c, 0, sizeof(lsm_compaction_t));
+	c->level = best;
+	if (best == 0)
+	{
+		c->inputs[0] = malloc((size_t) v->files[0] * sizeof(lsm_sst_t *));
+		if (c->inputs[0] == NULL)
+			return false;
+		for (i = 0; i < v->files[0]; i++)
+		{
+			c->inputs[0][c->ninputs[0]++] = v->level[0][i];
+			lsm_range_extend(v->level[0][i], &smallest, &largest);
+		}
+	}
+	else
+	{
+		const char *pointer = lsm->compact_pointer[best];
+		lsm_sst_t  *sst = v->level[best][0];
+
+		/* Round-robin: the first file past the previous compaction */
+		for (i = 0; pointer != NULL && i < v->files[best]; i++)
+		{
+			if (lsm_key_compare(v->level[best][i]->smallest, strlen(v->level[best][i]->smallest),
+								pointer, strlen(pointer)) > 0)
+			{
+				sst = v->level[best][i];
+				break;
+			}
+		}
+		c->inputs[0] = malloc(sizeof(lsm_sst_t *));
+		if (c->inputs[0] == NULL)
+			return false;
+		c->inputs[0][c->ninputs[0]++] = sst;
+		lsm_range_extend(sst, &smallest, &largest);
+		free(lsm->compact_pointer[best]);
+		lsm->compact_pointer[best] = strdup(sst->largest);
+	}
+
+	next = v->level[best + 1];
+	nnext = v->files[best + 1];
+	c->inputs[1] = malloc((size_t) (nnext > 0 ? nnext : 1) * sizeof(lsm_sst_t *));
+	if (c->inputs[1] == NULL)
+	{
+		free(c->inputs[0]);
+		return false;
+	}
+	for (i = 0; i < nnext; i++)
+	{
+		if (lsm_key_compare(next[i]->largest, strlen(next[i]->largest),
+							smallest, strlen(smallest)) < 0 ||
+			lsm_key_compare(next[i]->smallest, strlen(next[i]->smallest),
+							largest, strlen(largest)) > 0)
+			continue;
+		c->inputs[1][c->ninputs[1]++] = next[i];
+	}
+	c->base = v;
+	atomic_fetch_add_explicit(&v->refs, 1, memory_order_relaxed);
+	return true;
+}
+
+/* Swap a compaction's inputs for its outputs; mutex held */
+static int
+lsm_compaction_install(lsm_t *lsm, lsm_compaction_t *c, lsm_sst_t **outputs, int noutputs,
+					   char *errbuf, size_t errbuflen)
+{
+	lsm_version_t *v = lsm_version_copy(lsm->current);
+	int			which;
+	int			i;
+
+	if (v == NULL || !lsm_version_complete(v, lsm->current))
+	{
+		lsm_version_unref(v);
+		snprintf(errbuf, errbuflen, "Memory allocation failed for LSM version");
+		return -1;
+	}
+	for (which = 0; which < 2; which++)
+	{
+		for (i = 0; i < c->ninputs[which]; i++)
+			lsm_version_remove(v, c->level + which, c->inputs[which][i]);
+	}
+	for (i = 0; i < noutputs; i++)
+	{
+		if (lsm_version_add(v, c->level + 1, outputs[i]) != 0)
+		{
+			lsm_version_unref(v);
+			snprintf(errbuf, errbuflen, "Memory allocation failed for LSM version");
+			return -1;
+		}
+	}
+	if (lsm_manifest_write(lsm, v, errbuf, errbuflen) != 0)
+	{
+		lsm_version_unref(v);
+		return -1;
+	}
+	lsm_install(lsm, v);
+	return 0;
+}
+
+static int
+lsm_compact(lsm_t *lsm, lsm_compaction_t *c, char *errbuf, size_t errbuflen)
+{
+	lsm_merge_t merge;
+	lsm_build_t build;
+	uint64_t	read_bytes = 0;
+	int			which;
+	int			i;
+	int			ret;
+
+	/* Nothing to merge with: move the file down as it is */
+	if (c->ninputs[0] == 1 && c->ninputs[1] == 0)
+	{
+		pthread_mutex_lock(&lsm->mutex);
+		ret = lsm_compaction_install(lsm, c, c->inputs[0], 1, errbuf, errbuflen);
+		if (ret == 0)
+			lsm->stats.compactions++;
+		pthread_cond_broadcast(&lsm->done_cond);
+		pthread_mutex_unlock(&lsm->mutex);
+		return ret;
+	}
+
+	memset(&merge, 0, sizeof(merge));
+	merge.current = -1;
+	merge.children = calloc((size_t) (c->ninputs[0] + 1), sizeof(lsm_child_t));
+	if (merge.children == NULL)
+		return -1;
+	ret = 0;
+	for (i = 0; i < c->ninputs[0]; i++)
+	{
+		ret |= lsm_merge_add(&merge, NULL, &c->inputs[0][i], 1);
+		read_bytes += c->inputs[0][i]->file_size;
+	}
+	if (c->ninputs[1] > 0)
+		ret |= lsm_merge_add(&merge, NULL, c->inputs[1], c->ninputs[1]);
+	for (i = 0; i < c->ninputs[1]; i++)
+		read_bytes += c->inputs[1][i]->file_size;
+	if (ret != 0)
+	{
+		lsm_merge_free(&merge);
+		return -1;
+	}
+
+	memset(&build, 0, sizeof(build));
+	build.lsm = lsm;
+	build.level = c->level + 1;
+	build.base = c->base;
+	build.drop_deletes = true;
+	pthread_mutex_lock(&lsm->mutex);
+	build.smallest_snapshot = lsm_smallest_snapshot(lsm);
+	pthread_mutex_unlock(&lsm->mutex);
+
+	for (lsm_merge_seek(&merge, NULL, 0); merge.current >= 0; lsm_merge_next(&merge))
+	{
+		if (atomic_load(&lsm->stopping) ||
+			lsm_build_add(&build, &merge.children[merge.current].entry, errbuf, errbuflen) != 0)
+		{
+			ret = -1;
+			break;
+		}
+	}
+	lsm_merge_free(&merge);
+	if (ret == 0)
+		ret = lsm_build_cut(&build, errbuf, errbuflen);
+	if (ret != 0)
+	{
+		lsm_build_abort(&build);
+		return -1;
+	}
+
+	pthread_mutex_lock(&lsm->mutex);
+	ret = lsm_compaction_install(lsm, c, build.outputs, build.noutputs, errbuf, errbuflen);
+	if (ret == 0)
+	{
+		for (which = 0; which < 2; which++)
+		{
+			for (i = 0; i < c->ninputs[which]; i++)
+				atomic_store(&c->inputs[which][i]->obsolete, true);
+		}
+		lsm->stats.compactions++;
+		lsm->stats.compaction_read_bytes += read_bytes;
+		lsm->stats.compaction_write_bytes += build.bytes;
+	}
+	pthread_cond_broadcast(&lsm->done_cond);
+	pthread_mutex_unlock(&lsm->mutex);
+	if (ret != 0)
+	{
+		lsm_build_abort(&build);
+		return -1;
+	}
+	for (i = 0; i < build.noutputs; i++)
+		lsm_sst_unref(build.outputs[i]);
+	free(build.outputs);
+	return 0;
+}
+
+static void *
+lsm_worker(void *arg)
+{
+	lsm_t	   *lsm = (lsm_t *) arg;
+	char		errbuf[256];
+
+	pthread_mutex_lock(&lsm->mutex);
+	while (!atomic_load(&lsm->stopping) && lsm->error[0] == '\0')
+	{
+		lsm_compaction_t c;
+		int			ret;
+
+		errbuf[0] = '\0';
+		if (lsm->current->imm != NULL)
+		{
+			pthread_mutex_unlock(&lsm->mutex);
+			ret = lsm_flush(lsm, errbuf, sizeof(errbuf));
+		}
+		else if (lsm_pick_compaction(lsm, &c))
+		{
+			pthread_mutex_unlock(&lsm->mutex);
+			ret = lsm_compact(lsm, &c, errbuf, sizeof(errbuf));
+			lsm_version_unref(c.base);
+			free(c.inputs[0]);
+			free(c.inputs[1]);
+		}
+		else
+		{
+			pthread_cond_wait(&lsm->work_cond, &lsm->mutex);
+			continue;
+		}
+		if (ret != 0 && !atomic_load(&lsm->stopping))
+			lsm_worker_fail(lsm, errbuf);
+		pthread_mutex_lock(&lsm->mutex);
+	}
+	pthread_mutex_unlock(&lsm->mutex);
+	return NULL;
+}
+
+/*
+ * Open and close
+ */
+
+static int
+lsm_number_compare(const void *a, const void *b)
+{
+	uint64_t	x = *(const uint64_t *) a;
+	uint64_t	y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Replay logs from log_number on into a memtable and write it to level 0,
+ * then drop the replayed logs and any SST the manifest does not list.
+ */
+static int
+lsm_recover(lsm_t *lsm, uint64_t log_number, char *errbuf, size_t errbuflen)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	uint64_t   *logs = NULL;
+	size_t		nlogs = 0;
+	lsm_memtable_t *mem;
+	lsm_build_t build;
+	size_t		i;
+	int			ret = 0;
+
+	dir = opendir(lsm->dir);
+	if (dir == NULL)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to list", lsm->dir);
+		return -1;
+	}
+	while ((de = readdir(dir)) != NULL)
+	{
+		char		suffix[8];
+		uint64_t	number;
+		char		path[1100];
+		int			level;
+		int			j;
+		bool		live = false;
+
+		if (sscanf(de->d_name, "%" SCNu64 ".%7s", &number, suffix) != 2)
+			continue;
+		if (number >= lsm->next_file)
+			lsm->next_file = number + 1;
+		if (strcmp(suffix, "log") == 0 && number >= log_number)
+		{
+			uint64_t   *grown = realloc(logs, (nlogs + 1) * sizeof(uint64_t));
+
+			if (grown == NULL)
+			{
+				ret = -1;
+				break;
+			}
+			logs = grown;
+			logs[nlogs++] = number;
+			continue;
+		}
+		for (level = 0; strcmp(suffix, "sst") == 0 && level < LSM_LEVELS; level++)
+		{
+			for (j = 0; j < lsm->current->files[level]; j++)
+				live |= lsm->current->level[level][j]->number == number;
+		}
+		if (!live)
+		{
+			snprintf(path, sizeof(path), "%s/%s", lsm->dir, de->d_name);
+			unlink(path);
+		}
+	}
+	closedir(dir);
+	if (ret != 0)
+	{
+		free(logs);
+		return -1;
+	}
+
+	if (nlogs > 1)
+		qsort(logs, nlogs, sizeof(uint64_t), lsm_number_compare);
+	mem = lsm_memtable_create(lsm, 0, errbuf, errbuflen);
+	if (mem == NULL)
+	{
+		free(logs);
+		return -1;
+	}
+	for (i = 0; i < nlogs && ret == 0; i++)
+		ret = lsm_log_replay(lsm, logs[i], mem, errbuf, errbuflen);
+	if (ret == 0 && !lsm_memtable_empty(mem))
+	{
+		ret = lsm_write_level0(lsm, mem, lsm->current, &build, errbuf, errbuflen);
+		if (ret == 0 && build.noutputs > 0)
+		{
+			ret = lsm_version_add(lsm->current, 0, build.outputs[0]);
+			lsm->stats.flushes++;
+			lsm->stats.flush_bytes += build.bytes;
+			lsm_sst_unref(build.outputs[0]);
+		}
+		if (ret == 0)
+			free(build.outputs);
+	}
+	lsm_memtable_unref(mem);
+
+	/* Writers log past everything replayed; the manifest then retires it */
+	if (ret == 0)
+	{
+		char		path[1100];
+
+		lsm->mem->log_number = lsm->next_file++;
+		lsm_file_path(lsm, lsm->mem->log_number, "log", path, sizeof(path));
+		lsm->mem->log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+		if (lsm->mem->log_fd < 0)
+		{
+			lsm_set_error(errbuf, errbuflen, "Failed to create LSM log", path);
+			ret = -1;
+		}
+	}
+	if (ret == 0)
+		ret = lsm_manifest_write(lsm, lsm->current, errbuf, errbuflen);
+	for (i = 0; i < nlogs && ret == 0; i++)
+	{
+		char		path[1100];
+
+		lsm_file_path(lsm, logs[i], "log", path, sizeof(path));
+		unlink(path);
+	}
+	free(logs);
+	return ret;
+}
+
+lsm_t *
+lsm_open(const char *dir, const lsm_options_t *options, char *errbuf, size_t errbuflen)
+{
+	lsm_t	   *lsm;
+	uint64_t	log_number = 0;
+	int			ret;
+
+	if (dir == NULL || options == NULL || options->memtable_bytes == 0 ||
+		options->sst_bytes == 0 || options->level_base_bytes == 0 || options->level0_files <= 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Invalid parameters for lsm_open");
+		return NULL;
+	}
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+	{
+		lsm_set_error(errbuf, errbuflen, "Failed to create", dir);
+		return NULL;
+	}
+	lsm = calloc(1, sizeof(lsm_t));
+	if (lsm == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Memory allocation failed for LSM engine");
+		return NULL;
+	}
+	snprintf(lsm->dir, sizeof(lsm->dir), "%s", dir);
+	lsm->options = *options;
+	pthread_mutex_init(&lsm->write_mutex, NULL);
+	pthread_mutex_init(&lsm->mutex, NULL);
+	pthread_cond_init(&lsm->work_cond, NULL);
+	pthread_cond_init(&lsm->done_cond, NULL);
+	lsm->snapshots.next = &lsm->snapshots;
+	lsm->snapshots.prev = &lsm->snapshots;
+	atomic_init(&lsm->last_seq, 0);
+	atomic_init(&lsm->stopping, false);
+	atomic_init(&lsm->user_bytes, 0);
+	atomic_init(&lsm->filter_checks, 0);
+	atomic_init(&lsm->filter_negatives, 0);
+	lsm->next_file = 1;
+
+	lsm->current = lsm_version_copy(NULL);
+	ret = lsm->current != NULL ? 0 : -1;
+	if (ret == 0)
+		ret = lsm_manifest_read(lsm, lsm->current, &log_number, errbuf, errbuflen);
+	if (ret == 0)
+	{
+		/* Its log is opened by lsm_recover(), numbered after the replayed ones */
+		lsm->mem = lsm_memtable_create(lsm, 0, errbuf, errbuflen);
+		lsm->current->mem = lsm->mem;
+		ret = lsm->mem != NULL ? lsm_recover(lsm, log_number, errbuf, errbuflen) : -1;
+	}
+	if (ret == 0 && pthread_create(&lsm->worker, NULL, lsm_worker, lsm) != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Failed to start LSM worker thread");
+		ret = -1;
+	}
+	if (ret != 0)
+	{
+		lsm_version_unref(lsm->current);
+		pthread_cond_destroy(&lsm->work_cond);
+		pthread_cond_destroy(&lsm->done_cond);
+		pthread_mutex_destroy(&lsm->mutex);
+		pthread_mutex_destroy(&lsm->write_mutex);
+		free(lsm);
+		return NULL;
+	}
+	lsm->worker_started = true;
+	return lsm;
+}
+
+/*
+ * Stop the worker and release everything.  Unflushed writes stay in the
+ * logs and are replayed by the next lsm_open().
+ */
+void
+lsm_close(lsm_t *lsm)
+{
+	int			level;
+
+	if (lsm == NULL)
+		return;
+	pthread_mutex_lock(&lsm->mutex);
+	atomic_store(&lsm->stopping, true);
+	pthread_cond_broadcast(&lsm->work_cond);
+	pthread_cond_broadcast(&lsm->done_cond);
+	pthread_mutex_unlock(&lsm->mutex);
+	if (lsm->worker_started)
+		pthread_join(lsm->worker, NULL);
+
+	pthread_mutex_lock(&lsm->write_mutex);
+	if (lsm->mem->log_fd >= 0)
+		(void) fdatasync(lsm->mem->log_fd);
+	pthread_mutex_unlock(&lsm->write_mutex);
+
+	lsm_version_unref(lsm->current);
+	for (level = 0; level < LSM_LEVELS; level++)
+		free(lsm->compact_pointer[level]);
+	pthread_cond_destroy(&lsm->work_cond);
+	pthread_cond_destroy(&lsm->done_cond);
+	pthread_mutex_destroy(&lsm->mutex);
+	pthread_mutex_destroy(&lsm->write_mutex);
+	free(lsm);
+}
+
+void
+lsm_get_stats(lsm_t *lsm, lsm_stats_t *stats)
+{
+	int			level;
+
+	memset(stats, 0, sizeof(lsm_stats_t));
+	if (lsm == NULL)
+		return;
+	pthread_mutex_lock(&lsm->mutex);
+	*stats = lsm->stats;
+	stats->memtable_bytes = atomic_load_explicit(&lsm->current->mem->bytes, memory_order_relaxed);
+	if (lsm->current->imm != NULL)
+		stats->memtable_bytes += atomic_load_explicit(&lsm->current->imm->bytes,
+													  memory_order_relaxed);
+	for (level = 0; level < LSM_LEVELS; level++)
+	{
+		stats->level_files[level] = (uint64_t) lsm->current->files[level];
+		stats->level_bytes[level] = lsm_level_bytes(lsm->current, level);
+	}
+	pthread_mutex_unlock(&lsm->mutex);
+	stats->user_bytes = atomic_load_explicit(&lsm->user_bytes, memory_order_relaxed);
+	stats->filter_checks = atomic_load_explicit(&lsm->filter_checks, memory_order_relaxed);
+	stats->filter_negatives = atomic_load_explicit(&lsm->filter_negatives, memory_order_relaxed);
+}
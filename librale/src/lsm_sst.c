@@ -0,0 +1,575 @@
+/*-------------------------------------------------------------------------
+ *
+ * lsm_sst.c
+ *		Sorted table files of the LSM engine.
+ *
+ *		An SST is a run of data blocks, a Bloom filter block, an index
+ *		block and a fixed footer:
+ *
+ *			data	entries: u16 key length, u16 value length,
+ *					u64 (sequence << 8 | type), key, value; a block is
+ *					closed before an entry would take it past
+ *					LSM_BLOCK_SIZE
+ *			filter	LSM_FILTER_BITS bits per distinct user key,
+ *					LSM_FILTER_HASHES probes by double hashing
+ *			index	per block: u16 key length, u32 size, u64 offset,
+ *					last user key
+ *			footer	u64 index offset, index size, filter offset,
+ *					filter size, entry count, magic
+ *
+ *		Integers are in host byte order; the files are not meant to move
+ *		between machines.  Opening an SST reads the index and the filter
+ *		into memory; data blocks are read with pread() and left to the
+ *		kernel page cache.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Local headers */
+#include "hash.h"
+#include "lsm.h"
+
+#define LSM_SST_MAGIC		UINT64_C(0x72616c656c736d31)	/* "ralelsm1" */
+#define LSM_FOOTER_SIZE		48
+#define LSM_INDEX_HEADER	14		/* u16 key length, u32 size, u64 offset */
+
+struct lsm_sst_writer
+{
+	int					fd;
+	char				path[1100];
+	uint64_t			offset;
+	char				block[LSM_BLOCK_SIZE];
+	uint32_t			block_len;
+	char				last_key[MAX_KEY_SIZE];
+	uint16_t			last_key_len;
+	uint64_t			entries;
+	char			   *index;
+	size_t				index_len;
+	size_t				index_cap;
+	uint64_t		   *hashes;		/* Of distinct user keys, for the filter */
+	uint64_t			nhashes;
+	uint64_t			hashes_cap;
+};
+
+int
+lsm_entry_compare(const char *a, size_t a_len, uint64_t a_seq,
+				  const char *b, size_t b_len, uint64_t b_seq)
+{
+	int			c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+	if (c != 0)
+		return c;
+	if (a_len != b_len)
+		return a_len < b_len ? -1 : 1;
+	if (a_seq != b_seq)
+		return a_seq > b_seq ? -1 : 1;
+	return 0;
+}
+
+static int
+lsm_key_compare(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	return lsm_entry_compare(a, a_len, 0, b, b_len, 0);
+}
+
+static bool
+lsm_write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0)
+	{
+		ssize_t		n = write(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t) n;
+	}
+	return true;
+}
+
+static bool
+lsm_pread_full(int fd, void *buf, size_t len, uint64_t offset)
+{
+	char	   *p = buf;
+
+	while (len > 0)
+	{
+		ssize_t		n = pread(fd, p, len, (off_t) offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t) n;
+		offset += (uint64_t) n;
+	}
+	return true;
+}
+
+/* Filter probe i of a key hash, as a bit number */
+static inline uint64_t
+lsm_filter_bit(uint64_t hash, int i, uint64_t bits)
+{
+	uint64_t	delta = (hash >> 33) | (hash << 31);
+
+	return (hash + (uint64_t) i * delta) % bits;
+}
+
+/*
+ * Writer
+ */
+
+lsm_sst_writer_t *
+lsm_sst_create(const char *path, uint64_t expected_entries, char *errbuf, size_t errbuflen)
+{
+	lsm_sst_writer_t *writer = calloc(1, sizeof(lsm_sst_writer_t));
+
+	if (writer == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Memory allocation failed for SST writer");
+		return NULL;
+	}
+	writer->hashes_cap = expected_entries > 0 ? expected_entries : 1024;
+	writer->hashes = malloc(writer->hashes_cap * sizeof(uint64_t));
+	writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (writer->hashes == NULL || writer->fd < 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Failed to create SST %s: %s", path, strerror(errno));
+		if (writer->fd >= 0)
+			close(writer->fd);
+		free(writer->hashes);
+		free(writer);
+		return NULL;
+	}
+	snprintf(writer->path, sizeof(writer->path), "%s", path);
+	return writer;
+}
+
+static bool
+lsm_sst_index_append(lsm_sst_writer_t *writer, uint64_t offset, uint32_t size)
+{
+	size_t		need = LSM_INDEX_HEADER + writer->last_key_len;
+	char	   *p;
+
+	if (writer->index_len + need > writer->index_cap)
+	{
+		size_t		cap = writer->index_cap > 0 ? writer->index_cap * 2 : 4096;
+		char	   *grown;
+
+		while (cap < writer->index_len + need)
+			cap *= 2;
+		grown = realloc(writer->index, cap);
+		if (grown == NULL)
+			return false;
+		writer->index = grown;
+		writer->index_cap = cap;
+	}
+	p = writer->index + writer->index_len;
+	memcpy(p, &writer->last_key_len, sizeof(uint16_t));
+	memcpy(p + 2, &size, sizeof(uint32_t));
+	memcpy(p + 6, &offset, sizeof(uint64_t));
+	memcpy(p + LSM_INDEX_HEADER, writer->last_key, writer->last_key_len);
+	writer->index_len += need;
+	return true;
+}
+
+static bool
+lsm_sst_flush_block(lsm_sst_writer_t *writer)
+{
+	if (writer->block_len == 0)
+		return true;
+	if (!lsm_write_full(writer->fd, writer->block, writer->block_len) ||
+		!lsm_sst_index_append(writer, writer->offset, writer->block_len))
+		return false;
+	writer->offset += writer->block_len;
+	writer->block_len = 0;
+	return true;
+}
+
+/* Entries must arrive in lsm_entry_compare() order */
+int
+lsm_sst_add(lsm_sst_writer_t *writer, const lsm_entry_t *entry)
+{
+	uint32_t	size = LSM_ENTRY_HEADER + (uint32_t) entry->key_len + entry->value_len;
+	uint64_t	seq_type = (entry->seq << 8) | entry->type;
+	char	   *p;
+
+	if (entry->key_len >= MAX_KEY_SIZE || size > LSM_BLOCK_SIZE)
+		return -1;
+
+	/* A new user key: remember its hash for the filter */
+	if (writer->entries == 0 ||
+		lsm_key_compare(entry->key, entry->key_len, writer->last_key, writer->last_key_len) != 0)
+	{
+		if (writer->nhashes == writer->hashes_cap)
+		{
+			uint64_t   *grown = realloc(writer->hashes, writer->hashes_cap * 2 * sizeof(uint64_t));
+
+			if (grown == NULL)
+				return -1;
+			writer->hashes = grown;
+			writer->hashes_cap *= 2;
+		}
+		writer->hashes[writer->nhashes++] = hash_key_seeded(entry->key, entry->key_len,
+															LSM_HASH_SEED);
+	}
+
+	if (writer->block_len + size > LSM_BLOCK_SIZE && !lsm_sst_flush_block(writer))
+		return -1;
+
+	p = writer->block + writer->block_len;
+	memcpy(p, &entry->key_len, sizeof(uint16_t));
+	memcpy(p + 2, &entry->value_len, sizeof(uint16_t));
+	memcpy(p + 4, &seq_type, sizeof(uint64_t));
+	memcpy(p + LSM_ENTRY_HEADER, entry->key, entry->key_len);
+	memcpy(p + LSM_ENTRY_HEADER + entry->key_len, entry->value, entry->value_len);
+	writer->block_len += size;
+
+	memcpy(writer->last_key, entry->key, entry->key_len);
+	writer->last_key_len = entry->key_len;
+	writer->entries++;
+	return 0;
+}
+
+uint64_t
+lsm_sst_writer_bytes(const lsm_sst_writer_t *writer)
+{
+	return writer->offset + writer->block_len;
+}
+
+uint64_t
+lsm_sst_writer_entries(const lsm_sst_writer_t *writer)
+{
+	return writer->entries;
+}
+
+static void
+lsm_sst_writer_free(lsm_sst_writer_t *writer)
+{
+	free(writer->index);
+	free(writer->hashes);
+	free(writer);
+}
+
+/* Write filter, index and footer, sync and close */
+int
+lsm_sst_finish(lsm_sst_writer_t *writer, char *errbuf, size_t errbuflen)
+{
+	uint64_t	footer[LSM_FOOTER_SIZE / sizeof(uint64_t)];
+	uint64_t	bits = writer->nhashes * LSM_FILTER_BITS;
+	uint8_t    *filter;
+	uint64_t	i;
+	int			j;
+	bool		ok;
+
+	/* Whole bytes, so the reader's bit count matches */
+	bits = bits < 64 ? 64 : (bits + 7) & ~(uint64_t) 7;
+	filter = calloc(bits / 8, 1);
+	ok = filter != NULL && lsm_sst_flush_block(writer);
+	if (ok)
+	{
+		for (i = 0; i < writer->nhashes; i++)
+		{
+			for (j = 0; j < LSM_FILTER_HASHES; j++)
+			{
+				uint64_t	bit = lsm_filter_bit(writer->hashes[i], j, bits);
+
+				filter[bit / 8] |= (uint8_t) (1u << (bit % 8));
+			}
+		}
+
+		footer[0] = writer->offset + bits / 8;	/* Index offset */
+		footer[1] = writer->index_len;
+		footer[2] = writer->offset;				/* Filter offset */
+		footer[3] = bits / 8;
+		footer[4] = writer->entries;
+		footer[5] = LSM_SST_MAGIC;
+		ok = lsm_write_full(writer->fd, filter, bits / 8) &&
+			lsm_write_full(writer->fd, writer->index, writer->index_len) &&
+			lsm_write_full(writer->fd, footer, sizeof(footer)) &&
+			fdatasync(writer->fd) == 0;
+	}
+	free(filter);
+	if (close(writer->fd) != 0)
+		ok = false;
+	if (!ok)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Failed to write SST %s: %s", writer->path, strerror(errno));
+		unlink(writer->path);
+	}
+	lsm_sst_writer_free(writer);
+	return ok ? 0 : -1;
+}
+
+void
+lsm_sst_abort(lsm_sst_writer_t *writer)
+{
+	if (writer == NULL)
+		return;
+	close(writer->fd);
+	unlink(writer->path);
+	lsm_sst_writer_free(writer);
+}
+
+/*
+ * Reader
+ */
+
+static void
+lsm_sst_free(lsm_sst_t *sst)
+{
+	uint32_t	i;
+
+	if (sst->fd >= 0)
+		close(sst->fd);
+	if (sst->block_last != NULL)
+	{
+		for (i = 0; i < sst->blocks; i++)
+			free(sst->block_last[i]);
+	}
+	free(sst->block_last);
+	free(sst->block_offset);
+	free(sst->block_size);
+	free(sst->filter);
+	free(sst->smallest);
+	free(sst);
+}
+
+/* Decode the entry at pos of a block; false if it overruns the block */
+static bool
+lsm_entry_decode(const char *block, uint32_t size, uint32_t pos, lsm_entry_t *entry)
+{
+	uint64_t	seq_type;
+
+	if (pos + LSM_ENTRY_HEADER > size)
+		return false;
+	memcpy(&entry->key_len, block + pos, sizeof(uint16_t));
+	memcpy(&entry->value_len, block + pos + 2, sizeof(uint16_t));
+	memcpy(&seq_type, block + pos + 4, sizeof(uint64_t));
+	if (pos + LSM_ENTRY_HEADER + (uint32_t) entry->key_len + entry->value_len > size)
+		return false;
+	entry->key = block + pos + LSM_ENTRY_HEADER;
+	entry->value = entry->key + entry->key_len;
+	entry->seq = seq_type >> 8;
+	entry->type = (uint8_t) (seq_type & 0xFF);
+	return true;
+}
+
+lsm_sst_t *
+lsm_sst_open(const char *path, uint64_t number, char *errbuf, size_t errbuflen)
+{
+	uint64_t	footer[LSM_FOOTER_SIZE / sizeof(uint64_t)];
+	struct stat st;
+	lsm_sst_t  *sst;
+	char	   *index = NULL;
+	char		first[LSM_ENTRY_HEADER + MAX_KEY_SIZE];
+	lsm_entry_t entry;
+	uint32_t	first_len;
+	size_t		pos;
+	uint32_t	b;
+
+	sst = calloc(1, sizeof(lsm_sst_t));
+	if (sst == NULL)
+		goto fail;
+	sst->fd = open(path, O_RDONLY);
+	if (sst->fd < 0 || fstat(sst->fd, &st) != 0 || st.st_size < LSM_FOOTER_SIZE)
+		goto fail;
+	sst->file_size = (uint64_t) st.st_size;
+	if (!lsm_pread_full(sst->fd, footer, sizeof(footer), sst->file_size - LSM_FOOTER_SIZE) ||
+		footer[5] != LSM_SST_MAGIC ||
+		footer[3] == 0 || footer[0] + footer[1] > sst->file_size ||
+		footer[2] + footer[3] > footer[0])
+		goto fail;
+
+	snprintf(sst->path, sizeof(sst->path), "%s", path);
+	sst->number = number;
+	sst->entries = footer[4];
+	sst->filter_bits = footer[3] * 8;
+	sst->filter = malloc(footer[3]);
+	index = malloc(footer[1] + 1);
+	if (sst->filter == NULL || index == NULL ||
+		!lsm_pread_full(sst->fd, sst->filter, footer[3], footer[2]) ||
+		!lsm_pread_full(sst->fd, index, footer[1], footer[0]))
+		goto fail;
+
+	/* Count the index entries, then decode them */
+	for (pos = 0; pos + LSM_INDEX_HEADER <= footer[1]; sst->blocks++)
+	{
+		uint16_t	key_len;
+
+		memcpy(&key_len, index + pos, sizeof(uint16_t));
+		pos += LSM_INDEX_HEADER + key_len;
+	}
+	if (pos != footer[1] || sst->blocks == 0)
+		goto fail;
+	sst->block_offset = malloc(sst->blocks * sizeof(uint64_t));
+	sst->block_size = malloc(sst->blocks * sizeof(uint32_t));
+	sst->block_last = calloc(sst->blocks, sizeof(char *));
+	if (sst->block_offset == NULL || sst->block_size == NULL || sst->block_last == NULL)
+		goto fail;
+	for (pos = 0, b = 0; b < sst->blocks; b++)
+	{
+		uint16_t	key_len;
+
+		memcpy(&key_len, index + pos, sizeof(uint16_t));
+		memcpy(&sst->block_size[b], index + pos + 2, sizeof(uint32_t));
+		memcpy(&sst->block_offset[b], index + pos + 6, sizeof(uint64_t));
+		if (sst->block_size[b] > LSM_BLOCK_SIZE)
+			goto fail;
+		sst->block_last[b] = malloc((size_t) key_len + 1);
+		if (sst->block_last[b] == NULL)
+			goto fail;
+		memcpy(sst->block_last[b], index + pos + LSM_INDEX_HEADER, key_len);
+		sst->block_last[b][key_len] = '\0';
+		pos += LSM_INDEX_HEADER + key_len;
+	}
+	free(index);
+	index = NULL;
+	sst->largest = sst->block_last[sst->blocks - 1];
+
+	/* Smallest key: the first entry of the first block (value not needed) */
+	first_len = sst->block_size[0] < sizeof(first) ? sst->block_size[0] : (uint32_t) sizeof(first);
+	if (first_len < LSM_ENTRY_HEADER ||
+		!lsm_pread_full(sst->fd, first, first_len, sst->block_offset[0]))
+		goto fail;
+	memcpy(&entry.key_len, first, sizeof(uint16_t));
+	if (LSM_ENTRY_HEADER + (uint32_t) entry.key_len > first_len)
+		goto fail;
+	sst->smallest = malloc((size_t) entry.key_len + 1);
+	if (sst->smallest == NULL)
+		goto fail;
+	memcpy(sst->smallest, first + LSM_ENTRY_HEADER, entry.key_len);
+	sst->smallest[entry.key_len] = '\0';
+
+	atomic_init(&sst->refs, 1);
+	atomic_init(&sst->obsolete, false);
+	return sst;
+
+fail:
+	if (errbuf != NULL && errbuflen > 0)
+		snprintf(errbuf, errbuflen, "Failed to open SST %s", path);
+	free(index);
+	if (sst != NULL)
+		lsm_sst_free(sst);
+	return NULL;
+}
+
+void
+lsm_sst_ref(lsm_sst_t *sst)
+{
+	atomic_fetch_add_explicit(&sst->refs, 1, memory_order_relaxed);
+}
+
+/* Drop a reference; the last one closes the file, and deletes it if obsolete */
+void
+lsm_sst_unref(lsm_sst_t *sst)
+{
+	if (sst == NULL || atomic_fetch_sub_explicit(&sst->refs, 1, memory_order_acq_rel) != 1)
+		return;
+	if (atomic_load_explicit(&sst->obsolete, memory_order_relaxed))
+		unlink(sst->path);
+	lsm_sst_free(sst);
+}
+
+bool
+lsm_sst_may_contain(const lsm_sst_t *sst, uint64_t hash)
+{
+	int			i;
+
+	for (i = 0; i < LSM_FILTER_HASHES; i++)
+	{
+		uint64_t	bit = lsm_filter_bit(hash, i, sst->filter_bits);
+
+		if ((sst->filter[bit / 8] & (1u << (bit % 8))) == 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Iterator
+ */
+
+static void
+lsm_sst_iter_load(lsm_sst_iter_t *iter, uint32_t block)
+{
+	lsm_sst_t  *sst = iter->sst;
+
+	iter->valid = false;
+	if (block >= sst->blocks ||
+		!lsm_pread_full(sst->fd, iter->buf, sst->block_size[block], sst->block_offset[block]))
+		return;
+	iter->block = block;
+	iter->size = sst->block_size[block];
+	iter->pos = 0;
+	iter->valid = lsm_entry_decode(iter->buf, iter->size, 0, &iter->entry);
+}
+
+void
+lsm_sst_iter_init(lsm_sst_iter_t *iter, lsm_sst_t *sst)
+{
+	iter->sst = sst;
+	iter->valid = false;
+}
+
+void
+lsm_sst_iter_first(lsm_sst_iter_t *iter)
+{
+	lsm_sst_iter_load(iter, 0);
+}
+
+void
+lsm_sst_iter_next(lsm_sst_iter_t *iter)
+{
+	if (!iter->valid)
+		return;
+	iter->pos += LSM_ENTRY_HEADER + (uint32_t) iter->entry.key_len + iter->entry.value_len;
+	if (iter->pos < iter->size)
+		iter->valid = lsm_entry_decode(iter->buf, iter->size, iter->pos, &iter->entry);
+	else
+		lsm_sst_iter_load(iter, iter->block + 1);
+}
+
+/* First entry whose user key is not below key, newest version first */
+void
+lsm_sst_iter_seek(lsm_sst_iter_t *iter, const char *key, size_t key_len)
+{
+	lsm_sst_t  *sst = iter->sst;
+	uint32_t	lo = 0;
+	uint32_t	hi = sst->blocks;
+
+	/* First block whose last key is at or past key */
+	while (lo < hi)
+	{
+		uint32_t	mid = lo + (hi - lo) / 2;
+		const char *last = sst->block_last[mid];
+
+		if (lsm_key_compare(last, strlen(last), key, key_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	lsm_sst_iter_load(iter, lo);
+	while (iter->valid &&
+		   lsm_key_compare(iter->entry.key, iter->entry.key_len, key, key_len) < 0)
+		lsm_sst_iter_next(iter);
+}
@@ -0,0 +1,2001 @@
+/*-------------------------------------------------------------------------
+ *
+ * rale_client.c
+ *		Non-blocking client for the RALE key-value store.
+ *
+ *		A future waiting for a route (no leader known, or its member's
+ *		connection down) sits on the client's pending list.  Once written
+ *		to a connection it moves to that connection's in-flight list, whose
+ *		order is the order replies come back in.  Discovery STATUS requests
+ *		and a watch's requests are futures too, owned by the client.
+ *
+ *		Callbacks run from rale_client_process() only.  Submitting from a
+ *		callback just queues the request; it is sent once the events at
+ *		hand are handled, so no connection changes under a reply being
+ *		parsed.  For the same reason unwatching from a callback only marks
+ *		the watch, and the end of rale_client_process() frees it.
+ *
+ *		Deadlines are checked at the head of each list.  A future resent
+ *		after a redirect joins the tail with its original deadline, so it
+ *		may time out a little late, never early.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* memmem(), strdup() */
+#endif
+
+/** System headers */
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+/** Local headers */
+#include "rale_client.h"
+
+#define CLIENT_DEFAULT_TIMEOUT_MS	5000
+#define CLIENT_DEFAULT_REDIRECTS	3
+#define CLIENT_DEFAULT_RECONNECT_MS	200
+#define CLIENT_WATCH_POLL_MS		5000	/* The server holds a WATCH this long */
+#define CLIENT_IDLE_REOPEN_MS		4000	/* Under the server's 5 s keep-alive limit */
+#define CLIENT_READ_SIZE			(16 * 1024)
+#define CLIENT_MAX_EVENTS			64
+
+typedef enum client_op
+{
+	CLIENT_OP_GET = 0,
+	CLIENT_OP_PUT,
+	CLIENT_OP_CAS,
+	CLIENT_OP_LEASE,			/* Grant or revoke */
+	CLIENT_OP_KEEPALIVE,		/* Writes nothing, so safe to resend */
+	CLIENT_OP_STATUS,			/* Leader discovery */
+	CLIENT_OP_WATCH				/* A watch's first GET, then its long polls */
+} client_op_t;
+
+typedef enum conn_state
+{
+	CONN_CLOSED = 0,
+	CONN_CONNECTING,
+	CONN_READY
+} conn_state_t;
+
+/* Growable byte buffer */
+typedef struct client_str
+{
+	char			   *data;
+	size_t				len;
+	size_t				cap;
+} client_str_t;
+
+typedef struct client_watch client_watch_t;
+
+typedef struct client_conn
+{
+	int					fd;
+	int					member;		/* Index into members, -1 if unset */
+	conn_state_t		state;
+	uint32_t			events;		/* As registered with epoll */
+	uint64_t			retry_at_ms;	/* No reconnect before this */
+	uint64_t			active_ms;	/* Last request or reply */
+	client_str_t		out;
+	size_t				out_sent;
+	bool				blocked;	/* The socket took no more; wait for EPOLLOUT */
+	client_str_t		in;
+	rale_future_t	   *sent_head;	/* In flight, in reply order */
+	rale_future_t	   *sent_tail;
+	client_watch_t	   *watch;		/* Owner of a watch's connection */
+} client_conn_t;
+
+typedef struct client_member
+{
+	char				host[256];
+	uint16_t			port;
+	struct sockaddr_storage addr;
+	socklen_t			addr_len;
+	int32_t				node_id;	/* From STATUS, -1 until known */
+	client_conn_t		conn;
+} client_member_t;
+
+struct client_watch
+{
+	client_watch_t	   *next;
+	int					id;
+	char			   *key;
+	char			   *seen;		/* Value last reported, NULL if absent */
+	bool				baseline;	/* seen has been read */
+	bool				removed;	/* Unwatched from a callback */
+	uint64_t			retry_at_ms;	/* After a refused request */
+	rale_watch_cb		cb;
+	void			   *arg;
+	client_conn_t		conn;
+};
+
+struct rale_future
+{
+	rale_future_t	   *next;
+	client_op_t			op;
+	rale_client_status_t status;
+	client_str_t		body;		/* JSON command */
+	char			   *value;
+	int					member;		/* STATUS: the member asked */
+	int					redirects;
+	uint64_t			revision;	/* From the reply, 0 if none */
+	bool				to_leader;	/* A lagging member could not serve it */
+	uint64_t			deadline_ms;
+	bool				released;	/* Free on completion */
+	client_watch_t	   *watch;
+	rale_client_cb		cb;
+	void			   *arg;
+};
+
+struct rale_client
+{
+	client_member_t		members[RALE_CLIENT_MAX_MEMBERS];
+	int					member_count;
+	rale_client_options_t options;
+	int					epoll_fd;
+	int					timer_fd;
+	uint64_t			timer_at_ms;	/* Armed expiry, 0 if disarmed */
+	rale_future_t	   *pending_head;
+	rale_future_t	   *pending_tail;
+	int					leader;		/* Member index, -1 if unknown */
+	long				leader_term;	/* Term it was learned in, -1 if unknown */
+	int					statuses_out;	/* Discovery replies outstanding */
+	uint64_t			discover_at_ms;	/* No new discovery before this */
+	int					next_read;	/* Round robin for read_any */
+	uint64_t			revision;	/* Newest revision this session has seen */
+	client_watch_t	   *watches;
+	int					next_watch_id;
+	bool				processing;
+	bool				destroying;
+	uint64_t			completed;
+};
+
+static void client_conn_fail(rale_client_t *client, client_conn_t *conn);
+static void client_dispatch(rale_client_t *client);
+static void client_arm_timer(rale_client_t *client);
+
+static uint64_t
+client_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+/*-------------------------------------------------------------------------
+ * Buffers and JSON
+ *-------------------------------------------------------------------------
+ */
+
+/* Make room for more bytes plus a terminator */
+static bool
+client_str_reserve(client_str_t *str, size_t more)
+{
+	size_t		cap = str->cap > 0 ? str->cap : 256;
+	char	   *grown;
+
+	if (str->len + more + 1 <= str->cap)
+		return true;
+	while (cap < str->len + more + 1)
+		cap *= 2;
+	grown = realloc(str->data, cap);
+	if (grown == NULL)
+		return false;
+	str->data = grown;
+	str->cap = cap;
+	return true;
+}
+
+/* Append text; the caller has reserved room */
+static void
+client_str_raw(client_str_t *str, const char *text)
+{
+	size_t		len = strlen(text);
+
+	memcpy(str->data + str->len, text, len + 1);
+	str->len += len;
+}
+
+/* Append text as a quoted JSON string, or null; needs 6 * strlen + 3 bytes */
+static void
+client_str_json(client_str_t *str, const char *text)
+{
+	const unsigned char *p;
+	char	   *out;
+
+	if (text == NULL)
+	{
+		client_str_raw(str, "null");
+		return;
+	}
+	out = str->data + str->len;
+	*out++ = '"';
+	for (p = (const unsigned char *) text; *p != '\0'; p++)
+	{
+		if (*p == '"' || *p == '\\')
+		{
+			*out++ = '\\';
+			*out++ = (char) *p;
+		}
+		else if (*p < 0x20)
+			out += sprintf(out, "\\u%04x", *p);
+		else
+			*out++ = (char) *p;
+	}
+	*out++ = '"';
+	*out = '\0';
+	str->len = (size_t) (out - str->data);
+}
+
+static void
+client_str_free(client_str_t *str)
+{
+	free(str->data);
+	str->data = NULL;
+	str->len = 0;
+	str->cap = 0;
+}
+
+/*
+ * Build {"command":<command>,"key":<key>[,<name>:<value>]...}.  names and
+ * values come in pairs; a NULL value is written as null.  A non-negative
+ * timeout_ms is appended as "timeout_ms".
+ */
+static bool
+client_command(client_str_t *body, const char *command, const char *key,
+			   const char *const *names, const char *const *values, int fields,
+			   int timeout_ms)
+{
+	size_t		need = 64 + strlen(command) + 6 * strlen(key);
+	int			i;
+
+	for (i = 0; i < fields; i++)
+		need += 8 + strlen(names[i]) + (values[i] != NULL ? 6 * strlen(values[i]) : 4);
+	if (!client_str_reserve(body, need))
+		return false;
+
+	client_str_raw(body, "{\"command\":\"");
+	client_str_raw(body, command);
+	client_str_raw(body, "\",\"key\":");
+	client_str_json(body, key);
+	for (i = 0; i < fields; i++)
+	{
+		client_str_raw(body, ",\"");
+		client_str_raw(body, names[i]);
+		client_str_raw(body, "\":");
+		client_str_json(body, values[i]);
+	}
+	if (timeout_ms >= 0)
+		body->len += (size_t) sprintf(body->data + body->len, ",\"timeout_ms\":%d", timeout_ms);
+	client_str_raw(body, "}");
+	return true;
+}
+
+/* Add "name":value to the object client_command() built */
+static bool
+client_command_number(client_str_t *body, const char *name, uint64_t value)
+{
+	if (!client_str_reserve(body, strlen(name) + 26))
+		return false;
+	body->len--;				/* The closing brace */
+	body->len += (size_t) sprintf(body->data + body->len, ",\"%s\":%llu}", name,
+								  (unsigned long long) value);
+	return true;
+}
+
+/* Build {"command":<command>,<name>:<value>} for the lease commands */
+static bool
+client_lease_command(client_str_t *body, const char *command, const char *name,
+					 uint64_t value)
+{
+	if (!client_str_reserve(body, strlen(command) + strlen(name) + 48))
+		return false;
+	body->len += (size_t) sprintf(body->data + body->len, "{\"command\":\"%s\",\"%s\":%llu}",
+								  command, name, (unsigned long long) value);
+	return true;
+}
+
+/* Start of the value of the first "name" member, or NULL */
+static const char *
+client_json_field(const char *json, const char *name)
+{
+	char		pattern[64];
+	const char *p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+	p = strstr(json, pattern);
+	if (p == NULL)
+		return NULL;
+	p += strlen(pattern);
+	while (*p == ' ')
+		p++;
+	return p;
+}
+
+static bool
+client_json_hex4(const char *p, unsigned int *code)
+{
+	int			i;
+
+	*code = 0;
+	for (i = 0; i < 4; i++)
+	{
+		char		c = p[i];
+
+		*code <<= 4;
+		if (c >= '0' && c <= '9')
+			*code |= (unsigned int) (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			*code |= (unsigned int) (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			*code |= (unsigned int) (c - 'A' + 10);
+		else
+			return false;
+	}
+	return true;
+}
+
+/* Encode code point as UTF-8, returning the bytes written */
+static size_t
+client_utf8(char *out, unsigned int code)
+{
+	if (code < 0x80)
+	{
+		out[0] = (char) code;
+		return 1;
+	}
+	if (code < 0x800)
+	{
+		out[0] = (char) (0xC0 | (code >> 6));
+		out[1] = (char) (0x80 | (code & 0x3F));
+		return 2;
+	}
+	if (code < 0x10000)
+	{
+		out[0] = (char) (0xE0 | (code >> 12));
+		out[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+		out[2] = (char) (0x80 | (code & 0x3F));
+		return 3;
+	}
+	out[0] = (char) (0xF0 | (code >> 18));
+	out[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+	out[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+	out[3] = (char) (0x80 | (code & 0x3F));
+	return 4;
+}
+
+/*
+ * Decode the JSON string opening at p into a new string; NULL if p is not
+ * a well-formed string.  No escape decodes longer than it is written, so
+ * strlen(p) bytes are always enough.
+ */
+static char *
+client_json_string(const char *p)
+{
+	const char *s;
+	char	   *out;
+	char	   *o;
+
+	if (p == NULL || *p != '"')
+		return NULL;
+	out = malloc(strlen(p));
+	if (out == NULL)
+		return NULL;
+	o = out;
+	for (s = p + 1; *s != '"'; s++)
+	{
+		unsigned int code;
+		unsigned int low;
+
+		if (*s == '\0')
+			goto malformed;
+		if (*s != '\\')
+		{
+			*o++ = *s;
+			continue;
+		}
+		s++;
+		switch (*s)
+		{
+			case '"':
+			case '\\':
+			case '/':
+				*o++ = *s;
+				break;
+			case 'b':
+				*o++ = '\b';
+				break;
+			case 'f':
+				*o++ = '\f';
+				break;
+			case 'n':
+				*o++ = '\n';
+				break;
+			case 'r':
+				*o++ = '\r';
+				break;
+			case 't':
+				*o++ = '\t';
+				break;
+			case 'u':
+				if (!client_json_hex4(s + 1, &code))
+					goto malformed;
+				s += 4;
+				/* A high surrogate pairs with the low one escaped next */
+				if (code >= 0xD800 && code < 0xDC00 && s[1] == '\\' && s[2] == 'u' &&
+					client_json_hex4(s + 3, &low) && low >= 0xDC00 && low < 0xE000)
+				{
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					s += 6;
+				}
+				o += client_utf8(o, code);
+				break;
+			default:
+				goto malformed;
+		}
+	}
+	*o = '\0';
+	return out;
+
+malformed:
+	free(out);
+	return NULL;
+}
+
+/*-------------------------------------------------------------------------
+ * Futures
+ *-------------------------------------------------------------------------
+ */
+
+static rale_future_t *
+client_future_new(rale_client_t *client, client_op_t op)
+{
+	rale_future_t *future = calloc(1, sizeof(rale_future_t));
+
+	if (future == NULL)
+		return NULL;
+	future->op = op;
+	future->status = RALE_CLIENT_PENDING;
+	future->member = -1;
+	future->deadline_ms = client_now_ms() + (uint64_t) client->options.request_timeout_ms;
+	return future;
+}
+
+static void
+client_future_free(rale_future_t *future)
+{
+	client_str_free(&future->body);
+	free(future->value);
+	free(future);
+}
+
+static bool
+client_is_internal(const rale_future_t *future)
+{
+	return future->op == CLIENT_OP_STATUS || future->op == CLIENT_OP_WATCH;
+}
+
+/* Discovery is over once every STATUS asked has been answered or lost */
+static void
+client_status_done(rale_client_t *client)
+{
+	if (--client->statuses_out == 0 && client->leader < 0)
+		client->discover_at_ms = client_now_ms() + (uint64_t) client->options.reconnect_ms;
+}
+
+/*
+ * Finish future with status, taking ownership of value.  An internal
+ * future has nobody to report to and is dropped.
+ */
+static void
+client_complete(rale_client_t *client, rale_future_t *future, rale_client_status_t status,
+				char *value)
+{
+	if (client_is_internal(future))
+	{
+		if (future->op == CLIENT_OP_STATUS)
+			client_status_done(client);
+		free(value);
+		client_future_free(future);
+		return;
+	}
+
+	future->status = status;
+	free(future->value);
+	future->value = value;
+	client->completed++;
+	if (future->released)
+	{
+		client_future_free(future);
+		return;
+	}
+	/* The callback may release the future; it is not touched afterwards */
+	if (future->cb != NULL)
+		future->cb(future, future->arg);
+}
+
+static void
+client_enqueue(rale_client_t *client, rale_future_t *future)
+{
+	future->next = NULL;
+	if (client->pending_tail != NULL)
+		client->pending_tail->next = future;
+	else
+		client->pending_head = future;
+	client->pending_tail = future;
+}
+
+/* Put the list head..tail back in front of whatever was queued since */
+static void
+client_requeue_front(rale_client_t *client, rale_future_t *head, rale_future_t *tail)
+{
+	if (head == NULL)
+		return;
+	tail->next = client->pending_head;
+	client->pending_head = head;
+	if (client->pending_tail == NULL)
+		client->pending_tail = tail;
+}
+
+/*-------------------------------------------------------------------------
+ * Connections
+ *-------------------------------------------------------------------------
+ */
+
+static void
+client_conn_init(client_conn_t *conn, int member, client_watch_t *watch)
+{
+	memset(conn, 0, sizeof(client_conn_t));
+	conn->fd = -1;
+	conn->member = member;
+	conn->state = CONN_CLOSED;
+	conn->watch = watch;
+}
+
+static void
+client_conn_update(rale_client_t *client, client_conn_t *conn)
+{
+	struct epoll_event ev;
+	uint32_t	want = EPOLLIN;
+
+	if (conn->state == CONN_CLOSED)
+		return;
+	if (conn->state == CONN_CONNECTING || conn->blocked)
+		want |= EPOLLOUT;
+	if (want == conn->events)
+		return;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = want;
+	ev.data.ptr = conn;
+	if (epoll_ctl(client->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == 0)
+		conn->events = want;
+}
+
+/* Start a non-blocking connect; false (and a retry time) if it failed at once */
+static bool
+client_conn_open(rale_client_t *client, client_conn_t *conn)
+{
+	client_member_t *member = &client->members[conn->member];
+	struct epoll_event ev;
+	int			one = 1;
+	int			fd;
+
+	fd = socket(member->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		goto failed;
+	/* Pipelined requests are small; do not hold them back */
+	(void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, (struct sockaddr *) &member->addr, member->addr_len) != 0 &&
+		errno != EINPROGRESS)
+	{
+		close(fd);
+		goto failed;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.ptr = conn;
+	if (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		close(fd);
+		goto failed;
+	}
+	conn->fd = fd;
+	conn->events = ev.events;
+	conn->state = CONN_CONNECTING;
+	conn->active_ms = client_now_ms();
+	return true;
+
+failed:
+	conn->retry_at_ms = client_now_ms() + (uint64_t) client->options.reconnect_ms;
+	return false;
+}
+
+/*
+ * Whether requests can be queued on conn now, connecting it if it is due.
+ * An idle connection is checked first, and replaced if the server has
+ * closed it or is about to: a write sent on it could not be retried.
+ */
+static bool
+client_conn_usable(rale_client_t *client, client_conn_t *conn, uint64_t now)
+{
+	char		byte;
+
+	if (conn->state == CONN_READY && conn->sent_head == NULL &&
+		(now - conn->active_ms >= CLIENT_IDLE_REOPEN_MS ||
+		 recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+		 (errno != EAGAIN && errno != EWOULDBLOCK)))
+		client_conn_fail(client, conn);
+	if (conn->state != CONN_CLOSED)
+		return true;
+	if (now < conn->retry_at_ms)
+		return false;
+	return client_conn_open(client, conn);
+}
+
+static int
+client_conn_flush(client_conn_t *conn)
+{
+	while (conn->out_sent < conn->out.len)
+	{
+		ssize_t		n = send(conn->fd, conn->out.data + conn->out_sent,
+							 conn->out.len - conn->out_sent, MSG_NOSIGNAL);
+
+		if (n > 0)
+			conn->out_sent += (size_t) n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			conn->blocked = true;
+			return 0;
+		}
+		else
+			return -1;
+	}
+	conn->out.len = 0;
+	conn->out_sent = 0;
+	conn->blocked = false;
+	return 0;
+}
+
+/*
+ * Queue future's request on conn behind those already in flight.  It goes
+ * out at once if nothing else is in flight; otherwise it waits for the
+ * flush at the end of rale_client_process(), or at the start of the next
+ * one, so a burst of requests shares one send().  A reply is due on the
+ * connection meanwhile, and wakes the client.
+ */
+static void
+client_send(rale_client_t *client, client_conn_t *conn, rale_future_t *future)
+{
+	client_member_t *member = &client->members[conn->member];
+
+	/* Drop what has gone out before growing the buffer */
+	if (conn->out_sent > 0)
+	{
+		memmove(conn->out.data, conn->out.data + conn->out_sent, conn->out.len - conn->out_sent);
+		conn->out.len -= conn->out_sent;
+		conn->out_sent = 0;
+	}
+	if (!client_str_reserve(&conn->out, 160 + strlen(member->host) + future->body.len))
+	{
+		client_complete(client, future, RALE_CLIENT_ERROR, strdup("out of memory"));
+		return;
+	}
+	conn->out.len += (size_t) sprintf(conn->out.data + conn->out.len,
+		"POST /api/command HTTP/1.1\r\n"
+		"Host: %s:%u\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: %zu\r\n"
+		"\r\n",
+		member->host, (unsigned) member->port, future->body.len);
+	memcpy(conn->out.data + conn->out.len, future->body.data, future->body.len);
+	conn->out.len += future->body.len;
+
+	future->next = NULL;
+	if (conn->sent_tail != NULL)
+		conn->sent_tail->next = future;
+	else
+		conn->sent_head = future;
+	conn->sent_tail = future;
+	conn->active_ms = client_now_ms();
+
+	if (conn->state == CONN_READY && !conn->blocked &&
+		(conn->sent_head == future || conn->out.len - conn->out_sent >= CLIENT_READ_SIZE) &&
+		client_conn_flush(conn) < 0)
+	{
+		client_conn_fail(client, conn);
+		return;
+	}
+	client_conn_update(client, conn);
+}
+
+static void
+client_conn_flush_queued(rale_client_t *client, client_conn_t *conn)
+{
+	if (conn->state != CONN_READY || conn->blocked || conn->out_sent == conn->out.len)
+		return;
+	if (client_conn_flush(conn) < 0)
+		client_conn_fail(client, conn);
+	else
+		client_conn_update(client, conn);
+}
+
+/* Send what client_send() left queued */
+static void
+client_flush_all(rale_client_t *client)
+{
+	client_watch_t *watch;
+	int			i;
+
+	for (i = 0; i < client->member_count; i++)
+		client_conn_flush_queued(client, &client->members[i].conn);
+	for (watch = client->watches; watch != NULL; watch = watch->next)
+		client_conn_flush_queued(client, &watch->conn);
+}
+
+/*
+ * Close conn and settle what was in flight on it.  Reads are resent, as
+ * is anything queued before the connection was up.  A write that may have
+ * reached the server is not: it completes as unavailable.
+ */
+static void
+client_conn_fail(rale_client_t *client, client_conn_t *conn)
+{
+	rale_future_t *future;
+	rale_future_t *next;
+	uint64_t	now = client_now_ms();
+	bool		was_ready = (conn->state == CONN_READY);
+
+	if (conn->fd >= 0)
+	{
+		(void) epoll_ctl(client->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+		close(conn->fd);
+	}
+	conn->fd = -1;
+	/* Closing with nothing in flight is the server ending an idle connection */
+	conn->retry_at_ms = (was_ready && conn->sent_head == NULL) ? now :
+		now + (uint64_t) client->options.reconnect_ms;
+	conn->state = CONN_CLOSED;
+	conn->events = 0;
+	conn->out.len = 0;
+	conn->out_sent = 0;
+	conn->blocked = false;
+	conn->in.len = 0;
+
+	/* The leader may be gone; find out again before the next write */
+	if (conn->watch == NULL && conn->member == client->leader)
+		client->leader = -1;
+	if (conn->watch != NULL)
+		conn->member = -1;
+
+	future = conn->sent_head;
+	conn->sent_head = NULL;
+	conn->sent_tail = NULL;
+	for (; future != NULL; future = next)
+	{
+		next = future->next;
+		future->next = NULL;
+		if (client_is_internal(future))
+			client_complete(client, future, RALE_CLIENT_UNAVAILABLE, NULL);
+		else if (now >= future->deadline_ms)
+			client_complete(client, future, RALE_CLIENT_TIMEOUT, NULL);
+		else if (!was_ready || future->op == CLIENT_OP_GET ||
+				 future->op == CLIENT_OP_KEEPALIVE)
+			client_enqueue(client, future);
+		else
+			client_complete(client, future, RALE_CLIENT_UNAVAILABLE,
+							strdup("connection lost; the write may have been applied"));
+	}
+}
+
+/*-------------------------------------------------------------------------
+ * Leader discovery
+ *-------------------------------------------------------------------------
+ */
+
+static int
+client_member_by_node(const rale_client_t *client, int32_t node_id)
+{
+	int			i;
+
+	if (node_id < 0)
+		return -1;
+	for (i = 0; i < client->member_count; i++)
+	{
+		if (client->members[i].node_id == node_id)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * The one member at ip, -1 if there is none or several (members on one
+ * host differ only by port, which the hint does not carry).
+ */
+static int
+client_member_by_ip(const rale_client_t *client, const char *ip)
+{
+	char		host[NI_MAXHOST];
+	int			found = -1;
+	int			i;
+
+	for (i = 0; i < client->member_count; i++)
+	{
+		const client_member_t *member = &client->members[i];
+
+		if (strcmp(member->host, ip) != 0 &&
+			(getnameinfo((const struct sockaddr *) &member->addr, member->addr_len,
+						 host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0 ||
+			 strcmp(host, ip) != 0))
+			continue;
+		if (found >= 0)
+			return -1;
+		found = i;
+	}
+	return found;
+}
+
+/* Ask every reachable member for STATUS, unless a round is under way */
+static void
+client_discover(rale_client_t *client)
+{
+	uint64_t	now = client_now_ms();
+	int			i;
+
+	if (client->statuses_out > 0 || now < client->discover_at_ms)
+		return;
+	for (i = 0; i < client->member_count; i++)
+	{
+		client_conn_t *conn = &client->members[i].conn;
+		rale_future_t *future;
+
+		if (!client_conn_usable(client, conn, now))
+			continue;
+		future = client_future_new(client, CLIENT_OP_STATUS);
+		if (future == NULL)
+			break;
+		if (!client_str_reserve(&future->body, 32))
+		{
+			client_future_free(future);
+			break;
+		}
+		client_str_raw(&future->body, "{\"command\":\"STATUS\"}");
+		future->member = i;
+		future->released = true;
+		client->statuses_out++;
+		client_send(client, conn, future);
+	}
+	if (client->statuses_out == 0)
+		client->discover_at_ms = now + (uint64_t) client->options.reconnect_ms;
+}
+
+/*
+ * A member's STATUS names itself and, unless it is the leader, the leader
+ * it follows.  The leader's own word wins; a follower's is taken only
+ * while no leader is known.
+ */
+static void
+client_status_reply(rale_client_t *client, const rale_future_t *future, const char *body)
+{
+	client_member_t *member = &client->members[future->member];
+	const char *field;
+	char	   *role;
+	int			leader;
+
+	field = client_json_field(body, "node_id");
+	if (field == NULL)
+		return;
+	member->node_id = (int32_t) strtol(field, NULL, 10);
+
+	role = client_json_string(client_json_field(body, "role"));
+	if (role != NULL && strcmp(role, "leader") == 0)
+	{
+		client->leader = future->member;
+		field = client_json_field(body, "term");
+		client->leader_term = field != NULL ? strtol(field, NULL, 10) : -1;
+	}
+	else if (client->leader < 0 && (field = client_json_field(body, "leader_id")) != NULL)
+	{
+		leader = client_member_by_node(client, (int32_t) strtol(field, NULL, 10));
+		if (leader >= 0)
+			client->leader = leader;
+	}
+	else if (client->leader == future->member)
+		client->leader = -1;
+	free(role);
+}
+
+/*
+ * A member refused a request with "NOT_LEADER <id> <ip> <term>".  Take the
+ * leader it names, by node id or else by address, unless the hint is from
+ * an older term than the leader we know; otherwise rediscover.  Then send
+ * the request again.
+ */
+static void
+client_redirect(rale_client_t *client, int from, rale_future_t *future, const char *args)
+{
+	char	   *end;
+	char		ip[NI_MAXHOST];
+	int32_t		node_id = (int32_t) strtol(args, &end, 10);
+	long		term = -1;
+	int			leader;
+	size_t		len;
+
+	while (*end == ' ')
+		end++;
+	len = strcspn(end, " ");
+	if (len >= sizeof(ip))
+		len = 0;
+	memcpy(ip, end, len);
+	ip[len] = '\0';
+	if (end[len] == ' ')
+		term = strtol(end + len + 1, NULL, 10);
+
+	leader = client_member_by_node(client, node_id);
+	if (leader < 0 && node_id >= 0 && len > 0 && strcmp(ip, "-") != 0)
+	{
+		leader = client_member_by_ip(client, ip);
+		if (leader >= 0 && client->members[leader].node_id < 0)
+			client->members[leader].node_id = node_id;
+	}
+
+	if (client->leader == from)
+		client->leader = -1;
+	if (leader >= 0 && leader != from && (term < 0 || term >= client->leader_term))
+	{
+		client->leader = leader;
+		client->leader_term = term;
+	}
+	else
+		client->discover_at_ms = 0;
+
+	if (future->redirects++ >= client->options.max_redirects)
+	{
+		client_complete(client, future, RALE_CLIENT_UNAVAILABLE, strdup("NOT_LEADER"));
+		return;
+	}
+	client_enqueue(client, future);
+}
+
+/*-------------------------------------------------------------------------
+ * Watches
+ *-------------------------------------------------------------------------
+ */
+
+/* Send the watch's next request: its first GET, then one long poll after another */
+static void
+client_watch_step(rale_client_t *client, client_watch_t *watch, uint64_t now)
+{
+	const char *name = "value";
+	const char *seen = watch->seen;
+	rale_future_t *future;
+	bool		built;
+
+	if (watch->removed || watch->conn.sent_head != NULL || now < watch->retry_at_ms)
+		return;
+	if (watch->conn.state == CONN_CLOSED)
+	{
+		if (now < watch->conn.retry_at_ms)
+			return;
+		if (watch->conn.member < 0)
+		{
+			watch->conn.member = client->leader >= 0 ? client->leader :
+				client->next_read % client->member_count;
+			client->next_read = watch->conn.member + 1;
+		}
+		if (!client_conn_open(client, &watch->conn))
+		{
+			watch->conn.member = -1;
+			return;
+		}
+	}
+
+	future = client_future_new(client, CLIENT_OP_WATCH);
+	if (future == NULL)
+		return;
+	if (watch->baseline)
+	{
+		future->deadline_ms += CLIENT_WATCH_POLL_MS;
+		built = client_command(&future->body, "WATCH", watch->key, &name, &seen, 1,
+							   CLIENT_WATCH_POLL_MS);
+	}
+	else
+		built = client_command(&future->body, "GET", watch->key, NULL, NULL, 0, -1);
+	if (!built)
+	{
+		client_future_free(future);
+		return;
+	}
+	future->released = true;
+	future->watch = watch;
+	client_send(client, &watch->conn, future);
+}
+
+static void
+client_watch_reply(rale_client_t *client, client_watch_t *watch, const char *result)
+{
+	const char *value = NULL;
+	bool		absent = false;
+	bool		changed;
+
+	if (strncmp(result, "OK: ", 4) == 0)
+		value = result + 4;
+	else if (strcmp(result, "DELETED") == 0 ||
+			 (!watch->baseline && strcmp(result, "ERROR: Key not found") == 0))
+		absent = true;
+	else if (strcmp(result, "TIMEOUT") != 0)
+	{
+		/* Refused; try again in a while rather than at once */
+		watch->retry_at_ms = client_now_ms() + (uint64_t) client->options.reconnect_ms;
+		return;
+	}
+	if (value == NULL && !absent)
+		return;
+
+	changed = (value == NULL) != (watch->seen == NULL) ||
+		(value != NULL && strcmp(value, watch->seen) != 0);
+	if (changed)
+	{
+		char	   *copy = value != NULL ? strdup(value) : NULL;
+
+		if (value != NULL && copy == NULL)
+			return;
+		free(watch->seen);
+		watch->seen = copy;
+	}
+	if (!watch->baseline)
+	{
+		watch->baseline = true;
+		return;
+	}
+	if (changed && !watch->removed && watch->cb != NULL)
+		watch->cb(watch->key, value != NULL ? RALE_CLIENT_OK : RALE_CLIENT_NOT_FOUND,
+				  watch->seen, watch->arg);
+}
+
+static void
+client_watch_free(rale_client_t *client, client_watch_t *watch)
+{
+	client_watch_t **link;
+
+	for (link = &client->watches; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == watch)
+		{
+			*link = watch->next;
+			break;
+		}
+	}
+	client_conn_fail(client, &watch->conn);
+	client_str_free(&watch->conn.out);
+	client_str_free(&watch->conn.in);
+	free(watch->key);
+	free(watch->seen);
+	free(watch);
+}
+
+/*-------------------------------------------------------------------------
+ * Replies
+ *-------------------------------------------------------------------------
+ */
+
+/* Settle future with the reply body (NUL-terminated) that conn returned */
+static void
+client_reply(rale_client_t *client, client_conn_t *conn, rale_future_t *future,
+			 const char *body)
+{
+	const char *field;
+	char	   *result;
+	char	   *value;
+
+	if (future->op == CLIENT_OP_STATUS)
+	{
+		client_status_reply(client, future, body);
+		client_complete(client, future, RALE_CLIENT_OK, NULL);
+		return;
+	}
+
+	result = client_json_string(client_json_field(body, "result"));
+	if (result == NULL)
+	{
+		/* Not a command reply at all, e.g. {"error": ...} */
+		client_complete(client, future, RALE_CLIENT_ERROR, strdup(body));
+		return;
+	}
+	if (future->op == CLIENT_OP_WATCH)
+	{
+		client_watch_reply(client, future->watch, result);
+		client_complete(client, future, RALE_CLIENT_OK, result);
+		return;
+	}
+
+	/* Replies to reads and writes say how new the state they saw was */
+	if ((field = client_json_field(body, "revision")) != NULL)
+	{
+		future->revision = strtoull(field, NULL, 10);
+		if (future->revision > client->revision)
+			client->revision = future->revision;
+	}
+
+	if (strncmp(result, "OK: ", 4) == 0)
+	{
+		memmove(result, result + 4, strlen(result + 4) + 1);
+		client_complete(client, future, RALE_CLIENT_OK, result);
+	}
+	else if (strncmp(result, "ERROR: REVISION_TIMEOUT", 23) == 0 && !future->to_leader)
+	{
+		/* The member is behind this session; the leader never is */
+		free(result);
+		future->to_leader = true;
+		client_enqueue(client, future);
+	}
+	else if (strncmp(result, "ERROR: REVISION_TIMEOUT", 23) == 0)
+	{
+		memmove(result, result + 7, strlen(result + 7) + 1);
+		client_complete(client, future, RALE_CLIENT_TIMEOUT, result);
+	}
+	else if (strcmp(result, "ERROR: Key not found") == 0)
+		client_complete(client, future, RALE_CLIENT_NOT_FOUND, result);
+	else if (strcmp(result, "ERROR: CAS_FAILED") == 0)
+		client_complete(client, future, RALE_CLIENT_CAS_FAILED, result);
+	else if (strcmp(result, "ERROR: LEASE_NOT_FOUND") == 0)
+		client_complete(client, future, RALE_CLIENT_NOT_FOUND, result);
+	else if (strncmp(result, "ERROR: NOT_LEADER", 17) == 0)
+	{
+		value = strdup(result + 17);
+		free(result);
+		client_redirect(client, conn->member, future, value != NULL ? value : "-1");
+		free(value);
+	}
+	else
+	{
+		if (strncmp(result, "ERROR: ", 7) == 0)
+			memmove(result, result + 7, strlen(result + 7) + 1);
+		client_complete(client, future, RALE_CLIENT_ERROR, result);
+	}
+}
+
+/*
+ * Parse the head of one response: its Content-Length and whether the
+ * server closes afterwards.  -1 unless it is HTTP with a length.
+ */
+static int
+client_parse_head(const char *head, size_t head_len, size_t *content_length, bool *closing)
+{
+	const char *line = head;
+	const char *end = head + head_len;
+	bool		have_length = false;
+
+	if (head_len < 12 || strncmp(head, "HTTP/1.", 7) != 0)
+		return -1;
+	*closing = false;
+	while (line < end)
+	{
+		const char *eol = memchr(line, '\n', (size_t) (end - line));
+		size_t		len;
+
+		if (eol == NULL)
+			break;
+		len = (size_t) (eol - line);
+		if (len > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+		{
+			*content_length = (size_t) strtoul(line + 15, NULL, 10);
+			have_length = true;
+		}
+		else if (len > 11 && strncasecmp(line, "Connection:", 11) == 0)
+		{
+			const char *v = line + 11;
+
+			while (*v == ' ')
+				v++;
+			*closing = strncasecmp(v, "close", 5) == 0;
+		}
+		line = eol + 1;
+	}
+	return have_length ? 0 : -1;
+}
+
+/* Hand every complete response in conn's buffer to its future; -1 to close */
+static int
+client_conn_parse(rale_client_t *client, client_conn_t *conn)
+{
+	size_t		pos = 0;
+	int			ret = 0;
+
+	while (pos < conn->in.len)
+	{
+		char	   *start = conn->in.data + pos;
+		size_t		avail = conn->in.len - pos;
+		char	   *head_end = memmem(start, avail, "\r\n\r\n", 4);
+		rale_future_t *future;
+		size_t		head_len;
+		size_t		content_length = 0;
+		bool		closing;
+		char		saved;
+
+		if (head_end == NULL)
+			break;
+		head_len = (size_t) (head_end - start) + 4;
+		if (client_parse_head(start, head_len, &content_length, &closing) < 0)
+			return -1;
+		if (avail < head_len + content_length)
+			break;
+		future = conn->sent_head;
+		if (future == NULL)
+			return -1;			/* A reply nobody asked for */
+		conn->active_ms = client_now_ms();
+		conn->sent_head = future->next;
+		if (conn->sent_head == NULL)
+			conn->sent_tail = NULL;
+		future->next = NULL;
+
+		/* The buffer keeps a spare byte for the terminator */
+		saved = start[head_len + content_length];
+		start[head_len + content_length] = '\0';
+		client_reply(client, conn, future, start + head_len);
+		start[head_len + content_length] = saved;
+		pos += head_len + content_length;
+		if (closing)
+		{
+			ret = -1;
+			break;
+		}
+	}
+	memmove(conn->in.data, conn->in.data + pos, conn->in.len - pos);
+	conn->in.len -= pos;
+	return ret;
+}
+
+static int
+client_conn_read(rale_client_t *client, client_conn_t *conn)
+{
+	for (;;)
+	{
+		ssize_t		n;
+
+		if (!client_str_reserve(&conn->in, CLIENT_READ_SIZE))
+			return -1;
+		n = recv(conn->fd, conn->in.data + conn->in.len, conn->in.cap - conn->in.len - 1, 0);
+		if (n > 0)
+		{
+			conn->in.len += (size_t) n;
+			if (client_conn_parse(client, conn) < 0)
+				return -1;
+		}
+		else if (n == 0)
+			return -1;
+		else if (errno == EINTR)
+			continue;
+		else
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+}
+
+static void
+client_conn_event(rale_client_t *client, client_conn_t *conn, uint32_t events)
+{
+	if (conn->state == CONN_CLOSED)
+		return;					/* Closed earlier in this batch of events */
+	if (conn->state == CONN_CONNECTING)
+	{
+		int			err = 0;
+		socklen_t	len = sizeof(err);
+
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+		{
+			client_conn_fail(client, conn);
+			return;
+		}
+		conn->state = CONN_READY;
+		events |= EPOLLOUT;
+	}
+	if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && client_conn_read(client, conn) < 0)
+	{
+		client_conn_fail(client, conn);
+		return;
+	}
+	if ((events & EPOLLOUT) && client_conn_flush(conn) < 0)
+	{
+		client_conn_fail(client, conn);
+		return;
+	}
+	client_conn_update(client, conn);
+}
+
+/*-------------------------------------------------------------------------
+ * Scheduling
+ *-------------------------------------------------------------------------
+ */
+
+/* Member for future: the leader, or for read_any the next member up */
+static int
+client_route(rale_client_t *client, const rale_future_t *future, uint64_t now)
+{
+	int			i;
+
+	if (future->op == CLIENT_OP_GET && client->options.read_any && !future->to_leader)
+	{
+		for (i = 0; i < client->member_count; i++)
+		{
+			int			m = (client->next_read + i) % client->member_count;
+
+			if (client->members[m].conn.state != CONN_CLOSED ||
+				now >= client->members[m].conn.retry_at_ms)
+			{
+				client->next_read = m + 1;
+				return m;
+			}
+		}
+		return -1;
+	}
+	return client->leader;
+}
+
+/* Send every pending future that has somewhere to go */
+static void
+client_dispatch(rale_client_t *client)
+{
+	rale_future_t *future = client->pending_head;
+	rale_future_t *next;
+	rale_future_t *keep_head = NULL;
+	rale_future_t *keep_tail = NULL;
+	uint64_t	now = client_now_ms();
+	bool		need_leader = false;
+
+	client->pending_head = NULL;
+	client->pending_tail = NULL;
+	for (; future != NULL; future = next)
+	{
+		int			member = client_route(client, future, now);
+
+		next = future->next;
+		future->next = NULL;
+		if (member >= 0 && client_conn_usable(client, &client->members[member].conn, now))
+		{
+			client_send(client, &client->members[member].conn, future);
+			continue;
+		}
+		if (member < 0 || member == client->leader)
+			need_leader = true;
+		if (keep_tail != NULL)
+			keep_tail->next = future;
+		else
+			keep_head = future;
+		keep_tail = future;
+	}
+	client_requeue_front(client, keep_head, keep_tail);
+	if (need_leader)
+		client_discover(client);
+}
+
+/* Time out what has waited too long: pending futures and stuck connections */
+static void
+client_expire(rale_client_t *client)
+{
+	rale_future_t *future = client->pending_head;
+	rale_future_t *next;
+	rale_future_t *keep_head = NULL;
+	rale_future_t *keep_tail = NULL;
+	rale_future_t *expired = NULL;
+	client_watch_t *watch;
+	uint64_t	now = client_now_ms();
+	int			i;
+
+	client->pending_head = NULL;
+	client->pending_tail = NULL;
+	for (; future != NULL; future = next)
+	{
+		next = future->next;
+		if (now >= future->deadline_ms)
+		{
+			future->next = expired;
+			expired = future;
+			continue;
+		}
+		future->next = NULL;
+		if (keep_tail != NULL)
+			keep_tail->next = future;
+		else
+			keep_head = future;
+		keep_tail = future;
+	}
+	client_requeue_front(client, keep_head, keep_tail);
+	for (; expired != NULL; expired = next)
+	{
+		next = expired->next;
+		expired->next = NULL;
+		client_complete(client, expired, RALE_CLIENT_TIMEOUT, NULL);
+	}
+
+	for (i = 0; i < client->member_count; i++)
+	{
+		client_conn_t *conn = &client->members[i].conn;
+
+		if (conn->sent_head != NULL && now >= conn->sent_head->deadline_ms)
+			client_conn_fail(client, conn);
+	}
+	for (watch = client->watches; watch != NULL; watch = watch->next)
+	{
+		if (watch->conn.sent_head != NULL && now >= watch->conn.sent_head->deadline_ms)
+			client_conn_fail(client, &watch->conn);
+	}
+}
+
+/* Whatever was due by now has just been handled; only later times count */
+static void
+client_earliest(uint64_t *earliest, uint64_t now, uint64_t at)
+{
+	if (at > now && at < *earliest)
+		*earliest = at;
+}
+
+/* Arm the timer for the next deadline, retry or rediscovery */
+static void
+client_arm_timer(rale_client_t *client)
+{
+	struct itimerspec its;
+	rale_future_t *future;
+	client_watch_t *watch;
+	uint64_t	earliest = UINT64_MAX;
+	uint64_t	now = client_now_ms();
+	int			i;
+
+	for (future = client->pending_head; future != NULL; future = future->next)
+		client_earliest(&earliest, now, future->deadline_ms);
+	if (client->pending_head != NULL)
+	{
+		if (client->leader < 0 && client->statuses_out == 0)
+			client_earliest(&earliest, now, client->discover_at_ms);
+		for (i = 0; i < client->member_count; i++)
+		{
+			if (client->members[i].conn.state == CONN_CLOSED)
+				client_earliest(&earliest, now, client->members[i].conn.retry_at_ms);
+		}
+	}
+	for (i = 0; i < client->member_count; i++)
+	{
+		if (client->members[i].conn.sent_head != NULL)
+			client_earliest(&earliest, now, client->members[i].conn.sent_head->deadline_ms);
+	}
+	for (watch = client->watches; watch != NULL; watch = watch->next)
+	{
+		if (watch->conn.sent_head != NULL)
+			client_earliest(&earliest, now, watch->conn.sent_head->deadline_ms);
+		else if (watch->conn.state == CONN_CLOSED && watch->conn.retry_at_ms > watch->retry_at_ms)
+			client_earliest(&earliest, now, watch->conn.retry_at_ms);
+		else
+			client_earliest(&earliest, now, watch->retry_at_ms);
+	}
+
+	/*
+	 * A timer already set to go off no later can stay, and one with nothing
+	 * left to wait for goes off once for nothing; either way the next call
+	 * arms it again.  That saves a system call per request, whose deadline
+	 * is nearly always later than its predecessor's.
+	 */
+	if (earliest == UINT64_MAX ||
+		(client->timer_at_ms > now && client->timer_at_ms <= earliest))
+		return;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = (time_t) (earliest / 1000);
+	its.it_value.tv_nsec = (long) (earliest % 1000) * 1000000L;
+	if (timerfd_settime(client->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+		client->timer_at_ms = earliest;
+}
+
+/*-------------------------------------------------------------------------
+ * Public interface
+ *-------------------------------------------------------------------------
+ */
+
+/* Split "host:port" or "[v6]:port" and resolve it */
+static int
+client_member_init(client_member_t *member, const char *spec, char *errbuf, size_t errbuflen)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	const char *host = spec;
+	const char *colon;
+	size_t		host_len;
+	char		port[8];
+	int			ret;
+
+	if (*spec == '[')
+	{
+		host = spec + 1;
+		colon = strchr(host, ']');
+		if (colon == NULL)
+		{
+			snprintf(errbuf, errbuflen, "member \"%s\": missing ']'", spec);
+			return -1;
+		}
+		host_len = (size_t) (colon - host);
+		colon = (colon[1] == ':') ? colon + 1 : NULL;
+	}
+	else
+	{
+		colon = strrchr(spec, ':');
+		host_len = colon != NULL ? (size_t) (colon - spec) : strlen(spec);
+	}
+	if (host_len == 0 || host_len >= sizeof(member->host))
+	{
+		snprintf(errbuf, errbuflen, "member \"%s\": bad host", spec);
+		return -1;
+	}
+	memcpy(member->host, host, host_len);
+	member->host[host_len] = '\0';
+	member->port = RALE_CLIENT_DEFAULT_PORT;
+	if (colon != NULL)
+	{
+		long		value = strtol(colon + 1, NULL, 10);
+
+		if (value <= 0 || value > 65535)
+		{
+			snprintf(errbuf, errbuflen, "member \"%s\": bad port", spec);
+			return -1;
+		}
+		member->port = (uint16_t) value;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV;
+	snprintf(port, sizeof(port), "%u", (unsigned) member->port);
+	ret = getaddrinfo(member->host, port, &hints, &res);
+	if (ret != 0 || res == NULL)
+	{
+		snprintf(errbuf, errbuflen, "member \"%s\": %s", spec, gai_strerror(ret));
+		return -1;
+	}
+	memcpy(&member->addr, res->ai_addr, res->ai_addrlen);
+	member->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+	member->node_id = -1;
+	return 0;
+}
+
+rale_client_t *
+rale_client_create(const char *const *members, int count, const rale_client_options_t *options,
+				   char *errbuf, size_t errbuflen)
+{
+	rale_client_t *client;
+	struct epoll_event ev;
+	char		scratch[256];
+	int			i;
+
+	if (errbuf == NULL || errbuflen == 0)
+	{
+		errbuf = scratch;
+		errbuflen = sizeof(scratch);
+	}
+	if (members == NULL || count <= 0 || count > RALE_CLIENT_MAX_MEMBERS)
+	{
+		snprintf(errbuf, errbuflen, "between 1 and %d members are needed", RALE_CLIENT_MAX_MEMBERS);
+		return NULL;
+	}
+	client = calloc(1, sizeof(rale_client_t));
+	if (client == NULL)
+	{
+		snprintf(errbuf, errbuflen, "out of memory");
+		return NULL;
+	}
+	client->epoll_fd = -1;
+	client->timer_fd = -1;
+	client->leader = -1;
+	client->leader_term = -1;
+
+	if (options != NULL)
+		client->options = *options;
+	if (client->options.request_timeout_ms <= 0)
+		client->options.request_timeout_ms = CLIENT_DEFAULT_TIMEOUT_MS;
+	if (client->options.max_redirects <= 0)
+		client->options.max_redirects = CLIENT_DEFAULT_REDIRECTS;
+	if (client->options.reconnect_ms <= 0)
+		client->options.reconnect_ms = CLIENT_DEFAULT_RECONNECT_MS;
+
+	for (i = 0; i < count; i++)
+	{
+		if (members[i] == NULL ||
+			client_member_init(&client->members[i], members[i], errbuf, errbuflen) != 0)
+		{
+			if (members[i] == NULL)
+				snprintf(errbuf, errbuflen, "member %d is NULL", i);
+			free(client);
+			return NULL;
+		}
+		client_conn_init(&client->members[i].conn, i, NULL);
+	}
+	client->member_count = count;
+
+	client->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	client->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;			/* The timer; connections carry their own */
+	if (client->epoll_fd < 0 || client->timer_fd < 0 ||
+		epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, client->timer_fd, &ev) != 0)
+	{
+		snprintf(errbuf, errbuflen, "cannot set up event descriptors: %s", strerror(errno));
+		if (client->epoll_fd >= 0)
+			close(client->epoll_fd);
+		if (client->timer_fd >= 0)
+			close(client->timer_fd);
+		free(client);
+		return NULL;
+	}
+
+	/* Connect and look for the leader before the first request needs it */
+	client_discover(client);
+	client_arm_timer(client);
+	return client;
+}
+
+void
+rale_client_destroy(rale_client_t *client)
+{
+	rale_future_t *future;
+	int			i;
+
+	if (client == NULL)
+		return;
+	client->destroying = true;
+	while (client->watches != NULL)
+		client_watch_free(client, client->watches);
+	while ((future = client->pending_head) != NULL)
+	{
+		client->pending_head = future->next;
+		future->next = NULL;
+		client_complete(client, future, RALE_CLIENT_UNAVAILABLE, NULL);
+	}
+	for (i = 0; i < client->member_count; i++)
+	{
+		client_conn_t *conn = &client->members[i].conn;
+
+		/* Nothing is resent any more: fail everything in flight */
+		while ((future = conn->sent_head) != NULL)
+		{
+			conn->sent_head = future->next;
+			future->next = NULL;
+			client_complete(client, future, RALE_CLIENT_UNAVAILABLE, NULL);
+		}
+		conn->sent_tail = NULL;
+		if (conn->fd >= 0)
+			close(conn->fd);
+		client_str_free(&conn->out);
+		client_str_free(&conn->in);
+	}
+	close(client->timer_fd);
+	close(client->epoll_fd);
+	free(client);
+}
+
+int
+rale_client_fd(const rale_client_t *client)
+{
+	return client != NULL ? client->epoll_fd : -1;
+}
+
+int32_t
+rale_client_leader(const rale_client_t *client)
+{
+	if (client == NULL || client->leader < 0)
+		return -1;
+	return client->members[client->leader].node_id;
+}
+
+int
+rale_client_process(rale_client_t *client, int timeout_ms)
+{
+	struct epoll_event events[CLIENT_MAX_EVENTS];
+	client_watch_t *watch;
+	client_watch_t *next;
+	uint64_t	completed;
+	uint64_t	now;
+	int			n;
+	int			i;
+
+	if (client == NULL || client->processing)
+		return -1;
+	completed = client->completed;
+	client->processing = true;
+	client_flush_all(client);
+	n = epoll_wait(client->epoll_fd, events, CLIENT_MAX_EVENTS, timeout_ms);
+	if (n < 0 && errno != EINTR)
+	{
+		client->processing = false;
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (events[i].data.ptr == NULL)
+		{
+			uint64_t	expirations;
+
+			if (read(client->timer_fd, &expirations, sizeof(expirations)) > 0)
+				client->timer_at_ms = 0;
+			continue;
+		}
+		client_conn_event(client, (client_conn_t *) events[i].data.ptr, events[i].events);
+	}
+	client_expire(client);
+	client_dispatch(client);
+
+	now = client_now_ms();
+	for (watch = client->watches; watch != NULL; watch = next)
+	{
+		next = watch->next;
+		if (watch->removed)
+			client_watch_free(client, watch);
+		else
+			client_watch_step(client, watch, now);
+	}
+	client->processing = false;
+
+	/* Requests queued by callbacks go out now rather than next time */
+	if (client->pending_head != NULL)
+		client_dispatch(client);
+	client_flush_all(client);
+	client_arm_timer(client);
+	return (int) (client->completed - completed);
+}
+
+static rale_future_t *
+client_submit(rale_client_t *client, rale_future_t *future, bool built,
+			  rale_client_cb cb, void *arg)
+{
+	if (!built)
+	{
+		client_future_free(future);
+		return NULL;
+	}
+	future->cb = cb;
+	future->arg = arg;
+	client_enqueue(client, future);
+	if (!client->processing)
+	{
+		client_dispatch(client);
+		client_arm_timer(client);
+	}
+	return future;
+}
+
+rale_future_t *
+rale_client_get(rale_client_t *client, const char *key, rale_client_cb cb, void *arg)
+{
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || key == NULL ||
+		(future = client_future_new(client, CLIENT_OP_GET)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_command(&future->body, "GET", key, NULL, NULL, 0, -1) &&
+						 (client->revision == 0 ||
+						  client_command_number(&future->body, "min_rev", client->revision)),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_put(rale_client_t *client, const char *key, const char *value,
+				rale_client_cb cb, void *arg)
+{
+	const char *name = "value";
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || key == NULL || value == NULL ||
+		(future = client_future_new(client, CLIENT_OP_PUT)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_command(&future->body, "PUT", key, &name, &value, 1, -1),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_cas(rale_client_t *client, const char *key, const char *expected,
+				const char *value, rale_client_cb cb, void *arg)
+{
+	const char *names[2] = {"expected", "value"};
+	const char *values[2] = {expected, value};
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || key == NULL || value == NULL ||
+		(future = client_future_new(client, CLIENT_OP_CAS)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_command(&future->body, "CAS", key, names, values, 2, -1),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_put_leased(rale_client_t *client, const char *key, const char *value,
+					   uint64_t lease, rale_client_cb cb, void *arg)
+{
+	const char *name = "value";
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || key == NULL || value == NULL || lease == 0 ||
+		(future = client_future_new(client, CLIENT_OP_PUT)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_command(&future->body, "PUT", key, &name, &value, 1, -1) &&
+						 client_command_number(&future->body, "lease", lease),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_lease_grant(rale_client_t *client, int ttl, rale_client_cb cb, void *arg)
+{
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || ttl <= 0 ||
+		(future = client_future_new(client, CLIENT_OP_LEASE)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_lease_command(&future->body, "LEASE_GRANT", "ttl", (uint64_t) ttl),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_lease_keepalive(rale_client_t *client, uint64_t lease, rale_client_cb cb, void *arg)
+{
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || lease == 0 ||
+		(future = client_future_new(client, CLIENT_OP_KEEPALIVE)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_lease_command(&future->body, "LEASE_KEEPALIVE", "lease", lease),
+						 cb, arg);
+}
+
+rale_future_t *
+rale_client_lease_revoke(rale_client_t *client, uint64_t lease, rale_client_cb cb, void *arg)
+{
+	rale_future_t *future;
+
+	if (client == NULL || client->destroying || lease == 0 ||
+		(future = client_future_new(client, CLIENT_OP_LEASE)) == NULL)
+		return NULL;
+	return client_submit(client, future,
+						 client_lease_command(&future->body, "LEASE_REVOKE", "lease", lease),
+						 cb, arg);
+}
+
+int
+rale_client_watch(rale_client_t *client, const char *key, rale_watch_cb cb, void *arg)
+{
+	client_watch_t *watch;
+
+	if (client == NULL || client->destroying || key == NULL || cb == NULL)
+		return -1;
+	watch = calloc(1, sizeof(client_watch_t));
+	if (watch == NULL)
+		return -1;
+	watch->key = strdup(key);
+	if (watch->key == NULL)
+	{
+		free(watch);
+		return -1;
+	}
+	watch->id = client->next_watch_id++;
+	watch->cb = cb;
+	watch->arg = arg;
+	client_conn_init(&watch->conn, -1, watch);
+	watch->next = client->watches;
+	client->watches = watch;
+	if (!client->processing)
+	{
+		client_watch_step(client, watch, client_now_ms());
+		client_arm_timer(client);
+	}
+	return watch->id;
+}
+
+void
+rale_client_unwatch(rale_client_t *client, int watch_id)
+{
+	client_watch_t *watch;
+
+	if (client == NULL)
+		return;
+	for (watch = client->watches; watch != NULL; watch = watch->next)
+	{
+		if (watch->id != watch_id)
+			continue;
+		/* Its connection may be the one being read; free it afterwards */
+		if (client->processing)
+			watch->removed = true;
+		else
+			client_watch_free(client, watch);
+		return;
+	}
+}
+
+rale_client_status_t
+rale_future_status(const rale_future_t *future)
+{
+	return future != NULL ? future->status : RALE_CLIENT_ERROR;
+}
+
+const char *
+rale_future_value(const rale_future_t *future)
+{
+	return future != NULL ? future->value : NULL;
+}
+
+uint64_t
+rale_future_revision(const rale_future_t *future)
+{
+	return future != NULL ? future->revision : 0;
+}
+
+uint64_t
+rale_client_revision(const rale_client_t *client)
+{
+	return client != NULL ? client->revision : 0;
+}
+
+void
+rale_client_advance_revision(rale_client_t *client, uint64_t revision)
+{
+	if (client != NULL && revision > client->revision)
+		client->revision = revision;
+}
+
+rale_client_status_t
+rale_future_wait(rale_client_t *client, rale_future_t *future, int timeout_ms)
+{
+	uint64_t	deadline = client_now_ms() + (uint64_t) (timeout_ms > 0 ? timeout_ms : 0);
+
+	if (future == NULL)
+		return RALE_CLIENT_ERROR;
+	while (future->status == RALE_CLIENT_PENDING)
+	{
+		int			wait = -1;
+
+		if (timeout_ms >= 0)
+		{
+			uint64_t	now = client_now_ms();
+
+			if (now >= deadline)
+				break;
+			wait = (int) (deadline - now);
+		}
+		if (rale_client_process(client, wait) < 0)
+			break;
+	}
+	return future->status;
+}
+
+void
+rale_future_release(rale_future_t *future)
+{
+	if (future == NULL)
+		return;
+	/* A pending future is freed by its completion instead */
+	if (future->status == RALE_CLIENT_PENDING)
+	{
+		future->released = true;
+		future->cb = NULL;
+		return;
+	}
+	client_future_free(future);
+}
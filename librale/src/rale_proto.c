@@ -25,8 +25,11 @@
 #include "rale.h"
 #include "udp.h"
 #include "rale_error.h"
+#include "probes.h"
 /* Notify DStore of leader elections for cluster-wide sync */
 #include "dstore.h"
+#include "wal.h"
+#include "watchdog.h"
 
 /* Election/heartbeat timing */
 #define DEFAULT_ELECTION_TIMEOUT 5   /* seconds; used if config not set */
@@ -45,17 +48,28 @@ static int      election_active = 0;
 static time_t   next_heartbeat_at = 0;
 static time_t   next_vote_request_at = 0;
 
+/* The daemon's watchdog, consulted before standing for election */
+static const watchdog_context_t *rale_watchdog = NULL;
+
+/* Reloadable timings come from the published snapshot once there is one */
+static const config_handle_t keep_alive_timeout_handle = CONFIG_HANDLE(dstore.keep_alive_timeout);
+static const config_handle_t heartbeat_interval_handle = CONFIG_HANDLE(dstore.keep_alive_interval);
+
 static int get_keep_alive_timeout(void)
 {
-	if (rale_config.dstore.keep_alive_timeout > 0)
-		return (int) rale_config.dstore.keep_alive_timeout;
+	int timeout = config_get_int(keep_alive_timeout_handle, &rale_config);
+
+	if (timeout > 0)
+		return timeout;
 	return DEFAULT_ELECTION_TIMEOUT;
 }
 
 static int get_heartbeat_interval(void)
 {
-	if (rale_config.dstore.keep_alive_interval > 0)
-		return (int) rale_config.dstore.keep_alive_interval;
+	int interval = config_get_int(heartbeat_interval_handle, &rale_config);
+
+	if (interval > 0)
+		return interval;
 	return DEFAULT_HEARTBEAT_INTERVAL;
 }
 
@@ -72,6 +86,8 @@ static int rale_state_load(rale_state_t *state);
 static void rale_handle_message(const char *msg,
 							   const char *sender_ip,
 							   int sender_port);
+static void rale_handle_batch(const udp_message_t *messages, int count);
+static void rale_start_election(void);
 static void rale_send_message(const char *message,
 							 const char *target_ip,
 							 int target_port);
@@ -85,8 +101,43 @@ static void rale_note_leader(int leader_id)
 	}
 }
 
+void
+rale_set_watchdog(const watchdog_context_t *watchdog)
+{
+	rale_watchdog = watchdog;
+}
+
+/*
+ * With watchdog_mode "required" a node that cannot arm its watchdog must
+ * not lead: a stall would leave it running beside the next leader.  It
+ * then stays a follower and keeps voting for others.
+ */
+static bool rale_may_lead(void)
+{
+	static bool refused = false;
+
+	if (rale_watchdog == NULL || watchdog_can_become_leader(rale_watchdog))
+	{
+		refused = false;
+		return true;
+	}
+	if (!refused)
+		rale_debug_log("Not standing for election: the required watchdog cannot be armed");
+	refused = true;
+	return false;
+}
+
+static void rale_become_follower(int known_leader);
+
 static void rale_become_leader(void)
 {
+	/* The watchdog may have failed since the election started */
+	if (!rale_may_lead())
+	{
+		rale_become_follower(-1);
+		return;
+	}
+	RALE_PROBE2(election__won, current_rale_state.current_term, votes_received);
 	current_rale_state.role = rale_role_leader;
 	current_rale_state.leader_id = rale_config.node.id;
 	election_active = 0;
@@ -104,6 +155,8 @@ static void rale_become_leader(void)
 
 static void rale_become_follower(int known_leader)
 {
+	if (election_active)
+		RALE_PROBE1(election__lost, current_rale_state.current_term);
 	current_rale_state.role = rale_role_follower;
 	if (known_leader >= 0)
 		rale_note_leader(known_leader);
@@ -176,6 +229,7 @@ rale_setup_socket(const uint16_t port)
 					   "Check if port is available and network configuration is correct");
 		return NULL;
 	}
+	conn->on_receive_batch = rale_handle_batch;
 	/* Save for processing and cleanup */
 	rale_udp_conn = conn;
 	rale_debug_log("UDP server setup complete on port %d", port);
@@ -368,6 +422,8 @@ rale_handle_message(const char *msg,
 			const char *sp = strchr(p, ' ');
 			if (sp && *(sp + 1) != '\0') hb_term = atoi(sp + 1);
 
+			RALE_PROBE2(heartbeat__receive, hb_leader, hb_term);
+
 			if (hb_term > current_rale_state.current_term)
 			{
 				current_rale_state.current_term = hb_term;
@@ -406,6 +462,26 @@ rale_handle_message(const char *msg,
 			rale_become_leader();
 		}
 	}
+	else if (strncmp(msg, "TIMEOUT_NOW", 11) == 0)
+	{
+		/* Parse: TIMEOUT_NOW <leader_id> <term>; the leader is leaving */
+		int from_leader = -1, from_term = -1;
+		if (msg[11] == ' ')
+		{
+			from_leader = atoi(msg + 12);
+			const char *sp = strchr(msg + 12, ' ');
+			if (sp && *(sp + 1) != '\0') from_term = atoi(sp + 1);
+		}
+		if (from_term >= current_rale_state.current_term &&
+			current_rale_state.role != rale_role_leader)
+		{
+			rale_debug_log("Leader %d handed off leadership in term %d, starting election",
+						   from_leader, from_term);
+			if (from_term > current_rale_state.current_term)
+				current_rale_state.current_term = from_term;
+			rale_start_election();
+		}
+	}
 	else if (strncmp(msg, "ELECTION_TIMEOUT", 15) == 0)
 	{
 		time_t elapsed_time;
@@ -413,11 +489,12 @@ rale_handle_message(const char *msg,
 		
 		elapsed_time = current_time - current_rale_state.last_heartbeat;
 		
-		if (elapsed_time > (time_t)rale_config.dstore.keep_alive_timeout)
+		if (elapsed_time > (time_t)get_keep_alive_timeout() && rale_may_lead())
 		{
 			rale_debug_log("Starting election due to timeout");
 			current_rale_state.role = rale_role_candidate;
 			current_rale_state.current_term++;
+			RALE_PROBE1(election__start, current_rale_state.current_term);
 			current_rale_state.voted_for = rale_config.node.id;
 			votes_received = 1; /* vote for self */
 			election_active = 1;
@@ -440,37 +517,48 @@ rale_handle_message(const char *msg,
 	}
 }
 
+/*
+ * Handle every datagram read in one wakeup.  Replies are only queued here;
+ * rale_quram_process() sends them all together afterwards.
+ */
+static void
+rale_handle_batch(const udp_message_t *messages, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		rale_handle_message(messages[i].data, messages[i].sender_address,
+							messages[i].sender_port);
+}
+
+/*
+ * Queue a message on the protocol socket, so replies reach our listening
+ * port and one tick's messages leave in a single sendmmsg().
+ */
 static void
 rale_send_message(const char *message,
 				 const char *target_ip,
 				 int target_port)
 {
-	connection_t *conn;
-	int result;
-
 	if (message == NULL || target_ip == NULL)
 		return;
 
-	conn = udp_client_init(target_port, NULL);
-	if (conn == NULL)
+	if (rale_udp_conn == NULL)
 	{
-		rale_set_error(RALE_ERROR_NETWORK_INIT, "rale_send_message",
-					   "Failed to create UDP client",
-					   "UDP client initialization failed",
-					   "Check network configuration and port availability");
+		rale_set_error(RALE_ERROR_NOT_INITIALIZED, "rale_send_message",
+					   "Failed to send message",
+					   "UDP socket not set up",
+					   "Call rale_setup_socket() first");
 		return;
 	}
 
-	result = udp_sendto(conn, message, target_ip, target_port);
-	if (result != 0)
+	if (udp_queue(rale_udp_conn, message, target_ip, target_port) != 0)
 	{
 		rale_set_error(RALE_ERROR_NETWORK_UNREACHABLE, "rale_send_message",
 					   "Failed to send message",
-					   "UDP message transmission failed",
-					   "Check network connectivity and target availability");
+					   "UDP message could not be queued",
+					   "Check the target address and message size");
 	}
-
-	udp_destroy(conn);
 }
 
 librale_status_t
@@ -527,6 +615,51 @@ rale_finit(void)
 	return RALE_SUCCESS;
 }
 
+/*
+ * Called by a leader on its way out, after its last tick: make the log
+ * durable, then send TIMEOUT_NOW to the connected follower that has
+ * acknowledged the most, so it starts an election at once instead of after
+ * the election timeout.
+ */
+int
+rale_hand_off_leadership(void)
+{
+	librale_replica_status_t replicas[MAX_NODES];
+	uint32_t	count;
+	uint32_t	i;
+	int			best = -1;
+	char		message[64];
+
+	if (wal_flush() != 0)
+		rale_debug_log("WAL flush before shutdown failed");
+
+	if (current_rale_state.role != rale_role_leader || rale_udp_conn == NULL)
+		return RALE_SUCCESS;
+
+	count = dstore_get_replication(replicas, MAX_NODES, NULL);
+	for (i = 0; i < count; i++)
+	{
+		if (replicas[i].connected &&
+			(best < 0 || replicas[i].match_index > replicas[best].match_index))
+			best = (int) i;
+	}
+	if (best < 0)
+		return RALE_SUCCESS;
+
+	snprintf(message, sizeof(message), "TIMEOUT_NOW %d %d",
+			 rale_config.node.id, current_rale_state.current_term);
+	for (i = 0; i < cluster.node_count; i++)
+	{
+		if (cluster.nodes[i].id != replicas[best].node_id)
+			continue;
+		rale_debug_log("Handing off leadership to node %d", cluster.nodes[i].id);
+		rale_send_message(message, cluster.nodes[i].ip, cluster.nodes[i].rale_port);
+		if (udp_flush(rale_udp_conn) < 0)
+			return RALE_ERROR_GENERAL;
+	}
+	return RALE_SUCCESS;
+}
+
 static void
 rale_send_heartbeat(void)
 {
@@ -534,6 +667,7 @@ rale_send_heartbeat(void)
 	uint32_t i;
 	snprintf(heartbeat_msg, sizeof(heartbeat_msg), "HEARTBEAT %d %d",
 			 rale_config.node.id, current_rale_state.current_term);
+	RALE_PROBE1(heartbeat__send, current_rale_state.current_term);
 	for (i = 0; i < cluster.node_count; i++)
 	{
 		if (cluster.nodes[i].id == rale_config.node.id)
@@ -567,7 +701,18 @@ rale_request_votes(void)
 static void
 rale_start_election(void)
 {
+	if (!rale_may_lead())
+	{
+		if (current_rale_state.role == rale_role_candidate)
+			rale_become_follower(-1);
+		return;
+	}
+
+	/* A candidate whose deadline passed without a majority lost that term */
+	if (election_active)
+		RALE_PROBE1(election__lost, current_rale_state.current_term);
 	current_rale_state.current_term++;
+	RALE_PROBE1(election__start, current_rale_state.current_term);
 	current_rale_state.voted_for = rale_config.node.id;
 	current_rale_state.role = rale_role_candidate;
 	election_active = 1;
@@ -602,7 +747,8 @@ rale_handle_candidate_duties(void)
 static void
 rale_handle_follower_duties(void)
 {
-	if (time(NULL) > current_rale_state.last_heartbeat + get_keep_alive_timeout())
+	if (time(NULL) > current_rale_state.last_heartbeat + get_keep_alive_timeout() &&
+		rale_may_lead())
 	{
 		current_rale_state.role = rale_role_candidate;
 		rale_start_election();
@@ -628,6 +774,15 @@ rale_quram_process(void)
 	{
 		rale_handle_follower_duties();
 	}
+
+	/* Replies and fan-out queued during this tick */
+	if (rale_udp_conn && udp_flush(rale_udp_conn) < 0)
+	{
+		rale_set_error(RALE_ERROR_NETWORK_UNREACHABLE, "rale_quram_process",
+					   "Failed to send message",
+					   "UDP message transmission failed",
+					   "Check network connectivity and target availability");
+	}
 	
 	return RALE_SUCCESS;
 }
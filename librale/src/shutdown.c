@@ -9,25 +9,44 @@
  */
 
 #include "shutdown.h"
+#include "config.h"
 #include "rale_error.h"
+#include "trace.h"
 #include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #define MODULE "COMM"
 
 extern volatile int system_exit;
-volatile int dstore_shutdown_requested = 0;
-volatile int rale_shutdown_requested = 0;
-volatile int comm_shutdown_requested = 0;
+
+static _Atomic shutdown_state_t shutdown_states[SHUTDOWN_SUBSYSTEMS];
+static _Atomic uint64_t shutdown_requested_at_ms = 0;
+static int shutdown_event_fd = -1;
 
 static pthread_mutex_t shutdown_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t shutdown_cond = PTHREAD_COND_INITIALIZER;
 static int shutdown_system_initialized = 0;
 
+static uint64_t
+shutdown_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
 int
 librale_shutdown_init(void)
 {
+	pthread_condattr_t attr;
+	int			i;
+
 	if (shutdown_system_initialized)
 	{
 		rale_debug_log("Shutdown system already initialized");
@@ -36,23 +55,40 @@ librale_shutdown_init(void)
 
 	/** Initialize shutdown state */
 	system_exit = 0;
-	dstore_shutdown_requested = 0;
-	rale_shutdown_requested = 0;
-	comm_shutdown_requested = 0;
+	for (i = 0; i < SHUTDOWN_SUBSYSTEMS; i++)
+		atomic_store(&shutdown_states[i], SHUTDOWN_STATE_RUNNING);
+	atomic_store(&shutdown_requested_at_ms, 0);
+
+	/** Readable from the request on, so no waiter can miss it */
+	shutdown_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shutdown_event_fd < 0)
+	{
+		rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "shutdown", "Failed to create shutdown eventfd: %s", strerror(errno));
+		return -1;
+	}
 
 	/** Initialize mutex and condition variable */
 	if (pthread_mutex_init(&shutdown_mutex, NULL) != 0)
 	{
 		rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "shutdown", "Failed to initialize shutdown mutex: %s", strerror(errno));
+		close(shutdown_event_fd);
+		shutdown_event_fd = -1;
 		return -1;
 	}
 
-	if (pthread_cond_init(&shutdown_cond, NULL) != 0)
+	/** Completion waits are timed on the monotonic clock */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (pthread_cond_init(&shutdown_cond, &attr) != 0)
 	{
 		rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "shutdown", "Failed to initialize shutdown condition: %s", strerror(errno));
+		pthread_condattr_destroy(&attr);
 		pthread_mutex_destroy(&shutdown_mutex);
+		close(shutdown_event_fd);
+		shutdown_event_fd = -1;
 		return -1;
 	}
+	pthread_condattr_destroy(&attr);
 
 	shutdown_system_initialized = 1;
 	rale_debug_log("Shutdown coordination system initialized");
@@ -62,90 +98,138 @@ librale_shutdown_init(void)
 void
 librale_shutdown_cleanup(void)
 {
+	/** All threads have stopped; retired configuration snapshots can go */
+	config_snapshot_cleanup();
+	trace_cleanup();
+
 	if (!shutdown_system_initialized)
 		return;
 
 	/** Clean up synchronization primitives */
 	pthread_cond_destroy(&shutdown_cond);
 	pthread_mutex_destroy(&shutdown_mutex);
-	
+	close(shutdown_event_fd);
+	shutdown_event_fd = -1;
+
 	shutdown_system_initialized = 0;
 	rale_debug_log("Shutdown coordination system cleaned up");
 }
 
+/**
+ * Ask every subsystem to stop.  Called from signal handlers, so it only
+ * stores flags and writes the eventfd; it neither locks nor logs.
+ */
 void
 librale_request_shutdown(void)
 {
-	if (!shutdown_system_initialized)
+	uint64_t	one = 1;
+	uint64_t	unset = 0;
+	int			saved_errno = errno;
+	int			i;
+
+	system_exit = 1;
+	(void) atomic_compare_exchange_strong(&shutdown_requested_at_ms, &unset, shutdown_now_ms());
+	for (i = 0; i < SHUTDOWN_SUBSYSTEMS; i++)
 	{
-		rale_debug_log("Shutdown system not initialized, using fallback");
-		system_exit = 1;
-		return;
+		shutdown_state_t running = SHUTDOWN_STATE_RUNNING;
+
+		(void) atomic_compare_exchange_strong(&shutdown_states[i], &running,
+											  SHUTDOWN_STATE_REQUESTED);
 	}
 
-	pthread_mutex_lock(&shutdown_mutex);
-	
-	rale_debug_log("Requesting coordinated shutdown of all subsystems");
-	
-	/** Set shutdown flags for all subsystems */
-	system_exit = 1;
-	dstore_shutdown_requested = 1;
-	rale_shutdown_requested = 1;
-	comm_shutdown_requested = 1;
-	
-	/** Broadcast shutdown signal to all waiting threads */
-	pthread_cond_broadcast(&shutdown_cond);
-	
-	pthread_mutex_unlock(&shutdown_mutex);
-	
-	rale_debug_log("Shutdown request broadcasted to all subsystems");
+	/** Wake every select() and poll() that watches the eventfd */
+	if (shutdown_event_fd >= 0)
+		(void) write(shutdown_event_fd, &one, sizeof(one));
+	errno = saved_errno;
 }
 
 int
-librale_is_shutdown_requested(const char *subsystem)
+librale_is_shutdown_requested(shutdown_subsystem_t subsystem)
 {
-	if (!shutdown_system_initialized)
-	{
-		/** Fallback to system_exit if shutdown system not initialized */
-		return system_exit;
-	}
+	if (system_exit)
+		return 1;
+	if ((unsigned) subsystem >= SHUTDOWN_SUBSYSTEMS)
+		return 0;
+	return atomic_load_explicit(&shutdown_states[subsystem], memory_order_acquire) !=
+		SHUTDOWN_STATE_RUNNING;
+}
 
-	if (subsystem == NULL)
-		return system_exit;
-	
-	if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_DSTORE) == 0)
-		return dstore_shutdown_requested;
-	else if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_RALE) == 0)
-		return rale_shutdown_requested;
-	else if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_COMM) == 0)
-		return comm_shutdown_requested;
-	else
-		return system_exit;
+/**
+ * Descriptor that turns readable when shutdown is requested and stays so;
+ * add it to a select() read set.  -1 before librale_shutdown_init().
+ */
+int
+librale_shutdown_fd(void)
+{
+	return shutdown_event_fd;
 }
 
+/**
+ * Sleep up to timeout_ms, returning early (and true) once shutdown is
+ * requested.
+ */
+bool
+librale_shutdown_sleep(int timeout_ms)
+{
+	struct pollfd pfd;
+
+	if (system_exit)
+		return true;
+	pfd.fd = shutdown_event_fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	(void) poll(&pfd, shutdown_event_fd >= 0 ? 1 : 0, timeout_ms);
+	return system_exit != 0;
+}
+
+/**
+ * Milliseconds since the first shutdown request, 0 if there was none.
+ */
+uint64_t
+librale_shutdown_elapsed_ms(void)
+{
+	uint64_t	requested = atomic_load(&shutdown_requested_at_ms);
+
+	return requested != 0 ? shutdown_now_ms() - requested : 0;
+}
+
+/**
+ * Wait until the subsystem calls librale_signal_shutdown_complete(), at
+ * most timeout_ms.  Returns 0 once it has, -1 on timeout.
+ */
 int
-librale_wait_for_shutdown_completion(int timeout_seconds)
+librale_wait_for_shutdown_completion(shutdown_subsystem_t subsystem, int timeout_ms)
 {
-	if (!shutdown_system_initialized)
+	struct timespec ts;
+	int			result = 0;
+
+	if (!shutdown_system_initialized || (unsigned) subsystem >= SHUTDOWN_SUBSYSTEMS)
 	{
 		rale_debug_log("Shutdown system not initialized, cannot wait");
 		return -1;
 	}
 
-	struct timespec ts;
-	clock_gettime(CLOCK_REALTIME, &ts);
-	ts.tv_sec += timeout_seconds;
-	
-	rale_debug_log("Waiting for subsystems to complete shutdown (timeout: %d seconds)", timeout_seconds);
-	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	rale_debug_log("Waiting for subsystem %d to complete shutdown (timeout: %d ms)", (int) subsystem, timeout_ms);
+
 	pthread_mutex_lock(&shutdown_mutex);
-	
-	/** Wait until all subsystems signal completion or timeout */
-	int result = pthread_cond_timedwait(&shutdown_cond, &shutdown_mutex, &ts);
-	
+
+	/** The completion may already have happened; only wait if it has not */
+	while (result == 0 &&
+		   atomic_load(&shutdown_states[subsystem]) != SHUTDOWN_STATE_COMPLETE)
+		result = pthread_cond_timedwait(&shutdown_cond, &shutdown_mutex, &ts);
+
 	if (result == 0)
 	{
-		rale_debug_log("All subsystems completed shutdown successfully");
+		rale_debug_log("Subsystem %d completed shutdown", (int) subsystem);
 	}
 	else if (result == ETIMEDOUT)
 	{
@@ -155,14 +239,14 @@ librale_wait_for_shutdown_completion(int timeout_seconds)
 	{
 		rale_debug_log("Error waiting for shutdown completion: %s", strerror(result));
 	}
-	
+
 	pthread_mutex_unlock(&shutdown_mutex);
-	
+
 	return (result == 0) ? 0 : -1;
 }
 
 void
-librale_signal_shutdown_complete(const char *subsystem)
+librale_signal_shutdown_complete(shutdown_subsystem_t subsystem)
 {
 	if (!shutdown_system_initialized)
 	{
@@ -170,36 +254,20 @@ librale_signal_shutdown_complete(const char *subsystem)
 		return;
 	}
 
-	if (subsystem == NULL)
+	if ((unsigned) subsystem >= SHUTDOWN_SUBSYSTEMS)
 	{
-		rale_set_error(RALE_ERROR_INVALID_PARAMETER, "shutdown", "Cannot signal shutdown completion: subsystem is NULL", "", "");
+		rale_set_error(RALE_ERROR_INVALID_PARAMETER, "shutdown", "Cannot signal shutdown completion: unknown subsystem", "", "");
 		return;
 	}
 
 	pthread_mutex_lock(&shutdown_mutex);
-	
-	rale_debug_log("Subsystem '%s' signaled shutdown completion", subsystem);
-	
-	/** Mark the specific subsystem as completed */
-	if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_DSTORE) == 0)
-		dstore_shutdown_requested = 0;
-	else if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_RALE) == 0)
-		rale_shutdown_requested = 0;
-	else if (strcmp(subsystem, SHUTDOWN_SUBSYSTEM_COMM) == 0)
-		comm_shutdown_requested = 0;
-	else
-	{
-		rale_debug_log("Unknown subsystem '%s'", subsystem);
-		pthread_mutex_unlock(&shutdown_mutex);
-		return;
-	}
-	
-	/** Check if all subsystems are done */
-	if (!dstore_shutdown_requested && !rale_shutdown_requested && !comm_shutdown_requested)
-	{
-		rale_debug_log("All subsystems completed shutdown, signaling main thread");
-		pthread_cond_broadcast(&shutdown_cond);
-	}
-	
+
+	rale_debug_log("Subsystem %d signaled shutdown completion", (int) subsystem);
+
+	/** Complete still reads as requested, so the loop does not restart */
+	atomic_store_explicit(&shutdown_states[subsystem], SHUTDOWN_STATE_COMPLETE,
+						  memory_order_release);
+	pthread_cond_broadcast(&shutdown_cond);
+
 	pthread_mutex_unlock(&shutdown_mutex);
 }
@@ -8,8 +8,27 @@
  *-------------------------------------------------------------------------
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* CPU_SET, pthread_setaffinity_np */
+#endif
 #include "system_detect.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define SYSFS_CPU_DIR   "/sys/devices/system/cpu"
+#define SYSFS_NODE_DIR  "/sys/devices/system/node"
+
+/* MPOL_PREFERRED from <linux/mempolicy.h>, which not every libc ships */
+#define SYSTEM_MPOL_PREFERRED   1
 
 /*-------------------------------------------------------------------------
  * System Information Functions
@@ -116,3 +135,287 @@ get_default_path(const char *path_type)
     else
         return NULL;
 }
+
+/*-------------------------------------------------------------------------
+ * CPU Topology
+ *-------------------------------------------------------------------------*/
+
+static int
+read_sysfs_line(const char *path, char *buf, size_t buflen)
+{
+    FILE    *fp = fopen(path, "r");
+    size_t  len;
+
+    if (fp == NULL)
+        return -1;
+    if (fgets(buf, (int)buflen, fp) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    len = strlen(buf);
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+        buf[--len] = '\0';
+    return 0;
+}
+
+static int
+read_sysfs_int(const char *path, int fallback)
+{
+    char buf[32];
+
+    if (read_sysfs_line(path, buf, sizeof(buf)) != 0)
+        return fallback;
+    return atoi(buf);
+}
+
+static system_cpu_t *
+topology_find_cpu(system_topology_t *topology, int cpu)
+{
+    int i;
+
+    for (i = 0; i < topology->cpu_count; i++) {
+        if (topology->cpus[i].cpu == cpu)
+            return &topology->cpus[i];
+    }
+    return NULL;
+}
+
+int
+system_parse_cpu_list(const char *list, int *cpus, int max_cpus)
+{
+    const char  *p = list;
+    int         count = 0;
+
+    if (list == NULL || cpus == NULL)
+        return -1;
+
+    while (*p != '\0') {
+        char    *end;
+        long    first;
+        long    last;
+        long    cpu;
+
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (*p == '\0')
+            break;
+
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+            p = end;
+        }
+        if (*p != '\0' && *p != ',' && *p != ' ')
+            return -1;
+
+        for (cpu = first; cpu <= last; cpu++) {
+            if (count >= max_cpus || cpu >= SYSTEM_MAX_CPUS)
+                return -1;
+            cpus[count++] = (int)cpu;
+        }
+    }
+    return count;
+}
+
+void
+system_format_cpu_list(const int *cpus, int count, char *out, size_t outlen)
+{
+    size_t  used = 0;
+    int     i = 0;
+
+    if (out == NULL || outlen == 0)
+        return;
+    out[0] = '\0';
+
+    while (i < count && used < outlen) {
+        int first = cpus[i];
+        int last = first;
+        int n;
+
+        while (i + 1 < count && cpus[i + 1] == last + 1)
+            last = cpus[++i];
+        i++;
+
+        if (first == last)
+            n = snprintf(out + used, outlen - used, "%s%d", used ? "," : "", first);
+        else
+            n = snprintf(out + used, outlen - used, "%s%d-%d", used ? "," : "", first, last);
+        if (n < 0)
+            break;
+        used += (size_t)n;
+    }
+}
+
+int
+system_topology_detect(system_topology_t *topology)
+{
+#ifdef __linux__
+    char    online[4096];
+    char    path[256];
+    int     cpus[SYSTEM_MAX_CPUS];
+    int     count;
+    int     i;
+    int     j;
+    DIR     *dir;
+    struct dirent *entry;
+
+    if (topology == NULL)
+        return -1;
+    memset(topology, 0, sizeof(system_topology_t));
+
+    if (read_sysfs_line(SYSFS_CPU_DIR "/online", online, sizeof(online)) != 0)
+        return -1;
+    count = system_parse_cpu_list(online, cpus, SYSTEM_MAX_CPUS);
+    if (count <= 0)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        system_cpu_t *info = &topology->cpus[i];
+
+        info->cpu = cpus[i];
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/core_id", cpus[i]);
+        info->core_id = read_sysfs_int(path, cpus[i]);
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/physical_package_id", cpus[i]);
+        info->package_id = read_sysfs_int(path, 0);
+        info->numa_node = 0;
+    }
+    topology->cpu_count = count;
+
+    /* Each nodeN directory lists its CPUs; no directory means no NUMA */
+    topology->numa_node_count = 1;
+    dir = opendir(SYSFS_NODE_DIR);
+    if (dir != NULL) {
+        int nodes = 0;
+
+        while ((entry = readdir(dir)) != NULL) {
+            char    list[4096];
+            int     node_cpus[SYSTEM_MAX_CPUS];
+            int     node;
+            int     n;
+            char    *end;
+
+            if (strncmp(entry->d_name, "node", 4) != 0)
+                continue;
+            node = (int)strtol(entry->d_name + 4, &end, 10);
+            if (end == entry->d_name + 4 || *end != '\0' || node >= SYSTEM_MAX_NUMA_NODES)
+                continue;
+
+            snprintf(path, sizeof(path), SYSFS_NODE_DIR "/%s/cpulist", entry->d_name);
+            if (read_sysfs_line(path, list, sizeof(list)) != 0)
+                continue;
+            nodes++;
+            n = system_parse_cpu_list(list, node_cpus, SYSTEM_MAX_CPUS);
+            for (j = 0; j < n; j++) {
+                system_cpu_t *info = topology_find_cpu(topology, node_cpus[j]);
+
+                if (info != NULL)
+                    info->numa_node = node;
+            }
+        }
+        closedir(dir);
+        if (nodes > 0)
+            topology->numa_node_count = nodes;
+    }
+
+    /* Count distinct packages and cores; O(n^2) over at most a few hundred CPUs */
+    for (i = 0; i < count; i++) {
+        bool new_package = true;
+        bool new_core = true;
+
+        for (j = 0; j < i; j++) {
+            if (topology->cpus[j].package_id == topology->cpus[i].package_id) {
+                new_package = false;
+                if (topology->cpus[j].core_id == topology->cpus[i].core_id)
+                    new_core = false;
+            }
+        }
+        if (new_package)
+            topology->package_count++;
+        if (new_core)
+            topology->core_count++;
+    }
+    return 0;
+#else
+    if (topology != NULL)
+        memset(topology, 0, sizeof(system_topology_t));
+    return -1;
+#endif
+}
+
+int
+system_topology_numa_node(const system_topology_t *topology, int cpu)
+{
+    int i;
+
+    if (topology == NULL)
+        return -1;
+    for (i = 0; i < topology->cpu_count; i++) {
+        if (topology->cpus[i].cpu == cpu)
+            return topology->cpus[i].numa_node;
+    }
+    return -1;
+}
+
+int
+system_pin_thread(pthread_t thread, const int *cpus, int count)
+{
+#ifdef __linux__
+    cpu_set_t   set;
+    int         i;
+    int         rc;
+
+    if (cpus == NULL || count <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    CPU_ZERO(&set);
+    for (i = 0; i < count; i++) {
+        if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+            errno = EINVAL;
+            return -1;
+        }
+        CPU_SET((size_t) cpus[i], &set);
+    }
+    rc = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &set);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return 0;
+#else
+    (void)thread;
+    (void)cpus;
+    (void)count;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int
+system_prefer_numa_node(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    unsigned long mask;
+
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) {
+        errno = EINVAL;
+        return -1;
+    }
+    mask = 1UL << node;
+    return syscall(SYS_set_mempolicy, SYSTEM_MPOL_PREFERRED, &mask, sizeof(mask) * 8) == 0 ? 0 : -1;
+#else
+    (void)node;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
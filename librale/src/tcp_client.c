@@ -13,14 +13,20 @@
 
 /** System headers */
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 /** Local headers */
 #include "tcp_client.h"
@@ -84,20 +90,22 @@ tcp_client_init(const char *ip_address, int port,
 int
 tcp_client_connect(tcp_client_t *client, const char *ip_address, int port)
 {
+    int sock;
+
     if (!client || !ip_address || port <= 0) {
         return -1;
     }
 
-    // Close existing socket if connected
-    if (client->is_connected && client->sock >= 0) {
+    // Close the existing socket, including one shut down after a failure
+    client->is_connected = 0;
+    if (client->sock >= 0) {
         close(client->sock);
         client->sock = -1;
-        client->is_connected = 0;
     }
 
     // Create new socket
-    client->sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (client->sock < 0) {
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
         return -1;
     }
 
@@ -107,19 +115,18 @@ tcp_client_connect(tcp_client_t *client, const char *ip_address, int port)
     client->server_addr.sin_port = htons(port);
 
     if (inet_pton(AF_INET, ip_address, &client->server_addr.sin_addr) <= 0) {
-        close(client->sock);
-        client->sock = -1;
+        close(sock);
         return -1;
     }
 
     // Attempt connection
-    if (connect(client->sock, (struct sockaddr *)&client->server_addr, sizeof(client->server_addr)) < 0) {
-        close(client->sock);
-        client->sock = -1;
+    if (connect(sock, (struct sockaddr *)&client->server_addr, sizeof(client->server_addr)) < 0) {
+        close(sock);
         return -1;
     }
 
-    // Update client state
+    // Update client state once the socket is usable
+    client->sock = sock;
     client->is_connected = 1;
     
     return 0;
@@ -136,10 +143,17 @@ tcp_client_send(tcp_client_t *client, const char *message)
         return;
     }
 
+    /* Newline-delimited like tcp_server_send(), in one system call */
+    struct iovec iov[2];
     size_t message_len = strlen(message);
-    ssize_t sent = send(client->sock, message, message_len, 0);
+
+    iov[0].iov_base = (void *)message;
+    iov[0].iov_len = message_len;
+    iov[1].iov_base = (void *)"\n";
+    iov[1].iov_len = 1;
+    ssize_t sent = writev(client->sock, iov, 2);
     
-    if (sent < 0 || (size_t)sent != message_len) {
+    if (sent < 0 || (size_t)sent != message_len + 1) {
         // Send failed or partial send
         client->is_connected = 0;
         if (client->on_disconnection) {
@@ -148,6 +162,111 @@ tcp_client_send(tcp_client_t *client, const char *message)
     }
 }
 
+/* Send part of a file range; sendfile() on Linux, pread() and send() elsewhere */
+static ssize_t
+tcp_client_send_range(int sock, int fd, off_t *offset, size_t count)
+{
+    ssize_t sent;
+
+#ifdef __linux__
+    sent = sendfile(sock, fd, offset, count);
+#else
+    char buffer[8192];
+
+    sent = pread(fd, buffer, count < sizeof(buffer) ? count : sizeof(buffer), *offset);
+    if (sent > 0) {
+        sent = send(sock, buffer, (size_t)sent, 0);
+        if (sent > 0) {
+            *offset += sent;
+        }
+    }
+#endif
+    if (sent == 0) {
+        // The file is shorter than the range
+        errno = EIO;
+        sent = -1;
+    }
+    return sent;
+}
+
+static void
+tcp_client_set_cork(int sock, int on)
+{
+#ifdef TCP_CORK
+    (void)setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+#else
+    (void)sock;
+    (void)on;
+#endif
+}
+
+int
+tcp_client_sendfile(tcp_client_t *client, int fd, off_t *offset, size_t count,
+                    const char *trailer)
+{
+    off_t end;
+    ssize_t sent;
+    int flags;
+
+    if (!client || fd < 0 || !offset) {
+        return -1;
+    }
+
+    if (!client->is_connected || client->sock < 0) {
+        return -1;
+    }
+
+    end = *offset + (off_t)count;
+    tcp_client_set_cork(client->sock, 1);
+
+    /* Start only if the socket takes some of the range without waiting */
+    if (count > 0) {
+        flags = fcntl(client->sock, F_GETFL, 0);
+        (void)fcntl(client->sock, F_SETFL, flags | O_NONBLOCK);
+        sent = tcp_client_send_range(client->sock, fd, offset, count);
+        (void)fcntl(client->sock, F_SETFL, flags);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            tcp_client_set_cork(client->sock, 0);
+            return 0;
+        }
+        if (sent < 0) {
+            goto failed;
+        }
+    }
+
+    /* Once started, the range goes out whole so no other message splits it */
+    while (*offset < end) {
+        if (tcp_client_send_range(client->sock, fd, offset, (size_t)(end - *offset)) < 0) {
+            goto failed;
+        }
+    }
+
+    if (trailer) {
+        struct iovec iov[2];
+        size_t trailer_len = strlen(trailer);
+
+        iov[0].iov_base = (void *)trailer;
+        iov[0].iov_len = trailer_len;
+        iov[1].iov_base = (void *)"\n";
+        iov[1].iov_len = 1;
+        sent = writev(client->sock, iov, 2);
+        if (sent < 0 || (size_t)sent != trailer_len + 1) {
+            goto failed;
+        }
+    }
+
+    /* Uncorking pushes out the last partial segment */
+    tcp_client_set_cork(client->sock, 0);
+    return 1;
+
+failed:
+    client->is_connected = 0;
+    if (client->on_disconnection) {
+        client->on_disconnection(client->sock, client->ip_address, errno);
+    }
+    return -1;
+}
+
 void
 tcp_client_receive(tcp_client_t *client)
 {
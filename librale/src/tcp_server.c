@@ -36,12 +36,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 /** Local headers */
 #include "librale_internal.h"
 #include "tcp_server.h"
 #include "shutdown.h"
+#include "probes.h"
 
 /** Constants */
 #define MODULE "DSTORE"
@@ -162,6 +164,7 @@ tcp_server_run(tcp_server_t *server)
 	int                 sd;
 	ssize_t             valread;
 	int                 i;
+	int                 shutdown_fd;
 
 	if (server == NULL || server->server_sock == -1)
 	{
@@ -170,22 +173,22 @@ tcp_server_run(tcp_server_t *server)
 		return -1;
 	}
 
-	/** Set up timeout for faster shutdown responsiveness */
-	/** Use shorter timeout when shutdown is requested for faster shutdown */
-	if (librale_is_shutdown_requested("dstore"))
-	{
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 10000; /** 10ms timeout for faster shutdown */
-	}
-	else
-	{
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 100000; /** 100ms timeout for normal operation */
-	}
+	/** A shutdown request ends the wait through the shutdown eventfd */
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000; /** 100ms timeout for normal operation */
 
 	FD_ZERO(&read_fds);
 	FD_SET(server->server_sock, &read_fds);
 	max_sd = server->server_sock;
+	shutdown_fd = librale_shutdown_fd();
+	if (shutdown_fd >= 0)
+	{
+		FD_SET(shutdown_fd, &read_fds);
+		if (shutdown_fd > max_sd)
+		{
+			max_sd = shutdown_fd;
+		}
+	}
 
 	for (i = 0; i < server->max_clients; i++)
 	{
@@ -208,9 +211,11 @@ tcp_server_run(tcp_server_t *server)
 			"Select error: %s.", "Select operation failed", "Check system state");
 		return -1;
 	}
-	else if (activity == 0)
+	else if (activity == 0 ||
+			 (shutdown_fd >= 0 && FD_ISSET(shutdown_fd, &read_fds) &&
+			  librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_DSTORE)))
 	{
-		return 0; /** Timeout occurred */
+		return 0; /** Timeout occurred, or shutdown was requested */
 	}
 
 	rale_debug_log("Select returned %d - activity detected on server socket %d",
@@ -256,6 +261,7 @@ tcp_server_run(tcp_server_t *server)
 
 		/** Store the new client socket */
 		server->client_socks[client_slot] = new_socket_fd;
+		RALE_PROBE2(connection__accept, new_socket_fd, client_slot);
 
 		/** Pass the connection to the callback if defined */
 		if (server->on_connection)
@@ -308,6 +314,7 @@ tcp_server_run(tcp_server_t *server)
 											ntohs(client_address.sin_port));
 				}
 
+				RALE_PROBE2(connection__close, sd, i);
 				close(sd);
 				server->client_socks[i] = -1; /** Mark slot as free */
 			}
@@ -315,6 +322,7 @@ tcp_server_run(tcp_server_t *server)
 			{
 				rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "tcp_server_run",
 					"Read error from client (fd %d, slot %d): %s", sd, i, strerror(errno));
+				RALE_PROBE2(connection__close, sd, i);
 				close(sd);
 				server->client_socks[i] = -1; /** Mark slot as free */
 			}
@@ -491,6 +499,7 @@ tcp_server_client_disconnect(
 								client_port_val);
 	}
 
+	RALE_PROBE2(connection__close, server->client_socks[client_sock_idx], client_sock_idx);
 	shutdown(server->client_socks[client_sock_idx], SHUT_RDWR);
 	close(server->client_socks[client_sock_idx]);
 	server->client_socks[client_sock_idx] = -1; /** Mark slot as free */
@@ -509,6 +518,8 @@ tcp_server_client_disconnect(
 int
 tcp_server_send(tcp_server_t *server, int client_sock_idx, const char *message)
 {
+	struct iovec iov[2];
+
 	if (server == NULL || message == NULL)
 	{
 		rale_set_error(RALE_ERROR_INVALID_PARAMETER, "tcp_server_send",
@@ -530,20 +541,18 @@ tcp_server_send(tcp_server_t *server, int client_sock_idx, const char *message)
 		return -1;
 	}
 
-    if (send(server->client_socks[client_sock_idx], message, strlen(message), 0) == -1)
+	/** Message and its newline delimiter go out in one system call */
+	iov[0].iov_base = (void *) message;
+	iov[0].iov_len = strlen(message);
+	iov[1].iov_base = (void *) "\n";
+	iov[1].iov_len = 1;
+	if (writev(server->client_socks[client_sock_idx], iov, 2) == -1)
 	{
-					rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "tcp_server_send",
-				"Failed to send message to client %d: %s", client_sock_idx, strerror(errno));
+		rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "tcp_server_send",
+			"Failed to send message to client %d: %s", client_sock_idx, strerror(errno));
 		return -1;
 	}
 
-    /** Append a newline to delimit messages */
-    if (send(server->client_socks[client_sock_idx], "\n", 1, 0) == -1)
-    {
-        	rale_set_error_fmt(RALE_ERROR_SYSTEM_CALL, "tcp_server_send",
-	    "Failed to send newline terminator to client %d: %s", client_sock_idx, strerror(errno));
-    }
-
 	rale_debug_log(
 		"Message sent to client %d: \"%s\"",
 		client_sock_idx, message);
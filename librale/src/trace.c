@@ -0,0 +1,337 @@
+/*-------------------------------------------------------------------------
+ *
+ * trace.c
+ *		Sampled per-request tracing spans.
+ *
+ *		Recording must cost next to nothing on the request path, so each
+ *		thread writes spans into its own fixed ring with no locking.  A slot
+ *		carries a sequence number that is odd while the owner rewrites it;
+ *		the exporter copies a slot and keeps it only if the sequence was
+ *		even and unchanged across the copy.  Rings are registered once, on a
+ *		thread's first sampled span, and live until trace_cleanup().
+ *
+ *		Span times are CLOCK_REALTIME so exports from different nodes line
+ *		up on one timeline, to within their clock skew.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/** Local headers */
+#include "trace.h"
+#include "cluster.h"
+
+#define TRACE_SEQUENCE_MASK		((UINT64_C(1) << 48) - 1)
+
+typedef struct trace_slot_t
+{
+	_Atomic uint64_t	seq;		/* 2n + 1 while span n is written, 2n + 2 after */
+	_Atomic uint64_t	trace_id;
+	_Atomic uint64_t	start_ns;
+	_Atomic uint64_t	end_ns;
+	_Atomic uint32_t	stage;
+} trace_slot_t;
+
+typedef struct trace_ring_t
+{
+	struct trace_ring_t *next;
+	uint32_t			tid;		/* Registration order, used as the export tid */
+	uint64_t			written;	/* Spans recorded; owner thread only */
+	trace_slot_t		slots[TRACE_RING_SIZE];
+} trace_ring_t;
+
+extern cluster_t cluster;
+
+static const char *const trace_stage_names[TRACE_STAGE_COUNT] = {
+	"request",
+	"parse",
+	"local_apply",
+	"persist",
+	"replicate_send",
+	"follower_apply"
+};
+
+/* Registered rings; the mutex guards the list, never the slots */
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t *rings = NULL;
+static uint32_t ring_count = 0;
+
+static _Atomic uint64_t request_count = 0;
+static uint64_t sequence_base;
+static pthread_once_t sequence_once = PTHREAD_ONCE_INIT;
+
+static __thread trace_ring_t *thread_ring = NULL;
+static __thread uint64_t thread_trace_id = 0;
+
+static uint64_t
+trace_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + (uint64_t) ts.tv_nsec;
+}
+
+/* Ids restart from the clock, so a restarted node does not reuse old ones */
+static void
+trace_init_sequence(void)
+{
+	sequence_base = trace_now_ns() / 1000;
+}
+
+static const config_handle_t sample_rate_handle = CONFIG_HANDLE(trace.sample_rate);
+
+static uint32_t
+trace_sample_rate(void)
+{
+	return (uint32_t) config_get_int(sample_rate_handle, NULL);
+}
+
+uint64_t
+trace_begin(void)
+{
+	uint32_t	rate = trace_sample_rate();
+	uint64_t	n;
+
+	thread_trace_id = 0;
+	if (rate == 0)
+		return 0;
+
+	n = atomic_fetch_add_explicit(&request_count, 1, memory_order_relaxed);
+	if (n % rate != 0)
+		return 0;
+
+	pthread_once(&sequence_once, trace_init_sequence);
+	thread_trace_id = ((uint64_t) (uint16_t) cluster.self_id << 48) |
+		((sequence_base + n) & TRACE_SEQUENCE_MASK);
+	if (thread_trace_id == 0)
+		thread_trace_id = 1;
+	return thread_trace_id;
+}
+
+void
+trace_adopt(uint64_t trace_id)
+{
+	thread_trace_id = trace_id;
+}
+
+void
+trace_end(void)
+{
+	thread_trace_id = 0;
+}
+
+uint64_t
+trace_current(void)
+{
+	return thread_trace_id;
+}
+
+uint64_t
+trace_clock(void)
+{
+	return thread_trace_id != 0 ? trace_now_ns() : 0;
+}
+
+static trace_ring_t *
+trace_register_ring(void)
+{
+	trace_ring_t *ring = calloc(1, sizeof(trace_ring_t));
+
+	if (ring == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&ring_mutex);
+	ring->tid = ++ring_count;
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&ring_mutex);
+	return ring;
+}
+
+void
+trace_span(trace_stage_t stage, uint64_t start_ns)
+{
+	trace_slot_t   *slot;
+	uint64_t		n;
+
+	if (thread_trace_id == 0 || start_ns == 0 || stage >= TRACE_STAGE_COUNT)
+		return;
+	if (thread_ring == NULL && (thread_ring = trace_register_ring()) == NULL)
+		return;
+
+	n = thread_ring->written++;
+	slot = &thread_ring->slots[n % TRACE_RING_SIZE];
+
+	atomic_store_explicit(&slot->seq, 2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&slot->trace_id, thread_trace_id, memory_order_relaxed);
+	atomic_store_explicit(&slot->start_ns, start_ns, memory_order_relaxed);
+	atomic_store_explicit(&slot->end_ns, trace_now_ns(), memory_order_relaxed);
+	atomic_store_explicit(&slot->stage, (uint32_t) stage, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, 2 * n + 2, memory_order_release);
+}
+
+const char *
+trace_stage_name(trace_stage_t stage)
+{
+	return stage < TRACE_STAGE_COUNT ? trace_stage_names[stage] : "unknown";
+}
+
+size_t
+trace_format_context(char *buf, size_t buflen)
+{
+	int len;
+
+	if (thread_trace_id == 0 || buf == NULL || buflen <= TRACE_CONTEXT_LENGTH)
+		return 0;
+
+	len = snprintf(buf, buflen, "%c%016llx ", TRACE_CONTEXT_PREFIX,
+				   (unsigned long long) thread_trace_id);
+	return len == TRACE_CONTEXT_LENGTH ? (size_t) len : 0;
+}
+
+const char *
+trace_strip_context(const char *frame, uint64_t *trace_id)
+{
+	uint64_t	id = 0;
+	int			i;
+
+	if (trace_id != NULL)
+		*trace_id = 0;
+	if (frame == NULL || frame[0] != TRACE_CONTEXT_PREFIX)
+		return frame;
+
+	for (i = 1; i < TRACE_CONTEXT_LENGTH - 1; i++)
+	{
+		char	c = frame[i];
+		int		digit;
+
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else
+			return frame;
+		id = (id << 4) | (uint64_t) digit;
+	}
+	if (frame[TRACE_CONTEXT_LENGTH - 1] != ' ')
+		return frame;
+
+	if (trace_id != NULL)
+		*trace_id = id;
+	return frame + TRACE_CONTEXT_LENGTH;
+}
+
+/* Copy one slot; false if it is empty or was rewritten during the copy */
+static bool
+trace_read_slot(trace_slot_t *slot, uint64_t *trace_id, uint64_t *start_ns,
+				uint64_t *end_ns, uint32_t *stage)
+{
+	uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+	if (seq == 0 || (seq & 1) != 0)
+		return false;
+
+	*trace_id = atomic_load_explicit(&slot->trace_id, memory_order_relaxed);
+	*start_ns = atomic_load_explicit(&slot->start_ns, memory_order_relaxed);
+	*end_ns = atomic_load_explicit(&slot->end_ns, memory_order_relaxed);
+	*stage = atomic_load_explicit(&slot->stage, memory_order_relaxed);
+	atomic_thread_fence(memory_order_acquire);
+
+	return atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq;
+}
+
+int
+trace_export_chrome(const char *path, char *errbuf, size_t errbuflen)
+{
+	FILE		   *fp;
+	trace_ring_t   *ring;
+	int				node_id = cluster.self_id;
+	int				count = 0;
+	int				i;
+
+	if (path == NULL || path[0] == '\0')
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "TRACE_ERR_INVALID: No export path given.");
+		return -1;
+	}
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "TRACE_ERR_FILE_IO: Cannot open \"%s\": %s.",
+					 path, strerror(errno));
+		return -1;
+	}
+
+	/* One process lane per node, one thread lane per ring */
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"node %d\"}}",
+			node_id, node_id);
+
+	pthread_mutex_lock(&ring_mutex);
+	for (ring = rings; ring != NULL; ring = ring->next)
+	{
+		for (i = 0; i < TRACE_RING_SIZE; i++)
+		{
+			uint64_t	trace_id;
+			uint64_t	start_ns;
+			uint64_t	end_ns;
+			uint32_t	stage;
+			uint64_t	dur_ns;
+
+			if (!trace_read_slot(&ring->slots[i], &trace_id, &start_ns, &end_ns, &stage))
+				continue;
+
+			dur_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"rale\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+					"\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"trace_id\":\"%016llx\"}}",
+					trace_stage_name((trace_stage_t) stage), node_id, ring->tid,
+					(unsigned long long) (start_ns / 1000), (unsigned) (start_ns % 1000),
+					(unsigned long long) (dur_ns / 1000), (unsigned) (dur_ns % 1000),
+					(unsigned long long) trace_id);
+			count++;
+		}
+	}
+	pthread_mutex_unlock(&ring_mutex);
+
+	fputs("\n]}\n", fp);
+	if (fclose(fp) != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "TRACE_ERR_FILE_IO: Failed to write \"%s\": %s.",
+					 path, strerror(errno));
+		return -1;
+	}
+	return count;
+}
+
+void
+trace_cleanup(void)
+{
+	trace_ring_t *ring;
+
+	pthread_mutex_lock(&ring_mutex);
+	while ((ring = rings) != NULL)
+	{
+		rings = ring->next;
+		free(ring);
+	}
+	ring_count = 0;
+	pthread_mutex_unlock(&ring_mutex);
+	thread_ring = NULL;
+}
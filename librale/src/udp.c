@@ -7,6 +7,12 @@
  *    receiving, and managing UDP sockets. It supports both client and
  *    server UDP operations.
  *
+ *    The consensus path moves datagrams in batches: udp_process_messages()
+ *    drains up to UDP_BATCH_SIZE waiting datagrams with one recvmmsg(),
+ *    and replies or fan-out queued with udp_queue() leave together with
+ *    one sendmmsg() on udp_flush().  Elsewhere the same calls fall back
+ *    to one recvfrom()/sendto() per datagram.
+ *
  * Copyright (c) 2024-2025, pgElephant, Inc.
  *
  * IDENTIFICATION
@@ -15,6 +21,10 @@
  *-------------------------------------------------------------------------
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* recvmmsg, sendmmsg */
+#endif
+
 /** System headers */
 #include <errno.h>
 #include <fcntl.h>
@@ -23,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
@@ -38,6 +49,18 @@
 #define MAX_UDP_MESSAGE_SIZE 1024
 #define MAX_UDP_BUFFER_SIZE 2048
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define HAVE_MMSG 1
+#endif
+
+struct udp_outbox
+{
+	int					count;
+	struct sockaddr_in	dest[UDP_BATCH_SIZE];
+	size_t				len[UDP_BATCH_SIZE];
+	char				data[UDP_BATCH_SIZE][UDP_BUFFER_SIZE];
+};
+
 /* UDP status structure */
 typedef struct {
 	bool initialized;
@@ -471,6 +494,7 @@ udp_destroy(connection_t *udp)
 		close(udp->sockfd);
 	}
 	
+	free(udp->outbox);
 	free(udp);
 }
 
@@ -577,24 +601,234 @@ udp_loop(connection_t *udp)
 	}
 }
 
+/*
+ * Read every datagram already waiting, up to max_messages, without
+ * blocking.  Returns the number read, 0 when none was waiting, -1 on error.
+ */
+int
+udp_recv_batch(connection_t *udp, udp_message_t *messages, int max_messages)
+{
+	struct sockaddr_in addrs[UDP_BATCH_SIZE];
+	int			count = 0;
+	int			i;
+
+	if (udp == NULL || udp->sockfd < 0 || messages == NULL || max_messages <= 0)
+	{
+		return -1;
+	}
+	if (max_messages > UDP_BATCH_SIZE)
+	{
+		max_messages = UDP_BATCH_SIZE;
+	}
+
+#ifdef HAVE_MMSG
+	{
+		struct mmsghdr	msgs[UDP_BATCH_SIZE];
+		struct iovec	iov[UDP_BATCH_SIZE];
+
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < max_messages; i++)
+		{
+			iov[i].iov_base = messages[i].data;
+			iov[i].iov_len = sizeof(messages[i].data) - 1;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		}
+
+		do
+		{
+			count = recvmmsg(udp->sockfd, msgs, (unsigned int) max_messages, MSG_DONTWAIT, NULL);
+		} while (count < 0 && errno == EINTR);
+		if (count < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		for (i = 0; i < count; i++)
+		{
+			messages[i].data[msgs[i].msg_len] = '\0';
+		}
+	}
+#else
+	while (count < max_messages)
+	{
+		socklen_t	addr_len = sizeof(addrs[count]);
+		ssize_t		received = recvfrom(udp->sockfd, messages[count].data,
+										sizeof(messages[count].data) - 1, MSG_DONTWAIT,
+										(struct sockaddr *)&addrs[count], &addr_len);
+
+		if (received < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return (count > 0) ? count : -1;
+		}
+		messages[count].data[received] = '\0';
+		count++;
+	}
+#endif
+
+	for (i = 0; i < count; i++)
+	{
+		if (inet_ntop(AF_INET, &addrs[i].sin_addr, messages[i].sender_address,
+					  sizeof(messages[i].sender_address)) == NULL)
+		{
+			messages[i].sender_address[0] = '\0';
+		}
+		messages[i].sender_port = ntohs(addrs[i].sin_port);
+	}
+	return count;
+}
+
+/*
+ * Queue a datagram for the next udp_flush(); a full queue is flushed
+ * first.  Returns 0, or -1 if the message cannot be queued.
+ */
+int
+udp_queue(connection_t *udp, const char *message, const char *address, int port)
+{
+	udp_outbox_t   *outbox;
+	size_t			len;
+
+	if (udp == NULL || udp->sockfd < 0 || message == NULL || address == NULL)
+	{
+		return -1;
+	}
+
+	len = strlen(message);
+	if (len == 0 || len >= UDP_BUFFER_SIZE)
+	{
+		return -1;
+	}
+
+	if (udp->outbox == NULL)
+	{
+		udp->outbox = calloc(1, sizeof(udp_outbox_t));
+		if (udp->outbox == NULL)
+		{
+			return -1;
+		}
+	}
+	outbox = udp->outbox;
+	if (outbox->count == UDP_BATCH_SIZE)
+	{
+		(void) udp_flush(udp);
+	}
+
+	memset(&outbox->dest[outbox->count], 0, sizeof(struct sockaddr_in));
+	outbox->dest[outbox->count].sin_family = AF_INET;
+	outbox->dest[outbox->count].sin_port = htons((uint16_t) port);
+	if (inet_pton(AF_INET, address, &outbox->dest[outbox->count].sin_addr) <= 0)
+	{
+		return -1;
+	}
+	memcpy(outbox->data[outbox->count], message, len);
+	outbox->len[outbox->count] = len;
+	outbox->count++;
+	return 0;
+}
+
+/*
+ * Send every queued datagram.  A datagram the kernel refuses is dropped
+ * and the rest still go out.  Returns the number sent, -1 if any failed.
+ */
+int
+udp_flush(connection_t *udp)
+{
+	udp_outbox_t   *outbox;
+	int				sent = 0;
+	int				failed = 0;
+	int				i;
+
+	if (udp == NULL || udp->outbox == NULL || udp->outbox->count == 0)
+	{
+		return 0;
+	}
+	outbox = udp->outbox;
+
+#ifdef HAVE_MMSG
+	{
+		struct mmsghdr	msgs[UDP_BATCH_SIZE];
+		struct iovec	iov[UDP_BATCH_SIZE];
+
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < outbox->count; i++)
+		{
+			iov[i].iov_base = outbox->data[i];
+			iov[i].iov_len = outbox->len[i];
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &outbox->dest[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(outbox->dest[i]);
+		}
+
+		i = 0;
+		while (i < outbox->count)
+		{
+			int n = sendmmsg(udp->sockfd, &msgs[i], (unsigned int) (outbox->count - i), 0);
+
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				/* Skip the datagram sendmmsg() stopped at */
+				failed++;
+				i++;
+				continue;
+			}
+			sent += n;
+			i += n;
+		}
+	}
+#else
+	for (i = 0; i < outbox->count; i++)
+	{
+		if (sendto(udp->sockfd, outbox->data[i], outbox->len[i], 0,
+				   (struct sockaddr *)&outbox->dest[i], sizeof(outbox->dest[i])) < 0)
+		{
+			failed++;
+			continue;
+		}
+		sent++;
+	}
+#endif
+
+	outbox->count = 0;
+	return (failed > 0) ? -1 : sent;
+}
+
 void
 udp_process_messages(connection_t *udp)
 {
+	udp_message_t	messages[UDP_BATCH_SIZE];
+	int				count;
+	int				i;
+
 	if (udp == NULL || udp->sockfd < 0)
 	{
 		return;
 	}
 	
-	char buffer[UDP_BUFFER_SIZE];
-	char sender_address[INET_ADDRSTRLEN];
-	int sender_port;
-	
-	/* Process one message (non-blocking) */
-	if (udp_recvfrom(udp, buffer, sizeof(buffer), sender_address, &sender_port) == 0)
+	/* Everything waiting now, in one batch (non-blocking) */
+	count = udp_recv_batch(udp, messages, UDP_BATCH_SIZE);
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (udp->on_receive_batch)
+	{
+		udp->on_receive_batch(messages, count);
+	}
+	else if (udp->on_receive)
 	{
-		if (udp->on_receive)
+		for (i = 0; i < count; i++)
 		{
-			udp->on_receive(buffer, sender_address, sender_port);
+			udp->on_receive(messages[i].data, messages[i].sender_address,
+							messages[i].sender_port);
 		}
 	}
 }
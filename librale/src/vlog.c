@@ -0,0 +1,844 @@
+/*-------------------------------------------------------------------------
+ *
+ * vlog.c
+ *		Append-only value log with a page cache and a garbage collector.
+ *
+ *		A record is an 8-byte header (key and value lengths) followed by
+ *		the key and the value, so a segment can be walked without the
+ *		index.  A reference names the segment, the record offset and both
+ *		lengths, in text so the index can store it like any other value.
+ *
+ *		Locking: mutex serializes appends and guards the active segment,
+ *		the garbage counts and the statistics.  segments_lock protects the
+ *		slot table: readers hold it shared across their pread(), rotation
+ *		and removal take it exclusively, so a descriptor is never closed
+ *		under a reader.  cache_mutex guards the page cache; a miss is read
+ *		while holding it.  Segment ids only grow, so a reference into a
+ *		removed segment is recognized instead of reading the wrong file.
+ *
+ *		A segment's size is published after its bytes are written.  A page
+ *		read from the active segment keeps only the bytes below that size;
+ *		a later read past them refills the page.
+ *
+ *		The collector picks the sealed segment with the largest share of
+ *		garbage at or above gc_percent, hands each record to the relocate
+ *		callback, which copies the still-live ones into the active segment,
+ *		and then removes the file.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Local headers */
+#include "vlog.h"
+
+#define VLOG_PREFIX			"vlog."
+#define VLOG_HEADER_SIZE	8		/* uint32 key length, uint32 value length */
+#define VLOG_GC_INTERVAL_S	1		/* Collector recheck without a wakeup */
+#define VLOG_RECORD_STACK	2048	/* Larger records are built on the heap */
+
+typedef struct vlog_segment
+{
+	uint32_t			id;			/* 0 if the slot is free */
+	int					fd;
+	_Atomic uint64_t	size;		/* Bytes written and readable */
+	uint64_t			garbage;	/* Bytes of dead records */
+	bool				collecting;
+} vlog_segment_t;
+
+typedef struct vlog_page
+{
+	uint32_t			segment;	/* 0 if the page is unused */
+	uint32_t			valid;		/* Bytes of data read */
+	uint64_t			page_no;
+	int32_t				next;		/* Bucket chain, -1 ends it */
+	bool				referenced;
+} vlog_page_t;
+
+typedef struct vlog_ref
+{
+	uint32_t			segment;
+	uint32_t			key_len;
+	uint32_t			value_len;
+	uint64_t			offset;		/* Of the record header */
+} vlog_ref_t;
+
+struct vlog
+{
+	char				dir[1024];
+	uint64_t			segment_bytes;
+
+	pthread_mutex_t		mutex;
+	pthread_rwlock_t	segments_lock;
+	vlog_segment_t		segments[VLOG_MAX_SEGMENTS];
+	uint32_t			active;
+	uint32_t			next_id;
+	vlog_stats_t		stats;
+
+	pthread_mutex_t		cache_mutex;
+	vlog_page_t		   *pages;
+	char			   *page_data;
+	int32_t			   *buckets;
+	uint32_t			npages;
+	uint32_t			nbuckets;	/* Power of two */
+	uint32_t			hand;
+	uint64_t			cache_hits;
+	uint64_t			cache_misses;
+
+	pthread_cond_t		gc_wake;
+	pthread_t			gc_thread;
+	bool				gc_running;
+	_Atomic bool		stopping;
+	int					gc_percent;
+	vlog_relocate_fn	relocate;
+	void			   *relocate_arg;
+};
+
+static inline vlog_segment_t *
+vlog_slot(vlog_t *vlog, uint32_t id)
+{
+	return &vlog->segments[id % VLOG_MAX_SEGMENTS];
+}
+
+static void
+vlog_path(const vlog_t *vlog, uint32_t id, char *path, size_t path_size)
+{
+	snprintf(path, path_size, "%s/" VLOG_PREFIX "%08" PRIx32, vlog->dir, id);
+}
+
+static uint64_t
+vlog_record_bytes(const vlog_ref_t *ref)
+{
+	return VLOG_HEADER_SIZE + (uint64_t) ref->key_len + ref->value_len;
+}
+
+static void
+vlog_ref_format(const vlog_ref_t *ref, char *text, size_t text_size)
+{
+	snprintf(text, text_size, "%" PRIx32 ":%" PRIx64 ":%" PRIx32 ":%" PRIx32,
+			 ref->segment, ref->offset, ref->key_len, ref->value_len);
+}
+
+/* Fields of a reference in order; false unless all four parse */
+static bool
+vlog_ref_parse(const char *text, vlog_ref_t *ref)
+{
+	unsigned long long fields[4];
+	char	   *end;
+	int			i;
+
+	for (i = 0; i < 4; i++)
+	{
+		fields[i] = strtoull(text, &end, 16);
+		if (end == text || *end != (i < 3 ? ':' : '\0'))
+			return false;
+		text = end + 1;
+	}
+	if (fields[0] == 0 || fields[0] > UINT32_MAX || fields[2] > UINT32_MAX ||
+		fields[3] > UINT32_MAX)
+		return false;
+	ref->segment = (uint32_t) fields[0];
+	ref->offset = (uint64_t) fields[1];
+	ref->key_len = (uint32_t) fields[2];
+	ref->value_len = (uint32_t) fields[3];
+	return true;
+}
+
+static bool
+vlog_pread_full(int fd, char *buf, size_t len, uint64_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t		n = pread(fd, buf, len, (off_t) offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		buf += n;
+		len -= (size_t) n;
+		offset += (uint64_t) n;
+	}
+	return true;
+}
+
+static bool
+vlog_pwrite_full(int fd, const char *buf, size_t len, uint64_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t		n = pwrite(fd, buf, len, (off_t) offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		buf += n;
+		len -= (size_t) n;
+		offset += (uint64_t) n;
+	}
+	return true;
+}
+
+/*
+ * Page cache
+ */
+
+static inline uint32_t
+vlog_page_bucket(const vlog_t *vlog, uint32_t segment, uint64_t page_no)
+{
+	uint64_t	h = ((uint64_t) segment << 40) ^ page_no;
+
+	h *= UINT64_C(0x9e3779b97f4a7c15);
+	return (uint32_t) (h >> 32) & (vlog->nbuckets - 1);
+}
+
+static int32_t
+vlog_page_find(const vlog_t *vlog, uint32_t segment, uint64_t page_no)
+{
+	int32_t		i;
+
+	for (i = vlog->buckets[vlog_page_bucket(vlog, segment, page_no)]; i >= 0;
+		 i = vlog->pages[i].next)
+	{
+		if (vlog->pages[i].segment == segment && vlog->pages[i].page_no == page_no)
+			return i;
+	}
+	return -1;
+}
+
+static void
+vlog_page_unlink(vlog_t *vlog, int32_t index)
+{
+	vlog_page_t *page = &vlog->pages[index];
+	int32_t    *link = &vlog->buckets[vlog_page_bucket(vlog, page->segment, page->page_no)];
+
+	while (*link != index)
+		link = &vlog->pages[*link].next;
+	*link = page->next;
+	page->segment = 0;
+	page->valid = 0;
+}
+
+/* CLOCK: the first page past the hand not referenced since the last sweep */
+static int32_t
+vlog_page_evict(vlog_t *vlog)
+{
+	for (;;)
+	{
+		int32_t		index = (int32_t) vlog->hand;
+		vlog_page_t *page = &vlog->pages[index];
+
+		vlog->hand = (vlog->hand + 1) % vlog->npages;
+		if (page->segment == 0)
+			return index;
+		if (page->referenced)
+		{
+			page->referenced = false;
+			continue;
+		}
+		vlog_page_unlink(vlog, index);
+		return index;
+	}
+}
+
+static void
+vlog_cache_forget(vlog_t *vlog, uint32_t segment)
+{
+	uint32_t	i;
+
+	pthread_mutex_lock(&vlog->cache_mutex);
+	for (i = 0; i < vlog->npages; i++)
+	{
+		if (vlog->pages[i].segment == segment)
+			vlog_page_unlink(vlog, (int32_t) i);
+	}
+	pthread_mutex_unlock(&vlog->cache_mutex);
+}
+
+/* Copy len bytes at offset of a segment; segments_lock held shared */
+static bool
+vlog_cache_read(vlog_t *vlog, vlog_segment_t *seg, char *dst, size_t len, uint64_t offset)
+{
+	if (vlog->npages == 0)
+		return vlog_pread_full(seg->fd, dst, len, offset);
+
+	while (len > 0)
+	{
+		uint64_t	page_no = offset / VLOG_PAGE_SIZE;
+		uint32_t	in_page = (uint32_t) (offset % VLOG_PAGE_SIZE);
+		size_t		chunk = VLOG_PAGE_SIZE - in_page;
+		vlog_page_t *page;
+		int32_t		index;
+
+		if (chunk > len)
+			chunk = len;
+
+		pthread_mutex_lock(&vlog->cache_mutex);
+		index = vlog_page_find(vlog, seg->id, page_no);
+		if (index >= 0 && vlog->pages[index].valid >= in_page + chunk)
+			vlog->cache_hits++;
+		else
+		{
+			uint64_t	start = page_no * VLOG_PAGE_SIZE;
+			uint64_t	size = atomic_load_explicit(&seg->size, memory_order_acquire);
+			ssize_t		n;
+
+			vlog->cache_misses++;
+			if (index < 0)
+			{
+				uint32_t	bucket;
+
+				index = vlog_page_evict(vlog);
+				bucket = vlog_page_bucket(vlog, seg->id, page_no);
+				vlog->pages[index].segment = seg->id;
+				vlog->pages[index].page_no = page_no;
+				vlog->pages[index].next = vlog->buckets[bucket];
+				vlog->buckets[bucket] = index;
+			}
+			do
+				n = pread(seg->fd, vlog->page_data + (size_t) index * VLOG_PAGE_SIZE,
+						  VLOG_PAGE_SIZE, (off_t) start);
+			while (n < 0 && errno == EINTR);
+
+			/* Bytes past the published size may still be in flight */
+			if (n < 0 || size <= start)
+				n = 0;
+			else if ((uint64_t) n > size - start)
+				n = (ssize_t) (size - start);
+			vlog->pages[index].valid = (uint32_t) n;
+			if (vlog->pages[index].valid < in_page + chunk)
+			{
+				vlog_page_unlink(vlog, index);
+				pthread_mutex_unlock(&vlog->cache_mutex);
+				return false;
+			}
+		}
+		page = &vlog->pages[index];
+		page->referenced = true;
+		memcpy(dst, vlog->page_data + (size_t) index * VLOG_PAGE_SIZE + in_page, chunk);
+		pthread_mutex_unlock(&vlog->cache_mutex);
+
+		dst += chunk;
+		len -= chunk;
+		offset += chunk;
+	}
+	return true;
+}
+
+/*
+ * Segments
+ */
+
+/* Remove leftovers of an earlier run; rale.db is the durable copy */
+static void
+vlog_remove_stale(const char *dir)
+{
+	DIR		   *d = opendir(dir);
+	struct dirent *de;
+	char		path[1300];
+
+	if (d == NULL)
+		return;
+	while ((de = readdir(d)) != NULL)
+	{
+		if (strncmp(de->d_name, VLOG_PREFIX, strlen(VLOG_PREFIX)) != 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		unlink(path);
+	}
+	closedir(d);
+}
+
+/* Start a new active segment; mutex held */
+static int
+vlog_rotate(vlog_t *vlog)
+{
+	uint32_t	id = vlog->next_id;
+	vlog_segment_t *seg = vlog_slot(vlog, id);
+	char		path[1300];
+	int			fd;
+
+	if (seg->id != 0)
+		return -1;				/* Every slot still holds an uncollected segment */
+
+	vlog_path(vlog, id, path, sizeof(path));
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+
+	pthread_rwlock_wrlock(&vlog->segments_lock);
+	seg->id = id;
+	seg->fd = fd;
+	atomic_store_explicit(&seg->size, 0, memory_order_relaxed);
+	seg->garbage = 0;
+	seg->collecting = false;
+	pthread_rwlock_unlock(&vlog->segments_lock);
+
+	vlog->active = id;
+	vlog->next_id = id + 1 == 0 ? 1 : id + 1;
+	vlog->stats.segments++;
+	/* The segment just sealed may already be worth collecting */
+	pthread_cond_signal(&vlog->gc_wake);
+	return 0;
+}
+
+/* Close and delete a collected segment; mutex held */
+static void
+vlog_remove_segment(vlog_t *vlog, vlog_segment_t *seg)
+{
+	char		path[1300];
+	uint32_t	id = seg->id;
+	uint64_t	size = atomic_load_explicit(&seg->size, memory_order_relaxed);
+
+	pthread_rwlock_wrlock(&vlog->segments_lock);
+	close(seg->fd);
+	seg->fd = -1;
+	seg->id = 0;
+	pthread_rwlock_unlock(&vlog->segments_lock);
+
+	vlog_path(vlog, id, path, sizeof(path));
+	unlink(path);
+
+	vlog->stats.segments--;
+	vlog->stats.bytes -= size;
+	vlog->stats.garbage_bytes -= seg->garbage;
+	vlog->stats.gc_segments++;
+	vlog->stats.gc_reclaimed_bytes += seg->garbage;
+	seg->garbage = 0;
+	seg->collecting = false;
+}
+
+vlog_t *
+vlog_open(const char *dir, uint64_t segment_bytes, uint64_t cache_bytes,
+		  char *errbuf, size_t errbuflen)
+{
+	vlog_t	   *vlog;
+	uint32_t	i;
+
+	vlog = calloc(1, sizeof(vlog_t));
+	if (vlog == NULL)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Memory allocation failed for value log");
+		return NULL;
+	}
+	snprintf(vlog->dir, sizeof(vlog->dir), "%s", dir);
+	vlog->segment_bytes = segment_bytes;
+	vlog->next_id = 1;
+	vlog->gc_percent = 50;
+	for (i = 0; i < VLOG_MAX_SEGMENTS; i++)
+		vlog->segments[i].fd = -1;
+
+	vlog->npages = (uint32_t) (cache_bytes / VLOG_PAGE_SIZE);
+	if (vlog->npages > 0)
+	{
+		vlog->nbuckets = 1;
+		while (vlog->nbuckets < vlog->npages)
+			vlog->nbuckets <<= 1;
+		vlog->pages = calloc(vlog->npages, sizeof(vlog_page_t));
+		vlog->page_data = malloc((size_t) vlog->npages * VLOG_PAGE_SIZE);
+		vlog->buckets = malloc(vlog->nbuckets * sizeof(int32_t));
+		if (vlog->pages == NULL || vlog->page_data == NULL || vlog->buckets == NULL)
+		{
+			free(vlog->pages);
+			free(vlog->page_data);
+			free(vlog->buckets);
+			free(vlog);
+			if (errbuf != NULL && errbuflen > 0)
+				snprintf(errbuf, errbuflen, "Memory allocation failed for value cache");
+			return NULL;
+		}
+		memset(vlog->buckets, 0xFF, vlog->nbuckets * sizeof(int32_t));
+	}
+
+	pthread_mutex_init(&vlog->mutex, NULL);
+	pthread_rwlock_init(&vlog->segments_lock, NULL);
+	pthread_mutex_init(&vlog->cache_mutex, NULL);
+	pthread_cond_init(&vlog->gc_wake, NULL);
+
+	vlog_remove_stale(dir);
+	if (vlog_rotate(vlog) != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "Failed to create value log segment in %s: %s",
+					 dir, strerror(errno));
+		vlog_close(vlog);
+		return NULL;
+	}
+	return vlog;
+}
+
+int
+vlog_append(vlog_t *vlog, const char *key, size_t key_len, const char *value,
+			size_t value_len, char *ref, size_t ref_size)
+{
+	char		stack_buf[VLOG_RECORD_STACK];
+	char	   *buf = stack_buf;
+	vlog_segment_t *seg;
+	vlog_ref_t	r;
+	uint32_t	lengths[2];
+	uint64_t	bytes = VLOG_HEADER_SIZE + key_len + value_len;
+	uint64_t	offset;
+	int			ret = -1;
+
+	if (key_len > UINT32_MAX || value_len > UINT32_MAX)
+		return -1;
+	if (bytes > sizeof(stack_buf))
+	{
+		buf = malloc(bytes);
+		if (buf == NULL)
+			return -1;
+	}
+	lengths[0] = (uint32_t) key_len;
+	lengths[1] = (uint32_t) value_len;
+	memcpy(buf, lengths, VLOG_HEADER_SIZE);
+	memcpy(buf + VLOG_HEADER_SIZE, key, key_len);
+	memcpy(buf + VLOG_HEADER_SIZE + key_len, value, value_len);
+
+	pthread_mutex_lock(&vlog->mutex);
+	seg = vlog_slot(vlog, vlog->active);
+	offset = atomic_load_explicit(&seg->size, memory_order_relaxed);
+	if (offset > 0 && offset + bytes > vlog->segment_bytes)
+	{
+		if (vlog_rotate(vlog) != 0)
+			goto out;
+		seg = vlog_slot(vlog, vlog->active);
+		offset = 0;
+	}
+	if (!vlog_pwrite_full(seg->fd, buf, (size_t) bytes, offset))
+		goto out;
+	atomic_store_explicit(&seg->size, offset + bytes, memory_order_release);
+	vlog->stats.bytes += bytes;
+	vlog->stats.appends++;
+
+	r.segment = seg->id;
+	r.offset = offset;
+	r.key_len = (uint32_t) key_len;
+	r.value_len = (uint32_t) value_len;
+	vlog_ref_format(&r, ref, ref_size);
+	ret = 0;
+
+out:
+	pthread_mutex_unlock(&vlog->mutex);
+	if (buf != stack_buf)
+		free(buf);
+	return ret;
+}
+
+int
+vlog_read(vlog_t *vlog, const char *ref, char *value, size_t value_size)
+{
+	vlog_segment_t *seg;
+	vlog_ref_t	r;
+	size_t		len;
+	bool		ok;
+
+	if (value_size == 0 || !vlog_ref_parse(ref, &r))
+		return -1;
+
+	len = r.value_len < value_size - 1 ? r.value_len : value_size - 1;
+	pthread_rwlock_rdlock(&vlog->segments_lock);
+	seg = vlog_slot(vlog, r.segment);
+	if (seg->id != r.segment)
+	{
+		pthread_rwlock_unlock(&vlog->segments_lock);
+		return VLOG_STALE;
+	}
+	ok = vlog_cache_read(vlog, seg, value, len, r.offset + VLOG_HEADER_SIZE + r.key_len);
+	pthread_rwlock_unlock(&vlog->segments_lock);
+	if (!ok)
+		return -1;
+	value[len] = '\0';
+	return 0;
+}
+
+void
+vlog_discard(vlog_t *vlog, const char *ref)
+{
+	vlog_segment_t *seg;
+	vlog_ref_t	r;
+	uint64_t	bytes;
+
+	if (!vlog_ref_parse(ref, &r))
+		return;
+
+	bytes = vlog_record_bytes(&r);
+	pthread_mutex_lock(&vlog->mutex);
+	seg = vlog_slot(vlog, r.segment);
+	if (seg->id == r.segment)
+	{
+		uint64_t	size = atomic_load_explicit(&seg->size, memory_order_relaxed);
+
+		seg->garbage += bytes;
+		vlog->stats.garbage_bytes += bytes;
+		if (seg->id != vlog->active &&
+			seg->garbage * 100 >= size * (uint64_t) vlog->gc_percent)
+			pthread_cond_signal(&vlog->gc_wake);
+	}
+	pthread_mutex_unlock(&vlog->mutex);
+}
+
+/*
+ * Collector
+ */
+
+/* Sealed segment with the most garbage at or above gc_percent; mutex held */
+static vlog_segment_t *
+vlog_gc_pick(vlog_t *vlog)
+{
+	vlog_segment_t *best = NULL;
+	double		best_share = 0.0;
+	uint32_t	i;
+
+	for (i = 0; i < VLOG_MAX_SEGMENTS; i++)
+	{
+		vlog_segment_t *seg = &vlog->segments[i];
+		uint64_t	size = atomic_load_explicit(&seg->size, memory_order_relaxed);
+		double		share;
+
+		if (seg->id == 0 || seg->id == vlog->active || seg->collecting || size == 0)
+			continue;
+		if (seg->garbage * 100 < size * (uint64_t) vlog->gc_percent)
+			continue;
+		share = (double) seg->garbage / (double) size;
+		if (best == NULL || share > best_share)
+		{
+			best = seg;
+			best_share = share;
+		}
+	}
+	return best;
+}
+
+/*
+ * Offer every record of a sealed segment to the relocate callback.  Runs
+ * without mutex; the segment is not written any more and is not removed
+ * while collecting is set.  false if stopped or the segment is unreadable.
+ */
+static bool
+vlog_gc_segment(vlog_t *vlog, uint32_t id, int fd, uint64_t size)
+{
+	char	   *buf = NULL;
+	size_t		buf_size = 0;
+	uint64_t	offset = 0;
+	uint64_t	relocated = 0;
+	bool		ok = true;
+
+	while (offset + VLOG_HEADER_SIZE <= size)
+	{
+		uint32_t	lengths[2];
+		vlog_ref_t	r;
+		char		ref[VLOG_REF_SIZE];
+		size_t		need;
+		int			moved;
+
+		if (atomic_load_explicit(&vlog->stopping, memory_order_relaxed) ||
+			!vlog_pread_full(fd, (char *) lengths, VLOG_HEADER_SIZE, offset))
+		{
+			ok = false;
+			break;
+		}
+		r.segment = id;
+		r.offset = offset;
+		r.key_len = lengths[0];
+		r.value_len = lengths[1];
+		if (offset + vlog_record_bytes(&r) > size)
+		{
+			ok = false;
+			break;
+		}
+
+		/* Key and value, each NUL-terminated */
+		need = (size_t) r.key_len + r.value_len + 2;
+		if (need > buf_size)
+		{
+			char	   *grown = realloc(buf, need);
+
+			if (grown == NULL)
+			{
+				ok = false;
+				break;
+			}
+			buf = grown;
+			buf_size = need;
+		}
+		if (!vlog_pread_full(fd, buf, r.key_len, offset + VLOG_HEADER_SIZE) ||
+			!vlog_pread_full(fd, buf + r.key_len + 1, r.value_len,
+							 offset + VLOG_HEADER_SIZE + r.key_len))
+		{
+			ok = false;
+			break;
+		}
+		buf[r.key_len] = '\0';
+		buf[r.key_len + 1 + r.value_len] = '\0';
+
+		vlog_ref_format(&r, ref, sizeof(ref));
+		moved = vlog->relocate(vlog->relocate_arg, buf, ref, buf + r.key_len + 1);
+		if (moved < 0)
+		{
+			ok = false;
+			break;
+		}
+		relocated += (uint64_t) moved;
+		offset += vlog_record_bytes(&r);
+	}
+	free(buf);
+
+	pthread_mutex_lock(&vlog->mutex);
+	vlog->stats.gc_relocated += relocated;
+	pthread_mutex_unlock(&vlog->mutex);
+	return ok;
+}
+
+/* Wait for a wakeup or the recheck interval; mutex held */
+static void
+vlog_gc_sleep(vlog_t *vlog)
+{
+	struct timespec deadline;
+
+	if (atomic_load_explicit(&vlog->stopping, memory_order_relaxed))
+		return;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += VLOG_GC_INTERVAL_S;
+	pthread_cond_timedwait(&vlog->gc_wake, &vlog->mutex, &deadline);
+}
+
+static void *
+vlog_gc_main(void *arg)
+{
+	vlog_t	   *vlog = (vlog_t *) arg;
+
+	pthread_mutex_lock(&vlog->mutex);
+	while (!atomic_load_explicit(&vlog->stopping, memory_order_relaxed))
+	{
+		vlog_segment_t *seg = vlog_gc_pick(vlog);
+		uint32_t	id;
+		int			fd;
+		uint64_t	size;
+		bool		ok;
+
+		if (seg == NULL)
+		{
+			vlog_gc_sleep(vlog);
+			continue;
+		}
+
+		seg->collecting = true;
+		id = seg->id;
+		fd = seg->fd;
+		size = atomic_load_explicit(&seg->size, memory_order_relaxed);
+		pthread_mutex_unlock(&vlog->mutex);
+
+		ok = vlog_gc_segment(vlog, id, fd, size);
+		if (ok)
+			vlog_cache_forget(vlog, id);
+
+		pthread_mutex_lock(&vlog->mutex);
+		if (ok)
+			vlog_remove_segment(vlog, seg);
+		else
+		{
+			/* Stopping, or try again later rather than spin on a bad segment */
+			seg->collecting = false;
+			vlog_gc_sleep(vlog);
+		}
+	}
+	pthread_mutex_unlock(&vlog->mutex);
+	return NULL;
+}
+
+int
+vlog_start_gc(vlog_t *vlog, vlog_relocate_fn relocate, void *arg, int gc_percent)
+{
+	int			ret = 0;
+
+	pthread_mutex_lock(&vlog->mutex);
+	if (!vlog->gc_running)
+	{
+		vlog->relocate = relocate;
+		vlog->relocate_arg = arg;
+		if (gc_percent > 0 && gc_percent <= 100)
+			vlog->gc_percent = gc_percent;
+		if (pthread_create(&vlog->gc_thread, NULL, vlog_gc_main, vlog) == 0)
+			vlog->gc_running = true;
+		else
+			ret = -1;
+	}
+	pthread_mutex_unlock(&vlog->mutex);
+	return ret;
+}
+
+void
+vlog_close(vlog_t *vlog)
+{
+	uint32_t	i;
+	char		path[1300];
+
+	if (vlog == NULL)
+		return;
+
+	pthread_mutex_lock(&vlog->mutex);
+	atomic_store_explicit(&vlog->stopping, true, memory_order_relaxed);
+	pthread_cond_broadcast(&vlog->gc_wake);
+	pthread_mutex_unlock(&vlog->mutex);
+	if (vlog->gc_running)
+		pthread_join(vlog->gc_thread, NULL);
+
+	for (i = 0; i < VLOG_MAX_SEGMENTS; i++)
+	{
+		vlog_segment_t *seg = &vlog->segments[i];
+
+		if (seg->id == 0)
+			continue;
+		close(seg->fd);
+		vlog_path(vlog, seg->id, path, sizeof(path));
+		unlink(path);
+	}
+
+	pthread_cond_destroy(&vlog->gc_wake);
+	pthread_mutex_destroy(&vlog->cache_mutex);
+	pthread_rwlock_destroy(&vlog->segments_lock);
+	pthread_mutex_destroy(&vlog->mutex);
+	free(vlog->pages);
+	free(vlog->page_data);
+	free(vlog->buckets);
+	free(vlog);
+}
+
+void
+vlog_get_stats(vlog_t *vlog, vlog_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+	if (vlog == NULL)
+	{
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&vlog->mutex);
+	memcpy(stats, &vlog->stats, sizeof(*stats));
+	pthread_mutex_unlock(&vlog->mutex);
+
+	pthread_mutex_lock(&vlog->cache_mutex);
+	stats->cache_pages = vlog->npages;
+	stats->cache_hits = vlog->cache_hits;
+	stats->cache_misses = vlog->cache_misses;
+	pthread_mutex_unlock(&vlog->cache_mutex);
+}
@@ -0,0 +1,532 @@
+/*-------------------------------------------------------------------------
+ *
+ * wal.c
+ *		Append writer for the rale.db key-value log.
+ *
+ *		All records go through one buffer under wal_mutex.  A flush writes
+ *		the buffer at wal_offset and advances it, so concurrent writers
+ *		never interleave inside a record.  Batches are per thread: records
+ *		appended by a thread inside a batch wait in the buffer, but any
+ *		flush, whoever triggers it, writes them out too.
+ *
+ *		The io_uring backend talks to the kernel directly (no liburing):
+ *		one ring, the buffer registered as fixed buffer 0 and the file as
+ *		fixed file 0.  A flush queues IORING_OP_WRITE_FIXED, linked with
+ *		IOSQE_IO_LINK to an IORING_OP_FSYNC when wal_sync is on, and waits
+ *		for both with the same io_uring_enter() that submits them.  A short
+ *		write cancels the linked fsync; the remainder is then queued again
+ *		with its own.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* syscall(), MAP_POPULATE */
+#endif
+
+/** System headers */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+/** Local headers */
+#include "wal.h"
+#include "rale_error.h"
+
+#define MODULE "wal"
+
+/* user_data of the two operations in a flush */
+#define WAL_OP_WRITE	1
+#define WAL_OP_FSYNC	2
+
+#ifdef HAVE_IO_URING
+typedef struct wal_ring
+{
+	int					fd;
+	void			   *sq_ptr;
+	size_t				sq_size;
+	void			   *cq_ptr;
+	size_t				cq_size;
+	struct io_uring_sqe *sqes;
+	size_t				sqes_size;
+	unsigned		   *sq_head;
+	unsigned		   *sq_tail;
+	unsigned		   *sq_mask;
+	unsigned		   *sq_array;
+	unsigned		   *cq_head;
+	unsigned		   *cq_tail;
+	unsigned		   *cq_mask;
+	struct io_uring_cqe *cqes;
+} wal_ring_t;
+
+static wal_ring_t wal_ring = {.fd = -1};
+#endif
+
+static pthread_mutex_t wal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int wal_fd = -1;
+static bool wal_sync_writes = false;
+static off_t wal_offset = 0;
+static wal_stats_t wal_stats;
+
+/* Registered with the ring as fixed buffer 0, so it must never move */
+static char wal_buffer[WAL_BUFFER_SIZE];
+static size_t wal_used = 0;
+
+static __thread int batch_depth = 0;
+
+const char *
+wal_backend_name(wal_backend_t backend)
+{
+	switch (backend)
+	{
+		case WAL_BACKEND_SYNC:
+			return "sync";
+		case WAL_BACKEND_URING:
+			return "io_uring";
+		case WAL_BACKEND_AUTO:
+		default:
+			return "auto";
+	}
+}
+
+#ifdef HAVE_IO_URING
+static void
+wal_uring_teardown(void)
+{
+	if (wal_ring.sqes != NULL)
+		munmap(wal_ring.sqes, wal_ring.sqes_size);
+	if (wal_ring.cq_ptr != NULL && wal_ring.cq_ptr != wal_ring.sq_ptr)
+		munmap(wal_ring.cq_ptr, wal_ring.cq_size);
+	if (wal_ring.sq_ptr != NULL)
+		munmap(wal_ring.sq_ptr, wal_ring.sq_size);
+	if (wal_ring.fd >= 0)
+		close(wal_ring.fd);
+	memset(&wal_ring, 0, sizeof(wal_ring));
+	wal_ring.fd = -1;
+}
+
+static void *
+wal_uring_map(size_t size, off_t offset)
+{
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					 wal_ring.fd, offset);
+
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/* Set up the ring and register wal_fd and wal_buffer with it */
+static int
+wal_uring_setup(void)
+{
+	struct io_uring_params params;
+	struct iovec iov;
+	char	   *sq;
+	char	   *cq;
+
+	memset(&params, 0, sizeof(params));
+	wal_ring.fd = (int) syscall(__NR_io_uring_setup, WAL_URING_DEPTH, &params);
+	if (wal_ring.fd < 0)
+		return -1;
+
+	wal_ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	wal_ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+	{
+		if (wal_ring.cq_size > wal_ring.sq_size)
+			wal_ring.sq_size = wal_ring.cq_size;
+		wal_ring.cq_size = wal_ring.sq_size;
+	}
+
+	wal_ring.sq_ptr = wal_uring_map(wal_ring.sq_size, IORING_OFF_SQ_RING);
+	if (wal_ring.sq_ptr == NULL)
+		goto fail;
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+		wal_ring.cq_ptr = wal_ring.sq_ptr;
+	else if ((wal_ring.cq_ptr = wal_uring_map(wal_ring.cq_size, IORING_OFF_CQ_RING)) == NULL)
+		goto fail;
+	wal_ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	wal_ring.sqes = wal_uring_map(wal_ring.sqes_size, IORING_OFF_SQES);
+	if (wal_ring.sqes == NULL)
+		goto fail;
+
+	sq = wal_ring.sq_ptr;
+	cq = wal_ring.cq_ptr;
+	wal_ring.sq_head = (unsigned *) (void *) (sq + params.sq_off.head);
+	wal_ring.sq_tail = (unsigned *) (void *) (sq + params.sq_off.tail);
+	wal_ring.sq_mask = (unsigned *) (void *) (sq + params.sq_off.ring_mask);
+	wal_ring.sq_array = (unsigned *) (void *) (sq + params.sq_off.array);
+	wal_ring.cq_head = (unsigned *) (void *) (cq + params.cq_off.head);
+	wal_ring.cq_tail = (unsigned *) (void *) (cq + params.cq_off.tail);
+	wal_ring.cq_mask = (unsigned *) (void *) (cq + params.cq_off.ring_mask);
+	wal_ring.cqes = (struct io_uring_cqe *) (void *) (cq + params.cq_off.cqes);
+
+	if (syscall(__NR_io_uring_register, wal_ring.fd, IORING_REGISTER_FILES, &wal_fd, 1) < 0)
+		goto fail;
+	iov.iov_base = wal_buffer;
+	iov.iov_len = sizeof(wal_buffer);
+	if (syscall(__NR_io_uring_register, wal_ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+		goto fail;
+	return 0;
+
+fail:
+	wal_uring_teardown();
+	return -1;
+}
+
+/* Next free submission entry, cleared; only ever called under wal_mutex */
+static struct io_uring_sqe *
+wal_uring_get_sqe(unsigned *tail)
+{
+	unsigned			index = *tail & *wal_ring.sq_mask;
+	struct io_uring_sqe *sqe = &wal_ring.sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	wal_ring.sq_array[index] = index;
+	(*tail)++;
+	return sqe;
+}
+
+/*
+ * Write wal_buffer[0, wal_used) at wal_offset.  Each pass submits the
+ * remainder (plus its fsync) and reaps both in one io_uring_enter().
+ */
+static int
+wal_uring_flush(void)
+{
+	size_t		done = 0;
+
+	while (done < wal_used)
+	{
+		struct io_uring_sqe *sqe;
+		unsigned	tail = *wal_ring.sq_tail;
+		unsigned	pending = 1;
+		size_t		written = 0;
+		int			error = 0;
+
+		sqe = wal_uring_get_sqe(&tail);
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = 0;
+		sqe->addr = (uint64_t) (uintptr_t) (wal_buffer + done);
+		sqe->len = (uint32_t) (wal_used - done);
+		sqe->off = (uint64_t) wal_offset + done;
+		sqe->buf_index = 0;
+		sqe->user_data = WAL_OP_WRITE;
+		if (wal_sync_writes)
+		{
+			sqe->flags |= IOSQE_IO_LINK;
+			sqe = wal_uring_get_sqe(&tail);
+			sqe->opcode = IORING_OP_FSYNC;
+			sqe->flags = IOSQE_FIXED_FILE;
+			sqe->fd = 0;
+			sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+			sqe->user_data = WAL_OP_FSYNC;
+			pending++;
+		}
+		__atomic_store_n(wal_ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+		while (pending > 0)
+		{
+			unsigned	to_submit = tail - __atomic_load_n(wal_ring.sq_head, __ATOMIC_ACQUIRE);
+			unsigned	head;
+
+			wal_stats.syscalls++;
+			if (syscall(__NR_io_uring_enter, wal_ring.fd, to_submit, pending,
+						IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+				return -1;
+
+			head = *wal_ring.cq_head;
+			while (head != __atomic_load_n(wal_ring.cq_tail, __ATOMIC_ACQUIRE))
+			{
+				struct io_uring_cqe *cqe = &wal_ring.cqes[head & *wal_ring.cq_mask];
+
+				if (cqe->user_data == WAL_OP_WRITE)
+				{
+					if (cqe->res < 0)
+						error = -cqe->res;
+					else
+						written = (size_t) cqe->res;
+				}
+				else if (cqe->res < 0 && cqe->res != -ECANCELED)
+					error = -cqe->res;
+				head++;
+				pending--;
+			}
+			__atomic_store_n(wal_ring.cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		if (error != 0 || written == 0)
+		{
+			errno = error != 0 ? error : EIO;
+			return -1;
+		}
+		done += written;
+	}
+	return 0;
+}
+#endif
+
+static int
+wal_sync_flush(void)
+{
+	size_t		done = 0;
+
+	while (done < wal_used)
+	{
+		ssize_t		n = pwrite(wal_fd, wal_buffer + done, wal_used - done,
+							   wal_offset + (off_t) done);
+
+		wal_stats.syscalls++;
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += (size_t) n;
+	}
+	if (wal_sync_writes)
+	{
+		wal_stats.syscalls++;
+		if (fdatasync(wal_fd) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write out the buffer.  On failure the buffered records are dropped, as
+ * the old fopen()/fputs() path dropped them, and the tail is re-read so
+ * later records do not leave a hole.
+ */
+static int
+wal_flush_locked(void)
+{
+	int			ret;
+
+	if (wal_used == 0 || wal_fd < 0)
+		return 0;
+
+#ifdef HAVE_IO_URING
+	if (wal_stats.backend == WAL_BACKEND_URING)
+		ret = wal_uring_flush();
+	else
+#endif
+		ret = wal_sync_flush();
+
+	wal_stats.flushes++;
+	if (ret == 0)
+	{
+		wal_offset += (off_t) wal_used;
+		wal_stats.bytes += wal_used;
+	}
+	else
+	{
+		struct stat st;
+
+		rale_set_error_fmt(RALE_ERROR_DB_WRITE, MODULE,
+			"Failed to write %zu bytes to rale.db: %s.", wal_used, strerror(errno));
+		if (fstat(wal_fd, &st) == 0)
+			wal_offset = st.st_size;
+	}
+	wal_used = 0;
+	return ret;
+}
+
+int
+wal_open(const char *path, wal_backend_t backend, int sync,
+		 char *errbuf, size_t errbuflen)
+{
+	struct stat st;
+	int			fd;
+
+	if (path == NULL || path[0] == '\0')
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "WAL_ERR_INVALID: No file path given.");
+		return -1;
+	}
+
+	wal_close();
+
+	fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "WAL_ERR_FILE_IO: Cannot open \"%s\": %s.",
+					 path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	pthread_mutex_lock(&wal_mutex);
+	wal_fd = fd;
+	wal_offset = st.st_size;
+	wal_used = 0;
+	wal_sync_writes = sync != 0;
+	memset(&wal_stats, 0, sizeof(wal_stats));
+	wal_stats.backend = WAL_BACKEND_SYNC;
+
+#ifdef HAVE_IO_URING
+	if (backend != WAL_BACKEND_SYNC)
+	{
+		if (wal_uring_setup() == 0)
+			wal_stats.backend = WAL_BACKEND_URING;
+		else
+			rale_debug_log("io_uring unavailable for \"%s\" (%s), using sync writes",
+						   path, strerror(errno));
+	}
+#else
+	if (backend == WAL_BACKEND_URING)
+		rale_debug_log("io_uring not compiled in, using sync writes for \"%s\"", path);
+#endif
+	pthread_mutex_unlock(&wal_mutex);
+
+	rale_debug_log("rale.db writer open: \"%s\" at offset %lld, backend %s, sync %s",
+				   path, (long long) st.st_size, wal_backend_name(wal_stats.backend),
+				   sync ? "on" : "off");
+	return 0;
+}
+
+int
+wal_append(const char *record, size_t len)
+{
+	int			ret = 0;
+
+	if (record == NULL)
+		return -1;
+
+	pthread_mutex_lock(&wal_mutex);
+	if (wal_fd < 0)
+	{
+		pthread_mutex_unlock(&wal_mutex);
+		return -1;
+	}
+
+	wal_stats.appends++;
+	while (len > 0)
+	{
+		size_t		n = sizeof(wal_buffer) - wal_used;
+
+		if (n > len)
+			n = len;
+		memcpy(wal_buffer + wal_used, record, n);
+		wal_used += n;
+		record += n;
+		len -= n;
+		if (wal_used == sizeof(wal_buffer) && wal_flush_locked() != 0)
+			ret = -1;
+	}
+	if (batch_depth == 0 && wal_flush_locked() != 0)
+		ret = -1;
+	pthread_mutex_unlock(&wal_mutex);
+	return ret;
+}
+
+void
+wal_batch_begin(void)
+{
+	batch_depth++;
+}
+
+int
+wal_batch_end(void)
+{
+	if (batch_depth > 0 && --batch_depth == 0)
+		return wal_flush();
+	return 0;
+}
+
+int
+wal_flush(void)
+{
+	int			ret;
+
+	pthread_mutex_lock(&wal_mutex);
+	ret = wal_flush_locked();
+	pthread_mutex_unlock(&wal_mutex);
+	return ret;
+}
+
+void
+wal_get_stats(wal_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+	pthread_mutex_lock(&wal_mutex);
+	*stats = wal_stats;
+	pthread_mutex_unlock(&wal_mutex);
+}
+
+int
+wal_replace(const char *path, const char *replacement, char *errbuf, size_t errbuflen)
+{
+	wal_stats_t saved;
+	wal_backend_t backend;
+	bool		sync;
+	int			ret = 0;
+
+	pthread_mutex_lock(&wal_mutex);
+	if (wal_fd < 0)
+	{
+		pthread_mutex_unlock(&wal_mutex);
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "WAL_ERR_CLOSED: The writer is not open.");
+		return -1;
+	}
+	saved = wal_stats;
+	sync = wal_sync_writes;
+	pthread_mutex_unlock(&wal_mutex);
+
+	/* Buffered records land in the old file, which the rename then drops */
+	wal_close();
+	if (rename(replacement, path) != 0)
+	{
+		if (errbuf != NULL && errbuflen > 0)
+			snprintf(errbuf, errbuflen, "WAL_ERR_FILE_IO: Cannot rename \"%s\" to \"%s\": %s.",
+					 replacement, path, strerror(errno));
+		ret = -1;
+	}
+
+	/* Either way, keep appending to whatever is at path now */
+	if (wal_open(path, saved.backend, sync, ret == 0 ? errbuf : NULL, errbuflen) != 0)
+		return -1;
+	pthread_mutex_lock(&wal_mutex);
+	backend = wal_stats.backend;
+	wal_stats = saved;
+	wal_stats.backend = backend;
+	pthread_mutex_unlock(&wal_mutex);
+	return ret;
+}
+
+void
+wal_close(void)
+{
+	pthread_mutex_lock(&wal_mutex);
+	if (wal_fd >= 0)
+	{
+		(void) wal_flush_locked();
+#ifdef HAVE_IO_URING
+		if (wal_ring.fd >= 0)
+			wal_uring_teardown();
+#endif
+		close(wal_fd);
+		wal_fd = -1;
+	}
+	pthread_mutex_unlock(&wal_mutex);
+}
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #ifdef __linux__
 #include <linux/watchdog.h>
@@ -49,6 +50,7 @@ watchdog_config_init_defaults(watchdog_config_t *config)
 	config->timeout_seconds = WATCHDOG_DEFAULT_TIMEOUT;
 	config->safety_margin_seconds = WATCHDOG_SAFETY_MARGIN;
 	config->keepalive_interval_seconds = WATCHDOG_KEEPALIVE_INTERVAL;
+	config->tick_budget_ms = WATCHDOG_DEFAULT_TICK_BUDGET_MS;
 	config->test_mode = false;
 	config->soft_noboot = false;
 
@@ -143,6 +145,121 @@ watchdog_device_accessible(const char *device_path)
 	return false;
 }
 
+/*
+ * Open the device when the watchdog is enabled.  In test mode device_path
+ * is an ordinary file that records what a real device would be sent; with
+ * soft_noboot alone nothing is opened and expiry is only simulated, so the
+ * machine is never rebooted.  Called with the mutex held.
+ */
+static bool
+watchdog_open_device(watchdog_context_t *ctx)
+{
+	if (ctx->device_fd >= 0)
+	{
+		return true;
+	}
+
+	if (ctx->config.test_mode)
+	{
+		ctx->device_fd = open(ctx->config.device_path,
+			O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	}
+	else if (ctx->config.soft_noboot)
+	{
+		return true;
+	}
+	else
+	{
+		ctx->device_fd = open(ctx->config.device_path, O_WRONLY | O_CLOEXEC);
+#ifdef __linux__
+		if (ctx->device_fd >= 0)
+		{
+			int timeout = (int) ctx->config.timeout_seconds;
+
+			if (ioctl(ctx->device_fd, WDIOC_SETTIMEOUT, &timeout) != 0)
+			{
+				rale_debug_log("Watchdog %s kept its own timeout: %s",
+					ctx->config.device_path, strerror(errno));
+			}
+		}
+#endif
+	}
+
+	if (ctx->device_fd < 0)
+	{
+		rale_set_error_errno(RALE_ERROR_WATCHDOG_OPEN, MODULE,
+			"Failed to open watchdog device", ctx->config.device_path, NULL, errno);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Close the device with the magic character first, so the driver disarms
+ * instead of firing.  Called with the mutex held.
+ */
+static void
+watchdog_close_device(watchdog_context_t *ctx)
+{
+	const char *magic = ctx->config.test_mode ? "V\n" : "V";
+
+	if (ctx->device_fd < 0)
+	{
+		return;
+	}
+
+	if (write(ctx->device_fd, magic, strlen(magic)) < 0)
+	{
+		rale_debug_log("Watchdog magic close failed: %s", strerror(errno));
+	}
+	close(ctx->device_fd);
+	ctx->device_fd = -1;
+}
+
+/*
+ * Ping the device.  Called with the mutex held.
+ */
+static bool
+watchdog_feed_locked(watchdog_context_t *ctx, time_t now)
+{
+	bool ok = true;
+
+	if (ctx->device_fd >= 0)
+	{
+		if (ctx->config.test_mode)
+		{
+			char line[64];
+			int len = snprintf(line, sizeof(line), "keepalive %lld\n", (long long) now);
+
+			ok = write(ctx->device_fd, line, (size_t) len) == len;
+		}
+		else
+		{
+#ifdef __linux__
+			int dummy = 0;
+
+			ok = ioctl(ctx->device_fd, WDIOC_KEEPALIVE, &dummy) == 0;
+#else
+			ok = write(ctx->device_fd, "\0", 1) == 1;
+#endif
+		}
+	}
+
+	if (!ok)
+	{
+		ctx->stats.keepalives_failed++;
+		rale_set_error_errno(RALE_ERROR_WATCHDOG_FAILED, MODULE,
+			"Failed to send watchdog keepalive", ctx->config.device_path, NULL, errno);
+		return false;
+	}
+
+	ctx->last_keepalive = now;
+	ctx->expiry_reported = false;
+	ctx->stats.keepalives_sent++;
+	ctx->stats.last_keepalive = now;
+	return true;
+}
+
 /*
  * Initialize watchdog context
  */
@@ -200,11 +317,7 @@ watchdog_cleanup(watchdog_context_t *ctx)
 
 	pthread_mutex_lock(&ctx->mutex);
 	
-	if (ctx->device_fd >= 0)
-	{
-		close(ctx->device_fd);
-		ctx->device_fd = -1;
-	}
+	watchdog_close_device(ctx);
 	
 	ctx->state = WATCHDOG_STATE_UNINITIALIZED;
 	ctx->is_active = false;
@@ -236,24 +349,23 @@ watchdog_enable(watchdog_context_t *ctx)
 
 	pthread_mutex_lock(&ctx->mutex);
 	
-	if (ctx->config.test_mode)
+	if (!watchdog_open_device(ctx))
 	{
-		ctx->state = WATCHDOG_STATE_TEST_MODE;
-		ctx->is_active = true;
-		ctx->enabled_at = time(NULL);
-		ctx->stats.enable_count++;
-		ctx->stats.last_enable = ctx->enabled_at;
+		ctx->state = WATCHDOG_STATE_FAILED;
+		ctx->is_active = false;
 		pthread_mutex_unlock(&ctx->mutex);
-		rale_debug_log("Watchdog enabled in test mode");
-		return true;
+		return false;
 	}
 
-	/* For now, just mark as enabled without opening device */
-	ctx->state = WATCHDOG_STATE_ENABLED;
+	ctx->state = ctx->config.test_mode ? WATCHDOG_STATE_TEST_MODE : WATCHDOG_STATE_ENABLED;
 	ctx->is_active = true;
 	ctx->enabled_at = time(NULL);
+	ctx->last_keepalive = ctx->enabled_at;
+	ctx->expiry_reported = false;
 	ctx->stats.enable_count++;
 	ctx->stats.last_enable = ctx->enabled_at;
+	ctx->stats.current_timeout = ctx->config.timeout_seconds;
+	ctx->stats.is_test_mode = ctx->config.test_mode;
 	
 	pthread_mutex_unlock(&ctx->mutex);
 	rale_debug_log("Watchdog enabled");
@@ -275,11 +387,7 @@ watchdog_disable(watchdog_context_t *ctx)
 
 	pthread_mutex_lock(&ctx->mutex);
 	
-	if (ctx->device_fd >= 0)
-	{
-		close(ctx->device_fd);
-		ctx->device_fd = -1;
-	}
+	watchdog_close_device(ctx);
 	
 	ctx->state = WATCHDOG_STATE_DISABLED;
 	ctx->is_active = false;
@@ -312,9 +420,11 @@ watchdog_keepalive(watchdog_context_t *ctx)
 		return true;
 	}
 
-	ctx->last_keepalive = time(NULL);
-	ctx->stats.keepalives_sent++;
-	ctx->stats.last_keepalive = ctx->last_keepalive;
+	if (!watchdog_feed_locked(ctx, time(NULL)))
+	{
+		pthread_mutex_unlock(&ctx->mutex);
+		return false;
+	}
 	
 	pthread_mutex_unlock(&ctx->mutex);
 	rale_debug_log("Watchdog keepalive sent");
@@ -420,7 +530,9 @@ watchdog_get_platform_info(void)
 }
 
 /*
- * Check if watchdog can become leader
+ * Check if this node may stand for election.  The watchdog is armed only
+ * once the node leads, so with mode "required" a follower qualifies while
+ * its watchdog is armed or the device can be opened to arm it.
  */
 bool
 watchdog_can_become_leader(const watchdog_context_t *ctx)
@@ -430,17 +542,18 @@ watchdog_can_become_leader(const watchdog_context_t *ctx)
 		return false;
 	}
 
-	if (ctx->config.mode == WATCHDOG_MODE_DISABLED)
+	if (ctx->config.mode != WATCHDOG_MODE_REQUIRED || ctx->is_active)
 	{
 		return true;
 	}
 
-	if (ctx->config.mode == WATCHDOG_MODE_REQUIRED && !ctx->is_active)
+	/* Test mode creates its stand-in file; soft_noboot opens nothing */
+	if (ctx->config.test_mode || ctx->config.soft_noboot)
 	{
-		return false;
+		return true;
 	}
 
-	return true;
+	return access(ctx->config.device_path, W_OK) == 0;
 }
 
 /*
@@ -502,7 +615,196 @@ watchdog_get_stats(const watchdog_context_t *ctx, watchdog_stats_t *stats)
 		return;
 	}
 
+	pthread_mutex_lock((pthread_mutex_t *) &ctx->mutex);
 	memcpy(stats, &ctx->stats, sizeof(watchdog_stats_t));
+	pthread_mutex_unlock((pthread_mutex_t *) &ctx->mutex);
+}
+
+/*
+ * Histogram bucket of a tick: [0] under 1ms, [i] under 2^i ms
+ */
+static int
+watchdog_tick_bucket(uint64_t elapsed_us)
+{
+	uint64_t	ms = elapsed_us / 1000;
+	int			bucket = 0;
+
+	while (ms > 0 && bucket < WATCHDOG_TICK_BUCKETS - 1)
+	{
+		ms >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/*
+ * Mark the start of one main-loop iteration.  Only the loop thread calls
+ * this, so tick_started needs no lock.
+ */
+void
+watchdog_tick_begin(watchdog_context_t *ctx)
+{
+	if (!ctx)
+	{
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ctx->tick_started);
+}
+
+/*
+ * Mark the end of a main-loop iteration and return its duration in
+ * microseconds.
+ *
+ * This is the only place the watchdog is fed while the daemon runs: a
+ * tick that finishes within tick_budget_ms feeds it (at most once per
+ * keepalive interval), a slower one does not and sets *over_budget.  A loop
+ * that stalls or hangs therefore stops feeding, and the device fires once
+ * the stall outlasts its timeout.  In test_mode and soft_noboot, where
+ * nothing can reboot, that expiry is counted and recorded instead.
+ */
+uint64_t
+watchdog_tick_end(watchdog_context_t *ctx, bool *over_budget)
+{
+	struct timespec now;
+	int64_t		elapsed;
+	uint64_t	elapsed_us;
+	uint32_t	budget_ms;
+	time_t		wall;
+	bool		late;
+
+	if (over_budget)
+	{
+		*over_budget = false;
+	}
+	if (!ctx)
+	{
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (int64_t) (now.tv_sec - ctx->tick_started.tv_sec) * 1000000 +
+		(now.tv_nsec - ctx->tick_started.tv_nsec) / 1000;
+	elapsed_us = elapsed > 0 ? (uint64_t) elapsed : 0;
+	budget_ms = ctx->config.tick_budget_ms > 0 ?
+		ctx->config.tick_budget_ms : WATCHDOG_DEFAULT_TICK_BUDGET_MS;
+	late = elapsed_us > (uint64_t) budget_ms * 1000;
+	wall = time(NULL);
+
+	pthread_mutex_lock(&ctx->mutex);
+
+	ctx->stats.ticks++;
+	ctx->stats.last_tick_us = elapsed_us;
+	if (elapsed_us > ctx->stats.max_tick_us)
+	{
+		ctx->stats.max_tick_us = elapsed_us;
+	}
+	ctx->stats.tick_histogram[watchdog_tick_bucket(elapsed_us)]++;
+	if (late)
+	{
+		ctx->stats.ticks_over_budget++;
+	}
+
+	if (ctx->is_active)
+	{
+		if ((ctx->config.test_mode || ctx->config.soft_noboot) && !ctx->expiry_reported &&
+			wall - ctx->last_keepalive >= (time_t) ctx->config.timeout_seconds)
+		{
+			ctx->expiry_reported = true;
+			ctx->stats.expirations++;
+			if (ctx->device_fd >= 0)
+			{
+				char line[64];
+				int len = snprintf(line, sizeof(line), "expired %lld\n", (long long) wall);
+
+				if (write(ctx->device_fd, line, (size_t) len) != len)
+				{
+					rale_debug_log("Failed to record watchdog expiry: %s", strerror(errno));
+				}
+			}
+			rale_debug_log("Watchdog expired; not rebooting (test_mode/soft_noboot)");
+		}
+
+		if (!late && wall - ctx->last_keepalive >= (time_t) ctx->config.keepalive_interval_seconds)
+		{
+			(void) watchdog_feed_locked(ctx, wall);
+		}
+	}
+
+	pthread_mutex_unlock(&ctx->mutex);
+
+	if (over_budget)
+	{
+		*over_budget = late;
+	}
+	return elapsed_us;
+}
+
+/*
+ * Upper bound, in milliseconds, of the bucket holding the given percentile
+ * of tick durations.  The open-ended last bucket reports the maximum.
+ */
+uint32_t
+watchdog_tick_percentile(const watchdog_stats_t *stats, int percent)
+{
+	uint64_t	rank;
+	uint64_t	seen = 0;
+	int			i;
+
+	if (!stats || stats->ticks == 0)
+	{
+		return 0;
+	}
+
+	rank = (stats->ticks * (uint64_t) percent + 99) / 100;
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	for (i = 0; i < WATCHDOG_TICK_BUCKETS - 1; i++)
+	{
+		seen += stats->tick_histogram[i];
+		if (seen >= rank)
+		{
+			return 1u << i;
+		}
+	}
+	return (uint32_t) (stats->max_tick_us / 1000);
+}
+
+/*
+ * Whether a keepalive is due
+ */
+bool
+watchdog_time_to_keepalive(const watchdog_context_t *ctx)
+{
+	if (!ctx || !ctx->is_active)
+	{
+		return false;
+	}
+
+	return time(NULL) - ctx->last_keepalive >= (time_t) ctx->config.keepalive_interval_seconds;
+}
+
+/*
+ * Seconds left before the device fires without another keepalive
+ */
+uint32_t
+watchdog_time_until_expiry(const watchdog_context_t *ctx)
+{
+	time_t elapsed;
+
+	if (!ctx || !ctx->is_active)
+	{
+		return 0;
+	}
+
+	elapsed = time(NULL) - ctx->last_keepalive;
+	if (elapsed >= (time_t) ctx->config.timeout_seconds)
+	{
+		return 0;
+	}
+	return ctx->config.timeout_seconds - (uint32_t) elapsed;
 }
 
 /* Stub implementations for other functions - can be extended later */
@@ -514,8 +816,6 @@ int watchdog_device_get_timeout(const char *device_path) { (void)device_path; re
 bool watchdog_device_set_timeout(const char *device_path, uint32_t timeout_seconds) { (void)device_path; (void)timeout_seconds; return true; }
 uint32_t watchdog_calculate_safe_timeout(uint32_t ttl, uint32_t loop_wait, int32_t safety_margin) { (void)ttl; (void)loop_wait; (void)safety_margin; return WATCHDOG_DEFAULT_TIMEOUT; }
 bool watchdog_should_enable_for_leadership(const watchdog_context_t *ctx, uint32_t ttl) { (void)ctx; (void)ttl; return true; }
-bool watchdog_time_to_keepalive(const watchdog_context_t *ctx) { (void)ctx; return true; }
-uint32_t watchdog_time_until_expiry(const watchdog_context_t *ctx) { (void)ctx; return WATCHDOG_DEFAULT_TIMEOUT; }
 bool watchdog_enable_test_mode(watchdog_context_t *ctx) { (void)ctx; return true; }
 bool watchdog_disable_test_mode(watchdog_context_t *ctx) { (void)ctx; return true; }
 bool watchdog_simulate_failure(watchdog_context_t *ctx) { (void)ctx; return true; }
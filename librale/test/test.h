@@ -0,0 +1,65 @@
+/*-------------------------------------------------------------------------
+ *
+ * test.h
+ *		Checks shared by the librale test programs
+ *
+ * Each program runs its cases in order and exits non-zero if any check
+ * failed, which is all `make check` looks at.  assert() is no use here:
+ * the tree builds with NDEBUG.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RALE_TEST_H
+#define RALE_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int	test_failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+static inline uint64_t
+test_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static inline void
+test_sleep_ms(int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+/* Exit status for main() */
+static inline int
+test_result(const char *name)
+{
+	if (test_failures > 0)
+	{
+		fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+		return 1;
+	}
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+#endif							/* RALE_TEST_H */
@@ -0,0 +1,443 @@
+/*-------------------------------------------------------------------------
+ *
+ * test_client.c
+ *		rale_client against a mock cluster of two REST members
+ *
+ * Each mock member listens on a loopback port and answers POST
+ * /api/command from canned replies the test sets per phase: its STATUS,
+ * and what it says to PUT and GET.  The cases cover following a
+ * NOT_LEADER hint, ignoring a hint from an older term than the known
+ * leader's, and reads that carry min_rev: retried on the leader when a
+ * member times out, failing with RALE_CLIENT_TIMEOUT when it does too.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Local headers */
+#include "rale_client.h"
+#include "test.h"
+
+#define MOCK_MEMBERS		2
+#define MOCK_CONNS			16
+#define MOCK_REPLY_SIZE		160
+#define MOCK_REQUEST_SIZE	8192
+
+typedef struct mock_member
+{
+	int			listen_fd;
+	uint16_t	port;
+	char		status[MOCK_REPLY_SIZE];	/* Body of the STATUS reply */
+	char		put_reply[MOCK_REPLY_SIZE];
+	char		put_once[MOCK_REPLY_SIZE];	/* Replaces put_reply for one PUT */
+	char		get_reply[MOCK_REPLY_SIZE];
+	char		last_get[MOCK_REPLY_SIZE];	/* Body of the last GET */
+	int			statuses;
+	int			puts;
+	int			gets;
+} mock_member_t;
+
+typedef struct mock_conn
+{
+	int			fd;
+	int			member;
+	size_t		len;
+	char		buf[MOCK_REQUEST_SIZE];
+} mock_conn_t;
+
+static pthread_mutex_t mock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mock_member_t mock[MOCK_MEMBERS];
+static mock_conn_t mock_conns[MOCK_CONNS];
+static volatile bool mock_stopping = false;
+
+static void
+mock_set(char *field, const char *text)
+{
+	pthread_mutex_lock(&mock_mutex);
+	snprintf(field, MOCK_REPLY_SIZE, "%s", text);
+	pthread_mutex_unlock(&mock_mutex);
+}
+
+static int
+mock_count(const int *counter)
+{
+	int			count;
+
+	pthread_mutex_lock(&mock_mutex);
+	count = *counter;
+	pthread_mutex_unlock(&mock_mutex);
+	return count;
+}
+
+/* The reply body member m gives to a request body; mock_mutex held */
+static const char *
+mock_answer(mock_member_t *m, const char *body)
+{
+	if (strstr(body, "\"command\":\"STATUS\"") != NULL)
+	{
+		m->statuses++;
+		return m->status;
+	}
+	if (strstr(body, "\"command\":\"PUT\"") != NULL)
+	{
+		m->puts++;
+		if (m->put_once[0] != '\0')
+		{
+			static char once[MOCK_REPLY_SIZE];
+
+			memcpy(once, m->put_once, sizeof(once));
+			m->put_once[0] = '\0';
+			return once;
+		}
+		return m->put_reply;
+	}
+	if (strstr(body, "\"command\":\"GET\"") != NULL)
+	{
+		m->gets++;
+		snprintf(m->last_get, sizeof(m->last_get), "%.*s", MOCK_REPLY_SIZE - 1, body);
+		return m->get_reply;
+	}
+	return "{\"error\":\"unknown command\"}";
+}
+
+/* Answer every complete request buffered on conn; false once it is closed */
+static bool
+mock_serve(mock_conn_t *conn)
+{
+	for (;;)
+	{
+		char		head[MOCK_REPLY_SIZE * 2];
+		char		body[MOCK_REQUEST_SIZE];
+		const char *end;
+		const char *length;
+		const char *answer;
+		size_t		head_len;
+		size_t		body_len;
+		int			n;
+
+		conn->buf[conn->len] = '\0';
+		end = strstr(conn->buf, "\r\n\r\n");
+		if (end == NULL)
+			return true;
+		head_len = (size_t) (end - conn->buf) + 4;
+		length = strstr(conn->buf, "Content-Length:");
+		if (length == NULL || length > end)
+			return false;
+		body_len = (size_t) strtoul(length + 15, NULL, 10);
+		if (body_len >= sizeof(body) || head_len + body_len >= sizeof(conn->buf))
+			return false;
+		if (conn->len < head_len + body_len)
+			return true;
+		memcpy(body, conn->buf + head_len, body_len);
+		body[body_len] = '\0';
+		memmove(conn->buf, conn->buf + head_len + body_len, conn->len - head_len - body_len);
+		conn->len -= head_len + body_len;
+
+		pthread_mutex_lock(&mock_mutex);
+		answer = mock_answer(&mock[conn->member], body);
+		n = snprintf(head, sizeof(head),
+					 "HTTP/1.1 200 OK\r\n"
+					 "Content-Type: application/json\r\n"
+					 "Content-Length: %zu\r\n"
+					 "\r\n%s", strlen(answer), answer);
+		pthread_mutex_unlock(&mock_mutex);
+		if (write(conn->fd, head, (size_t) n) != n)
+			return false;
+	}
+}
+
+static void *
+mock_run(void *arg)
+{
+	struct pollfd fds[MOCK_MEMBERS + MOCK_CONNS];
+	int			i;
+
+	(void) arg;
+	while (!mock_stopping)
+	{
+		int			nfds = 0;
+
+		for (i = 0; i < MOCK_MEMBERS; i++)
+		{
+			fds[nfds].fd = mock[i].listen_fd;
+			fds[nfds++].events = POLLIN;
+		}
+		for (i = 0; i < MOCK_CONNS; i++)
+		{
+			fds[nfds].fd = mock_conns[i].fd;
+			fds[nfds++].events = POLLIN;
+		}
+		if (poll(fds, (nfds_t) nfds, 20) <= 0)
+			continue;
+
+		for (i = 0; i < MOCK_MEMBERS; i++)
+		{
+			int			fd;
+			int			c;
+
+			if (!(fds[i].revents & POLLIN) || (fd = accept(mock[i].listen_fd, NULL, NULL)) < 0)
+				continue;
+			for (c = 0; c < MOCK_CONNS && mock_conns[c].fd >= 0; c++)
+				;
+			if (c == MOCK_CONNS)
+			{
+				close(fd);
+				continue;
+			}
+			mock_conns[c].fd = fd;
+			mock_conns[c].member = i;
+			mock_conns[c].len = 0;
+		}
+		for (i = 0; i < MOCK_CONNS; i++)
+		{
+			mock_conn_t *conn = &mock_conns[i];
+			ssize_t		n;
+
+			if (conn->fd < 0 || !(fds[MOCK_MEMBERS + i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			n = read(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - 1 - conn->len);
+			if (n > 0)
+				conn->len += (size_t) n;
+			if (n <= 0 || !mock_serve(conn))
+			{
+				close(conn->fd);
+				conn->fd = -1;
+			}
+		}
+	}
+	return NULL;
+}
+
+static int
+mock_start(pthread_t *thread)
+{
+	int			i;
+
+	for (i = 0; i < MOCK_CONNS; i++)
+		mock_conns[i].fd = -1;
+	for (i = 0; i < MOCK_MEMBERS; i++)
+	{
+		struct sockaddr_in addr;
+		socklen_t	len = sizeof(addr);
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		mock[i].listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (mock[i].listen_fd < 0 ||
+			bind(mock[i].listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+			listen(mock[i].listen_fd, 8) != 0 ||
+			getsockname(mock[i].listen_fd, (struct sockaddr *) &addr, &len) != 0)
+			return -1;
+		mock[i].port = ntohs(addr.sin_port);
+	}
+	return pthread_create(thread, NULL, mock_run, NULL);
+}
+
+static void
+mock_stop(pthread_t thread)
+{
+	int			i;
+
+	mock_stopping = true;
+	pthread_join(thread, NULL);
+	for (i = 0; i < MOCK_CONNS; i++)
+	{
+		if (mock_conns[i].fd >= 0)
+			close(mock_conns[i].fd);
+	}
+	for (i = 0; i < MOCK_MEMBERS; i++)
+		close(mock[i].listen_fd);
+}
+
+static rale_client_t *
+client_connect(bool read_any)
+{
+	rale_client_options_t options;
+	char		names[MOCK_MEMBERS][32];
+	const char *members[MOCK_MEMBERS];
+	char		errbuf[128];
+	int			i;
+
+	memset(&options, 0, sizeof(options));
+	options.request_timeout_ms = 2000;
+	options.reconnect_ms = 50;
+	options.read_any = read_any;
+	for (i = 0; i < MOCK_MEMBERS; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "127.0.0.1:%u", (unsigned) mock[i].port);
+		members[i] = names[i];
+	}
+	return rale_client_create(members, MOCK_MEMBERS, &options, errbuf, sizeof(errbuf));
+}
+
+/* Process client until it follows leader and every member answered STATUS */
+static void
+client_settle(rale_client_t *client, int32_t leader)
+{
+	uint64_t	deadline = test_now_ms() + 2000;
+	uint64_t	settled = 0;
+
+	while (test_now_ms() < deadline)
+	{
+		rale_client_process(client, 10);
+		if (rale_client_leader(client) != leader ||
+			mock_count(&mock[0].statuses) == 0 || mock_count(&mock[1].statuses) == 0)
+			settled = 0;
+		else if (settled == 0)
+			settled = test_now_ms();
+		else if (test_now_ms() - settled >= 50)
+			return;
+	}
+}
+
+/* Submit-and-wait helpers; the future is released, its outcome copied out */
+static rale_client_status_t
+client_wait(rale_client_t *client, rale_future_t *future, char *value, size_t value_size,
+			uint64_t *revision)
+{
+	rale_client_status_t status;
+
+	if (future == NULL)
+		return RALE_CLIENT_ERROR;
+	status = rale_future_wait(client, future, 3000);
+	snprintf(value, value_size, "%s",
+			 rale_future_value(future) != NULL ? rale_future_value(future) : "");
+	if (revision != NULL)
+		*revision = rale_future_revision(future);
+	rale_future_release(future);
+	return status;
+}
+
+/*
+ * Node 1 claims leadership in term 4 and refuses the write, naming node 2
+ * in term 5; the client resends it there and keeps node 2 as leader.
+ */
+static void
+test_not_leader_hint(rale_client_t *client)
+{
+	char		value[MOCK_REPLY_SIZE];
+	uint64_t	revision = 0;
+
+	client_settle(client, 1);
+	CHECK(rale_client_leader(client) == 1);
+
+	CHECK(client_wait(client, rale_client_put(client, "k", "v1", NULL, NULL),
+					  value, sizeof(value), &revision) == RALE_CLIENT_OK);
+	CHECK(strcmp(value, "v1") == 0);
+	CHECK(revision == 7);
+	CHECK(rale_client_leader(client) == 2);
+	CHECK(rale_client_revision(client) == 7);
+	CHECK(mock_count(&mock[0].puts) == 1);
+	CHECK(mock_count(&mock[1].puts) == 1);
+}
+
+/*
+ * Node 2, the leader of term 5, refuses a write with a hint back to node
+ * 1 from term 4.  The client must not go back to node 1: it rediscovers,
+ * finds node 2 leading term 6 and sends the write there again.
+ */
+static void
+test_stale_hint(rale_client_t *client)
+{
+	char		value[MOCK_REPLY_SIZE];
+	uint64_t	revision = 0;
+
+	mock_set(mock[0].status, "{\"node_id\":1,\"role\":\"follower\",\"leader_id\":2}");
+	mock_set(mock[0].put_reply, "{\"result\":\"OK: wrong\",\"revision\":99}");
+	mock_set(mock[1].status, "{\"node_id\":2,\"role\":\"leader\",\"term\":6}");
+	mock_set(mock[1].put_once, "{\"result\":\"ERROR: NOT_LEADER 1 127.0.0.1 4\"}");
+	mock_set(mock[1].put_reply, "{\"result\":\"OK: v2\",\"revision\":8}");
+
+	CHECK(client_wait(client, rale_client_put(client, "k", "v2", NULL, NULL),
+					  value, sizeof(value), &revision) == RALE_CLIENT_OK);
+	CHECK(strcmp(value, "v2") == 0);
+	CHECK(revision == 8);
+	CHECK(rale_client_leader(client) == 2);
+	CHECK(mock_count(&mock[0].puts) == 1);
+	CHECK(mock_count(&mock[1].puts) == 3);
+}
+
+/*
+ * With read_any, the first GET goes to node 1, which has not applied the
+ * session's revision in time; the leader serves it instead.  When the
+ * leader times out as well, the read fails with RALE_CLIENT_TIMEOUT.
+ */
+static void
+test_min_rev(void)
+{
+	rale_client_t *client = client_connect(true);
+	char		value[MOCK_REPLY_SIZE];
+	char		last_get[MOCK_REPLY_SIZE];
+	int			gets;
+
+	CHECK(client != NULL);
+	if (client == NULL)
+		return;
+	client_settle(client, 2);
+	rale_client_advance_revision(client, 8);
+	CHECK(rale_client_revision(client) == 8);
+
+	mock_set(mock[0].get_reply, "{\"result\":\"ERROR: REVISION_TIMEOUT 3\"}");
+	mock_set(mock[1].get_reply, "{\"result\":\"OK: v2\",\"revision\":8}");
+	CHECK(client_wait(client, rale_client_get(client, "k", NULL, NULL),
+					  value, sizeof(value), NULL) == RALE_CLIENT_OK);
+	CHECK(strcmp(value, "v2") == 0);
+	CHECK(mock_count(&mock[0].gets) == 1);
+	CHECK(mock_count(&mock[1].gets) == 1);
+	pthread_mutex_lock(&mock_mutex);
+	memcpy(last_get, mock[0].last_get, sizeof(last_get));
+	pthread_mutex_unlock(&mock_mutex);
+	CHECK(strstr(last_get, "\"min_rev\":8") != NULL);
+
+	mock_set(mock[1].get_reply, "{\"result\":\"ERROR: REVISION_TIMEOUT 5\"}");
+	gets = mock_count(&mock[1].gets);
+	CHECK(client_wait(client, rale_client_get(client, "k", NULL, NULL),
+					  value, sizeof(value), NULL) == RALE_CLIENT_TIMEOUT);
+	CHECK(strcmp(value, "REVISION_TIMEOUT 5") == 0);
+	CHECK(mock_count(&mock[1].gets) >= gets + 1);
+
+	rale_client_destroy(client);
+}
+
+int
+main(void)
+{
+	rale_client_t *client;
+	pthread_t	thread;
+
+	mock_set(mock[0].status, "{\"node_id\":1,\"role\":\"leader\",\"term\":4}");
+	mock_set(mock[0].put_reply, "{\"result\":\"ERROR: NOT_LEADER 2 127.0.0.1 5\"}");
+	mock_set(mock[1].status, "{\"node_id\":2,\"role\":\"follower\"}");
+	mock_set(mock[1].put_reply, "{\"result\":\"OK: v1\",\"revision\":7}");
+	if (mock_start(&thread) != 0)
+	{
+		fprintf(stderr, "test_client: cannot start the mock cluster\n");
+		return 1;
+	}
+
+	client = client_connect(false);
+	CHECK(client != NULL);
+	if (client != NULL)
+	{
+		test_not_leader_hint(client);
+		test_stale_hint(client);
+		rale_client_destroy(client);
+	}
+	test_min_rev();
+
+	mock_stop(thread);
+	return test_result("test_client");
+}
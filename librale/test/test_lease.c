@@ -0,0 +1,131 @@
+/*-------------------------------------------------------------------------
+ *
+ * test_lease.c
+ *		Lease table: expiry, keepalives and the keys a lease takes along
+ *
+ * Runs against the table in lease.c alone, with one-second TTLs on a
+ * clock the test advances itself, so no time actually passes.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Local headers */
+#include "lease.h"
+#include "test.h"
+
+typedef struct removed_keys
+{
+	int			count;
+	char		keys[4][16];
+} removed_keys_t;
+
+static void
+collect_key(const char *key, void *arg)
+{
+	removed_keys_t *removed = arg;
+
+	if (removed->count < 4)
+		snprintf(removed->keys[removed->count], sizeof(removed->keys[0]), "%s", key);
+	removed->count++;
+}
+
+static bool
+removed_has(const removed_keys_t *removed, const char *key)
+{
+	int			i;
+
+	for (i = 0; i < removed->count && i < 4; i++)
+	{
+		if (strcmp(removed->keys[i], key) == 0)
+			return true;
+	}
+	return false;
+}
+
+static uint64_t test_clock_ms = 1000000;
+
+static uint64_t
+test_clock(void)
+{
+	return test_clock_ms;
+}
+
+int
+main(void)
+{
+	removed_keys_t removed;
+	lease_stats_t stats;
+	uint64_t	ids[8];
+	char	   *renewals;
+
+	lease_set_clock(test_clock);
+	CHECK(lease_grant(10, 1) == 0);
+	CHECK(lease_grant(20, 1) == 0);
+	CHECK(lease_grant(0, 1) == -1);
+	CHECK(lease_attach("a", 10) == 0);
+	CHECK(lease_attach("b", 10) == 0);
+	CHECK(lease_attach("c", 20) == 0);
+	CHECK(lease_attach("d", 99) == -1);
+
+	/* Moving a key to another lease detaches it from the first */
+	CHECK(lease_attach("b", 20) == 0);
+	CHECK(lease_key_attached("a"));
+	CHECK(!lease_key_attached("d"));
+
+	/* The first call as leader grants the failover grace and expires nothing */
+	CHECK(lease_expired(true, ids, 8) == 0);
+
+	test_clock_ms += 600;
+	CHECK(lease_keepalive(10) == 1);
+	CHECK(lease_keepalive(99) == -1);
+
+	/* Only the lease nobody renewed has run out */
+	test_clock_ms += 600;
+	CHECK(lease_expired(true, ids, 8) == 1);
+	CHECK(ids[0] == 20);
+	CHECK(lease_keepalive(20) == -1);
+
+	/* The renewal is shipped once */
+	renewals = lease_take_renewals();
+	CHECK(renewals != NULL && strcmp(renewals, LEASE_RENEW_PREFIX "10") == 0);
+	free(renewals);
+	CHECK(lease_take_renewals() == NULL);
+
+	/* Expiry takes the lease's keys, including the one moved to it */
+	memset(&removed, 0, sizeof(removed));
+	CHECK(lease_revoke(20, true, collect_key, &removed) == 2);
+	CHECK(removed.count == 2 && removed_has(&removed, "b") && removed_has(&removed, "c"));
+	CHECK(!lease_exists(20));
+	CHECK(!lease_key_attached("c"));
+	CHECK(lease_key_attached("a"));
+
+	/* A lease renewed since it was found expired is kept */
+	CHECK(lease_keepalive(10) == 1);
+	CHECK(lease_revoke(10, true, NULL, NULL) == -1);
+	CHECK(lease_exists(10));
+
+	/* Followers never expire anything, even past the deadline */
+	test_clock_ms += 1100;
+	CHECK(lease_expired(false, ids, 8) == 0);
+	memset(&removed, 0, sizeof(removed));
+	CHECK(lease_revoke(10, true, collect_key, &removed) == 1);
+	CHECK(removed.count == 1 && removed_has(&removed, "a"));
+
+	lease_get_stats(&stats);
+	CHECK(stats.leases == 0);
+	CHECK(stats.keys == 0);
+	CHECK(stats.granted == 2);
+	CHECK(stats.expired == 2);
+	CHECK(stats.keepalives == 2);
+
+	lease_set_clock(NULL);
+
+	return test_result("test_lease");
+}
@@ -0,0 +1,212 @@
+/*-------------------------------------------------------------------------
+ *
+ * test_lsm.c
+ *		LSM engine: round trip, deletes, snapshots and reopening
+ *
+ * Runs against lsm.c alone in a scratch directory, with a 64 KB memtable
+ * so a few thousand writes go through flushes and level-0 compactions.
+ * Everything written must read back the same before and after a reopen,
+ * with deleted keys staying deleted once their tombstones are on disk.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Local headers */
+#include "lsm.h"
+#include "test.h"
+
+#define TEST_KEYS		3000
+#define TEST_VALUE_LEN	100
+
+static void
+test_key(int i, char *key, size_t size)
+{
+	snprintf(key, size, "key%05d", i);
+}
+
+/* Value of key i in write round 0 (the fill) or 1 (the overwrites) */
+static void
+test_value(int i, int round, char *value, size_t size)
+{
+	snprintf(value, size, "%d-%d-%0*d", round, i, TEST_VALUE_LEN, i);
+}
+
+static bool
+test_deleted(int i)
+{
+	return i % 10 == 0;
+}
+
+static bool
+test_overwritten(int i)
+{
+	return i % 7 == 0;
+}
+
+static lsm_t *
+test_open(const char *dir)
+{
+	lsm_options_t options;
+	char		errbuf[256];
+	lsm_t	   *lsm;
+
+	memset(&options, 0, sizeof(options));
+	options.memtable_bytes = 64 * 1024;
+	options.sst_bytes = 64 * 1024;
+	options.level_base_bytes = 256 * 1024;
+	options.level0_files = 2;
+	lsm = lsm_open(dir, &options, errbuf, sizeof(errbuf));
+	if (lsm == NULL)
+		fprintf(stderr, "lsm_open: %s\n", errbuf);
+	return lsm;
+}
+
+/* Every key holds its latest value or is absent; the iterator agrees */
+static void
+test_check_contents(lsm_t *lsm)
+{
+	char		key[32];
+	char		expected[TEST_VALUE_LEN + 32];
+	char		value[TEST_VALUE_LEN + 32];
+	char		previous[32] = "";
+	lsm_iter_t *iter;
+	int			live = 0;
+	int			seen = 0;
+	int			i;
+
+	for (i = 0; i < TEST_KEYS; i++)
+	{
+		test_key(i, key, sizeof(key));
+		if (test_deleted(i))
+		{
+			CHECK(lsm_get(lsm, NULL, key, strlen(key), value, sizeof(value)) == 1);
+			continue;
+		}
+		test_value(i, test_overwritten(i) ? 1 : 0, expected, sizeof(expected));
+		CHECK(lsm_get(lsm, NULL, key, strlen(key), value, sizeof(value)) == 0);
+		CHECK(strcmp(value, expected) == 0);
+		live++;
+	}
+	CHECK(lsm_get(lsm, NULL, "absent", 6, value, sizeof(value)) == 1);
+
+	/* Ascending, each key once, no tombstones */
+	iter = lsm_iter_open(lsm, NULL);
+	CHECK(iter != NULL);
+	for (; iter != NULL && lsm_iter_valid(iter); lsm_iter_next(iter))
+	{
+		CHECK(strcmp(previous, lsm_iter_key(iter)) < 0);
+		CHECK(!test_deleted(atoi(lsm_iter_key(iter) + 3)));
+		snprintf(previous, sizeof(previous), "%s", lsm_iter_key(iter));
+		seen++;
+	}
+	lsm_iter_close(iter);
+	CHECK(seen == live);
+}
+
+/* Remove the engine's files, then its directory and the scratch one */
+static void
+test_remove(const char *root, const char *dir)
+{
+	char		path[1100];
+	DIR		   *d = opendir(dir);
+	struct dirent *de;
+
+	while (d != NULL && (de = readdir(d)) != NULL)
+	{
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		(void) unlink(path);
+	}
+	if (d != NULL)
+		closedir(d);
+	(void) rmdir(dir);
+	(void) rmdir(root);
+}
+
+int
+main(void)
+{
+	char		root[] = "/tmp/test_lsm.XXXXXX";
+	char		dir[64];
+	char		key[32];
+	char		value[TEST_VALUE_LEN + 32];
+	char		old[TEST_VALUE_LEN + 32];
+	lsm_snapshot_t *snapshot;
+	lsm_stats_t stats;
+	lsm_t	   *lsm;
+	int			i;
+
+	if (mkdtemp(root) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(dir, sizeof(dir), "%s/lsm", root);
+
+	lsm = test_open(dir);
+	CHECK(lsm != NULL);
+	if (lsm == NULL)
+		return test_result("test_lsm");
+
+	for (i = 0; i < TEST_KEYS; i++)
+	{
+		test_key(i, key, sizeof(key));
+		test_value(i, 0, value, sizeof(value));
+		CHECK(lsm_put(lsm, key, strlen(key), value, strlen(value), NULL, 0) == 0);
+	}
+
+	/* A snapshot keeps seeing the fill through the overwrites and deletes */
+	snapshot = lsm_snapshot_acquire(lsm);
+	CHECK(snapshot != NULL);
+	for (i = 0; i < TEST_KEYS; i++)
+	{
+		test_key(i, key, sizeof(key));
+		if (test_deleted(i))
+		{
+			CHECK(lsm_delete(lsm, key, strlen(key), NULL, 0) == 0);
+		}
+		else if (test_overwritten(i))
+		{
+			test_value(i, 1, value, sizeof(value));
+			CHECK(lsm_put(lsm, key, strlen(key), value, strlen(value), NULL, 0) == 0);
+		}
+	}
+	test_key(10, key, sizeof(key));
+	test_value(10, 0, old, sizeof(old));
+	CHECK(lsm_get(lsm, snapshot, key, strlen(key), value, sizeof(value)) == 0);
+	CHECK(strcmp(value, old) == 0);
+	test_key(7, key, sizeof(key));
+	test_value(7, 0, old, sizeof(old));
+	CHECK(lsm_get(lsm, snapshot, key, strlen(key), value, sizeof(value)) == 0);
+	CHECK(strcmp(value, old) == 0);
+	lsm_snapshot_release(lsm, snapshot);
+
+	test_check_contents(lsm);
+
+	/* Several memtables' worth of writes went out as SSTs */
+	lsm_get_stats(lsm, &stats);
+	CHECK(stats.flushes > 0);
+	lsm_close(lsm);
+
+	/* Reopened from its own files: the log, the SSTs and the MANIFEST */
+	lsm = test_open(dir);
+	CHECK(lsm != NULL);
+	if (lsm != NULL)
+	{
+		test_check_contents(lsm);
+		lsm_close(lsm);
+	}
+
+	test_remove(root, dir);
+	return test_result("test_lsm");
+}
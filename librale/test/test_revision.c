@@ -0,0 +1,44 @@
+/*-------------------------------------------------------------------------
+ *
+ * test_revision.c
+ *		Reads with min_rev: waiting for a revision this node has not applied
+ *
+ * A GET with min_rev beyond what the member applied waits in
+ * dstore_wait_revision() and answers REVISION_TIMEOUT when that gives up.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <stdint.h>
+
+/** Local headers */
+#include "dstore.h"
+#include "test.h"
+
+int
+main(void)
+{
+	uint64_t	started;
+	uint64_t	elapsed;
+
+	/* Nothing applied yet; revision 0 is always there */
+	CHECK(dstore_applied_revision() == 0);
+	CHECK(dstore_wait_revision(0, 1000) == 0);
+
+	/* A revision never applied times out, neither early nor much late */
+	started = test_now_ms();
+	CHECK(dstore_wait_revision(5, 150) == 1);
+	elapsed = test_now_ms() - started;
+	CHECK(elapsed >= 150);
+	CHECK(elapsed < 1000);
+
+	/* No wait at all */
+	started = test_now_ms();
+	CHECK(dstore_wait_revision(5, 0) == 1);
+	CHECK(test_now_ms() - started < 100);
+
+	return test_result("test_revision");
+}
@@ -0,0 +1,70 @@
+/*-------------------------------------------------------------------------
+ *
+ * ralectrl_bulk.h
+ *		Bulk import and export of key/value data for ralectrl
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RALECTRL_BULK_H
+#define RALECTRL_BULK_H
+
+#include <stdbool.h>
+
+#include "ralectrl_http_client.h"
+
+/*-------------------------------------------------------------------------
+ * Bulk Transfer Configuration
+ *-------------------------------------------------------------------------*/
+
+#define RALECTRL_BULK_DEFAULT_BATCH     256     /* Records per PUT_BATCH */
+#define RALECTRL_BULK_DEFAULT_WORKERS   4       /* Parallel connections */
+#define RALECTRL_BULK_DEFAULT_INFLIGHT  8       /* Pipelined requests per connection */
+#define RALECTRL_BULK_DEFAULT_PAGE      1000    /* Records per EXPORT page */
+#define RALECTRL_BULK_MAX_BATCH         4096
+#define RALECTRL_BULK_MAX_WORKERS       64
+#define RALECTRL_BULK_MAX_INFLIGHT      64
+#define RALECTRL_BULK_MAX_RETRIES       3       /* Reconnects before a batch fails */
+
+typedef enum {
+    RALECTRL_BULK_NDJSON = 0,           /* One {"key":...,"value":...} per line */
+    RALECTRL_BULK_SNAPSHOT              /* Binary layout written by hash_save() */
+} ralectrl_bulk_format_t;
+
+typedef struct {
+    const char              *path;      /* Input/output file, "-" for stdin/stdout */
+    ralectrl_bulk_format_t  format;
+    int                     batch_size;
+    int                     workers;
+    int                     inflight;
+    int                     page_size;
+    bool                    progress;   /* Report progress on stderr */
+} ralectrl_bulk_options_t;
+
+/*-------------------------------------------------------------------------
+ * Bulk Transfer Functions
+ *-------------------------------------------------------------------------*/
+
+/**
+ * Initialize bulk options with defaults
+ */
+void ralectrl_bulk_options_init(ralectrl_bulk_options_t *options);
+
+/**
+ * Parse a format name ("ndjson" or "snapshot")
+ */
+int ralectrl_bulk_parse_format(const char *name, ralectrl_bulk_format_t *format);
+
+/**
+ * Stream records from options->path into the store
+ */
+int ralectrl_bulk_import(const ralectrl_http_config_t *config, const ralectrl_bulk_options_t *options);
+
+/**
+ * Stream every record in the store to options->path
+ */
+int ralectrl_bulk_export(const ralectrl_http_config_t *config, const ralectrl_bulk_options_t *options);
+
+#endif												/* RALECTRL_BULK_H */
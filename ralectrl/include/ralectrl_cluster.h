@@ -0,0 +1,45 @@
+/*-------------------------------------------------------------------------
+ *
+ * ralectrl_cluster.h
+ *		Cluster-wide status fan-out for ralectrl
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RALECTRL_CLUSTER_H
+#define RALECTRL_CLUSTER_H
+
+#include <stdint.h>
+
+#include "ralectrl_http_client.h"
+
+/*-------------------------------------------------------------------------
+ * Cluster Status Configuration
+ *-------------------------------------------------------------------------*/
+
+#define RALECTRL_CLUSTER_DEFAULT_TIMEOUT_MS 2000    /* Per-node deadline */
+#define RALECTRL_CLUSTER_MAX_NODES          256
+
+typedef struct {
+    int         timeout_ms;             /* Deadline for every node's reply */
+    uint16_t    http_port;              /* REST port of members, 0 = same as seed */
+} ralectrl_cluster_options_t;
+
+/*-------------------------------------------------------------------------
+ * Cluster Status Functions
+ *-------------------------------------------------------------------------*/
+
+/**
+ * Initialize cluster status options with defaults
+ */
+void ralectrl_cluster_options_init(ralectrl_cluster_options_t *options);
+
+/**
+ * Ask the seed server for the member list, query every member concurrently
+ * and print one aggregated table; returns -1 unless every member answered
+ */
+int ralectrl_cluster_status(const ralectrl_http_config_t *config, const ralectrl_cluster_options_t *options);
+
+#endif												/* RALECTRL_CLUSTER_H */
@@ -22,6 +22,12 @@
 #define RALECTRL_HTTP_DEFAULT_TIMEOUT   30
 #define RALECTRL_HTTP_BUFFER_SIZE       8192
 #define RALECTRL_HTTP_MAX_REDIRECTS     5
+#define RALECTRL_HTTP_MAX_HEADER_SIZE   65536   /* Largest response header block accepted */
+#define RALECTRL_HTTP_POOL_SIZE         32      /* Idle keep-alive connections kept */
+#define RALECTRL_HTTP_POOL_IDLE_SECONDS 4       /* Below raled's 5s idle timeout */
+
+/* Idle keep-alive connections keyed by host:port; see ralectrl_http_request() */
+typedef struct ralectrl_http_pool ralectrl_http_pool_t;
 
 typedef struct {
     char        *server_host;           /* Server hostname or IP */
@@ -32,6 +38,7 @@ typedef struct {
     bool        verify_ssl;             /* Verify SSL certificates */
     char        *ca_cert_file;          /* CA certificate file */
     int         max_redirects;          /* Maximum HTTP redirects to follow */
+    ralectrl_http_pool_t *pool;         /* Connection pool, owned by config_init/cleanup */
 } ralectrl_http_config_t;
 
 typedef struct {
@@ -42,6 +49,43 @@ typedef struct {
     long        response_time_ms;       /* Response time in milliseconds */
 } ralectrl_http_response_t;
 
+/*
+ * A persistent (keep-alive) connection.  Requests may be pipelined: call
+ * ralectrl_http_conn_send() several times, then collect the responses in
+ * order with ralectrl_http_conn_receive().
+ */
+typedef struct {
+    int         sockfd;                 /* Connected socket, -1 when closed */
+    const ralectrl_http_config_t *config;
+    char        *rbuf;                  /* Received bytes not yet consumed */
+    size_t      rlen;
+    size_t      rcap;
+    int         pending;                /* Requests sent but not yet answered */
+    bool        peer_closing;           /* Server sent Connection: close */
+
+    /* Parse state of the response at the front of rbuf */
+    size_t      scan_offset;            /* Bytes already searched for end of headers */
+    size_t      header_length;          /* 0 until the header block is complete */
+    size_t      body_offset;            /* Next undecoded byte of a chunked body */
+    size_t      content_length;
+    size_t      body_capacity;
+    int         body_mode;              /* Length, chunked or read-to-EOF */
+} ralectrl_http_conn_t;
+
+/*
+ * One request of a fan-out.  Calls may target different servers; configs
+ * copied from one initialized config share its connection pool.
+ */
+typedef struct {
+    const ralectrl_http_config_t *config;
+    const char  *method;
+    const char  *path;
+    const char  *json_body;             /* NULL for no body */
+    ralectrl_http_response_t response;
+    int         result;                 /* 0 on success, -1 on transport error */
+    bool        timed_out;              /* Deadline passed before the reply */
+} ralectrl_http_call_t;
+
 /*-------------------------------------------------------------------------
  * HTTP Client Functions
  *-------------------------------------------------------------------------*/
@@ -56,6 +100,18 @@ void ralectrl_http_config_init(ralectrl_http_config_t *config);
  */
 void ralectrl_http_config_cleanup(ralectrl_http_config_t *config);
 
+/**
+ * Make one HTTP request, reusing a pooled keep-alive connection if possible
+ */
+int ralectrl_http_request(const ralectrl_http_config_t *config, const char *method, const char *path,
+                          const char *json_body, ralectrl_http_response_t *response);
+
+/**
+ * Run requests concurrently on non-blocking sockets from one thread; every
+ * call not answered within timeout_ms fails with timed_out set
+ */
+int ralectrl_http_multi(ralectrl_http_call_t *calls, size_t count, int timeout_ms);
+
 /**
  * Make HTTP GET request
  */
@@ -85,6 +141,27 @@ int ralectrl_http_delete(const ralectrl_http_config_t *config, const char *path,
  */
 void ralectrl_http_response_cleanup(ralectrl_http_response_t *response);
 
+/**
+ * Open a keep-alive connection to the configured server
+ */
+int ralectrl_http_conn_open(const ralectrl_http_config_t *config, ralectrl_http_conn_t *conn);
+
+/**
+ * Queue one request on a keep-alive connection without waiting for the reply
+ */
+int ralectrl_http_conn_send(ralectrl_http_conn_t *conn, const char *method, const char *path,
+                            const char *json_body);
+
+/**
+ * Read the next response, in request order, from a keep-alive connection
+ */
+int ralectrl_http_conn_receive(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response);
+
+/**
+ * Close a keep-alive connection and release its buffers
+ */
+void ralectrl_http_conn_close(ralectrl_http_conn_t *conn);
+
 /*-------------------------------------------------------------------------
  * REST API Wrapper Functions
  *-------------------------------------------------------------------------*/
@@ -27,6 +27,8 @@
 
 #include "ralectrl.h"
 #include "ralectrl_http_client.h"
+#include "ralectrl_bulk.h"
+#include "ralectrl_cluster.h"
 
 #define RESPONSE_BUF_SIZE			1024
 #define DEFAULT_HTTP_PORT			8080
@@ -50,6 +52,12 @@ static int handle_stop_command(int argc, char *argv[]);
 static int resolve_raled_path(char *buf, size_t buflen, const char *argv0 __attribute__((unused)));
 static void print_status_help(const char *progname);
 static int handle_status_command(int argc, char *argv[]);
+static void print_import_help(const char *progname);
+static void print_export_help(const char *progname);
+static int handle_import_command(int argc, char *argv[]);
+static int handle_export_command(int argc, char *argv[]);
+static void print_cluster_status_help(const char *progname);
+static int handle_cluster_status_command(int argc, char *argv[]);
 static int find_raled_pid_for_config(const char *config_path);
 
 static int
@@ -264,7 +272,7 @@ main(int argc, char *argv[])
     if (!command)
 	{
         char error_msg[256];
-        		snprintf(error_msg, sizeof(error_msg), "Error: No command specified. Use ADD, REMOVE, LIST, START, STOP, or STATUS.\n");
+        		snprintf(error_msg, sizeof(error_msg), "Error: No command specified. Use ADD, REMOVE, LIST, START, STOP, STATUS, CLUSTER-STATUS, IMPORT, or EXPORT.\n");
         fputs(error_msg, stderr);
 		print_help(argv[0]);
 		ralectrl_http_config_cleanup(&g_http_config);
@@ -330,13 +338,19 @@ main(int argc, char *argv[])
 		result = handle_stop_command(handler_argc, handler_argv);
 	else if (strcmp(command, "STATUS") == 0)
 		result = handle_status_command(handler_argc, handler_argv);
+	else if (strcmp(command, "CLUSTER-STATUS") == 0 || strcmp(command, "cluster-status") == 0)
+		result = handle_cluster_status_command(handler_argc, handler_argv);
+	else if (strcmp(command, "IMPORT") == 0)
+		result = handle_import_command(handler_argc, handler_argv);
+	else if (strcmp(command, "EXPORT") == 0)
+		result = handle_export_command(handler_argc, handler_argv);
 	else if (strcmp(command, "HELP") == 0 || strcmp(command, "--help") == 0 ||
 			 strcmp(command, "-h") == 0)
 		print_help(argv[0]);
     else
 	{
         char error_msg[256];
-        		snprintf(error_msg, sizeof(error_msg), "Error: Unknown command \"%s\". Use ADD, REMOVE, LIST, START, STOP, or STATUS.\n", command);
+        		snprintf(error_msg, sizeof(error_msg), "Error: Unknown command \"%s\". Use ADD, REMOVE, LIST, START, STOP, STATUS, CLUSTER-STATUS, IMPORT, or EXPORT.\n", command);
         fputs(error_msg, stderr);
 		print_help(argv[0]);
 		free(handler_argv);
@@ -368,6 +382,9 @@ print_help(const char *progname)
 	printf("  START    Start raled daemon with a config\n");
 	printf("  STOP     Stop raled daemon matching a config\n");
 	printf("  STATUS   Show status of raled matching a config\n");
+	printf("  CLUSTER-STATUS  Query every cluster member concurrently\n");
+	printf("  IMPORT   Bulk load key/value records into the store\n");
+	printf("  EXPORT   Bulk dump all key/value records from the store\n");
 	printf("  HELP     Show this help message\n");
 	printf("\nFor command-specific options, run: %s <command> --help\n\n", progname);
 }
@@ -389,6 +406,203 @@ print_status_help(const char *progname)
 	printf("Usage: %s STATUS --config <path>\n", progname);
 }
 
+static void
+print_cluster_status_help(const char *progname)
+{
+	printf("Usage: %s CLUSTER-STATUS [--timeout <ms>] [--http-port <port>]\n", progname);
+	printf("  -t, --timeout <ms>         Per-node deadline (default: %d)\n", RALECTRL_CLUSTER_DEFAULT_TIMEOUT_MS);
+	printf("  -P, --http-port <port>     REST port of members (default: same as --port)\n");
+}
+
+static void
+print_import_help(const char *progname)
+{
+	printf("Usage: %s IMPORT [--file <path>] [--format ndjson|snapshot] [OPTIONS]\n", progname);
+	printf("  -f, --file <path>          Input file (default: stdin)\n");
+	printf("  -F, --format <fmt>         ndjson (default) or snapshot\n");
+	printf("  -b, --batch-size <n>       Records per request (default: %d)\n", RALECTRL_BULK_DEFAULT_BATCH);
+	printf("  -w, --workers <n>          Parallel connections (default: %d)\n", RALECTRL_BULK_DEFAULT_WORKERS);
+	printf("  -i, --inflight <n>         Pipelined requests per connection (default: %d)\n", RALECTRL_BULK_DEFAULT_INFLIGHT);
+	printf("  -q, --quiet                Do not report progress\n");
+}
+
+static void
+print_export_help(const char *progname)
+{
+	printf("Usage: %s EXPORT [--file <path>] [--format ndjson|snapshot] [OPTIONS]\n", progname);
+	printf("  -f, --file <path>          Output file (default: stdout, ndjson only)\n");
+	printf("  -F, --format <fmt>         ndjson (default) or snapshot\n");
+	printf("  -w, --workers <n>          Partitions exported in parallel (default: %d)\n", RALECTRL_BULK_DEFAULT_WORKERS);
+	printf("  -P, --page-size <n>        Records per request (default: %d)\n", RALECTRL_BULK_DEFAULT_PAGE);
+	printf("  -q, --quiet                Do not report progress\n");
+}
+
+/**
+ * Parse options shared by IMPORT and EXPORT; returns 1 when help was shown
+ */
+static int
+parse_bulk_options(const char *verb, int argc, char *argv[],
+				   ralectrl_bulk_options_t *options,
+				   void (*print_usage)(const char *progname))
+{
+	int				c;
+	static struct option bulk_options[] = {
+		{"file", required_argument, NULL, 'f'},
+		{"format", required_argument, NULL, 'F'},
+		{"batch-size", required_argument, NULL, 'b'},
+		{"workers", required_argument, NULL, 'w'},
+		{"inflight", required_argument, NULL, 'i'},
+		{"page-size", required_argument, NULL, 'P'},
+		{"quiet", no_argument, NULL, 'q'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	ralectrl_bulk_options_init(options);
+
+#ifdef __APPLE__
+	optreset = 1;
+#endif
+	optind = 0;
+
+	while ((c = getopt_long(argc, argv, "f:F:b:w:i:P:qh", bulk_options, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'f':
+				options->path = optarg;
+				break;
+			case 'F':
+				if (ralectrl_bulk_parse_format(optarg, &options->format) == 0)
+					break;
+				fprintf(stderr, "Error: Unknown format \"%s\" for %s.\n", optarg, verb);
+				print_usage("ralectrl");
+				return -1;
+			case 'b':
+				options->batch_size = atoi(optarg);
+				break;
+			case 'w':
+				options->workers = atoi(optarg);
+				break;
+			case 'i':
+				options->inflight = atoi(optarg);
+				break;
+			case 'P':
+				options->page_size = atoi(optarg);
+				break;
+			case 'q':
+				options->progress = false;
+				break;
+			case 'h':
+				print_usage("ralectrl");
+				return 1;
+			default:
+			{
+				char error_msg[256];
+				snprintf(error_msg, sizeof(error_msg), "Error: Invalid option for %s.\n", verb);
+				fputs(error_msg, stderr);
+				print_usage("ralectrl");
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * CLUSTER-STATUS: fan STATUS out to every member listed by the server
+ */
+static int
+handle_cluster_status_command(int argc, char *argv[])
+{
+	int				c;
+	int				port;
+	ralectrl_cluster_options_t options;
+	static struct option cluster_options[] = {
+		{"timeout", required_argument, NULL, 't'},
+		{"http-port", required_argument, NULL, 'P'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	ralectrl_cluster_options_init(&options);
+
+#ifdef __APPLE__
+	optreset = 1;
+#endif
+	optind = 0;
+
+	while ((c = getopt_long(argc, argv, "t:P:h", cluster_options, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 't':
+				options.timeout_ms = atoi(optarg);
+				break;
+			case 'P':
+				port = atoi(optarg);
+				if (port <= 0 || port > 65535)
+				{
+					fprintf(stderr, "Error: Invalid --http-port \"%s\".\n", optarg);
+					return 1;
+				}
+				options.http_port = (uint16_t)port;
+				break;
+			case 'h':
+				print_cluster_status_help("ralectrl");
+				return 0;
+			default:
+			{
+				char error_msg[256];
+				snprintf(error_msg, sizeof(error_msg), "Error: Invalid option for CLUSTER-STATUS.\n");
+				fputs(error_msg, stderr);
+				print_cluster_status_help("ralectrl");
+				return 1;
+			}
+		}
+	}
+
+	if (options.timeout_ms <= 0)
+	{
+		fprintf(stderr, "Error: --timeout must be positive.\n");
+		return 1;
+	}
+
+	return ralectrl_cluster_status(&g_http_config, &options) == 0 ? 0 : 1;
+}
+
+/**
+ * IMPORT: stream NDJSON or snapshot records into the store
+ */
+static int
+handle_import_command(int argc, char *argv[])
+{
+	ralectrl_bulk_options_t options;
+	int				rc;
+
+	rc = parse_bulk_options("IMPORT", argc, argv, &options, print_import_help);
+	if (rc != 0)
+		return rc < 0 ? 1 : 0;
+
+	return ralectrl_bulk_import(&g_http_config, &options) == 0 ? 0 : 1;
+}
+
+/**
+ * EXPORT: stream every record in the store as NDJSON or a snapshot
+ */
+static int
+handle_export_command(int argc, char *argv[])
+{
+	ralectrl_bulk_options_t options;
+	int				rc;
+
+	rc = parse_bulk_options("EXPORT", argc, argv, &options, print_export_help);
+	if (rc != 0)
+		return rc < 0 ? 1 : 0;
+
+	return ralectrl_bulk_export(&g_http_config, &options) == 0 ? 0 : 1;
+}
+
 /**
  * START: spawn raled with a config path; optional stdout redirection
  */
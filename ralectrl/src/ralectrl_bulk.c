@@ -0,0 +1,940 @@
+/*-------------------------------------------------------------------------
+ *
+ * ralectrl_bulk.c
+ *		Bulk import and export of key/value data for ralectrl
+ *
+ * Import reads NDJSON or snapshot records, packs them into PUT_BATCH
+ * requests and hands them to a pool of worker threads.  Each worker owns a
+ * keep-alive connection and pipelines up to "inflight" batches before it
+ * waits for the oldest reply.  Export splits the store into one partition
+ * per worker and pages through each with the EXPORT command.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "ralectrl_bulk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <cjson/cJSON.h>
+
+/* Key and value limits enforced by the server (librale hash.h) */
+#define BULK_MAX_KEY_SIZE       255
+#define BULK_MAX_VALUE_SIZE     1024
+
+/*-------------------------------------------------------------------------
+ * Shared State
+ *-------------------------------------------------------------------------*/
+
+typedef struct bulk_batch_t {
+    char                *body;          /* Serialized PUT_BATCH request */
+    int                 records;
+    size_t              bytes;          /* Key and value bytes carried */
+    struct bulk_batch_t *next;
+} bulk_batch_t;
+
+typedef struct {
+    const ralectrl_http_config_t    *config;
+    const ralectrl_bulk_options_t   *options;
+
+    pthread_mutex_t     mutex;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+    pthread_cond_t      finished;
+    bulk_batch_t        *head;
+    bulk_batch_t        *tail;
+    int                 depth;
+    int                 capacity;
+    bool                closed;         /* No more batches will be queued */
+    bool                done;           /* All work complete; stop reporting */
+
+    FILE                *out;           /* Export destination */
+    uint64_t            records_read;
+    uint64_t            records_done;
+    uint64_t            records_failed;
+    uint64_t            bytes_done;
+    int                 errors;
+    struct timeval      started;
+} bulk_state_t;
+
+static double
+bulk_elapsed_seconds(const struct timeval *since)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (double)(now.tv_sec - since->tv_sec) +
+           (double)(now.tv_usec - since->tv_usec) / 1000000.0;
+}
+
+static void
+bulk_report(bulk_state_t *state, const char *verb, bool final)
+{
+    double  elapsed = bulk_elapsed_seconds(&state->started);
+    double  rate;
+    double  mbps;
+
+    if (elapsed <= 0.0)
+        elapsed = 0.001;
+    rate = (double)state->records_done / elapsed;
+    mbps = (double)state->bytes_done / elapsed / (1024.0 * 1024.0);
+
+    fprintf(stderr, "\r%s %llu records (%llu failed) in %.1fs, %.0f rec/s, %.2f MB/s%s",
+            verb,
+            (unsigned long long)state->records_done,
+            (unsigned long long)state->records_failed,
+            elapsed, rate, mbps, final ? "\n" : "   ");
+    fflush(stderr);
+}
+
+typedef struct {
+    bulk_state_t    *state;
+    const char      *verb;
+} bulk_progress_arg_t;
+
+static void *
+bulk_progress_thread(void *arg)
+{
+    bulk_progress_arg_t *progress = (bulk_progress_arg_t *)arg;
+    bulk_state_t        *state = progress->state;
+
+    pthread_mutex_lock(&state->mutex);
+    while (!state->done) {
+        struct timeval  now;
+        struct timespec deadline;
+
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + 1;
+        deadline.tv_nsec = (long)now.tv_usec * 1000;
+        pthread_cond_timedwait(&state->finished, &state->mutex, &deadline);
+        if (!state->done)
+            bulk_report(state, progress->verb, false);
+    }
+    pthread_mutex_unlock(&state->mutex);
+    return NULL;
+}
+
+static int
+bulk_state_init(bulk_state_t *state, const ralectrl_http_config_t *config,
+                const ralectrl_bulk_options_t *options)
+{
+    memset(state, 0, sizeof(bulk_state_t));
+    state->config = config;
+    state->options = options;
+    state->capacity = options->workers * options->inflight;
+    gettimeofday(&state->started, NULL);
+
+    if (pthread_mutex_init(&state->mutex, NULL) != 0)
+        return -1;
+    pthread_cond_init(&state->not_empty, NULL);
+    pthread_cond_init(&state->not_full, NULL);
+    pthread_cond_init(&state->finished, NULL);
+    return 0;
+}
+
+static void
+bulk_state_cleanup(bulk_state_t *state)
+{
+    while (state->head) {
+        bulk_batch_t *next = state->head->next;
+        free(state->head->body);
+        free(state->head);
+        state->head = next;
+    }
+    pthread_cond_destroy(&state->not_empty);
+    pthread_cond_destroy(&state->not_full);
+    pthread_cond_destroy(&state->finished);
+    pthread_mutex_destroy(&state->mutex);
+}
+
+/*-------------------------------------------------------------------------
+ * Options
+ *-------------------------------------------------------------------------*/
+
+void
+ralectrl_bulk_options_init(ralectrl_bulk_options_t *options)
+{
+    if (options == NULL)
+        return;
+
+    memset(options, 0, sizeof(ralectrl_bulk_options_t));
+    options->path = "-";
+    options->format = RALECTRL_BULK_NDJSON;
+    options->batch_size = RALECTRL_BULK_DEFAULT_BATCH;
+    options->workers = RALECTRL_BULK_DEFAULT_WORKERS;
+    options->inflight = RALECTRL_BULK_DEFAULT_INFLIGHT;
+    options->page_size = RALECTRL_BULK_DEFAULT_PAGE;
+    options->progress = true;
+}
+
+int
+ralectrl_bulk_parse_format(const char *name, ralectrl_bulk_format_t *format)
+{
+    if (name == NULL || format == NULL)
+        return -1;
+
+    if (strcmp(name, "ndjson") == 0 || strcmp(name, "json") == 0)
+        *format = RALECTRL_BULK_NDJSON;
+    else if (strcmp(name, "snapshot") == 0 || strcmp(name, "binary") == 0)
+        *format = RALECTRL_BULK_SNAPSHOT;
+    else
+        return -1;
+    return 0;
+}
+
+static int
+bulk_validate_options(const ralectrl_bulk_options_t *options)
+{
+    if (options->batch_size < 1 || options->batch_size > RALECTRL_BULK_MAX_BATCH) {
+        fprintf(stderr, "Error: --batch-size must be between 1 and %d\n", RALECTRL_BULK_MAX_BATCH);
+        return -1;
+    }
+    if (options->workers < 1 || options->workers > RALECTRL_BULK_MAX_WORKERS) {
+        fprintf(stderr, "Error: --workers must be between 1 and %d\n", RALECTRL_BULK_MAX_WORKERS);
+        return -1;
+    }
+    if (options->inflight < 1 || options->inflight > RALECTRL_BULK_MAX_INFLIGHT) {
+        fprintf(stderr, "Error: --inflight must be between 1 and %d\n", RALECTRL_BULK_MAX_INFLIGHT);
+        return -1;
+    }
+    if (options->page_size < 1) {
+        fprintf(stderr, "Error: --page-size must be positive\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*-------------------------------------------------------------------------
+ * Import: batch queue
+ *-------------------------------------------------------------------------*/
+
+static int
+bulk_queue_push(bulk_state_t *state, bulk_batch_t *batch)
+{
+    pthread_mutex_lock(&state->mutex);
+    while (state->depth >= state->capacity && state->errors == 0)
+        pthread_cond_wait(&state->not_full, &state->mutex);
+
+    if (state->errors != 0) {
+        pthread_mutex_unlock(&state->mutex);
+        return -1;
+    }
+
+    batch->next = NULL;
+    if (state->tail)
+        state->tail->next = batch;
+    else
+        state->head = batch;
+    state->tail = batch;
+    state->depth++;
+    pthread_cond_signal(&state->not_empty);
+    pthread_mutex_unlock(&state->mutex);
+    return 0;
+}
+
+/*
+ * Take the next batch.  Workers with requests already in flight must not
+ * block here, or their replies would sit unread while the queue is empty.
+ */
+static bulk_batch_t *
+bulk_queue_pop(bulk_state_t *state, bool wait)
+{
+    bulk_batch_t *batch = NULL;
+
+    pthread_mutex_lock(&state->mutex);
+    while (wait && state->head == NULL && !state->closed)
+        pthread_cond_wait(&state->not_empty, &state->mutex);
+
+    if (state->head) {
+        batch = state->head;
+        state->head = batch->next;
+        if (state->head == NULL)
+            state->tail = NULL;
+        state->depth--;
+        pthread_cond_signal(&state->not_full);
+    }
+    pthread_mutex_unlock(&state->mutex);
+    return batch;
+}
+
+static void
+bulk_queue_close(bulk_state_t *state)
+{
+    pthread_mutex_lock(&state->mutex);
+    state->closed = true;
+    pthread_cond_broadcast(&state->not_empty);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+/*-------------------------------------------------------------------------
+ * Import: workers
+ *-------------------------------------------------------------------------*/
+
+static void
+bulk_account_batch(bulk_state_t *state, const bulk_batch_t *batch,
+                   const ralectrl_http_response_t *response)
+{
+    int     applied = 0;
+    int     failed = batch->records;
+
+    if (response != NULL && response->body != NULL) {
+        cJSON *json = cJSON_Parse(response->body);
+
+        if (json != NULL) {
+            cJSON *applied_obj = cJSON_GetObjectItem(json, "applied");
+            cJSON *failed_obj = cJSON_GetObjectItem(json, "failed");
+
+            if (cJSON_IsNumber(applied_obj) && cJSON_IsNumber(failed_obj)) {
+                applied = applied_obj->valueint;
+                failed = failed_obj->valueint;
+            }
+            cJSON_Delete(json);
+        }
+    }
+
+    pthread_mutex_lock(&state->mutex);
+    state->records_done += (uint64_t)applied;
+    state->records_failed += (uint64_t)failed;
+    if (batch->records > 0)
+        state->bytes_done += batch->bytes * (uint64_t)applied / (uint64_t)batch->records;
+    pthread_mutex_unlock(&state->mutex);
+}
+
+static void *
+bulk_import_worker(void *arg)
+{
+    bulk_state_t            *state = (bulk_state_t *)arg;
+    const int               window_size = state->options->inflight;
+    bulk_batch_t            *window[RALECTRL_BULK_MAX_INFLIGHT];
+    int                     window_head = 0;
+    int                     window_count = 0;
+    ralectrl_http_conn_t    conn;
+    bool                    connected = false;
+    int                     failures = 0;
+    int                     i;
+
+    memset(&conn, 0, sizeof(conn));
+    conn.sockfd = -1;
+
+    for (;;) {
+        ralectrl_http_response_t    response;
+        bulk_batch_t                *batch;
+
+        /* Keep the pipeline full */
+        while (window_count < window_size) {
+            batch = bulk_queue_pop(state, window_count == 0);
+            if (batch == NULL)
+                break;
+            window[(window_head + window_count) % window_size] = batch;
+            window_count++;
+            if (connected &&
+                ralectrl_http_conn_send(&conn, "POST", "/api/command", batch->body) != 0) {
+                ralectrl_http_conn_close(&conn);
+                connected = false;
+            }
+        }
+
+        if (window_count == 0)
+            break;
+
+        if (!connected) {
+            if (failures > RALECTRL_BULK_MAX_RETRIES) {
+                /* Give up on what we hold; the producer stops on errors */
+                for (i = 0; i < window_count; i++) {
+                    batch = window[(window_head + i) % window_size];
+                    bulk_account_batch(state, batch, NULL);
+                    free(batch->body);
+                    free(batch);
+                }
+                window_count = 0;
+                pthread_mutex_lock(&state->mutex);
+                state->errors++;
+                pthread_cond_broadcast(&state->not_full);
+                pthread_mutex_unlock(&state->mutex);
+                failures = 0;
+                continue;
+            }
+            if (failures > 0)
+                usleep((useconds_t)(100000 * failures));
+
+            if (ralectrl_http_conn_open(state->config, &conn) != 0) {
+                ralectrl_http_conn_close(&conn);
+                failures++;
+                continue;
+            }
+            connected = true;
+
+            /* PUT is idempotent, so replaying unanswered batches is safe */
+            for (i = 0; i < window_count && connected; i++) {
+                batch = window[(window_head + i) % window_size];
+                if (ralectrl_http_conn_send(&conn, "POST", "/api/command", batch->body) != 0) {
+                    ralectrl_http_conn_close(&conn);
+                    connected = false;
+                }
+            }
+            if (!connected) {
+                failures++;
+                continue;
+            }
+        }
+
+        if (ralectrl_http_conn_receive(&conn, &response) != 0) {
+            ralectrl_http_conn_close(&conn);
+            connected = false;
+            failures++;
+            continue;
+        }
+        failures = 0;
+
+        batch = window[window_head];
+        window_head = (window_head + 1) % window_size;
+        window_count--;
+
+        if (response.status_code == 401 || response.status_code == 404)
+            ralectrl_print_api_error(&response);
+        bulk_account_batch(state, batch, &response);
+        ralectrl_http_response_cleanup(&response);
+        free(batch->body);
+        free(batch);
+
+        /* Server is closing: replay whatever it will not answer */
+        if (conn.peer_closing) {
+            ralectrl_http_conn_close(&conn);
+            connected = false;
+        }
+    }
+
+    ralectrl_http_conn_close(&conn);
+    return NULL;
+}
+
+/*-------------------------------------------------------------------------
+ * Import: record readers
+ *-------------------------------------------------------------------------*/
+
+typedef struct {
+    bulk_state_t    *state;
+    cJSON           *request;
+    cJSON           *items;
+    int             records;
+    size_t          bytes;
+} bulk_builder_t;
+
+static int
+bulk_builder_reset(bulk_builder_t *builder)
+{
+    builder->request = cJSON_CreateObject();
+    if (builder->request == NULL)
+        return -1;
+    cJSON_AddStringToObject(builder->request, "command", "PUT_BATCH");
+    builder->items = cJSON_CreateArray();
+    if (builder->items == NULL) {
+        cJSON_Delete(builder->request);
+        builder->request = NULL;
+        return -1;
+    }
+    cJSON_AddItemToObject(builder->request, "items", builder->items);
+    builder->records = 0;
+    builder->bytes = 0;
+    return 0;
+}
+
+static int
+bulk_builder_flush(bulk_builder_t *builder)
+{
+    bulk_batch_t    *batch;
+    char            *body;
+
+    if (builder->records == 0)
+        return 0;
+
+    body = cJSON_PrintUnformatted(builder->request);
+    cJSON_Delete(builder->request);
+    builder->request = NULL;
+    if (body == NULL)
+        return -1;
+
+    batch = malloc(sizeof(bulk_batch_t));
+    if (batch == NULL) {
+        free(body);
+        return -1;
+    }
+    batch->body = body;
+    batch->records = builder->records;
+    batch->bytes = builder->bytes;
+
+    if (bulk_queue_push(builder->state, batch) != 0) {
+        free(batch->body);
+        free(batch);
+        return -1;
+    }
+    return bulk_builder_reset(builder);
+}
+
+static int
+bulk_builder_add(bulk_builder_t *builder, const char *key, size_t key_len,
+                 const char *value, size_t value_len)
+{
+    cJSON   *item;
+    char    *key_copy;
+    char    *value_copy;
+
+    if (key_len == 0 || key_len >= BULK_MAX_KEY_SIZE || value_len >= BULK_MAX_VALUE_SIZE) {
+        pthread_mutex_lock(&builder->state->mutex);
+        builder->state->records_failed++;
+        pthread_mutex_unlock(&builder->state->mutex);
+        return 0;
+    }
+
+    key_copy = strndup(key, key_len);
+    value_copy = strndup(value, value_len);
+    item = cJSON_CreateObject();
+    if (key_copy == NULL || value_copy == NULL || item == NULL) {
+        free(key_copy);
+        free(value_copy);
+        cJSON_Delete(item);
+        return -1;
+    }
+    cJSON_AddStringToObject(item, "key", key_copy);
+    cJSON_AddStringToObject(item, "value", value_copy);
+    cJSON_AddItemToArray(builder->items, item);
+    free(key_copy);
+    free(value_copy);
+
+    builder->records++;
+    builder->bytes += key_len + value_len;
+
+    pthread_mutex_lock(&builder->state->mutex);
+    builder->state->records_read++;
+    pthread_mutex_unlock(&builder->state->mutex);
+
+    if (builder->records >= builder->state->options->batch_size)
+        return bulk_builder_flush(builder);
+    return 0;
+}
+
+static int
+bulk_read_ndjson(FILE *in, bulk_builder_t *builder)
+{
+    char        *line = NULL;
+    size_t      line_cap = 0;
+    ssize_t     line_len;
+    uint64_t    line_no = 0;
+    int         rc = 0;
+
+    while (rc == 0 && (line_len = getline(&line, &line_cap, in)) >= 0) {
+        cJSON   *json;
+        cJSON   *key;
+        cJSON   *value;
+
+        line_no++;
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r'))
+            line[--line_len] = '\0';
+        if (line_len == 0)
+            continue;
+
+        json = cJSON_Parse(line);
+        key = json ? cJSON_GetObjectItem(json, "key") : NULL;
+        value = json ? cJSON_GetObjectItem(json, "value") : NULL;
+        if (!cJSON_IsString(key) || !cJSON_IsString(value)) {
+            fprintf(stderr, "\nWarning: skipping malformed record on line %llu\n",
+                    (unsigned long long)line_no);
+            pthread_mutex_lock(&builder->state->mutex);
+            builder->state->records_failed++;
+            pthread_mutex_unlock(&builder->state->mutex);
+            cJSON_Delete(json);
+            continue;
+        }
+
+        rc = bulk_builder_add(builder, key->valuestring, strlen(key->valuestring),
+                              value->valuestring, strlen(value->valuestring));
+        cJSON_Delete(json);
+    }
+
+    free(line);
+    if (rc == 0 && ferror(in)) {
+        fprintf(stderr, "\nError: Failed to read input: %s\n", strerror(errno));
+        rc = -1;
+    }
+    return rc;
+}
+
+/*
+ * Snapshot layout matches hash_save(): an int record count followed by
+ * (int key_len, key bytes, int value_len, value bytes) per record, in host
+ * byte order.
+ */
+static int
+bulk_read_snapshot(FILE *in, bulk_builder_t *builder)
+{
+    int     count;
+    int     i;
+    char    key[BULK_MAX_KEY_SIZE];
+    char    value[BULK_MAX_VALUE_SIZE];
+
+    if (fread(&count, sizeof(int), 1, in) != 1 || count < 0) {
+        fprintf(stderr, "Error: Snapshot header is missing or invalid\n");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        int key_len;
+        int value_len;
+
+        if (fread(&key_len, sizeof(int), 1, in) != 1 ||
+            key_len <= 0 || key_len >= (int)sizeof(key) ||
+            fread(key, (size_t)key_len, 1, in) != 1 ||
+            fread(&value_len, sizeof(int), 1, in) != 1 ||
+            value_len < 0 || value_len >= (int)sizeof(value) ||
+            (value_len > 0 && fread(value, (size_t)value_len, 1, in) != 1)) {
+            fprintf(stderr, "\nError: Snapshot is truncated or corrupt at record %d of %d\n",
+                    i + 1, count);
+            return -1;
+        }
+
+        if (bulk_builder_add(builder, key, (size_t)key_len, value, (size_t)value_len) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+ralectrl_bulk_import(const ralectrl_http_config_t *config, const ralectrl_bulk_options_t *options)
+{
+    bulk_state_t        state;
+    bulk_builder_t      builder;
+    bulk_progress_arg_t progress = { &state, "Imported" };
+    pthread_t           workers[RALECTRL_BULK_MAX_WORKERS];
+    pthread_t           reporter;
+    bool                have_reporter = false;
+    int                 started = 0;
+    FILE                *in;
+    int                 rc;
+    int                 i;
+
+    if (config == NULL || options == NULL || bulk_validate_options(options) != 0)
+        return -1;
+
+    if (strcmp(options->path, "-") == 0)
+        in = stdin;
+    else if ((in = fopen(options->path, "rb")) == NULL) {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", options->path, strerror(errno));
+        return -1;
+    }
+
+    if (bulk_state_init(&state, config, options) != 0) {
+        if (in != stdin)
+            fclose(in);
+        return -1;
+    }
+
+    for (i = 0; i < options->workers; i++) {
+        if (pthread_create(&workers[i], NULL, bulk_import_worker, &state) != 0)
+            break;
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Failed to start import workers\n");
+        bulk_state_cleanup(&state);
+        if (in != stdin)
+            fclose(in);
+        return -1;
+    }
+    if (options->progress)
+        have_reporter = pthread_create(&reporter, NULL, bulk_progress_thread, &progress) == 0;
+
+    memset(&builder, 0, sizeof(builder));
+    builder.state = &state;
+    rc = bulk_builder_reset(&builder);
+    if (rc == 0) {
+        if (options->format == RALECTRL_BULK_SNAPSHOT)
+            rc = bulk_read_snapshot(in, &builder);
+        else
+            rc = bulk_read_ndjson(in, &builder);
+    }
+    if (rc == 0)
+        rc = bulk_builder_flush(&builder);
+    cJSON_Delete(builder.request);
+
+    bulk_queue_close(&state);
+    for (i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_lock(&state.mutex);
+    state.done = true;
+    pthread_cond_broadcast(&state.finished);
+    pthread_mutex_unlock(&state.mutex);
+    if (have_reporter)
+        pthread_join(reporter, NULL);
+
+    if (options->progress)
+        bulk_report(&state, "Imported", true);
+    if (state.errors > 0) {
+        fprintf(stderr, "Error: Lost connection to %s:%d; import incomplete\n",
+                config->server_host, config->server_port);
+        rc = -1;
+    }
+    if (rc == 0 && state.records_failed > 0)
+        rc = -1;
+
+    bulk_state_cleanup(&state);
+    if (in != stdin)
+        fclose(in);
+    return rc;
+}
+
+/*-------------------------------------------------------------------------
+ * Export
+ *-------------------------------------------------------------------------*/
+
+typedef struct {
+    bulk_state_t    *state;
+    int             partition;
+} bulk_export_arg_t;
+
+static int
+bulk_write_record(bulk_state_t *state, cJSON *item)
+{
+    cJSON   *key = cJSON_GetObjectItem(item, "key");
+    cJSON   *value = cJSON_GetObjectItem(item, "value");
+    int     rc = 0;
+
+    if (!cJSON_IsString(key) || !cJSON_IsString(value))
+        return -1;
+
+    /* Caller holds state->mutex so records are never interleaved */
+    if (state->options->format == RALECTRL_BULK_SNAPSHOT) {
+        int key_len = (int)strlen(key->valuestring);
+        int value_len = (int)strlen(value->valuestring);
+
+        if (fwrite(&key_len, sizeof(int), 1, state->out) != 1 ||
+            fwrite(key->valuestring, (size_t)key_len, 1, state->out) != 1 ||
+            fwrite(&value_len, sizeof(int), 1, state->out) != 1 ||
+            (value_len > 0 && fwrite(value->valuestring, (size_t)value_len, 1, state->out) != 1))
+            rc = -1;
+    } else {
+        char *line = cJSON_PrintUnformatted(item);
+
+        if (line == NULL || fputs(line, state->out) == EOF || fputc('\n', state->out) == EOF)
+            rc = -1;
+        free(line);
+    }
+
+    if (rc == 0) {
+        state->records_done++;
+        state->bytes_done += strlen(key->valuestring) + strlen(value->valuestring);
+    }
+    return rc;
+}
+
+/*
+ * Pages within a partition depend on the previous cursor and cannot be
+ * pipelined; parallelism comes from one partition per worker instead.
+ */
+static void *
+bulk_export_worker(void *arg)
+{
+    bulk_export_arg_t       *export_arg = (bulk_export_arg_t *)arg;
+    bulk_state_t            *state = export_arg->state;
+    ralectrl_http_conn_t    conn;
+    double                  cursor = 0;
+    bool                    done = false;
+    int                     failures = 0;
+
+    memset(&conn, 0, sizeof(conn));
+    conn.sockfd = -1;
+
+    while (!done && failures <= RALECTRL_BULK_MAX_RETRIES) {
+        ralectrl_http_response_t    response;
+        char                        body[256];
+        cJSON                       *json;
+        cJSON                       *items;
+        cJSON                       *item;
+        cJSON                       *next_cursor;
+        cJSON                       *done_obj;
+        cJSON                       *skipped;
+        int                         written = 0;
+
+        pthread_mutex_lock(&state->mutex);
+        if (state->errors > 0) {
+            pthread_mutex_unlock(&state->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&state->mutex);
+
+        if (conn.sockfd < 0 && ralectrl_http_conn_open(state->config, &conn) != 0) {
+            ralectrl_http_conn_close(&conn);
+            failures++;
+            usleep((useconds_t)(100000 * failures));
+            continue;
+        }
+
+        snprintf(body, sizeof(body),
+                 "{\"command\":\"EXPORT\",\"partition\":%d,\"partitions\":%d,"
+                 "\"cursor\":%.0f,\"limit\":%d}",
+                 export_arg->partition, state->options->workers, cursor,
+                 state->options->page_size);
+
+        if (ralectrl_http_conn_send(&conn, "POST", "/api/command", body) != 0 ||
+            ralectrl_http_conn_receive(&conn, &response) != 0) {
+            ralectrl_http_conn_close(&conn);
+            failures++;
+            continue;
+        }
+        if (conn.peer_closing)
+            ralectrl_http_conn_close(&conn);
+
+        if (!ralectrl_http_is_success(&response)) {
+            ralectrl_print_api_error(&response);
+            ralectrl_http_response_cleanup(&response);
+            break;
+        }
+
+        json = response.body ? cJSON_Parse(response.body) : NULL;
+        ralectrl_http_response_cleanup(&response);
+        items = json ? cJSON_GetObjectItem(json, "items") : NULL;
+        next_cursor = json ? cJSON_GetObjectItem(json, "cursor") : NULL;
+        done_obj = json ? cJSON_GetObjectItem(json, "done") : NULL;
+        if (!cJSON_IsArray(items) || !cJSON_IsNumber(next_cursor) || !cJSON_IsBool(done_obj)) {
+            fprintf(stderr, "\nError: Unexpected EXPORT reply from server\n");
+            cJSON_Delete(json);
+            break;
+        }
+
+        pthread_mutex_lock(&state->mutex);
+        cJSON_ArrayForEach(item, items) {
+            if (bulk_write_record(state, item) != 0) {
+                state->records_failed++;
+                if (ferror(state->out)) {
+                    state->errors++;
+                    break;
+                }
+            }
+            written++;
+        }
+
+        /* Entries too large for a reply page; report them and carry on */
+        skipped = cJSON_GetObjectItem(json, "skipped");
+        if (cJSON_IsNumber(skipped) && skipped->valueint > 0) {
+            cJSON_ArrayForEach(item, cJSON_GetObjectItem(json, "skipped_keys"))
+                if (cJSON_IsString(item))
+                    fprintf(stderr, "\nWarning: Skipped %s: value too large to export\n",
+                            item->valuestring);
+            state->records_failed += (uint64_t)skipped->valueint;
+            written += skipped->valueint;
+        }
+        pthread_mutex_unlock(&state->mutex);
+
+        done = cJSON_IsTrue(done_obj);
+        if (!done && written == 0 && next_cursor->valuedouble == cursor) {
+            fprintf(stderr, "\nError: EXPORT made no progress in partition %d\n",
+                    export_arg->partition);
+            cJSON_Delete(json);
+            break;
+        }
+        cursor = next_cursor->valuedouble;
+        failures = 0;
+        cJSON_Delete(json);
+    }
+
+    ralectrl_http_conn_close(&conn);
+    if (!done) {
+        pthread_mutex_lock(&state->mutex);
+        state->errors++;
+        pthread_mutex_unlock(&state->mutex);
+    }
+    return NULL;
+}
+
+int
+ralectrl_bulk_export(const ralectrl_http_config_t *config, const ralectrl_bulk_options_t *options)
+{
+    bulk_state_t        state;
+    bulk_progress_arg_t progress = { &state, "Exported" };
+    bulk_export_arg_t   args[RALECTRL_BULK_MAX_WORKERS];
+    pthread_t           workers[RALECTRL_BULK_MAX_WORKERS];
+    pthread_t           reporter;
+    bool                have_reporter = false;
+    int                 started = 0;
+    int                 count_placeholder = 0;
+    int                 rc = 0;
+    int                 i;
+
+    if (config == NULL || options == NULL || bulk_validate_options(options) != 0)
+        return -1;
+
+    if (bulk_state_init(&state, config, options) != 0)
+        return -1;
+
+    if (strcmp(options->path, "-") == 0) {
+        if (options->format == RALECTRL_BULK_SNAPSHOT) {
+            fprintf(stderr, "Error: Snapshot export needs a seekable --file\n");
+            bulk_state_cleanup(&state);
+            return -1;
+        }
+        state.out = stdout;
+    } else if ((state.out = fopen(options->path, "wb")) == NULL) {
+        fprintf(stderr, "Error: Cannot create %s: %s\n", options->path, strerror(errno));
+        bulk_state_cleanup(&state);
+        return -1;
+    }
+
+    /* Snapshot record count is patched in once the export completes */
+    if (options->format == RALECTRL_BULK_SNAPSHOT &&
+        fwrite(&count_placeholder, sizeof(int), 1, state.out) != 1)
+        rc = -1;
+
+    if (rc == 0 && options->progress)
+        have_reporter = pthread_create(&reporter, NULL, bulk_progress_thread, &progress) == 0;
+
+    for (i = 0; rc == 0 && i < options->workers; i++) {
+        args[i].state = &state;
+        args[i].partition = i;
+        if (pthread_create(&workers[i], NULL, bulk_export_worker, &args[i]) != 0) {
+            pthread_mutex_lock(&state.mutex);
+            state.errors++;
+            pthread_mutex_unlock(&state.mutex);
+            break;
+        }
+        started++;
+    }
+    for (i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_lock(&state.mutex);
+    state.done = true;
+    pthread_cond_broadcast(&state.finished);
+    pthread_mutex_unlock(&state.mutex);
+    if (have_reporter)
+        pthread_join(reporter, NULL);
+
+    if (state.errors > 0 || state.records_failed > 0)
+        rc = -1;
+
+    if (rc == 0 && options->format == RALECTRL_BULK_SNAPSHOT) {
+        int count = (int)state.records_done;
+
+        if (fseek(state.out, 0, SEEK_SET) != 0 || fwrite(&count, sizeof(int), 1, state.out) != 1)
+            rc = -1;
+    }
+    if (fflush(state.out) != 0)
+        rc = -1;
+    if (state.out != stdout)
+        fclose(state.out);
+
+    if (options->progress)
+        bulk_report(&state, "Exported", true);
+    if (rc != 0)
+        fprintf(stderr, "Error: Export from %s:%d incomplete\n",
+                config->server_host, config->server_port);
+
+    bulk_state_cleanup(&state);
+    return rc;
+}
@@ -0,0 +1,268 @@
+/*-------------------------------------------------------------------------
+ *
+ * ralectrl_cluster.c
+ *		Cluster-wide status fan-out for ralectrl
+ *
+ * The seed server supplies the member list; every member is then asked for
+ * its STATUS at once over non-blocking sockets, so the whole report takes
+ * one round trip plus at most the per-node deadline, however many nodes
+ * there are.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "ralectrl_cluster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cjson/cJSON.h>
+
+#define STATUS_REQUEST  "{\"command\":\"STATUS\",\"format\":\"json\"}"
+
+typedef struct {
+    int                     id;
+    char                    name[64];
+    char                    host[64];
+    ralectrl_http_config_t  config;     /* Shallow copy of the seed config */
+
+    /* Filled from the member's STATUS reply */
+    bool                    responded;
+    char                    role[16];
+    long                    term;
+    long                    commit_index;
+    long                    last_applied;
+} cluster_member_t;
+
+void
+ralectrl_cluster_options_init(ralectrl_cluster_options_t *options)
+{
+    if (options == NULL)
+        return;
+
+    memset(options, 0, sizeof(ralectrl_cluster_options_t));
+    options->timeout_ms = RALECTRL_CLUSTER_DEFAULT_TIMEOUT_MS;
+    options->http_port = 0;
+}
+
+static long
+cluster_json_long(const cJSON *json, const char *name)
+{
+    cJSON *item = cJSON_GetObjectItem(json, name);
+
+    return cJSON_IsNumber(item) ? (long)item->valuedouble : -1;
+}
+
+/*
+ * Fetch the member list from the seed.  Members that advertise no usable
+ * address are reached through the seed's host name instead.
+ */
+static int
+cluster_load_members(const ralectrl_http_config_t *config, const ralectrl_cluster_options_t *options,
+                     cluster_member_t *members, int max_members)
+{
+    ralectrl_http_response_t    response;
+    cJSON                       *json;
+    cJSON                       *nodes;
+    cJSON                       *node;
+    int                         count = 0;
+
+    if (ralectrl_http_post_json(config, "/api/command", "{\"command\":\"LIST\"}", &response) != 0)
+        return -1;
+    if (!ralectrl_http_is_success(&response)) {
+        ralectrl_print_api_error(&response);
+        ralectrl_http_response_cleanup(&response);
+        return -1;
+    }
+
+    json = response.body ? cJSON_Parse(response.body) : NULL;
+    ralectrl_http_response_cleanup(&response);
+    nodes = json ? cJSON_GetObjectItem(json, "nodes") : NULL;
+    if (!cJSON_IsArray(nodes)) {
+        fprintf(stderr, "Error: Unexpected LIST reply from %s:%d\n",
+                config->server_host, config->server_port);
+        cJSON_Delete(json);
+        return -1;
+    }
+
+    cJSON_ArrayForEach(node, nodes) {
+        cJSON               *id = cJSON_GetObjectItem(node, "id");
+        cJSON               *name = cJSON_GetObjectItem(node, "name");
+        cJSON               *ip = cJSON_GetObjectItem(node, "ip");
+        cluster_member_t    *member;
+        const char          *host;
+
+        if (count >= max_members || !cJSON_IsNumber(id))
+            continue;
+
+        host = cJSON_IsString(ip) ? ip->valuestring : "";
+        if (host[0] == '\0' || strcmp(host, "unknown") == 0 || strcmp(host, "0.0.0.0") == 0)
+            host = config->server_host;
+
+        member = &members[count++];
+        memset(member, 0, sizeof(cluster_member_t));
+        member->id = id->valueint;
+        snprintf(member->name, sizeof(member->name), "%s",
+                 cJSON_IsString(name) ? name->valuestring : "");
+        snprintf(member->host, sizeof(member->host), "%s", host);
+
+        /* Borrows host and api_key; never passed to config_cleanup */
+        member->config = *config;
+        member->config.server_host = member->host;
+        member->config.server_port = options->http_port ? options->http_port : config->server_port;
+        member->config.pool = NULL;
+    }
+
+    cJSON_Delete(json);
+    return count;
+}
+
+static void
+cluster_parse_status(cluster_member_t *member, const ralectrl_http_call_t *call)
+{
+    cJSON *json;
+    cJSON *role;
+
+    if (call->result != 0 || !ralectrl_http_is_success(&call->response) || call->response.body == NULL)
+        return;
+
+    json = cJSON_Parse(call->response.body);
+    if (json == NULL)
+        return;
+
+    role = cJSON_GetObjectItem(json, "role");
+    snprintf(member->role, sizeof(member->role), "%s",
+             cJSON_IsString(role) ? role->valuestring : "unknown");
+    member->term = cluster_json_long(json, "term");
+    member->commit_index = cluster_json_long(json, "commit_index");
+    member->last_applied = cluster_json_long(json, "last_applied");
+    member->responded = true;
+    cJSON_Delete(json);
+}
+
+static int
+cluster_compare_long(const void *a, const void *b)
+{
+    long la = *(const long *)a;
+    long lb = *(const long *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+/* Nearest-rank percentile of an ascending array */
+static long
+cluster_percentile(const long *sorted, int count, int percent)
+{
+    int rank = (percent * count + 99) / 100;
+
+    if (rank < 1)
+        rank = 1;
+    return sorted[rank - 1];
+}
+
+int
+ralectrl_cluster_status(const ralectrl_http_config_t *config, const ralectrl_cluster_options_t *options)
+{
+    cluster_member_t        *members;
+    ralectrl_http_call_t    *calls;
+    long                    latencies[RALECTRL_CLUSTER_MAX_NODES];
+    const cluster_member_t  *leader = NULL;
+    int                     leaders = 0;
+    int                     responded = 0;
+    int                     count;
+    int                     i;
+
+    if (config == NULL || options == NULL)
+        return -1;
+
+    members = calloc(RALECTRL_CLUSTER_MAX_NODES, sizeof(cluster_member_t));
+    if (members == NULL)
+        return -1;
+
+    count = cluster_load_members(config, options, members, RALECTRL_CLUSTER_MAX_NODES);
+    if (count <= 0) {
+        if (count == 0)
+            fprintf(stderr, "Error: Cluster has no members\n");
+        free(members);
+        return -1;
+    }
+
+    calls = calloc((size_t)count, sizeof(ralectrl_http_call_t));
+    if (calls == NULL) {
+        free(members);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        calls[i].config = &members[i].config;
+        calls[i].method = "POST";
+        calls[i].path = "/api/command";
+        calls[i].json_body = STATUS_REQUEST;
+    }
+
+    ralectrl_http_multi(calls, (size_t)count, options->timeout_ms);
+
+    for (i = 0; i < count; i++) {
+        cluster_parse_status(&members[i], &calls[i]);
+        if (!members[i].responded)
+            continue;
+        latencies[responded++] = calls[i].response.response_time_ms;
+        if (strcmp(members[i].role, "leader") == 0) {
+            leaders++;
+            if (leader == NULL || members[i].term > leader->term)
+                leader = &members[i];
+        }
+    }
+
+    fputs("\n┌─────────┬──────────┬──────────────────────┬───────────┬────────┬──────────┬──────────┬────────┬─────────┐\n", stdout);
+    fputs("│ Node ID │   Name   │       Address        │   Role    │  Term  │  Commit  │ Applied  │  Lag   │ RTT ms  │\n", stdout);
+    fputs("├─────────┼──────────┼──────────────────────┼───────────┼────────┼──────────┼──────────┼────────┼─────────┤\n", stdout);
+    for (i = 0; i < count; i++) {
+        const cluster_member_t  *member = &members[i];
+        char                    address[96];
+        char                    lag[24];
+
+        snprintf(address, sizeof(address), "%s:%u", member->host, (unsigned)member->config.server_port);
+        if (!member->responded) {
+            printf("│ %7d │ %8.8s │ %20.20s │ %9s │ %6s │ %8s │ %8s │ %6s │ %7s │\n",
+                   member->id, member->name, address,
+                   calls[i].timed_out ? "timeout" : "down", "-", "-", "-", "-", "-");
+            continue;
+        }
+
+        /* Lag is how far this node's commit index trails the leader's */
+        if (leader != NULL && member->commit_index >= 0 && leader->commit_index >= 0)
+            snprintf(lag, sizeof(lag), "%ld", leader->commit_index - member->commit_index);
+        else
+            snprintf(lag, sizeof(lag), "-");
+
+        printf("│ %7d │ %8.8s │ %20.20s │ %9s │ %6ld │ %8ld │ %8ld │ %6s │ %7ld │\n",
+               member->id, member->name, address, member->role, member->term,
+               member->commit_index, member->last_applied, lag,
+               calls[i].response.response_time_ms);
+    }
+    fputs("└─────────┴──────────┴──────────────────────┴───────────┴────────┴──────────┴──────────┴────────┴─────────┘\n", stdout);
+
+    printf("Responded: %d/%d", responded, count);
+    if (leader != NULL)
+        printf("   Leader: node %d (term %ld)", leader->id, leader->term);
+    else
+        printf("   Leader: none");
+    if (responded > 0) {
+        qsort(latencies, (size_t)responded, sizeof(long), cluster_compare_long);
+        printf("   RTT p50/p90/p99/max: %ld/%ld/%ld/%ld ms",
+               cluster_percentile(latencies, responded, 50),
+               cluster_percentile(latencies, responded, 90),
+               cluster_percentile(latencies, responded, 99),
+               latencies[responded - 1]);
+    }
+    printf("\n\n");
+    if (leaders > 1)
+        fprintf(stderr, "Warning: %d nodes report themselves as leader\n", leaders);
+
+    for (i = 0; i < count; i++)
+        ralectrl_http_response_cleanup(&calls[i].response);
+    free(calls);
+    free(members);
+    return responded == count ? 0 : -1;
+}
@@ -18,9 +18,17 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <strings.h>
 #include <sys/time.h>
 #include <cjson/cJSON.h>
 
+static ralectrl_http_pool_t *ralectrl_http_pool_create(void);
+static void ralectrl_http_pool_destroy(ralectrl_http_pool_t *pool);
+
 /*-------------------------------------------------------------------------
  * HTTP Client Configuration Functions
  *-------------------------------------------------------------------------*/
@@ -38,6 +46,7 @@ ralectrl_http_config_init(ralectrl_http_config_t *config)
     config->use_ssl = false;
     config->verify_ssl = true;
     config->max_redirects = RALECTRL_HTTP_MAX_REDIRECTS;
+    config->pool = ralectrl_http_pool_create();
 }
 
 void
@@ -58,20 +67,55 @@ ralectrl_http_config_cleanup(ralectrl_http_config_t *config)
         free(config->ca_cert_file);
         config->ca_cert_file = NULL;
     }
+    ralectrl_http_pool_destroy(config->pool);
+    config->pool = NULL;
 }
 
 /*-------------------------------------------------------------------------
  * Low-level HTTP Functions
  *-------------------------------------------------------------------------*/
 
+/*
+ * Resolve host into an IPv4 address.  getaddrinfo() is used rather than
+ * gethostbyname() because fan-out resolves from several threads at once.
+ */
+static int
+ralectrl_http_resolve(const char *host, uint16_t port, struct sockaddr_in *server_addr)
+{
+    struct addrinfo     hints;
+    struct addrinfo     *result = NULL;
+    int                 rc;
+
+    memset(server_addr, 0, sizeof(struct sockaddr_in));
+    server_addr->sin_family = AF_INET;
+    server_addr->sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr->sin_addr) == 1)
+        return 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    rc = getaddrinfo(host, NULL, &hints, &result);
+    if (rc != 0 || result == NULL) {
+        fprintf(stderr, "Error: No such host: %s\n", host);
+        return -1;
+    }
+    server_addr->sin_addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return 0;
+}
+
 static int
 ralectrl_http_connect(const char *host, uint16_t port, int timeout_seconds)
 {
     struct sockaddr_in  server_addr;
-    struct hostent      *server;
     int                 sockfd;
     struct timeval      tv;
 
+    /* Resolve hostname */
+    if (ralectrl_http_resolve(host, port, &server_addr) != 0)
+        return -1;
+
     /* Create socket */
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
@@ -89,20 +133,6 @@ ralectrl_http_connect(const char *host, uint16_t port, int timeout_seconds)
         fprintf(stderr, "Warning: Failed to set socket send timeout\n");
     }
 
-    /* Resolve hostname */
-    server = gethostbyname(host);
-    if (server == NULL) {
-        fprintf(stderr, "Error: No such host: %s\n", host);
-        close(sockfd);
-        return -1;
-    }
-
-    /* Setup server address */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr_list[0], (size_t)server->h_length);
-    server_addr.sin_port = htons(port);
-
     /* Connect to server */
     if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         fprintf(stderr, "Error: Failed to connect to %s:%d: %s\n", host, port, strerror(errno));
@@ -113,299 +143,875 @@ ralectrl_http_connect(const char *host, uint16_t port, int timeout_seconds)
     return sockfd;
 }
 
+/*-------------------------------------------------------------------------
+ * Persistent Connection Functions
+ *-------------------------------------------------------------------------*/
+
+/* How the body of the response being parsed is delimited */
+#define RALECTRL_HTTP_BODY_LENGTH       0   /* Content-Length (or no body) */
+#define RALECTRL_HTTP_BODY_CHUNKED      1   /* Transfer-Encoding: chunked */
+#define RALECTRL_HTTP_BODY_EOF          2   /* Runs until the server closes */
+
+/* Longest chunk-size line (size plus extensions) we are willing to buffer */
+#define RALECTRL_HTTP_MAX_CHUNK_LINE    1024
+
 static int
-ralectrl_http_send_request(int sockfd, const char *method, const char *path, 
-                          const char *host, const char *headers, const char *body)
-{
-    char    request[RALECTRL_HTTP_BUFFER_SIZE];
-    int     request_len;
-
-    /* Build HTTP request */
-    if (body && strlen(body) > 0) {
-        request_len = snprintf(request, sizeof(request),
-            "%s %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Length: %zu\r\n"
-            "Connection: close\r\n"
-            "%s"
-            "\r\n"
-            "%s",
-            method, path, host, strlen(body), headers ? headers : "", body);
-    } else {
-        request_len = snprintf(request, sizeof(request),
-            "%s %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Connection: close\r\n"
-            "%s"
-            "\r\n",
-            method, path, host, headers ? headers : "");
+ralectrl_http_send_all(int sockfd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(sockfd, data, length, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
     }
+    return 0;
+}
 
-    if (request_len >= (int)sizeof(request)) {
-        fprintf(stderr, "Error: HTTP request too large\n");
-        return -1;
+static void
+ralectrl_http_reset_parse(ralectrl_http_conn_t *conn)
+{
+    conn->scan_offset = 0;
+    conn->header_length = 0;
+    conn->body_offset = 0;
+    conn->content_length = 0;
+    conn->body_capacity = 0;
+    conn->body_mode = RALECTRL_HTTP_BODY_LENGTH;
+}
+
+static char *
+ralectrl_http_find_crlf(char *data, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < length; i++) {
+        if (data[i] == '\r' && data[i + 1] == '\n')
+            return data + i;
     }
+    return NULL;
+}
 
-    /* Send request */
-    if (send(sockfd, request, (size_t)request_len, 0) < 0) {
-        fprintf(stderr, "Error: Failed to send HTTP request: %s\n", strerror(errno));
+static bool
+ralectrl_http_header_has_token(const char *value, size_t length, const char *token)
+{
+    size_t token_length = strlen(token);
+    size_t i;
+
+    for (i = 0; i + token_length <= length; i++) {
+        if (strncasecmp(value + i, token, token_length) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Parse the status line and the headers that decide how the body is framed.
+ * Called once per response, as soon as the blank line ending the header
+ * block has arrived.
+ */
+static int
+ralectrl_http_parse_headers(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response)
+{
+    char        *data = conn->rbuf;
+    char        *end = data + conn->header_length;
+    char        *line = data;
+    bool        have_length = false;
+    bool        chunked = false;
+
+    if (strncmp(data, "HTTP/1.", 7) != 0)
         return -1;
+
+    response->status_code = 0;
+    while (line < end) {
+        char    *eol = memchr(line, '\n', (size_t)(end - line));
+        size_t  len;
+
+        if (eol == NULL)
+            break;
+        len = (size_t)(eol - line);
+
+        if (line == data) {
+            char *space = memchr(line, ' ', len);
+            if (space)
+                response->status_code = atoi(space + 1);
+        } else if (len > 15 && strncasecmp(line, "Content-Length:", 15) == 0) {
+            conn->content_length = (size_t)strtoul(line + 15, NULL, 10);
+            have_length = true;
+        } else if (len > 18 && strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            chunked = ralectrl_http_header_has_token(line + 18, len - 18, "chunked");
+        } else if (len > 11 && strncasecmp(line, "Connection:", 11) == 0) {
+            if (ralectrl_http_header_has_token(line + 11, len - 11, "close"))
+                conn->peer_closing = true;
+        } else if (len > 13 && strncasecmp(line, "Content-Type:", 13) == 0 &&
+                   response->content_type == NULL) {
+            char    *v = line + 13;
+            size_t  vlen;
+
+            while (*v == ' ')
+                v++;
+            vlen = (size_t)(eol - v);
+            if (vlen > 0 && v[vlen - 1] == '\r')
+                vlen--;
+            response->content_type = strndup(v, vlen);
+        }
+        line = eol + 1;
     }
 
+    if (chunked) {
+        conn->body_mode = RALECTRL_HTTP_BODY_CHUNKED;
+        conn->content_length = 0;
+    } else if (have_length) {
+        conn->body_mode = RALECTRL_HTTP_BODY_LENGTH;
+    } else if ((response->status_code >= 100 && response->status_code < 200) ||
+               response->status_code == 204 || response->status_code == 304) {
+        conn->body_mode = RALECTRL_HTTP_BODY_LENGTH;
+        conn->content_length = 0;
+    } else {
+        /* Body runs to end of stream; the connection cannot be reused */
+        conn->body_mode = RALECTRL_HTTP_BODY_EOF;
+        conn->peer_closing = true;
+    }
+    conn->body_offset = conn->header_length;
     return 0;
 }
 
 static int
-ralectrl_http_receive_response(int sockfd, ralectrl_http_response_t *response)
-{
-    char        buffer[RALECTRL_HTTP_BUFFER_SIZE];
-    ssize_t     bytes_received;
-    char        *response_data = NULL;
-    size_t      response_size = 0;
-    char        *header_end;
-    char        *status_line;
-    char        *body_start;
-    char        *content_length_str;
-    int         content_length = 0;
-
-    /* Receive response data */
-    while ((bytes_received = recv(sockfd, buffer, sizeof(buffer) - 1, 0)) > 0) {
-        buffer[bytes_received] = '\0';
-        
-        /* Reallocate response buffer */
-        response_data = realloc(response_data, response_size + (size_t)bytes_received + 1);
-        if (response_data == NULL) {
+ralectrl_http_append_body(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response,
+                          const char *data, size_t length)
+{
+    if (response->body == NULL || response->body_length + length + 1 > conn->body_capacity) {
+        size_t  capacity = conn->body_capacity ? conn->body_capacity : RALECTRL_HTTP_BUFFER_SIZE;
+        char    *grown;
+
+        while (capacity < response->body_length + length + 1)
+            capacity *= 2;
+        grown = realloc(response->body, capacity);
+        if (grown == NULL) {
             fprintf(stderr, "Error: Failed to allocate memory for response\n");
             return -1;
         }
-        
-        memcpy(response_data + response_size, buffer, (size_t)bytes_received);
-        response_size += (size_t)bytes_received;
-        response_data[response_size] = '\0';
+        response->body = grown;
+        conn->body_capacity = capacity;
     }
 
-    if (response_data == NULL) {
-        fprintf(stderr, "Error: No response received\n");
-        return -1;
-    }
+    memcpy(response->body + response->body_length, data, length);
+    response->body_length += length;
+    response->body[response->body_length] = '\0';
+    return 0;
+}
 
-    /* Parse status line */
-    status_line = response_data;
-    if (strncmp(status_line, "HTTP/1.", 7) == 0) {
-        char *space = strchr(status_line + 7, ' ');
-        if (space) {
-            response->status_code = atoi(space + 1);
+/*
+ * Decode every complete chunk that has arrived, starting where the previous
+ * call stopped.  Returns 1 with *total set once the terminating chunk and
+ * trailers are in, 0 when more bytes are needed and -1 on malformed input.
+ */
+static int
+ralectrl_http_decode_chunks(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response,
+                            size_t *total)
+{
+    for (;;) {
+        char                *line = conn->rbuf + conn->body_offset;
+        size_t              avail = conn->rlen - conn->body_offset;
+        char                *eol = ralectrl_http_find_crlf(line, avail);
+        char                *size_end;
+        unsigned long long  chunk_size;
+        size_t              line_length;
+
+        if (eol == NULL)
+            return avail > RALECTRL_HTTP_MAX_CHUNK_LINE ? -1 : 0;
+
+        chunk_size = strtoull(line, &size_end, 16);
+        if (size_end == line || chunk_size > (unsigned long long)(SIZE_MAX / 2))
+            return -1;
+        line_length = (size_t)(eol - line) + 2;
+
+        if (chunk_size == 0) {
+            /* Skip trailers up to the blank line that ends the message */
+            char *trailer = line + line_length;
+
+            for (;;) {
+                char *trailer_end = ralectrl_http_find_crlf(trailer,
+                                        (size_t)(conn->rbuf + conn->rlen - trailer));
+
+                if (trailer_end == NULL)
+                    return 0;
+                if (trailer_end == trailer) {
+                    *total = (size_t)(trailer_end + 2 - conn->rbuf);
+                    return 1;
+                }
+                trailer = trailer_end + 2;
+            }
         }
+
+        if (avail < line_length + (size_t)chunk_size + 2)
+            return 0;
+        if (line[line_length + chunk_size] != '\r' || line[line_length + chunk_size + 1] != '\n')
+            return -1;
+        if (ralectrl_http_append_body(conn, response, line + line_length, (size_t)chunk_size) != 0)
+            return -1;
+        conn->body_offset += line_length + (size_t)chunk_size + 2;
     }
+}
 
-    /* Find header/body separator */
-    header_end = strstr(response_data, "\r\n\r\n");
-    if (header_end == NULL) {
-        header_end = strstr(response_data, "\n\n");
-        if (header_end) {
-            body_start = header_end + 2;
-        } else {
-            body_start = response_data + response_size;
-        }
-    } else {
-        body_start = header_end + 4;
-    }
-
-    /* Extract Content-Length */
-    content_length_str = strstr(response_data, "Content-Length:");
-    if (content_length_str && content_length_str < body_start) {
-        content_length = atoi(content_length_str + 15);
-    }
-
-    /* Extract Content-Type */
-    char *content_type_str = strstr(response_data, "Content-Type:");
-    if (content_type_str && content_type_str < body_start) {
-        char *ct_start = content_type_str + 13;
-        while (*ct_start == ' ') ct_start++;
-        char *ct_end = strstr(ct_start, "\r\n");
-        if (ct_end == NULL) ct_end = strstr(ct_start, "\n");
-        if (ct_end) {
-            size_t ct_len = (size_t)(ct_end - ct_start);
-            response->content_type = malloc(ct_len + 1);
-            if (response->content_type) {
-                strncpy(response->content_type, ct_start, ct_len);
-                response->content_type[ct_len] = '\0';
+/*
+ * Try to take one complete response off the front of the connection's
+ * receive buffer.  Returns 1 when a response was consumed, 0 when more
+ * bytes are needed and -1 when the data cannot be parsed.  With at_eof set
+ * a response without Content-Length is completed by the end of stream.
+ *
+ * Parse progress is kept in the connection, so each call only looks at
+ * bytes that arrived since the previous one.
+ */
+static int
+ralectrl_http_parse_buffered(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response,
+                             bool at_eof)
+{
+    size_t      total = 0;
+    int         rc;
+
+    if (conn->header_length == 0) {
+        size_t  i = conn->scan_offset > 3 ? conn->scan_offset - 3 : 0;
+        char    *data = conn->rbuf;
+
+        for (; i + 3 < conn->rlen; i++) {
+            if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n') {
+                conn->header_length = i + 4;
+                break;
             }
         }
+        if (conn->header_length == 0) {
+            conn->scan_offset = conn->rlen;
+            if (conn->rlen > RALECTRL_HTTP_MAX_HEADER_SIZE)
+                return -1;
+            return at_eof && conn->rlen > 0 ? -1 : 0;
+        }
+        if (ralectrl_http_parse_headers(conn, response) != 0)
+            return -1;
     }
 
-    /* Extract body */
-    if (body_start < response_data + response_size) {
-        size_t body_len = response_size - (size_t)(body_start - response_data);
-        if (content_length > 0 && body_len > (size_t)content_length) {
-            body_len = (size_t)content_length;
-        }
-        
-        response->body = malloc(body_len + 1);
-        if (response->body) {
-            memcpy(response->body, body_start, body_len);
-            response->body[body_len] = '\0';
-            response->body_length = body_len;
-        }
+    switch (conn->body_mode) {
+        case RALECTRL_HTTP_BODY_CHUNKED:
+            rc = ralectrl_http_decode_chunks(conn, response, &total);
+            if (rc <= 0)
+                return rc;
+            break;
+        case RALECTRL_HTTP_BODY_EOF:
+            if (!at_eof)
+                return 0;
+            conn->content_length = conn->rlen - conn->header_length;
+            /* fall through */
+        default:
+            total = conn->header_length + conn->content_length;
+            if (conn->rlen < total)
+                return 0;
+            if (ralectrl_http_append_body(conn, response, conn->rbuf + conn->header_length,
+                                          conn->content_length) != 0)
+                return -1;
+            break;
     }
 
-    free(response_data);
-    return 0;
+    conn->rlen -= total;
+    memmove(conn->rbuf, conn->rbuf + total, conn->rlen);
+    ralectrl_http_reset_parse(conn);
+    return 1;
 }
 
-/*-------------------------------------------------------------------------
- * High-level HTTP Functions
- *-------------------------------------------------------------------------*/
-
 int
-ralectrl_http_get(const ralectrl_http_config_t *config, const char *path, ralectrl_http_response_t *response)
+ralectrl_http_conn_open(const ralectrl_http_config_t *config, ralectrl_http_conn_t *conn)
 {
-    int         sockfd;
-    char        host_header[256];
-    struct timeval start_time, end_time;
-
-    if (config == NULL || path == NULL || response == NULL)
+    if (config == NULL || conn == NULL)
         return -1;
 
-    memset(response, 0, sizeof(ralectrl_http_response_t));
-    gettimeofday(&start_time, NULL);
+    memset(conn, 0, sizeof(ralectrl_http_conn_t));
+    conn->config = config;
+    conn->sockfd = ralectrl_http_connect(config->server_host, config->server_port, config->timeout_seconds);
+    return conn->sockfd < 0 ? -1 : 0;
+}
 
-    /* Connect to server */
-    sockfd = ralectrl_http_connect(config->server_host, config->server_port, config->timeout_seconds);
-    if (sockfd < 0)
+/*
+ * Format the request line and headers for a request carrying body_length
+ * bytes of JSON (has_body false for none).  Returns the header length.
+ */
+static int
+ralectrl_http_format_request(const ralectrl_http_config_t *config, const char *method,
+                             const char *path, bool has_body, size_t body_length,
+                             bool keep_alive, char *header, size_t header_size)
+{
+    int header_length;
+
+    header_length = snprintf(header, header_size,
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "Connection: %s\r\n"
+        "%s%s%s"
+        "%s"
+        "Content-Length: %zu\r\n"
+        "\r\n",
+        method, path, config->server_host, config->server_port,
+        keep_alive ? "keep-alive" : "close",
+        config->api_key ? "Authorization: Bearer " : "",
+        config->api_key ? config->api_key : "",
+        config->api_key ? "\r\n" : "",
+        has_body ? "Content-Type: application/json\r\n" : "",
+        body_length);
+    if (header_length < 0 || header_length >= (int)header_size) {
+        fprintf(stderr, "Error: HTTP request header too large\n");
         return -1;
-
-    /* Prepare headers */
-    snprintf(host_header, sizeof(host_header), "%s:%d", config->server_host, config->server_port);
-    
-    char headers[512] = "";
-    if (config->api_key) {
-        snprintf(headers, sizeof(headers), "Authorization: Bearer %s\r\n", config->api_key);
     }
+    return header_length;
+}
 
-    /* Send GET request */
-    if (ralectrl_http_send_request(sockfd, "GET", path, host_header, headers, NULL) < 0) {
-        close(sockfd);
+int
+ralectrl_http_conn_send(ralectrl_http_conn_t *conn, const char *method, const char *path,
+                        const char *json_body)
+{
+    char        header[1024];
+    size_t      body_length = json_body ? strlen(json_body) : 0;
+    int         header_length;
+
+    if (conn == NULL || conn->sockfd < 0 || method == NULL || path == NULL)
         return -1;
-    }
 
-    /* Receive response */
-    if (ralectrl_http_receive_response(sockfd, response) < 0) {
-        close(sockfd);
+    header_length = ralectrl_http_format_request(conn->config, method, path, json_body != NULL,
+                                                 body_length, true, header, sizeof(header));
+    if (header_length < 0)
+        return -1;
+
+    if (ralectrl_http_send_all(conn->sockfd, header, (size_t)header_length) < 0 ||
+        (body_length > 0 && ralectrl_http_send_all(conn->sockfd, json_body, body_length) < 0)) {
+        fprintf(stderr, "Error: Failed to send HTTP request: %s\n", strerror(errno));
         return -1;
     }
 
-    close(sockfd);
+    conn->pending++;
+    return 0;
+}
 
-    /* Calculate response time */
-    gettimeofday(&end_time, NULL);
-    response->response_time_ms = ((end_time.tv_sec - start_time.tv_sec) * 1000) + 
-                                ((end_time.tv_usec - start_time.tv_usec) / 1000);
+/*
+ * One recv() into the connection buffer, growing it as needed.  Returns
+ * the byte count, 0 at end of stream, or -1 with errno set.
+ */
+static ssize_t
+ralectrl_http_conn_read(ralectrl_http_conn_t *conn)
+{
+    ssize_t bytes_received;
 
-    return 0;
+    if (conn->rcap - conn->rlen < RALECTRL_HTTP_BUFFER_SIZE) {
+        size_t  new_cap = conn->rcap ? conn->rcap * 2 : RALECTRL_HTTP_BUFFER_SIZE * 2;
+        char    *grown = realloc(conn->rbuf, new_cap);
+
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for response\n");
+            errno = ENOMEM;
+            return -1;
+        }
+        conn->rbuf = grown;
+        conn->rcap = new_cap;
+    }
+
+    bytes_received = recv(conn->sockfd, conn->rbuf + conn->rlen, conn->rcap - conn->rlen, 0);
+    if (bytes_received > 0)
+        conn->rlen += (size_t)bytes_received;
+    return bytes_received;
 }
 
 int
-ralectrl_http_post_json(const ralectrl_http_config_t *config, const char *path, 
-                        const char *json_body, ralectrl_http_response_t *response)
+ralectrl_http_conn_receive(ralectrl_http_conn_t *conn, ralectrl_http_response_t *response)
 {
-    int         sockfd;
-    char        host_header[256];
-    char        headers[512];
-    struct timeval start_time, end_time;
+    bool        at_eof = false;
 
-    if (config == NULL || path == NULL || response == NULL)
+    if (conn == NULL || response == NULL || conn->sockfd < 0 || conn->pending <= 0)
         return -1;
 
     memset(response, 0, sizeof(ralectrl_http_response_t));
-    gettimeofday(&start_time, NULL);
 
-    /* Connect to server */
-    sockfd = ralectrl_http_connect(config->server_host, config->server_port, config->timeout_seconds);
-    if (sockfd < 0)
-        return -1;
+    for (;;) {
+        ssize_t     bytes_received;
+        int         parsed;
 
-    /* Prepare headers */
-    snprintf(host_header, sizeof(host_header), "%s:%d", config->server_host, config->server_port);
-    
-    if (config->api_key) {
-        snprintf(headers, sizeof(headers), 
-                "Content-Type: application/json\r\n"
-                "Authorization: Bearer %s\r\n", config->api_key);
-    } else {
-        strcpy(headers, "Content-Type: application/json\r\n");
+        parsed = ralectrl_http_parse_buffered(conn, response, at_eof);
+        if (parsed > 0) {
+            conn->pending--;
+            return 0;
+        }
+        if (parsed < 0 || at_eof) {
+            ralectrl_http_response_cleanup(response);
+            /* Closed before a single byte of the response arrived */
+            errno = parsed == 0 && conn->rlen == 0 ? ECONNRESET : EPROTO;
+            return -1;
+        }
+
+        bytes_received = ralectrl_http_conn_read(conn);
+        if (bytes_received < 0) {
+            if (errno == EINTR)
+                continue;
+            ralectrl_http_response_cleanup(response);
+            if (errno == ECONNRESET && conn->rlen != 0)
+                errno = EPROTO;
+            return -1;
+        }
+        if (bytes_received == 0)
+            at_eof = true;
     }
+}
 
-    /* Send POST request */
-    if (ralectrl_http_send_request(sockfd, "POST", path, host_header, headers, json_body) < 0) {
-        close(sockfd);
-        return -1;
+void
+ralectrl_http_conn_close(ralectrl_http_conn_t *conn)
+{
+    if (conn == NULL)
+        return;
+
+    if (conn->sockfd >= 0) {
+        close(conn->sockfd);
+        conn->sockfd = -1;
     }
+    free(conn->rbuf);
+    conn->rbuf = NULL;
+    conn->rlen = 0;
+    conn->rcap = 0;
+    conn->pending = 0;
+    conn->peer_closing = false;
+    ralectrl_http_reset_parse(conn);
+}
 
-    /* Receive response */
-    if (ralectrl_http_receive_response(sockfd, response) < 0) {
-        close(sockfd);
+/*-------------------------------------------------------------------------
+ * Connection Pool
+ *-------------------------------------------------------------------------*/
+
+typedef struct {
+    char                    key[288];   /* host:port */
+    ralectrl_http_conn_t    conn;
+    time_t                  idle_since;
+} ralectrl_http_pool_entry_t;
+
+struct ralectrl_http_pool {
+    pthread_mutex_t             mutex;
+    int                         count;
+    ralectrl_http_pool_entry_t  entries[RALECTRL_HTTP_POOL_SIZE];
+};
+
+static ralectrl_http_pool_t *
+ralectrl_http_pool_create(void)
+{
+    ralectrl_http_pool_t *pool = calloc(1, sizeof(ralectrl_http_pool_t));
+
+    if (pool == NULL)
+        return NULL;
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void
+ralectrl_http_pool_destroy(ralectrl_http_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = 0; i < pool->count; i++)
+        ralectrl_http_conn_close(&pool->entries[i].conn);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+static void
+ralectrl_http_pool_key(const ralectrl_http_config_t *config, char *key, size_t key_size)
+{
+    snprintf(key, key_size, "%s:%u", config->server_host, (unsigned)config->server_port);
+}
+
+/*
+ * An idle keep-alive connection must have nothing to read.  If it polls
+ * readable the server has closed it (or sent something we never asked for)
+ * and it is not safe to reuse.
+ */
+static bool
+ralectrl_http_conn_is_reusable(const ralectrl_http_conn_t *conn)
+{
+    struct pollfd pfd;
+
+    pfd.fd = conn->sockfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 0;
+}
+
+/*
+ * Take an idle connection to config's host:port out of the pool.  Returns
+ * true and fills *conn on success.  Expired and dead connections found on
+ * the way are closed.
+ */
+static bool
+ralectrl_http_pool_acquire(const ralectrl_http_config_t *config, ralectrl_http_conn_t *conn)
+{
+    ralectrl_http_pool_t    *pool = config->pool;
+    char                    key[288];
+    time_t                  now = time(NULL);
+    bool                    found = false;
+    int                     i;
+
+    if (pool == NULL)
+        return false;
+
+    ralectrl_http_pool_key(config, key, sizeof(key));
+
+    pthread_mutex_lock(&pool->mutex);
+    for (i = pool->count - 1; i >= 0 && !found; i--) {
+        ralectrl_http_pool_entry_t *entry = &pool->entries[i];
+        bool expired = now - entry->idle_since >= RALECTRL_HTTP_POOL_IDLE_SECONDS;
+
+        if (!expired && strcmp(entry->key, key) != 0)
+            continue;
+
+        if (!expired && ralectrl_http_conn_is_reusable(&entry->conn)) {
+            *conn = entry->conn;
+            conn->config = config;
+            found = true;
+        } else {
+            ralectrl_http_conn_close(&entry->conn);
+        }
+        pool->entries[i] = pool->entries[--pool->count];
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return found;
+}
+
+/*
+ * Return a connection after a completed request.  Connections the server
+ * is closing, or that still carry unread data, are closed instead.
+ */
+static void
+ralectrl_http_pool_release(const ralectrl_http_config_t *config, ralectrl_http_conn_t *conn)
+{
+    ralectrl_http_pool_t *pool = config->pool;
+
+    if (pool == NULL || conn->sockfd < 0 || conn->peer_closing ||
+        conn->pending != 0 || conn->rlen != 0) {
+        ralectrl_http_conn_close(conn);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->count < RALECTRL_HTTP_POOL_SIZE) {
+        ralectrl_http_pool_entry_t *entry = &pool->entries[pool->count++];
+
+        ralectrl_http_pool_key(config, entry->key, sizeof(entry->key));
+        entry->conn = *conn;
+        entry->idle_since = time(NULL);
+        conn->sockfd = -1;
+        conn->rbuf = NULL;
+        conn->rcap = 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    /* Closes the socket only if the pool was full */
+    ralectrl_http_conn_close(conn);
+}
+
+/*-------------------------------------------------------------------------
+ * High-level HTTP Functions
+ *-------------------------------------------------------------------------*/
+
+/*
+ * Methods that leave the server in the same state however often they run,
+ * and so may be replayed after a lost connection (RFC 9110, 9.2.2).
+ */
+static bool
+ralectrl_http_method_is_idempotent(const char *method)
+{
+    return strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0 ||
+           strcmp(method, "PUT") == 0 || strcmp(method, "DELETE") == 0;
+}
+
+int
+ralectrl_http_request(const ralectrl_http_config_t *config, const char *method, const char *path,
+                      const char *json_body, ralectrl_http_response_t *response)
+{
+    ralectrl_http_conn_t    conn;
+    struct timeval          start_time, end_time;
+
+    if (config == NULL || method == NULL || path == NULL || response == NULL)
         return -1;
+
+    memset(response, 0, sizeof(ralectrl_http_response_t));
+    gettimeofday(&start_time, NULL);
+
+    for (;;) {
+        bool reused = ralectrl_http_pool_acquire(config, &conn);
+        bool unanswered;
+
+        if (!reused && ralectrl_http_conn_open(config, &conn) != 0) {
+            ralectrl_http_conn_close(&conn);
+            return -1;
+        }
+
+        if (ralectrl_http_conn_send(&conn, method, path, json_body) != 0)
+            unanswered = true;
+        else if (ralectrl_http_conn_receive(&conn, response) == 0)
+            break;
+        else
+            unanswered = errno == ECONNRESET;
+
+        ralectrl_http_conn_close(&conn);
+        /*
+         * A pooled connection the server dropped while idle fails on send,
+         * or reads EOF before any response byte.  Only then, and only for
+         * idempotent methods, is it safe to go again on another connection;
+         * a timeout may mean the server already ran the request.
+         */
+        if (!reused || !unanswered || !ralectrl_http_method_is_idempotent(method)) {
+            fprintf(stderr, "Error: No response received\n");
+            return -1;
+        }
     }
 
-    close(sockfd);
+    ralectrl_http_pool_release(config, &conn);
 
     /* Calculate response time */
     gettimeofday(&end_time, NULL);
-    response->response_time_ms = ((end_time.tv_sec - start_time.tv_sec) * 1000) + 
+    response->response_time_ms = ((end_time.tv_sec - start_time.tv_sec) * 1000) +
                                 ((end_time.tv_usec - start_time.tv_usec) / 1000);
 
     return 0;
 }
 
+int
+ralectrl_http_get(const ralectrl_http_config_t *config, const char *path, ralectrl_http_response_t *response)
+{
+    return ralectrl_http_request(config, "GET", path, NULL, response);
+}
+
+int
+ralectrl_http_post_json(const ralectrl_http_config_t *config, const char *path,
+                        const char *json_body, ralectrl_http_response_t *response)
+{
+    return ralectrl_http_request(config, "POST", path, json_body ? json_body : "", response);
+}
+
+int
+ralectrl_http_put_json(const ralectrl_http_config_t *config, const char *path,
+                       const char *json_body, ralectrl_http_response_t *response)
+{
+    return ralectrl_http_request(config, "PUT", path, json_body ? json_body : "", response);
+}
+
 int
 ralectrl_http_delete(const ralectrl_http_config_t *config, const char *path, ralectrl_http_response_t *response)
 {
-    int         sockfd;
-    char        host_header[256];
-    char        headers[512];
-    struct timeval start_time, end_time;
+    return ralectrl_http_request(config, "DELETE", path, NULL, response);
+}
 
-    if (config == NULL || path == NULL || response == NULL)
-        return -1;
+/* Progress of one ralectrl_http_multi() call */
+#define RALECTRL_HTTP_MULTI_CONNECTING  0
+#define RALECTRL_HTTP_MULTI_SENDING     1
+#define RALECTRL_HTTP_MULTI_RECEIVING   2
+#define RALECTRL_HTTP_MULTI_DONE        3
+
+typedef struct {
+    ralectrl_http_conn_t    conn;
+    char                    *request;   /* Header and body, sent incrementally */
+    size_t                  request_length;
+    size_t                  sent;
+    int                     state;
+} ralectrl_http_multi_slot_t;
+
+static long
+ralectrl_http_elapsed_ms(const struct timeval *since)
+{
+    struct timeval now;
 
-    memset(response, 0, sizeof(ralectrl_http_response_t));
-    gettimeofday(&start_time, NULL);
+    gettimeofday(&now, NULL);
+    return ((now.tv_sec - since->tv_sec) * 1000) + ((now.tv_usec - since->tv_usec) / 1000);
+}
 
-    /* Connect to server */
-    sockfd = ralectrl_http_connect(config->server_host, config->server_port, config->timeout_seconds);
-    if (sockfd < 0)
-        return -1;
+/*
+ * Build the request and start a non-blocking connect.  On failure the
+ * slot is left DONE with the call's result at -1.
+ */
+static void
+ralectrl_http_multi_start(ralectrl_http_call_t *call, ralectrl_http_multi_slot_t *slot)
+{
+    const ralectrl_http_config_t    *config = call->config;
+    struct sockaddr_in              server_addr;
+    char                            header[1024];
+    size_t                          body_length = call->json_body ? strlen(call->json_body) : 0;
+    int                             header_length;
+    int                             flags;
+
+    slot->conn.sockfd = -1;
+    slot->conn.config = config;
+    slot->state = RALECTRL_HTTP_MULTI_DONE;
+
+    header_length = ralectrl_http_format_request(config, call->method, call->path,
+                                                 call->json_body != NULL, body_length,
+                                                 false, header, sizeof(header));
+    if (header_length < 0)
+        return;
+    slot->request_length = (size_t)header_length + body_length;
+    slot->request = malloc(slot->request_length);
+    if (slot->request == NULL)
+        return;
+    memcpy(slot->request, header, (size_t)header_length);
+    if (body_length > 0)
+        memcpy(slot->request + header_length, call->json_body, body_length);
 
-    /* Prepare headers */
-    snprintf(host_header, sizeof(host_header), "%s:%d", config->server_host, config->server_port);
-    
-    if (config->api_key) {
-        snprintf(headers, sizeof(headers), "Authorization: Bearer %s\r\n", config->api_key);
-    } else {
-        strcpy(headers, "");
+    if (ralectrl_http_resolve(config->server_host, config->server_port, &server_addr) != 0)
+        return;
+
+    slot->conn.sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (slot->conn.sockfd < 0)
+        return;
+    flags = fcntl(slot->conn.sockfd, F_GETFL, 0);
+    if (flags < 0 || fcntl(slot->conn.sockfd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return;
+
+    if (connect(slot->conn.sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0)
+        slot->state = RALECTRL_HTTP_MULTI_SENDING;
+    else if (errno == EINPROGRESS)
+        slot->state = RALECTRL_HTTP_MULTI_CONNECTING;
+}
+
+/*
+ * Advance one call after poll() reported events on its socket.  Returns
+ * true once the call is finished, successfully or not.
+ */
+static bool
+ralectrl_http_multi_step(ralectrl_http_call_t *call, ralectrl_http_multi_slot_t *slot,
+                         short revents, const struct timeval *start_time)
+{
+    if (slot->state == RALECTRL_HTTP_MULTI_CONNECTING) {
+        int         error = 0;
+        socklen_t   error_length = sizeof(error);
+
+        if (getsockopt(slot->conn.sockfd, SOL_SOCKET, SO_ERROR, &error, &error_length) < 0 ||
+            error != 0)
+            return true;
+        slot->state = RALECTRL_HTTP_MULTI_SENDING;
     }
 
-    /* Send DELETE request */
-    if (ralectrl_http_send_request(sockfd, "DELETE", path, host_header, headers, NULL) < 0) {
-        close(sockfd);
-        return -1;
+    if (slot->state == RALECTRL_HTTP_MULTI_SENDING && (revents & POLLOUT)) {
+        ssize_t sent = send(slot->conn.sockfd, slot->request + slot->sent,
+                            slot->request_length - slot->sent, MSG_NOSIGNAL);
+
+        if (sent < 0)
+            return !(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        slot->sent += (size_t)sent;
+        if (slot->sent == slot->request_length) {
+            slot->state = RALECTRL_HTTP_MULTI_RECEIVING;
+            slot->conn.pending = 1;
+        }
+        return false;
     }
 
-    /* Receive response */
-    if (ralectrl_http_receive_response(sockfd, response) < 0) {
-        close(sockfd);
+    if (slot->state == RALECTRL_HTTP_MULTI_RECEIVING && (revents & (POLLIN | POLLHUP | POLLERR))) {
+        ssize_t bytes_received = ralectrl_http_conn_read(&slot->conn);
+        int     parsed;
+
+        if (bytes_received < 0)
+            return !(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+
+        parsed = ralectrl_http_parse_buffered(&slot->conn, &call->response, bytes_received == 0);
+        if (parsed > 0) {
+            call->result = 0;
+            call->response.response_time_ms = ralectrl_http_elapsed_ms(start_time);
+            return true;
+        }
+        return parsed < 0 || bytes_received == 0;
+    }
+
+    return (revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+}
+
+int
+ralectrl_http_multi(ralectrl_http_call_t *calls, size_t count, int timeout_ms)
+{
+    ralectrl_http_multi_slot_t  *slots;
+    struct pollfd               *pfds;
+    size_t                      *active;
+    struct timeval              start_time;
+    size_t                      i;
+    int                         result = 0;
+
+    if (calls == NULL)
+        return -1;
+    if (count == 0)
+        return 0;
+
+    slots = calloc(count, sizeof(ralectrl_http_multi_slot_t));
+    pfds = calloc(count, sizeof(struct pollfd));
+    active = calloc(count, sizeof(size_t));
+    if (slots == NULL || pfds == NULL || active == NULL) {
+        free(slots);
+        free(pfds);
+        free(active);
         return -1;
     }
 
-    close(sockfd);
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < count; i++) {
+        calls[i].result = -1;
+        calls[i].timed_out = false;
+        memset(&calls[i].response, 0, sizeof(ralectrl_http_response_t));
+        ralectrl_http_multi_start(&calls[i], &slots[i]);
+    }
 
-    /* Calculate response time */
-    gettimeofday(&end_time, NULL);
-    response->response_time_ms = ((end_time.tv_sec - start_time.tv_sec) * 1000) + 
-                                ((end_time.tv_usec - start_time.tv_usec) / 1000);
+    for (;;) {
+        nfds_t  nfds = 0;
+        long    remaining = timeout_ms - ralectrl_http_elapsed_ms(&start_time);
+        int     ready;
+
+        for (i = 0; i < count; i++) {
+            if (slots[i].state == RALECTRL_HTTP_MULTI_DONE)
+                continue;
+            pfds[nfds].fd = slots[i].conn.sockfd;
+            pfds[nfds].events = slots[i].state == RALECTRL_HTTP_MULTI_RECEIVING ? POLLIN : POLLOUT;
+            pfds[nfds].revents = 0;
+            active[nfds] = i;
+            nfds++;
+        }
+        if (nfds == 0 || remaining <= 0)
+            break;
+
+        ready = poll(pfds, nfds, (int)remaining);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
 
-    return 0;
+        for (i = 0; i < (size_t)nfds; i++) {
+            size_t index = active[i];
+
+            if (pfds[i].revents == 0)
+                continue;
+            if (ralectrl_http_multi_step(&calls[index], &slots[index], pfds[i].revents, &start_time))
+                slots[index].state = RALECTRL_HTTP_MULTI_DONE;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (slots[i].state != RALECTRL_HTTP_MULTI_DONE)
+            calls[i].timed_out = true;
+        if (calls[i].result != 0) {
+            ralectrl_http_response_cleanup(&calls[i].response);
+            result = -1;
+        }
+        ralectrl_http_conn_close(&slots[i].conn);
+        free(slots[i].request);
+    }
+
+    free(slots);
+    free(pfds);
+    free(active);
+    return result;
 }
 
 void
@@ -17,8 +17,28 @@
 /** Local headers */
 #include "raled_config.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Main-loop tick and watchdog statistics, flattened for STATUS */
+typedef struct raled_loop_stats_t
+{
+	uint64_t	ticks;
+	uint64_t	ticks_over_budget;
+	uint64_t	max_tick_us;
+	uint32_t	tick_p50_ms;
+	uint32_t	tick_p99_ms;
+	uint64_t	keepalives_sent;
+	uint64_t	keepalives_failed;
+	uint64_t	expirations;
+	const char *watchdog_state;
+} raled_loop_stats_t;
+
 /** Function declarations */
 extern int raled_init(const config_t *config);
 extern int raled_finit(void);
 
+/** Main-loop tick and watchdog statistics; false if the watchdog is not set up */
+extern bool raled_get_loop_stats(raled_loop_stats_t *stats);
+
 #endif							/* RALED_H */
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * raled_affinity.h
+ *    CPU and NUMA placement of RALED threads.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ * IDENTIFICATION
+ *    raled/include/raled_affinity.h
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RALED_AFFINITY_H
+#define RALED_AFFINITY_H
+
+/** System headers */
+#include <stddef.h>
+
+/** Local headers */
+#include "raled_config.h"
+
+/** Detect the topology and resolve consensus_cpus and io_cpus against it */
+extern void raled_affinity_init(const config_t *config);
+
+/** Pin the calling thread as the main loop (network, consensus and apply) */
+extern void raled_affinity_apply_consensus(void);
+
+/** Pin the calling thread as an I/O thread; threads it creates inherit this */
+extern void raled_affinity_apply_io(void);
+
+/** Append the layout as a JSON member ("placement":{...}) if it fits; returns bytes written */
+extern int raled_affinity_describe(char *out, size_t outlen);
+
+#endif												/* RALED_AFFINITY_H */
@@ -39,5 +39,8 @@ typedef struct config_entry
 
 /** Function declarations */
 extern int read_config(const char *filename, config_t *config);
+extern int reload_config(const char *filename, char *errbuf, size_t errbuflen);
+extern int publish_runtime_config(void);
+extern int set_config_option(const char *name, const char *value, char *errbuf, size_t errbuflen);
 
 #endif												/* CONFIGFILE_H */
@@ -45,13 +45,35 @@ typedef struct guc_entry_t
 	int (*parser)(const char *); /** Parser function for enum types */
 } guc_entry_t;
 
+/** Index of a parameter in guc_table, resolved once by guc_lookup() */
+typedef int guc_handle_t;
+
+#define GUC_INVALID_HANDLE	(-1)
+
 /** External variables */
 extern guc_entry_t guc_table[];
 extern int guc_table_size;
 
 /** Function declarations */
 int guc_set(const char *name, const char *value);
+int guc_set_config(config_t *target, const char *name, const char *value);
+guc_entry_t *guc_find(const char *name);
+
+/** O(1) name resolution through a perfect hash built by guc_init() */
+void guc_init(void);
+guc_handle_t guc_lookup(const char *name);
+
+/** Lock-free reads of the published configuration; strings are copied out */
+int guc_get_int(guc_handle_t handle);
+bool guc_get_bool(guc_handle_t handle);
+const char *guc_get_string(guc_handle_t handle, char *out, size_t outlen);
+void guc_copy_running(config_t *out);
 int guc_show(const char *name, char *out, size_t outlen);
 void guc_show_all(void);
 
+/** Per-entry access to an arbitrary config_t, used to stage and diff reloads */
+void guc_format(const guc_entry_t *entry, const config_t *source, char *out, size_t outlen);
+void guc_copy(const guc_entry_t *entry, config_t *dest, const config_t *source);
+bool guc_equal(const guc_entry_t *entry, const config_t *a, const config_t *b);
+
 #endif												/* RALED_GUC_H */ 
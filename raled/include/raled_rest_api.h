@@ -23,6 +23,12 @@
 #define RALED_REST_MAX_CONNECTIONS  100
 #define RALED_REST_BUFFER_SIZE      8192
 #define RALED_REST_TIMEOUT_SECONDS  30
+#define RALED_REST_MAX_REQUEST_SIZE (1024 * 1024)  /* Largest accepted request incl. body */
+#define RALED_REST_COMMAND_RESPONSE_SIZE (64 * 1024)
+#define RALED_REST_METRICS_SIZE     (32 * 1024)
+#define RALED_REST_MAX_REPLICAS     16
+#define RALED_REST_IDLE_TIMEOUT_SECONDS  5   /* Keep-alive idle limit per connection */
+#define RALED_REST_MAX_ACCEPTORS    16      /* SO_REUSEPORT listeners, one thread each */
 
 typedef struct {
     char        *bind_address;          /* IP address to bind to */
@@ -34,14 +40,22 @@ typedef struct {
     bool        enable_ssl;             /* Enable HTTPS */
     char        *ssl_cert_file;         /* SSL certificate file */
     char        *ssl_key_file;          /* SSL private key file */
+    int         acceptors;              /* Listeners sharing the port via SO_REUSEPORT; 0 means 1 */
 } raled_rest_config_t;
 
+/* One listening socket and the thread accepting on it */
 typedef struct {
-    int                     server_fd;
-    pthread_t               server_thread;
+    int                     fd;
+    pthread_t               thread;
+} raled_rest_acceptor_t;
+
+typedef struct {
+    raled_rest_acceptor_t   acceptors[RALED_REST_MAX_ACCEPTORS];
+    int                     acceptor_count;
     bool                    running;
     raled_rest_config_t     config;
     pthread_mutex_t         mutex;
+    int                     active_connections; /* Connection threads in flight */
 } raled_rest_server_t;
 
 /*-------------------------------------------------------------------------
@@ -88,6 +102,7 @@ typedef struct {
     size_t              body_length;
     char                *remote_addr;
     uint16_t            remote_port;
+    bool                keep_alive;     /* Client allows connection reuse */
 } http_request_t;
 
 typedef struct {
@@ -231,15 +246,25 @@ int raled_rest_handle_step_down(const http_request_t *request, http_response_t *
 int raled_rest_handle_health(const http_request_t *request, http_response_t *response);
 
 /**
- * GET /api/v1/metrics - Get system metrics
+ * GET /api/v1/metrics - Replication metrics in Prometheus text format
  */
 int raled_rest_handle_metrics(const http_request_t *request, http_response_t *response);
 
+/**
+ * GET /api/v1/replication - Per-follower replication progress (leader)
+ */
+int raled_rest_handle_replication(const http_request_t *request, http_response_t *response);
+
 /**
  * POST /api/v1/shutdown - Graceful shutdown
  */
 int raled_rest_handle_shutdown(const http_request_t *request, http_response_t *response);
 
+/**
+ * POST /api/command - Run a raled command ({"command": ...}) and return its reply
+ */
+int raled_rest_handle_command(const http_request_t *request, http_response_t *response);
+
 /*-------------------------------------------------------------------------
  * JSON Utilities for API Responses
  *-------------------------------------------------------------------------*/
@@ -24,6 +24,6 @@ extern int is_status_requested(void);
 extern void clear_reload_request(void);
 extern void clear_status_request(void);
 extern void cleanup_signal_handlers(void);
-extern void graceful_shutdown(void);
+extern int graceful_shutdown(void);
 
 #endif												/* SIGNAL_H */
@@ -0,0 +1,174 @@
+/*-------------------------------------------------------------------------
+ *
+ * raled_affinity.c
+ *    CPU and NUMA placement of RALED threads.
+ *
+ *    The topology is read once from sysfs at startup.  consensus_cpus pins
+ *    the main loop thread, which runs the network, consensus and apply
+ *    ticks, and io_cpus pins the REST server and its connection threads.
+ *    Both are empty by default, leaving placement to the scheduler.
+ *
+ *    The main loop is kept on one NUMA node: if consensus_cpus spans
+ *    several, only the CPUs on the node of the first one are used, and the
+ *    thread's memory policy prefers that node, so the hash table and the
+ *    buffers it allocates stay local to the CPUs that touch them.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ * IDENTIFICATION
+ *    raled/src/raled_affinity.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+/** System headers */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Local headers */
+#include "raled_affinity.h"
+#include "raled_logger.h"
+#include "system_detect.h"
+
+static system_topology_t topology;
+static bool		topology_valid = false;
+
+static int		consensus_cpus[SYSTEM_MAX_CPUS];
+static int		consensus_count = 0;
+static int		consensus_node = -1;
+
+static int		io_cpus[SYSTEM_MAX_CPUS];
+static int		io_count = 0;
+
+/*
+ * Parse one CPU list setting, dropping CPUs that are not online.  Returns
+ * the number of usable CPUs; 0 leaves the threads unpinned.
+ */
+static int
+resolve_cpu_list(const char *name, const char *list, int *cpus)
+{
+	int		count;
+	int		usable = 0;
+	int		i;
+
+	if (list == NULL || list[0] == '\0')
+		return 0;
+
+	count = system_parse_cpu_list(list, cpus, SYSTEM_MAX_CPUS);
+	if (count <= 0)
+	{
+		raled_log_warning("Ignoring invalid CPU list \"%s\" = \"%s\".", name, list);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (topology_valid && system_topology_numa_node(&topology, cpus[i]) < 0)
+		{
+			raled_log_warning("CPU \"%d\" in \"%s\" is not online; skipping it.", cpus[i], name);
+			continue;
+		}
+		cpus[usable++] = cpus[i];
+	}
+	return usable;
+}
+
+void
+raled_affinity_init(const config_t *config)
+{
+	int		kept = 0;
+	int		i;
+
+	topology_valid = system_topology_detect(&topology) == 0;
+	if (topology_valid)
+		raled_log_info("CPU topology: \"%d\" CPUs, \"%d\" cores, \"%d\" packages, \"%d\" NUMA nodes.",
+		               topology.cpu_count, topology.core_count, topology.package_count,
+		               topology.numa_node_count);
+	else
+		raled_log_debug("CPU topology unavailable on this platform.");
+
+	consensus_count = resolve_cpu_list("consensus_cpus", config->affinity.consensus_cpus, consensus_cpus);
+	io_count = resolve_cpu_list("io_cpus", config->affinity.io_cpus, io_cpus);
+
+	if (consensus_count > 0 && topology_valid)
+	{
+		consensus_node = system_topology_numa_node(&topology, consensus_cpus[0]);
+		for (i = 0; i < consensus_count; i++)
+		{
+			if (system_topology_numa_node(&topology, consensus_cpus[i]) == consensus_node)
+				consensus_cpus[kept++] = consensus_cpus[i];
+		}
+		if (kept < consensus_count)
+			raled_log_warning("\"consensus_cpus\" spans NUMA nodes; using only the \"%d\" CPUs on node \"%d\".",
+			                  kept, consensus_node);
+		consensus_count = kept;
+	}
+}
+
+void
+raled_affinity_apply_consensus(void)
+{
+	char	list[256];
+
+	if (consensus_count == 0)
+		return;
+
+	system_format_cpu_list(consensus_cpus, consensus_count, list, sizeof(list));
+	if (system_pin_thread(pthread_self(), consensus_cpus, consensus_count) != 0)
+	{
+		raled_log_warning("Could not pin main loop to CPUs \"%s\": %s.", list, strerror(errno));
+		return;
+	}
+
+	if (consensus_node >= 0 && topology.numa_node_count > 1 &&
+		system_prefer_numa_node(consensus_node) != 0)
+		raled_log_warning("Could not prefer NUMA node \"%d\" for main loop memory: %s.",
+		                  consensus_node, strerror(errno));
+
+	raled_log_info("Main loop pinned to CPUs \"%s\" (NUMA node \"%d\").", list, consensus_node);
+}
+
+void
+raled_affinity_apply_io(void)
+{
+	char	list[256];
+
+	if (io_count == 0)
+		return;
+
+	system_format_cpu_list(io_cpus, io_count, list, sizeof(list));
+	if (system_pin_thread(pthread_self(), io_cpus, io_count) != 0)
+	{
+		raled_log_warning("Could not pin I/O thread to CPUs \"%s\": %s.", list, strerror(errno));
+		return;
+	}
+	raled_log_debug("I/O thread pinned to CPUs \"%s\".", list);
+}
+
+int
+raled_affinity_describe(char *out, size_t outlen)
+{
+	char	consensus_list[256];
+	char	io_list[256];
+	int		len;
+
+	system_format_cpu_list(consensus_cpus, consensus_count, consensus_list, sizeof(consensus_list));
+	system_format_cpu_list(io_cpus, io_count, io_list, sizeof(io_list));
+
+	len = snprintf(out, outlen,
+		",\"placement\":{\"cpus\":%d,\"cores\":%d,\"packages\":%d,\"numa_nodes\":%d,"
+		"\"consensus_cpus\":\"%s\",\"consensus_numa_node\":%d,\"io_cpus\":\"%s\"}",
+		topology.cpu_count, topology.core_count, topology.package_count, topology.numa_node_count,
+		consensus_list, consensus_node, io_list);
+	if (len < 0 || (size_t) len >= outlen)
+	{
+		/* Nothing is appended unless the whole object fits */
+		if (outlen > 0)
+			out[0] = '\0';
+		return 0;
+	}
+	return len;
+}
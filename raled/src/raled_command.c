@@ -11,30 +11,111 @@
  *-------------------------------------------------------------------------
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <cjson/cJSON.h>
 #include "raled_command.h"
+#include "raled_configfile.h"
+#include "raled_guc.h"
 #include "raled_logger.h"
+#include "raled.h"
+#include "raled_affinity.h"
 #include "librale.h"
+#include "trace.h"
+#include "probes.h"
+#include "wal.h"
+#include "batch.h"
+#include "lease.h"
+#include "db.h"
 
 #define MAX_COMMAND_LENGTH 1024
 #define MAX_RESPONSE_LENGTH 2048
 #define MAX_KEY_LENGTH 256
 #define MAX_VALUE_LENGTH 1024
+#define MAX_BATCH_ITEMS 4096
+#define MAX_EXPORT_PARTITIONS 1024
+#define EXPORT_ENVELOPE_RESERVE 160
+#define RALED_MAX_REPLICAS 16
+#define WATCH_MAX_TIMEOUT_MS 5000	/* Within the REST server's stop wait */
+#define MIN_REV_TIMEOUT_MS 1000	/* GET min_rev wait unless timeout_ms says */
 
-static librale_status_t process_get_command(const char *key, char *response, size_t response_size);
-static librale_status_t process_put_command(const char *key, const char *value, char *response, size_t response_size);
+/* State threaded through librale_db_scan while building an EXPORT page */
+typedef struct export_page_t {
+	cJSON	   *items;
+	cJSON	   *skipped_keys;	/* Entries too large for any page */
+	size_t		budget;
+	size_t		used;
+	int			count;
+	int			skipped;
+	int			limit;
+} export_page_t;
+
+/* Start of the current traced request, until its handler is reached */
+static __thread uint64_t parse_started;
+
+static librale_status_t dispatch_command(const char *command_text, char *response, size_t response_size);
+static void trace_parse_done(void);
+static librale_status_t process_get_command(const char *key, uint64_t min_rev, int timeout_ms, char *response, size_t response_size);
+static librale_status_t revision_reply(const char *text, uint64_t revision, librale_status_t status, char *response, size_t response_size);
+static librale_status_t process_put_command(const char *key, const char *value, uint64_t lease, char *response, size_t response_size);
+static librale_status_t process_lease_grant_command(int ttl, char *response, size_t response_size);
+static librale_status_t process_lease_keepalive_command(uint64_t lease, char *response, size_t response_size);
+static librale_status_t process_lease_revoke_command(uint64_t lease, char *response, size_t response_size);
+static uint64_t lease_id_arg(const char *text);
+static librale_status_t process_cas_command(const char *key, const char *expected, const char *value, char *response, size_t response_size);
+static librale_status_t process_watch_command(const char *key, const char *seen, int timeout_ms, char *response, size_t response_size);
 static librale_status_t process_list_command(char *response, size_t response_size);
 static librale_status_t process_status_command(char *response, size_t response_size);
+static librale_status_t process_status_json_command(char *response, size_t response_size);
+static int replication_describe(char *out, size_t outlen);
+static const char *role_name(int32_t role);
 static librale_status_t process_stop_command(char *response, size_t response_size);
+static librale_status_t process_reload_command(char *response, size_t response_size);
+static librale_status_t process_show_command(const char *name, char *response, size_t response_size);
+static librale_status_t process_set_command(const char *name, const char *value, char *response, size_t response_size);
 static librale_status_t process_add_command(int node_id, const char *name, const char *ip, int rale_port, int dstore_port, char *response, size_t response_size);
 static librale_status_t process_remove_command(int node_id, char *response, size_t response_size);
+static librale_status_t process_put_batch_command(const cJSON *items, char *response, size_t response_size);
+static librale_status_t process_export_command(const cJSON *json, char *response, size_t response_size);
+static librale_status_t process_trace_export_command(const char *file, char *response, size_t response_size);
+static librale_status_t process_replication_command(char *response, size_t response_size);
 
+/*
+ * Every command passes through here.  A sampled one gets a trace id that
+ * the storage layer and the replication frames pick up from this thread.
+ */
 librale_status_t
 raled_process_command(const char *command_text, char *response, size_t response_size)
+{
+	librale_status_t result;
+	uint64_t	start;
+
+	RALE_PROBE1(command__start, command_text);
+	trace_begin();
+	start = trace_clock();
+	parse_started = start;
+
+	result = dispatch_command(command_text, response, response_size);
+
+	trace_span(TRACE_STAGE_REQUEST, start);
+	trace_end();
+	RALE_PROBE2(command__done, command_text, (int) result);
+	return result;
+}
+
+/* The parse stage ends when a handler starts; batches record it once */
+static void
+trace_parse_done(void)
+{
+	trace_span(TRACE_STAGE_PARSE, parse_started);
+	parse_started = 0;
+}
+
+static librale_status_t
+dispatch_command(const char *command_text, char *response, size_t response_size)
 {
 	if (!command_text || !response || response_size == 0) {
 		raled_log_error("Invalid parameters to raled_process_command: missing required arguments.");
@@ -60,20 +141,119 @@ raled_process_command(const char *command_text, char *response, size_t response_
 			const char *cmd = cmd_obj->valuestring;
 			
 			if (strcmp(cmd, "GET") == 0) {
+				/* "min_rev" holds the read until this node has applied that revision */
 				cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(json, "key");
+				cJSON *min_rev_obj = cJSON_GetObjectItemCaseSensitive(json, "min_rev");
+				cJSON *timeout_obj = cJSON_GetObjectItemCaseSensitive(json, "timeout_ms");
 				if (cJSON_IsString(key_obj)) {
-					librale_status_t result = process_get_command(key_obj->valuestring, response, response_size);
+					librale_status_t result = process_get_command(key_obj->valuestring,
+						(cJSON_IsNumber(min_rev_obj) && min_rev_obj->valuedouble > 0) ?
+							(uint64_t) min_rev_obj->valuedouble : 0,
+						cJSON_IsNumber(timeout_obj) ? timeout_obj->valueint : MIN_REV_TIMEOUT_MS,
+						response, response_size);
 					cJSON_Delete(json);
 					return result;
 				}
 			} else if (strcmp(cmd, "PUT") == 0) {
+				/* "lease" attaches the key to a lease from LEASE_GRANT */
 				cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(json, "key");
 				cJSON *value_obj = cJSON_GetObjectItemCaseSensitive(json, "value");
-				if (cJSON_IsString(key_obj) && cJSON_IsString(value_obj)) {
-					librale_status_t result = process_put_command(key_obj->valuestring, value_obj->valuestring, response, response_size);
+				cJSON *lease_obj = cJSON_GetObjectItemCaseSensitive(json, "lease");
+				if (cJSON_IsString(key_obj) && cJSON_IsString(value_obj) &&
+					(lease_obj == NULL || cJSON_IsNumber(lease_obj))) {
+					librale_status_t result = process_put_command(key_obj->valuestring, value_obj->valuestring,
+						(lease_obj != NULL && lease_obj->valuedouble > 0) ? (uint64_t) lease_obj->valuedouble : 0,
+						response, response_size);
+					cJSON_Delete(json);
+					return result;
+				}
+			} else if (strcmp(cmd, "LEASE_GRANT") == 0) {
+				cJSON *ttl_obj = cJSON_GetObjectItemCaseSensitive(json, "ttl");
+				if (cJSON_IsNumber(ttl_obj)) {
+					librale_status_t result = process_lease_grant_command(ttl_obj->valueint, response, response_size);
+					cJSON_Delete(json);
+					return result;
+				}
+			} else if (strcmp(cmd, "LEASE_KEEPALIVE") == 0 || strcmp(cmd, "LEASE_REVOKE") == 0) {
+				cJSON *lease_obj = cJSON_GetObjectItemCaseSensitive(json, "lease");
+				if (cJSON_IsNumber(lease_obj) && lease_obj->valuedouble > 0) {
+					librale_status_t result = strcmp(cmd, "LEASE_REVOKE") == 0 ?
+						process_lease_revoke_command((uint64_t) lease_obj->valuedouble, response, response_size) :
+						process_lease_keepalive_command((uint64_t) lease_obj->valuedouble, response, response_size);
 					cJSON_Delete(json);
 					return result;
 				}
+			} else if (strcmp(cmd, "CAS") == 0) {
+				/* A missing or null "expected" asks for the key to be absent */
+				cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(json, "key");
+				cJSON *expected_obj = cJSON_GetObjectItemCaseSensitive(json, "expected");
+				cJSON *value_obj = cJSON_GetObjectItemCaseSensitive(json, "value");
+				if (cJSON_IsString(key_obj) && cJSON_IsString(value_obj) &&
+					(expected_obj == NULL || cJSON_IsNull(expected_obj) || cJSON_IsString(expected_obj))) {
+					librale_status_t result = process_cas_command(key_obj->valuestring,
+						cJSON_IsString(expected_obj) ? expected_obj->valuestring : NULL,
+						value_obj->valuestring, response, response_size);
+					cJSON_Delete(json);
+					return result;
+				}
+			} else if (strcmp(cmd, "WATCH") == 0) {
+				/* "value" is what the caller last saw, null for an absent key */
+				cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(json, "key");
+				cJSON *seen_obj = cJSON_GetObjectItemCaseSensitive(json, "value");
+				cJSON *timeout_obj = cJSON_GetObjectItemCaseSensitive(json, "timeout_ms");
+				if (cJSON_IsString(key_obj) && (cJSON_IsNull(seen_obj) || cJSON_IsString(seen_obj))) {
+					librale_status_t result = process_watch_command(key_obj->valuestring,
+						cJSON_IsString(seen_obj) ? seen_obj->valuestring : NULL,
+						cJSON_IsNumber(timeout_obj) ? timeout_obj->valueint : WATCH_MAX_TIMEOUT_MS,
+						response, response_size);
+					cJSON_Delete(json);
+					return result;
+				}
+			} else if (strcmp(cmd, "PUT_BATCH") == 0) {
+				cJSON *items_obj = cJSON_GetObjectItemCaseSensitive(json, "items");
+				if (cJSON_IsArray(items_obj)) {
+					librale_status_t result = process_put_batch_command(items_obj, response, response_size);
+					cJSON_Delete(json);
+					return result;
+				}
+			} else if (strcmp(cmd, "EXPORT") == 0) {
+				librale_status_t result = process_export_command(json, response, response_size);
+				cJSON_Delete(json);
+				return result;
+			} else if (strcmp(cmd, "STATUS") == 0) {
+				cJSON_Delete(json);
+				return process_status_json_command(response, response_size);
+			} else if (strcmp(cmd, "REPLICATION") == 0) {
+				cJSON_Delete(json);
+				return process_replication_command(response, response_size);
+			} else if (strcmp(cmd, "RELOAD") == 0) {
+				cJSON_Delete(json);
+				return process_reload_command(response, response_size);
+			} else if (strcmp(cmd, "TRACE_EXPORT") == 0) {
+				cJSON *file = cJSON_GetObjectItem(json, "file");
+				librale_status_t result = process_trace_export_command(
+					cJSON_IsString(file) ? file->valuestring : NULL, response, response_size);
+				cJSON_Delete(json);
+				return result;
+			} else if (strcmp(cmd, "SHOW") == 0 || strcmp(cmd, "SET") == 0) {
+				cJSON *name = cJSON_GetObjectItem(json, "name");
+				cJSON *value = cJSON_GetObjectItem(json, "value");
+				librale_status_t result;
+
+				if (!cJSON_IsString(name)) {
+					snprintf(response, response_size, "ERROR: %s requires a parameter name", cmd);
+					result = RALE_ERROR_GENERAL;
+				} else if (strcmp(cmd, "SHOW") == 0) {
+					result = process_show_command(name->valuestring, response, response_size);
+				} else if (!cJSON_IsString(value)) {
+					snprintf(response, response_size, "ERROR: SET requires a string value");
+					result = RALE_ERROR_GENERAL;
+				} else {
+					result = process_set_command(name->valuestring, value->valuestring,
+												 response, response_size);
+				}
+				cJSON_Delete(json);
+				return result;
 			}
 		}
 		cJSON_Delete(json);
@@ -101,10 +281,12 @@ raled_process_command(const char *command_text, char *response, size_t response_
 			snprintf(response, response_size, "ERROR: GET requires a key");
 			return RALE_ERROR_GENERAL;
 		}
-		return process_get_command(key, response, response_size);
+		return process_get_command(key, 0, 0, response, response_size);
 	} else if (strcmp(token, "PUT") == 0) {
 		char *key = strtok(NULL, " \t\n");
 		char *value = strtok(NULL, "");  /* Get rest of line as value */
+		char *last;
+		uint64_t lease = 0;
 		if (!key || !value) {
 			snprintf(response, response_size, "ERROR: PUT requires key and value");
 			return RALE_ERROR_GENERAL;
@@ -113,13 +295,59 @@ raled_process_command(const char *command_text, char *response, size_t response_
 		while (*value && (*value == ' ' || *value == '\t')) {
 			value++;
 		}
-		return process_put_command(key, value, response, response_size);
+		/* A last word "lease=<id>" attaches the key to that lease */
+		last = strrchr(value, ' ');
+		if (last != NULL && strncmp(last + 1, "lease=", 6) == 0 &&
+			(lease = lease_id_arg(last + 7)) != 0) {
+			while (last > value && (last[-1] == ' ' || last[-1] == '\t')) {
+				last--;
+			}
+			*last = '\0';
+		}
+		return process_put_command(key, value, lease, response, response_size);
+	} else if (strcmp(token, "LEASE_GRANT") == 0) {
+		char *ttl = strtok(NULL, " \t\n");
+		if (!ttl) {
+			snprintf(response, response_size, "ERROR: LEASE_GRANT requires a TTL in seconds");
+			return RALE_ERROR_GENERAL;
+		}
+		return process_lease_grant_command(atoi(ttl), response, response_size);
+	} else if (strcmp(token, "LEASE_KEEPALIVE") == 0 || strcmp(token, "LEASE_REVOKE") == 0) {
+		uint64_t lease = lease_id_arg(strtok(NULL, " \t\n"));
+		if (lease == 0) {
+			snprintf(response, response_size, "ERROR: %s requires a lease id", token);
+			return RALE_ERROR_GENERAL;
+		}
+		return strcmp(token, "LEASE_REVOKE") == 0 ?
+			process_lease_revoke_command(lease, response, response_size) :
+			process_lease_keepalive_command(lease, response, response_size);
 	} else if (strcmp(token, "LIST") == 0) {
 		return process_list_command(response, response_size);
 	} else if (strcmp(token, "STATUS") == 0) {
 		return process_status_command(response, response_size);
+	} else if (strcmp(token, "REPLICATION") == 0) {
+		return process_replication_command(response, response_size);
 	} else if (strcmp(token, "STOP") == 0) {
 		return process_stop_command(response, response_size);
+	} else if (strcmp(token, "RELOAD") == 0) {
+		return process_reload_command(response, response_size);
+	} else if (strcmp(token, "TRACE_EXPORT") == 0) {
+		return process_trace_export_command(strtok(NULL, " \t\n"), response, response_size);
+	} else if (strcmp(token, "SHOW") == 0) {
+		char *name = strtok(NULL, " \t\n");
+		if (!name) {
+			snprintf(response, response_size, "ERROR: SHOW requires a parameter name");
+			return RALE_ERROR_GENERAL;
+		}
+		return process_show_command(name, response, response_size);
+	} else if (strcmp(token, "SET") == 0) {
+		char *name = strtok(NULL, " \t\n");
+		char *value = strtok(NULL, " \t\n");
+		if (!name || !value) {
+			snprintf(response, response_size, "ERROR: SET requires a parameter name and value");
+			return RALE_ERROR_GENERAL;
+		}
+		return process_set_command(name, value, response, response_size);
 	} else if (strcmp(token, "ADD") == 0) {
 		char *node_id_str = strtok(NULL, " \t\n");
 		char *name = strtok(NULL, " \t\n");
@@ -152,31 +380,100 @@ raled_process_command(const char *command_text, char *response, size_t response_
 	}
 }
 
+/*
+ * Reply {"result": text, "revision": revision}; a client carries the
+ * revision on to its next read.
+ */
 static librale_status_t
-process_get_command(const char *key, char *response, size_t response_size)
+revision_reply(const char *text, uint64_t revision, librale_status_t status,
+			   char *response, size_t response_size)
+{
+	cJSON *reply = cJSON_CreateObject();
+	char *reply_text = NULL;
+
+	if (reply != NULL) {
+		cJSON_AddStringToObject(reply, "result", text);
+		cJSON_AddNumberToObject(reply, "revision", (double) revision);
+		reply_text = cJSON_PrintUnformatted(reply);
+		cJSON_Delete(reply);
+	}
+	if (reply_text == NULL) {
+		snprintf(response, response_size, "ERROR: Out of memory");
+		return RALE_ERROR_GENERAL;
+	}
+	strlcpy(response, reply_text, response_size);
+	free(reply_text);
+	return status;
+}
+
+/*
+ * A read with min_rev waits, up to timeout_ms, for this node to apply that
+ * revision, so a session that wrote on the leader reads its own writes
+ * anywhere.  If it never does, the reply is "ERROR: REVISION_TIMEOUT
+ * <applied>" and the client should ask another node.  The reply carries
+ * the revision the value is at least as new as.
+ */
+static librale_status_t
+process_get_command(const char *key, uint64_t min_rev, int timeout_ms,
+					char *response, size_t response_size)
 {
 	char value[MAX_VALUE_LENGTH];
+	char text[MAX_VALUE_LENGTH + 16];
 	char errbuf[256];
+	uint64_t revision;
 
+	trace_parse_done();
 	if (strlen(key) > MAX_KEY_LENGTH) {
 		snprintf(response, response_size, "ERROR: Key too long");
 		return RALE_ERROR_GENERAL;
 	}
+	if (timeout_ms < 0 || timeout_ms > WATCH_MAX_TIMEOUT_MS) {
+		timeout_ms = WATCH_MAX_TIMEOUT_MS;
+	}
 
+	if (min_rev > 0 && librale_dstore_wait_revision(min_rev, timeout_ms) != 0) {
+		snprintf(response, response_size, "ERROR: REVISION_TIMEOUT %llu",
+				 (unsigned long long) librale_dstore_applied_revision());
+		return RALE_ERROR_GENERAL;
+	}
+
+	/* Read the revision first; the value is at least that new */
+	revision = librale_dstore_applied_revision();
 	if (librale_db_get(key, value, sizeof(value), errbuf, sizeof(errbuf)) == RALE_SUCCESS) {
-		snprintf(response, response_size, "OK: %s", value);
-		return RALE_SUCCESS;
+		snprintf(text, sizeof(text), "OK: %s", value);
+		return revision_reply(text, revision, RALE_SUCCESS, response, response_size);
 	} else {
-		snprintf(response, response_size, "ERROR: %s", errbuf);
-		return RALE_ERROR_GENERAL;
+		snprintf(text, sizeof(text), "ERROR: %s", errbuf);
+		return revision_reply(text, revision, RALE_ERROR_GENERAL, response, response_size);
+	}
+}
+
+/* A lease id in decimal, 0 if text is anything else */
+static uint64_t
+lease_id_arg(const char *text)
+{
+	char *end;
+	unsigned long long id;
+
+	if (text == NULL || !isdigit((unsigned char) *text)) {
+		return 0;
 	}
+	id = strtoull(text, &end, 10);
+	return *end == '\0' ? (uint64_t) id : 0;
 }
 
+/*
+ * A lease-less PUT goes the usual way, forwarded by a follower if
+ * dstore_forward_writes says so; a leased one is taken by the leader only,
+ * like CAS, and fails with "ERROR: LEASE_NOT_FOUND" once the lease is gone.
+ */
 static librale_status_t
-process_put_command(const char *key, const char *value, char *response, size_t response_size)
+process_put_command(const char *key, const char *value, uint64_t lease,
+					char *response, size_t response_size)
 {
 	char errbuf[256];
 
+	trace_parse_done();
 	if (strlen(key) > MAX_KEY_LENGTH) {
 		snprintf(response, response_size, "ERROR: Key too long");
 		return RALE_ERROR_GENERAL;
@@ -187,39 +484,207 @@ process_put_command(const char *key, const char *value, char *response, size_t r
 		return RALE_ERROR_GENERAL;
 	}
 
-	/* Use available API for PUT command */
-	char full_command[512];
-	snprintf(full_command, sizeof(full_command), "PUT %s %s", key, value);
-	librale_dstore_put_from_command(full_command, errbuf, sizeof(errbuf));
+	errbuf[0] = '\0';
+	if (lease != 0) {
+		int ret = librale_dstore_put_leased(key, value, lease, errbuf, sizeof(errbuf));
+
+		if (ret > 0) {
+			snprintf(response, response_size, "ERROR: LEASE_NOT_FOUND");
+			return RALE_ERROR_GENERAL;
+		}
+		if (ret < 0 && errbuf[0] == '\0') {
+			snprintf(errbuf, sizeof(errbuf), "failed to store key-value pair ('%s')", key);
+		}
+	} else {
+		/* Use available API for PUT command; dstore expects "PUT key=value" */
+		char full_command[MAX_KEY_LENGTH + MAX_VALUE_LENGTH + 8];
+		snprintf(full_command, sizeof(full_command), "PUT %s=%s", key, value);
+		librale_dstore_put_from_command(full_command, errbuf, sizeof(errbuf));
+	}
 	
 	if (strlen(errbuf) > 0) {
 		snprintf(response, response_size, "ERROR: %s", errbuf);
 		return RALE_ERROR_GENERAL;
 	} else {
-		snprintf(response, response_size, "OK: %s", value);
-		return RALE_SUCCESS;
+		char text[MAX_VALUE_LENGTH + 8];
+
+		snprintf(text, sizeof(text), "OK: %s", value);
+		return revision_reply(text, librale_dstore_write_revision(), RALE_SUCCESS,
+							  response, response_size);
 	}
 }
 
+/*
+ * Replies "OK: <lease id>" with the revision of the grant, which is the id.
+ */
+static librale_status_t
+process_lease_grant_command(int ttl, char *response, size_t response_size)
+{
+	char errbuf[256];
+	char text[32];
+	uint64_t lease;
+
+	trace_parse_done();
+	errbuf[0] = '\0';
+	if (librale_dstore_lease_grant(ttl, &lease, errbuf, sizeof(errbuf)) != 0) {
+		snprintf(response, response_size, "ERROR: %s", errbuf);
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(text, sizeof(text), "OK: %llu", (unsigned long long) lease);
+	return revision_reply(text, lease, RALE_SUCCESS, response, response_size);
+}
+
+/*
+ * Replies "OK: <ttl>", the seconds every key of the lease now has left.
+ * Nothing is written, so there is no revision.
+ */
+static librale_status_t
+process_lease_keepalive_command(uint64_t lease, char *response, size_t response_size)
+{
+	char errbuf[256];
+	int ttl = 0;
+	int ret;
+
+	trace_parse_done();
+	errbuf[0] = '\0';
+	ret = librale_dstore_lease_keepalive(lease, &ttl, errbuf, sizeof(errbuf));
+	if (ret > 0) {
+		snprintf(response, response_size, "ERROR: LEASE_NOT_FOUND");
+		return RALE_ERROR_GENERAL;
+	} else if (ret < 0) {
+		snprintf(response, response_size, "ERROR: %s", errbuf);
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(response, response_size, "OK: %d", ttl);
+	return RALE_SUCCESS;
+}
+
+/* Replies "OK: REVOKED" once the lease and all its keys are gone */
+static librale_status_t
+process_lease_revoke_command(uint64_t lease, char *response, size_t response_size)
+{
+	char errbuf[256];
+	int ret;
+
+	trace_parse_done();
+	errbuf[0] = '\0';
+	ret = librale_dstore_lease_revoke(lease, errbuf, sizeof(errbuf));
+	if (ret > 0) {
+		snprintf(response, response_size, "ERROR: LEASE_NOT_FOUND");
+		return RALE_ERROR_GENERAL;
+	} else if (ret < 0) {
+		snprintf(response, response_size, "ERROR: %s", errbuf);
+		return RALE_ERROR_GENERAL;
+	}
+	return revision_reply("OK: REVOKED", librale_dstore_write_revision(), RALE_SUCCESS,
+						  response, response_size);
+}
+
+/*
+ * Replies "OK: <value>" with its revision once stored and "ERROR:
+ * CAS_FAILED" if the key held something else.  A follower replies "ERROR:
+ * NOT_LEADER <leader id> <leader ip> <term>", as it does to PUT unless
+ * dstore_forward_writes is on.
+ */
+static librale_status_t
+process_cas_command(const char *key, const char *expected, const char *value,
+					char *response, size_t response_size)
+{
+	char errbuf[256];
+	int ret;
+
+	trace_parse_done();
+	if (strlen(key) > MAX_KEY_LENGTH) {
+		snprintf(response, response_size, "ERROR: Key too long");
+		return RALE_ERROR_GENERAL;
+	}
+
+	if (strlen(value) > MAX_VALUE_LENGTH ||
+		(expected != NULL && strlen(expected) > MAX_VALUE_LENGTH)) {
+		snprintf(response, response_size, "ERROR: Value too long");
+		return RALE_ERROR_GENERAL;
+	}
+
+	errbuf[0] = '\0';
+	ret = librale_dstore_cas(key, expected, value, errbuf, sizeof(errbuf));
+	if (ret == 0) {
+		char text[MAX_VALUE_LENGTH + 8];
+
+		snprintf(text, sizeof(text), "OK: %s", value);
+		return revision_reply(text, librale_dstore_write_revision(), RALE_SUCCESS,
+							  response, response_size);
+	} else if (ret > 0) {
+		snprintf(response, response_size, "ERROR: CAS_FAILED");
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(response, response_size, "ERROR: %s", errbuf);
+	return RALE_ERROR_GENERAL;
+}
+
+/*
+ * Long poll: hold the request until key differs from seen (NULL: absent),
+ * then reply "OK: <value>" or "DELETED"; "TIMEOUT" if it never did.
+ */
+static librale_status_t
+process_watch_command(const char *key, const char *seen, int timeout_ms,
+					  char *response, size_t response_size)
+{
+	char value[MAX_VALUE_LENGTH];
+
+	trace_parse_done();
+	if (strlen(key) > MAX_KEY_LENGTH) {
+		snprintf(response, response_size, "ERROR: Key too long");
+		return RALE_ERROR_GENERAL;
+	}
+	if (timeout_ms < 0 || timeout_ms > WATCH_MAX_TIMEOUT_MS) {
+		timeout_ms = WATCH_MAX_TIMEOUT_MS;
+	}
+
+	switch (librale_db_watch(key, seen, timeout_ms, value, sizeof(value))) {
+		case 0:
+			snprintf(response, response_size, "OK: %s", value);
+			return RALE_SUCCESS;
+		case 1:
+			snprintf(response, response_size, "DELETED");
+			return RALE_SUCCESS;
+		case 2:
+			snprintf(response, response_size, "TIMEOUT");
+			return RALE_SUCCESS;
+		default:
+			snprintf(response, response_size, "ERROR: Invalid WATCH");
+			return RALE_ERROR_GENERAL;
+	}
+}
+
+static const char *
+role_name(int32_t role)
+{
+	return (role == 0 ? "follower" :
+			(role == 1 ? "candidate" :
+			 (role == 2 ? "leader" : "unknown")));
+}
+
 static librale_status_t
 process_list_command(char *response, size_t response_size)
 {
 	int32_t current_role = librale_get_current_role();
 	int32_t self_id = librale_cluster_get_self_id();
+	uint32_t node_count = librale_cluster_get_node_count();
 	uint32_t i;
-	char role_buf[16];
-
-	const char *role_str = (current_role == 0 ? "follower" : (current_role == 1 ? "candidate" : (current_role == 2 ? "leader" : "unknown")));
-	strlcpy(role_buf, role_str, sizeof(role_buf));
+	librale_node_info_t info;
 
 	snprintf(response, response_size, "{\"nodes\":[");
 	size_t pos = strlen(response);
-	for (i = 0; i < librale_cluster_get_node_count(); i++) {
-		/* Note: librale_node_t is incomplete, so we'll provide basic cluster info */
-		const char *n_role = ((int32_t)i == self_id) ? role_buf : "unknown";
+	for (i = 0; i < node_count; i++) {
+		if (librale_cluster_get_node_info(i, &info) != RALE_SUCCESS)
+			continue;
+
+		/* Only the local role is known here; peers report their own via STATUS */
+		const char *n_role = (info.id == self_id) ? role_name(current_role) : "unknown";
 		int w = snprintf(response + pos, response_size - pos,
-			"%s{\"id\":%d,\"name\":\"node%d\",\"ip\":\"unknown\",\"rale_port\":0,\"dstore_port\":0,\"role\":\"%s\"}",
-			(pos > 10 ? "," : ""), (int)i, (int)i, n_role);
+			"%s{\"id\":%d,\"name\":\"%s\",\"ip\":\"%s\",\"rale_port\":%u,\"dstore_port\":%u,\"role\":\"%s\"}",
+			(pos > 10 ? "," : ""), (int)info.id, info.name, info.ip,
+			(unsigned)info.rale_port, (unsigned)info.dstore_port, n_role);
 		if (w < 0 || (size_t)w >= response_size - pos)
 			break;
 		pos += (size_t)w;
@@ -238,13 +703,220 @@ process_status_command(char *response, size_t response_size)
 	int32_t self_id = librale_cluster_get_self_id();
 	uint32_t node_count = librale_cluster_get_node_count();
 	
-	const char *role_str = (current_role == 0 ? "follower" : 
-							(current_role == 1 ? "candidate" : 
-							 (current_role == 2 ? "leader" : "unknown")));
-	
 	snprintf(response, response_size, 
 		"STATUS: node_id=%d, role=%s, cluster_size=%u", 
-		self_id, role_str, node_count);
+		self_id, role_name(current_role), node_count);
+	return RALE_SUCCESS;
+}
+
+/*
+ * Append ,"replication":{...} with this leader's view of every follower.
+ * Nothing is appended unless the whole object fits.
+ */
+static int
+replication_describe(char *out, size_t outlen)
+{
+	librale_replica_status_t replicas[RALED_MAX_REPLICAS];
+	uint64_t	last_index = 0;
+	uint32_t	count;
+	uint32_t	i;
+	size_t		len;
+	int			n;
+
+	count = librale_dstore_get_replication(replicas, RALED_MAX_REPLICAS, &last_index);
+	n = snprintf(out, outlen, ",\"replication\":{\"last_index\":%llu,\"followers\":[",
+				 (unsigned long long) last_index);
+	if (n < 0 || (size_t) n >= outlen)
+		goto no_room;
+	len = (size_t) n;
+
+	for (i = 0; i < count; i++) {
+		const librale_replica_status_t *r = &replicas[i];
+
+		n = snprintf(out + len, outlen - len,
+			"%s{\"node_id\":%d,\"connected\":%s,\"sent_index\":%llu,\"match_index\":%llu,"
+			"\"lag_entries\":%llu,\"lag_ms\":%llu,\"entries_in_flight\":%llu,"
+			"\"bytes_in_flight\":%llu,\"last_ack_age_ms\":%lld,\"rtt_ewma_us\":%llu,\"gap_index\":%llu}",
+			i > 0 ? "," : "", r->node_id, r->connected ? "true" : "false",
+			(unsigned long long) r->sent_index, (unsigned long long) r->match_index,
+			(unsigned long long) r->lag_entries, (unsigned long long) r->lag_ms,
+			(unsigned long long) r->entries_in_flight, (unsigned long long) r->bytes_in_flight,
+			(long long) r->last_ack_age_ms, (unsigned long long) r->rtt_ewma_us,
+			(unsigned long long) r->gap_index);
+		if (n < 0 || (size_t) n >= outlen - len)
+			goto no_room;
+		len += (size_t) n;
+	}
+
+	n = snprintf(out + len, outlen - len, "]}");
+	if (n < 0 || (size_t) n >= outlen - len)
+		goto no_room;
+	return (int) (len + (size_t) n);
+
+no_room:
+	out[0] = '\0';
+	return 0;
+}
+
+/*
+ * REPLICATION: follower progress as a JSON object, on any node.  Only the
+ * leader's numbers are meaningful.
+ */
+static librale_status_t
+process_replication_command(char *response, size_t response_size)
+{
+	int len;
+
+	if (response_size < 3) {
+		return RALE_ERROR_GENERAL;
+	}
+	response[0] = '{';
+	/* Drop the leading comma of the ,"replication":{...} member */
+	len = replication_describe(response + 1, response_size - 2);
+	if (len == 0) {
+		snprintf(response, response_size, "ERROR: Response buffer too small");
+		return RALE_ERROR_GENERAL;
+	}
+	memmove(response + 1, response + 2, (size_t) len - 1);
+	snprintf(response + len, response_size - (size_t) len, "}");
+	return RALE_SUCCESS;
+}
+
+/*
+ * Machine-readable STATUS for cluster-wide polling: consensus position of
+ * this node, from which callers derive replication lag against the leader.
+ */
+static librale_status_t
+process_status_json_command(char *response, size_t response_size)
+{
+	librale_rale_status_t status;
+	raled_loop_stats_t	loop;
+	int					len;
+
+	if (librale_get_rale_status(&status) != RALE_SUCCESS) {
+		snprintf(response, response_size, "{\"error\":\"status unavailable\"}");
+		return RALE_ERROR_GENERAL;
+	}
+
+	len = snprintf(response, response_size,
+		"{\"node_id\":%d,\"role\":\"%s\",\"term\":%d,\"leader_id\":%d,"
+		"\"last_log_index\":%d,\"commit_index\":%d,\"last_applied\":%d,\"cluster_size\":%u",
+		librale_cluster_get_self_id(), role_name(status.role), status.term, status.leader_id,
+		status.last_log_index, status.commit_index, status.last_applied,
+		librale_cluster_get_node_count());
+
+	if (len > 0 && (size_t) len < response_size && raled_get_loop_stats(&loop)) {
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"loop\":{\"ticks\":%llu,\"over_budget\":%llu,\"p50_ms\":%u,\"p99_ms\":%u,\"max_ms\":%llu},"
+			"\"watchdog\":{\"state\":\"%s\",\"keepalives\":%llu,\"keepalives_failed\":%llu,\"expirations\":%llu}",
+			(unsigned long long) loop.ticks, (unsigned long long) loop.ticks_over_budget,
+			loop.tick_p50_ms, loop.tick_p99_ms,
+			(unsigned long long) (loop.max_tick_us / 1000),
+			loop.watchdog_state, (unsigned long long) loop.keepalives_sent,
+			(unsigned long long) loop.keepalives_failed, (unsigned long long) loop.expirations);
+	}
+	if (len > 0 && (size_t) len < response_size)
+		len += raled_affinity_describe(response + len, response_size - (size_t) len);
+	if (len > 0 && (size_t) len < response_size && status.role == 2)
+		len += replication_describe(response + len, response_size - (size_t) len);
+	if (len > 0 && (size_t) len < response_size) {
+		wal_stats_t wal;
+
+		wal_get_stats(&wal);
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"wal\":{\"backend\":\"%s\",\"appends\":%llu,\"flushes\":%llu,\"syscalls\":%llu,"
+			"\"bytes\":%llu,\"syscalls_per_append\":%.3f}",
+			wal_backend_name(wal.backend), (unsigned long long) wal.appends,
+			(unsigned long long) wal.flushes, (unsigned long long) wal.syscalls,
+			(unsigned long long) wal.bytes,
+			wal.appends > 0 ? (double) wal.syscalls / (double) wal.appends : 0.0);
+	}
+	if (len > 0 && (size_t) len < response_size) {
+		batch_stats_t batch;
+
+		batch_get_stats(&batch);
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"write_batch\":{\"batches\":%llu,\"entries\":%llu,\"bytes\":%llu,"
+			"\"closed_entries\":%llu,\"closed_bytes\":%llu,\"closed_delay\":%llu,"
+			"\"size_p50\":%llu,\"size_p99\":%llu,\"size_max\":%llu,"
+			"\"wait_p50_us\":%llu,\"wait_p99_us\":%llu,\"wait_max_us\":%llu}",
+			(unsigned long long) batch.batches, (unsigned long long) batch.entries,
+			(unsigned long long) batch.bytes, (unsigned long long) batch.closed_entries,
+			(unsigned long long) batch.closed_bytes, (unsigned long long) batch.closed_delay,
+			(unsigned long long) batch_size_percentile(&batch, 50),
+			(unsigned long long) batch_size_percentile(&batch, 99),
+			(unsigned long long) batch.max_size,
+			(unsigned long long) batch_wait_percentile(&batch, 50),
+			(unsigned long long) batch_wait_percentile(&batch, 99),
+			(unsigned long long) batch.max_wait_us);
+	}
+	if (len > 0 && (size_t) len < response_size) {
+		lease_stats_t leases;
+
+		lease_get_stats(&leases);
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"leases\":{\"leases\":%llu,\"keys\":%llu,\"granted\":%llu,\"revoked\":%llu,"
+			"\"expired\":%llu,\"keepalives\":%llu,\"checkpoints\":%llu}",
+			(unsigned long long) leases.leases, (unsigned long long) leases.keys,
+			(unsigned long long) leases.granted, (unsigned long long) leases.revoked,
+			(unsigned long long) leases.expired, (unsigned long long) leases.keepalives,
+			(unsigned long long) leases.checkpoints);
+	}
+	if (len > 0 && (size_t) len < response_size) {
+		bloom_stats_t filter;
+
+		db_filter_stats(&filter);
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"key_filter\":{\"capacity\":%llu,\"keys\":%llu,\"checks\":%llu,"
+			"\"negatives\":%llu,\"false_positives\":%llu,\"false_positive_rate\":%.4f}",
+			(unsigned long long) filter.capacity, (unsigned long long) filter.keys,
+			(unsigned long long) filter.checks, (unsigned long long) filter.negatives,
+			(unsigned long long) filter.false_positives, bloom_false_positive_rate(&filter));
+	}
+	if (len > 0 && (size_t) len < response_size) {
+		vlog_stats_t vlog;
+
+		db_value_log_stats(&vlog);
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"value_log\":{\"segments\":%llu,\"bytes\":%llu,\"garbage_bytes\":%llu,"
+			"\"appends\":%llu,\"cache_pages\":%llu,\"cache_hits\":%llu,\"cache_misses\":%llu,"
+			"\"gc_segments\":%llu,\"gc_relocated\":%llu,\"gc_reclaimed_bytes\":%llu}",
+			(unsigned long long) vlog.segments, (unsigned long long) vlog.bytes,
+			(unsigned long long) vlog.garbage_bytes, (unsigned long long) vlog.appends,
+			(unsigned long long) vlog.cache_pages, (unsigned long long) vlog.cache_hits,
+			(unsigned long long) vlog.cache_misses, (unsigned long long) vlog.gc_segments,
+			(unsigned long long) vlog.gc_relocated, (unsigned long long) vlog.gc_reclaimed_bytes);
+	}
+	if (len > 0 && (size_t) len < response_size) {
+		lsm_stats_t lsm;
+		uint64_t	files = 0;
+		uint64_t	bytes = 0;
+		int			level;
+
+		db_lsm_stats(&lsm);
+		for (level = 0; level < LSM_LEVELS; level++) {
+			files += lsm.level_files[level];
+			bytes += lsm.level_bytes[level];
+		}
+		len += snprintf(response + len, response_size - (size_t) len,
+			",\"storage\":{\"engine\":\"%s\",\"memtable_bytes\":%llu,\"sst_files\":%llu,"
+			"\"sst_bytes\":%llu,\"level0_files\":%llu,\"flushes\":%llu,\"compactions\":%llu,"
+			"\"user_bytes\":%llu,\"flush_bytes\":%llu,\"compaction_read_bytes\":%llu,"
+			"\"compaction_write_bytes\":%llu,\"write_amplification\":%.2f,\"stalls\":%llu,"
+			"\"filter_checks\":%llu,\"filter_negatives\":%llu}",
+			db_engine_name(), (unsigned long long) lsm.memtable_bytes,
+			(unsigned long long) files, (unsigned long long) bytes,
+			(unsigned long long) lsm.level_files[0], (unsigned long long) lsm.flushes,
+			(unsigned long long) lsm.compactions, (unsigned long long) lsm.user_bytes,
+			(unsigned long long) lsm.flush_bytes, (unsigned long long) lsm.compaction_read_bytes,
+			(unsigned long long) lsm.compaction_write_bytes,
+			lsm.user_bytes > 0 ? (double) (lsm.flush_bytes + lsm.compaction_write_bytes) /
+				(double) lsm.user_bytes : 0.0,
+			(unsigned long long) lsm.stalls, (unsigned long long) lsm.filter_checks,
+			(unsigned long long) lsm.filter_negatives);
+	}
+	if (len > 0 && (size_t) len + 1 < response_size)
+		snprintf(response + len, response_size - (size_t) len, "}");
 	return RALE_SUCCESS;
 }
 
@@ -257,6 +929,96 @@ process_stop_command(char *response, size_t response_size)
 	return RALE_SUCCESS;
 }
 
+/*
+ * Same as SIGHUP, but synchronous, so the caller learns whether the file
+ * was applied.
+ */
+static librale_status_t
+process_reload_command(char *response, size_t response_size)
+{
+	extern char config_file[]; /* from raled_args.c */
+	char		detail[256];
+
+	raled_log_info("RELOAD command received, reloading configuration file \"%s\".", config_file);
+	if (reload_config(config_file, detail, sizeof(detail)) != 0) {
+		snprintf(response, response_size, "ERROR: reload failed: %s", detail);
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(response, response_size, "OK: configuration reloaded (%s)", detail);
+	return RALE_SUCCESS;
+}
+
+/*
+ * Write the spans this node still holds as Chrome trace JSON (load it in
+ * Perfetto or chrome://tracing).  Exports from several nodes share one
+ * clock and trace ids, so they can be opened together.
+ */
+static librale_status_t
+process_trace_export_command(const char *file, char *response, size_t response_size)
+{
+	extern config_t config; /* from raled_args.c */
+	char		path[PATH_MAX];
+	char		errbuf[256];
+	int			count;
+	int			len;
+
+	/*
+	 * Clients name the file, never the directory: the export always lands
+	 * in log_directory, so a request cannot overwrite files elsewhere.
+	 */
+	if (file != NULL && file[0] != '\0' &&
+		(strchr(file, '/') != NULL || strstr(file, "..") != NULL)) {
+		snprintf(response, response_size,
+				 "ERROR: TRACE_EXPORT takes a file name inside log_directory, not a path");
+		return RALE_ERROR_GENERAL;
+	}
+
+	if (file == NULL || file[0] == '\0')
+		len = snprintf(path, sizeof(path), "%s/trace-node%d.json",
+					   config.log_directory, librale_cluster_get_self_id());
+	else
+		len = snprintf(path, sizeof(path), "%s/%s", config.log_directory, file);
+	if (len < 0 || (size_t) len >= sizeof(path)) {
+		snprintf(response, response_size, "ERROR: TRACE_EXPORT path too long");
+		return RALE_ERROR_GENERAL;
+	}
+
+	count = trace_export_chrome(path, errbuf, sizeof(errbuf));
+	if (count < 0) {
+		snprintf(response, response_size, "ERROR: %s", errbuf);
+		return RALE_ERROR_GENERAL;
+	}
+	raled_log_info("Exported %d trace spans to \"%s\".", count, path);
+	snprintf(response, response_size, "OK: %d spans written to %s", count, path);
+	return RALE_SUCCESS;
+}
+
+static librale_status_t
+process_show_command(const char *name, char *response, size_t response_size)
+{
+	char value[MAX_VALUE_LENGTH];
+
+	if (guc_show(name, value, sizeof(value)) != 0) {
+		snprintf(response, response_size, "ERROR: unrecognized configuration parameter '%s'", name);
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(response, response_size, "%s = %s", name, value);
+	return RALE_SUCCESS;
+}
+
+static librale_status_t
+process_set_command(const char *name, const char *value, char *response, size_t response_size)
+{
+	char detail[MAX_VALUE_LENGTH];
+
+	if (set_config_option(name, value, detail, sizeof(detail)) != 0) {
+		snprintf(response, response_size, "ERROR: %s", detail);
+		return RALE_ERROR_GENERAL;
+	}
+	snprintf(response, response_size, "OK: %s = %s", name, detail);
+	return RALE_SUCCESS;
+}
+
 static librale_status_t
 process_add_command(int node_id, const char *name, const char *ip, int rale_port, int dstore_port, char *response, size_t response_size)
 {
@@ -275,3 +1037,231 @@ process_remove_command(int node_id, char *response, size_t response_size)
 	snprintf(response, response_size, "ERROR: REMOVE command not implemented in current API");
 	return RALE_ERROR_GENERAL;
 }
+
+/*
+ * On the leader the items go to the batcher as one group, committed
+ * together; a follower, which may have to forward each one, stores them
+ * one at a time through process_put_command().
+ */
+static librale_status_t
+process_put_batch_command(const cJSON *items, char *response, size_t response_size)
+{
+	const cJSON *item;
+	librale_put_t *puts;
+	char		item_response[MAX_RESPONSE_LENGTH];
+	char		errbuf[256];
+	uint64_t	revision = 0;
+	int			count = 0;
+	int			applied = 0;
+	int			failed = 0;
+	int			i;
+
+	if (cJSON_GetArraySize(items) > MAX_BATCH_ITEMS) {
+		snprintf(response, response_size, "ERROR: Batch too large (max %d items)", MAX_BATCH_ITEMS);
+		return RALE_ERROR_GENERAL;
+	}
+
+	puts = calloc((size_t) cJSON_GetArraySize(items) + 1, sizeof(librale_put_t));
+	if (puts == NULL) {
+		snprintf(response, response_size, "ERROR: Out of memory");
+		return RALE_ERROR_GENERAL;
+	}
+
+	trace_parse_done();
+	cJSON_ArrayForEach(item, items) {
+		cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(item, "key");
+		cJSON *value_obj = cJSON_GetObjectItemCaseSensitive(item, "value");
+		cJSON *lease_obj = cJSON_GetObjectItemCaseSensitive(item, "lease");
+
+		if (!cJSON_IsString(key_obj) || !cJSON_IsString(value_obj) ||
+			(lease_obj != NULL && !cJSON_IsNumber(lease_obj)) ||
+			strlen(key_obj->valuestring) > MAX_KEY_LENGTH ||
+			strlen(value_obj->valuestring) > MAX_VALUE_LENGTH) {
+			failed++;
+			continue;
+		}
+		puts[count].key = key_obj->valuestring;
+		puts[count].value = value_obj->valuestring;
+		puts[count].lease = (lease_obj != NULL && lease_obj->valuedouble > 0) ?
+			(uint64_t) lease_obj->valuedouble : 0;
+		count++;
+	}
+
+	errbuf[0] = '\0';
+	if (count == 0) {
+		/* Nothing to store */
+	} else if (librale_dstore_put_batch(puts, count, errbuf, sizeof(errbuf)) == 0) {
+		for (i = 0; i < count; i++) {
+			if (puts[i].result == 0) {
+				applied++;
+				if (puts[i].revision > revision)
+					revision = puts[i].revision;
+			} else
+				failed++;
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			if (process_put_command(puts[i].key, puts[i].value, puts[i].lease,
+									item_response, sizeof(item_response)) == RALE_SUCCESS) {
+				applied++;
+				if (librale_dstore_write_revision() > revision)
+					revision = librale_dstore_write_revision();
+			} else
+				failed++;
+		}
+	}
+	free(puts);
+
+	raled_log_debug("PUT_BATCH applied \"%d\" items, \"%d\" failed.", applied, failed);
+	snprintf(response, response_size, "{\"applied\":%d,\"failed\":%d,\"revision\":%llu}",
+			 applied, failed, (unsigned long long) revision);
+	return failed == 0 ? RALE_SUCCESS : RALE_ERROR_GENERAL;
+}
+
+/*
+ * Length of a string once cJSON has escaped it, without the quotes.
+ */
+static size_t
+json_escaped_length(const char *str)
+{
+	size_t		len = 0;
+
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+
+		if (c == '"' || c == '\\' || c == '\b' || c == '\f' ||
+			c == '\n' || c == '\r' || c == '\t')
+			len += 2;
+		else if (c < 32)
+			len += 6;
+		else
+			len += 1;
+	}
+	return len;
+}
+
+static int
+export_page_add(const char *key, const char *value, void *arg)
+{
+	export_page_t *page = (export_page_t *) arg;
+	cJSON	   *entry;
+	size_t		cost;
+
+	/* {"key":"","value":""}, */
+	cost = json_escaped_length(key) + json_escaped_length(value) + 22;
+	if (page->count >= page->limit)
+		return 1;
+	if (cost > page->budget) {
+		size_t		key_cost = json_escaped_length(key) + 3;
+
+		/*
+		 * No page can ever hold this entry.  Skip it and name it in the
+		 * reply so the export still makes progress past it.
+		 */
+		if (page->used + key_cost <= page->budget) {
+			cJSON_AddItemToArray(page->skipped_keys, cJSON_CreateString(key));
+			page->used += key_cost;
+		} else if (page->count > 0 || page->skipped > 0)
+			return 1;
+		page->skipped++;
+		return 0;
+	}
+	if (page->used + cost > page->budget)
+		return 1;
+
+	entry = cJSON_CreateObject();
+	if (entry == NULL)
+		return 1;
+	cJSON_AddStringToObject(entry, "key", key);
+	cJSON_AddStringToObject(entry, "value", value);
+	cJSON_AddItemToArray(page->items, entry);
+	page->used += cost;
+	page->count++;
+	return 0;
+}
+
+/*
+ * EXPORT returns one page of a partition of the store:
+ *   {"command":"EXPORT","partition":0,"partitions":4,"cursor":0,"limit":500}
+ * The reply carries the cursor to resume from and whether the partition is
+ * exhausted.  Pages are sized to fit the caller's response buffer; entries
+ * that cannot fit even alone are counted in "skipped" and their keys listed
+ * in "skipped_keys" instead.
+ */
+static librale_status_t
+process_export_command(const cJSON *json, char *response, size_t response_size)
+{
+	cJSON	   *partition_obj = cJSON_GetObjectItemCaseSensitive(json, "partition");
+	cJSON	   *partitions_obj = cJSON_GetObjectItemCaseSensitive(json, "partitions");
+	cJSON	   *cursor_obj = cJSON_GetObjectItemCaseSensitive(json, "cursor");
+	cJSON	   *limit_obj = cJSON_GetObjectItemCaseSensitive(json, "limit");
+	cJSON	   *reply;
+	char	   *reply_text;
+	char		errbuf[256];
+	export_page_t page;
+	uint32_t	partition = 0;
+	uint32_t	partitions = 1;
+	uint64_t	cursor = 0;
+	bool		complete = false;
+
+	if (response_size <= EXPORT_ENVELOPE_RESERVE) {
+		snprintf(response, response_size, "ERROR: Response buffer too small");
+		return RALE_ERROR_GENERAL;
+	}
+
+	if (cJSON_IsNumber(partitions_obj) && partitions_obj->valuedouble >= 1 &&
+		partitions_obj->valuedouble <= MAX_EXPORT_PARTITIONS)
+		partitions = (uint32_t) partitions_obj->valuedouble;
+	if (cJSON_IsNumber(partition_obj) && partition_obj->valuedouble >= 0)
+		partition = (uint32_t) partition_obj->valuedouble;
+	if (cJSON_IsNumber(cursor_obj) && cursor_obj->valuedouble >= 0)
+		cursor = (uint64_t) cursor_obj->valuedouble;
+	if (partition >= partitions) {
+		snprintf(response, response_size, "ERROR: Partition out of range");
+		return RALE_ERROR_GENERAL;
+	}
+
+	memset(&page, 0, sizeof(page));
+	page.budget = response_size - EXPORT_ENVELOPE_RESERVE;
+	page.limit = INT32_MAX;
+	if (cJSON_IsNumber(limit_obj) && limit_obj->valueint > 0)
+		page.limit = limit_obj->valueint;
+
+	reply = cJSON_CreateObject();
+	page.items = cJSON_CreateArray();
+	page.skipped_keys = cJSON_CreateArray();
+	if (reply == NULL || page.items == NULL || page.skipped_keys == NULL) {
+		cJSON_Delete(reply);
+		cJSON_Delete(page.items);
+		cJSON_Delete(page.skipped_keys);
+		snprintf(response, response_size, "ERROR: Out of memory");
+		return RALE_ERROR_GENERAL;
+	}
+
+	errbuf[0] = '\0';
+	if (librale_db_scan(partition, partitions, &cursor, export_page_add, &page,
+						&complete, errbuf, sizeof(errbuf)) != RALE_SUCCESS) {
+		cJSON_Delete(reply);
+		cJSON_Delete(page.items);
+		cJSON_Delete(page.skipped_keys);
+		snprintf(response, response_size, "ERROR: %s", errbuf);
+		return RALE_ERROR_GENERAL;
+	}
+
+	cJSON_AddNumberToObject(reply, "cursor", (double) cursor);
+	cJSON_AddBoolToObject(reply, "done", complete);
+	cJSON_AddNumberToObject(reply, "count", page.count);
+	cJSON_AddItemToObject(reply, "items", page.items);
+	cJSON_AddNumberToObject(reply, "skipped", page.skipped);
+	cJSON_AddItemToObject(reply, "skipped_keys", page.skipped_keys);
+
+	reply_text = cJSON_PrintUnformatted(reply);
+	cJSON_Delete(reply);
+	if (reply_text == NULL) {
+		snprintf(response, response_size, "ERROR: Out of memory");
+		return RALE_ERROR_GENERAL;
+	}
+	strlcpy(response, reply_text, response_size);
+	free(reply_text);
+	return RALE_SUCCESS;
+}
@@ -13,17 +13,30 @@
 
 /** System headers */
 #include <ctype.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /** Local headers */
+#include "librale.h"
 #include "raled_guc.h"
 #include "raled_inc.h"
 
-int
-read_config(const char *filename, config_t *config_param __attribute__((unused)))
+/** External variables */
+extern config_t config;
+extern librale_config_t *librale_cfg;
+
+/** Serializes reloads from SIGHUP and the RELOAD command */
+static pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Parse filename into target.  Returns the number of settings rejected
+ * (unknown name or out-of-range value), or -1 if the file cannot be read.
+ */
+static int
+parse_config_file(const char *filename, config_t *target)
 {
 	FILE  *file;
 	char   line[MAX_LINE_LENGTH];
@@ -34,6 +47,7 @@ read_config(const char *filename, config_t *config_param __attribute__((unused))
 	char  *comment;
 	char  *end;
 	char   msg[256];
+	int    rejected = 0;
 
 	file = fopen(filename, "r");
 	if (file == NULL)
@@ -95,7 +109,12 @@ read_config(const char *filename, config_t *config_param __attribute__((unused))
 			*end-- = '\0';
 		}
 
-		guc_set(key, value);
+		if (guc_set_config(target, key, value) != 0)
+		{
+			raled_log_warning("Ignoring invalid setting \"%s\" = \"%s\" in \"%s\".",
+			                  key, value, filename);
+			rejected++;
+		}
 	}
 
 	if (file != NULL)
@@ -108,5 +127,162 @@ read_config(const char *filename, config_t *config_param __attribute__((unused))
         snprintf(dbg, sizeof(dbg), "Loading configuration file '%s'", filename);
         raled_ereport(RALED_LOG_INFO, "RALED", dbg, NULL, NULL);
     }
+	return rejected;
+}
+
+int
+read_config(const char *filename, config_t *config_param)
+{
+	return parse_config_file(filename, config_param ? config_param : &config) < 0 ? -1 : 0;
+}
+
+/*
+ * Publish the global config, as loaded at startup, as the snapshot that
+ * librale threads and the guc_get_*() accessors read.  The global config is
+ * not written after this; reloads publish a new snapshot instead.
+ */
+int
+publish_runtime_config(void)
+{
+	if (librale_cfg == NULL)
+		return 0;
+
+	return librale_config_publish((const librale_config_t *) &config) == RALE_SUCCESS ? 0 : -1;
+}
+
+/*
+ * Re-read filename and apply its reloadable settings to the running daemon.
+ *
+ * The file is parsed into a private copy of the running configuration, so
+ * a file with errors changes nothing.  Settings marked non-reloadable in
+ * guc_table keep their running value and are reported as needing a
+ * restart.  The copy then replaces the running configuration through
+ * librale_config_publish(); readers see it on their next snapshot pin and
+ * never read a half-applied reload.
+ */
+int
+reload_config(const char *filename, char *errbuf, size_t errbuflen)
+{
+	config_t	running;
+	config_t	staged;
+	char		old_value[MAX_STRING_LENGTH];
+	char		new_value[MAX_STRING_LENGTH];
+	int			rejected;
+	int			changed = 0;
+	int			pending = 0;
+	int			i;
+
+	pthread_mutex_lock(&reload_mutex);
+
+	guc_copy_running(&running);
+	memcpy(&staged, &running, sizeof(config_t));
+	rejected = parse_config_file(filename, &staged);
+	if (rejected != 0)
+	{
+		pthread_mutex_unlock(&reload_mutex);
+		if (rejected < 0)
+			snprintf(errbuf, errbuflen, "could not read configuration file \"%s\"", filename);
+		else
+			snprintf(errbuf, errbuflen, "%d invalid setting(s) in \"%s\"; nothing applied",
+			         rejected, filename);
+		raled_log_error("Configuration reload failed: %s.", errbuf);
+		return -1;
+	}
+
+	for (i = 0; i < guc_table_size; i++)
+	{
+		const guc_entry_t *entry = &guc_table[i];
+
+		if (guc_equal(entry, &staged, &running))
+			continue;
+
+		guc_format(entry, &running, old_value, sizeof(old_value));
+		guc_format(entry, &staged, new_value, sizeof(new_value));
+		if (!entry->reloadable)
+		{
+			raled_log_warning("Parameter \"%s\" cannot be changed without restarting raled; keeping \"%s\".",
+			                  entry->name, old_value);
+			guc_copy(entry, &staged, &running);
+			pending++;
+			continue;
+		}
+		raled_log_config_change(entry->name, old_value, new_value);
+		changed++;
+	}
+
+	if (changed > 0)
+	{
+		if (librale_config_publish((const librale_config_t *) &staged) != RALE_SUCCESS)
+		{
+			pthread_mutex_unlock(&reload_mutex);
+			snprintf(errbuf, errbuflen, "could not publish configuration to librale");
+			raled_log_error("Configuration reload failed: %s.", errbuf);
+			return -1;
+		}
+		raled_logger_set_level((raled_log_level_t) staged.raled_log.level);
+	}
+
+	pthread_mutex_unlock(&reload_mutex);
+
+	snprintf(errbuf, errbuflen, "%d parameter(s) changed, %d require restart", changed, pending);
+	raled_log_info("Configuration reloaded from \"%s\": %s.", filename, errbuf);
+	return 0;
+}
+
+/*
+ * Change one reloadable parameter of the running daemon, as SET from the
+ * admin API.  The change is not written back to the configuration file and
+ * is lost on restart or overridden by the next reload that sets it.
+ */
+int
+set_config_option(const char *name, const char *value, char *errbuf, size_t errbuflen)
+{
+	guc_entry_t *entry;
+	config_t	running;
+	config_t	staged;
+	char		old_value[MAX_STRING_LENGTH];
+	char		new_value[MAX_STRING_LENGTH];
+
+	entry = guc_find(name);
+	if (entry == NULL)
+	{
+		snprintf(errbuf, errbuflen, "unrecognized configuration parameter \"%s\"", name);
+		return -1;
+	}
+	if (!entry->reloadable)
+	{
+		snprintf(errbuf, errbuflen, "parameter \"%s\" cannot be changed without restarting raled",
+		         entry->name);
+		return -1;
+	}
+
+	pthread_mutex_lock(&reload_mutex);
+
+	guc_copy_running(&running);
+	memcpy(&staged, &running, sizeof(config_t));
+	if (guc_set_config(&staged, entry->name, value) != 0)
+	{
+		pthread_mutex_unlock(&reload_mutex);
+		snprintf(errbuf, errbuflen, "invalid value for parameter \"%s\": \"%s\"", entry->name, value);
+		return -1;
+	}
+
+	if (!guc_equal(entry, &staged, &running))
+	{
+		guc_format(entry, &running, old_value, sizeof(old_value));
+		guc_format(entry, &staged, new_value, sizeof(new_value));
+		raled_log_config_change(entry->name, old_value, new_value);
+
+		if (librale_config_publish((const librale_config_t *) &staged) != RALE_SUCCESS)
+		{
+			pthread_mutex_unlock(&reload_mutex);
+			snprintf(errbuf, errbuflen, "could not publish configuration to librale");
+			return -1;
+		}
+		raled_logger_set_level((raled_log_level_t) staged.raled_log.level);
+	}
+
+	pthread_mutex_unlock(&reload_mutex);
+	guc_format(entry, &staged, errbuf, errbuflen);
 	return 0;
 }
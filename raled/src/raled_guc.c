@@ -14,13 +14,25 @@
  *-------------------------------------------------------------------------*/
 
 /** System headers */
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 /** Local headers */
+#include "librale.h"
 #include "raled_guc.h"
 #include "raled_inc.h"
+#include "wal.h"
+#include "hash.h"
+#include "engine.h"
+#include "watchdog.h"
+
+/** Slots in the name index; a power of two comfortably above the table size */
+#define GUC_INDEX_SIZE			128
+/** Seeds tried before giving up on a collision-free index */
+#define GUC_INDEX_MAX_SEEDS		100000
 
 /** External variables */
 extern config_t config;
@@ -50,6 +62,46 @@ parse_protocol(const char *value)
     return PROTOCOL_UNIX;
 }
 
+static int
+parse_watchdog_mode(const char *value)
+{
+	if (strcmp(value, "optional") == 0)
+		return WATCHDOG_MODE_OPTIONAL;
+	else if (strcmp(value, "required") == 0)
+		return WATCHDOG_MODE_REQUIRED;
+	else
+		return WATCHDOG_MODE_DISABLED;
+}
+
+static int
+parse_wal_backend(const char *value)
+{
+	if (strcmp(value, "sync") == 0)
+		return WAL_BACKEND_SYNC;
+	else if (strcmp(value, "io_uring") == 0)
+		return WAL_BACKEND_URING;
+	else
+		return WAL_BACKEND_AUTO;
+}
+
+static int
+parse_index_layout(const char *value)
+{
+	if (strcmp(value, "swiss") == 0)
+		return HASH_LAYOUT_SWISS;
+	else
+		return HASH_LAYOUT_CHAINED;
+}
+
+static int
+parse_storage_engine(const char *value)
+{
+	if (strcmp(value, "lsm") == 0)
+		return STORAGE_ENGINE_LSM;
+	else
+		return STORAGE_ENGINE_HASH;
+}
+
 static int
 parse_log_level(const char *value)
 {
@@ -147,13 +199,121 @@ guc_entry_t guc_table[] = {
 		0, 10000, false,
 		NULL
 	},
+	{
+		"key_filter_capacity",
+		GUC_INT,
+		&config.db.key_filter_capacity,
+		"65536",
+		"Keys the Bloom filter in front of GET lookups is sized for; 0 disables it",
+		0, 100000000, false,
+		NULL
+	},
+	{
+		"index_layout",
+		GUC_ENUM,
+		&config.db.index_layout,
+		"chained",
+		"Key index layout (chained, swiss)",
+		0, 0, false,
+		parse_index_layout
+	},
+	{
+		"value_log",
+		GUC_BOOL,
+		&config.db.value_log,
+		"off",
+		"Keep values longer than value_inline_max in append-only value log files",
+		0, 0, false,
+		NULL
+	},
+	{
+		"value_inline_max",
+		GUC_INT,
+		&config.db.value_inline_max,
+		"128",
+		"Longest value, in bytes, kept in the key index when value_log is on",
+		32, 1024, false,
+		NULL
+	},
+	{
+		"value_segment_mb",
+		GUC_INT,
+		&config.db.value_segment_mb,
+		"64",
+		"Size of one value log segment file, in megabytes",
+		1, 4096, false,
+		NULL
+	},
+	{
+		"value_cache_mb",
+		GUC_INT,
+		&config.db.value_cache_mb,
+		"32",
+		"Page cache for value log reads, in megabytes; 0 reads every value from disk",
+		0, 65536, false,
+		NULL
+	},
+	{
+		"value_gc_percent",
+		GUC_INT,
+		&config.db.value_gc_percent,
+		"50",
+		"Share of a value log segment, in percent, that must be garbage before it is collected",
+		1, 100, false,
+		NULL
+	},
+	{
+		"storage_engine",
+		GUC_ENUM,
+		&config.db.storage_engine,
+		"hash",
+		"Storage engine (hash: in memory, loaded from rale.db; lsm: on-disk log-structured merge tree)",
+		0, 0, false,
+		parse_storage_engine
+	},
+	{
+		"lsm_memtable_mb",
+		GUC_INT,
+		&config.db.lsm_memtable_mb,
+		"64",
+		"Size of the LSM engine's in-memory table before it is written out, in megabytes",
+		1, 4096, false,
+		NULL
+	},
+	{
+		"lsm_sst_mb",
+		GUC_INT,
+		&config.db.lsm_sst_mb,
+		"8",
+		"Size of one LSM compaction output file, in megabytes",
+		1, 1024, false,
+		NULL
+	},
+	{
+		"lsm_level0_files",
+		GUC_INT,
+		&config.db.lsm_level0_files,
+		"4",
+		"Level 0 files that start a compaction into level 1; writes wait at three times this",
+		1, 64, false,
+		NULL
+	},
+	{
+		"lsm_level_base_mb",
+		GUC_INT,
+		&config.db.lsm_level_base_mb,
+		"64",
+		"Size budget of LSM level 1, in megabytes; each deeper level gets ten times more",
+		1, 65536, false,
+		NULL
+	},
 	{
 		"raled_log_destination",
 		GUC_ENUM,
 		&config.raled_log.destination,
 		"stdout",
 		"RALED log destination",
-		0, 0, true,
+		0, 0, false,
 		parse_log_destination
 	},
 	{
@@ -162,7 +322,7 @@ guc_entry_t guc_table[] = {
 		&config.raled_log.file,
 		"raled1.log",
 		"RALED log file",
-		0, 0, true,
+		0, 0, false,
 		NULL
 	},
 	{
@@ -198,7 +358,7 @@ guc_entry_t guc_table[] = {
 		&config.dstore_log.destination,
 		"stdout",
 		"DStore log destination",
-		0, 0, true,
+		0, 0, false,
 		parse_log_destination
 	},
 	{
@@ -207,7 +367,7 @@ guc_entry_t guc_table[] = {
 		&config.dstore_log.file,
 		"dstore1.log",
 		"DStore log file",
-		0, 0, true,
+		0, 0, false,
 		NULL
 	},
 	{
@@ -243,7 +403,7 @@ guc_entry_t guc_table[] = {
 		&config.communication.log.destination,
 		"file",
 		"COMM log destination",
-		0, 0, true,
+		0, 0, false,
 		parse_log_destination
 	},
 	{
@@ -291,13 +451,22 @@ guc_entry_t guc_table[] = {
 		1, 3600, true,
 		NULL
 	},
+	{
+		"dstore_forward_writes",
+		GUC_BOOL,
+		&config.dstore.forward_writes,
+		"off",
+		"Followers forward writes to the leader instead of answering NOT_LEADER",
+		0, 0, true,
+		NULL
+	},
 	{
 		"log_directory",
 		GUC_STRING,
 		&config.log_directory,
 		"./log",
 		"Base directory for log files",
-		0, 0, true,
+		0, 0, false,
 		NULL
 	},
     {
@@ -335,130 +504,541 @@ guc_entry_t guc_table[] = {
 		"Max communication retries",
 		0, 100, false,
 		NULL
+	},
+	{
+		"watchdog_mode",
+		GUC_ENUM,
+		&config.watchdog.mode,
+		"disabled",
+		"Watchdog mode while leader (disabled, optional, required: never lead without one)",
+		0, 0, false,
+		parse_watchdog_mode
+	},
+	{
+		"watchdog_device",
+		GUC_STRING,
+		&config.watchdog.device,
+		"/dev/watchdog",
+		"Watchdog device, or stand-in file with watchdog_test_mode",
+		0, 0, false,
+		NULL
+	},
+	{
+		"watchdog_timeout",
+		GUC_INT,
+		&config.watchdog.timeout,
+		"30",
+		"Watchdog timeout in seconds",
+		10, 600, false,
+		NULL
+	},
+	{
+		"watchdog_tick_budget_ms",
+		GUC_INT,
+		&config.watchdog.tick_budget_ms,
+		"1000",
+		"Main-loop ticks slower than this warn and do not feed the watchdog",
+		10, 60000, false,
+		NULL
+	},
+	{
+		"watchdog_test_mode",
+		GUC_BOOL,
+		&config.watchdog.test_mode,
+		"off",
+		"Treat watchdog_device as a plain file that records keepalives",
+		0, 0, false,
+		NULL
+	},
+	{
+		"watchdog_soft_noboot",
+		GUC_BOOL,
+		&config.watchdog.soft_noboot,
+		"off",
+		"Only record watchdog expiry, never arm a device that reboots",
+		0, 0, false,
+		NULL
+	},
+	{
+		"consensus_cpus",
+		GUC_STRING,
+		&config.affinity.consensus_cpus,
+		"",
+		"CPUs for the network, consensus and apply loop (e.g. 2-3)",
+		0, 0, false,
+		NULL
+	},
+	{
+		"io_cpus",
+		GUC_STRING,
+		&config.affinity.io_cpus,
+		"",
+		"CPUs for REST API and connection threads (e.g. 4-7)",
+		0, 0, false,
+		NULL
+	},
+	{
+		"trace_sample_rate",
+		GUC_INT,
+		&config.trace.sample_rate,
+		"0",
+		"Trace one in this many requests; 0 disables tracing",
+		0, 1000000, true,
+		NULL
+	},
+	{
+		"wal_io_backend",
+		GUC_ENUM,
+		&config.wal.backend,
+		"auto",
+		"rale.db write backend (auto, sync, io_uring)",
+		0, 0, false,
+		parse_wal_backend
+	},
+	{
+		"wal_sync",
+		GUC_BOOL,
+		&config.wal.sync,
+		"off",
+		"fdatasync rale.db after every flush",
+		0, 0, false,
+		NULL
+	},
+	{
+		"write_batch_max_entries",
+		GUC_INT,
+		&config.write_batch.max_entries,
+		"64",
+		"Most writes the leader commits in one rale.db flush and replication frame",
+		1, 1024, true,
+		NULL
+	},
+	{
+		"write_batch_max_bytes",
+		GUC_INT,
+		&config.write_batch.max_bytes,
+		"65536",
+		"Most key and value bytes the leader commits in one batch",
+		1024, 16777216, true,
+		NULL
+	},
+	{
+		"write_batch_max_delay_us",
+		GUC_INT,
+		&config.write_batch.max_delay_us,
+		"200",
+		"Longest a busy leader waits for a write batch to fill, in microseconds; 0 never waits",
+		0, 100000, true,
+		NULL
+	},
+	{
+		"rest_port",
+		GUC_INT,
+		&config.rest.port,
+		"8080",
+		"Port of the REST API; 0 disables it",
+		0, 65535, false,
+		NULL
+	},
+	{
+		"rest_bind_address",
+		GUC_STRING,
+		&config.rest.bind_address,
+		"127.0.0.1",
+		"Address the REST API listens on (0.0.0.0 for all)",
+		0, 0, false,
+		NULL
+	},
+	{
+		"rest_acceptors",
+		GUC_INT,
+		&config.rest.acceptors,
+		"1",
+		"REST API listeners sharing rest_port, one accept thread each",
+		1, 16, false,
+		NULL
 	}
 };
 
 int guc_table_size = sizeof(guc_table) / sizeof(guc_table[0]);
 
-int
-guc_set(const char *name, const char *value)
+/*
+ * Table entries point into the global config.  The same field of another
+ * config_t (a staged copy during reload) lives at the same offset.
+ */
+static void *
+guc_var(const guc_entry_t *entry, const config_t *target)
 {
-	int i;
-	int v;
+	return (char *) target + ((char *) entry->var - (char *) &config);
+}
 
-    /** Simple alias mapping to support existing config keys */
-    if (strcmp(name, "socket_path") == 0)
-    {
-        name = "communication_socket";
-    }
-    else if (strcmp(name, "log_directory") == 0)
-    {
-        /** already mapped in table to config.log_directory */
-    }
-    else if (strcmp(name, "log_file") == 0)
-    {
-        name = "raled_log_file";
-    }
-    else if (strcmp(name, "log_level") == 0)
-    {
-        name = "raled_log_level";
-    }
+/* The librale handle of an entry's field, for config_get_int() */
+static config_handle_t
+guc_config_handle(const guc_entry_t *entry)
+{
+	return (config_handle_t) ((char *) entry->var - (char *) &config);
+}
+
+/*
+ * GUC_INT values are int fields, except the ports, which are uint16_t in
+ * node_config_t.  Writing a full int there would clobber the neighbouring
+ * field.
+ */
+static bool
+guc_is_port(const guc_entry_t *entry)
+{
+	return entry->var == (void *) &config.node.rale_port ||
+		   entry->var == (void *) &config.node.dstore_port;
+}
+
+static int
+guc_load_int(const guc_entry_t *entry, const void *var)
+{
+	if (guc_is_port(entry))
+		return *((const uint16_t *) var);
+	return *((const int *) var);
+}
+
+static void
+guc_store_int(const guc_entry_t *entry, void *var, int value)
+{
+	if (guc_is_port(entry))
+		*((uint16_t *) var) = (uint16_t) value;
+	else
+		*((int *) var) = value;
+}
+
+/** Old configuration keys still accepted, and the parameter they set */
+static const struct
+{
+	const char *alias;
+	const char *name;
+} guc_aliases[] = {
+	{"socket_path", "communication_socket"},
+	{"log_file", "raled_log_file"},
+	{"log_level", "raled_log_level"}
+};
+
+/*
+ * Name index.  guc_index_build() searches for a seed under which every
+ * parameter name and alias hashes to its own slot, so a lookup is one hash,
+ * one slot and one strcmp to reject unknown names.  The index is built once
+ * by guc_init() at startup, and is read-only afterwards.
+ */
+static pthread_once_t guc_index_once = PTHREAD_ONCE_INIT;
+static bool		guc_index_ready = false;
+static uint32_t guc_index_seed;
+static struct
+{
+	const char *key;
+	guc_handle_t handle;
+} guc_index[GUC_INDEX_SIZE];
+
+static uint32_t
+guc_hash(const char *name, uint32_t seed)
+{
+	uint32_t	h = 2166136261u ^ seed;
+
+	while (*name)
+	{
+		h ^= (uint8_t) *name++;
+		h *= 16777619u;
+	}
+	return h & (GUC_INDEX_SIZE - 1);
+}
+
+static guc_handle_t
+guc_linear_lookup(const char *name)
+{
+	int i;
 
 	for (i = 0; i < guc_table_size; i++)
 	{
 		if (strcmp(name, guc_table[i].name) == 0)
+			return i;
+	}
+	return GUC_INVALID_HANDLE;
+}
+
+static bool
+guc_index_try(uint32_t seed)
+{
+	size_t	i;
+	int		j;
+
+	memset(guc_index, 0, sizeof(guc_index));
+	for (j = 0; j < guc_table_size; j++)
+	{
+		uint32_t slot = guc_hash(guc_table[j].name, seed);
+
+		if (guc_index[slot].key != NULL)
+			return false;
+		guc_index[slot].key = guc_table[j].name;
+		guc_index[slot].handle = j;
+	}
+	for (i = 0; i < sizeof(guc_aliases) / sizeof(guc_aliases[0]); i++)
+	{
+		uint32_t slot = guc_hash(guc_aliases[i].alias, seed);
+
+		if (guc_index[slot].key != NULL)
+			return false;
+		guc_index[slot].key = guc_aliases[i].alias;
+		guc_index[slot].handle = guc_linear_lookup(guc_aliases[i].name);
+	}
+	return true;
+}
+
+static void
+guc_index_build(void)
+{
+	uint32_t seed;
+
+	for (seed = 0; seed < GUC_INDEX_MAX_SEEDS; seed++)
+	{
+		if (guc_index_try(seed))
 		{
-			switch (guc_table[i].type)
-			{
-				case GUC_INT:
-					v = atoi(value);
-					if (v < guc_table[i].min || v > guc_table[i].max)
-					{
-						return -1;
-					}
-					*((int *) guc_table[i].var) = v;
-					return 0;
-				case GUC_STRING:
-					strncpy((char *) guc_table[i].var, value, MAX_STRING_LENGTH - 1);
-					((char *) guc_table[i].var)[MAX_STRING_LENGTH - 1] = '\0';
-					return 0;
-				case GUC_BOOL:
-					*((int *) guc_table[i].var) = (strcmp(value, "on") == 0 ||
-												   strcmp(value, "true") == 0);
-					return 0;
-				case GUC_ENUM:
-					if (guc_table[i].parser != NULL)
-					{
-						*((int *) guc_table[i].var) = guc_table[i].parser(value);
-						return 0;
-					}
-					return -1;
-			}
+			guc_index_seed = seed;
+			guc_index_ready = true;
+			return;
 		}
 	}
-	return -1;
+	/* Not reachable at the current table size; lookups fall back to a scan */
+	memset(guc_index, 0, sizeof(guc_index));
 }
 
-int
-guc_show(const char *name, char *out, size_t outlen)
+/*
+ * Build the name index.  Called at startup before any parameter is set;
+ * guc_lookup() also builds it on first use for callers that run earlier.
+ */
+void
+guc_init(void)
 {
-	int i;
+	pthread_once(&guc_index_once, guc_index_build);
+}
 
-	for (i = 0; i < guc_table_size; i++)
+guc_handle_t
+guc_lookup(const char *name)
+{
+	uint32_t	slot;
+	size_t		i;
+
+	if (name == NULL)
+		return GUC_INVALID_HANDLE;
+
+	pthread_once(&guc_index_once, guc_index_build);
+	if (guc_index_ready)
 	{
-		if (strcmp(name, guc_table[i].name) == 0)
+		slot = guc_hash(name, guc_index_seed);
+		if (guc_index[slot].key == NULL || strcmp(guc_index[slot].key, name) != 0)
+			return GUC_INVALID_HANDLE;
+		return guc_index[slot].handle;
+	}
+
+	for (i = 0; i < sizeof(guc_aliases) / sizeof(guc_aliases[0]); i++)
+	{
+		if (strcmp(name, guc_aliases[i].alias) == 0)
 		{
-			switch (guc_table[i].type)
+			name = guc_aliases[i].name;
+			break;
+		}
+	}
+	return guc_linear_lookup(name);
+}
+
+guc_entry_t *
+guc_find(const char *name)
+{
+	guc_handle_t handle = guc_lookup(name);
+
+	return handle == GUC_INVALID_HANDLE ? NULL : &guc_table[handle];
+}
+
+/*
+ * Values as of the most recently published configuration.  The snapshot is
+ * pinned for the read and released with guc_snapshot_release(), so these
+ * accessors take no lock and a reload may free it afterwards.  Before the
+ * first publish they read the global config being loaded.
+ */
+static const config_t *
+guc_snapshot(void)
+{
+	const librale_config_t *current = librale_config_current();
+
+	return current ? (const config_t *) current : &config;
+}
+
+static void
+guc_snapshot_release(void)
+{
+	librale_config_release();
+}
+
+int
+guc_get_int(guc_handle_t handle)
+{
+	const guc_entry_t *entry;
+	int			value;
+
+	if (handle < 0 || handle >= guc_table_size)
+		return 0;
+	entry = &guc_table[handle];
+	if (entry->type == GUC_STRING)
+		return 0;
+	if (!guc_is_port(entry))
+		return config_get_int(guc_config_handle(entry), &config);
+
+	value = guc_load_int(entry, guc_var(entry, guc_snapshot()));
+	guc_snapshot_release();
+	return value;
+}
+
+bool
+guc_get_bool(guc_handle_t handle)
+{
+	return guc_get_int(handle) != 0;
+}
+
+const char *
+guc_get_string(guc_handle_t handle, char *out, size_t outlen)
+{
+	if (outlen == 0)
+		return out;
+	out[0] = '\0';
+	if (handle < 0 || handle >= guc_table_size || guc_table[handle].type != GUC_STRING)
+		return out;
+	strlcpy(out, (const char *) guc_var(&guc_table[handle], guc_snapshot()), outlen);
+	guc_snapshot_release();
+	return out;
+}
+
+/*
+ * Copy of the running configuration: the published snapshot, or the global
+ * config before the first publish.  Reloads stage their changes in it.
+ */
+void
+guc_copy_running(config_t *out)
+{
+	memcpy(out, guc_snapshot(), sizeof(config_t));
+	guc_snapshot_release();
+}
+
+int
+guc_set(const char *name, const char *value)
+{
+	return guc_set_config(&config, name, value);
+}
+
+int
+guc_set_config(config_t *target, const char *name, const char *value)
+{
+	guc_entry_t *entry;
+	void	   *var;
+	int			v;
+
+	entry = guc_find(name);
+	if (entry == NULL)
+		return -1;
+	var = guc_var(entry, target);
+
+	switch (entry->type)
+	{
+		case GUC_INT:
+			v = atoi(value);
+			if (v < entry->min || v > entry->max)
 			{
-				case GUC_INT:
-					snprintf(out, outlen, "%d", *((int *) guc_table[i].var));
-					return 0;
-				case GUC_STRING:
-					snprintf(out, outlen, "%s", (char *) guc_table[i].var);
-					return 0;
-				case GUC_BOOL:
-					snprintf(out, outlen, "%s", *((int *) guc_table[i].var) ? "on" : "off");
-					return 0;
-				case GUC_ENUM:
-					/** For enums, just show the numeric value for now */
-					snprintf(out, outlen, "%d", *((int *) guc_table[i].var));
-					return 0;
+				return -1;
 			}
-		}
+			guc_store_int(entry, var, v);
+			return 0;
+		case GUC_STRING:
+			strncpy((char *) var, value, MAX_STRING_LENGTH - 1);
+			((char *) var)[MAX_STRING_LENGTH - 1] = '\0';
+			return 0;
+		case GUC_BOOL:
+			*((int *) var) = (strcmp(value, "on") == 0 ||
+							  strcmp(value, "true") == 0);
+			return 0;
+		case GUC_ENUM:
+			if (entry->parser != NULL)
+			{
+				*((int *) var) = entry->parser(value);
+				return 0;
+			}
+			return -1;
 	}
 	return -1;
 }
 
+void
+guc_format(const guc_entry_t *entry, const config_t *source, char *out, size_t outlen)
+{
+	const void *var = guc_var(entry, source);
+
+	switch (entry->type)
+	{
+		case GUC_STRING:
+			snprintf(out, outlen, "%s", (const char *) var);
+			break;
+		case GUC_BOOL:
+			snprintf(out, outlen, "%s", *((const int *) var) ? "on" : "off");
+			break;
+		case GUC_INT:
+			snprintf(out, outlen, "%d", guc_load_int(entry, var));
+			break;
+		case GUC_ENUM:
+			snprintf(out, outlen, "%d", *((const int *) var));
+			break;
+	}
+}
+
+void
+guc_copy(const guc_entry_t *entry, config_t *dest, const config_t *source)
+{
+	size_t len = sizeof(int);
+
+	if (entry->type == GUC_STRING)
+		len = MAX_STRING_LENGTH;
+	else if (guc_is_port(entry))
+		len = sizeof(uint16_t);
+	memcpy(guc_var(entry, dest), guc_var(entry, source), len);
+}
+
+bool
+guc_equal(const guc_entry_t *entry, const config_t *a, const config_t *b)
+{
+	if (entry->type == GUC_STRING)
+		return strcmp((const char *) guc_var(entry, a), (const char *) guc_var(entry, b)) == 0;
+	if (entry->type == GUC_INT)
+		return guc_load_int(entry, guc_var(entry, a)) == guc_load_int(entry, guc_var(entry, b));
+	return *((const int *) guc_var(entry, a)) == *((const int *) guc_var(entry, b));
+}
+
+int
+guc_show(const char *name, char *out, size_t outlen)
+{
+	guc_entry_t *entry = guc_find(name);
+
+	if (entry == NULL)
+		return -1;
+	guc_format(entry, guc_snapshot(), out, outlen);
+	guc_snapshot_release();
+	return 0;
+}
+
 void
 guc_show_all(void)
 {
-    int i;
+	const config_t *running = guc_snapshot();
+	int			i;
 
-    for (i = 0; i < guc_table_size; i++)
-    {
-        char line[512];
-        const char *value_str = NULL;
-        char buf[256];
-
-        switch (guc_table[i].type)
-        {
-            case GUC_INT:
-                snprintf(buf, sizeof(buf), "%d", *((int *) guc_table[i].var));
-                value_str = buf;
-                break;
-            case GUC_STRING:
-                value_str = (const char *) guc_table[i].var;
-                break;
-            case GUC_BOOL:
-                value_str = (*((int *) guc_table[i].var)) ? "on" : "off";
-                break;
-            case GUC_ENUM:
-                snprintf(buf, sizeof(buf), "%d", *((int *) guc_table[i].var));
-                value_str = buf;
-                break;
-        }
-
-        snprintf(line, sizeof(line), "%-30s = %s", guc_table[i].name, value_str ? value_str : "");
-        raled_ereport(RALED_LOG_DEBUG, "RALED", line, NULL, NULL);
-    }
+	for (i = 0; i < guc_table_size; i++)
+	{
+		char		line[512];
+		char		buf[MAX_STRING_LENGTH];
+
+		guc_format(&guc_table[i], running, buf, sizeof(buf));
+		snprintf(line, sizeof(line), "%-30s = %s", guc_table[i].name, buf);
+		raled_ereport(RALED_LOG_DEBUG, "RALED", line, NULL, NULL);
+	}
+	guc_snapshot_release();
 }
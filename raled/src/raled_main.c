@@ -18,15 +18,19 @@
 #include <pthread.h>
 #include "librale.h"
 #include "raled.h"
+#include "raled_affinity.h"
 #include "raled_args.h"
 #include "raled_configfile.h"
+#include "raled_guc.h"
 #include "raled_logger.h"
 #include "raled_comm.h"
 #include "raled_signal.h"
 #include "raled_response.h"
+#include "raled_rest_api.h"
 #include "shutdown.h"
 #include "cluster.h"
 #include "rale_error.h"
+#include "watchdog.h"
 
 #define MAX_CLIENTS 10
 #define SOCKET_BACKLOG 5
@@ -37,15 +41,28 @@ librale_config_t *librale_cfg = NULL;
 static void cleanup_resources(void);
 static librale_status_t initialize_librale(void);
 static void *raled_main_loop_thread(void *arg);
+static void setup_loop_watchdog(void);
+static void loop_watchdog_follow_role(void);
+static int start_rest_server(void);
 
 static pthread_t dstore_server_thread;
 static int dstore_threads_started = 0;
+static bool subsystems_stopped = false;	/* Loop thread finished in time */
+
+/* Fed by the main loop; see raled_main_loop_thread() */
+static watchdog_context_t loop_watchdog;
+static bool loop_watchdog_ready = false;
+
+static raled_rest_server_t rest_server;
+static bool rest_server_ready = false;
 
 int
 main(int argc, char *argv[])
 {
 	librale_status_t result;
 
+	/* Resolve parameter names once, before the command line sets any */
+	guc_init();
 	parse_arguments(argc, argv);
 
 	/* Check if PID file already exists and another instance is running */
@@ -100,6 +117,8 @@ main(int argc, char *argv[])
 	raled_log_info("Node configuration: id=\"%d\", name=\"%s\", rale_port=\"%d\", dstore_port=\"%d\".",
 	               config.node.id, config.node.name, config.node.rale_port, config.node.dstore_port);
 
+	raled_affinity_init(&config);
+
 			raled_log_debug("Initializing librale subsystem.");
 	result = initialize_librale();
 	if (result != RALE_SUCCESS)
@@ -150,6 +169,15 @@ main(int argc, char *argv[])
 		}
 	}
 
+	/* After daemon(), whose fork would leave the acceptor threads behind */
+	if (start_rest_server() != 0)
+	{
+		raled_log_error("REST API server failed to start on port \"%d\".", config.rest.port);
+		subsystems_stopped = (graceful_shutdown() == 0);
+		cleanup_resources();
+		return 1;
+	}
+
 	raled_log_info("RALED started successfully.");
 	if (!daemon_mode) {
 		printf("RALED started successfully in foreground mode\n");
@@ -165,11 +193,13 @@ main(int argc, char *argv[])
 		/* Handle SIGHUP reload request */
 		if (is_reload_requested())
 		{
-			clear_reload_request();
-			/* Best-effort: re-read config file; dynamic reconfig is limited */
 			extern char config_file[]; /* from raled_args.c */
-			(void) read_config(config_file, &config);
-			raled_ereport(RALED_LOG_INFO, "RALED", "Configuration reload applied where supported.", NULL, NULL);
+			char reload_msg[256];
+
+			clear_reload_request();
+			raled_log_info("Received SIGHUP, reloading configuration file \"%s\".", config_file);
+			/* reload_config() logs the outcome; reload_msg is for RELOAD replies */
+			(void) reload_config(config_file, reload_msg, sizeof(reload_msg));
 		}
 
 		/* Handle SIGUSR1 status request */
@@ -183,11 +213,12 @@ main(int argc, char *argv[])
 			raled_ereport(RALED_LOG_INFO, "RALED", msg, NULL, NULL);
 		}
 
-		usleep(100000);
+		(void) librale_shutdown_sleep(100);
 	}
 	
 	printf("Shutdown requested, cleaning up...\n");
 			raled_ereport(RALED_LOG_INFO, "RALED", "RALED shutting down - initiating shutdown sequence.", NULL, NULL);
+	subsystems_stopped = (graceful_shutdown() == 0);
 	cleanup_resources();
 	
 	/* Always remove PID file if it exists (safety cleanup) */
@@ -198,7 +229,8 @@ main(int argc, char *argv[])
 		printf("PID file removed: %s\n", actual_pid_file);
 	}
 	
-			raled_ereport(RALED_LOG_INFO, "RALED", "RALED shutdown complete - all resources cleaned up.", NULL, NULL);
+	raled_log_info("RALED shutdown complete in \"%llu\" ms - all resources cleaned up.",
+	               (unsigned long long) librale_shutdown_elapsed_ms());
 	printf("RALED shutdown complete\n");
 
 	return 0;
@@ -207,18 +239,33 @@ main(int argc, char *argv[])
 static void
 cleanup_resources(void)
 {
+	/* No REST request may reach librale while it is torn down */
+	if (rest_server_ready)
+	{
+		rest_server_ready = false;
+		raled_rest_server_cleanup(&rest_server);
+	}
+
 	/* Stop DStore and RALE and cleanup Unix socket */
 	if (dstore_threads_started > 0)
 	{
 		void *rv;
-		/* Signal shutdown so main loop returns */
 		raled_log_info("Stopping daemon threads.");
 		
-		/* Use a simple approach - just cancel the thread if it's stuck */
-		pthread_cancel(dstore_server_thread);
+		/* The loop has left at its next wakeup; cancel only one that is stuck */
+		if (!subsystems_stopped)
+			pthread_cancel(dstore_server_thread);
 		pthread_join(dstore_server_thread, &rv);
 		dstore_threads_started = 0;
 	}
+
+	/* Disarm with the magic close rather than let the device fire */
+	if (loop_watchdog_ready)
+	{
+		loop_watchdog_ready = false;
+		rale_set_watchdog(NULL);
+		watchdog_cleanup(&loop_watchdog);
+	}
 	
 	(void) librale_rale_finit();
 	comm_finit();
@@ -234,6 +281,40 @@ cleanup_resources(void)
 	librale_shutdown_cleanup();
 }
 
+/*
+ * Start the REST API on rest_port unless it is 0.  Its threads are pinned
+ * to io_cpus by raled_affinity_apply_io().
+ */
+static int
+start_rest_server(void)
+{
+	raled_rest_config_t rest_config;
+
+	if (config.rest.port == 0)
+	{
+		raled_log_info("REST API disabled (rest_port = 0).");
+		return 0;
+	}
+
+	memset(&rest_config, 0, sizeof(rest_config));
+	rest_config.bind_address = config.rest.bind_address[0] != '\0' ?
+		config.rest.bind_address : NULL;
+	rest_config.port = (uint16_t) config.rest.port;
+	rest_config.max_connections = RALED_REST_MAX_CONNECTIONS;
+	rest_config.timeout_seconds = RALED_REST_TIMEOUT_SECONDS;
+	rest_config.acceptors = config.rest.acceptors;
+
+	if (raled_rest_server_init(&rest_server, &rest_config) != 0)
+		return -1;
+	if (raled_rest_server_start(&rest_server) != 0)
+	{
+		raled_rest_server_cleanup(&rest_server);
+		return -1;
+	}
+	rest_server_ready = true;
+	return 0;
+}
+
 static librale_status_t
 initialize_librale(void)
 {
@@ -300,6 +381,14 @@ initialize_librale(void)
 	/* Store the configuration globally for raled_init to use */
 	librale_cfg = librale_config;
 
+	/* Keep-alive timings reach librale through the published snapshot */
+	if (publish_runtime_config() != 0)
+	{
+		librale_cfg = NULL;
+		librale_config_destroy(librale_config);
+		return RALE_ERROR_GENERAL;
+	}
+
 	result = librale_rale_init(librale_config);
 	if (result != RALE_SUCCESS)
 	{
@@ -356,6 +445,8 @@ initialize_librale(void)
 	
 	raled_log_info("Cluster configuration completed. Added %d nodes to cluster.", cluster_get_node_count());
 
+	setup_loop_watchdog();
+
 	/* Start single main loop thread instead of separate server/client threads */
 	if (pthread_create(&dstore_server_thread, NULL, raled_main_loop_thread, NULL) == 0)
 	{
@@ -366,24 +457,152 @@ initialize_librale(void)
 	return RALE_SUCCESS;
 }
 
+/*
+ * The watchdog is armed while this node leads and fed only by loop
+ * iterations that finish within watchdog_tick_budget_ms.  A stalled loop
+ * (a long hash_save, a blocking send) therefore stops feeding it, and a
+ * leader that stalls past the device timeout is taken down before a new
+ * leader can be elected beside it.
+ */
+static void
+setup_loop_watchdog(void)
+{
+	watchdog_config_t wd_config;
+
+	watchdog_config_init_defaults(&wd_config);
+	wd_config.mode = (watchdog_mode_t) config.watchdog.mode;
+	if (config.watchdog.device[0] != '\0')
+	{
+		snprintf(wd_config.device_path, sizeof(wd_config.device_path), "%s", config.watchdog.device);
+	}
+	if (config.watchdog.timeout > 0)
+	{
+		wd_config.timeout_seconds = config.watchdog.timeout;
+	}
+	wd_config.keepalive_interval_seconds = wd_config.timeout_seconds / 3;
+	if (config.watchdog.tick_budget_ms > 0)
+	{
+		wd_config.tick_budget_ms = config.watchdog.tick_budget_ms;
+	}
+	wd_config.test_mode = config.watchdog.test_mode != 0;
+	wd_config.soft_noboot = config.watchdog.soft_noboot != 0;
+
+	if (!watchdog_init(&loop_watchdog, &wd_config))
+	{
+		const rale_error_info_t *error_info = rale_get_last_error();
+
+		raled_log_warning("Watchdog unavailable, main loop runs unsupervised: %s.",
+		                  (error_info && error_info->error_message) ? error_info->error_message : "unknown error");
+		return;
+	}
+	loop_watchdog_ready = true;
+
+	/* Elections consult it: with mode "required" an unarmable node never leads */
+	rale_set_watchdog(&loop_watchdog);
+
+	raled_log_info("Watchdog mode \"%s\", device \"%s\"%s, timeout \"%u\" s, tick budget \"%u\" ms.",
+	               watchdog_mode_to_string(wd_config.mode), wd_config.device_path,
+	               wd_config.test_mode ? " (test mode)" : (wd_config.soft_noboot ? " (soft_noboot)" : ""),
+	               wd_config.timeout_seconds, wd_config.tick_budget_ms);
+}
+
+/* Arm the watchdog on becoming leader and disarm it on stepping down */
+static void
+loop_watchdog_follow_role(void)
+{
+	static bool enable_failed = false;
+	bool		leader = librale_get_current_role() == rale_role_leader;
+
+	if (leader && !watchdog_is_active(&loop_watchdog))
+	{
+		if (!watchdog_prepare_for_leadership(&loop_watchdog, 0))
+		{
+			if (!enable_failed)
+			{
+				const rale_error_info_t *error_info = rale_get_last_error();
+
+				raled_log_warning("Could not arm watchdog for leadership: %s.",
+				                  (error_info && error_info->error_message) ? error_info->error_message : "unknown error");
+			}
+			enable_failed = true;
+		}
+		else if (watchdog_is_active(&loop_watchdog))
+		{
+			enable_failed = false;
+			raled_log_info("Watchdog armed for leadership.");
+		}
+	}
+	else if (!leader && watchdog_is_active(&loop_watchdog))
+	{
+		(void) watchdog_release_leadership(&loop_watchdog);
+		raled_log_info("Watchdog disarmed after leaving leadership.");
+	}
+}
+
+bool
+raled_get_loop_stats(raled_loop_stats_t *stats)
+{
+	watchdog_stats_t	wd;
+
+	if (!loop_watchdog_ready)
+	{
+		return false;
+	}
+
+	watchdog_get_stats(&loop_watchdog, &wd);
+	stats->ticks = wd.ticks;
+	stats->ticks_over_budget = wd.ticks_over_budget;
+	stats->max_tick_us = wd.max_tick_us;
+	stats->tick_p50_ms = watchdog_tick_percentile(&wd, 50);
+	stats->tick_p99_ms = watchdog_tick_percentile(&wd, 99);
+	stats->keepalives_sent = wd.keepalives_sent;
+	stats->keepalives_failed = wd.keepalives_failed;
+	stats->expirations = wd.expirations;
+	stats->watchdog_state = watchdog_state_to_string(watchdog_get_state(&loop_watchdog));
+	return true;
+}
+
 static void *
 raled_main_loop_thread(void *arg)
 {
 	(void)arg;
 	
 			raled_ereport(RALED_LOG_INFO, "RALED", "Starting main processing loop.", NULL, NULL);
+	raled_affinity_apply_consensus();
 	
 	while (!librale_is_shutdown_requested(SHUTDOWN_SUBSYSTEM_RALE))
 	{
+		bool		over_budget = false;
+		uint64_t	tick_us;
+
+		if (loop_watchdog_ready)
+			watchdog_tick_begin(&loop_watchdog);
+
 		/* Process all librale ticks in sequence */
 		(void) librale_dstore_server_tick();
 		(void) librale_dstore_client_tick();
 		(void) librale_rale_tick();
+
+		if (loop_watchdog_ready)
+		{
+			loop_watchdog_follow_role();
+			tick_us = watchdog_tick_end(&loop_watchdog, &over_budget);
+			if (over_budget)
+			{
+				raled_log_warning("Main loop tick took \"%llu\" ms, over the \"%u\" ms budget; watchdog not fed.",
+				                  (unsigned long long) (tick_us / 1000), loop_watchdog.config.tick_budget_ms);
+			}
+		}
 		
-		/* Small delay to prevent busy waiting */
-		usleep(50000); /* 50ms */
+		/* Small delay to prevent busy waiting; a shutdown request ends it */
+		(void) librale_shutdown_sleep(50);
 	}
 	
 			raled_ereport(RALED_LOG_INFO, "RALED", "Main processing loop shutting down.", NULL, NULL);
+
+	/* Last words as leader, from the thread that owns the protocol state */
+	if (librale_rale_hand_off() != RALE_SUCCESS)
+		raled_log_warning("Leadership hand-off at shutdown failed.");
+	librale_signal_shutdown_complete(SHUTDOWN_SUBSYSTEM_RALE);
 	return NULL;
 }
@@ -9,10 +9,14 @@
  */
 
 #include "raled_rest_api.h"
+#include "raled_affinity.h"
+#include "raled_command.h"
 #include "raled_logger.h"
-#include "../librale/include/librale.h"
-#include "../librale/include/cluster.h"
-#include "../librale/include/rale.h"
+#include "librale.h"
+#include "cluster.h"
+#include "rale.h"
+#include "batch.h"
+#include "db.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +25,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/time.h>
+#include <strings.h>
 #include <errno.h>
 #include <cjson/cJSON.h>
 
@@ -36,8 +42,18 @@ static int g_endpoint_count = 0;
  * Forward Declarations
  *-------------------------------------------------------------------------*/
 
+typedef struct {
+    int                 client_fd;
+    struct sockaddr_in  client_addr;
+} rest_connection_t;
+
 static void *raled_rest_server_thread(void *arg);
+static void *raled_rest_connection_thread(void *arg);
 static void raled_rest_handle_connection(int client_fd, struct sockaddr_in *client_addr);
+static bool raled_rest_serve_request(int client_fd, const char *raw, size_t length,
+                                     char *remote_addr, uint16_t remote_port);
+static int raled_http_frame_request(const char *data, size_t length, size_t *request_length);
+static int raled_rest_write_all(int fd, const char *data, size_t length);
 static int raled_rest_route_request(const http_request_t *request, http_response_t *response);
 static void raled_rest_cleanup_request(http_request_t *request);
 static void raled_rest_cleanup_response(http_response_t *response);
@@ -71,7 +87,8 @@ raled_rest_server_init(raled_rest_server_t *server, const raled_rest_config_t *c
         return -1;
     }
 
-    server->server_fd = -1;
+    for (int i = 0; i < RALED_REST_MAX_ACCEPTORS; i++)
+        server->acceptors[i].fd = -1;
     server->running = false;
     g_rest_server = server;
 
@@ -83,7 +100,9 @@ raled_rest_server_init(raled_rest_server_t *server, const raled_rest_config_t *c
     raled_rest_register_endpoint("/api/v1/leader/step-down", HTTP_METHOD_POST, raled_rest_handle_step_down);
     raled_rest_register_endpoint("/api/v1/health", HTTP_METHOD_GET, raled_rest_handle_health);
     raled_rest_register_endpoint("/api/v1/metrics", HTTP_METHOD_GET, raled_rest_handle_metrics);
+    raled_rest_register_endpoint("/api/v1/replication", HTTP_METHOD_GET, raled_rest_handle_replication);
     raled_rest_register_endpoint("/api/v1/shutdown", HTTP_METHOD_POST, raled_rest_handle_shutdown);
+    raled_rest_register_endpoint("/api/command", HTTP_METHOD_POST, raled_rest_handle_command);
 
     	raled_log_info("REST API server initialized on \"%s\":\"%d\".", 
                    server->config.bind_address ? server->config.bind_address : "0.0.0.0",
@@ -92,26 +111,38 @@ raled_rest_server_init(raled_rest_server_t *server, const raled_rest_config_t *c
     return 0;
 }
 
-int
-raled_rest_server_start(raled_rest_server_t *server)
+/*
+ * Open one listening socket on the configured address.  With reuseport
+ * every acceptor binds the same port and the kernel spreads incoming
+ * connections across them.
+ */
+static int
+raled_rest_open_listener(const raled_rest_server_t *server, bool reuseport)
 {
     struct sockaddr_in  server_addr;
     int                 opt = 1;
-
-    if (server == NULL)
-        return -1;
+    int                 fd;
 
     /* Create socket */
-    server->server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server->server_fd == -1) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
         	raled_log_error("Failed to create REST API server socket: \"%s\".", strerror(errno));
         return -1;
     }
 
     /* Set socket options */
-    if (setsockopt(server->server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
         	raled_log_warning("Failed to set SO_REUSEADDR: \"%s\".", strerror(errno));
     }
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        	raled_log_error("Failed to set SO_REUSEPORT: \"%s\".", strerror(errno));
+        close(fd);
+        return -1;
+    }
+#else
+    (void) reuseport;
+#endif
 
     /* Setup server address */
     memset(&server_addr, 0, sizeof(server_addr));
@@ -121,7 +152,7 @@ raled_rest_server_start(raled_rest_server_t *server)
     if (server->config.bind_address && strlen(server->config.bind_address) > 0) {
         if (inet_pton(AF_INET, server->config.bind_address, &server_addr.sin_addr) <= 0) {
             	raled_log_error("Invalid bind address: \"%s\".", server->config.bind_address);
-            close(server->server_fd);
+            close(fd);
             return -1;
         }
     } else {
@@ -129,31 +160,93 @@ raled_rest_server_start(raled_rest_server_t *server)
     }
 
     /* Bind socket */
-    if (bind(server->server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+    if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
         	raled_log_error("Failed to bind REST API server socket: \"%s\".", strerror(errno));
-        close(server->server_fd);
+        close(fd);
         return -1;
     }
 
     /* Listen for connections */
-    if (listen(server->server_fd, server->config.max_connections) == -1) {
+    if (listen(fd, server->config.max_connections) == -1) {
         	raled_log_error("Failed to listen on REST API server socket: \"%s\".", strerror(errno));
-        close(server->server_fd);
+        close(fd);
         return -1;
     }
 
-    /* Create server thread */
-    server->running = true;
-    if (pthread_create(&server->server_thread, NULL, raled_rest_server_thread, server) != 0) {
-        	raled_log_error("Failed to create REST API server thread.");
-        server->running = false;
-        close(server->server_fd);
+    return fd;
+}
+
+/* Wake and join every acceptor thread, then close the listening sockets */
+static void
+raled_rest_stop_acceptors(raled_rest_server_t *server, int started)
+{
+    for (int i = 0; i < server->acceptor_count; i++) {
+        /* shutdown() makes a blocked accept() return; close() alone does not */
+        if (server->acceptors[i].fd != -1)
+            shutdown(server->acceptors[i].fd, SHUT_RDWR);
+    }
+    for (int i = 0; i < started; i++) {
+        if (pthread_join(server->acceptors[i].thread, NULL) != 0) {
+            	raled_log_warning("Failed to join REST API server thread.");
+        }
+    }
+    for (int i = 0; i < server->acceptor_count; i++) {
+        if (server->acceptors[i].fd != -1) {
+            close(server->acceptors[i].fd);
+            server->acceptors[i].fd = -1;
+        }
+    }
+    server->acceptor_count = 0;
+}
+
+int
+raled_rest_server_start(raled_rest_server_t *server)
+{
+    int count;
+    int started;
+
+    if (server == NULL)
         return -1;
+
+    count = server->config.acceptors;
+    if (count < 1)
+        count = 1;
+    if (count > RALED_REST_MAX_ACCEPTORS)
+        count = RALED_REST_MAX_ACCEPTORS;
+#ifndef SO_REUSEPORT
+    if (count > 1) {
+        	raled_log_warning("SO_REUSEPORT not supported; using one REST API acceptor instead of \"%d\".",
+                          count);
+        count = 1;
     }
+#endif
+
+    /* Bind every listener before accepting on any */
+    for (server->acceptor_count = 0; server->acceptor_count < count; server->acceptor_count++) {
+        int fd = raled_rest_open_listener(server, count > 1);
 
-    	raled_log_info("REST API server started on \"%s\":\"%d\".", 
+        if (fd == -1) {
+            raled_rest_stop_acceptors(server, 0);
+            return -1;
+        }
+        server->acceptors[server->acceptor_count].fd = fd;
+    }
+
+    /* Create server threads */
+    server->running = true;
+    for (started = 0; started < count; started++) {
+        if (pthread_create(&server->acceptors[started].thread, NULL, raled_rest_server_thread,
+                           &server->acceptors[started]) != 0) {
+            	raled_log_error("Failed to create REST API server thread.");
+            server->running = false;
+            raled_rest_stop_acceptors(server, started);
+            return -1;
+        }
+    }
+
+    	raled_log_info("REST API server started on \"%s\":\"%d\" with \"%d\" acceptor(s).", 
                    server->config.bind_address ? server->config.bind_address : "0.0.0.0",
-                   server->config.port);
+                   server->config.port, count);
 
     return 0;
 }
@@ -164,22 +257,32 @@ raled_rest_server_stop(raled_rest_server_t *server)
     if (server == NULL || !server->running)
         return 0;
 
-    	raled_log_info("Stopping REST API server.");
+    raled_log_info("Stopping REST API server.");
 
     /* Signal server to stop */
     pthread_mutex_lock(&server->mutex);
     server->running = false;
     pthread_mutex_unlock(&server->mutex);
 
-    /* Close server socket */
-    if (server->server_fd != -1) {
-        close(server->server_fd);
-        server->server_fd = -1;
-    }
+    /* Wait for the acceptor threads to finish */
+    raled_rest_stop_acceptors(server, server->acceptor_count);
 
-    /* Wait for server thread to finish */
-    if (pthread_join(server->server_thread, NULL) != 0) {
-        	raled_log_warning("Failed to join REST API server thread.");
+    /* Connection threads notice !running after their current request or idle timeout */
+    {
+        int waited_ms = 0;
+
+        pthread_mutex_lock(&server->mutex);
+        while (server->active_connections > 0 &&
+               waited_ms < RALED_REST_IDLE_TIMEOUT_SECONDS * 1000 + 500) {
+            pthread_mutex_unlock(&server->mutex);
+            usleep(10000);
+            waited_ms += 10;
+            pthread_mutex_lock(&server->mutex);
+        }
+        if (server->active_connections > 0)
+            	raled_log_warning("\"%d\" REST API connections still open at shutdown.",
+                              server->active_connections);
+        pthread_mutex_unlock(&server->mutex);
     }
 
     	raled_log_info("REST API server stopped.");
@@ -243,16 +346,28 @@ raled_rest_register_endpoint(const char *path, http_method_t method, rest_endpoi
 static void *
 raled_rest_server_thread(void *arg)
 {
-    raled_rest_server_t     *server = (raled_rest_server_t *)arg;
+    raled_rest_acceptor_t   *acceptor = (raled_rest_acceptor_t *)arg;
+    raled_rest_server_t     *server = g_rest_server;
     struct sockaddr_in      client_addr;
     socklen_t               client_len;
     int                     client_fd;
+    pthread_attr_t          attr;
 
     	raled_log_debug("REST API server thread started.");
 
+    /* Connection threads inherit this thread's CPU set */
+    raled_affinity_apply_io();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
     while (server->running) {
+        rest_connection_t   *conn;
+        pthread_t           thread;
+        bool                admitted;
+
         client_len = sizeof(client_addr);
-        client_fd = accept(server->server_fd, (struct sockaddr *)&client_addr, &client_len);
+        client_fd = accept(acceptor->fd, (struct sockaddr *)&client_addr, &client_len);
         
         if (client_fd == -1) {
             if (errno == EINTR) {
@@ -266,70 +381,302 @@ raled_rest_server_thread(void *arg)
             break;
         }
 
-        /* Handle connection */
+        /*
+         * Each connection gets its own thread so that keep-alive clients
+         * (bulk import workers, status pollers) do not starve each other.
+         */
+        pthread_mutex_lock(&server->mutex);
+        admitted = server->active_connections < server->config.max_connections;
+        if (admitted)
+            server->active_connections++;
+        pthread_mutex_unlock(&server->mutex);
+
+        if (!admitted) {
+            static const char busy[] =
+                "HTTP/1.1 503 Service Unavailable\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: 21\r\n"
+                "Connection: close\r\n"
+                "\r\n"
+                "{\"error\":\"Too busy\"}\n";
+
+            	raled_log_warning("REST API connection limit \"%d\" reached; rejecting client.",
+                              server->config.max_connections);
+            raled_rest_write_all(client_fd, busy, sizeof(busy) - 1);
+            close(client_fd);
+            continue;
+        }
+
+        conn = malloc(sizeof(rest_connection_t));
+        if (conn != NULL) {
+            conn->client_fd = client_fd;
+            conn->client_addr = client_addr;
+            if (pthread_create(&thread, &attr, raled_rest_connection_thread, conn) == 0)
+                continue;
+            free(conn);
+        }
+
+        /* Could not hand off; serve inline */
+        	raled_log_warning("Failed to start REST API connection thread; serving inline.");
         raled_rest_handle_connection(client_fd, &client_addr);
         close(client_fd);
+        pthread_mutex_lock(&server->mutex);
+        server->active_connections--;
+        pthread_mutex_unlock(&server->mutex);
     }
 
+    pthread_attr_destroy(&attr);
     	raled_log_debug("REST API server thread stopped.");
     return NULL;
 }
 
+static void *
+raled_rest_connection_thread(void *arg)
+{
+    rest_connection_t   *conn = (rest_connection_t *)arg;
+    raled_rest_server_t *server = g_rest_server;
+
+    raled_rest_handle_connection(conn->client_fd, &conn->client_addr);
+    close(conn->client_fd);
+    free(conn);
+
+    if (server != NULL) {
+        pthread_mutex_lock(&server->mutex);
+        server->active_connections--;
+        pthread_mutex_unlock(&server->mutex);
+    }
+    return NULL;
+}
+
+static int
+raled_rest_write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/*
+ * Find the extent of the first request in a buffer.  Returns 1 and sets
+ * *request_length when a whole request (headers plus Content-Length body)
+ * is present, 0 when more data is needed, -1 when the request is malformed
+ * or exceeds RALED_REST_MAX_REQUEST_SIZE.
+ */
+static int
+raled_http_frame_request(const char *data, size_t length, size_t *request_length)
+{
+    size_t      header_length = 0;
+    size_t      content_length = 0;
+    size_t      i;
+    const char  *line;
+
+    for (i = 0; i + 1 < length; i++) {
+        if (data[i] == '\n' && data[i + 1] == '\n') {
+            header_length = i + 2;
+            break;
+        }
+        if (i + 3 < length && data[i] == '\r' && data[i + 1] == '\n' &&
+            data[i + 2] == '\r' && data[i + 3] == '\n') {
+            header_length = i + 4;
+            break;
+        }
+    }
+
+    if (header_length == 0)
+        return (length >= RALED_REST_MAX_REQUEST_SIZE) ? -1 : 0;
+
+    /* Scan header lines for Content-Length */
+    line = data;
+    while (line < data + header_length) {
+        const char *eol = memchr(line, '\n', (size_t)(data + header_length - line));
+
+        if (eol == NULL)
+            break;
+        if ((size_t)(eol - line) > 15 && strncasecmp(line, "Content-Length:", 15) == 0) {
+            char    *end;
+            unsigned long v = strtoul(line + 15, &end, 10);
+
+            if (end == line + 15 || v > RALED_REST_MAX_REQUEST_SIZE)
+                return -1;
+            content_length = (size_t)v;
+        }
+        line = eol + 1;
+    }
+
+    if (header_length + content_length > RALED_REST_MAX_REQUEST_SIZE)
+        return -1;
+    if (length < header_length + content_length)
+        return 0;
+
+    *request_length = header_length + content_length;
+    return 1;
+}
+
+/*
+ * Serve every request a client sends on one connection.  HTTP/1.1 clients
+ * keep the connection open by default and may pipeline; requests are
+ * answered strictly in order.
+ */
 static void
 raled_rest_handle_connection(int client_fd, struct sockaddr_in *client_addr)
 {
-    char                buffer[RALED_REST_BUFFER_SIZE];
-    http_request_t      request = {0};
-    http_response_t     response = {0};
-    ssize_t             bytes_read;
-    char                response_buffer[RALED_REST_BUFFER_SIZE];
-    
-    /* Read request */
-    bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-    if (bytes_read <= 0) {
-        	raled_log_warning("Failed to read HTTP request: \"%s\".", strerror(errno));
+    char                *buffer;
+    size_t              buffer_size = RALED_REST_BUFFER_SIZE;
+    size_t              buffered = 0;
+    char                remote_addr[INET_ADDRSTRLEN];
+    uint16_t            remote_port;
+    struct timeval      tv;
+    bool                keep_alive = true;
+
+    buffer = malloc(buffer_size);
+    if (buffer == NULL) {
+        	raled_log_error("Failed to allocate REST API connection buffer.");
         return;
     }
-    buffer[bytes_read] = '\0';
 
-    /* Store client address */
-    request.remote_addr = inet_ntoa(client_addr->sin_addr);
-    request.remote_port = ntohs(client_addr->sin_port);
+    if (inet_ntop(AF_INET, &client_addr->sin_addr, remote_addr, sizeof(remote_addr)) == NULL)
+        strlcpy(remote_addr, "unknown", sizeof(remote_addr));
+    remote_port = ntohs(client_addr->sin_port);
+
+    /* Bound how long an idle keep-alive connection may hold this thread */
+    tv.tv_sec = RALED_REST_IDLE_TIMEOUT_SECONDS;
+    tv.tv_usec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    while (keep_alive && g_rest_server != NULL && g_rest_server->running) {
+        size_t  request_length = 0;
+        int     framed;
+        char    saved;
+
+        while ((framed = raled_http_frame_request(buffer, buffered, &request_length)) == 0) {
+            ssize_t bytes_read;
+
+            if (buffered + 1 >= buffer_size) {
+                char *grown;
+
+                if (buffer_size >= RALED_REST_MAX_REQUEST_SIZE + 1) {
+                    framed = -1;
+                    break;
+                }
+                buffer_size *= 2;
+                if (buffer_size > RALED_REST_MAX_REQUEST_SIZE + 1)
+                    buffer_size = RALED_REST_MAX_REQUEST_SIZE + 1;
+                grown = realloc(buffer, buffer_size);
+                if (grown == NULL) {
+                    framed = -1;
+                    break;
+                }
+                buffer = grown;
+            }
+
+            bytes_read = read(client_fd, buffer + buffered, buffer_size - buffered - 1);
+            if (bytes_read < 0 && errno == EINTR)
+                continue;
+            if (bytes_read <= 0) {
+                /* Orderly close, idle timeout or error between requests */
+                if (buffered > 0)
+                    	raled_log_warning("Incomplete HTTP request from \"%s\":\"%d\".",
+                                      remote_addr, remote_port);
+                framed = -2;
+                break;
+            }
+            buffered += (size_t)bytes_read;
+        }
+
+        if (framed == -2)
+            break;
+        if (framed < 0) {
+            static const char bad[] =
+                "HTTP/1.1 400 Bad Request\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: 56\r\n"
+                "Connection: close\r\n"
+                "\r\n"
+                "{\"error\":\"Bad Request\",\"message\":\"Invalid HTTP request\"}";
+
+            	raled_log_warning("Rejecting oversized or malformed HTTP request from \"%s\":\"%d\".",
+                              remote_addr, remote_port);
+            raled_rest_write_all(client_fd, bad, sizeof(bad) - 1);
+            break;
+        }
+
+        saved = buffer[request_length];
+        buffer[request_length] = '\0';
+        keep_alive = raled_rest_serve_request(client_fd, buffer, request_length,
+                                              remote_addr, remote_port);
+        buffer[request_length] = saved;
+
+        buffered -= request_length;
+        memmove(buffer, buffer + request_length, buffered);
+    }
+
+    free(buffer);
+}
+
+/*
+ * Parse, route and answer a single framed request.  Returns true when the
+ * connection should stay open for another request.
+ */
+static bool
+raled_rest_serve_request(int client_fd, const char *raw, size_t length,
+                         char *remote_addr, uint16_t remote_port)
+{
+    http_request_t      request = {0};
+    http_response_t     response = {0};
+    char                *response_buffer;
+    size_t              response_buffer_size;
+    bool                keep_alive;
+
+    request.remote_addr = remote_addr;
+    request.remote_port = remote_port;
 
     /* Parse request */
-    if (raled_http_parse_request(buffer, (size_t)bytes_read, &request) != 0) {
+    if (raled_http_parse_request(raw, length, &request) != 0) {
         	raled_log_warning("Failed to parse HTTP request from \"%s\":\"%d\".", 
                          request.remote_addr, request.remote_port);
         
         /* Send 400 Bad Request */
+        request.keep_alive = false;
         response.status = HTTP_STATUS_BAD_REQUEST;
         raled_http_set_json_body(&response, "{\"error\":\"Bad Request\",\"message\":\"Invalid HTTP request\"}");
-        raled_http_generate_response(&response, response_buffer, sizeof(response_buffer));
-        write(client_fd, response_buffer, strlen(response_buffer));
-        raled_rest_cleanup_response(&response);
-        return;
-    }
-
-    /* Route request to handler */
-    if (raled_rest_route_request(&request, &response) != 0) {
+    } else if (raled_rest_route_request(&request, &response) != 0) {
         /* Send 404 Not Found */
         response.status = HTTP_STATUS_NOT_FOUND;
         raled_http_set_json_body(&response, "{\"error\":\"Not Found\",\"message\":\"Endpoint not found\"}");
     }
 
+    keep_alive = request.keep_alive && g_rest_server != NULL && g_rest_server->running;
+    raled_http_set_header(&response, "Connection", keep_alive ? "keep-alive" : "close");
+
     /* Add CORS headers if enabled */
     if (g_rest_server && g_rest_server->config.enable_cors) {
         raled_http_add_cors_headers(&response);
     }
 
-    /* Generate and send response */
-    if (raled_http_generate_response(&response, response_buffer, sizeof(response_buffer)) == 0) {
-        write(client_fd, response_buffer, strlen(response_buffer));
+    /* Generate and send response; size the buffer to the body so nothing is truncated */
+    response_buffer_size = RALED_REST_BUFFER_SIZE + response.body_length;
+    response_buffer = malloc(response_buffer_size);
+    if (response_buffer == NULL ||
+        raled_http_generate_response(&response, response_buffer, response_buffer_size) != 0 ||
+        raled_rest_write_all(client_fd, response_buffer, strlen(response_buffer)) != 0) {
+        keep_alive = false;
     }
+    free(response_buffer);
 
     /* Cleanup */
+    request.remote_addr = NULL;
     raled_rest_cleanup_request(&request);
     raled_rest_cleanup_response(&response);
+    return keep_alive;
 }
 
 static int
@@ -445,6 +792,46 @@ raled_http_parse_request(const char *raw_data, size_t data_length, http_request_
         request->query_string = strdup(query_start);
     }
 
+    /* HTTP/1.1 defaults to persistent connections, HTTP/1.0 does not */
+    request->keep_alive = (strncmp(path_end + 1, "HTTP/1.1", 8) == 0);
+
+    /* Parse header lines up to the blank line */
+    line_start = line_end + ((line_end[0] == '\r') ? 2 : 1);
+    while (*line_start != '\0' && *line_start != '\r' && *line_start != '\n') {
+        const char      *colon;
+        const char      *value_start;
+        const char      *value_end;
+        http_header_t   *new_headers;
+
+        line_end = strchr(line_start, '\n');
+        if (line_end == NULL)
+            break;
+        value_end = (line_end > line_start && line_end[-1] == '\r') ? line_end - 1 : line_end;
+
+        colon = memchr(line_start, ':', (size_t)(value_end - line_start));
+        if (colon != NULL) {
+            value_start = colon + 1;
+            while (value_start < value_end && (*value_start == ' ' || *value_start == '\t'))
+                value_start++;
+
+            new_headers = realloc(request->headers, sizeof(http_header_t) * (size_t)(request->header_count + 1));
+            if (new_headers == NULL)
+                return -1;
+            request->headers = new_headers;
+            request->headers[request->header_count].key = strndup(line_start, (size_t)(colon - line_start));
+            request->headers[request->header_count].value = strndup(value_start, (size_t)(value_end - value_start));
+            request->header_count++;
+
+            if ((size_t)(colon - line_start) == 10 && strncasecmp(line_start, "Connection", 10) == 0) {
+                if (strncasecmp(value_start, "close", 5) == 0)
+                    request->keep_alive = false;
+                else if (strncasecmp(value_start, "keep-alive", 10) == 0)
+                    request->keep_alive = true;
+            }
+        }
+        line_start = line_end + 1;
+    }
+
     /* Find body start (after headers) */
     body_start = strstr(raw_data, "\r\n\r\n");
     if (body_start == NULL)
@@ -568,6 +955,26 @@ raled_http_set_json_body(http_response_t *response, const char *json)
     return 0;
 }
 
+int
+raled_http_set_text_body(http_response_t *response, const char *text)
+{
+    if (response == NULL || text == NULL)
+        return -1;
+
+    if (response->body) {
+        free(response->body);
+    }
+
+    response->body = strdup(text);
+    if (response->body == NULL)
+        return -1;
+
+    response->body_length = strlen(text);
+    response->content_type = strdup("text/plain; version=0.0.4");
+
+    return 0;
+}
+
 bool
 raled_http_check_auth(const http_request_t *request, const char *api_key)
 {
@@ -626,7 +1033,7 @@ raled_http_set_header(http_response_t *response, const char *key, const char *va
         return -1;
 
     /* Reallocate headers array */
-    new_headers = realloc(response->headers, sizeof(http_header_t) * (response->header_count + 1));
+    new_headers = realloc(response->headers, sizeof(http_header_t) * (size_t) (response->header_count + 1));
     if (new_headers == NULL)
         return -1;
 
@@ -812,14 +1219,290 @@ raled_rest_handle_health(const http_request_t *request, http_response_t *respons
     return 0;
 }
 
+/* One gauge family, a sample per follower; returns the bytes written */
+static size_t
+metrics_replica_family(char *out, size_t outlen, const char *name, const char *help,
+                       const librale_replica_status_t *replicas, uint32_t count,
+                       double (*value)(const librale_replica_status_t *))
+{
+    size_t  len = 0;
+    int     n;
+
+    n = snprintf(out, outlen, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+    if (n < 0 || (size_t)n >= outlen)
+        return 0;
+    len = (size_t)n;
+
+    for (uint32_t i = 0; i < count; i++) {
+        n = snprintf(out + len, outlen - len, "%s{node=\"%d\"} %.6g\n",
+                     name, replicas[i].node_id, value(&replicas[i]));
+        if (n < 0 || (size_t)n >= outlen - len)
+            return 0;
+        len += (size_t)n;
+    }
+    return len;
+}
+
+/*
+ * One histogram from log2 buckets: bucket i counts values up to
+ * 2^i * scale, the last one everything above.  Returns the bytes written.
+ */
+static size_t
+metrics_histogram(char *out, size_t outlen, const char *name, const char *help,
+                  const uint64_t *buckets, int nbuckets, double scale,
+                  uint64_t count, double sum)
+{
+    uint64_t    cumulative = 0;
+    size_t      len;
+    int         n;
+
+    n = snprintf(out, outlen, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    if (n < 0 || (size_t)n >= outlen)
+        return 0;
+    len = (size_t)n;
+
+    for (int i = 0; i < nbuckets - 1; i++) {
+        cumulative += buckets[i];
+        n = snprintf(out + len, outlen - len, "%s_bucket{le=\"%.6g\"} %llu\n",
+                     name, (double)(UINT64_C(1) << i) * scale, (unsigned long long)cumulative);
+        if (n < 0 || (size_t)n >= outlen - len)
+            return 0;
+        len += (size_t)n;
+    }
+    n = snprintf(out + len, outlen - len,
+                 "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6g\n%s_count %llu\n",
+                 name, (unsigned long long)count, name, sum, name, (unsigned long long)count);
+    if (n < 0 || (size_t)n >= outlen - len)
+        return 0;
+    return len + (size_t)n;
+}
+
+static double metric_connected(const librale_replica_status_t *r) { return r->connected ? 1 : 0; }
+static double metric_match_index(const librale_replica_status_t *r) { return (double)r->match_index; }
+static double metric_lag_entries(const librale_replica_status_t *r) { return (double)r->lag_entries; }
+static double metric_lag_seconds(const librale_replica_status_t *r) { return (double)r->lag_ms / 1000.0; }
+static double metric_in_flight(const librale_replica_status_t *r) { return (double)r->entries_in_flight; }
+static double metric_bytes_in_flight(const librale_replica_status_t *r) { return (double)r->bytes_in_flight; }
+static double metric_rtt_seconds(const librale_replica_status_t *r) { return (double)r->rtt_ewma_us / 1e6; }
+static double metric_gap_index(const librale_replica_status_t *r) { return (double)r->gap_index; }
+static double metric_ack_age_seconds(const librale_replica_status_t *r)
+{
+    return r->last_ack_age_ms < 0 ? -1 : (double)r->last_ack_age_ms / 1000.0;
+}
+
 int
 raled_rest_handle_metrics(const http_request_t *request, http_response_t *response)
 {
+    static const struct {
+        const char  *name;
+        const char  *help;
+        double      (*value)(const librale_replica_status_t *);
+    } families[] = {
+        { "rale_replica_connected", "Leader has a connection to the follower", metric_connected },
+        { "rale_replica_match_index", "Highest entry the follower acknowledged", metric_match_index },
+        { "rale_replica_lag_entries", "Entries replicated but not acknowledged", metric_lag_entries },
+        { "rale_replica_lag_seconds", "Age of the oldest unacknowledged entry", metric_lag_seconds },
+        { "rale_replica_entries_in_flight", "Entries sent but not acknowledged", metric_in_flight },
+        { "rale_replica_bytes_in_flight", "Bytes sent but not acknowledged", metric_bytes_in_flight },
+        { "rale_replica_rtt_seconds", "Smoothed send-to-acknowledge time", metric_rtt_seconds },
+        { "rale_replica_gap_index", "First entry missing below an acknowledged one, 0 if none", metric_gap_index },
+        { "rale_replica_last_ack_age_seconds", "Time since the last acknowledgement, -1 if none", metric_ack_age_seconds },
+    };
+    librale_replica_status_t    replicas[RALED_REST_MAX_REPLICAS];
+    librale_rale_status_t       status;
+    uint64_t                    last_index = 0;
+    uint32_t                    count = 0;
+    bool                        leader;
+    char                        *body;
+    size_t                      len;
+    int                         n;
+
     (void)request; /* Unused parameter */
-    
-    response->status = HTTP_STATUS_NOT_IMPLEMENTED;
-    raled_http_set_json_body(response, "{\"error\":\"Not Implemented\",\"message\":\"Metrics endpoint not yet implemented\"}");
-    
+
+    body = malloc(RALED_REST_METRICS_SIZE);
+    if (body == NULL) {
+        response->status = HTTP_STATUS_INTERNAL_ERROR;
+        raled_http_set_json_body(response, "{\"error\":\"Internal Server Error\"}");
+        return 0;
+    }
+
+    /* Only the leader's view of its followers is meaningful */
+    leader = librale_get_rale_status(&status) == RALE_SUCCESS && status.role == 2;
+    if (leader)
+        count = librale_dstore_get_replication(replicas, RALED_REST_MAX_REPLICAS, &last_index);
+
+    n = snprintf(body, RALED_REST_METRICS_SIZE,
+                 "# HELP rale_is_leader Whether this node is the leader\n"
+                 "# TYPE rale_is_leader gauge\n"
+                 "rale_is_leader %d\n"
+                 "# HELP rale_replication_last_index Entries replicated by this node as leader\n"
+                 "# TYPE rale_replication_last_index counter\n"
+                 "rale_replication_last_index %llu\n",
+                 leader ? 1 : 0, (unsigned long long)last_index);
+    len = (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE) ? (size_t)n : 0;
+
+    for (size_t i = 0; i < sizeof(families) / sizeof(families[0]) && count > 0; i++)
+        len += metrics_replica_family(body + len, RALED_REST_METRICS_SIZE - len,
+                                      families[i].name, families[i].help,
+                                      replicas, count, families[i].value);
+
+    /* Group commit on the leader */
+    if (leader) {
+        batch_stats_t batch;
+
+        batch_get_stats(&batch);
+        len += metrics_histogram(body + len, RALED_REST_METRICS_SIZE - len,
+                                 "rale_write_batch_size", "Writes committed per rale.db flush and replication frame",
+                                 batch.size_histogram, BATCH_SIZE_BUCKETS, 1.0,
+                                 batch.batches, (double)batch.entries);
+        len += metrics_histogram(body + len, RALED_REST_METRICS_SIZE - len,
+                                 "rale_write_batch_wait_seconds", "Time a write queued before its batch was committed",
+                                 batch.wait_histogram, BATCH_WAIT_BUCKETS, 1e-6,
+                                 batch.entries, (double)batch.wait_total_us / 1e6);
+    }
+
+    /* Lookups of absent keys the key filter answered, and the ones it let through */
+    {
+        bloom_stats_t   filter;
+
+        db_filter_stats(&filter);
+        n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                     "# HELP rale_key_filter_negatives_total GET lookups answered absent by the key filter\n"
+                     "# TYPE rale_key_filter_negatives_total counter\n"
+                     "rale_key_filter_negatives_total %llu\n"
+                     "# HELP rale_key_filter_false_positives_total GET lookups the key filter passed for absent keys\n"
+                     "# TYPE rale_key_filter_false_positives_total counter\n"
+                     "rale_key_filter_false_positives_total %llu\n"
+                     "# HELP rale_key_filter_false_positive_ratio Share of absent-key lookups the key filter passed\n"
+                     "# TYPE rale_key_filter_false_positive_ratio gauge\n"
+                     "rale_key_filter_false_positive_ratio %.6g\n",
+                     (unsigned long long)filter.negatives, (unsigned long long)filter.false_positives,
+                     bloom_false_positive_rate(&filter));
+        if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+            len += (size_t)n;
+    }
+
+    /* Values kept on disk, the cache in front of them, and what collection reclaimed */
+    {
+        vlog_stats_t    vlog;
+
+        db_value_log_stats(&vlog);
+        n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                     "# HELP rale_value_log_bytes Bytes in value log segment files\n"
+                     "# TYPE rale_value_log_bytes gauge\n"
+                     "rale_value_log_bytes %llu\n"
+                     "# HELP rale_value_log_garbage_bytes Value log bytes of overwritten or deleted values\n"
+                     "# TYPE rale_value_log_garbage_bytes gauge\n"
+                     "rale_value_log_garbage_bytes %llu\n"
+                     "# HELP rale_value_cache_hits_total Value log reads served from the page cache\n"
+                     "# TYPE rale_value_cache_hits_total counter\n"
+                     "rale_value_cache_hits_total %llu\n"
+                     "# HELP rale_value_cache_misses_total Value log page reads from disk\n"
+                     "# TYPE rale_value_cache_misses_total counter\n"
+                     "rale_value_cache_misses_total %llu\n"
+                     "# HELP rale_value_log_gc_reclaimed_bytes_total Bytes freed by value log collection\n"
+                     "# TYPE rale_value_log_gc_reclaimed_bytes_total counter\n"
+                     "rale_value_log_gc_reclaimed_bytes_total %llu\n",
+                     (unsigned long long)vlog.bytes, (unsigned long long)vlog.garbage_bytes,
+                     (unsigned long long)vlog.cache_hits, (unsigned long long)vlog.cache_misses,
+                     (unsigned long long)vlog.gc_reclaimed_bytes);
+        if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+            len += (size_t)n;
+    }
+
+    /* LSM engine levels, and the bytes flushes and compactions wrote for client bytes */
+    {
+        lsm_stats_t     lsm;
+        int             level;
+
+        db_lsm_stats(&lsm);
+        n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                     "# HELP rale_lsm_memtable_bytes Bytes in the LSM memtables\n"
+                     "# TYPE rale_lsm_memtable_bytes gauge\n"
+                     "rale_lsm_memtable_bytes %llu\n"
+                     "# HELP rale_lsm_level_files SST files per LSM level\n"
+                     "# TYPE rale_lsm_level_files gauge\n",
+                     (unsigned long long)lsm.memtable_bytes);
+        if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+            len += (size_t)n;
+        for (level = 0; level < LSM_LEVELS; level++) {
+            n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                         "rale_lsm_level_files{level=\"%d\"} %llu\n",
+                         level, (unsigned long long)lsm.level_files[level]);
+            if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+                len += (size_t)n;
+        }
+        n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                     "# HELP rale_lsm_level_bytes SST bytes per LSM level\n"
+                     "# TYPE rale_lsm_level_bytes gauge\n");
+        if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+            len += (size_t)n;
+        for (level = 0; level < LSM_LEVELS; level++) {
+            n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                         "rale_lsm_level_bytes{level=\"%d\"} %llu\n",
+                         level, (unsigned long long)lsm.level_bytes[level]);
+            if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+                len += (size_t)n;
+        }
+        n = snprintf(body + len, RALED_REST_METRICS_SIZE - len,
+                     "# HELP rale_lsm_user_bytes_total Key and value bytes written by clients\n"
+                     "# TYPE rale_lsm_user_bytes_total counter\n"
+                     "rale_lsm_user_bytes_total %llu\n"
+                     "# HELP rale_lsm_flush_bytes_total SST bytes written by memtable flushes\n"
+                     "# TYPE rale_lsm_flush_bytes_total counter\n"
+                     "rale_lsm_flush_bytes_total %llu\n"
+                     "# HELP rale_lsm_compaction_read_bytes_total SST bytes read by compactions\n"
+                     "# TYPE rale_lsm_compaction_read_bytes_total counter\n"
+                     "rale_lsm_compaction_read_bytes_total %llu\n"
+                     "# HELP rale_lsm_compaction_write_bytes_total SST bytes written by compactions\n"
+                     "# TYPE rale_lsm_compaction_write_bytes_total counter\n"
+                     "rale_lsm_compaction_write_bytes_total %llu\n"
+                     "# HELP rale_lsm_write_stalls_total Writes that waited for a flush or compaction\n"
+                     "# TYPE rale_lsm_write_stalls_total counter\n"
+                     "rale_lsm_write_stalls_total %llu\n"
+                     "# HELP rale_lsm_filter_checks_total SST Bloom filter probes by GET lookups\n"
+                     "# TYPE rale_lsm_filter_checks_total counter\n"
+                     "rale_lsm_filter_checks_total %llu\n"
+                     "# HELP rale_lsm_filter_negatives_total SST reads the Bloom filters avoided\n"
+                     "# TYPE rale_lsm_filter_negatives_total counter\n"
+                     "rale_lsm_filter_negatives_total %llu\n",
+                     (unsigned long long)lsm.user_bytes, (unsigned long long)lsm.flush_bytes,
+                     (unsigned long long)lsm.compaction_read_bytes,
+                     (unsigned long long)lsm.compaction_write_bytes,
+                     (unsigned long long)lsm.stalls, (unsigned long long)lsm.filter_checks,
+                     (unsigned long long)lsm.filter_negatives);
+        if (n > 0 && (size_t)n < RALED_REST_METRICS_SIZE - len)
+            len += (size_t)n;
+    }
+
+    response->status = HTTP_STATUS_OK;
+    raled_http_set_text_body(response, body);
+    free(body);
+    return 0;
+}
+
+int
+raled_rest_handle_replication(const http_request_t *request, http_response_t *response)
+{
+    char *reply;
+
+    (void)request; /* Unused parameter */
+
+    reply = malloc(RALED_REST_COMMAND_RESPONSE_SIZE);
+    if (reply == NULL) {
+        response->status = HTTP_STATUS_INTERNAL_ERROR;
+        raled_http_set_json_body(response, "{\"error\":\"Internal Server Error\"}");
+        return 0;
+    }
+
+    if (raled_process_command("REPLICATION", reply, RALED_REST_COMMAND_RESPONSE_SIZE) == RALE_SUCCESS) {
+        response->status = HTTP_STATUS_OK;
+        raled_http_set_json_body(response, reply);
+    } else {
+        response->status = HTTP_STATUS_INTERNAL_ERROR;
+        raled_http_set_json_body(response, "{\"error\":\"Internal Server Error\"}");
+    }
+    free(reply);
     return 0;
 }
 
@@ -835,3 +1518,66 @@ raled_rest_handle_shutdown(const http_request_t *request, http_response_t *respo
     
     return 0;
 }
+
+int
+raled_rest_handle_command(const http_request_t *request, http_response_t *response)
+{
+    cJSON       *json;
+    cJSON       *command;
+    char        *reply;
+    char        *command_text = NULL;
+    bool        is_json_reply;
+
+    if (request->body == NULL || request->body_length == 0) {
+        response->status = HTTP_STATUS_BAD_REQUEST;
+        raled_http_set_json_body(response, "{\"error\":\"Bad Request\",\"message\":\"Missing command body\"}");
+        return 0;
+    }
+
+    /*
+     * Structured commands (GET, PUT, CAS, WATCH, PUT_BATCH, EXPORT) are passed through as
+     * JSON; {"command": "<text>"} wrappers carry a plain text command.
+     */
+    json = cJSON_Parse(request->body);
+    if (json == NULL) {
+        response->status = HTTP_STATUS_BAD_REQUEST;
+        raled_http_set_json_body(response, "{\"error\":\"Bad Request\",\"message\":\"Body is not valid JSON\"}");
+        return 0;
+    }
+    command = cJSON_GetObjectItemCaseSensitive(json, "command");
+    if (cJSON_IsString(command) && cJSON_GetArraySize(json) == 1)
+        command_text = strdup(command->valuestring);
+    cJSON_Delete(json);
+
+    reply = malloc(RALED_REST_COMMAND_RESPONSE_SIZE);
+    if (reply == NULL) {
+        free(command_text);
+        response->status = HTTP_STATUS_INTERNAL_ERROR;
+        raled_http_set_json_body(response, "{\"error\":\"Internal Server Error\"}");
+        return 0;
+    }
+
+    if (raled_process_command(command_text ? command_text : request->body,
+                              reply, RALED_REST_COMMAND_RESPONSE_SIZE) == RALE_SUCCESS)
+        response->status = HTTP_STATUS_OK;
+    else
+        response->status = HTTP_STATUS_BAD_REQUEST;
+    free(command_text);
+
+    is_json_reply = (reply[0] == '{' || reply[0] == '[');
+    if (is_json_reply) {
+        raled_http_set_json_body(response, reply);
+    } else {
+        cJSON   *wrapper = cJSON_CreateObject();
+        char    *text;
+
+        cJSON_AddStringToObject(wrapper, "result", reply);
+        text = cJSON_PrintUnformatted(wrapper);
+        raled_http_set_json_body(response, text ? text : "{}");
+        free(text);
+        cJSON_Delete(wrapper);
+    }
+
+    free(reply);
+    return 0;
+}
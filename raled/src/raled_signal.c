@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 /** Local headers */
 #include "raled_signal.h"
@@ -36,12 +37,14 @@ pthread_t server_thread = 0;
 pthread_t client_thread = 0;
 pthread_t unix_socket_thread = 0;
 
-/** Signal handler context */
+/** Time the main loop thread gets to finish its last tick */
+#define SHUTDOWN_TIMEOUT_MS 1000
+
+/** Signal handler context; atomics, since a handler cannot take a lock */
 static struct {
-    volatile int shutdown_requested;
-    volatile int reload_requested;
-    volatile int status_requested;
-    pthread_mutex_t mutex;
+    atomic_int shutdown_requested;
+    atomic_int reload_requested;
+    atomic_int status_requested;
 } signal_ctx;
 
 
@@ -72,14 +75,11 @@ signal_handler(int signal)
     char msg[256];
     int old_errno = errno;
     
-    /** Thread-safe signal handling */
-    pthread_mutex_lock(&signal_ctx.mutex);
-    
     switch (signal) {
         case SIGTERM:
         case SIGINT:
             /** Graceful shutdown request from signal */
-            signal_ctx.shutdown_requested = 1;
+            atomic_store(&signal_ctx.shutdown_requested, 1);
             /** Use coordinated shutdown system for signal-based shutdown */
             librale_request_shutdown();
             snprintf(msg, sizeof(msg),
@@ -90,8 +90,9 @@ signal_handler(int signal)
             
         case SIGQUIT:
             /** Immediate shutdown request */
-            signal_ctx.shutdown_requested = 1;
-            system_exit = 1;
+            atomic_store(&signal_ctx.shutdown_requested, 1);
+            /** Same wakeup; SIGQUIT differs only in how it is logged */
+            librale_request_shutdown();
             snprintf(msg, sizeof(msg),
                      "Immediate shutdown initiated by SIGQUIT");
             raled_ereport(RALED_LOG_WARNING, "RALED", msg, NULL, NULL);
@@ -99,7 +100,7 @@ signal_handler(int signal)
             
         case SIGHUP:
             /** Configuration reload request */
-            signal_ctx.reload_requested = 1;
+            atomic_store(&signal_ctx.reload_requested, 1);
             snprintf(msg, sizeof(msg),
                      "Configuration reload requested by SIGHUP");
             raled_ereport(RALED_LOG_INFO, "RALED", msg, NULL, NULL);
@@ -107,7 +108,7 @@ signal_handler(int signal)
             
         case SIGUSR1:
             /** Status request */
-            signal_ctx.status_requested = 1;
+            atomic_store(&signal_ctx.status_requested, 1);
             snprintf(msg, sizeof(msg),
                      "Status report requested by SIGUSR1");
             raled_ereport(RALED_LOG_INFO, "RALED", msg, NULL, NULL);
@@ -144,7 +145,6 @@ signal_handler(int signal)
             break;
     }
     
-    pthread_mutex_unlock(&signal_ctx.mutex);
     errno = old_errno;
 }
 
@@ -158,12 +158,9 @@ setup_signal_handlers(void)
     int ret = 0;
     
     /** Initialize signal context */
-    memset(&signal_ctx, 0, sizeof(signal_ctx));
-    if (pthread_mutex_init(&signal_ctx.mutex, NULL) != 0) {
-        raled_ereport(RALED_LOG_ERROR, "RALED", 
-                      "Failed to initialize signal mutex", NULL, NULL);
-        return -1;
-    }
+    atomic_init(&signal_ctx.shutdown_requested, 0);
+    atomic_init(&signal_ctx.reload_requested, 0);
+    atomic_init(&signal_ctx.status_requested, 0);
     
     /** Register signal handlers */
     if (signal(SIGTERM, signal_handler) == SIG_ERR) {
@@ -223,11 +220,7 @@ setup_signal_handlers(void)
 int
 is_shutdown_requested(void)
 {
-    int result;
-    pthread_mutex_lock(&signal_ctx.mutex);
-    result = signal_ctx.shutdown_requested;
-    pthread_mutex_unlock(&signal_ctx.mutex);
-    return result;
+    return atomic_load(&signal_ctx.shutdown_requested);
 }
 
 /**
@@ -237,11 +230,7 @@ is_shutdown_requested(void)
 int
 is_reload_requested(void)
 {
-    int result;
-    pthread_mutex_lock(&signal_ctx.mutex);
-    result = signal_ctx.reload_requested;
-    pthread_mutex_unlock(&signal_ctx.mutex);
-    return result;
+    return atomic_load(&signal_ctx.reload_requested);
 }
 
 /**
@@ -251,11 +240,7 @@ is_reload_requested(void)
 int
 is_status_requested(void)
 {
-    int result;
-    pthread_mutex_lock(&signal_ctx.mutex);
-    result = signal_ctx.status_requested;
-    pthread_mutex_unlock(&signal_ctx.mutex);
-    return result;
+    return atomic_load(&signal_ctx.status_requested);
 }
 
 /**
@@ -264,9 +249,7 @@ is_status_requested(void)
 void
 clear_reload_request(void)
 {
-    pthread_mutex_lock(&signal_ctx.mutex);
-    signal_ctx.reload_requested = 0;
-    pthread_mutex_unlock(&signal_ctx.mutex);
+    atomic_store(&signal_ctx.reload_requested, 0);
 }
 
 /**
@@ -275,9 +258,7 @@ clear_reload_request(void)
 void
 clear_status_request(void)
 {
-    pthread_mutex_lock(&signal_ctx.mutex);
-    signal_ctx.status_requested = 0;
-    pthread_mutex_unlock(&signal_ctx.mutex);
+    atomic_store(&signal_ctx.status_requested, 0);
 }
 
 /**
@@ -286,7 +267,6 @@ clear_status_request(void)
 void
 cleanup_signal_handlers(void)
 {
-    pthread_mutex_destroy(&signal_ctx.mutex);
     raled_ereport(RALED_LOG_DEBUG, "RALED", 
                   "Signal handlers cleaned up", NULL, NULL);
 }
@@ -294,37 +274,35 @@ cleanup_signal_handlers(void)
 /**
  * Graceful shutdown function
  * Performs cleanup in the correct order
+ * Returns 0 if the main loop finished in time, -1 if it must be cancelled
  */
-void
+int
 graceful_shutdown(void)
 {
+    int result = 0;
+
     raled_ereport(RALED_LOG_INFO, "RALED", 
                   "Beginning graceful shutdown sequence...", NULL, NULL);
     
-    /** Set shutdown flag */
-    system_exit = 1;
+    /** Set shutdown flags and wake every loop (a no-op after a signal) */
+    librale_request_shutdown();
     
-    /** Wait for subsystems to finish (with timeout) */
+    /** The loop thread flushes the WAL and hands off leadership, then signals */
     raled_ereport(RALED_LOG_INFO, "RALED", 
                   "Waiting for subsystems to finish...", NULL, NULL);
     
-    /** Wait for all subsystems to complete shutdown */
-    int shutdown_wait_result = librale_wait_for_shutdown_completion(5); /* 5 second timeout */
-    if (shutdown_wait_result != 0)
+    if (librale_wait_for_shutdown_completion(SHUTDOWN_SUBSYSTEM_RALE, SHUTDOWN_TIMEOUT_MS) != 0)
     {
         raled_ereport(RALED_LOG_WARNING, "RALED", 
                       "Subsystem shutdown timeout reached", NULL, NULL);
+        result = -1;
     }
     
-    /** Give threads time to finish gracefully */
-    sleep(2);
-    
-    /** Force thread termination if they haven't finished */
+    /** Join threads that were started */
     if (server_thread != 0) {
         raled_ereport(RALED_LOG_INFO, "RALED", 
                       "Attempting to join server thread...", NULL, NULL);
         
-        /** Try to join with a short timeout */
         int join_result = pthread_join(server_thread, NULL);
         if (join_result != 0) {
             raled_ereport(RALED_LOG_WARNING, "RALED", 
@@ -339,7 +317,6 @@ graceful_shutdown(void)
         raled_ereport(RALED_LOG_INFO, "RALED", 
                       "Attempting to join client thread...", NULL, NULL);
         
-        /** Try to join with a short timeout */
         int join_result = pthread_join(client_thread, NULL);
         if (join_result != 0) {
             raled_ereport(RALED_LOG_WARNING, "RALED", 
@@ -352,4 +329,5 @@ graceful_shutdown(void)
     
     raled_ereport(RALED_LOG_INFO, "RALED", 
                   "Graceful shutdown completed", NULL, NULL);
+    return result;
 }